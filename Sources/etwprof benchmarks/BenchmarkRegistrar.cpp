@@ -0,0 +1,67 @@
+#include "BenchmarkRegistrar.hpp"
+
+namespace EPB {
+
+void Parameters::Set (const std::string& name, const std::string& value)
+{
+    m_values[name] = value;
+}
+
+uint64_t Parameters::GetUInt (const std::string& name, uint64_t defaultValue) const
+{
+    auto it = m_values.find (name);
+
+    return it == m_values.end () ? defaultValue : std::stoull (it->second, nullptr, 0);
+}
+
+double Parameters::GetDouble (const std::string& name, double defaultValue) const
+{
+    auto it = m_values.find (name);
+
+    return it == m_values.end () ? defaultValue : std::stod (it->second);
+}
+
+std::string Parameters::GetString (const std::string& name, const std::string& defaultValue) const
+{
+    auto it = m_values.find (name);
+
+    return it == m_values.end () ? defaultValue : it->second;
+}
+
+BenchmarkRegistrar& BenchmarkRegistrar::Instance ()
+{
+    static BenchmarkRegistrar instance;
+
+    return instance;
+}
+
+void BenchmarkRegistrar::Register (const std::string& name,
+                                   const std::string& description,
+                                   const Benchmark& benchmark)
+{
+    m_benchmarkMap[name] = { description, benchmark };
+}
+
+const BenchmarkRegistrar::Entry* BenchmarkRegistrar::Find (const std::string& name) const
+{
+    auto it = m_benchmarkMap.find (name);
+
+    return it == m_benchmarkMap.end () ? nullptr : &it->second;
+}
+
+void BenchmarkRegistrar::Enumerate (const Enumerator& enumerator) const
+{
+    for (auto& [name, entry] : m_benchmarkMap) {
+        if (!enumerator (name, entry))
+            return;
+    }
+}
+
+BenchmarkRegistrator::BenchmarkRegistrator (const std::string& name,
+                                            const std::string& description,
+                                            const Benchmark& benchmark)
+{
+    BenchmarkRegistrar::Instance ().Register (name, description, benchmark);
+}
+
+}   // namespace EPB
\ No newline at end of file
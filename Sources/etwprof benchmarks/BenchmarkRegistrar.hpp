@@ -0,0 +1,55 @@
+#ifndef EPB_BENCHMARK_REGISTRAR_HPP
+#define EPB_BENCHMARK_REGISTRAR_HPP
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace EPB {
+
+// Parameters of a benchmark run, given on the command line in a --name=value form
+class Parameters {
+public:
+    void Set (const std::string& name, const std::string& value);
+
+    uint64_t    GetUInt (const std::string& name, uint64_t defaultValue) const;
+    double      GetDouble (const std::string& name, double defaultValue) const;
+    std::string GetString (const std::string& name, const std::string& defaultValue) const;
+
+private:
+    std::map<std::string, std::string> m_values;
+};
+
+using Benchmark = std::function<bool (const Parameters&)>;
+
+class BenchmarkRegistrar {
+public:
+    struct Entry {
+        std::string description;
+        Benchmark   benchmark;
+    };
+
+    using Enumerator = std::function<bool (const std::string&, const Entry&)>;
+
+    static BenchmarkRegistrar& Instance ();
+
+    void Register (const std::string& name, const std::string& description, const Benchmark& benchmark);
+
+    const Entry* Find (const std::string& name) const;
+
+    void Enumerate (const Enumerator& enumerator) const;
+
+private:
+    std::map<std::string, Entry> m_benchmarkMap;
+};
+
+// Small helper class for registering benchmarks
+class BenchmarkRegistrator {
+public:
+    BenchmarkRegistrator (const std::string& name, const std::string& description, const Benchmark& benchmark);
+};
+
+}   // namespace EPB
+
+#endif  // #ifndef EPB_BENCHMARK_REGISTRAR_HPP
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "BenchmarkRegistrar.hpp"
+#include "SyntheticKernelStream.hpp"
+#include "Utility.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "OS/ETW/ETLReader.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/FileSystem/XZFileWriter.hpp"
+
+namespace EPB {
+namespace {
+
+// Feeds the same events to the callback on every call
+using EventSource = std::function<void (const std::function<void (const ETWP::EventView&)>&)>;
+
+struct WriteResult {
+    double   totalNs;
+    double   closeNs;
+    uint64_t nEventsWritten;
+    uint64_t nBytesWritten;
+    uint64_t nCompressedBytesWritten;
+};
+
+WriteResult WriteTrace (const std::filesystem::path& path,
+                        const ETWP::ETLWriterConfig& config,
+                        const EventSource& eventSource)
+{
+    WriteResult result = {};
+    try {
+        Stopwatch stopwatch;
+        ETWP::ETLWriter writer (path, config);
+        eventSource ([&] (const ETWP::EventView& event) { writer.WriteEvent (event); });
+
+        Stopwatch closeStopwatch;
+        std::wstring errorMsg;
+        if (!writer.Close (&errorMsg))
+            Fail ("Unable to finish ETL file: " + path.string ());
+
+        result.closeNs = closeStopwatch.GetElapsedNs ();
+        result.totalNs = stopwatch.GetElapsedNs ();
+        result.nEventsWritten = writer.GetStats ().nEventsWritten;
+        result.nBytesWritten = writer.GetStats ().nBytesWritten;
+        result.nCompressedBytesWritten = writer.GetStats ().nCompressedBytesWritten;
+    } catch (const ETWP::ETLWriter::InitException&) {
+        Fail ("Unable to create ETL file: " + path.string ());
+    }
+
+    return result;
+}
+
+void PrintModeResult (const char* mode, double ns, double closeNs, uint64_t size, uint64_t plainSize, double plainNs)
+{
+    std::printf ("  %-11s  %8.1f ms (finish %7.1f ms), %7.2f MB (%5.1f%%), %s\n",
+                 (std::string (mode) + ":").c_str (),
+                 ns / 1'000'000.0,
+                 closeNs / 1'000'000.0,
+                 size / (1'024.0 * 1'024.0),
+                 plainSize == 0 ? 0.0 : 100.0 * size / plainSize,
+                 FormatSpeedup (plainNs, ns).c_str ());
+}
+
+// Compares ways of producing a compressed ETL file, with the same events (of a synthetic kernel event stream, or of
+//   an existing trace with --input=<path>):
+//   - plain:    the ETL file is written uncompressed (the baseline)
+//   - postpass: the ETL file is written uncompressed, then compressed with one thread, like 7zr.exe used to do
+//               (LZMA2, preset 4). "finish" is the time spent after the last event
+//   - stream:   the ETL file is compressed by ETLWriter while it's being written (see XZFileWriter), on --xzthreads
+//               threads (one per processor, at most XZFileWriter::kMaxDefaultThreads by default)
+// Time spent generating (or decoding) the events is included in every mode, it's printed as "source" for reference.
+//   ETW's own buffer compression is only available on Windows, so it is not measured here
+bool CompressBenchmark (const Parameters& parameters)
+{
+    const std::string inputPath = parameters.GetString ("input", "");
+    const uint64_t nEvents = parameters.GetUInt ("events", 2'000'000);
+    const uint32_t preset = static_cast<uint32_t> (parameters.GetUInt ("preset", 4));
+    const uint32_t nXZThreads = static_cast<uint32_t> (parameters.GetUInt ("xzthreads", 0));
+    const SyntheticKernelStreamConfig config = SyntheticKernelStreamConfig::FromParameters (parameters);
+
+    if (preset > 9)
+        Fail ("Invalid preset!");
+
+    ETWP::ETLWriterConfig writerConfig;
+    writerConfig.numberOfProcessors = config.cpus;
+    writerConfig.loggerName = L"etwprof_bench";
+
+    std::unique_ptr<ETWP::ETLReader> reader;
+    EventSource eventSource;
+    if (!inputPath.empty ()) {
+        try {
+            reader = std::make_unique<ETWP::ETLReader> (inputPath);
+        } catch (const ETWP::ETLReader::InitException&) {
+            Fail ("Unable to open ETL file: " + inputPath);
+        }
+
+        writerConfig.numberOfProcessors = std::max<uint32_t> (reader->GetLogfileHeader ().m_numberOfProcessors, 1);
+        eventSource = [&] (const std::function<void (const ETWP::EventView&)>& callback) {
+            reader->ForEachEvent (callback);
+        };
+    } else {
+        // The stream is deterministic, so every mode gets the same events
+        eventSource = [&] (const std::function<void (const ETWP::EventView&)>& callback) {
+            SyntheticKernelStream stream (config);
+            SyntheticKernelStream::Chunk chunk;
+            for (uint64_t nGenerated = 0; nGenerated < nEvents; nGenerated += chunk.records.size ()) {
+                stream.GenerateChunk (static_cast<size_t> (std::min<uint64_t> (65'536, nEvents - nGenerated)),
+                                      &chunk);
+                for (const ETWP::EventRecordLayout& record : chunk.records)
+                    callback (ETWP::EventView (record));
+            }
+        };
+    }
+
+    const std::filesystem::path tempDir = std::filesystem::temp_directory_path ();
+    const std::filesystem::path plainPath = tempDir / "etwprof_bench_compress.etl";
+    const std::filesystem::path postPassPath = tempDir / "etwprof_bench_compress_postpass.etl.xz";
+    const std::filesystem::path streamPath = tempDir / "etwprof_bench_compress_stream.etl.xz";
+
+    Stopwatch stopwatch;
+    uint64_t nSourceEvents = 0;
+    eventSource ([&] (const ETWP::EventView&) { ++nSourceEvents; });
+    const double sourceNs = stopwatch.GetElapsedNs ();
+
+    const WriteResult plain = WriteTrace (plainPath, writerConfig, eventSource);
+
+    ETWP::XZFileWriterConfig postPassConfig;
+    postPassConfig.preset = preset;
+    postPassConfig.nThreads = 1;
+    stopwatch.Restart ();
+    std::wstring errorMsg;
+    if (!ETWP::CompressFileXZ (plainPath, postPassPath, postPassConfig, &errorMsg))
+        Fail ("Unable to compress ETL file: " + plainPath.string ());
+
+    const double postPassCompressNs = stopwatch.GetElapsedNs ();
+    const uint64_t postPassSize = std::filesystem::file_size (postPassPath);
+
+    ETWP::ETLWriterConfig streamConfig = writerConfig;
+    streamConfig.compress = true;
+    streamConfig.compression.preset = preset;
+    streamConfig.compression.nThreads = nXZThreads;
+    const WriteResult stream = WriteTrace (streamPath, streamConfig, eventSource);
+
+    PrintHeader ("Compression (" + std::to_string (plain.nEventsWritten) + " events, " +
+                 std::to_string (plain.nBytesWritten / (1'024 * 1'024)) + " MB, preset " + std::to_string (preset) +
+                 (inputPath.empty () ? "" : ", " + inputPath) + ")");
+    std::printf ("  source:       %8.1f ms (%llu events)\n",
+                 sourceNs / 1'000'000.0,
+                 static_cast<unsigned long long> (nSourceEvents));
+    PrintModeResult ("plain", plain.totalNs, plain.closeNs, plain.nBytesWritten, plain.nBytesWritten, plain.totalNs);
+    PrintModeResult ("postpass",
+                     plain.totalNs + postPassCompressNs,
+                     postPassCompressNs + plain.closeNs,
+                     postPassSize,
+                     plain.nBytesWritten,
+                     plain.totalNs);
+    PrintModeResult ("stream",
+                     stream.totalNs,
+                     stream.closeNs,
+                     stream.nCompressedBytesWritten,
+                     plain.nBytesWritten,
+                     plain.totalNs);
+    std::printf ("  stream vs. postpass: %s (finish: %s)\n",
+                 FormatSpeedup (plain.totalNs + postPassCompressNs, stream.totalNs).c_str (),
+                 FormatSpeedup (postPassCompressNs + plain.closeNs, stream.closeNs).c_str ());
+    std::printf ("  peak memory:  %.2f MB\n", GetPeakMemoryUsage () / (1'024.0 * 1'024.0));
+
+    reader.reset ();
+    for (const std::filesystem::path& path : { plainPath, postPassPath, streamPath }) {
+        std::error_code ec;
+        std::filesystem::remove (path, ec);
+    }
+
+    if (stream.nEventsWritten != plain.nEventsWritten || stream.nBytesWritten != plain.nBytesWritten)
+        Fail ("The compressed trace has different contents than the uncompressed one!");
+
+    if (stream.nCompressedBytesWritten == 0 || stream.nCompressedBytesWritten >= plain.nBytesWritten)
+        Fail ("The compressed trace is not smaller than the uncompressed one!");
+
+    return true;
+}
+
+BenchmarkRegistrator benchmarkRegistrator ("compress",
+                                           "Compressing ETL files after writing them vs. while writing them",
+                                           CompressBenchmark);
+
+}   // namespace
+}   // namespace EPB
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include "BenchmarkRegistrar.hpp"
+#include "Utility.hpp"
+
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "Profiler/EventDispatchTable.hpp"
+
+template<>
+struct std::hash<GUID> {
+    std::size_t operator() (const GUID& guid) const {
+        return guid.Data1 ^ (std::size_t (guid.Data2) << 32) ^ (std::size_t (guid.Data3) << 48);
+    }
+};
+
+namespace EPB {
+namespace {
+
+using ETWP::EventDispatchTable;
+using Handler = EventDispatchTable::Handler;
+
+constexpr size_t kNumberOfHandlers = size_t (Handler::UserProvider) + 1;
+
+// Compares the table-driven dispatch of the per-event filter with the if/else chain on provider IDs it replaced. Only
+//   the classification of events (finding the handler) is measured, the handlers themselves are the same for both.
+// The replayed events follow a "mix", i.e. a list of (provider ID, opcode, weight) triplets. The default mix resembles
+//   the event type distribution of a system-wide kernel session on a busy developer machine (with context switches,
+//   plus one user provider). The mix of a real recording can be supplied with --mix=<path>. Each line of such a file
+//   looks like this:
+//     <provider GUID> <opcode> <weight> [user]
+//   Where "user" marks providers that are enabled as user providers (--enable). Lines starting with '#' are ignored
+struct MixEntry {
+    GUID     providerID;
+    UCHAR    opcode;
+    uint32_t weight;
+    bool     userProvider;
+};
+
+struct Event {
+    GUID  providerID;
+    UCHAR opcode;
+};
+
+// {3d6fa8d4-fe05-11d0-9dda-00c04fd7ba7c}
+constexpr GUID kDiskIoGuid = { 0x3d6fa8d4, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+// {90cbdc39-4a3e-11d1-84f4-0000f80464e3}
+constexpr GUID kFileIoGuid = { 0x90cbdc39, 0x4a3e, 0x11d1, { 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3 } };
+// {3d6fa8d3-fe05-11d0-9dda-00c04fd7ba7c}
+constexpr GUID kPageFaultGuid = { 0x3d6fa8d3, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+// Made up user providers, one enabled, one not
+constexpr GUID kUserProviderGuid = { 0x1d1e4a8a, 0x6a1b, 0x4f3e, { 0x9c, 0x11, 0x5b, 0x2e, 0x70, 0x42, 0x13, 0x37 } };
+constexpr GUID kOtherProviderGuid = { 0x7e0a7c31, 0x2f61, 0x49b8, { 0xa1, 0x55, 0x0d, 0x6b, 0x94, 0x8e, 0x20, 0x11 } };
+
+const std::vector<MixEntry> kDefaultMix = {
+    { PerfInfoGuid,        ETWP::ETWConstants::SampledProfileOpcode, 3'000, false },
+    { StackWalkGuid,       ETWP::ETWConstants::StackWalkOpcode,      2'800, false },
+    { ThreadGuid,          ETWP::ETWConstants::CSwitchOpcode,        1'500, false },
+    { ThreadGuid,          ETWP::ETWConstants::ReadyThreadOpcode,      700, false },
+    { PerfInfoGuid,        66 /* DPC */,                               400, false },
+    { PerfInfoGuid,        67 /* ISR */,                               200, false },
+    { PerfInfoGuid,        68 /* Timer DPC */,                         150, false },
+    { kFileIoGuid,         64 /* Create */,                            250, false },
+    { kFileIoGuid,         67 /* Read */,                              150, false },
+    { kDiskIoGuid,         10 /* Read */,                              150, false },
+    { kDiskIoGuid,         11 /* Write */,                             150, false },
+    { kPageFaultGuid,      10 /* Transition fault */,                  100, false },
+    { kUserProviderGuid,   0,                                          200, true  },
+    { kOtherProviderGuid,  0,                                          150, false },
+    { ThreadGuid,          ETWP::ETWConstants::TStartOpcode,            20, false },
+    { ThreadGuid,          ETWP::ETWConstants::TEndOpcode,              20, false },
+    { ImageLoadGuid,       10 /* Load */,                               20, false },
+    { ProcessGuid,         ETWP::ETWConstants::PStartOpcode,             5, false },
+    { ProcessGuid,         ETWP::ETWConstants::PEndOpcode,               5, false },
+    { EventTraceEventGuid, 0 /* Header */,                               5, false }
+};
+
+bool ParseGUID (const std::string& string, GUID* pGUIDOut)
+{
+    unsigned int data1, data2, data3, data4[8];
+    const int nParsed = std::sscanf (string.c_str (),
+                                     "%8x-%4x-%4x-%2x%2x-%2x%2x%2x%2x%2x%2x",
+                                     &data1,
+                                     &data2,
+                                     &data3,
+                                     &data4[0], &data4[1], &data4[2], &data4[3],
+                                     &data4[4], &data4[5], &data4[6], &data4[7]);
+    if (nParsed != 11)
+        return false;
+
+    pGUIDOut->Data1 = data1;
+    pGUIDOut->Data2 = static_cast<uint16_t> (data2);
+    pGUIDOut->Data3 = static_cast<uint16_t> (data3);
+    for (size_t i = 0; i < 8; ++i)
+        pGUIDOut->Data4[i] = static_cast<uint8_t> (data4[i]);
+
+    return true;
+}
+
+std::vector<MixEntry> LoadMix (const std::string& path)
+{
+    std::ifstream file (path);
+    if (!file)
+        Fail ("Unable to open mix file: " + path);
+
+    std::vector<MixEntry> mix;
+    std::string line;
+    while (std::getline (file, line)) {
+        if (line.empty () || line[0] == '#')
+            continue;
+
+        std::istringstream lineStream (line);
+        std::string guidString;
+        unsigned int opcode = 0;
+        uint32_t weight = 0;
+        std::string userMarker;
+        const bool valid = bool (lineStream >> guidString >> opcode >> weight);
+        lineStream >> userMarker;
+
+        MixEntry entry = {};
+        if (!valid || !ParseGUID (guidString, &entry.providerID) || opcode > 255)
+            Fail ("Invalid line in mix file: \"" + line + "\"");
+
+        entry.opcode = static_cast<UCHAR> (opcode);
+        entry.weight = weight;
+        entry.userProvider = userMarker == "user";
+        mix.push_back (entry);
+    }
+
+    if (mix.empty ())
+        Fail ("Mix file is empty: " + path);
+
+    return mix;
+}
+
+std::vector<Event> GenerateEvents (const std::vector<MixEntry>& mix, uint64_t count, Random& random)
+{
+    uint64_t totalWeight = 0;
+    for (const MixEntry& entry : mix)
+        totalWeight += entry.weight;
+
+    std::vector<Event> events;
+    events.reserve (count);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t pick = random.NextBelow (totalWeight);
+        for (const MixEntry& entry : mix) {
+            if (pick < entry.weight) {
+                events.push_back ({ entry.providerID, entry.opcode });
+                break;
+            }
+
+            pick -= entry.weight;
+        }
+    }
+
+    return events;
+}
+
+// This is what FilterEventForProfiling did before EventDispatchTable
+Handler ClassifyWithIfElseChain (const Event& event, bool cswitch, const std::unordered_set<GUID>& userProviderIDs)
+{
+    using namespace ETWP::ETWConstants;
+
+    if (event.providerID == StackWalkGuid) {
+        return Handler::StackWalk;
+    } else if (event.providerID == PerfInfoGuid && event.opcode == SampledProfileOpcode) {
+        return Handler::SampledProfile;
+    } else if (event.providerID == ThreadGuid) {
+        if (event.opcode == TStartOpcode   ||
+            event.opcode == TDCStartOpcode ||
+            event.opcode == TEndOpcode     ||
+            event.opcode == TDCEndOpcode)
+        {
+            return Handler::Thread;
+        } else if (cswitch) {
+            if (event.opcode == ReadyThreadOpcode || event.opcode == CSwitchOpcode)
+                return Handler::ContextSwitch;
+        }
+    } else if (event.providerID == ProcessGuid) {
+        return Handler::Process;
+    } else if (event.providerID == ImageLoadGuid) {
+        return Handler::ImageLoad;
+    } else if (event.providerID == EventTraceEventGuid) {
+        return Handler::Keep;
+    } else if (userProviderIDs.contains (event.providerID)) {
+        return Handler::UserProvider;
+    }
+
+    return Handler::Drop;
+}
+
+template<typename ClassifyFunc>
+double MeasureDispatch (const std::vector<Event>& events,
+                        uint64_t rounds,
+                        ClassifyFunc classify,
+                        std::array<uint64_t, kNumberOfHandlers>* pHistogramOut)
+{
+    pHistogramOut->fill (0);
+
+    Stopwatch stopwatch;
+    for (uint64_t round = 0; round < rounds; ++round) {
+        for (const Event& event : events)
+            ++(*pHistogramOut)[size_t (classify (event))];
+    }
+
+    return stopwatch.GetElapsedNs () / (rounds * events.size ());
+}
+
+bool DispatchBenchmark (const Parameters& parameters)
+{
+    const uint64_t nEvents = parameters.GetUInt ("events", 1'000'000);
+    const uint64_t rounds = parameters.GetUInt ("rounds", 20);
+    const bool cswitch = parameters.GetUInt ("cswitch", 1) != 0;
+    const std::string mixPath = parameters.GetString ("mix", "");
+
+    if (nEvents == 0 || rounds == 0)
+        Fail ("Invalid event or round count!");
+
+    const std::vector<MixEntry> mix = mixPath.empty () ? kDefaultMix : LoadMix (mixPath);
+
+    Random random (parameters.GetUInt ("seed", 13));
+    const std::vector<Event> events = GenerateEvents (mix, nEvents, random);
+
+    std::unordered_set<GUID> userProviderSet;
+    std::vector<GUID> userProviderIDs;
+    for (const MixEntry& entry : mix) {
+        if (entry.userProvider && userProviderSet.insert (entry.providerID).second)
+            userProviderIDs.push_back (entry.providerID);
+    }
+
+    const EventDispatchTable table = ETWP::CreateProfileDispatchTable (cswitch, userProviderIDs);
+
+    PrintHeader ("Event dispatch (" + std::to_string (nEvents) + " events from a mix of " +
+                 std::to_string (mix.size ()) + " event types, " + std::to_string (rounds) + " rounds)");
+
+    std::array<uint64_t, kNumberOfHandlers> chainHistogram;
+    const double chainNs = MeasureDispatch (events, rounds, [&] (const Event& event) {
+        return ClassifyWithIfElseChain (event, cswitch, userProviderSet);
+    }, &chainHistogram);
+
+    std::array<uint64_t, kNumberOfHandlers> tableHistogram;
+    const double tableNs = MeasureDispatch (events, rounds, [&table] (const Event& event) {
+        return table.GetHandler (event.providerID, event.opcode);
+    }, &tableHistogram);
+
+    if (chainHistogram != tableHistogram)
+        Fail ("The if/else chain and EventDispatchTable disagree on the handlers of events!");
+
+    PrintResult ("dispatch (if/else chain)", chainNs);
+    PrintResult ("dispatch (EventDispatchTable)", tableNs, FormatSpeedup (chainNs, tableNs));
+
+    std::printf ("  EventDispatchTable: %zu providers in %zu slots, %.1f%% of events dropped\n",
+                 table.GetNumberOfProviders (),
+                 table.GetSize (),
+                 100.0 * tableHistogram[size_t (Handler::Drop)] / (rounds * events.size ()));
+
+    return true;
+}
+
+BenchmarkRegistrator benchmarkRegistrator ("dispatch",
+                                           "Per-event handler lookup (EventDispatchTable vs. if/else chain)",
+                                           DispatchBenchmark);
+
+}   // namespace
+}   // namespace EPB
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "BenchmarkRegistrar.hpp"
+#include "SyntheticKernelStream.hpp"
+#include "Utility.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <climits>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "OS/ETW/ETLReader.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/ParallelETLDecoder.hpp"
+
+namespace EPB {
+namespace {
+
+struct EventTypeCount {
+    GUID     providerID;
+    UCHAR    opcode;
+    uint64_t count;
+};
+
+// Per-event work: timestamps and payload sizes are summed, so decoding cannot be optimized away (payloads are not
+//   touched, though). Padded to a cache line, as each worker has its own
+struct alignas (64) Totals {
+    uint64_t nEvents = 0;
+    uint64_t checksum = 0;
+
+    void Add (const ETWP::EventView& event)
+    {
+        ++nEvents;
+        checksum += event.GetTimestamp () + event.GetUserDataLength ();
+    }
+
+    void Merge (const Totals& other)
+    {
+        nEvents += other.nEvents;
+        checksum += other.checksum;
+    }
+
+    bool operator== (const Totals& rhs) const
+    {
+        return nEvents == rhs.nEvents && checksum == rhs.checksum;
+    }
+};
+
+void PrintModeResult (const char* mode, const Totals& totals, uint64_t fileSize, double ns, double serialNs)
+{
+    std::printf ("  %-11s  %.1f MB/s, %.2f M events/s (%s, checksum %016llx)\n",
+                 (std::string (mode) + ":").c_str (),
+                 fileSize / (1'024.0 * 1'024.0) / (ns / 1'000'000'000.0),
+                 totals.nEvents / ns * 1'000.0,
+                 FormatSpeedup (serialNs, ns).c_str (),
+                 static_cast<unsigned long long> (totals.checksum));
+}
+
+// Writes nEvents events of a synthetic kernel event stream into an ETL file. Returns the number of events written
+uint64_t GenerateTrace (const std::filesystem::path& path,
+                        const SyntheticKernelStreamConfig& config,
+                        uint64_t nEvents)
+{
+    ETWP::ETLWriterConfig writerConfig;
+    writerConfig.numberOfProcessors = config.cpus;
+    writerConfig.loggerName = L"etwprof_bench";
+
+    SyntheticKernelStream stream (config);
+    SyntheticKernelStream::Chunk chunk;
+    try {
+        ETWP::ETLWriter writer (path, writerConfig);
+        for (uint64_t nGenerated = 0; nGenerated < nEvents; nGenerated += chunk.records.size ()) {
+            stream.GenerateChunk (static_cast<size_t> (std::min<uint64_t> (65'536, nEvents - nGenerated)), &chunk);
+            for (const ETWP::EventRecordLayout& record : chunk.records)
+                writer.WriteEvent (ETWP::EventView (record));
+        }
+
+        std::wstring errorMsg;
+        if (!writer.Close (&errorMsg))
+            Fail ("Unable to finish ETL file: " + path.string ());
+
+        return writer.GetStats ().nEventsWritten;
+    } catch (const ETWP::ETLWriter::InitException&) {
+        Fail ("Unable to create ETL file: " + path.string ());
+    }
+}
+
+// Decodes every event of an ETL file with ETLReader: serially, then with ParallelETLDecoder (--workers=<n>, one per
+//   processor by default), both unordered and ordered. Without --input=<path>, a trace of a synthetic kernel event
+//   stream is written first (into --etl=<path>, or a temporary file), and the number of events read back is checked.
+//   The results of the parallel modes are checked against the serial one.
+// With --dump=1, the number of events per provider and opcode is printed as well
+bool ETLReadBenchmark (const Parameters& parameters)
+{
+    const std::string inputPath = parameters.GetString ("input", "");
+    const uint64_t nEvents = parameters.GetUInt ("events", 5'000'000);
+    const std::string etlPath = parameters.GetString ("etl", "");
+    const bool dump = parameters.GetUInt ("dump", 0) != 0;
+
+    // The logfile header is read as an event, too
+    std::filesystem::path path = inputPath;
+    uint64_t nExpected = 0;
+    const bool temporary = inputPath.empty () && etlPath.empty ();
+    if (inputPath.empty ()) {
+        path = temporary ? std::filesystem::temp_directory_path () / "etwprof_bench_etlread.etl" :
+                           std::filesystem::path (etlPath);
+        nExpected = GenerateTrace (path, SyntheticKernelStreamConfig::FromParameters (parameters), nEvents) + 1;
+    }
+
+    std::unique_ptr<ETWP::ETLReader> reader;
+    Stopwatch stopwatch;
+    try {
+        reader = std::make_unique<ETWP::ETLReader> (path);
+    } catch (const ETWP::ETLReader::InitException&) {
+        Fail ("Unable to open ETL file: " + path.string ());
+    }
+
+    const double openNs = stopwatch.GetElapsedNs ();
+    const uint64_t fileSize = reader->GetFileSize ();
+    const size_t nBuffers = reader->GetNumberOfBuffers ();
+    ETWP::ParallelETLDecoder decoder (*reader, static_cast<uint32_t> (parameters.GetUInt ("workers", 0)));
+
+    PrintHeader ("ETL reading (" + std::to_string (fileSize / (1'024 * 1'024)) + " MB, " + std::to_string (nBuffers) +
+                 " buffers, " + std::to_string (decoder.GetNumberOfThreads ()) + " threads)");
+    std::printf ("  open:        %.2f ms\n", openNs / 1'000'000.0);
+
+    // Serial
+    stopwatch.Restart ();
+    Totals serialTotals;
+    uint64_t nCompressedBuffers = 0;
+    std::vector<EventTypeCount> eventTypeCounts;
+    for (size_t i = 0; i < nBuffers; ++i) {
+        const ETWP::ETLBufferView buffer = reader->GetBuffer (i);
+        nCompressedBuffers += buffer.IsCompressed ();
+
+        for (const ETWP::EventView& event : buffer) {
+            serialTotals.Add (event);
+            if (!dump)
+                continue;
+
+            const auto matches = [&event] (const EventTypeCount& c) {
+                return c.providerID == event.GetProviderID () && c.opcode == event.GetOpcode ();
+            };
+
+            auto it = std::find_if (eventTypeCounts.begin (), eventTypeCounts.end (), matches);
+            if (it == eventTypeCounts.end ())
+                it = eventTypeCounts.insert (it, { event.GetProviderID (), event.GetOpcode (), 0 });
+
+            ++it->count;
+        }
+    }
+
+    const double serialNs = stopwatch.GetElapsedNs ();
+    PrintModeResult ("serial", serialTotals, fileSize, serialNs, serialNs);
+
+    // Unordered, aggregated per worker
+    stopwatch.Restart ();
+    std::vector<Totals> workerTotals (decoder.GetNumberOfThreads ());
+    decoder.ForEachBufferUnordered ([&workerTotals] (uint32_t workerIndex, const ETWP::ETLBufferView& buffer) {
+        Totals& totals = workerTotals[workerIndex];
+        for (const ETWP::EventView& event : buffer)
+            totals.Add (event);
+    });
+
+    Totals unorderedTotals;
+    for (const Totals& totals : workerTotals)
+        unorderedTotals.Merge (totals);
+
+    PrintModeResult ("unordered", unorderedTotals, fileSize, stopwatch.GetElapsedNs (), serialNs);
+    std::printf ("               %llu steals\n", static_cast<unsigned long long> (decoder.GetStats ().nSteals));
+
+    // Ordered
+    stopwatch.Restart ();
+    Totals orderedTotals;
+    int64_t lastTimeStamp = INT64_MIN;
+    uint64_t nOutOfOrder = 0;
+    decoder.ForEachEventOrdered ([&] (const ETWP::EventView& event) {
+        orderedTotals.Add (event);
+        nOutOfOrder += event.GetTimestamp () < lastTimeStamp;
+        lastTimeStamp = event.GetTimestamp ();
+    });
+
+    PrintModeResult ("ordered", orderedTotals, fileSize, stopwatch.GetElapsedNs (), serialNs);
+    std::printf ("               %llu of %llu buffers decoded ahead\n",
+                 static_cast<unsigned long long> (decoder.GetStats ().nBuffersDecodedAhead),
+                 static_cast<unsigned long long> (nBuffers));
+
+    if (nCompressedBuffers > 0)
+        std::printf ("  skipped:     %llu compressed buffers\n", static_cast<unsigned long long> (nCompressedBuffers));
+
+    if (dump) {
+        const auto isMoreFrequent = [] (const EventTypeCount& lhs, const EventTypeCount& rhs) {
+            return lhs.count > rhs.count;
+        };
+
+        std::sort (eventTypeCounts.begin (), eventTypeCounts.end (), isMoreFrequent);
+
+        for (const EventTypeCount& c : eventTypeCounts) {
+            std::printf ("  %08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x  opcode %3u: %llu\n",
+                         c.providerID.Data1, c.providerID.Data2, c.providerID.Data3,
+                         c.providerID.Data4[0], c.providerID.Data4[1], c.providerID.Data4[2], c.providerID.Data4[3],
+                         c.providerID.Data4[4], c.providerID.Data4[5], c.providerID.Data4[6], c.providerID.Data4[7],
+                         c.opcode,
+                         static_cast<unsigned long long> (c.count));
+        }
+    }
+
+    reader.reset ();
+    if (temporary) {
+        std::error_code ec;
+        std::filesystem::remove (path, ec);
+    }
+
+    if (nExpected != 0 && serialTotals.nEvents != nExpected) {
+        Fail ("Read " + std::to_string (serialTotals.nEvents) + " events instead of " + std::to_string (nExpected) +
+              "!");
+    }
+
+    if (!(unorderedTotals == serialTotals) || !(orderedTotals == serialTotals))
+        Fail ("Parallel decoding gave different results than serial decoding!");
+
+    if (nOutOfOrder != 0)
+        Fail ("Ordered decoding delivered " + std::to_string (nOutOfOrder) + " events out of order!");
+
+    return true;
+}
+
+BenchmarkRegistrator benchmarkRegistrator ("etlread",
+                                           "Decoding throughput of ETL files (of a synthetic trace by default)",
+                                           ETLReadBenchmark);
+
+}   // namespace
+}   // namespace EPB
\ No newline at end of file
@@ -0,0 +1,325 @@
+#include "BenchmarkRegistrar.hpp"
+#include "SyntheticKernelStream.hpp"
+#include "Utility.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/Process/ProcessLifetimeEventSource.hpp"
+#include "Profiler/FilterStats.hpp"
+#include "Profiler/ProfileFilter.hpp"
+#include "Profiler/ProgressCounters.hpp"
+#include "Profiler/RelogPipeline.hpp"
+#include "Profiler/ReorderWindow.hpp"
+
+namespace EPB {
+namespace {
+
+// Stand-in for the output path of the relogger: kept events (header and payload) are copied into ETW-sized buffers,
+//   full buffers are "flushed" (i.e. reused). This way, the cost of touching the payload of kept events is measured
+class OutputSink final : public ETWP::IEventSink {
+public:
+    static constexpr size_t kBufferSize = 64 * 1'024;
+
+    OutputSink (): m_buffer (kBufferSize), m_used (0), m_bytesWritten (0), m_nEvents (0)
+    {
+    }
+
+    virtual bool WriteEvent (const ETWP::EventView& event) override
+    {
+        const size_t size = sizeof (ETWP::EventHeaderLayout) + event.GetUserDataLength ();
+        if (m_used + size > m_buffer.size ())
+            m_used = 0;     // "Flush"
+
+        std::memcpy (m_buffer.data () + m_used, &event.GetRecord ().m_header, sizeof (ETWP::EventHeaderLayout));
+        std::memcpy (m_buffer.data () + m_used + sizeof (ETWP::EventHeaderLayout),
+                     event.GetUserData (),
+                     event.GetUserDataLength ());
+
+        m_used += (size + 7) & ~size_t (7);
+        m_bytesWritten += size;
+        ++m_nEvents;
+
+        return true;
+    }
+
+    uint64_t GetBytesWritten () const { return m_bytesWritten; }
+    uint64_t GetNumberOfEvents () const { return m_nEvents; }
+
+private:
+    std::vector<uint8_t> m_buffer;
+    size_t               m_used;
+    uint64_t             m_bytesWritten;
+    uint64_t             m_nEvents;
+};
+
+// Writes kept events into a real ETL file
+class ETLSink final : public ETWP::IEventSink {
+public:
+    ETLSink (const std::string& path, const SyntheticKernelStreamConfig& config):
+        m_writer (path, GetWriterConfig (config))
+    {
+    }
+
+    virtual bool WriteEvent (const ETWP::EventView& event) override
+    {
+        return m_writer.WriteEvent (event);
+    }
+
+    ETWP::ETLWriter& GetWriter () { return m_writer; }
+
+private:
+    ETWP::ETLWriter m_writer;
+
+    static ETWP::ETLWriterConfig GetWriterConfig (const SyntheticKernelStreamConfig& config)
+    {
+        ETWP::ETLWriterConfig writerConfig;
+        writerConfig.numberOfProcessors = config.cpus;
+        writerConfig.loggerName = L"etwprof_bench";
+
+        return writerConfig;
+    }
+};
+
+// Drives the per-event filter (FilterEventForProfiling, and through it ThreadRegistry, IDRegistry and
+//   EventDispatchTable) and the output path with a synthetic kernel event stream, at full speed. Events are generated
+//   in chunks beforehand, so generation is not measured. Timing is done for batches of events (timing each event
+//   would distort the results), so percentiles are of the per-event average of batches.
+// With --pipeline=1, kept events are written through a RelogPipeline (i.e. on a separate thread), like etwprof does
+//   with --pipeline. Then only the consuming side is timed.
+// With --etl=<path>, kept events are written into an ETL file with ETLWriter, instead of the stand-in output
+// With --stats=1, events are counted per category (see FilterStats), like etwprof does, to measure the overhead of that
+// With --progress=1, events are also counted for progress reporting (see ProgressCounters), and another thread samples
+//   the counters every millisecond (much more often than etwprof does), to measure the overhead of that
+// With --reorder=<ms>, events of unknown threads are held back in a ReorderWindow, like etwprof does with --reorder
+bool FilterBenchmark (const Parameters& parameters)
+{
+    const uint64_t nEvents = parameters.GetUInt ("events", 5'000'000);
+    const uint64_t chunkSize = parameters.GetUInt ("chunk", 65'536);
+    const uint64_t batchSize = parameters.GetUInt ("batch", 256);
+    const bool usePipeline = parameters.GetUInt ("pipeline", 0) != 0;
+    const uint64_t queueCapacity = parameters.GetUInt ("queuesize", ETWP::RelogPipeline::kDefaultQueueCapacity);
+    const std::string etlPath = parameters.GetString ("etl", "");
+    const bool collectStats = parameters.GetUInt ("stats", 0) != 0;
+    const bool countProgress = parameters.GetUInt ("progress", 0) != 0;
+    const uint64_t reorderWindow = parameters.GetUInt ("reorder", 0);
+    const SyntheticKernelStreamConfig config = SyntheticKernelStreamConfig::FromParameters (parameters);
+
+    if (nEvents == 0 || chunkSize == 0 || batchSize == 0)
+        Fail ("Invalid event, chunk or batch count!");
+
+    if (reorderWindow != 0 && usePipeline)
+        Fail ("The reorder window can't be used with the pipeline!");
+
+    SyntheticKernelStream stream (config);
+
+    ETWP::ProfileFilterData filterData = { {},
+                                           stream.GetEnabledUserProviderIDs (),
+                                           {},
+                                           { stream.GetTargetPID () },
+                                           config.cswitchRatio > 0,
+                                           false,
+                                           {} };
+    ETWP::PrepareForProfiling (&filterData);
+
+    ETWP::ProcessLifetimeEventSource processLifetimeEventSource;
+    OutputSink outputSink;
+    std::unique_ptr<ETLSink> etlSink;
+    if (!etlPath.empty ()) {
+        try {
+            etlSink = std::make_unique<ETLSink> (etlPath, config);
+        } catch (const ETWP::ETLWriter::InitException&) {
+            Fail ("Unable to create ETL file: " + etlPath);
+        }
+    }
+
+    ETWP::IEventSink& sink = etlSink != nullptr ? static_cast<ETWP::IEventSink&> (*etlSink) : outputSink;
+    std::unique_ptr<ETWP::RelogPipeline> pipeline;
+    if (usePipeline)
+        pipeline = std::make_unique<ETWP::RelogPipeline> (&sink, static_cast<size_t> (queueCapacity));
+
+    // Synthetic timestamps are in 100 ns units
+    std::unique_ptr<ETWP::ReorderWindow> reorder;
+    if (reorderWindow != 0) {
+        reorder = std::make_unique<ETWP::ReorderWindow> (&sink,
+                                                         ETWP::ReorderWindowConfig { uint32_t (reorderWindow) },
+                                                         10'000'000);
+        filterData.pReorderWindow = reorder.get ();
+        filterData.otherThreads.SetTimestampFrequency (10'000'000);
+    }
+
+    PrintHeader ("Filter throughput (" + std::to_string (config.threads) + " threads, " +
+                 std::to_string (config.cpus) + " CPUs, stack depth " + std::to_string (config.stackDepth) +
+                 (stream.UsesStackCache () ? ", " + std::to_string (config.stackKeys) + " stack keys" : "") +
+                 (usePipeline ? ", pipelined" : "") + (etlSink != nullptr ? ", ETL output" : "") +
+                 (collectStats ? ", filter statistics" : "") + (countProgress ? ", progress counters" : "") +
+                 (reorder != nullptr ? ", reorder window " + std::to_string (reorderWindow) + " ms" : "") + ")");
+
+    ETWP::ProgressCounters progress;
+    std::atomic<bool> samplingDone = false;
+    uint64_t nProgressSamples = 0;
+    std::thread samplerThread;
+    if (countProgress) {
+        samplerThread = std::thread ([&] () {
+            while (!samplingDone.load ()) {
+                progress.Sample ();
+                ++nProgressSamples;
+                std::this_thread::sleep_for (std::chrono::milliseconds (1));
+            }
+        });
+    }
+
+    ETWP::FilterStats filterStats;
+    if (reorder != nullptr)
+        reorder->SetCounters (collectStats ? &filterStats : nullptr, countProgress ? &progress : nullptr);
+
+    SyntheticKernelStream::Chunk chunk;
+    std::vector<double> batchNsPerEvent;
+    std::vector<uint8_t> decisions;
+    uint64_t nProcessed = 0;
+    uint64_t nKept = 0;
+    uint64_t nMismatches = 0;
+    double totalNs = 0;
+
+    while (nProcessed < nEvents) {
+        stream.GenerateChunk (static_cast<size_t> (std::min (chunkSize, nEvents - nProcessed)), &chunk);
+        decisions.resize (chunk.records.size ());
+
+        for (size_t batchStart = 0; batchStart < chunk.records.size (); batchStart += batchSize) {
+            const size_t batchEnd = std::min<size_t> (batchStart + batchSize, chunk.records.size ());
+
+            Stopwatch stopwatch;
+            for (size_t i = batchStart; i < batchEnd; ++i) {
+                const ETWP::EventView event (chunk.records[i]);
+                const auto filter = [&] () {
+                    return ETWP::FilterEventForProfiling (event, &filterData, &processLifetimeEventSource);
+                };
+                const bool keep = collectStats ? ETWP::FilterAndCount (event, &filterStats, filter) : filter ();
+                if (countProgress) {
+                    progress.AddEvent (keep);
+                    if (pipeline != nullptr && progress.ShouldSampleQueue ())
+                        progress.SetQueuedBytes (pipeline->GetQueuedSize ());
+                }
+
+                if (keep) {
+                    if (pipeline != nullptr)
+                        pipeline->Enqueue (event);
+                    else if (reorder != nullptr)
+                        reorder->WriteEvent (event);
+                    else
+                        sink.WriteEvent (event);
+                }
+
+                decisions[i] = keep;
+                nKept += keep;
+            }
+
+            const double elapsedNs = stopwatch.GetElapsedNs ();
+            totalNs += elapsedNs;
+            batchNsPerEvent.push_back (elapsedNs / (batchEnd - batchStart));
+        }
+
+        for (size_t i = 0; i < chunk.records.size (); ++i) {
+            const SyntheticKernelStream::Expectation expectation = chunk.expectations[i];
+            if (expectation != SyntheticKernelStream::Expectation::Unknown &&
+                (expectation == SyntheticKernelStream::Expectation::Keep) != bool (decisions[i]))
+            {
+                ++nMismatches;
+            }
+        }
+
+        nProcessed += chunk.records.size ();
+    }
+
+    if (pipeline != nullptr)
+        pipeline->Finish ();
+
+    if (reorder != nullptr)
+        reorder->Flush ();
+
+    if (countProgress) {
+        samplingDone = true;
+        samplerThread.join ();
+    }
+
+    uint64_t bytesWritten = outputSink.GetBytesWritten ();
+    uint64_t nEventsWritten = outputSink.GetNumberOfEvents ();
+    if (etlSink != nullptr) {
+        std::wstring errorMsg;
+        if (!etlSink->GetWriter ().Close (&errorMsg))
+            Fail ("Unable to finish ETL file: " + etlPath);
+
+        const ETWP::ETLWriter::Stats stats = etlSink->GetWriter ().GetStats ();
+        bytesWritten = stats.nBytesWritten;
+        nEventsWritten = stats.nEventsWritten;
+    }
+
+    std::printf ("  events:      %llu (%.1f%% kept)\n",
+                 static_cast<unsigned long long> (nProcessed),
+                 100.0 * nKept / nProcessed);
+    std::printf ("  throughput:  %.2f M events/s\n", nProcessed / totalNs * 1'000.0);
+    std::printf ("  ns/event:    avg %.2f, p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f\n",
+                 totalNs / nProcessed,
+                 GetPercentile (&batchNsPerEvent, 50),
+                 GetPercentile (&batchNsPerEvent, 90),
+                 GetPercentile (&batchNsPerEvent, 99),
+                 GetPercentile (&batchNsPerEvent, 99.9),
+                 GetPercentile (&batchNsPerEvent, 100));
+    std::printf ("  output:      %.2f MB (%.1f bytes/kept event)\n",
+                 bytesWritten / (1'024.0 * 1'024.0),
+                 nEventsWritten == 0 ? 0.0 : double (bytesWritten) / nEventsWritten);
+    if (pipeline != nullptr) {
+        const ETWP::RelogPipelineStats stats = pipeline->GetStats ();
+        std::printf ("  pipeline:    %llu dropped, queue high-water mark %.2f MB (of %.2f MB)\n",
+                     static_cast<unsigned long long> (stats.nDropped),
+                     stats.queueHighWaterMark / (1'024.0 * 1'024.0),
+                     stats.queueCapacity / (1'024.0 * 1'024.0));
+    }
+
+    if (collectStats) {
+        std::printf ("  statistics:  %zu categories, filter time %.2f ns/event (estimated)\n",
+                     filterStats.GetCategories ().size (),
+                     double (filterStats.GetEstimatedFilterTime ()) / nProcessed);
+    }
+
+    if (countProgress) {
+        std::printf ("  progress:    %llu samples taken, %llu events counted\n",
+                     static_cast<unsigned long long> (nProgressSamples),
+                     static_cast<unsigned long long> (progress.Sample ().nEvents));
+    }
+
+    if (reorder != nullptr) {
+        const ETWP::ReorderWindow::Stats stats = reorder->GetStats ();
+        std::printf ("  reorder:     %llu held, %llu recovered, %llu rejected, %llu expired, %llu evicted, "
+                     "%llu queued, high-water mark %.2f MB\n",
+                     static_cast<unsigned long long> (stats.nHeld),
+                     static_cast<unsigned long long> (stats.nRecovered),
+                     static_cast<unsigned long long> (stats.nRejected),
+                     static_cast<unsigned long long> (stats.nExpired),
+                     static_cast<unsigned long long> (stats.nEvicted),
+                     static_cast<unsigned long long> (stats.nQueued),
+                     stats.highWaterMark / (1'024.0 * 1'024.0));
+    }
+
+    std::printf ("  peak memory: %.2f MB\n", GetPeakMemoryUsage () / (1'024.0 * 1'024.0));
+
+    if (nMismatches != 0)
+        Fail ("The filter made " + std::to_string (nMismatches) + " unexpected decisions!");
+
+    return true;
+}
+
+BenchmarkRegistrator benchmarkRegistrator ("filter",
+                                           "Per-event filter and output throughput on a synthetic kernel event stream",
+                                           FilterBenchmark);
+
+}   // namespace
+}   // namespace EPB
\ No newline at end of file
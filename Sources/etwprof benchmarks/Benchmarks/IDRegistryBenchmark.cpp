@@ -0,0 +1,150 @@
+#include "BenchmarkRegistrar.hpp"
+#include "Utility.hpp"
+
+#include <cstdio>
+#include <unordered_set>
+#include <vector>
+
+#include "Profiler/IDRegistry.hpp"
+
+namespace EPB {
+namespace {
+
+// Compares IDRegistry with std::unordered_set, which was used for thread and process bookkeeping by the filter
+//   previously. The lookup stream mimics SampledProfile/CSwitch events of a busy machine: most events belong to
+//   threads that are *not* of interest
+struct IDRegistryBenchmarkConfig {
+    uint64_t liveThreads;   // Number of threads alive system-wide
+    uint64_t targetThreads; // Number of threads of the profiled process(es)
+    uint64_t lookups;
+    double   hitRatio;      // Ratio of lookups that refer to a target thread
+    uint64_t churnCycles;   // Add/remove pairs in the churn test
+    uint64_t seed;
+};
+
+std::vector<uint32_t> GenerateThreadIDs (Random& random, uint64_t count)
+{
+    // Windows hands out IDs from a handle table, so they are multiples of four, and they are usually below ~300K
+    std::unordered_set<uint32_t> ids;
+    while (ids.size () < count)
+        ids.insert (static_cast<uint32_t> (4 + random.NextBelow (75'000) * 4));
+
+    return { ids.begin (), ids.end () };
+}
+
+template<typename Set, typename ContainsFunc>
+uint64_t MeasureLookups (const Set& set,
+                         const std::vector<uint32_t>& lookupStream,
+                         ContainsFunc contains,
+                         double* pNsPerLookupOut)
+{
+    uint64_t hits = 0;
+
+    Stopwatch stopwatch;
+    for (const uint32_t id : lookupStream)
+        hits += contains (set, id) ? 1 : 0;
+
+    *pNsPerLookupOut = stopwatch.GetElapsedNs () / lookupStream.size ();
+
+    return hits;
+}
+
+template<typename Set, typename AddFunc, typename RemoveFunc>
+double MeasureChurn (Set& set,
+                     const std::vector<uint32_t>& churnIDs,
+                     AddFunc add,
+                     RemoveFunc remove)
+{
+    Stopwatch stopwatch;
+    for (const uint32_t id : churnIDs)
+        add (set, id);
+
+    for (const uint32_t id : churnIDs)
+        remove (set, id);
+
+    return stopwatch.GetElapsedNs () / (2 * churnIDs.size ());
+}
+
+bool IDRegistryBenchmark (const Parameters& parameters)
+{
+    const IDRegistryBenchmarkConfig config = { parameters.GetUInt ("threads", 20'000),
+                                               parameters.GetUInt ("targets", 64),
+                                               parameters.GetUInt ("lookups", 20'000'000),
+                                               parameters.GetDouble ("hitratio", 0.05),
+                                               parameters.GetUInt ("churn", 1'000'000),
+                                               parameters.GetUInt ("seed", 13) };
+
+    if (config.targetThreads == 0 || config.targetThreads > config.liveThreads || config.liveThreads > 75'000)
+        Fail ("Invalid thread counts (0 < targets <= threads <= 75000 is required)!");
+
+    Random random (config.seed);
+    const std::vector<uint32_t> liveThreads = GenerateThreadIDs (random, config.liveThreads);
+    const std::vector<uint32_t> targetThreads (liveThreads.begin (), liveThreads.begin () + config.targetThreads);
+
+    std::vector<uint32_t> lookupStream;
+    lookupStream.reserve (config.lookups);
+    for (uint64_t i = 0; i < config.lookups; ++i) {
+        if (random.NextDouble () < config.hitRatio)
+            lookupStream.push_back (targetThreads[random.NextBelow (targetThreads.size ())]);
+        else
+            lookupStream.push_back (liveThreads[random.NextBelow (liveThreads.size ())]);
+    }
+
+    std::unordered_set<uint32_t> hashSet (targetThreads.begin (), targetThreads.end ());
+    ETWP::IDRegistry registry;
+    for (const uint32_t tid : targetThreads)
+        registry.Add (tid);
+
+    PrintHeader ("IDRegistry vs. std::unordered_set (" + std::to_string (config.targetThreads) + " target threads, " +
+                 std::to_string (config.liveThreads) + " live threads, " + std::to_string (config.lookups) +
+                 " lookups)");
+
+    double hashSetNs = 0;
+    const uint64_t hashSetHits = MeasureLookups (hashSet, lookupStream, [] (const auto& s, uint32_t id) {
+        return s.contains (id);
+    }, &hashSetNs);
+
+    double registryNs = 0;
+    const uint64_t registryHits = MeasureLookups (registry, lookupStream, [] (const auto& r, uint32_t id) {
+        return r.Contains (id);
+    }, &registryNs);
+
+    if (hashSetHits != registryHits)
+        Fail ("IDRegistry and std::unordered_set disagree on lookup results!");
+
+    PrintResult ("lookup (std::unordered_set)", hashSetNs);
+    PrintResult ("lookup (IDRegistry)", registryNs, FormatSpeedup (hashSetNs, registryNs));
+
+    // Thread start/end events: add and remove IDs that are not present yet
+    std::vector<uint32_t> churnIDs;
+    churnIDs.reserve (config.churnCycles);
+    for (uint64_t i = 0; i < config.churnCycles; ++i)
+        churnIDs.push_back (liveThreads[config.targetThreads + random.NextBelow (liveThreads.size () -
+                                                                                 config.targetThreads)]);
+
+    const double hashSetChurnNs = MeasureChurn (hashSet,
+                                                churnIDs,
+                                                [] (auto& s, uint32_t id) { s.insert (id); },
+                                                [] (auto& s, uint32_t id) { s.erase (id); });
+    const double registryChurnNs = MeasureChurn (registry,
+                                                 churnIDs,
+                                                 [] (auto& r, uint32_t id) { r.Add (id); },
+                                                 [] (auto& r, uint32_t id) { r.Remove (id); });
+
+    if (hashSet.size () != registry.GetSize ())
+        Fail ("IDRegistry and std::unordered_set disagree on size after churn!");
+
+    PrintResult ("add/remove (std::unordered_set)", hashSetChurnNs);
+    PrintResult ("add/remove (IDRegistry)", registryChurnNs, FormatSpeedup (hashSetChurnNs, registryChurnNs));
+
+    std::printf ("  IDRegistry memory usage: %zu bytes\n", registry.GetMemoryUsage ());
+
+    return true;
+}
+
+BenchmarkRegistrator benchmarkRegistrator ("idregistry",
+                                           "Thread/process ID lookups (IDRegistry vs. std::unordered_set)",
+                                           IDRegistryBenchmark);
+
+}   // namespace
+}   // namespace EPB
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "BenchmarkRegistrar.hpp"
+#include "Utility.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Profiler/ModuleIndex.hpp"
+
+namespace EPB {
+namespace {
+
+// Compares ModuleIndex (one by one and batched lookups) with std::map and binary search over a sorted array, the
+//   obvious ways of resolving addresses to modules. Modules are laid out like in a process: DLLs of various sizes,
+//   with gaps between them. Most addresses are inside modules (instruction pointers usually are), the rest are not
+//   (e.g. JIT-ted code)
+struct ModuleIndexBenchmarkConfig {
+    uint64_t modules;
+    uint64_t lookups;
+    uint64_t bufferSize;    // Addresses are generated into a buffer of this size, which is looked up repeatedly
+    double   hitRatio;
+    uint64_t seed;
+};
+
+template<typename FindFunc>
+double MeasureLookups (const std::vector<UINT_PTR>& addresses,
+                       uint64_t nLookups,
+                       std::vector<uint32_t>* pResultsOut,
+                       FindFunc find)
+{
+    Stopwatch stopwatch;
+    for (uint64_t nDone = 0; nDone < nLookups; nDone += addresses.size ())
+        find (addresses.data (), addresses.size (), pResultsOut->data ());
+
+    return stopwatch.GetElapsedNs () / nLookups;
+}
+
+bool ModuleIndexBenchmark (const Parameters& parameters)
+{
+    const ModuleIndexBenchmarkConfig config = { parameters.GetUInt ("modules", 2'000),
+                                                parameters.GetUInt ("lookups", 100'000'000),
+                                                parameters.GetUInt ("buffer", 1'000'000),
+                                                parameters.GetDouble ("hitratio", 0.95),
+                                                parameters.GetUInt ("seed", 13) };
+
+    if (config.modules == 0 || config.bufferSize == 0 || config.lookups < config.bufferSize)
+        Fail ("Invalid module, lookup or buffer count (0 < buffer <= lookups is required)!");
+
+    Random random (config.seed);
+    std::vector<ETWP::ModuleIndex::Interval> intervals;
+    UINT_PTR base = 0x7FF6'0000'0000;
+    for (uint64_t i = 0; i < config.modules; ++i) {
+        const UINT_PTR size = (1 + random.NextBelow (256)) * 0x1'0000;    // 64 KB - 16 MB
+        intervals.push_back ({ base, base + size, static_cast<uint32_t> (i) });
+        base += size + random.NextBelow (16) * 0x1'0000;
+    }
+
+    std::vector<UINT_PTR> addresses;
+    addresses.reserve (config.bufferSize);
+    for (uint64_t i = 0; i < config.bufferSize; ++i) {
+        if (random.NextDouble () < config.hitRatio) {
+            const ETWP::ModuleIndex::Interval& interval = intervals[random.NextBelow (intervals.size ())];
+            addresses.push_back (interval.base + random.NextBelow (interval.end - interval.base));
+        } else {
+            addresses.push_back (0x1'0000'0000 + random.NextBelow (0x1'0000'0000));
+        }
+    }
+
+    std::map<UINT_PTR, ETWP::ModuleIndex::Interval> map;
+    for (const ETWP::ModuleIndex::Interval& interval : intervals)
+        map.emplace (interval.base, interval);
+
+    const std::vector<ETWP::ModuleIndex::Interval>& sorted = intervals;  // Generated in order
+    const ETWP::ModuleIndex index (intervals);
+
+    PrintHeader ("ModuleIndex vs. std::map and binary search (" + std::to_string (config.modules) + " modules, " +
+                 std::to_string (config.lookups) + " lookups)");
+
+    std::vector<uint32_t> mapResults (addresses.size ());
+    const double mapNs = MeasureLookups (addresses, config.lookups, &mapResults, [&] (const UINT_PTR* pAddresses,
+                                                                                       size_t n,
+                                                                                       uint32_t* pResults) {
+        for (size_t i = 0; i < n; ++i) {
+            auto it = map.upper_bound (pAddresses[i]);
+            pResults[i] = it != map.begin () && pAddresses[i] < (--it)->second.end ?
+                          it->second.moduleID :
+                          ETWP::ModuleIndex::kNoModule;
+        }
+    });
+
+    std::vector<uint32_t> sortedResults (addresses.size ());
+    const double sortedNs = MeasureLookups (addresses, config.lookups, &sortedResults, [&] (const UINT_PTR* pAddresses,
+                                                                                             size_t n,
+                                                                                             uint32_t* pResults) {
+        for (size_t i = 0; i < n; ++i) {
+            const UINT_PTR address = pAddresses[i];
+            auto it = std::upper_bound (sorted.begin (), sorted.end (), address, [] (UINT_PTR a, const auto& interval) {
+                return a < interval.base;
+            });
+            pResults[i] = it != sorted.begin () && address < (--it)->end ? it->moduleID : ETWP::ModuleIndex::kNoModule;
+        }
+    });
+
+    std::vector<uint32_t> indexResults (addresses.size ());
+    const double indexNs = MeasureLookups (addresses, config.lookups, &indexResults, [&] (const UINT_PTR* pAddresses,
+                                                                                           size_t n,
+                                                                                           uint32_t* pResults) {
+        for (size_t i = 0; i < n; ++i)
+            pResults[i] = index.Find (pAddresses[i]);
+    });
+
+    std::vector<uint32_t> batchResults (addresses.size ());
+    const double batchNs = MeasureLookups (addresses, config.lookups, &batchResults, [&] (const UINT_PTR* pAddresses,
+                                                                                           size_t n,
+                                                                                           uint32_t* pResults) {
+        index.FindBatch (pAddresses, n, pResults);
+    });
+
+    if (mapResults != sortedResults || mapResults != indexResults || mapResults != batchResults)
+        Fail ("ModuleIndex and the reference implementations disagree on lookup results!");
+
+    const uint64_t nHits = std::count_if (mapResults.begin (), mapResults.end (), [] (uint32_t moduleID) {
+        return moduleID != ETWP::ModuleIndex::kNoModule;
+    });
+
+    PrintResult ("lookup (std::map)", mapNs);
+    PrintResult ("lookup (binary search)", sortedNs, FormatSpeedup (mapNs, sortedNs));
+    PrintResult ("lookup (ModuleIndex)", indexNs, FormatSpeedup (mapNs, indexNs));
+    PrintResult ("lookup (ModuleIndex, batched)", batchNs, FormatSpeedup (mapNs, batchNs));
+
+    std::printf ("  hits: %.1f%%\n", 100.0 * nHits / addresses.size ());
+    std::printf ("  ModuleIndex memory usage: %zu bytes\n", index.GetMemoryUsage ());
+
+    return true;
+}
+
+BenchmarkRegistrator benchmarkRegistrator ("modules",
+                                           "Address to module lookups (ModuleIndex vs. std::map and binary search)",
+                                           ModuleIndexBenchmark);
+
+}   // namespace
+}   // namespace EPB
\ No newline at end of file
@@ -0,0 +1,213 @@
+#include "BenchmarkRegistrar.hpp"
+#include "SyntheticKernelStream.hpp"
+#include "Utility.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "OS/ETW/ETLReader.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+#include "OS/Process/ProcessLifetimeEventSource.hpp"
+#include "Profiler/EventMetadata.hpp"
+#include "Profiler/ProfileFilter.hpp"
+
+namespace EPB {
+namespace {
+
+struct OutputResult {
+    uint64_t nEventsWritten = 0;
+    uint64_t nBytesWritten = 0;     // All files written, including intermediate ones
+    uint64_t outputSize = 0;
+    uint64_t peakDiskUsage = 0;
+    double   totalNs = 0;
+    double   stopNs = 0;            // From the end of the event stream until the output is final
+};
+
+class WriterSink final : public ETWP::IEventSink {
+public:
+    explicit WriterSink (ETWP::ETLWriter* pWriter): m_pWriter (pWriter)
+    {
+    }
+
+    virtual bool WriteEvent (const ETWP::EventView& event) override
+    {
+        return m_pWriter->WriteEvent (event);
+    }
+
+private:
+    ETWP::ETLWriter* m_pWriter;
+};
+
+// Stand-in for TDH: every event kind has a TRACE_EVENT_INFO of realistic size
+bool GetFakeEventMetadata (const ETWP::EventView&, std::vector<ETWP::EventMetadataRecord>* pRecordsOut)
+{
+    pRecordsOut->push_back ({ ETWP::ETWConstants::EventInfoOpcode, std::vector<uint8_t> (400, 0xCD) });
+
+    return true;
+}
+
+ETWP::ETLWriterConfig GetWriterConfig (const SyntheticKernelStreamConfig& config)
+{
+    ETWP::ETLWriterConfig writerConfig;
+    writerConfig.numberOfProcessors = config.cpus;
+    writerConfig.loggerName = L"etwprof_bench";
+
+    return writerConfig;
+}
+
+uint64_t GetFileSize (const std::filesystem::path& path)
+{
+    std::error_code error;
+    const uintmax_t size = std::filesystem::file_size (path, error);
+
+    return error ? 0 : size;
+}
+
+void CloseWriter (ETWP::ETLWriter* pWriter, const std::filesystem::path& path)
+{
+    std::wstring errorMsg;
+    if (!pWriter->Close (&errorMsg))
+        Fail ("Unable to finish ETL file: " + path.string ());
+}
+
+// Filters the same synthetic event stream, and writes the output either in one pass (like etwprof does now), or in
+//   two passes: kept events go to an intermediate file first, which is then rewritten with metadata added, like the
+//   EVENT_TRACE_MERGE_EXTENDED_DATA_EVENT_METADATA merge of kerneltracecontrol.dll did
+OutputResult RunOutput (const SyntheticKernelStreamConfig& config,
+                        uint64_t nEvents,
+                        const std::filesystem::path& outputPath,
+                        bool twoPass)
+{
+    SyntheticKernelStream stream (config);
+
+    ETWP::ProfileFilterData filterData = { {},
+                                           stream.GetEnabledUserProviderIDs (),
+                                           {},
+                                           { stream.GetTargetPID () },
+                                           config.cswitchRatio > 0,
+                                           false,
+                                           {} };
+    ETWP::PrepareForProfiling (&filterData);
+    ETWP::ProcessLifetimeEventSource processLifetimeEventSource;
+
+    const std::filesystem::path writerPath = twoPass ? std::filesystem::path (outputPath.string () + ".raw.etl") :
+                                                       outputPath;
+    OutputResult result;
+    Stopwatch totalStopwatch;
+    try {
+        ETWP::ETLWriter writer (writerPath, GetWriterConfig (config));
+        WriterSink writerSink (&writer);
+        ETWP::EventMetadataSink metadataSink (&writerSink, GetFakeEventMetadata, filterData.userProviderIDs);
+        ETWP::IEventSink& sink = twoPass ? static_cast<ETWP::IEventSink&> (writerSink) : metadataSink;
+
+        SyntheticKernelStream::Chunk chunk;
+        for (uint64_t nProcessed = 0; nProcessed < nEvents; nProcessed += chunk.records.size ()) {
+            stream.GenerateChunk (static_cast<size_t> (std::min<uint64_t> (65'536, nEvents - nProcessed)), &chunk);
+            for (const ETWP::EventRecordLayout& record : chunk.records) {
+                const ETWP::EventView event (record);
+                if (ETWP::FilterEventForProfiling (event, &filterData, &processLifetimeEventSource))
+                    sink.WriteEvent (event);
+            }
+        }
+
+        Stopwatch stopStopwatch;
+        CloseWriter (&writer, writerPath);
+        result.nEventsWritten = writer.GetStats ().nEventsWritten;
+        result.nBytesWritten = GetFileSize (writerPath);
+
+        if (twoPass) {
+            {
+                const ETWP::ETLReader reader (writerPath);
+                ETWP::ETLWriter mergeWriter (outputPath, GetWriterConfig (config));
+                WriterSink mergeWriterSink (&mergeWriter);
+                ETWP::EventMetadataSink mergeSink (&mergeWriterSink, GetFakeEventMetadata, filterData.userProviderIDs);
+                reader.ForEachEvent ([&mergeSink] (const ETWP::EventView& event) { mergeSink.WriteEvent (event); });
+
+                CloseWriter (&mergeWriter, outputPath);
+                result.nEventsWritten = mergeWriter.GetStats ().nEventsWritten;
+            }
+
+            result.nBytesWritten += GetFileSize (outputPath);
+            result.peakDiskUsage = result.nBytesWritten;
+
+            std::error_code error;
+            std::filesystem::remove (writerPath, error);
+        }
+
+        result.stopNs = stopStopwatch.GetElapsedNs ();
+    } catch (const ETWP::ETLWriter::InitException&) {
+        Fail ("Unable to create ETL file: " + writerPath.string ());
+    } catch (const ETWP::ETLReader::InitException&) {
+        Fail ("Unable to read ETL file: " + writerPath.string ());
+    }
+
+    result.totalNs = totalStopwatch.GetElapsedNs ();
+    result.outputSize = GetFileSize (outputPath);
+    if (!twoPass)
+        result.peakDiskUsage = result.outputSize;
+
+    return result;
+}
+
+void PrintOutputResult (const char* mode, const OutputResult& result, uint64_t nKept)
+{
+    std::printf ("  %-9s  %.2f MB written (%.1f bytes/kept event), %.2f MB output, %.2f MB peak disk usage\n",
+                 (std::string (mode) + ":").c_str (),
+                 result.nBytesWritten / (1'024.0 * 1'024.0),
+                 nKept == 0 ? 0.0 : double (result.nBytesWritten) / nKept,
+                 result.outputSize / (1'024.0 * 1'024.0),
+                 result.peakDiskUsage / (1'024.0 * 1'024.0));
+    std::printf ("  %-9s  %.1f ms total, %.1f ms to stop\n",
+                 "",
+                 result.totalNs / 1'000'000.0,
+                 result.stopNs / 1'000'000.0);
+}
+
+// Measures how many bytes hit the disk per kept event, and how long stopping takes, when the output (with event
+//   metadata for user provider events) is written in a single pass, compared to writing an intermediate file first,
+//   then merging it into the final output. Both modes filter the same synthetic kernel event stream, so their outputs
+//   must contain the same events
+bool OutputBenchmark (const Parameters& parameters)
+{
+    const uint64_t nEvents = parameters.GetUInt ("events", 2'000'000);
+    const std::string etlPath = parameters.GetString ("etl", "");
+    const SyntheticKernelStreamConfig config = SyntheticKernelStreamConfig::FromParameters (parameters);
+
+    if (nEvents == 0)
+        Fail ("Invalid event count!");
+
+    if (etlPath.empty ())
+        Fail ("An output path is required (--etl=<path>)!");
+
+    PrintHeader ("Output size and stop latency (" + std::to_string (config.userProviders) + " user providers, " +
+                 std::to_string (config.cpus) + " CPUs)");
+
+    const OutputResult singlePass = RunOutput (config, nEvents, etlPath, false);
+    const OutputResult twoPass = RunOutput (config, nEvents, etlPath, true);
+
+    const uint64_t nKept = singlePass.nEventsWritten;
+    PrintOutputResult ("one pass", singlePass, nKept);
+    PrintOutputResult ("two pass", twoPass, nKept);
+
+    std::error_code error;
+    std::filesystem::remove (etlPath, error);
+
+    if (singlePass.nEventsWritten != twoPass.nEventsWritten) {
+        Fail ("Different number of events written in one (" + std::to_string (singlePass.nEventsWritten) +
+              ") and two passes (" + std::to_string (twoPass.nEventsWritten) + ")!");
+    }
+
+    return true;
+}
+
+BenchmarkRegistrator benchmarkRegistrator ("output",
+                                           "Bytes written per kept event and stop latency, single vs. two pass output",
+                                           OutputBenchmark);
+
+}   // namespace
+}   // namespace EPB
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "BenchmarkRegistrar.hpp"
+#include "Utility.hpp"
+
+#include <cstdio>
+#include <unordered_set>
+#include <vector>
+
+#include "Profiler/StackKeyTable.hpp"
+
+namespace EPB {
+namespace {
+
+// Compares StackKeyTable with the way stack keys were stored previously (an unbounded std::unordered_set), by
+//   replaying a synthetic stream of stack key references (StackKeyKernel/User events of a target) and definitions
+//   (StackWalkKeyDelete/Rundown events). The kernel's stack cache is modeled as a fixed number of live keys: a new key
+//   replaces a random one, whose definition is emitted then. Some definitions are lost (like when ETW loses events),
+//   those keys are never removed
+struct StackKeyBenchmarkConfig {
+    uint64_t operations;    // Number of references and definitions in total
+    uint64_t liveKeys;      // Size of the (modeled) stack cache
+    uint64_t targetRatio;   // Percentage of keys referenced by the target
+    uint64_t lossRatio;     // Per mille of definitions lost
+    uint64_t maxMemory;     // Memory limit of StackKeyTable, in bytes
+};
+
+struct Operation {
+    uint64_t key;
+    bool     isDefinition;
+};
+
+constexpr uint64_t kStackKeyBase = 0xFFFF'C000'0000'0000ULL;
+
+std::vector<Operation> GenerateOperations (const StackKeyBenchmarkConfig& config, uint64_t* pNumberOfLostOut)
+{
+    struct LiveKey {
+        uint64_t key;
+        bool     isTarget;
+    };
+
+    Random random (42);
+    uint64_t nextKey = 0;
+    const auto makeKey = [&] () -> LiveKey {
+        return { kStackKeyBase + 64 * nextKey++, random.NextBelow (100) < config.targetRatio };
+    };
+
+    std::vector<LiveKey> liveKeys;
+    for (uint64_t i = 0; i < config.liveKeys; ++i)
+        liveKeys.push_back (makeKey ());
+
+    std::vector<Operation> operations;
+    operations.reserve (config.operations);
+    *pNumberOfLostOut = 0;
+    while (operations.size () < config.operations) {
+        LiveKey& liveKey = liveKeys[random.NextBelow (liveKeys.size ())];
+        if (random.NextBelow (4) != 0) {
+            // Only references of the target are kept (and put into the table), the rest is filtered by PID
+            if (liveKey.isTarget)
+                operations.push_back ({ liveKey.key, false });
+        } else {
+            if (random.NextBelow (1'000) >= config.lossRatio)
+                operations.push_back ({ liveKey.key, true });
+            else
+                ++*pNumberOfLostOut;
+
+            liveKey = makeKey ();
+        }
+    }
+
+    return operations;
+}
+
+template<typename Reference, typename Remove>
+double MeasureReplay (const std::vector<Operation>& operations,
+                      std::vector<uint8_t>* pDecisionsOut,
+                      Reference&& reference,
+                      Remove&& remove)
+{
+    pDecisionsOut->resize (operations.size ());
+
+    Stopwatch stopwatch;
+    for (size_t i = 0; i < operations.size (); ++i) {
+        const Operation& operation = operations[i];
+        if (operation.isDefinition) {
+            (*pDecisionsOut)[i] = remove (operation.key);
+        } else {
+            reference (operation.key);
+            (*pDecisionsOut)[i] = true;
+        }
+    }
+
+    return stopwatch.GetElapsedNs () / operations.size ();
+}
+
+bool StackKeyBenchmark (const Parameters& parameters)
+{
+    const StackKeyBenchmarkConfig config = { parameters.GetUInt ("operations", 5'000'000),
+                                             parameters.GetUInt ("keys", 40'961),
+                                             parameters.GetUInt ("target", 25),
+                                             parameters.GetUInt ("loss", 10),
+                                             parameters.GetUInt ("memory", 1'024) * 1'024 };
+
+    if (config.operations == 0 || config.liveKeys == 0 || config.targetRatio > 100 || config.lossRatio > 1'000)
+        Fail ("Invalid operation or key counts, or ratios!");
+
+    PrintHeader ("Stack key table (" + std::to_string (config.operations) + " operations, " +
+                 std::to_string (config.liveKeys) + " live keys, " + std::to_string (config.lossRatio) +
+                 " per mille of definitions lost, " + std::to_string (config.maxMemory / 1'024) + " KB limit)");
+
+    uint64_t nLost = 0;
+    const std::vector<Operation> operations = GenerateOperations (config, &nLost);
+
+    std::unordered_set<uint64_t> legacyKeys;
+    std::vector<uint8_t> legacyDecisions;
+    const double legacyNs = MeasureReplay (operations,
+                                           &legacyDecisions,
+                                           [&] (uint64_t key) { legacyKeys.insert (key); },
+                                           [&] (uint64_t key) { return legacyKeys.erase (key) != 0; });
+
+    ETWP::StackKeyTable table (config.maxMemory);
+    std::vector<uint8_t> decisions;
+    const double tableNs = MeasureReplay (operations,
+                                          &decisions,
+                                          [&] (uint64_t key) { table.Reference (key); },
+                                          [&] (uint64_t key) { return table.Remove (key); });
+
+    // The table may only drop definitions of keys it evicted, it must never keep more than the set
+    uint64_t nDefinitions = 0;
+    uint64_t nKeptBySet = 0;
+    uint64_t nDroppedEarly = 0;
+    for (size_t i = 0; i < operations.size (); ++i) {
+        if (!operations[i].isDefinition)
+            continue;
+
+        ++nDefinitions;
+        if (decisions[i] && !legacyDecisions[i])
+            Fail ("The table kept the definition of a key that was never referenced!");
+
+        nKeptBySet += legacyDecisions[i];
+        nDroppedEarly += legacyDecisions[i] && !decisions[i];
+    }
+
+    const ETWP::StackKeyTable::Stats stats = table.GetStats ();
+    if (nDroppedEarly > stats.nEvicted)
+        Fail ("The table dropped definitions of keys it did not evict!");
+
+    PrintResult ("replay (std::unordered_set)", legacyNs);
+    PrintResult ("replay (StackKeyTable)", tableNs, FormatSpeedup (legacyNs, tableNs));
+
+    std::printf ("  Definitions: %llu (%llu lost), %llu of them kept by the set, %llu dropped because of eviction\n",
+                 static_cast<unsigned long long> (nDefinitions),
+                 static_cast<unsigned long long> (nLost),
+                 static_cast<unsigned long long> (nKeptBySet),
+                 static_cast<unsigned long long> (nDroppedEarly));
+    std::printf ("  Keys at the end: %zu in the set (~%.2f MB), %zu in the table (%.2f MB)\n",
+                 legacyKeys.size (),
+                 legacyKeys.size () * (sizeof (uint64_t) + 2 * sizeof (void*)) / (1'024.0 * 1'024.0),
+                 table.GetSize (),
+                 table.GetMemoryUsage () / (1'024.0 * 1'024.0));
+    std::printf ("  Table: %llu misses, %llu evicted in %llu sweeps, high-water mark %zu keys\n",
+                 static_cast<unsigned long long> (stats.nMisses),
+                 static_cast<unsigned long long> (stats.nEvicted),
+                 static_cast<unsigned long long> (stats.nSweeps),
+                 stats.highWaterMark);
+
+    return true;
+}
+
+BenchmarkRegistrator benchmarkRegistrator ("stackkeys",
+                                           "Stack key bookkeeping (StackKeyTable vs. std::unordered_set)",
+                                           StackKeyBenchmark);
+
+}   // namespace
+}   // namespace EPB
\ No newline at end of file
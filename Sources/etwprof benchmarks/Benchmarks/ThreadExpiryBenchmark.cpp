@@ -0,0 +1,172 @@
+#include "BenchmarkRegistrar.hpp"
+#include "Utility.hpp"
+
+#include <cstdio>
+#include <vector>
+
+#include "Profiler/IDRegistry.hpp"
+#include "Profiler/ProfileFilter.hpp"
+
+namespace EPB {
+namespace {
+
+// Compares ThreadRegistry (deletion marks in a timer wheel) with the way it worked previously: marks in a vector,
+//   scanned on every thread start. Thread events are generated at a fixed rate, with timestamps, so the results do
+//   not depend on how fast the machine is (the expiry of marks is driven by timestamps in both cases)
+struct ThreadExpiryBenchmarkConfig {
+    uint64_t threadsPerSecond;  // Threads of the target that end (and get replaced by a new one) per second
+    uint64_t threads;           // Number of thread ends in total
+    uint64_t targetThreads;     // Number of threads of the target, alive at the same time
+};
+
+constexpr int64_t kTimestampFrequency = 10'000'000;
+
+class LegacyThreadRegistry {
+public:
+    void Add (uint32_t tid)
+    {
+        m_threadIDs.Add (tid);
+    }
+
+    void MarkForDeletion (uint32_t tid, int64_t timestamp)
+    {
+        m_deletionMarks.push_back ({ tid, m_threadIDs.GetGeneration (tid), timestamp });
+    }
+
+    bool Contains (uint32_t tid) const
+    {
+        return m_threadIDs.Contains (tid);
+    }
+
+    void DeleteThreadsMarkedForDeletion (int64_t timestamp)
+    {
+        std::erase_if (m_deletionMarks, [this, timestamp] (const DeletionMark& mark) {
+            if (mark.generation != m_threadIDs.GetGeneration (mark.tid))
+                return true;
+
+            if (timestamp < mark.markTime + kTimestampFrequency)
+                return false;
+
+            m_threadIDs.Remove (mark.tid);
+
+            return true;
+        });
+    }
+
+private:
+    struct DeletionMark {
+        uint32_t                     tid;
+        ETWP::IDRegistry::Generation generation;
+        int64_t                      markTime;
+    };
+
+    ETWP::IDRegistry          m_threadIDs;
+    std::vector<DeletionMark> m_deletionMarks;
+};
+
+// Each thread end is followed by the start of a new thread. TIDs are not reused, so every thread that ended is deleted
+//   by expiry
+struct ThreadEnd {
+    uint32_t endedTID;
+    uint32_t startedTID;
+    int64_t  timestamp;
+};
+
+std::vector<ThreadEnd> GenerateThreadEnds (const ThreadExpiryBenchmarkConfig& config)
+{
+    const int64_t step = kTimestampFrequency / int64_t (config.threadsPerSecond);
+
+    std::vector<uint32_t> liveThreads;
+    for (uint64_t i = 0; i < config.targetThreads; ++i)
+        liveThreads.push_back (4 * uint32_t (i + 1));
+
+    std::vector<ThreadEnd> threadEnds;
+    threadEnds.reserve (config.threads);
+    uint32_t nextTID = 4 * uint32_t (config.targetThreads + 1);
+    for (uint64_t i = 0; i < config.threads; ++i) {
+        uint32_t& tid = liveThreads[i % liveThreads.size ()];
+        threadEnds.push_back ({ tid, nextTID, int64_t (i) * step });
+        tid = nextTID;
+        nextTID += 4;
+    }
+
+    return threadEnds;
+}
+
+template<typename Registry>
+double MeasureThreadChurn (const ThreadExpiryBenchmarkConfig& config,
+                           const std::vector<ThreadEnd>& threadEnds,
+                           Registry* pRegistry)
+{
+    for (uint64_t i = 0; i < config.targetThreads; ++i)
+        pRegistry->Add (4 * uint32_t (i + 1));
+
+    Stopwatch stopwatch;
+    for (const ThreadEnd& threadEnd : threadEnds) {
+        pRegistry->MarkForDeletion (threadEnd.endedTID, threadEnd.timestamp);
+        pRegistry->DeleteThreadsMarkedForDeletion (threadEnd.timestamp);
+        pRegistry->Add (threadEnd.startedTID);
+    }
+
+    return stopwatch.GetElapsedNs () / threadEnds.size ();
+}
+
+// Threads that ended more than a second ago must have been deleted, newer ones must not have been. ThreadRegistry
+//   might be late by a fraction of a second, so threads that ended around the threshold are not checked
+template<typename Registry>
+bool CheckExpiry (const std::vector<ThreadEnd>& threadEnds, const Registry& registry)
+{
+    const int64_t lastTimestamp = threadEnds.back ().timestamp;
+    for (const ThreadEnd& threadEnd : threadEnds) {
+        const int64_t age = lastTimestamp - threadEnd.timestamp;
+        if (age < kTimestampFrequency && !registry.Contains (threadEnd.endedTID))
+            return false;
+
+        if (age > kTimestampFrequency * 9 / 8 && registry.Contains (threadEnd.endedTID))
+            return false;
+    }
+
+    return true;
+}
+
+bool ThreadExpiryBenchmark (const Parameters& parameters)
+{
+    const ThreadExpiryBenchmarkConfig config = { parameters.GetUInt ("rate", 5'000),
+                                                 parameters.GetUInt ("threads", 100'000),
+                                                 parameters.GetUInt ("targets", 64) };
+
+    if (config.threadsPerSecond == 0 || config.threadsPerSecond > uint64_t (kTimestampFrequency) ||
+        config.threads == 0 || config.targetThreads == 0)
+    {
+        Fail ("Invalid thread counts or rate!");
+    }
+
+    PrintHeader ("ThreadRegistry expiry (" + std::to_string (config.threads) + " thread ends, " +
+                 std::to_string (config.threadsPerSecond) + " per second)");
+
+    const std::vector<ThreadEnd> threadEnds = GenerateThreadEnds (config);
+
+    LegacyThreadRegistry legacyRegistry;
+    const double legacyNs = MeasureThreadChurn (config, threadEnds, &legacyRegistry);
+
+    ETWP::ThreadRegistry registry;
+    registry.SetTimestampFrequency (kTimestampFrequency);
+    const double registryNs = MeasureThreadChurn (config, threadEnds, &registry);
+
+    if (!CheckExpiry (threadEnds, legacyRegistry) || !CheckExpiry (threadEnds, registry))
+        Fail ("Threads were not deleted in time (or were deleted too early)!");
+
+    PrintResult ("mark + expire (vector scan)", legacyNs);
+    PrintResult ("mark + expire (timer wheel)", registryNs, FormatSpeedup (legacyNs, registryNs));
+
+    std::printf ("  Threads marked for deletion at the end: %zu\n", registry.GetNumberOfThreadsMarkedForDeletion ());
+
+    return true;
+}
+
+BenchmarkRegistrator benchmarkRegistrator ("threadexpiry",
+                                           "Expiry of ended threads (ThreadRegistry vs. scanning marks)",
+                                           ThreadExpiryBenchmark);
+
+}   // namespace
+}   // namespace EPB
\ No newline at end of file
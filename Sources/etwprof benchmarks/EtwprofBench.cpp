@@ -0,0 +1,86 @@
+/*
+  This small utility program runs micro- and macrobenchmarks of etwprof's portable, performance critical parts (e.g.
+    the per-event filter's data structures). It does not depend on Windows, so it can be run on any machine.
+
+  See the "Benchmarks" folder for the available benchmarks.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+
+#include "BenchmarkRegistrar.hpp"
+
+namespace EPB {
+namespace {
+
+void Usage ()
+{
+    std::fprintf (stderr, "Usage: etwprof_bench <benchmark name> [--<parameter>=<value>...]\n");
+}
+
+void ListBenchmarks ()
+{
+    std::fprintf (stderr, "Available benchmarks:\n");
+
+    BenchmarkRegistrar::Instance ().Enumerate ([] (const std::string& name, const BenchmarkRegistrar::Entry& entry) {
+            std::fprintf (stderr, "\t%-16s %s\n", name.c_str (), entry.description.c_str ());
+
+            return true;
+        }
+    );
+}
+
+bool ParseParameters (int argc, char* argv[], Parameters* pParametersOut)
+{
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const size_t equalsSignPos = arg.find ('=');
+        if (arg.compare (0, 2, "--") != 0 || equalsSignPos == std::string::npos || equalsSignPos == 2) {
+            std::fprintf (stderr, "Invalid parameter: \"%s\"!\n", arg.c_str ());
+
+            return false;
+        }
+
+        pParametersOut->Set (arg.substr (2, equalsSignPos - 2), arg.substr (equalsSignPos + 1));
+    }
+
+    return true;
+}
+
+}   // namespace
+}   // namespace EPB
+
+int main (int argc, char* argv[])
+{
+    if (argc < 2) {
+        EPB::Usage ();
+        EPB::ListBenchmarks ();
+
+        return EXIT_FAILURE;
+    }
+
+    EPB::Parameters parameters;
+    if (!EPB::ParseParameters (argc, argv, &parameters)) {
+        EPB::Usage ();
+
+        return EXIT_FAILURE;
+    }
+
+    const EPB::BenchmarkRegistrar::Entry* pEntry = EPB::BenchmarkRegistrar::Instance ().Find (argv[1]);
+    if (pEntry == nullptr) {
+        std::fprintf (stderr, "Unknown benchmark: \"%s\"!\n", argv[1]);
+        EPB::ListBenchmarks ();
+
+        return EXIT_FAILURE;
+    }
+
+    try {
+        return pEntry->benchmark (parameters) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception& e) {    // E.g. malformed numeric parameters
+        std::fprintf (stderr, "Benchmark failed with exception: %s\n", e.what ());
+
+        return EXIT_FAILURE;
+    }
+}
\ No newline at end of file
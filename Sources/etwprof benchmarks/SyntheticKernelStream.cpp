@@ -0,0 +1,512 @@
+#include "SyntheticKernelStream.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+
+namespace EPB {
+
+namespace {
+
+using ETWP::ETWConstants::ThreadDataStub;
+using ETWP::ETWConstants::ProcessDataStub;
+
+// Approximate payload sizes of real events (64-bit, V2+ versions, with typical names and SIDs)
+constexpr size_t kSampledProfileSize = 16;
+constexpr size_t kStackWalkHeaderSize = 16;
+constexpr size_t kStackKeyReferenceSize = 24;
+constexpr size_t kCSwitchSize = 24;
+constexpr size_t kReadyThreadSize = 16;
+constexpr size_t kThreadSize = 72;
+constexpr size_t kProcessSize = 128;
+constexpr size_t kImageLoadSize = 128;
+constexpr size_t kUserEventSize = 32;
+constexpr size_t kNoiseEventSize = 24;
+
+constexpr UCHAR kImageLoadOpcode = 10;
+constexpr UCHAR kImageDCStartOpcode = 3;
+constexpr UCHAR kEventTraceHeaderOpcode = 0;
+
+constexpr uint64_t kKernelAddressBase = 0xfffff800'00000000ULL;
+constexpr uint64_t kUserAddressBase = 0x00007ff6'00000000ULL;
+constexpr uint64_t kStackKeyBase = 0xffffa000'00000000ULL;
+
+struct NoiseEventType {
+    GUID  providerID;
+    UCHAR opcode;
+};
+
+// {3d6fa8d4-fe05-11d0-9dda-00c04fd7ba7c}
+constexpr GUID kDiskIoGuid = { 0x3d6fa8d4, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+// {90cbdc39-4a3e-11d1-84f4-0000f80464e3}
+constexpr GUID kFileIoGuid = { 0x90cbdc39, 0x4a3e, 0x11d1, { 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3 } };
+// {3d6fa8d3-fe05-11d0-9dda-00c04fd7ba7c}
+constexpr GUID kPageFaultGuid = { 0x3d6fa8d3, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+
+const NoiseEventType kNoiseEventTypes[] = {
+    { PerfInfoGuid,   66 /* DPC */ },
+    { PerfInfoGuid,   67 /* ISR */ },
+    { kDiskIoGuid,    10 /* Read */ },
+    { kFileIoGuid,    64 /* Create */ },
+    { kPageFaultGuid, 10 /* Transition fault */ }
+};
+
+SyntheticKernelStream::Expectation ExpectKeepIf (bool condition)
+{
+    return condition ? SyntheticKernelStream::Expectation::Keep : SyntheticKernelStream::Expectation::Drop;
+}
+
+}   // namespace
+
+SyntheticKernelStreamConfig SyntheticKernelStreamConfig::FromParameters (const Parameters& parameters)
+{
+    return { static_cast<uint32_t> (parameters.GetUInt ("threads", 3'000)),
+             static_cast<uint32_t> (parameters.GetUInt ("processes", 150)),
+             static_cast<uint32_t> (parameters.GetUInt ("targetthreads", 32)),
+             parameters.GetDouble ("targetshare", 0.25),
+             static_cast<uint32_t> (parameters.GetUInt ("cpus", 16)),
+             static_cast<uint32_t> (parameters.GetUInt ("samplerate", 1'000)),
+             parameters.GetDouble ("cswitchratio", 1.0),
+             static_cast<uint32_t> (parameters.GetUInt ("stackdepth", 24)),
+             static_cast<uint32_t> (parameters.GetUInt ("stackkeys", 0)),
+             parameters.GetDouble ("pidchurn", 0.5),
+             static_cast<uint32_t> (parameters.GetUInt ("userproviders", 2)),
+             parameters.GetDouble ("userratio", 0.1),
+             parameters.GetDouble ("noiseratio", 0.5),
+             parameters.GetUInt ("seed", 13) };
+}
+
+void SyntheticKernelStream::Chunk::Clear ()
+{
+    records.clear ();
+    expectations.clear ();
+    payloadStorage.clear ();
+    payloadBytes = 0;
+}
+
+SyntheticKernelStream::SyntheticKernelStream (const SyntheticKernelStreamConfig& config):
+    m_config (config),
+    m_random (config.seed),
+    m_targetPID (0),
+    m_nSamples (0),
+    m_timestamp (0),
+    m_timestampStep (1),
+    m_rundownDone (false),
+    m_pChunk (nullptr)
+{
+    if (config.processes < 2 || config.targetThreads == 0 || config.threads < config.processes + config.targetThreads)
+        Fail ("Invalid thread/process counts (processes >= 2, targetthreads >= 1 and "
+              "threads >= processes + targetthreads is required)!");
+
+    if (config.cpus == 0 || config.sampleRate == 0)
+        Fail ("Invalid CPU count or sample rate!");
+
+    for (DWORD id = 4; id < 4 * (config.threads + config.processes + 100'000); id += 4)
+        m_freeIDs.push_back (id);
+
+    m_targetPID = AllocateID ();
+    for (uint32_t i = 0; i < config.targetThreads; ++i)
+        m_targetThreads.push_back ({ m_targetPID, AllocateID () });
+
+    for (uint32_t i = 1; i < config.processes; ++i)
+        m_otherPIDs.push_back (AllocateID ());
+
+    for (uint32_t i = 0; i < config.threads - config.targetThreads; ++i)
+        m_otherThreads.push_back ({ m_otherPIDs[i % m_otherPIDs.size ()], AllocateID () });
+
+    for (uint32_t cpu = 0; cpu < config.cpus; ++cpu)
+        m_runningThreads.push_back (PickThread ());
+
+    for (uint32_t i = 0; i < config.userProviders; ++i) {
+        GUID providerID = {};
+        providerID.Data1 = static_cast<decltype (providerID.Data1)> (m_random.Next ());
+        providerID.Data2 = static_cast<uint16_t> (m_random.Next ());
+        providerID.Data3 = 0x4000 | static_cast<uint16_t> (m_random.NextBelow (0x1000));
+        const uint64_t data4 = m_random.Next ();
+        std::memcpy (providerID.Data4, &data4, sizeof data4);
+
+        m_userProviderIDs.push_back (providerID);
+    }
+
+    m_timestampStep = std::max<int64_t> (1, 10'000'000 / (int64_t (config.sampleRate) * config.cpus));
+}
+
+DWORD SyntheticKernelStream::GetTargetPID () const
+{
+    return m_targetPID;
+}
+
+std::vector<GUID> SyntheticKernelStream::GetEnabledUserProviderIDs () const
+{
+    if (m_userProviderIDs.empty ())
+        return {};
+
+    return { m_userProviderIDs.front () };
+}
+
+bool SyntheticKernelStream::UsesStackCache () const
+{
+    return m_config.stackKeys != 0;
+}
+
+void SyntheticKernelStream::GenerateChunk (size_t nEvents, Chunk* pChunkOut)
+{
+    pChunkOut->Clear ();
+    pChunkOut->records.reserve (nEvents + 64);
+    pChunkOut->expectations.reserve (nEvents + 64);
+
+    m_pChunk = pChunkOut;
+    m_payloadOffsets.clear ();
+
+    if (!m_rundownDone) {
+        EmitRundown ();
+
+        m_rundownDone = true;
+    }
+
+    // Events with a ratio of r per sample are emitted floor(r) times, plus once more with a probability of frac(r)
+    auto repeat = [this] (double ratio, auto emit) {
+        for (double remaining = ratio; remaining > 0; remaining -= 1.0) {
+            if (remaining >= 1.0 || m_random.NextDouble () < remaining)
+                emit ();
+        }
+    };
+
+    while (pChunkOut->records.size () < nEvents) {
+        EmitSample ();
+
+        repeat (m_config.cswitchRatio, [this] () { EmitContextSwitch (); });
+        repeat (m_config.noiseRatio, [this] () { EmitNoise (); });
+        if (!m_userProviderIDs.empty ())
+            repeat (m_config.userRatio, [this] () { EmitUserProviderEvent (); });
+
+        EmitProcessChurn ();
+    }
+
+    // Payload storage is final now, let records point into it
+    const uint8_t* pPayloads = reinterpret_cast<const uint8_t*> (pChunkOut->payloadStorage.data ());
+    for (size_t i = 0; i < pChunkOut->records.size (); ++i)
+        pChunkOut->records[i].m_pUserData = pPayloads + m_payloadOffsets[i];
+
+    m_pChunk = nullptr;
+}
+
+DWORD SyntheticKernelStream::AllocateID ()
+{
+    if (m_freeIDs.empty ())
+        Fail ("Synthetic kernel stream ran out of process/thread IDs!");
+
+    const DWORD id = m_freeIDs.front ();
+    m_freeIDs.pop_front ();
+
+    return id;
+}
+
+void SyntheticKernelStream::FreeID (DWORD id)
+{
+    m_freeIDs.push_back (id);
+}
+
+SyntheticKernelStream::Thread SyntheticKernelStream::PickThread ()
+{
+    if (m_random.NextDouble () < m_config.targetShare || m_otherThreads.empty ())
+        return m_targetThreads[m_random.NextBelow (m_targetThreads.size ())];
+    else
+        return m_otherThreads[m_random.NextBelow (m_otherThreads.size ())];
+}
+
+void SyntheticKernelStream::EmitRundown ()
+{
+    const Thread targetProcessThread = { m_targetPID, m_targetThreads.front ().tid };
+
+    EmitEvent (EventTraceEventGuid, kEventTraceHeaderOpcode, targetProcessThread, uint64_t (0), 272, Expectation::Keep);
+
+    EmitEvent (ProcessGuid,
+               ETWP::ETWConstants::PDCStartOpcode,
+               targetProcessThread,
+               ProcessDataStub { kKernelAddressBase + m_targetPID, m_targetPID, 0 },
+               kProcessSize,
+               Expectation::Keep);
+
+    for (const DWORD pid : m_otherPIDs) {
+        EmitEvent (ProcessGuid,
+                   ETWP::ETWConstants::PDCStartOpcode,
+                   { pid, 0 },
+                   ProcessDataStub { kKernelAddressBase + pid, pid, 0 },
+                   kProcessSize,
+                   Expectation::Drop);
+    }
+
+    for (const std::vector<Thread>* pThreads : { &m_targetThreads, &m_otherThreads }) {
+        for (const Thread& thread : *pThreads) {
+            EmitEvent (ThreadGuid,
+                       ETWP::ETWConstants::TDCStartOpcode,
+                       thread,
+                       ThreadDataStub { thread.pid, thread.tid },
+                       kThreadSize,
+                       ExpectKeepIf (thread.pid == m_targetPID));
+        }
+    }
+
+    // A couple of user mode images for each process, and some drivers
+    std::vector<DWORD> pids = m_otherPIDs;
+    pids.push_back (m_targetPID);
+    for (const DWORD pid : pids) {
+        for (uint32_t i = 0; i < 4; ++i) {
+            const ETWP::ETWConstants::ImageLoadDataStub imageLoad = { kUserAddressBase + i * 0x100000, 0x80000, pid };
+            EmitEvent (ImageLoadGuid,
+                       kImageDCStartOpcode,
+                       { pid, 0 },
+                       imageLoad,
+                       kImageLoadSize,
+                       ExpectKeepIf (pid == m_targetPID));
+        }
+    }
+
+    for (uint32_t i = 0; i < 64; ++i) {
+        const ETWP::ETWConstants::ImageLoadDataStub imageLoad = { kKernelAddressBase + i * 0x100000, 0x80000, 0 };
+        EmitEvent (ImageLoadGuid, kImageDCStartOpcode, { 0, 0 }, imageLoad, kImageLoadSize, Expectation::Keep);
+    }
+}
+
+void SyntheticKernelStream::EmitSample ()
+{
+    const uint32_t cpu = static_cast<uint32_t> (m_nSamples % m_config.cpus);
+    const Thread& thread = m_runningThreads[cpu];
+
+    const bool kernelMode = m_random.NextDouble () < 0.3;
+    const UINT_PTR ip = (kernelMode ? kKernelAddressBase : kUserAddressBase) + m_random.NextBelow (0x1000000);
+
+    EmitEvent (PerfInfoGuid,
+               ETWP::ETWConstants::SampledProfileOpcode,
+               thread,
+               ETWP::ETWConstants::SampledProfileDataStub { ip, thread.tid },
+               kSampledProfileSize,
+               ExpectKeepIf (thread.pid == m_targetPID));
+    m_pChunk->records.back ().m_processorNumber = static_cast<UCHAR> (cpu);
+
+    EmitStack (thread, ExpectKeepIf (thread.pid == m_targetPID));
+
+    ++m_nSamples;
+    m_timestamp += m_timestampStep;
+}
+
+void SyntheticKernelStream::EmitContextSwitch ()
+{
+    const uint32_t cpu = static_cast<uint32_t> (m_random.NextBelow (m_config.cpus));
+    const Thread oldThread = m_runningThreads[cpu];
+    const Thread newThread = PickThread ();
+    m_runningThreads[cpu] = newThread;
+
+    if (m_random.NextDouble () < 0.5) {
+        const ETWP::ETWConstants::ReadyThreadDataStub readyThread = { newThread.tid, 0, 0, 0, 0 };
+        EmitEvent (ThreadGuid, ETWP::ETWConstants::ReadyThreadOpcode, oldThread, readyThread, kReadyThreadSize);
+        EmitStack (oldThread, ExpectKeepIf (oldThread.pid == m_targetPID));
+    }
+
+    EmitEvent (ThreadGuid,
+               ETWP::ETWConstants::CSwitchOpcode,
+               newThread,
+               ETWP::ETWConstants::CSwitchDataStub { newThread.tid, oldThread.tid },
+               kCSwitchSize);
+    EmitStack (newThread, ExpectKeepIf (newThread.pid == m_targetPID));
+}
+
+void SyntheticKernelStream::EmitProcessChurn ()
+{
+    using namespace ETWP::ETWConstants;
+
+    // End short-lived processes whose time has come
+    for (auto it = m_shortLivedProcesses.begin (); it != m_shortLivedProcesses.end ();) {
+        if (it->endSample > m_nSamples) {
+            ++it;
+
+            continue;
+        }
+
+        for (const DWORD tid : it->tids) {
+            const Thread thread = { it->pid, tid };
+            EmitEvent (ThreadGuid, TEndOpcode, thread, ThreadDataStub { it->pid, tid }, kThreadSize, Expectation::Drop);
+
+            std::erase_if (m_otherThreads, [tid] (const Thread& t) { return t.tid == tid; });
+            for (Thread& runningThread : m_runningThreads) {
+                if (runningThread.tid == tid)
+                    runningThread = PickThread ();
+            }
+
+            FreeID (tid);
+        }
+
+        EmitEvent (ProcessGuid,
+                   PEndOpcode,
+                   { it->pid, 0 },
+                   ProcessDataStub { kKernelAddressBase + it->pid, it->pid, m_otherPIDs.front () },
+                   kProcessSize,
+                   Expectation::Drop);
+        FreeID (it->pid);
+
+        it = m_shortLivedProcesses.erase (it);
+    }
+
+    if (m_random.NextDouble () >= m_config.pidChurn / 1'000)
+        return;
+
+    // Start a short-lived process, with a couple of threads and image loads
+    ShortLivedProcess process = { AllocateID (), {}, m_nSamples + 100 + m_random.NextBelow (2'000) };
+    const DWORD parentPID = m_otherPIDs[m_random.NextBelow (m_otherPIDs.size ())];
+    EmitEvent (ProcessGuid,
+               PStartOpcode,
+               { parentPID, 0 },
+               ProcessDataStub { kKernelAddressBase + process.pid, process.pid, parentPID },
+               kProcessSize,
+               Expectation::Drop);
+
+    const uint64_t nThreads = 1 + m_random.NextBelow (4);
+    for (uint64_t i = 0; i < nThreads; ++i) {
+        const Thread thread = { process.pid, AllocateID () };
+        EmitEvent (ThreadGuid,
+                   TStartOpcode,
+                   thread,
+                   ThreadDataStub { thread.pid, thread.tid },
+                   kThreadSize,
+                   Expectation::Drop);
+
+        process.tids.push_back (thread.tid);
+        m_otherThreads.push_back (thread);
+    }
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        const ETWP::ETWConstants::ImageLoadDataStub imageLoad = { kUserAddressBase + i * 0x100000,
+                                                                  0x80000,
+                                                                  process.pid };
+        EmitEvent (ImageLoadGuid,
+                   kImageLoadOpcode,
+                   { process.pid, process.tids.front () },
+                   imageLoad,
+                   kImageLoadSize,
+                   Expectation::Drop);
+    }
+
+    m_shortLivedProcesses.push_back (std::move (process));
+
+    // The target process is not static either: replace one of its threads every now and then
+    if (m_random.NextDouble () < 0.25) {
+        const size_t index = m_random.NextBelow (m_targetThreads.size ());
+        const Thread endedThread = m_targetThreads[index];
+        EmitEvent (ThreadGuid,
+                   TEndOpcode,
+                   endedThread,
+                   ThreadDataStub { endedThread.pid, endedThread.tid },
+                   kThreadSize,
+                   Expectation::Keep);
+
+        const Thread startedThread = { m_targetPID, AllocateID () };
+        EmitEvent (ThreadGuid,
+                   TStartOpcode,
+                   startedThread,
+                   ThreadDataStub { startedThread.pid, startedThread.tid },
+                   kThreadSize,
+                   Expectation::Keep);
+
+        m_targetThreads[index] = startedThread;
+        for (Thread& runningThread : m_runningThreads) {
+            if (runningThread.tid == endedThread.tid)
+                runningThread = startedThread;
+        }
+
+        FreeID (endedThread.tid);
+    }
+}
+
+void SyntheticKernelStream::EmitUserProviderEvent ()
+{
+    const size_t providerIndex = m_random.NextBelow (m_userProviderIDs.size ());
+    const Thread thread = PickThread ();
+
+    EmitEvent (m_userProviderIDs[providerIndex],
+               0,
+               thread,
+               m_nSamples,
+               kUserEventSize,
+               ExpectKeepIf (providerIndex == 0 && thread.pid == m_targetPID));
+}
+
+void SyntheticKernelStream::EmitNoise ()
+{
+    const NoiseEventType& type = kNoiseEventTypes[m_random.NextBelow (std::size (kNoiseEventTypes))];
+
+    EmitEvent (type.providerID, type.opcode, PickThread (), m_nSamples, kNoiseEventSize, Expectation::Drop);
+}
+
+void SyntheticKernelStream::EmitStack (const Thread& thread, Expectation expectation)
+{
+    using namespace ETWP::ETWConstants;
+
+    if (m_config.stackKeys == 0) {
+        EmitEvent (StackWalkGuid,
+                   StackWalkOpcode,
+                   thread,
+                   StackWalkDataStub { uint64_t (m_timestamp), thread.pid, thread.tid },
+                   kStackWalkHeaderSize + m_config.stackDepth * sizeof (UINT_PTR),
+                   expectation);
+
+        return;
+    }
+
+    const UINT_PTR key = kStackKeyBase + m_random.NextBelow (m_config.stackKeys) * 64;
+    const bool kernelKey = m_random.NextDouble () < 0.3;
+    EmitEvent (StackWalkGuid,
+               kernelKey ? StackKeyKernelOpcode : StackKeyUserOpcode,
+               thread,
+               StackKeyReference { uint64_t (m_timestamp), thread.pid, thread.tid, key },
+               kStackKeyReferenceSize,
+               expectation);
+
+    // The stack cache evicts keys every now and then (the definition of a key comes with its deletion)
+    if (m_random.NextDouble () < 0.01) {
+        const UINT_PTR evictedKey = kStackKeyBase + m_random.NextBelow (m_config.stackKeys) * 64;
+        EmitEvent (StackWalkGuid,
+                   StackWalkKeyDeleteOpcode,
+                   { 0, 0 },
+                   StackKeyDefinition { evictedKey },
+                   sizeof (StackKeyDefinition) + m_config.stackDepth * sizeof (UINT_PTR));
+    }
+}
+
+void SyntheticKernelStream::EmitEvent (const GUID& providerID,
+                                       UCHAR opcode,
+                                       const Thread& thread,
+                                       const void* pPayload,
+                                       size_t payloadSize,
+                                       size_t totalPayloadSize,
+                                       Expectation expectation)
+{
+    totalPayloadSize = std::max (totalPayloadSize, payloadSize);
+
+    // Keep payloads 8-byte aligned, just like ETW does
+    const size_t offset = m_pChunk->payloadStorage.size () * sizeof (uint64_t);
+    m_pChunk->payloadStorage.resize (m_pChunk->payloadStorage.size () + (totalPayloadSize + 7) / 8);
+    std::memcpy (reinterpret_cast<uint8_t*> (m_pChunk->payloadStorage.data ()) + offset, pPayload, payloadSize);
+    m_pChunk->payloadBytes += totalPayloadSize;
+    m_payloadOffsets.push_back (offset);
+
+    ETWP::EventRecordLayout record = {};
+    record.m_header.m_size = static_cast<USHORT> (sizeof (ETWP::EventHeaderLayout) + totalPayloadSize);
+    record.m_header.m_threadID = thread.tid;
+    record.m_header.m_processID = thread.pid;
+    record.m_header.m_timeStamp = m_timestamp;
+    record.m_header.m_providerID = providerID;
+    record.m_header.m_opcode = opcode;
+    // Kernel events are classic (MOF) events
+    if (std::find (m_userProviderIDs.begin (), m_userProviderIDs.end (), providerID) == m_userProviderIDs.end ())
+        record.m_header.m_flags = ETWP::ETLFormat::kEventHeaderFlagClassicHeader;
+
+    record.m_userDataLength = static_cast<USHORT> (totalPayloadSize);
+
+    m_pChunk->records.push_back (record);
+    m_pChunk->expectations.push_back (expectation);
+}
+
+}   // namespace EPB
\ No newline at end of file
@@ -0,0 +1,141 @@
+#ifndef EPB_SYNTHETIC_KERNEL_STREAM_HPP
+#define EPB_SYNTHETIC_KERNEL_STREAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "BenchmarkRegistrar.hpp"
+#include "Utility.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+namespace EPB {
+
+struct SyntheticKernelStreamConfig {
+    uint32_t threads;           // Number of threads alive system-wide (including the target's)
+    uint32_t processes;         // Number of processes alive system-wide (including the target)
+    uint32_t targetThreads;     // Number of threads of the profiled process
+    double   targetShare;       // Share of CPU time the profiled process gets
+    uint32_t cpus;
+    uint32_t sampleRate;        // Samples/s, per CPU (this determines timestamps only)
+    double   cswitchRatio;      // Context switches per sample
+    uint32_t stackDepth;        // Frames per stack
+    uint32_t stackKeys;         // If not zero, the stack cache is used, with this many distinct stack keys
+    double   pidChurn;          // Short-living processes started per 1000 samples
+    uint32_t userProviders;     // Number of user providers, only the first one is enabled
+    double   userRatio;         // User provider events per sample
+    double   noiseRatio;        // Other, uninteresting kernel events (DPCs, disk I/O, etc.) per sample
+    uint64_t seed;
+
+    // Reads all members from benchmark parameters (see the default values in the implementation)
+    static SyntheticKernelStreamConfig FromParameters (const Parameters& parameters);
+};
+
+// Generates a realistic, endless stream of kernel events of a busy machine, as seen by the per-event filter: rundown
+//   (DCStart) events first, then samples with stacks, context switches, thread and process lifetime events, user
+//   provider events and noise, in chunks. Events are EVENT_RECORD-like structures, with payloads of realistic size.
+// For some events (samples and stacks of live threads), the generator knows whether the filter should keep them, so
+//   benchmarks can check the filter's decisions, as well
+class SyntheticKernelStream final {
+public:
+    enum class Expectation : uint8_t {
+        Unknown,
+        Keep,
+        Drop
+    };
+
+    struct Chunk {
+        std::vector<ETWP::EventRecordLayout> records;
+        std::vector<Expectation>             expectations;
+        std::vector<uint64_t>                payloadStorage;    // Payloads of records point into this
+        size_t                               payloadBytes;
+
+        void Clear ();
+    };
+
+    explicit SyntheticKernelStream (const SyntheticKernelStreamConfig& config);
+
+    DWORD             GetTargetPID () const;
+    std::vector<GUID> GetEnabledUserProviderIDs () const;
+    bool              UsesStackCache () const;
+
+    // Generates (roughly) nEvents events; the first chunk starts with rundown events
+    void GenerateChunk (size_t nEvents, Chunk* pChunkOut);
+
+private:
+    struct Thread {
+        DWORD pid;
+        DWORD tid;
+    };
+
+    struct ShortLivedProcess {
+        DWORD              pid;
+        std::vector<DWORD> tids;
+        uint64_t           endSample;
+    };
+
+    SyntheticKernelStreamConfig    m_config;
+    Random                         m_random;
+    DWORD                          m_targetPID;
+    std::vector<Thread>            m_targetThreads;
+    std::vector<Thread>            m_otherThreads;
+    std::vector<DWORD>             m_otherPIDs;
+    std::vector<ShortLivedProcess> m_shortLivedProcesses;
+    std::vector<Thread>            m_runningThreads;   // Per CPU
+    std::deque<DWORD>              m_freeIDs;          // Windows reuses PIDs and TIDs, and so do we
+    std::vector<GUID>              m_userProviderIDs;
+    uint64_t                       m_nSamples;
+    int64_t                        m_timestamp;
+    int64_t                        m_timestampStep;
+    bool                           m_rundownDone;
+
+    // Used during generation only
+    Chunk*                         m_pChunk;
+    std::vector<size_t>            m_payloadOffsets;
+
+    DWORD  AllocateID ();
+    void   FreeID (DWORD id);
+    Thread PickThread ();
+
+    void EmitRundown ();
+    void EmitSample ();
+    void EmitContextSwitch ();
+    void EmitProcessChurn ();
+    void EmitUserProviderEvent ();
+    void EmitNoise ();
+    void EmitStack (const Thread& thread, Expectation expectation);
+
+    void EmitEvent (const GUID& providerID,
+                    UCHAR opcode,
+                    const Thread& thread,
+                    const void* pPayload,
+                    size_t payloadSize,
+                    size_t totalPayloadSize,
+                    Expectation expectation);
+
+    template<typename Payload>
+    void EmitEvent (const GUID& providerID,
+                    UCHAR opcode,
+                    const Thread& thread,
+                    const Payload& payload,
+                    size_t totalPayloadSize,
+                    Expectation expectation = Expectation::Unknown);
+};
+
+template<typename Payload>
+void SyntheticKernelStream::EmitEvent (const GUID& providerID,
+                                       UCHAR opcode,
+                                       const Thread& thread,
+                                       const Payload& payload,
+                                       size_t totalPayloadSize,
+                                       Expectation expectation /*= Expectation::Unknown*/)
+{
+    EmitEvent (providerID, opcode, thread, &payload, sizeof payload, totalPayloadSize, expectation);
+}
+
+}   // namespace EPB
+
+#endif  // #ifndef EPB_SYNTHETIC_KERNEL_STREAM_HPP
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "Utility.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif  // #ifdef _WIN32
+
+namespace EPB {
+
+Stopwatch::Stopwatch (): m_start (std::chrono::steady_clock::now ())
+{
+}
+
+void Stopwatch::Restart ()
+{
+    m_start = std::chrono::steady_clock::now ();
+}
+
+double Stopwatch::GetElapsedNs () const
+{
+    return std::chrono::duration<double, std::nano> (std::chrono::steady_clock::now () - m_start).count ();
+}
+
+Random::Random (uint64_t seed): m_state (seed == 0 ? 0x9e3779b97f4a7c15ULL : seed)
+{
+}
+
+uint64_t Random::Next ()
+{
+    m_state ^= m_state >> 12;
+    m_state ^= m_state << 25;
+    m_state ^= m_state >> 27;
+
+    return m_state * 0x2545f4914f6cdd1dULL;
+}
+
+uint64_t Random::NextBelow (uint64_t bound)
+{
+    return bound == 0 ? 0 : Next () % bound;
+}
+
+double Random::NextDouble ()
+{
+    return (Next () >> 11) * (1.0 / 9007199254740992.0);    // 53 bits of randomness
+}
+
+void PrintHeader (const std::string& title)
+{
+    std::printf ("\n== %s ==\n", title.c_str ());
+}
+
+void PrintResult (const std::string& name, double nsPerOperation, const std::string& comment /*= ""*/)
+{
+    std::printf ("  %-40s %10.2f ns/op  %s\n", name.c_str (), nsPerOperation, comment.c_str ());
+}
+
+std::string FormatSpeedup (double baselineNs, double ns)
+{
+    char buffer[64];
+    std::snprintf (buffer, sizeof buffer, "speedup: %.2fx", ns > 0 ? baselineNs / ns : 0.0);
+
+    return buffer;
+}
+
+double GetPercentile (std::vector<double>* pValues, double p)
+{
+    if (pValues->empty ())
+        return 0.0;
+
+    std::sort (pValues->begin (), pValues->end ());
+    const size_t index = static_cast<size_t> (p / 100.0 * (pValues->size () - 1) + 0.5);
+
+    return (*pValues)[std::min (index, pValues->size () - 1)];
+}
+
+size_t GetPeakMemoryUsage ()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo (GetCurrentProcess (), &counters, sizeof counters))
+        return 0;
+
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage = {};
+    if (getrusage (RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return static_cast<size_t> (usage.ru_maxrss) * 1'024;  // In KiB on Linux
+#endif  // #ifdef _WIN32
+}
+
+[[noreturn]] void Fail (const std::string& msg)
+{
+    std::fprintf (stderr, "ERROR: %s\n", msg.c_str ());
+
+    std::exit (EXIT_FAILURE);
+}
+
+}   // namespace EPB
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef EPB_UTILITY_HPP
+#define EPB_UTILITY_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace EPB {
+
+class Stopwatch {
+public:
+    Stopwatch ();
+
+    void   Restart ();
+    double GetElapsedNs () const;
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Deterministic, fast PRNG (xorshift64*), so results are reproducible across runs and platforms
+class Random {
+public:
+    explicit Random (uint64_t seed);
+
+    uint64_t Next ();
+    uint64_t NextBelow (uint64_t bound);
+    double   NextDouble ();  // [0, 1)
+
+private:
+    uint64_t m_state;
+};
+
+void PrintHeader (const std::string& title);
+void PrintResult (const std::string& name, double nsPerOperation, const std::string& comment = "");
+
+std::string FormatSpeedup (double baselineNs, double ns);
+
+// Sorts values. p is in [0, 100]
+double GetPercentile (std::vector<double>* pValues, double p);
+
+size_t GetPeakMemoryUsage ();  // Peak resident set size/working set of the process, in bytes
+
+[[noreturn]] void Fail (const std::string& msg);
+
+}   // namespace EPB
+
+#endif  // #ifndef EPB_UTILITY_HPP
\ No newline at end of file
@@ -0,0 +1,252 @@
+/*
+  This small utility program cuts existing (e.g. system-wide, captured with xperf) ETL files down to the events etwprof
+    would have recorded when profiling the target processes. It does not depend on Windows, so traces can be filtered
+    on any machine.
+
+  See FilterETLFile in Profiler/OfflineFilter.hpp for details.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <string>
+
+#include "Profiler/OfflineFilter.hpp"
+
+namespace {
+
+void Usage ()
+{
+    std::fprintf (stderr,
+                  "Usage: etwprof_filter --input=<ETL_path> --output=<ETL_path> --target=<PID_or_name> "
+                  "[--target=<PID_or_name>...] [--children] [--cswitch] [--provider=<GUID>...] [--threads=<n>] "
+                  "[--compress] [--images=<dir> [--imagecache=<file>]] [--reorder=<ms>] [--stats] "
+                  "[--statsjson=<file>]\n"
+                  "\n"
+                  "  --input=<i>     ETL file to filter (64-bit trace, e.g. captured with xperf)\n"
+                  "  --output=<o>    Filtered ETL file to write\n"
+                  "  --target=<t>    Process to keep events of (PID or image name, e.g. notepad.exe)\n"
+                  "  --children      Keep events of child processes (started during the trace), as well\n"
+                  "  --cswitch       Keep context switch events as well\n"
+                  "  --provider=<p>  Keep events of this user provider (of the target processes), as well\n"
+                  "  --threads=<n>   Number of decoding threads [default: one per logical processor]\n"
+                  "  --compress      Compress the output with xz while it's written (e.g. --output=trace.etl.xz)\n"
+                  "  --images=<d>    Add image identity events (needed for symbol lookup), read from the images\n"
+                  "                  (.exe, .dll, .sys, etc.) in this directory, looked up by file name\n"
+                  "  --imagecache=<f>\n"
+                  "                  Cache image identities in this file, so unchanged images are not read again\n"
+                  "  --reorder=<r>   Hold back events of unknown threads this long (in ms), in case their thread\n"
+                  "                  start comes later\n"
+                  "  --stats         Print the number of events (and bytes) kept and dropped per provider and opcode\n"
+                  "  --statsjson=<f> Write the same statistics into this JSON file\n");
+}
+
+std::wstring Widen (const std::string& string)
+{
+    // Image names are matched in ASCII, characters outside of it never match anyways
+    return std::wstring (string.begin (), string.end ());
+}
+
+bool ParseGUID (const std::string& string, GUID* pGUIDOut)
+{
+    const size_t braces = !string.empty () && string.front () == '{' ? 1 : 0;
+    if (string.size () != 36 + 2 * braces || (braces != 0 && string.back () != '}'))
+        return false;
+
+    unsigned int data[11];
+    int nCharsRead = 0;
+    if (std::sscanf (string.c_str () + braces,
+                     "%8x-%4x-%4x-%2x%2x-%2x%2x%2x%2x%2x%2x%n",
+                     &data[0], &data[1], &data[2], &data[3], &data[4], &data[5],
+                     &data[6], &data[7], &data[8], &data[9], &data[10], &nCharsRead) != 11 ||
+        nCharsRead != 36)
+    {
+        return false;
+    }
+
+    pGUIDOut->Data1 = data[0];
+    pGUIDOut->Data2 = static_cast<uint16_t> (data[1]);
+    pGUIDOut->Data3 = static_cast<uint16_t> (data[2]);
+    for (size_t i = 0; i < 8; ++i)
+        pGUIDOut->Data4[i] = static_cast<uint8_t> (data[3 + i]);
+
+    return true;
+}
+
+// Images are looked up by their file name (the directories in the trace are of the traced machine)
+std::filesystem::path TranslateImagePath (const std::filesystem::path& imageDirectory, const std::wstring& imagePath)
+{
+    const size_t lastSeparator = imagePath.find_last_of (L"\\/");
+    if (lastSeparator == std::wstring::npos)
+        return imageDirectory / imagePath;
+
+    return imageDirectory / imagePath.substr (lastSeparator + 1);
+}
+
+bool IsPID (const std::string& string)
+{
+    return !string.empty () && string.find_first_not_of ("0123456789") == std::string::npos;
+}
+
+bool ParseArguments (int argc,
+                     char* argv[],
+                     std::string* pInputPathOut,
+                     std::string* pOutputPathOut,
+                     ETWP::OfflineFilterOptions* pOptionsOut,
+                     bool* pPrintStatsOut,
+                     std::string* pStatsPathOut)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const size_t equalsSignPos = arg.find ('=');
+        const std::string name = arg.substr (0, equalsSignPos);
+        const std::string value = equalsSignPos == std::string::npos ? "" : arg.substr (equalsSignPos + 1);
+
+        if (name == "--input") {
+            *pInputPathOut = value;
+        } else if (name == "--output") {
+            *pOutputPathOut = value;
+        } else if (name == "--target" && IsPID (value)) {
+            pOptionsOut->targetPIDs.push_back (static_cast<ETWP::PID> (std::stoul (value)));
+        } else if (name == "--target" && !value.empty ()) {
+            pOptionsOut->targetNames.push_back (Widen (value));
+        } else if (arg == "--children") {
+            pOptionsOut->profileChildren = true;
+        } else if (arg == "--cswitch") {
+            pOptionsOut->cswitch = true;
+        } else if (arg == "--compress") {
+            pOptionsOut->compress = true;
+        } else if (name == "--provider") {
+            GUID providerID;
+            if (!ParseGUID (value, &providerID)) {
+                std::fprintf (stderr, "Invalid provider GUID: \"%s\"!\n", value.c_str ());
+
+                return false;
+            }
+
+            pOptionsOut->userProviderIDs.push_back (providerID);
+        } else if (name == "--images" && !value.empty ()) {
+            const std::filesystem::path imageDirectory = value;
+            pOptionsOut->imagePathTranslator = [imageDirectory] (const std::wstring& imagePath) {
+                return TranslateImagePath (imageDirectory, imagePath);
+            };
+        } else if (name == "--imagecache" && !value.empty ()) {
+            pOptionsOut->imageCachePath = value;
+        } else if (arg == "--stats") {
+            *pPrintStatsOut = true;
+        } else if (name == "--statsjson" && !value.empty ()) {
+            *pStatsPathOut = value;
+        } else if (name == "--threads" && IsPID (value)) {
+            pOptionsOut->nThreads = static_cast<uint32_t> (std::stoul (value));
+        } else if (name == "--reorder" && IsPID (value)) {
+            pOptionsOut->reorder.window = static_cast<uint32_t> (std::stoul (value));
+        } else {
+            std::fprintf (stderr, "Invalid parameter: \"%s\"!\n", arg.c_str ());
+
+            return false;
+        }
+    }
+
+    if (pInputPathOut->empty () || pOutputPathOut->empty ()) {
+        std::fprintf (stderr, "Input and output paths are required!\n");
+
+        return false;
+    }
+
+    if (pOptionsOut->targetPIDs.empty () && pOptionsOut->targetNames.empty ()) {
+        std::fprintf (stderr, "At least one target is required!\n");
+
+        return false;
+    }
+
+    return true;
+}
+
+}   // namespace
+
+int main (int argc, char* argv[])
+{
+    std::string inputPath;
+    std::string outputPath;
+    ETWP::OfflineFilterOptions options;
+    bool printStats = false;
+    std::string statsPath;
+    try {
+        if (!ParseArguments (argc, argv, &inputPath, &outputPath, &options, &printStats, &statsPath)) {
+            Usage ();
+
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception&) {   // E.g. out of range numeric parameters
+        std::fprintf (stderr, "Invalid numeric parameter!\n");
+
+        return EXIT_FAILURE;
+    }
+
+    const auto start = std::chrono::steady_clock::now ();
+
+    ETWP::OfflineFilterStats stats;
+    std::wstring errorMsg;
+    if (!ETWP::FilterETLFile (inputPath, outputPath, options, &stats, &errorMsg)) {
+        std::fprintf (stderr, "Filtering failed: %ls\n", errorMsg.c_str ());
+
+        return EXIT_FAILURE;
+    }
+
+    const double elapsedSec = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+    std::printf ("Events:    %llu read, %llu kept (%.1f%%)\n",
+                 static_cast<unsigned long long> (stats.nEventsRead),
+                 static_cast<unsigned long long> (stats.nEventsKept),
+                 stats.nEventsRead == 0 ? 0.0 : 100.0 * stats.nEventsKept / stats.nEventsRead);
+    std::printf ("Processes: %u matched by name, %u child processes\n",
+                 stats.nProcessesMatchedByName,
+                 stats.nChildProcesses);
+    std::printf ("Output:    %.2f MB (%llu events lost)\n",
+                 stats.writerStats.nBytesWritten / (1'024.0 * 1'024.0),
+                 static_cast<unsigned long long> (stats.writerStats.nEventsLost));
+    if (options.compress) {
+        std::printf ("           %.2f MB compressed (%.1f%%)\n",
+                     stats.writerStats.nCompressedBytesWritten / (1'024.0 * 1'024.0),
+                     stats.writerStats.nBytesWritten == 0 ?
+                         0.0 :
+                         100.0 * stats.writerStats.nCompressedBytesWritten / stats.writerStats.nBytesWritten);
+    }
+    if (options.imagePathTranslator != nullptr) {
+        std::printf ("Images:    %u resolved (%u from cache), %u not found, %llu identity events\n",
+                     stats.imageResolverStats.nResolved,
+                     stats.imageResolverStats.nFromCache,
+                     stats.imageResolverStats.nUnresolved,
+                     static_cast<unsigned long long> (stats.imageIdentityStats.nIdentityEventsWritten));
+    }
+
+    if (options.reorder.IsEnabled ()) {
+        std::printf ("Reorder:   %llu events recovered (of %llu held back), %llu rejected, %llu expired, "
+                     "%llu evicted\n",
+                     static_cast<unsigned long long> (stats.reorderStats.nRecovered),
+                     static_cast<unsigned long long> (stats.reorderStats.nHeld),
+                     static_cast<unsigned long long> (stats.reorderStats.nRejected),
+                     static_cast<unsigned long long> (stats.reorderStats.nExpired),
+                     static_cast<unsigned long long> (stats.reorderStats.nEvicted));
+    }
+
+    std::printf ("Time:      %.2f s (%.1f MB/s)\n",
+                 elapsedSec,
+                 elapsedSec == 0 ? 0.0 : stats.nBytesRead / (1'024.0 * 1'024.0) / elapsedSec);
+
+    if (printStats) {
+        std::printf ("\n");
+        for (const std::wstring& line : ETWP::FormatFilterStats (stats.filterStats, 20))
+            std::printf ("%ls\n", line.c_str ());
+    }
+
+    if (!statsPath.empty () && !stats.filterStats.WriteJSON (statsPath, &errorMsg)) {
+        std::fprintf (stderr, "%ls\n", errorMsg.c_str ());
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "TestEvents.hpp"
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+
+namespace EUT {
+
+namespace ETWConstants = ETWP::ETWConstants;
+
+ETWP::EventView TestEvent::GetView ()
+{
+    record.m_pUserData = payload.data ();
+    record.m_userDataLength = static_cast<USHORT> (payload.size ());
+    record.m_pExtendedData = extendedData.empty () ? nullptr : extendedData.data ();
+    record.m_extendedDataCount = static_cast<USHORT> (extendedData.size ());
+
+    return ETWP::EventView (record);
+}
+
+TestEvent MakeEvent (const GUID& providerID, UCHAR opcode, int64_t timeStamp, DWORD pid, DWORD tid, UCHAR processor)
+{
+    TestEvent event = {};
+    event.record.m_header.m_flags = ETWP::ETLFormat::kEventHeaderFlagClassicHeader;
+    event.record.m_header.m_providerID = providerID;
+    event.record.m_header.m_opcode = opcode;
+    event.record.m_header.m_version = 2;
+    event.record.m_header.m_processID = pid;
+    event.record.m_header.m_threadID = tid;
+    event.record.m_header.m_timeStamp = timeStamp;
+    event.record.m_processorNumber = processor;
+
+    return event;
+}
+
+TestEvent MakeProcessEvent (UCHAR opcode, DWORD pid, int64_t timeStamp)
+{
+    TestEvent event = MakeEvent (ProcessGuid, opcode, timeStamp, pid, 0);
+    Append (&event.payload, uint64_t (0xFFFF'A000'0000'0000 + pid));   // UniqueProcessKey
+    Append (&event.payload, pid);
+    Append (&event.payload, uint32_t (4));                              // ParentId
+    Append (&event.payload, uint64_t (0));
+
+    return event;
+}
+
+TestEvent MakeThreadEvent (UCHAR opcode, DWORD pid, DWORD tid, int64_t timeStamp)
+{
+    TestEvent event = MakeEvent (ThreadGuid, opcode, timeStamp, pid, tid);
+    Append (&event.payload, pid);
+    Append (&event.payload, tid);
+    Append (&event.payload, uint64_t (0));
+
+    return event;
+}
+
+TestEvent MakeImageEvent (UCHAR opcode,
+                          DWORD pid,
+                          uint64_t imageBase,
+                          uint64_t imageSize,
+                          const std::wstring& fileName,
+                          int64_t timeStamp)
+{
+    TestEvent event = MakeEvent (ImageLoadGuid, opcode, timeStamp, pid, 0);
+    Append (&event.payload, imageBase);
+    Append (&event.payload, imageSize);
+    Append (&event.payload, pid);
+    Append (&event.payload, uint32_t (0));              // ImageChecksum
+    Append (&event.payload, uint32_t (0x5E0B'1A2C));    // TimeDateStamp
+    event.payload.resize (56);                          // FileName follows the reserved fields
+    for (const wchar_t c : fileName)
+        Append (&event.payload, static_cast<char16_t> (c));
+
+    Append (&event.payload, char16_t (0));
+
+    return event;
+}
+
+TestEvent MakeSampleEvent (DWORD pid, DWORD tid, uint64_t ip, int64_t timeStamp, UCHAR processor)
+{
+    TestEvent event = MakeEvent (PerfInfoGuid, ETWConstants::SampledProfileOpcode, timeStamp, pid, tid, processor);
+    Append (&event.payload, ip);
+    Append (&event.payload, tid);
+    Append (&event.payload, uint32_t (1));  // Count
+
+    return event;
+}
+
+TestEvent MakeStackWalkEvent (DWORD pid,
+                              DWORD tid,
+                              const std::vector<uint64_t>& frames,
+                              int64_t sampleTimeStamp,
+                              UCHAR processor)
+{
+    TestEvent event = MakeEvent (StackWalkGuid, ETWConstants::StackWalkOpcode, sampleTimeStamp, pid, tid, processor);
+    Append (&event.payload, uint64_t (sampleTimeStamp));
+    Append (&event.payload, pid);
+    Append (&event.payload, tid);
+    for (const uint64_t frame : frames)
+        Append (&event.payload, frame);
+
+    return event;
+}
+
+TestEvent MakeCSwitchEvent (DWORD newTID, DWORD oldTID, int64_t timeStamp)
+{
+    TestEvent event = MakeEvent (ThreadGuid, ETWConstants::CSwitchOpcode, timeStamp, 0, 0);
+    Append (&event.payload, newTID);
+    Append (&event.payload, oldTID);
+
+    return event;
+}
+
+std::vector<uint64_t> MakeFrames (uint64_t firstIP, size_t nFrames)
+{
+    std::vector<uint64_t> frames;
+    frames.reserve (nFrames);
+    for (size_t i = 0; i < nFrames; ++i)
+        frames.push_back (firstIP + i);
+
+    return frames;
+}
+
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef EUT_TEST_EVENTS_HPP
+#define EUT_TEST_EVENTS_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+namespace EUT {
+
+template<typename T>
+void Append (std::vector<uint8_t>* pBytes, const T& value)
+{
+    const size_t oldSize = pBytes->size ();
+    pBytes->resize (oldSize + sizeof value);
+    std::memcpy (pBytes->data () + oldSize, &value, sizeof value);
+}
+
+// Owns the payload (and extended data) of the event it describes
+struct TestEvent {
+    ETWP::EventRecordLayout                    record;
+    std::vector<uint8_t>                       payload;
+    std::vector<ETWP::EventExtendedItemLayout> extendedData;
+
+    ETWP::EventView GetView ();
+};
+
+// A kernel (classic) event of the given process and thread, without payload
+TestEvent MakeEvent (const GUID& providerID,
+                     UCHAR opcode,
+                     int64_t timeStamp,
+                     DWORD pid,
+                     DWORD tid,
+                     UCHAR processor = 0);
+
+// Kernel events, with the leading part of their payload (what etwprof reads of them). The process and thread IDs in
+//   the header are set as well
+TestEvent MakeProcessEvent (UCHAR opcode, DWORD pid, int64_t timeStamp);    // Parent process is the System process
+TestEvent MakeThreadEvent (UCHAR opcode, DWORD pid, DWORD tid, int64_t timeStamp);
+TestEvent MakeImageEvent (UCHAR opcode,
+                          DWORD pid,
+                          uint64_t imageBase,
+                          uint64_t imageSize,
+                          const std::wstring& fileName,
+                          int64_t timeStamp);
+TestEvent MakeSampleEvent (DWORD pid, DWORD tid, uint64_t ip, int64_t timeStamp, UCHAR processor = 0);
+// Logged with the same timestamp as its sample
+TestEvent MakeStackWalkEvent (DWORD pid,
+                              DWORD tid,
+                              const std::vector<uint64_t>& frames,
+                              int64_t sampleTimeStamp,
+                              UCHAR processor = 0);
+TestEvent MakeCSwitchEvent (DWORD newTID, DWORD oldTID, int64_t timeStamp);
+
+// Consecutive instruction pointers, for stacks whose contents do not matter
+std::vector<uint64_t> MakeFrames (uint64_t firstIP, size_t nFrames);
+
+}   // namespace EUT
+
+#endif  // #ifndef EUT_TEST_EVENTS_HPP
\ No newline at end of file
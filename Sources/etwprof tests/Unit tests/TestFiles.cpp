@@ -0,0 +1,18 @@
+#include "TestFiles.hpp"
+
+#include <system_error>
+
+namespace EUT {
+
+TempFile::TempFile (const std::string& prefix, const std::string& fileName):
+    m_path (std::filesystem::temp_directory_path () / ("etwprof_unit_tests_" + prefix + "_" + fileName))
+{
+}
+
+TempFile::~TempFile ()
+{
+    std::error_code ec;
+    std::filesystem::remove (m_path, ec);
+}
+
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef EUT_TEST_FILES_HPP
+#define EUT_TEST_FILES_HPP
+
+#include <filesystem>
+#include <string>
+
+namespace EUT {
+
+// A file in the temporary directory, named "etwprof_unit_tests_<prefix>_<fileName>" (the prefix tells the suites
+//   apart). Deletes the file on destruction
+class TempFile final {
+public:
+    TempFile (const std::string& prefix, const std::string& fileName);
+    ~TempFile ();
+
+    const std::filesystem::path& GetPath () const { return m_path; }
+
+private:
+    std::filesystem::path m_path;
+};
+
+}   // namespace EUT
+
+#endif  // #ifndef EUT_TEST_FILES_HPP
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "TestRegistrar.hpp"
+
+namespace EUT {
+
+TestRegistrar& TestRegistrar::Instance ()
+{
+    static TestRegistrar instance;
+
+    return instance;
+}
+
+void TestRegistrar::Register (const std::string& name, const Test& test)
+{
+    m_testMap[name] = test;
+}
+
+void TestRegistrar::Enumerate (const Enumerator& enumerator) const
+{
+    for (auto& pair : m_testMap) {
+        if (!enumerator (pair.first, pair.second))
+            return;
+    }
+}
+
+TestRegistrator::TestRegistrator (const std::string& name, const Test& test)
+{
+    TestRegistrar::Instance ().Register (name, test);
+}
+
+TestFailure::TestFailure (const std::string& message): std::runtime_error (message)
+{
+}
+
+namespace Impl {
+
+void CheckFailed (const char* expression, const char* file, int line)
+{
+    throw TestFailure (std::string (file) + "(" + std::to_string (line) + "): check failed: " + expression);
+}
+
+}   // namespace Impl
+
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef EUT_TEST_REGISTRAR_HPP
+#define EUT_TEST_REGISTRAR_HPP
+
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+namespace EUT {
+
+using Test = std::function<void (void)>;
+
+class TestRegistrar {
+public:
+    using Enumerator = std::function<bool (const std::string&, const Test&)>;
+
+    static TestRegistrar& Instance ();
+
+    void Register (const std::string& name, const Test& test);
+
+    void Enumerate (const Enumerator& enumerator) const;
+
+private:
+    std::map<std::string, Test> m_testMap;
+};
+
+// Small helper class for registering tests
+class TestRegistrator {
+public:
+    TestRegistrator (const std::string& name, const Test& test);
+};
+
+// Thrown by failed checks, fails the test being run
+class TestFailure : public std::runtime_error {
+public:
+    explicit TestFailure (const std::string& message);
+};
+
+namespace Impl {
+
+[[noreturn]] void CheckFailed (const char* expression, const char* file, int line);
+
+}   // namespace Impl
+
+}   // namespace EUT
+
+#define EUT_CHECK(expr)                                                        \
+    if (!(expr))                                                               \
+        EUT::Impl::CheckFailed (#expr, __FILE__, __LINE__)
+
+#endif  // #ifndef EUT_TEST_REGISTRAR_HPP
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "TestSegments.hpp"
+
+#include <utility>
+
+namespace EUT {
+
+RecordedEvent RecordEvent (const ETWP::EventView& event)
+{
+    const uint8_t* pPayload = static_cast<const uint8_t*> (event.GetUserData ());
+    RecordedEvent recordedEvent = { event.GetProviderID (),
+                                    event.GetOpcode (),
+                                    event.GetTimestamp (),
+                                    event.GetProcessorNumber (),
+                                    std::vector<uint8_t> (pPayload, pPayload + event.GetUserDataLength ()),
+                                    {} };
+    if (event.GetExtendedDataCount () > 0) {
+        const ETWP::EventExtendedItemLayout& item = event.GetExtendedData ()[0];
+        const uint8_t* pData = reinterpret_cast<const uint8_t*> (item.m_dataPtr);
+        recordedEvent.extendedData.assign (pData, pData + item.m_dataSize);
+    }
+
+    return recordedEvent;
+}
+
+bool RecordingSink::WriteEvent (const ETWP::EventView& event)
+{
+    m_events.push_back (RecordEvent (event));
+
+    return true;
+}
+
+MemorySegment::MemorySegment (RecordedSegment* pSegment, bool fail): m_pSegment (pSegment), m_fail (fail)
+{
+}
+
+bool MemorySegment::Finish (std::wstring* pErrorOut)
+{
+    m_pSegment->finished = true;
+    m_pSegment->finisherID = std::this_thread::get_id ();
+    if (m_fail)
+        *pErrorOut = L"Finish failed";
+
+    return !m_fail;
+}
+
+bool MemorySegment::WriteEvent (const ETWP::EventView& event)
+{
+    m_pSegment->writerID = std::this_thread::get_id ();
+    m_pSegment->events.push_back (RecordEvent (event));
+
+    return true;
+}
+
+SegmentCollector::SegmentCollector (uint32_t failingSegmentNumber, uint32_t failingFinishSegmentNumber):
+    m_segments (),
+    m_failingSegmentNumber (failingSegmentNumber),
+    m_failingFinishSegmentNumber (failingFinishSegmentNumber),
+    m_failed (false),
+    m_nRequests (0)
+{
+}
+
+ETWP::OutputSegmentFactory SegmentCollector::GetFactory ()
+{
+    return [this] (uint32_t segmentNumber,
+                   int64_t startTimeStamp,
+                   std::wstring* pErrorOut) -> std::unique_ptr<ETWP::IOutputSegment>
+    {
+        ++m_nRequests;
+        if (segmentNumber == m_failingSegmentNumber && !m_failed) {
+            m_failed = true;
+            *pErrorOut = L"Create failed";
+
+            return nullptr;
+        }
+
+        m_segments.push_back (std::make_unique<RecordedSegment> ());
+        m_segments.back ()->segmentNumber = segmentNumber;
+        m_segments.back ()->startTimeStamp = startTimeStamp;
+
+        return std::make_unique<MemorySegment> (m_segments.back ().get (),
+                                                segmentNumber == m_failingFinishSegmentNumber);
+    };
+}
+
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,87 @@
+#ifndef EUT_TEST_SEGMENTS_HPP
+#define EUT_TEST_SEGMENTS_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+#include "Profiler/OutputRotation.hpp"
+#include "Profiler/RelogPipeline.hpp"
+
+namespace EUT {
+
+struct RecordedEvent {
+    GUID                 providerID;
+    UCHAR                opcode;
+    int64_t              timeStamp;
+    UCHAR                processorNumber;
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> extendedData;  // Of the first item only
+};
+
+RecordedEvent RecordEvent (const ETWP::EventView& event);
+
+// Collects the events written in memory
+class RecordingSink final : public ETWP::IEventSink {
+public:
+    virtual bool WriteEvent (const ETWP::EventView& event) override;
+
+    const std::vector<RecordedEvent>& GetEvents () const { return m_events; }
+
+private:
+    std::vector<RecordedEvent> m_events;
+};
+
+struct RecordedSegment {
+    uint32_t                   segmentNumber;
+    int64_t                    startTimeStamp;
+    std::vector<RecordedEvent> events;
+    bool                       finished = false;
+    std::thread::id            writerID;       // Of the last event
+    std::thread::id            finisherID;
+};
+
+// Collects the events of a segment in memory. Finishing it fails if fail is set (after recording it as finished)
+class MemorySegment final : public ETWP::IOutputSegment, public ETWP::IEventSink {
+public:
+    MemorySegment (RecordedSegment* pSegment, bool fail);
+
+    virtual ETWP::IEventSink* GetSink () override { return this; }
+    virtual uint64_t GetSize () const override { return 0; }
+
+    virtual bool Finish (std::wstring* pErrorOut) override;
+
+    virtual bool WriteEvent (const ETWP::EventView& event) override;
+
+private:
+    RecordedSegment* m_pSegment;
+    bool             m_fail;
+};
+
+// Creates MemorySegments, and keeps what they recorded. Creating segment number failingSegmentNumber fails (once),
+//   finishing segment number failingFinishSegmentNumber fails (0 means no failures)
+class SegmentCollector final {
+public:
+    explicit SegmentCollector (uint32_t failingSegmentNumber = 0, uint32_t failingFinishSegmentNumber = 0);
+
+    ETWP::OutputSegmentFactory GetFactory ();
+
+    // Must be called after the segments are finished only
+    const std::vector<std::unique_ptr<RecordedSegment>>& GetSegments () const { return m_segments; }
+    uint32_t GetNumberOfRequests () const { return m_nRequests; }  // Of segments, including failed ones
+
+private:
+    std::vector<std::unique_ptr<RecordedSegment>> m_segments;
+    uint32_t                                      m_failingSegmentNumber;
+    uint32_t                                      m_failingFinishSegmentNumber;
+    bool                                          m_failed;
+    uint32_t                                      m_nRequests;
+};
+
+}   // namespace EUT
+
+#endif  // #ifndef EUT_TEST_SEGMENTS_HPP
\ No newline at end of file
@@ -0,0 +1,494 @@
+#include "TestFiles.hpp"
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETLReader.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+#include "OS/ETW/ExtendedData.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETLFormat = ETWP::ETLFormat;
+
+using ETWP::ETLBufferView;
+using ETWP::ETLEventIterator;
+using ETWP::ETLReader;
+using ETWP::ETLWriter;
+using ETWP::ETLWriterConfig;
+using ETWP::EventExtendedItemLayout;
+using ETWP::EventHeaderLayout;
+using ETWP::EventRecordLayout;
+using ETWP::EventView;
+
+constexpr char kTempFilePrefix[] = "reader";
+constexpr uint32_t kBufferSize = 4 * 1'024;
+constexpr int64_t kStartTimeStamp = 1'000'000;
+
+struct Event {
+    GUID                 providerID;
+    UCHAR                opcode;
+    ULONG                processID;
+    ULONG                threadID;
+    int64_t              timeStamp;
+    UCHAR                processorNumber;
+    std::vector<uint8_t> payload;
+
+    bool operator== (const Event& rhs) const
+    {
+        return providerID == rhs.providerID && opcode == rhs.opcode && processID == rhs.processID &&
+               threadID == rhs.threadID && timeStamp == rhs.timeStamp && processorNumber == rhs.processorNumber &&
+               payload == rhs.payload;
+    }
+};
+
+Event ToEvent (const EventView& view)
+{
+    const uint8_t* pPayload = static_cast<const uint8_t*> (view.GetUserData ());
+
+    return { view.GetProviderID (),
+             view.GetOpcode (),
+             view.GetProcessID (),
+             view.GetThreadID (),
+             view.GetTimestamp (),
+             view.GetProcessorNumber (),
+             std::vector<uint8_t> (pPayload, pPayload + view.GetUserDataLength ()) };
+}
+
+// Builds ETL buffers by hand, so the reader can be tested with events ETLWriter never writes
+class BufferBuilder final {
+public:
+    explicit BufferBuilder (UCHAR processorNumber): m_bytes (kBufferSize, 0xFF)
+    {
+        ETLFormat::BufferHeader header = {};
+        header.m_bufferSize = kBufferSize;
+        header.m_processorNumber = processorNumber;
+        std::memcpy (m_bytes.data (), &header, sizeof header);
+        m_used = sizeof header;
+    }
+
+    template<typename Header>
+    void Add (const Header& header, const std::vector<uint8_t>& rest)
+    {
+        const size_t size = sizeof header + rest.size ();
+        std::memcpy (m_bytes.data () + m_used, &header, sizeof header);
+        if (!rest.empty ())
+            std::memcpy (m_bytes.data () + m_used + sizeof header, rest.data (), rest.size ());
+
+        std::memset (m_bytes.data () + m_used + size, 0, Align (size) - size);
+        m_used += Align (size);
+    }
+
+    std::vector<uint8_t> Finish (USHORT bufferFlag = 0, USHORT bufferType = ETLFormat::kBufferTypeGeneric)
+    {
+        ETLFormat::BufferHeader header;
+        std::memcpy (&header, m_bytes.data (), sizeof header);
+        header.m_savedOffset = static_cast<ULONG> (m_used);
+        header.m_currentOffset = static_cast<ULONG> (m_used);
+        header.m_bufferFlag = bufferFlag;
+        header.m_bufferType = bufferType;
+        std::memcpy (m_bytes.data (), &header, sizeof header);
+
+        return m_bytes;
+    }
+
+    static size_t Align (size_t size)
+    {
+        return (size + ETLFormat::kEventAlignment - 1) & ~(ETLFormat::kEventAlignment - 1);
+    }
+
+private:
+    std::vector<uint8_t> m_bytes;
+    size_t               m_used;
+};
+
+template<typename T>
+std::vector<uint8_t> ToBytes (const T& value)
+{
+    std::vector<uint8_t> bytes (sizeof value);
+    std::memcpy (bytes.data (), &value, sizeof value);
+
+    return bytes;
+}
+
+void Append (std::vector<uint8_t>* pBytes, const std::vector<uint8_t>& bytes)
+{
+    const size_t oldSize = pBytes->size ();
+    pBytes->resize (oldSize + bytes.size ());
+    if (!bytes.empty ())
+        std::memcpy (pBytes->data () + oldSize, bytes.data (), bytes.size ());
+}
+
+std::vector<uint8_t> MakeHeaderBuffer (ULONG pointerSize)
+{
+    ETLFormat::TraceLogfileHeader logfileHeader = {};
+    logfileHeader.m_bufferSize = kBufferSize;
+    logfileHeader.m_numberOfProcessors = 2;
+    logfileHeader.m_pointerSize = pointerSize;
+    logfileHeader.m_perfFreq = 10'000'000;
+
+    std::vector<uint8_t> rest = ToBytes (logfileHeader);
+    Append (&rest, { 'x', 0, 'y', 0, 0, 0, 0, 0 });  // Logger name ("xy"), empty log file name
+
+    const ETLFormat::SystemTraceHeader header = {
+        ETLFormat::MakeMarker (ETLFormat::HeaderType::System64, ETLFormat::kLogfileHeaderVersion),
+        static_cast<USHORT> (sizeof (ETLFormat::SystemTraceHeader) + rest.size ()),
+        ETLFormat::kGroupHeader,
+        0,
+        0,
+        kStartTimeStamp,
+        0,
+        0
+    };
+
+    BufferBuilder builder (0);
+    builder.Add (header, rest);
+
+    return builder.Finish (0, ETLFormat::kBufferTypeHeader);
+}
+
+void WriteFile (const std::filesystem::path& path, const std::vector<uint8_t>& bytes)
+{
+    std::ofstream file (path, std::ios::binary | std::ios::trunc);
+    file.write (reinterpret_cast<const char*> (bytes.data ()), bytes.size ());
+}
+
+void ETLReaderRoundTrip ()
+{
+    TempFile file (kTempFilePrefix, "RoundTrip.etl");
+
+    ETLWriterConfig config;
+    config.bufferSize = kBufferSize;
+    config.numberOfProcessors = 3;
+    config.startTimeStamp = kStartTimeStamp;
+    config.loggerName = L"etwprof reader test";
+
+    std::mt19937_64 random (11);
+    std::vector<Event> expected[3];
+    uint64_t nExpected = 0;
+    {
+        ETLWriter writer (file.GetPath (), config);
+        for (uint32_t i = 0; i < 3'000; ++i) {
+            const UCHAR cpu = static_cast<UCHAR> (random () % 3);
+            std::vector<uint8_t> payload (random () % 300);
+            for (uint8_t& byte : payload)
+                byte = static_cast<uint8_t> (random ());
+
+            EventRecordLayout record = {};
+            record.m_header.m_processID = 100 + i % 5;
+            record.m_header.m_threadID = 200 + i % 11;
+            record.m_header.m_timeStamp = kStartTimeStamp + 10 + i;
+            record.m_header.m_opcode = static_cast<UCHAR> (random ());
+            record.m_processorNumber = cpu;
+            record.m_pUserData = payload.data ();
+            record.m_userDataLength = static_cast<USHORT> (payload.size ());
+
+            // Kernel, classic and manifest-based events
+            switch (i % 3) {
+                case 0:
+                    record.m_header.m_providerID = ThreadGuid;
+                    record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+                    break;
+                case 1:
+                    record.m_header.m_providerID = EtwProfProfilerGuid;
+                    record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+                    break;
+                case 2:
+                    record.m_header.m_providerID = UxThemeGuid;
+                    break;
+            }
+
+            EUT_CHECK (writer.WriteEvent (EventView (record)));
+            expected[cpu].push_back ({ record.m_header.m_providerID,
+                                       record.m_header.m_opcode,
+                                       record.m_header.m_processID,
+                                       record.m_header.m_threadID,
+                                       record.m_header.m_timeStamp,
+                                       cpu,
+                                       payload });
+            ++nExpected;
+        }
+
+        std::wstring errorMsg;
+        EUT_CHECK (writer.Close (&errorMsg));
+    }
+
+    ETLReader reader (file.GetPath ());
+    EUT_CHECK (reader.GetLoggerName () == L"etwprof reader test");
+    EUT_CHECK (reader.GetLogfileHeader ().m_bufferSize == kBufferSize);
+    EUT_CHECK (reader.GetLogfileHeader ().m_numberOfProcessors == 3);
+    EUT_CHECK (reader.GetNumberOfBuffers () == reader.GetLogfileHeader ().m_buffersWritten);
+    EUT_CHECK (reader.GetFileSize () == uint64_t (reader.GetNumberOfBuffers ()) * kBufferSize);
+
+    std::vector<Event> decoded[3];
+    uint64_t nEvents = 0;
+    bool first = true;
+    reader.ForEachEvent ([&] (const EventView& event) {
+        ++nEvents;
+
+        // The logfile header is delivered as an event, as in real-time sessions
+        if (first) {
+            EUT_CHECK (event.GetProviderID () == EventTraceEventGuid && event.GetOpcode () == 0);
+            EUT_CHECK (event.GetTimestamp () == kStartTimeStamp);
+            first = false;
+
+            return;
+        }
+
+        const bool classic = (event.GetRecord ().m_header.m_flags & ETLFormat::kEventHeaderFlagClassicHeader) != 0;
+        EUT_CHECK (classic == !(event.GetProviderID () == UxThemeGuid));
+        EUT_CHECK (event.GetProcessorNumber () < 3);
+        decoded[event.GetProcessorNumber ()].push_back (ToEvent (event));
+    });
+
+    EUT_CHECK (nEvents == nExpected + 1);
+    for (size_t cpu = 0; cpu < 3; ++cpu)
+        EUT_CHECK (decoded[cpu] == expected[cpu]);
+}
+
+void ETLReaderHeaderTypes ()
+{
+    TempFile file (kTempFilePrefix, "HeaderTypes.etl");
+
+    std::vector<uint8_t> bytes = MakeHeaderBuffer (8);
+    BufferBuilder builder (1);
+
+    const ETLFormat::CompactTraceHeader compactHeader = {
+        ETLFormat::MakeMarker (ETLFormat::HeaderType::Compact64, 3),
+        static_cast<USHORT> (sizeof (ETLFormat::CompactTraceHeader) + 4),
+        ETLFormat::kGroupThread | ETWP::ETWConstants::CSwitchOpcode,
+        11,
+        12,
+        kStartTimeStamp + 1
+    };
+    builder.Add (compactHeader, { 1, 2, 3, 4 });
+
+    const ETLFormat::PerfInfoTraceHeader perfInfoHeader = {
+        ETLFormat::MakeMarker (ETLFormat::HeaderType::PerfInfo64, 2),
+        static_cast<USHORT> (sizeof (ETLFormat::PerfInfoTraceHeader) + 2),
+        ETLFormat::kGroupPerfInfo | ETWP::ETWConstants::SampledProfileOpcode,
+        kStartTimeStamp + 2
+    };
+    builder.Add (perfInfoHeader, { 5, 6 });
+
+    const ETLFormat::FullTraceHeader fullHeader = {
+        static_cast<USHORT> (sizeof (ETLFormat::FullTraceHeader) + 1),
+        UCHAR (ETLFormat::HeaderType::FullHeader64),
+        UCHAR (ETLFormat::kHeaderMarkerFlags >> 24),
+        7,
+        4,
+        1,
+        21,
+        22,
+        kStartTimeStamp + 3,
+        EtwProfProfilerGuid,
+        0
+    };
+    builder.Add (fullHeader, { 9 });
+
+    // Not supported, skipped
+    const ULONG instanceMarker = ETLFormat::MakeMarker (ETLFormat::HeaderType::Instance64, 16);
+    builder.Add (instanceMarker, std::vector<uint8_t> (12, 0));
+
+    // Kernel event of an unknown group
+    const ETLFormat::SystemTraceHeader unknownGroupHeader = {
+        ETLFormat::MakeMarker (ETLFormat::HeaderType::System64, 0),
+        static_cast<USHORT> (sizeof (ETLFormat::SystemTraceHeader)),
+        0x2A05,
+        31,
+        32,
+        kStartTimeStamp + 4,
+        0,
+        0
+    };
+    builder.Add (unknownGroupHeader, {});
+
+    // Manifest-based event with a stack trace and an event key
+    const uint64_t stack[] = { 77, 0x1000, 0x2000, 0x3000 };
+    const uint64_t eventKey = 0x1234'5678'9ABC;
+    std::vector<uint8_t> rest;
+    Append (&rest, ToBytes (ETLFormat::ExtendedItemHeader { 0, ETLFormat::kExtTypeStackTrace64, 1, sizeof stack }));
+    Append (&rest, ToBytes (stack));
+    Append (&rest, ToBytes (ETLFormat::ExtendedItemHeader { 0, ETLFormat::kExtTypeEventKey, 0, sizeof eventKey }));
+    Append (&rest, ToBytes (eventKey));
+    Append (&rest, { 42, 43, 44 });
+
+    EventHeaderLayout eventHeader = {};
+    eventHeader.m_size = static_cast<USHORT> (sizeof eventHeader + rest.size ());
+    eventHeader.m_headerType = ETLFormat::kEventHeaderType;
+    eventHeader.m_flags = ETLFormat::kEventHeaderFlagExtendedInfo;
+    eventHeader.m_threadID = 41;
+    eventHeader.m_processID = 42;
+    eventHeader.m_timeStamp = kStartTimeStamp + 5;
+    eventHeader.m_providerID = UxThemeGuid;
+    eventHeader.m_opcode = 13;
+    builder.Add (eventHeader, rest);
+
+    Append (&bytes, builder.Finish ());
+
+    // Compressed buffers are not supported
+    BufferBuilder compressedBuilder (0);
+    compressedBuilder.Add (compactHeader, { 1, 2, 3, 4 });
+    Append (&bytes, compressedBuilder.Finish (ETLFormat::kBufferFlagCompressed));
+
+    // A malformed event ends its buffer
+    BufferBuilder malformedBuilder (1);
+    malformedBuilder.Add (compactHeader, { 1, 2, 3, 4 });
+    ETLFormat::CompactTraceHeader malformedHeader = compactHeader;
+    malformedHeader.m_size = 2 * kBufferSize;
+    malformedBuilder.Add (malformedHeader, {});
+    malformedBuilder.Add (compactHeader, { 1, 2, 3, 4 });
+    Append (&bytes, malformedBuilder.Finish ());
+
+    // A truncated buffer at the end is ignored
+    Append (&bytes, std::vector<uint8_t> (100, 0));
+
+    WriteFile (file.GetPath (), bytes);
+
+    ETLReader reader (file.GetPath ());
+    EUT_CHECK (reader.GetLoggerName () == L"xy");
+    EUT_CHECK (reader.GetNumberOfBuffers () == 4);
+    EUT_CHECK (reader.GetBuffer (2).IsCompressed ());
+    EUT_CHECK (reader.GetBuffer (2).begin () == reader.GetBuffer (2).end ());
+
+    std::vector<EventRecordLayout> records;
+    std::vector<std::vector<uint8_t>> payloads;
+    for (const EventView& event : reader.GetBuffer (1)) {
+        records.push_back (event.GetRecord ());
+        payloads.push_back (ToEvent (event).payload);
+
+        if (event.GetProviderID () == UxThemeGuid) {
+            EUT_CHECK (event.GetExtendedDataCount () == 2);
+
+            ETWP::StackTraceView stackTrace;
+            EUT_CHECK (ETWP::GetStackTrace (event, &stackTrace));
+            EUT_CHECK (stackTrace.matchID == 77 && stackTrace.nFrames == 3 && stackTrace.is64Bit);
+            EUT_CHECK (stackTrace.GetAddress (0) == 0x1000 && stackTrace.GetAddress (2) == 0x3000);
+
+            uint64_t key = 0;
+            EUT_CHECK (ETWP::GetEventKey (event, &key) && key == eventKey);
+            EUT_CHECK (!ETWP::GetProcessStartKey (event, &key));
+        } else {
+            EUT_CHECK (event.GetExtendedDataCount () == 0);
+        }
+    }
+
+    EUT_CHECK (records.size () == 5);
+
+    EUT_CHECK (records[0].m_header.m_providerID == ThreadGuid);
+    EUT_CHECK (records[0].m_header.m_opcode == ETWP::ETWConstants::CSwitchOpcode);
+    EUT_CHECK (records[0].m_header.m_version == 3);
+    EUT_CHECK (records[0].m_header.m_threadID == 11 && records[0].m_header.m_processID == 12);
+    EUT_CHECK (records[0].m_processorNumber == 1);
+    EUT_CHECK ((payloads[0] == std::vector<uint8_t> { 1, 2, 3, 4 }));
+
+    EUT_CHECK (records[1].m_header.m_providerID == PerfInfoGuid);
+    EUT_CHECK (records[1].m_header.m_opcode == ETWP::ETWConstants::SampledProfileOpcode);
+    EUT_CHECK (records[1].m_header.m_timeStamp == kStartTimeStamp + 2);
+    EUT_CHECK ((payloads[1] == std::vector<uint8_t> { 5, 6 }));
+
+    EUT_CHECK (records[2].m_header.m_providerID == EtwProfProfilerGuid);
+    EUT_CHECK (records[2].m_header.m_opcode == 7 && records[2].m_header.m_level == 4);
+    EUT_CHECK (records[2].m_header.m_threadID == 21 && records[2].m_header.m_processID == 22);
+    EUT_CHECK ((payloads[2] == std::vector<uint8_t> { 9 }));
+
+    EUT_CHECK (records[3].m_header.m_providerID == GUID {});
+    EUT_CHECK (records[3].m_header.m_id == 0x2A05 && records[3].m_header.m_opcode == 0x05);
+    EUT_CHECK (payloads[3].empty ());
+
+    EUT_CHECK (records[4].m_header.m_opcode == 13 && records[4].m_header.m_timeStamp == kStartTimeStamp + 5);
+    EUT_CHECK ((payloads[4] == std::vector<uint8_t> { 42, 43, 44 }));
+
+    size_t nMalformedBufferEvents = 0;
+    for (const EventView& event : reader.GetBuffer (3)) {
+        EUT_CHECK (event.GetProviderID () == ThreadGuid);
+        ++nMalformedBufferEvents;
+    }
+
+    EUT_CHECK (nMalformedBufferEvents == 1);
+}
+
+void ETLReaderIteratorCopy ()
+{
+    TempFile file (kTempFilePrefix, "IteratorCopy.etl");
+
+    std::vector<uint8_t> bytes = MakeHeaderBuffer (8);
+    BufferBuilder builder (0);
+    for (USHORT i = 0; i < 2; ++i) {
+        const uint64_t stack[] = { i, 0x1000u + i };
+        std::vector<uint8_t> rest;
+        Append (&rest, ToBytes (ETLFormat::ExtendedItemHeader { 0, ETLFormat::kExtTypeStackTrace64, 0, sizeof stack }));
+        Append (&rest, ToBytes (stack));
+
+        EventHeaderLayout eventHeader = {};
+        eventHeader.m_size = static_cast<USHORT> (sizeof eventHeader + rest.size ());
+        eventHeader.m_headerType = ETLFormat::kEventHeaderType;
+        eventHeader.m_flags = ETLFormat::kEventHeaderFlagExtendedInfo;
+        eventHeader.m_providerID = UxThemeGuid;
+        builder.Add (eventHeader, rest);
+    }
+
+    Append (&bytes, builder.Finish ());
+    WriteFile (file.GetPath (), bytes);
+
+    ETLReader reader (file.GetPath ());
+    const ETLBufferView buffer = reader.GetBuffer (1);
+
+    // Copies have their own decoded event (extended data included), that stays valid when the original advances
+    ETLEventIterator it = buffer.begin ();
+    const ETLEventIterator copy = it;
+    ++it;
+    EUT_CHECK (it != copy && it != buffer.end ());
+
+    ETWP::StackTraceView stackTrace;
+    EUT_CHECK (ETWP::GetStackTrace (*copy, &stackTrace) && stackTrace.GetAddress (0) == 0x1000);
+    EUT_CHECK (ETWP::GetStackTrace (*it, &stackTrace) && stackTrace.GetAddress (0) == 0x1001);
+
+    ++it;
+    EUT_CHECK (it == buffer.end ());
+}
+
+void ETLReaderInvalidFiles ()
+{
+    const auto opens = [] (const std::filesystem::path& path) {
+        try {
+            ETLReader reader (path);
+        } catch (const ETLReader::InitException&) {
+            return false;
+        }
+
+        return true;
+    };
+
+    TempFile file (kTempFilePrefix, "InvalidFiles.etl");
+    EUT_CHECK (!opens (file.GetPath ()));   // Does not exist
+
+    WriteFile (file.GetPath (), {});
+    EUT_CHECK (!opens (file.GetPath ()));
+
+    WriteFile (file.GetPath (), std::vector<uint8_t> (kBufferSize, 0xAB));
+    EUT_CHECK (!opens (file.GetPath ()));
+
+    WriteFile (file.GetPath (), MakeHeaderBuffer (4));
+    EUT_CHECK (!opens (file.GetPath ()));
+
+    WriteFile (file.GetPath (), MakeHeaderBuffer (8));
+    EUT_CHECK (opens (file.GetPath ()));
+}
+
+TestRegistrator roundTrip ("ETLReader.RoundTrip", ETLReaderRoundTrip);
+TestRegistrator headerTypes ("ETLReader.HeaderTypes", ETLReaderHeaderTypes);
+TestRegistrator iteratorCopy ("ETLReader.IteratorCopy", ETLReaderIteratorCopy);
+TestRegistrator invalidFiles ("ETLReader.InvalidFiles", ETLReaderInvalidFiles);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,414 @@
+#include "TestFiles.hpp"
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETLFormat = ETWP::ETLFormat;
+
+using ETWP::ETLWriter;
+using ETWP::ETLWriterConfig;
+using ETWP::EventExtendedItemLayout;
+using ETWP::EventRecordLayout;
+using ETWP::EventView;
+
+constexpr char kTempFilePrefix[] = "writer";
+constexpr int64_t kPerfFreq = 10'000'000;
+constexpr int64_t kStartTimeStamp = 1'000'000;
+constexpr int64_t kStartSystemTime = 133'000'000'000'000'000;
+
+struct DecodedEvent {
+    GUID                 providerID;
+    UCHAR                opcode;
+    ULONG                processID;
+    ULONG                threadID;
+    int64_t              timeStamp;
+    UCHAR                processorNumber;
+    std::vector<uint8_t> payload;
+
+    bool operator== (const DecodedEvent& rhs) const
+    {
+        return providerID == rhs.providerID && opcode == rhs.opcode && processID == rhs.processID &&
+               threadID == rhs.threadID && timeStamp == rhs.timeStamp && processorNumber == rhs.processorNumber &&
+               payload == rhs.payload;
+    }
+};
+
+struct DecodedTrace {
+    ETLFormat::TraceLogfileHeader logfileHeader;
+    int64_t                       startTimeStamp;   // Of the logfile header event
+    std::vector<DecodedEvent>     events;           // In file order
+    uint32_t                      nBuffers;
+};
+
+template<typename T>
+T Read (const std::vector<uint8_t>& bytes, size_t offset)
+{
+    EUT_CHECK (offset + sizeof (T) <= bytes.size ());
+
+    T result;
+    std::memcpy (&result, bytes.data () + offset, sizeof result);
+
+    return result;
+}
+
+// Minimal ETL parser: walks buffers, and the events inside them, as a consumer would
+DecodedTrace DecodeTrace (const std::filesystem::path& path, uint32_t bufferSize)
+{
+    std::ifstream file (path, std::ios::binary);
+    const std::vector<uint8_t> bytes ((std::istreambuf_iterator<char> (file)), std::istreambuf_iterator<char> ());
+    EUT_CHECK (!bytes.empty () && bytes.size () % bufferSize == 0);
+
+    DecodedTrace trace = {};
+    trace.nBuffers = static_cast<uint32_t> (bytes.size () / bufferSize);
+
+    int64_t lastSequenceNumber = -1;
+    for (size_t bufferOffset = 0; bufferOffset < bytes.size (); bufferOffset += bufferSize) {
+        const ETLFormat::BufferHeader bufferHeader = Read<ETLFormat::BufferHeader> (bytes, bufferOffset);
+        EUT_CHECK (bufferHeader.m_bufferSize == bufferSize);
+        EUT_CHECK (bufferHeader.m_savedOffset <= bufferSize);
+        EUT_CHECK (bufferHeader.m_sequenceNumber == lastSequenceNumber + 1);
+        EUT_CHECK ((bufferOffset == 0) == (bufferHeader.m_bufferType == ETLFormat::kBufferTypeHeader));
+        lastSequenceNumber = bufferHeader.m_sequenceNumber;
+
+        int64_t lastTimeStamp = 0;
+        for (size_t offset = sizeof (ETLFormat::BufferHeader); offset < bufferHeader.m_savedOffset;) {
+            const size_t eventOffset = bufferOffset + offset;
+            const ULONG marker = Read<ULONG> (bytes, eventOffset);
+
+            DecodedEvent event = {};
+            event.processorNumber = bufferHeader.m_processorNumber;
+
+            size_t headerSize;
+            USHORT size;
+            if (ETLFormat::GetHeaderType (marker) == ETLFormat::HeaderType::System64) {
+                const ETLFormat::SystemTraceHeader header = Read<ETLFormat::SystemTraceHeader> (bytes, eventOffset);
+                const GUID* pProviderID = ETLFormat::GetKernelProviderID (header.m_hookID & 0xFF00);
+                EUT_CHECK (pProviderID != nullptr);
+
+                event.providerID = *pProviderID;
+                event.opcode = header.m_hookID & 0xFF;
+                event.processID = header.m_processID;
+                event.threadID = header.m_threadID;
+                event.timeStamp = header.m_systemTime;
+                headerSize = sizeof header;
+                size = header.m_size;
+            } else if (ETLFormat::GetHeaderType (marker) == ETLFormat::HeaderType::FullHeader64) {
+                const ETLFormat::FullTraceHeader header = Read<ETLFormat::FullTraceHeader> (bytes, eventOffset);
+                event.providerID = header.m_guid;
+                event.opcode = header.m_type;
+                event.processID = header.m_processID;
+                event.threadID = header.m_threadID;
+                event.timeStamp = header.m_timeStamp;
+                headerSize = sizeof header;
+                size = header.m_size;
+            } else {
+                const ETWP::EventHeaderLayout header = Read<ETWP::EventHeaderLayout> (bytes, eventOffset);
+                EUT_CHECK (header.m_headerType == ETLFormat::kEventHeaderType);
+                EUT_CHECK ((header.m_flags & ETLFormat::kEventHeaderFlagExtendedInfo) == 0);
+
+                event.providerID = header.m_providerID;
+                event.opcode = header.m_opcode;
+                event.processID = header.m_processID;
+                event.threadID = header.m_threadID;
+                event.timeStamp = header.m_timeStamp;
+                headerSize = sizeof header;
+                size = header.m_size;
+            }
+
+            EUT_CHECK (size >= headerSize && offset + size <= bufferHeader.m_savedOffset);
+            event.payload.assign (bytes.begin () + eventOffset + headerSize, bytes.begin () + eventOffset + size);
+            lastTimeStamp = event.timeStamp;
+
+            if (bufferOffset == 0) {
+                // The logfile header
+                EUT_CHECK (event.providerID == EventTraceEventGuid && event.opcode == 0);
+                EUT_CHECK (event.payload.size () >= sizeof (ETLFormat::TraceLogfileHeader));
+                std::memcpy (&trace.logfileHeader, event.payload.data (), sizeof trace.logfileHeader);
+                trace.startTimeStamp = event.timeStamp;
+            } else {
+                trace.events.push_back (std::move (event));
+            }
+
+            offset += (size + ETLFormat::kEventAlignment - 1) & ~(ETLFormat::kEventAlignment - 1);
+        }
+
+        if (bufferOffset != 0)
+            EUT_CHECK (bufferHeader.m_timeStamp == lastTimeStamp);
+
+        // The unused part of buffers is filled with 0xFF
+        for (size_t i = bufferHeader.m_savedOffset; i < bufferSize; ++i)
+            EUT_CHECK (bytes[bufferOffset + i] == 0xFF);
+    }
+
+    return trace;
+}
+
+ETLWriterConfig GetTestConfig ()
+{
+    ETLWriterConfig config;
+    config.bufferSize = 4 * 1'024;
+    config.blockSize = 16 * 1'024;
+    config.numberOfProcessors = 4;
+    config.perfFreq = kPerfFreq;
+    config.startTimeStamp = kStartTimeStamp;
+    config.startSystemTime = kStartSystemTime;
+    config.loggerName = L"etwprof unit tests";
+
+    return config;
+}
+
+std::vector<uint8_t> MakePayload (std::mt19937_64* pRandom, size_t size)
+{
+    std::vector<uint8_t> payload (size);
+    for (uint8_t& byte : payload)
+        byte = static_cast<uint8_t> ((*pRandom) ());
+
+    return payload;
+}
+
+void ETLWriterRoundTrip ()
+{
+    TempFile file (kTempFilePrefix, "RoundTrip.etl");
+    const ETLWriterConfig config = GetTestConfig ();
+
+    std::mt19937_64 random (7);
+    std::vector<DecodedEvent> expected[4];   // Per CPU, in order
+    uint64_t nExpected = 0;
+    int64_t lastTimeStamp = 0;
+    {
+        ETLWriter writer (file.GetPath (), config);
+
+        // Written by ETW itself, must be skipped (ETLWriter has its own logfile header)
+        EventRecordLayout logfileHeaderRecord = {};
+        logfileHeaderRecord.m_header.m_providerID = EventTraceEventGuid;
+        logfileHeaderRecord.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+        EUT_CHECK (writer.WriteEvent (EventView (logfileHeaderRecord)));
+
+        for (uint32_t i = 0; i < 5'000; ++i) {
+            const int64_t timeStamp = kStartTimeStamp + 1'000 + i * 100;
+            const UCHAR cpu = static_cast<UCHAR> (random () % 4);
+            const std::vector<uint8_t> payload = MakePayload (&random, random () % 200);
+
+            EventRecordLayout record = {};
+            record.m_header.m_processID = 1'000 + i % 3;
+            record.m_header.m_threadID = 2'000 + i % 7;
+            record.m_header.m_timeStamp = timeStamp;
+            record.m_header.m_opcode = static_cast<UCHAR> (1 + random () % 60);
+            record.m_header.m_version = 2;
+            record.m_processorNumber = cpu;
+            record.m_pUserData = payload.data ();
+            record.m_userDataLength = static_cast<USHORT> (payload.size ());
+
+            // Kernel (classic) events, classic events of other providers, and manifest-based events
+            switch (i % 3) {
+                case 0:
+                    record.m_header.m_providerID = PerfInfoGuid;
+                    record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+                    break;
+                case 1:
+                    record.m_header.m_providerID = EtwProfProfilerGuid;
+                    record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+                    break;
+                case 2:
+                    record.m_header.m_providerID = UxThemeGuid;
+                    break;
+            }
+
+            // Some events have stacks attached
+            std::vector<uint64_t> stack;
+            EventExtendedItemLayout item = {};
+            if (i % 5 == 0) {
+                stack.push_back (random ());    // Match ID
+                for (uint64_t frame = 0; frame < 1 + random () % 40; ++frame)
+                    stack.push_back (random ());
+
+                item.m_extType = ETLFormat::kExtTypeStackTrace64;
+                item.m_dataSize = static_cast<USHORT> (stack.size () * sizeof (uint64_t));
+                item.m_dataPtr = reinterpret_cast<uint64_t> (stack.data ());
+                record.m_header.m_flags |= ETLFormat::kEventHeaderFlagExtendedInfo;
+                record.m_pExtendedData = &item;
+                record.m_extendedDataCount = 1;
+            }
+
+            EUT_CHECK (writer.WriteEvent (EventView (record)));
+
+            expected[cpu].push_back ({ record.m_header.m_providerID,
+                                       record.m_header.m_opcode,
+                                       record.m_header.m_processID,
+                                       record.m_header.m_threadID,
+                                       timeStamp,
+                                       cpu,
+                                       payload });
+            ++nExpected;
+
+            if (!stack.empty ()) {
+                const ETWP::ETWConstants::StackWalkDataStub stackWalkData = { static_cast<UINT64> (timeStamp),
+                                                                              record.m_header.m_processID,
+                                                                              record.m_header.m_threadID };
+                std::vector<uint8_t> stackPayload (sizeof stackWalkData + (stack.size () - 1) * sizeof (uint64_t));
+                std::memcpy (stackPayload.data (), &stackWalkData, sizeof stackWalkData);
+                std::memcpy (stackPayload.data () + sizeof stackWalkData,
+                             stack.data () + 1,
+                             (stack.size () - 1) * sizeof (uint64_t));
+
+                expected[cpu].push_back ({ StackWalkGuid,
+                                           ETWP::ETWConstants::StackWalkOpcode,
+                                           record.m_header.m_processID,
+                                           record.m_header.m_threadID,
+                                           timeStamp,
+                                           cpu,
+                                           stackPayload });
+                ++nExpected;
+            }
+
+            lastTimeStamp = timeStamp;
+        }
+
+        std::wstring errorMsg;
+        EUT_CHECK (writer.Close (&errorMsg));
+
+        const ETLWriter::Stats stats = writer.GetStats ();
+        EUT_CHECK (stats.nEventsWritten == nExpected);
+        EUT_CHECK (stats.nEventsLost == 0);
+        EUT_CHECK (stats.nExtendedItemsDropped == 0);
+    }
+
+    const DecodedTrace trace = DecodeTrace (file.GetPath (), config.bufferSize);
+    EUT_CHECK (trace.nBuffers > 16);     // Several blocks were written
+    EUT_CHECK (trace.events.size () == nExpected);
+
+    // Events of the same CPU must come in order
+    std::vector<DecodedEvent> decoded[4];
+    for (const DecodedEvent& event : trace.events) {
+        EUT_CHECK (event.processorNumber < 4);
+        decoded[event.processorNumber].push_back (event);
+    }
+
+    for (size_t cpu = 0; cpu < 4; ++cpu)
+        EUT_CHECK (decoded[cpu] == expected[cpu]);
+
+    const ETLFormat::TraceLogfileHeader& header = trace.logfileHeader;
+    EUT_CHECK (header.m_bufferSize == config.bufferSize);
+    EUT_CHECK (header.m_buffersWritten == trace.nBuffers);
+    EUT_CHECK (header.m_numberOfProcessors == config.numberOfProcessors);
+    EUT_CHECK (header.m_pointerSize == 8);
+    EUT_CHECK (header.m_perfFreq == kPerfFreq);
+    EUT_CHECK (header.m_startTime == kStartSystemTime);
+    EUT_CHECK (header.m_reservedFlags == ETLFormat::kClockTypeQPC);
+    EUT_CHECK (header.m_eventsLost == 0);
+    EUT_CHECK (trace.startTimeStamp == kStartTimeStamp);
+    // The QPC frequency is 10 MHz, so QPC ticks equal FILETIME ticks
+    EUT_CHECK (header.m_endTime == kStartSystemTime + (lastTimeStamp - kStartTimeStamp));
+}
+
+void ETLWriterLostAndDroppedItems ()
+{
+    TempFile file (kTempFilePrefix, "LostAndDroppedItems.etl");
+    const ETLWriterConfig config = GetTestConfig ();
+
+    ETLWriter writer (file.GetPath (), config);
+
+    // Does not fit into a buffer
+    std::vector<uint8_t> payload (config.bufferSize);
+    EventRecordLayout record = {};
+    record.m_header.m_providerID = UxThemeGuid;
+    record.m_header.m_timeStamp = kStartTimeStamp + 1;
+    record.m_pUserData = payload.data ();
+    record.m_userDataLength = static_cast<USHORT> (payload.size ());
+    EUT_CHECK (!writer.WriteEvent (EventView (record)));
+
+    // Fits, but only the stack trace is kept from its extended data items
+    uint64_t stack[] = { 1, 0x1000, 0x2000 };
+    uint64_t relatedActivityID[2] = {};
+    const EventExtendedItemLayout items[] = {
+        { 0, ETLFormat::kExtTypeRelatedActivityID, 0, sizeof relatedActivityID,
+          reinterpret_cast<uint64_t> (&relatedActivityID) },
+        { 0, ETLFormat::kExtTypeStackTrace64, 0, sizeof stack, reinterpret_cast<uint64_t> (&stack) }
+    };
+
+    record.m_userDataLength = 16;
+    record.m_pExtendedData = items;
+    record.m_extendedDataCount = 2;
+    EUT_CHECK (writer.WriteEvent (EventView (record)));
+
+    std::wstring errorMsg;
+    EUT_CHECK (writer.Close (&errorMsg));
+    EUT_CHECK (writer.Close (&errorMsg));
+
+    const ETLWriter::Stats stats = writer.GetStats ();
+    EUT_CHECK (stats.nEventsWritten == 2);
+    EUT_CHECK (stats.nEventsLost == 1);
+    EUT_CHECK (stats.nExtendedItemsDropped == 1);
+
+    const DecodedTrace trace = DecodeTrace (file.GetPath (), config.bufferSize);
+    EUT_CHECK (trace.logfileHeader.m_eventsLost == 1);
+    EUT_CHECK (trace.events.size () == 2);
+    EUT_CHECK (trace.events[1].providerID == StackWalkGuid);
+    EUT_CHECK (trace.events[1].payload.size () == sizeof (ETWP::ETWConstants::StackWalkDataStub) + 2 * sizeof (uint64_t));
+}
+
+void ETLWriterStartFromLogfileHeader ()
+{
+    TempFile file (kTempFilePrefix, "StartFromLogfileHeader.etl");
+    ETLWriterConfig config = GetTestConfig ();
+    config.startTimeStamp = 0;
+
+    ETLWriter writer (file.GetPath (), config);
+
+    EventRecordLayout record = {};
+    record.m_header.m_providerID = EventTraceEventGuid;
+    record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+    record.m_header.m_timeStamp = kStartTimeStamp;
+    EUT_CHECK (writer.WriteEvent (EventView (record)));
+
+    record.m_header.m_providerID = PerfInfoGuid;
+    record.m_header.m_opcode = ETWP::ETWConstants::SampledProfileOpcode;
+    record.m_header.m_timeStamp = kStartTimeStamp + 3 * kPerfFreq;
+    EUT_CHECK (writer.WriteEvent (EventView (record)));
+
+    std::wstring errorMsg;
+    EUT_CHECK (writer.Close (&errorMsg));
+
+    const DecodedTrace trace = DecodeTrace (file.GetPath (), config.bufferSize);
+    EUT_CHECK (trace.startTimeStamp == kStartTimeStamp);
+    EUT_CHECK (trace.events.size () == 1);
+    EUT_CHECK (trace.logfileHeader.m_endTime == kStartSystemTime + 3 * 10'000'000);
+}
+
+void ETLWriterInvalidConfig ()
+{
+    TempFile file (kTempFilePrefix, "InvalidConfig.etl");
+    ETLWriterConfig config = GetTestConfig ();
+    config.bufferSize = 1'000;
+
+    bool thrown = false;
+    try {
+        ETLWriter writer (file.GetPath (), config);
+    } catch (const ETLWriter::InitException&) {
+        thrown = true;
+    }
+
+    EUT_CHECK (thrown);
+}
+
+TestRegistrator roundTrip ("ETLWriter.RoundTrip", ETLWriterRoundTrip);
+TestRegistrator lostAndDroppedItems ("ETLWriter.LostAndDroppedItems", ETLWriterLostAndDroppedItems);
+TestRegistrator startFromLogfileHeader ("ETLWriter.StartFromLogfileHeader", ETLWriterStartFromLogfileHeader);
+TestRegistrator invalidConfig ("ETLWriter.InvalidConfig", ETLWriterInvalidConfig);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
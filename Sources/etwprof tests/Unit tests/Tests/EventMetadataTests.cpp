@@ -0,0 +1,125 @@
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+#include "Profiler/EventMetadata.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETLFormat = ETWP::ETLFormat;
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::EventMetadataRecord;
+using ETWP::EventMetadataSink;
+using ETWP::EventRecordLayout;
+using ETWP::EventView;
+
+constexpr GUID kProviderID = { 0x11111111, 0x2222, 0x3333, { 4, 4, 4, 4, 4, 4, 4, 4 } };
+constexpr GUID kOtherProviderID = { 0x55555555, 0x6666, 0x7777, { 8, 8, 8, 8, 8, 8, 8, 8 } };
+
+// Keeps the header (and the payload size) of every event
+class RecordingSink final : public ETWP::IEventSink {
+public:
+    struct Event {
+        ETWP::EventHeaderLayout header;
+        UCHAR                   processorNumber;
+        USHORT                  payloadSize;
+    };
+
+    virtual bool WriteEvent (const EventView& event) override
+    {
+        m_events.push_back ({ event.GetRecord ().m_header, event.GetProcessorNumber (), event.GetUserDataLength () });
+
+        return true;
+    }
+
+    const std::vector<Event>& GetEvents () const { return m_events; }
+
+private:
+    std::vector<Event> m_events;
+};
+
+EventRecordLayout MakeRecord (const GUID& providerID, USHORT id, UCHAR version, int64_t timeStamp)
+{
+    EventRecordLayout record = {};
+    record.m_header.m_providerID = providerID;
+    record.m_header.m_id = id;
+    record.m_header.m_version = version;
+    record.m_header.m_processID = 1'000;
+    record.m_header.m_threadID = 1'004;
+    record.m_header.m_timeStamp = timeStamp;
+    record.m_processorNumber = 2;
+
+    return record;
+}
+
+void EventMetadataSinkTest ()
+{
+    // Event 1 has an event info and a map info, event 2 has no metadata, event 3 has metadata too big for an event
+    uint32_t nSourceCalls = 0;
+    const auto source = [&nSourceCalls] (const EventView& event, std::vector<EventMetadataRecord>* pRecordsOut) {
+        ++nSourceCalls;
+
+        const USHORT id = event.GetRecord ().m_header.m_id;
+        if (id == 1) {
+            pRecordsOut->push_back ({ ETWConstants::EventInfoOpcode, std::vector<uint8_t> (100) });
+            pRecordsOut->push_back ({ ETWConstants::EventMapInfoOpcode, std::vector<uint8_t> (20) });
+        } else if (id == 3) {
+            pRecordsOut->push_back ({ ETWConstants::EventInfoOpcode, std::vector<uint8_t> (70'000) });
+        }
+
+        return id != 2;
+    };
+
+    RecordingSink recordingSink;
+    EventMetadataSink sink (&recordingSink, source, { kProviderID });
+
+    int64_t timeStamp = 10;
+    const auto write = [&] (const GUID& providerID, USHORT id, UCHAR version) {
+        return sink.WriteEvent (EventView (MakeRecord (providerID, id, version, ++timeStamp)));
+    };
+
+    EUT_CHECK (write (kProviderID, 1, 0));
+    EUT_CHECK (recordingSink.GetEvents ().size () == 3);
+    EUT_CHECK (write (kProviderID, 1, 0));                 // Metadata is only written once
+    EUT_CHECK (write (kProviderID, 1, 1));                 // Other version
+    EUT_CHECK (recordingSink.GetEvents ().size () == 7);
+    EUT_CHECK (write (kProviderID, 2, 0));
+    EUT_CHECK (write (kProviderID, 2, 0));
+    EUT_CHECK (write (kProviderID, 3, 0));
+    EUT_CHECK (write (kOtherProviderID, 1, 0));            // Not a provider of interest
+    EUT_CHECK (recordingSink.GetEvents ().size () == 11);
+
+    EUT_CHECK (nSourceCalls == 4);
+    EUT_CHECK (sink.GetStats ().nEventKinds == 4);
+    EUT_CHECK (sink.GetStats ().nMetadataEventsWritten == 4);
+    EUT_CHECK (sink.GetStats ().nEventKindsWithoutMetadata == 1);
+
+    // Metadata events precede the event they describe, on the same processor, with the same timestamp
+    const std::vector<RecordingSink::Event>& events = recordingSink.GetEvents ();
+    for (const size_t i : { 0, 1, 4, 5 }) {
+        EUT_CHECK (events[i].header.m_providerID == EventMetadataGuid);
+        EUT_CHECK (events[i].header.m_flags == ETLFormat::kEventHeaderFlagClassicHeader);
+        EUT_CHECK (events[i].header.m_timeStamp == events[i + (i % 2 == 0 ? 2 : 1)].header.m_timeStamp);
+        EUT_CHECK (events[i].header.m_processID == 1'000);
+        EUT_CHECK (events[i].header.m_threadID == 1'004);
+        EUT_CHECK (events[i].processorNumber == 2);
+    }
+
+    EUT_CHECK (events[0].header.m_opcode == ETWConstants::EventInfoOpcode);
+    EUT_CHECK (events[0].payloadSize == 100);
+    EUT_CHECK (events[1].header.m_opcode == ETWConstants::EventMapInfoOpcode);
+    EUT_CHECK (events[1].payloadSize == 20);
+    EUT_CHECK (events[2].header.m_providerID == kProviderID);
+    EUT_CHECK (events[3].header.m_providerID == kProviderID);
+    EUT_CHECK (events[6].header.m_version == 1);
+}
+
+TestRegistrator eventMetadataSink ("EventMetadata.Sink", EventMetadataSinkTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
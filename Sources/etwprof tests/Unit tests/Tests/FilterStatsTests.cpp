@@ -0,0 +1,140 @@
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "Profiler/FilterStats.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::EventRecordLayout;
+using ETWP::EventView;
+using ETWP::FilterStats;
+
+constexpr GUID   kUserProviderID = { 0x12345678, 0x9ABC, 0xDEF0, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+constexpr size_t kHeaderSize = sizeof (ETWP::EventHeaderLayout);
+
+void Count (FilterStats* pStats, const GUID& providerID, UCHAR opcode, USHORT payloadSize, bool kept)
+{
+    EventRecordLayout record = {};
+    record.m_header.m_providerID = providerID;
+    record.m_header.m_opcode = opcode;
+    record.m_userDataLength = payloadSize;
+
+    pStats->Count (EventView (record), kept);
+}
+
+void FilterStatsCountTest ()
+{
+    FilterStats stats;
+    EUT_CHECK (stats.GetCategories ().empty ());
+    EUT_CHECK (stats.ShouldTime ());
+
+    // Providers alternate, so both the cached and the searched paths are taken
+    for (int i = 0; i < 10; ++i) {
+        Count (&stats, PerfInfoGuid, ETWConstants::SampledProfileOpcode, 16, i % 2 == 0);
+        Count (&stats, StackWalkGuid, ETWConstants::StackWalkOpcode, 64, true);
+        Count (&stats, StackWalkGuid, ETWConstants::StackWalkOpcode, 64, true);
+        Count (&stats, PerfInfoGuid, ETWConstants::SampledProfileOpcode, 16, false);
+    }
+
+    Count (&stats, kUserProviderID, 7, 1'000, false);
+
+    EUT_CHECK (stats.GetNumberOfEvents () == 41);
+
+    // Sorted by bytes
+    const std::vector<FilterStats::Category> categories = stats.GetCategories ();
+    EUT_CHECK (categories.size () == 3);
+    EUT_CHECK (ETWP::EventDispatchTable::GUIDEquals (categories[0].providerID, StackWalkGuid));
+    EUT_CHECK (categories[0].counters.nKept == 20);
+    EUT_CHECK (categories[0].counters.nDropped == 0);
+    EUT_CHECK (categories[0].counters.nKeptBytes == 20 * (kHeaderSize + 64));
+    EUT_CHECK (ETWP::EventDispatchTable::GUIDEquals (categories[1].providerID, PerfInfoGuid));
+    EUT_CHECK (categories[1].opcode == ETWConstants::SampledProfileOpcode);
+    EUT_CHECK (categories[1].counters.nKept == 5);
+    EUT_CHECK (categories[1].counters.nDropped == 15);
+    EUT_CHECK (categories[1].counters.nDroppedBytes == 15 * (kHeaderSize + 16));
+    EUT_CHECK (categories[2].opcode == 7);
+
+    const FilterStats::Counters totals = stats.GetTotals ();
+    EUT_CHECK (totals.nKept == 25);
+    EUT_CHECK (totals.nDropped == 16);
+    EUT_CHECK (totals.nKeptBytes + totals.nDroppedBytes == 41 * kHeaderSize + 20 * 16 + 20 * 64 + 1'000);
+
+    EUT_CHECK (ETWP::GetProviderName (PerfInfoGuid) == "PerfInfo");
+    EUT_CHECK (ETWP::GetProviderName (kUserProviderID) == "12345678-9abc-def0-0102-030405060708");
+}
+
+void FilterStatsTimingTest ()
+{
+    FilterStats stats;
+    EUT_CHECK (stats.GetEstimatedFilterTime () == 0);
+
+    // Every kTimingInterval-th event is timed, the total is extrapolated from those
+    uint32_t nTimed = 0;
+    for (uint64_t i = 0; i < 4 * FilterStats::kTimingInterval; ++i) {
+        if (stats.ShouldTime ()) {
+            stats.AddTime (100);
+            ++nTimed;
+        }
+
+        Count (&stats, PerfInfoGuid, ETWConstants::SampledProfileOpcode, 16, true);
+    }
+
+    EUT_CHECK (nTimed == 4);
+    EUT_CHECK (stats.GetEstimatedFilterTime () == 100 * 4 * FilterStats::kTimingInterval);
+
+    // The decision of the filter is counted (and returned)
+    const EventRecordLayout record = {};
+    EUT_CHECK (!ETWP::FilterAndCount (EventView (record), &stats, [] () { return false; }));
+    EUT_CHECK (ETWP::FilterAndCount (EventView (record), &stats, [] () { return true; }));
+    EUT_CHECK (stats.GetNumberOfEvents () == 4 * FilterStats::kTimingInterval + 2);
+    EUT_CHECK (stats.GetTotals ().nDropped == 1);
+}
+
+void FilterStatsReportTest ()
+{
+    FilterStats stats;
+    for (UCHAR opcode = 0; opcode < 5; ++opcode)
+        Count (&stats, ThreadGuid, opcode, 10 * (opcode + 1), opcode % 2 == 0);
+
+    // Categories beyond the limit are summed up
+    const std::vector<std::wstring> lines = ETWP::FormatFilterStats (stats, 3);
+    EUT_CHECK (lines.size () == 1 + 3 + 1 + 1 + 1);    // Header, categories, the rest, total, filter time
+    EUT_CHECK (lines[1].starts_with (L"Thread"));
+    EUT_CHECK (lines[4].starts_with (L"(2 more)"));
+    EUT_CHECK (lines[5].starts_with (L"Total"));
+    EUT_CHECK (lines[6].starts_with (L"Filter time"));
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path () / "etwprof_unit_tests_filter_stats.json";
+    std::wstring errorMsg;
+    EUT_CHECK (stats.WriteJSON (path, &errorMsg));
+    {
+        std::ifstream file (path);
+        std::stringstream contents;
+        contents << file.rdbuf ();
+        EUT_CHECK (contents.str ().starts_with ("{\n  \"events\": 5,\n  \"kept\": 3,\n  \"dropped\": 2,\n"));
+        EUT_CHECK (contents.str ().find ("{ \"provider\": \"Thread\", \"providerID\": "
+                                         "\"3d6fa8d1-fe05-11d0-9dda-00c04fd7ba7c\", \"opcode\": 4, \"kept\": 1, "
+                                         "\"dropped\": 0, ") != std::string::npos);
+        EUT_CHECK (contents.str ().ends_with ("\n  ]\n}\n"));
+    }
+
+    std::error_code ec;
+    std::filesystem::remove (path, ec);
+}
+
+TestRegistrator countTestRegistrator ("FilterStats.Count", FilterStatsCountTest);
+TestRegistrator timingTestRegistrator ("FilterStats.Timing", FilterStatsTimingTest);
+TestRegistrator reportTestRegistrator ("FilterStats.Report", FilterStatsReportTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
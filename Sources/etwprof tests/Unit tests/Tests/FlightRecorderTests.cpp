@@ -0,0 +1,337 @@
+#include "TestEvents.hpp"
+#include "TestRegistrar.hpp"
+#include "TestSegments.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+#include "Profiler/FlightRecorder.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETLFormat = ETWP::ETLFormat;
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::CPUThresholdTrigger;
+using ETWP::EventView;
+using ETWP::FlightRecorder;
+using ETWP::FlightRecorderConfig;
+using ETWP::IOutputSegment;
+
+constexpr int64_t  kPerfFreq = 10'000'000;
+constexpr int64_t  kSampleInterval = 100;    // 10 us
+constexpr DWORD    kPID = 2'000;
+constexpr DWORD    kTID = kPID + 4;
+constexpr uint64_t kSampleIP = 0x7FF6'0000'1000;
+
+// Returns the dumped samples, after checking that they are the last ones written (at kSampleInterval), without gaps
+size_t CheckSamplesAreContiguous (const RecordedSegment& dump, int64_t lastTimeStamp)
+{
+    std::vector<int64_t> timeStamps;
+    for (const RecordedEvent& event : dump.events) {
+        if (event.providerID == PerfInfoGuid)
+            timeStamps.push_back (event.timeStamp);
+    }
+
+    EUT_CHECK (!timeStamps.empty ());
+    EUT_CHECK (timeStamps.back () == lastTimeStamp);
+    for (size_t i = 1; i < timeStamps.size (); ++i)
+        EUT_CHECK (timeStamps[i] - timeStamps[i - 1] == kSampleInterval);
+
+    return timeStamps.size ();
+}
+
+// Thousands of slices' worth of samples into a small budget: memory must stay bounded, and the dump must contain the
+//   last samples, after a rundown of the state at the first dumped event
+void FlightRecorderMemoryLimitTest ()
+{
+    SegmentCollector collector;
+
+    FlightRecorderConfig config;
+    config.maxMemory = 8 * FlightRecorder::kBlockSize;
+    config.sliceDuration = 10;
+
+    int64_t timeStamp = 1'000;
+    uint32_t nThreadsAlive = 0;
+    {
+        FlightRecorder recorder (collector.GetFactory (), config, kPerfFreq);
+
+        TestEvent process = MakeProcessEvent (ETWConstants::PDCStartOpcode, kPID, timeStamp);
+        EUT_CHECK (recorder.WriteEvent (process.GetView ()));
+        for (DWORD tid = 100; tid < 108; ++tid) {
+            TestEvent thread = MakeThreadEvent (ETWConstants::TDCStartOpcode, kPID, tid, timeStamp);
+            EUT_CHECK (recorder.WriteEvent (thread.GetView ()));
+            ++nThreadsAlive;
+        }
+
+        for (uint32_t i = 0; i < 200'000; ++i) {
+            // Some threads end, some start, long before the dumped window
+            if (i == 1'000 || i == 2'000) {
+                TestEvent threadEnd = MakeThreadEvent (ETWConstants::TEndOpcode, kPID, 100 + i / 1'000, timeStamp);
+                EUT_CHECK (recorder.WriteEvent (threadEnd.GetView ()));
+                --nThreadsAlive;
+            } else if (i == 3'000) {
+                TestEvent threadStart = MakeThreadEvent (ETWConstants::TStartOpcode, kPID, 200, timeStamp);
+                EUT_CHECK (recorder.WriteEvent (threadStart.GetView ()));
+                ++nThreadsAlive;
+            }
+
+            timeStamp += kSampleInterval;
+            TestEvent sample = MakeSampleEvent (kPID, kTID, kSampleIP, timeStamp);
+            EUT_CHECK (recorder.WriteEvent (sample.GetView ()));
+        }
+
+        EUT_CHECK (recorder.GetMemoryUsage () <= config.maxMemory);
+
+        std::wstring errorMsg;
+        EUT_CHECK (recorder.Close (true, &errorMsg));
+
+        const FlightRecorder::Stats stats = recorder.GetStats ();
+        EUT_CHECK (stats.nEventsRecorded == 1 + 8 + 3 + 200'000);
+        EUT_CHECK (stats.nEventsEvicted > 150'000);
+        EUT_CHECK (stats.nSlicesEvicted > 0);
+        EUT_CHECK (stats.nEventsDropped == 0);
+        EUT_CHECK (stats.nDumps == 1);
+        EUT_CHECK (stats.nDumpsFailed == 0);
+        EUT_CHECK (stats.memoryHighWaterMark <= config.maxMemory);
+        EUT_CHECK (stats.nEventsDumped == stats.nEventsRecorded - stats.nEventsEvicted + 1 + nThreadsAlive);
+        EUT_CHECK (recorder.GetMemoryUsage () == 0);
+    }
+
+    const std::vector<std::unique_ptr<RecordedSegment>>& dumps = collector.GetSegments ();
+    EUT_CHECK (dumps.size () == 1);
+
+    const RecordedSegment& dump = *dumps[0];
+    EUT_CHECK (dump.segmentNumber == 1);
+    EUT_CHECK (dump.finished);
+    EUT_CHECK (dump.writerID != std::this_thread::get_id ());
+
+    // Rundown: the process, then the live threads (ended ones are not there, the one started later is)
+    EUT_CHECK (dump.events.size () > 1 + nThreadsAlive);
+    EUT_CHECK (dump.events[0].providerID == ProcessGuid);
+    EUT_CHECK (dump.events[0].opcode == ETWConstants::PDCStartOpcode);
+    std::vector<DWORD> rundownTIDs;
+    for (uint32_t i = 1; i <= nThreadsAlive; ++i) {
+        EUT_CHECK (dump.events[i].providerID == ThreadGuid);
+        EUT_CHECK (dump.events[i].opcode == ETWConstants::TDCStartOpcode);
+        EUT_CHECK (dump.events[i].timeStamp == dump.startTimeStamp);
+
+        DWORD tid;
+        std::memcpy (&tid, dump.events[i].payload.data () + sizeof (DWORD), sizeof tid);
+        rundownTIDs.push_back (tid);
+    }
+
+    EUT_CHECK ((rundownTIDs == std::vector<DWORD> { 100, 103, 104, 105, 106, 107, 200 }));
+    EUT_CHECK (dump.events[nThreadsAlive + 1].providerID == PerfInfoGuid);
+    EUT_CHECK (dump.events[nThreadsAlive + 1].timeStamp == dump.startTimeStamp);
+
+    // Slices are evicted as a whole, so the dump holds whole slices (of 100 samples each)
+    const size_t nSamples = CheckSamplesAreContiguous (dump, timeStamp);
+    EUT_CHECK (nSamples > 10'000);
+    EUT_CHECK (nSamples < 8 * FlightRecorder::kBlockSize / 100);
+    EUT_CHECK ((dump.startTimeStamp - 1'000) % (kPerfFreq / 100) == 0);
+}
+
+// Slices older than maxDuration are evicted, even if there is plenty of memory
+void FlightRecorderDurationTest ()
+{
+    SegmentCollector collector;
+
+    FlightRecorderConfig config;
+    config.maxMemory = 1'024 * FlightRecorder::kBlockSize;
+    config.maxDuration = 1;
+    config.sliceDuration = 100;
+
+    int64_t timeStamp = 0;
+    {
+        FlightRecorder recorder (collector.GetFactory (), config, kPerfFreq);
+
+        // 5 seconds
+        for (uint32_t i = 0; i < 500'000; ++i) {
+            timeStamp += kSampleInterval;
+            TestEvent sample = MakeSampleEvent (kPID, kTID, kSampleIP, timeStamp);
+            EUT_CHECK (recorder.WriteEvent (sample.GetView ()));
+        }
+
+        std::wstring errorMsg;
+        EUT_CHECK (recorder.Close (true, &errorMsg));
+        EUT_CHECK (recorder.GetStats ().nEventsDropped == 0);
+    }
+
+    EUT_CHECK (collector.GetSegments ().size () == 1);
+
+    // At least a second, at most a second and a slice
+    const size_t nSamples = CheckSamplesAreContiguous (*collector.GetSegments ()[0], timeStamp);
+    EUT_CHECK (nSamples >= 100'000);
+    EUT_CHECK (nSamples <= 110'000);
+}
+
+// Dumps are requested from another thread. Each dump holds the events recorded since the previous one
+void FlightRecorderRequestDumpTest ()
+{
+    SegmentCollector collector;
+
+    FlightRecorderConfig config;
+    config.maxMemory = 64 * FlightRecorder::kBlockSize;
+    config.sliceDuration = 10;
+
+    int64_t timeStamp = 0;
+    {
+        FlightRecorder recorder (collector.GetFactory (), config, kPerfFreq);
+
+        TestEvent process = MakeProcessEvent (ETWConstants::PDCStartOpcode, kPID, timeStamp);
+        EUT_CHECK (recorder.WriteEvent (process.GetView ()));
+
+        for (uint32_t i = 0; i < 3'000; ++i) {
+            if (i == 1'000 || i == 2'000) {
+                std::thread requester ([&recorder]() { recorder.RequestDump (); });
+                requester.join ();
+            }
+
+            timeStamp += kSampleInterval;
+            TestEvent sample = MakeSampleEvent (kPID, kTID, kSampleIP, timeStamp);
+            EUT_CHECK (recorder.WriteEvent (sample.GetView ()));
+        }
+
+        // Nothing is dumped at the end, if not asked to
+        std::wstring errorMsg;
+        EUT_CHECK (recorder.Close (false, &errorMsg));
+        EUT_CHECK (recorder.GetStats ().nDumps == 2);
+        EUT_CHECK (recorder.GetStats ().nEventsDumped == 1 + 1'000 + 1 + 1'000);
+    }
+
+    const std::vector<std::unique_ptr<RecordedSegment>>& dumps = collector.GetSegments ();
+    EUT_CHECK (dumps.size () == 2);
+    for (uint32_t i = 0; i < dumps.size (); ++i) {
+        EUT_CHECK (dumps[i]->segmentNumber == i + 1);
+        EUT_CHECK (dumps[i]->finished);
+
+        // Both are self-contained (the second one starts with a rundown)
+        EUT_CHECK (dumps[i]->events[0].providerID == ProcessGuid);
+        EUT_CHECK (dumps[i]->events[0].opcode == ETWConstants::PDCStartOpcode);
+    }
+
+    EUT_CHECK (dumps[0]->startTimeStamp == 0);
+    EUT_CHECK (dumps[0]->events.size () == 1 + 1'000);      // The process event was recorded, not a rundown
+    EUT_CHECK (dumps[1]->startTimeStamp == 1'001 * kSampleInterval);
+    EUT_CHECK (dumps[1]->events.size () == 1 + 1'000);
+    EUT_CHECK (CheckSamplesAreContiguous (*dumps[1], 2'000 * kSampleInterval) == 1'000);
+}
+
+// Samples with stacks on two CPUs, into a tiny budget. Stacks must not be separated from their samples, and extended
+//   data must be kept
+void FlightRecorderStacksTest ()
+{
+    SegmentCollector collector;
+
+    FlightRecorderConfig config;
+    config.maxMemory = 2 * FlightRecorder::kBlockSize;
+    config.sliceDuration = 1;
+
+    const std::vector<uint8_t> extendedData = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    const std::vector<uint64_t> frames = MakeFrames (kSampleIP, 32);
+    int64_t timeStamp = 0;
+    {
+        FlightRecorder recorder (collector.GetFactory (), config, kPerfFreq);
+
+        for (uint32_t i = 0; i < 20'000; ++i) {
+            timeStamp += kSampleInterval;
+            const UCHAR processor = UCHAR (i % 2);
+
+            TestEvent sample = MakeSampleEvent (kPID, kTID, kSampleIP, timeStamp, processor);
+            sample.extendedData.push_back ({ 0,
+                                             ETLFormat::kExtTypeEventKey,
+                                             0,
+                                             USHORT (extendedData.size ()),
+                                             reinterpret_cast<ULONGLONG> (extendedData.data ()) });
+            recorder.WriteEvent (sample.GetView ());
+
+            TestEvent stack = MakeStackWalkEvent (kPID, kTID, frames, timeStamp, processor);
+            recorder.WriteEvent (stack.GetView ());
+        }
+
+        std::wstring errorMsg;
+        EUT_CHECK (recorder.Close (true, &errorMsg));
+        EUT_CHECK (recorder.GetStats ().nSlicesEvicted > 0);
+    }
+
+    EUT_CHECK (collector.GetSegments ().size () == 1);
+
+    const RecordedSegment& dump = *collector.GetSegments ()[0];
+    EUT_CHECK (dump.events.size () % 2 == 0);
+    for (size_t i = 0; i < dump.events.size (); i += 2) {
+        EUT_CHECK (dump.events[i].providerID == PerfInfoGuid);
+        EUT_CHECK (dump.events[i].extendedData == extendedData);
+        EUT_CHECK (dump.events[i + 1].providerID == StackWalkGuid);
+        EUT_CHECK (dump.events[i + 1].timeStamp == dump.events[i].timeStamp);
+    }
+
+    EUT_CHECK (dump.events.back ().timeStamp == timeStamp);
+}
+
+void FlightRecorderFailuresTest ()
+{
+    FlightRecorderConfig config;
+    config.maxMemory = 4 * FlightRecorder::kBlockSize;
+
+    uint32_t nCreated = 0;
+    const auto factory = [&nCreated] (uint32_t, int64_t, std::wstring* pErrorOut) {
+        ++nCreated;
+        *pErrorOut = L"Create failed";
+
+        return std::unique_ptr<IOutputSegment> ();
+    };
+
+    FlightRecorder recorder (factory, config, kPerfFreq);
+    for (uint32_t i = 0; i < 1'000; ++i) {
+        if (i == 500)
+            recorder.RequestDump ();
+
+        TestEvent sample = MakeSampleEvent (kPID, kTID, kSampleIP, i * kSampleInterval);
+        recorder.WriteEvent (sample.GetView ());
+    }
+
+    std::wstring errorMsg;
+    EUT_CHECK (!recorder.Close (true, &errorMsg));
+    EUT_CHECK (errorMsg == L"Create failed");
+    EUT_CHECK (nCreated == 2);
+    EUT_CHECK (recorder.GetStats ().nDumps == 2);
+    EUT_CHECK (recorder.GetStats ().nDumpsFailed == 2);
+    EUT_CHECK (recorder.GetMemoryUsage () == 0);
+
+    // Closing again is a no-op
+    EUT_CHECK (recorder.Close (true, &errorMsg));
+}
+
+void FlightRecorderCPUThresholdTriggerTest ()
+{
+    CPUThresholdTrigger trigger (50.0);
+
+    EUT_CHECK (!trigger.Update (0, 1'000));         // First sample, nothing to compare to
+    EUT_CHECK (!trigger.Update (100, 2'000));       // 10%
+    EUT_CHECK (trigger.Update (900, 3'000));        // 80%
+    EUT_CHECK (trigger.GetLastUsage () == 80.0);
+    EUT_CHECK (!trigger.Update (2'900, 4'000));     // 200% (e.g. two cores), but already above
+    EUT_CHECK (!trigger.Update (2'950, 5'000));     // 5%, re-armed
+    EUT_CHECK (!trigger.Update (10, 6'000));        // A target exited, CPU time went backwards
+    EUT_CHECK (trigger.Update (610, 7'000));        // 60%
+    EUT_CHECK (!trigger.Update (610, 7'000));       // No time passed
+}
+
+TestRegistrator flightRecorderMemoryLimit ("FlightRecorder.MemoryLimit", FlightRecorderMemoryLimitTest);
+TestRegistrator flightRecorderDuration ("FlightRecorder.Duration", FlightRecorderDurationTest);
+TestRegistrator flightRecorderRequestDump ("FlightRecorder.RequestDump", FlightRecorderRequestDumpTest);
+TestRegistrator flightRecorderStacks ("FlightRecorder.Stacks", FlightRecorderStacksTest);
+TestRegistrator flightRecorderFailures ("FlightRecorder.Failures", FlightRecorderFailuresTest);
+TestRegistrator flightRecorderCPUThresholdTrigger ("FlightRecorder.CPUThresholdTrigger",
+                                                   FlightRecorderCPUThresholdTriggerTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
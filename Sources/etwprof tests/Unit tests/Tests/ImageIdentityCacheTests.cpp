@@ -0,0 +1,261 @@
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "Profiler/ImageIdentity.hpp"
+#include "Profiler/ImageIdentityCache.hpp"
+
+namespace EUT {
+namespace {
+
+using ETWP::ImageIdentityCache;
+using ETWP::ImageIdentityResolver;
+using ETWP::PEImageIdentity;
+
+constexpr GUID kPDBGUID = { 0x12345678, 0x9ABC, 0xDEF0, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+
+// Deletes the directory (and everything in it) on destruction
+class TempDirectory final {
+public:
+    explicit TempDirectory (const std::string& name):
+        m_path (std::filesystem::temp_directory_path () / ("etwprof_unit_tests_image_identity_cache_" + name))
+    {
+        std::filesystem::remove_all (m_path);
+    }
+
+    ~TempDirectory ()
+    {
+        std::error_code ec;
+        std::filesystem::remove_all (m_path, ec);
+    }
+
+    const std::filesystem::path& GetPath () const { return m_path; }
+
+private:
+    std::filesystem::path m_path;
+};
+
+void WriteFile (const std::filesystem::path& path, const std::string& contents)
+{
+    std::ofstream file (path, std::ios::binary | std::ios::trunc);
+    file.write (contents.data (), contents.size ());
+}
+
+PEImageIdentity MakeIdentity (uint32_t timeDateStamp, bool hasPDBInfo)
+{
+    PEImageIdentity identity = {};
+    identity.timeDateStamp = timeDateStamp;
+    identity.sizeOfImage = 0x3000;
+    identity.checksum = 0xABCD;
+    identity.hasPDBInfo = hasPDBInfo;
+    if (hasPDBInfo) {
+        identity.pdbGUID = kPDBGUID;
+        identity.pdbAge = 3;
+        identity.pdbPath = "D:\\build\\sample\\sample_" + std::to_string (timeDateStamp) + ".pdb";
+    }
+
+    return identity;
+}
+
+bool IsSame (const PEImageIdentity& lhs, const PEImageIdentity& rhs)
+{
+    return lhs.timeDateStamp == rhs.timeDateStamp &&
+           lhs.sizeOfImage == rhs.sizeOfImage &&
+           lhs.checksum == rhs.checksum &&
+           lhs.hasPDBInfo == rhs.hasPDBInfo &&
+           lhs.pdbGUID == rhs.pdbGUID &&
+           lhs.pdbAge == rhs.pdbAge &&
+           lhs.pdbPath == rhs.pdbPath;
+}
+
+void ImageIdentityCacheRoundTripTest ()
+{
+    TempDirectory directory ("RoundTrip");
+    const std::filesystem::path cachePath = directory.GetPath () / "cache" / "ImageIdentityCache.bin";
+
+    const PEImageIdentity ntdll = MakeIdentity (1, true);
+    const PEImageIdentity driver = MakeIdentity (2, false);
+    {
+        ImageIdentityCache cache (cachePath);
+        EUT_CHECK (cache.GetNumberOfRecords () == 0);
+
+        cache.Add (L"C:\\Windows\\System32\\ntdll.dll", 100, 1'000, ntdll);
+        cache.Add (L"C:\\Windows\\System32\\drivers\\ntfs.sys", 200, 2'000, driver);
+
+        // Records added can be found before saving, as well
+        PEImageIdentity identity;
+        EUT_CHECK (cache.Find (L"C:\\Windows\\System32\\ntdll.dll", 100, 1'000, &identity));
+        EUT_CHECK (IsSame (identity, ntdll));
+
+        std::wstring errorMsg;
+        EUT_CHECK (cache.Save (&errorMsg));
+        EUT_CHECK (cache.GetNumberOfRecords () == 2);
+    }
+
+    ImageIdentityCache cache (cachePath);
+    EUT_CHECK (cache.GetNumberOfRecords () == 2);
+
+    PEImageIdentity identity;
+    EUT_CHECK (cache.Find (L"C:\\Windows\\System32\\ntdll.dll", 100, 1'000, &identity));
+    EUT_CHECK (IsSame (identity, ntdll));
+    EUT_CHECK (cache.Find (L"C:\\Windows\\System32\\drivers\\ntfs.sys", 200, 2'000, &identity));
+    EUT_CHECK (IsSame (identity, driver));
+
+    // Records of changed files are not valid anymore
+    EUT_CHECK (!cache.Find (L"C:\\Windows\\System32\\ntdll.dll", 101, 1'000, &identity));
+    EUT_CHECK (!cache.Find (L"C:\\Windows\\System32\\ntdll.dll", 100, 1'001, &identity));
+    EUT_CHECK (!cache.Find (L"C:\\Windows\\System32\\kernel32.dll", 100, 1'000, &identity));
+
+    // Many records (collisions in the hash table)
+    for (uint32_t i = 0; i < 1'000; ++i)
+        cache.Add (L"C:\\Images\\" + std::to_wstring (i) + L".dll", i, i, MakeIdentity (i, i % 2 == 0));
+
+    std::wstring errorMsg;
+    EUT_CHECK (cache.Save (&errorMsg));
+
+    const ImageIdentityCache reloadedCache (cachePath);
+    EUT_CHECK (reloadedCache.GetNumberOfRecords () == 1'002);
+
+    bool allFound = true;
+    for (uint32_t i = 0; i < 1'000; ++i) {
+        allFound = allFound &&
+                   reloadedCache.Find (L"C:\\Images\\" + std::to_wstring (i) + L".dll", i, i, &identity) &&
+                   IsSame (identity, MakeIdentity (i, i % 2 == 0));
+    }
+
+    EUT_CHECK (allFound);
+}
+
+void ImageIdentityCacheConcurrentUpdatesTest ()
+{
+    TempDirectory directory ("ConcurrentUpdates");
+    const std::filesystem::path cachePath = directory.GetPath () / "ImageIdentityCache.bin";
+
+    std::wstring errorMsg;
+    {
+        ImageIdentityCache cache (cachePath);
+        cache.Add (L"C:\\a.dll", 1, 1, MakeIdentity (1, true));
+        cache.Add (L"C:\\b.dll", 2, 2, MakeIdentity (2, true));
+        EUT_CHECK (cache.Save (&errorMsg));
+    }
+
+    // Both "processes" load the same file, then save one after the other: records of neither are lost
+    ImageIdentityCache cache1 (cachePath);
+    ImageIdentityCache cache2 (cachePath);
+    cache1.Add (L"C:\\c.dll", 3, 3, MakeIdentity (3, true));
+    cache2.Add (L"C:\\d.dll", 4, 4, MakeIdentity (4, false));
+    cache2.Add (L"C:\\b.dll", 5, 5, MakeIdentity (5, false));     // b.dll has been updated since
+    EUT_CHECK (cache1.Save (&errorMsg));
+    EUT_CHECK (cache2.Save (&errorMsg));
+
+    const ImageIdentityCache cache (cachePath);
+    EUT_CHECK (cache.GetNumberOfRecords () == 4);
+
+    PEImageIdentity identity;
+    EUT_CHECK (cache.Find (L"C:\\a.dll", 1, 1, &identity));
+    EUT_CHECK (!cache.Find (L"C:\\b.dll", 2, 2, &identity));
+    EUT_CHECK (cache.Find (L"C:\\b.dll", 5, 5, &identity));
+    EUT_CHECK (IsSame (identity, MakeIdentity (5, false)));
+    EUT_CHECK (cache.Find (L"C:\\c.dll", 3, 3, &identity));
+    EUT_CHECK (cache.Find (L"C:\\d.dll", 4, 4, &identity));
+
+    // No temporary files are left behind
+    uint32_t nFiles = 0;
+    for ([[maybe_unused]] const auto& entry : std::filesystem::directory_iterator (directory.GetPath ()))
+        ++nFiles;
+
+    EUT_CHECK (nFiles == 1);
+}
+
+void ImageIdentityCacheInvalidFilesTest ()
+{
+    TempDirectory directory ("InvalidFiles");
+    std::filesystem::create_directories (directory.GetPath ());
+    const std::filesystem::path cachePath = directory.GetPath () / "ImageIdentityCache.bin";
+
+    std::wstring errorMsg;
+    {
+        ImageIdentityCache cache (cachePath);
+        cache.Add (L"C:\\a.dll", 1, 1, MakeIdentity (1, true));
+        EUT_CHECK (cache.Save (&errorMsg));
+    }
+
+    // Truncated file
+    const uintmax_t size = std::filesystem::file_size (cachePath);
+    std::filesystem::resize_file (cachePath, size - 1);
+    {
+        ImageIdentityCache cache (cachePath);
+        EUT_CHECK (cache.GetNumberOfRecords () == 0);
+
+        PEImageIdentity identity;
+        EUT_CHECK (!cache.Find (L"C:\\a.dll", 1, 1, &identity));
+    }
+
+    // Not a cache file at all: it's replaced when saving
+    WriteFile (cachePath, std::string (size, 'x'));
+    {
+        ImageIdentityCache cache (cachePath);
+        EUT_CHECK (cache.GetNumberOfRecords () == 0);
+
+        cache.Add (L"C:\\b.dll", 2, 2, MakeIdentity (2, true));
+        EUT_CHECK (cache.Save (&errorMsg));
+    }
+
+    const ImageIdentityCache cache (cachePath);
+    EUT_CHECK (cache.GetNumberOfRecords () == 1);
+
+    PEImageIdentity identity;
+    EUT_CHECK (cache.Find (L"C:\\b.dll", 2, 2, &identity));
+}
+
+void ImageIdentityCacheResolverTest ()
+{
+    TempDirectory directory ("Resolver");
+    std::filesystem::create_directories (directory.GetPath ());
+    const std::filesystem::path imagePath = directory.GetPath () / "sample.dll";
+    const std::filesystem::path cachePath = directory.GetPath () / "ImageIdentityCache.bin";
+    const auto translator = [&] (const std::wstring& imagePath) { return directory.GetPath () / imagePath; };
+
+    // Not a PE image, so the identity can only come from the cache
+    WriteFile (imagePath, "not an image");
+
+    uint64_t fileSize;
+    int64_t lastWriteTime;
+    EUT_CHECK (ImageIdentityCache::GetFileKey (imagePath, &fileSize, &lastWriteTime));
+    EUT_CHECK (fileSize == 12);
+
+    ImageIdentityCache cache (cachePath);
+    cache.Add (imagePath, fileSize, lastWriteTime, MakeIdentity (1, true));
+
+    {
+        ImageIdentityResolver resolver (translator, &cache);
+        resolver.Resolve ({ L"sample.dll", L"missing.dll" }, 2);
+
+        const PEImageIdentity* pIdentity = resolver.Get (L"sample.dll");
+        EUT_CHECK (pIdentity != nullptr && IsSame (*pIdentity, MakeIdentity (1, true)));
+        EUT_CHECK (resolver.Get (L"missing.dll") == nullptr);
+        EUT_CHECK (resolver.GetStats ().nResolved == 1);
+        EUT_CHECK (resolver.GetStats ().nFromCache == 1);
+        EUT_CHECK (resolver.GetStats ().nUnresolved == 1);
+    }
+
+    // After the image changes, it's read again
+    WriteFile (imagePath, "still not an image");
+    {
+        ImageIdentityResolver resolver (translator, &cache);
+        EUT_CHECK (resolver.Get (L"sample.dll") == nullptr);
+        EUT_CHECK (resolver.GetStats ().nFromCache == 0);
+    }
+}
+
+TestRegistrator imageIdentityCacheRoundTrip ("ImageIdentityCache.RoundTrip", ImageIdentityCacheRoundTripTest);
+TestRegistrator imageIdentityCacheConcurrentUpdates ("ImageIdentityCache.ConcurrentUpdates",
+                                                     ImageIdentityCacheConcurrentUpdatesTest);
+TestRegistrator imageIdentityCacheInvalidFiles ("ImageIdentityCache.InvalidFiles", ImageIdentityCacheInvalidFilesTest);
+TestRegistrator imageIdentityCacheResolver ("ImageIdentityCache.Resolver", ImageIdentityCacheResolverTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
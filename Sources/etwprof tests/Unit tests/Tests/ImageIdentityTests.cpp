@@ -0,0 +1,496 @@
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETLReader.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+#include "OS/FileSystem/PEImage.hpp"
+#include "Profiler/ImageIdentity.hpp"
+#include "Profiler/OfflineFilter.hpp"
+#include "Profiler/ProgressCounters.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETLFormat = ETWP::ETLFormat;
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::EventRecordLayout;
+using ETWP::EventView;
+using ETWP::ImageIdentityResolver;
+using ETWP::ImageIdentitySink;
+using ETWP::PEImageIdentity;
+
+constexpr GUID     kPDBGUID = { 0x12345678, 0x9ABC, 0xDEF0, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+constexpr uint32_t kPDBAge = 3;
+constexpr char     kPDBPath[] = "D:\\build\\sample\\sample.pdb";
+constexpr uint32_t kTimeDateStamp = 0x5F00'1234;
+constexpr uint32_t kSizeOfImage = 0x3000;
+constexpr uint32_t kChecksum = 0xABCD;
+constexpr uint64_t kImageBase = 0x7FF8'1000'0000;
+
+// Deletes the directory (and everything in it) on destruction
+class TempDirectory final {
+public:
+    explicit TempDirectory (const std::string& name):
+        m_path (std::filesystem::temp_directory_path () / ("etwprof_unit_tests_image_identity_" + name))
+    {
+        std::filesystem::create_directories (m_path);
+    }
+
+    ~TempDirectory ()
+    {
+        std::error_code ec;
+        std::filesystem::remove_all (m_path, ec);
+    }
+
+    const std::filesystem::path& GetPath () const { return m_path; }
+
+private:
+    std::filesystem::path m_path;
+};
+
+template<typename T>
+void WriteAt (std::vector<uint8_t>* pBytes, size_t offset, const T& value)
+{
+    std::memcpy (pBytes->data () + offset, &value, sizeof value);
+}
+
+// A minimal, but well formed PE image: headers, and a single section, which holds the debug directory (with a
+//   CodeView entry, if requested) and the RSDS record
+std::vector<uint8_t> MakePEImage (bool pe32Plus, bool codeView)
+{
+    constexpr size_t   kNTHeadersOffset = 0x80;
+    constexpr uint32_t kSectionRVA = 0x1000;
+    constexpr uint32_t kSectionFileOffset = 0x400;
+    constexpr uint32_t kSectionSize = 0x200;
+    constexpr uint32_t kDebugDirectoryOffset = 0x10;      // In the section
+    constexpr uint32_t kRSDSOffset = 0x80;                // In the section
+
+    std::vector<uint8_t> image (kSectionFileOffset + kSectionSize);
+    WriteAt (&image, 0, uint16_t (0x5A4D));
+    WriteAt (&image, 0x3C, uint32_t (kNTHeadersOffset));
+    WriteAt (&image, kNTHeadersOffset, uint32_t (0x00004550));
+
+    // IMAGE_FILE_HEADER
+    const size_t fileHeaderOffset = kNTHeadersOffset + 4;
+    const uint16_t sizeOfOptionalHeader = pe32Plus ? 240 : 224;
+    WriteAt (&image, fileHeaderOffset, uint16_t (pe32Plus ? 0x8664 : 0x14C));
+    WriteAt (&image, fileHeaderOffset + 2, uint16_t (1));
+    WriteAt (&image, fileHeaderOffset + 4, kTimeDateStamp);
+    WriteAt (&image, fileHeaderOffset + 16, sizeOfOptionalHeader);
+
+    // IMAGE_OPTIONAL_HEADER32/64
+    const size_t optionalHeaderOffset = fileHeaderOffset + 20;
+    const size_t dataDirectoriesOffset = optionalHeaderOffset + (pe32Plus ? 112 : 96);
+    WriteAt (&image, optionalHeaderOffset, uint16_t (pe32Plus ? 0x20B : 0x10B));
+    WriteAt (&image, optionalHeaderOffset + 56, kSizeOfImage);
+    WriteAt (&image, optionalHeaderOffset + 64, kChecksum);
+    WriteAt (&image, dataDirectoriesOffset - 4, uint32_t (16));
+    WriteAt (&image, dataDirectoriesOffset + 6 * 8, kSectionRVA + kDebugDirectoryOffset);
+    WriteAt (&image, dataDirectoriesOffset + 6 * 8 + 4, uint32_t (2 * 28));
+
+    // IMAGE_SECTION_HEADER
+    const size_t sectionHeaderOffset = optionalHeaderOffset + sizeOfOptionalHeader;
+    std::memcpy (image.data () + sectionHeaderOffset, ".rdata", 6);
+    WriteAt (&image, sectionHeaderOffset + 8, kSectionSize);
+    WriteAt (&image, sectionHeaderOffset + 12, kSectionRVA);
+    WriteAt (&image, sectionHeaderOffset + 16, kSectionSize);
+    WriteAt (&image, sectionHeaderOffset + 20, kSectionFileOffset);
+
+    // IMAGE_DEBUG_DIRECTORY entries: a POGO (13) entry first, then the CodeView (2) one, as linkers write them
+    const uint32_t rsdsSize = 24 + sizeof kPDBPath;
+    const size_t debugDirectoryOffset = kSectionFileOffset + kDebugDirectoryOffset;
+    WriteAt (&image, debugDirectoryOffset + 12, uint32_t (13));
+    WriteAt (&image, debugDirectoryOffset + 28 + 12, uint32_t (codeView ? 2 : 13));
+    WriteAt (&image, debugDirectoryOffset + 28 + 16, rsdsSize);
+    WriteAt (&image, debugDirectoryOffset + 28 + 20, kSectionRVA + kRSDSOffset);
+    WriteAt (&image, debugDirectoryOffset + 28 + 24, kSectionFileOffset + kRSDSOffset);
+
+    const size_t rsdsOffset = kSectionFileOffset + kRSDSOffset;
+    WriteAt (&image, rsdsOffset, uint32_t (0x53445352));
+    WriteAt (&image, rsdsOffset + 4, kPDBGUID);
+    WriteAt (&image, rsdsOffset + 20, kPDBAge);
+    std::memcpy (image.data () + rsdsOffset + 24, kPDBPath, sizeof kPDBPath);
+
+    return image;
+}
+
+void WriteFile (const std::filesystem::path& path, const std::vector<uint8_t>& contents)
+{
+    std::ofstream file (path, std::ios::binary);
+    file.write (reinterpret_cast<const char*> (contents.data ()), contents.size ());
+}
+
+bool Parse (const std::vector<uint8_t>& image, PEImageIdentity* pIdentityOut)
+{
+    std::wstring errorMsg;
+
+    return ETWP::ParsePEImageIdentity (reinterpret_cast<const std::byte*> (image.data ()),
+                                       image.size (),
+                                       pIdentityOut,
+                                       &errorMsg);
+}
+
+void PEImageIdentityTest ()
+{
+    for (const bool pe32Plus : { true, false }) {
+        PEImageIdentity identity;
+        EUT_CHECK (Parse (MakePEImage (pe32Plus, true), &identity));
+        EUT_CHECK (identity.timeDateStamp == kTimeDateStamp);
+        EUT_CHECK (identity.sizeOfImage == kSizeOfImage);
+        EUT_CHECK (identity.checksum == kChecksum);
+        EUT_CHECK (identity.hasPDBInfo);
+        EUT_CHECK (identity.pdbGUID == kPDBGUID);
+        EUT_CHECK (identity.pdbAge == kPDBAge);
+        EUT_CHECK (identity.pdbPath == kPDBPath);
+
+        // Without a CodeView entry, the image is still identified by its timestamp and size
+        EUT_CHECK (Parse (MakePEImage (pe32Plus, false), &identity));
+        EUT_CHECK (identity.timeDateStamp == kTimeDateStamp);
+        EUT_CHECK (!identity.hasPDBInfo);
+        EUT_CHECK (identity.pdbPath.empty ());
+    }
+
+    // Truncated images: the headers are required, the debug information is not
+    const std::vector<uint8_t> image = MakePEImage (true, true);
+    PEImageIdentity identity;
+    for (const size_t size : { size_t (0), size_t (0x40), size_t (0x90), size_t (0x100) })
+        EUT_CHECK (!Parse (std::vector<uint8_t> (image.begin (), image.begin () + size), &identity));
+
+    EUT_CHECK (Parse (std::vector<uint8_t> (image.begin (), image.begin () + 0x490), &identity));
+    EUT_CHECK (!identity.hasPDBInfo);
+
+    std::vector<uint8_t> notPE = image;
+    WriteAt (&notPE, 0x80, uint32_t (0x0000454E));    // "NE"
+    EUT_CHECK (!Parse (notPE, &identity));
+
+    // From a file
+    TempDirectory directory ("PEImage");
+    WriteFile (directory.GetPath () / "sample.dll", image);
+
+    std::wstring errorMsg;
+    EUT_CHECK (ETWP::ReadPEImageIdentity (directory.GetPath () / "sample.dll", &identity, &errorMsg));
+    EUT_CHECK (identity.pdbPath == kPDBPath);
+    EUT_CHECK (!ETWP::ReadPEImageIdentity (directory.GetPath () / "missing.dll", &identity, &errorMsg));
+    EUT_CHECK (!errorMsg.empty ());
+}
+
+// Image_Load (v3) payload, as written by the kernel
+std::vector<uint8_t> MakeImageLoadPayload (uint64_t imageBase, DWORD pid, const std::wstring& fileName)
+{
+    std::vector<uint8_t> payload (56);
+    WriteAt (&payload, 0, imageBase);
+    WriteAt (&payload, 8, uint64_t (kSizeOfImage));
+    WriteAt (&payload, 16, pid);
+    WriteAt (&payload, 20, kChecksum);
+    WriteAt (&payload, 24, kTimeDateStamp);
+    for (const wchar_t c : fileName) {
+        payload.resize (payload.size () + 2);
+        WriteAt (&payload, payload.size () - 2, static_cast<char16_t> (c));
+    }
+
+    payload.resize (payload.size () + 2);
+
+    return payload;
+}
+
+EventRecordLayout MakeRecord (const GUID& providerID,
+                              UCHAR opcode,
+                              int64_t timeStamp,
+                              const std::vector<uint8_t>& payload)
+{
+    EventRecordLayout record = {};
+    record.m_header.m_providerID = providerID;
+    record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+    record.m_header.m_opcode = opcode;
+    record.m_header.m_version = 3;
+    record.m_header.m_processID = 1'000;
+    record.m_header.m_threadID = 1'004;
+    record.m_header.m_timeStamp = timeStamp;
+    record.m_processorNumber = 1;
+    record.m_pUserData = payload.data ();
+    record.m_userDataLength = static_cast<USHORT> (payload.size ());
+
+    return record;
+}
+
+// Keeps a copy of every event (without extended data items)
+class RecordingSink final : public ETWP::IEventSink {
+public:
+    struct Event {
+        ETWP::EventHeaderLayout header;
+        UCHAR                   processorNumber;
+        std::vector<uint8_t>    payload;
+    };
+
+    virtual bool WriteEvent (const EventView& event) override
+    {
+        const uint8_t* pUserData = static_cast<const uint8_t*> (event.GetUserData ());
+        m_events.push_back ({ event.GetRecord ().m_header,
+                              event.GetProcessorNumber (),
+                              std::vector<uint8_t> (pUserData, pUserData + event.GetUserDataLength ()) });
+
+        return true;
+    }
+
+    const std::vector<Event>& GetEvents () const { return m_events; }
+
+private:
+    std::vector<Event> m_events;
+};
+
+template<typename T>
+T ReadAt (const std::vector<uint8_t>& bytes, size_t offset)
+{
+    T value;
+    std::memcpy (&value, bytes.data () + offset, sizeof value);
+
+    return value;
+}
+
+std::filesystem::path ToDirectory (const std::filesystem::path& directory, const std::wstring& imagePath)
+{
+    return directory / imagePath.substr (imagePath.find_last_of (L'\\') + 1);
+}
+
+void ImageIdentitySinkTest ()
+{
+    TempDirectory directory ("Sink");
+    WriteFile (directory.GetPath () / "sample.dll", MakePEImage (true, true));
+    WriteFile (directory.GetPath () / "nopdb.dll", MakePEImage (true, false));
+
+    const std::filesystem::path directoryPath = directory.GetPath ();
+    ImageIdentityResolver resolver ([&directoryPath] (const std::wstring& imagePath) {
+        return ToDirectory (directoryPath, imagePath);
+    });
+
+    // Parallel resolution, with duplicates
+    resolver.Resolve ({ L"\\Device\\HarddiskVolume3\\sample.dll",
+                        L"\\Device\\HarddiskVolume3\\missing.dll",
+                        L"\\Device\\HarddiskVolume3\\sample.dll" },
+                      4);
+    EUT_CHECK (resolver.GetStats ().nResolved == 1);
+    EUT_CHECK (resolver.GetStats ().nUnresolved == 1);
+
+    RecordingSink recordingSink;
+    ImageIdentitySink sink (&recordingSink, &resolver);
+
+    const std::vector<uint8_t> samplePayload =
+        MakeImageLoadPayload (kImageBase, 1'000, L"\\Device\\HarddiskVolume3\\sample.dll");
+    const std::vector<uint8_t> noPDBPayload =
+        MakeImageLoadPayload (kImageBase + 0x10'0000, 1'000, L"\\Device\\HarddiskVolume3\\nopdb.dll");
+    const std::vector<uint8_t> missingPayload =
+        MakeImageLoadPayload (kImageBase + 0x20'0000, 1'000, L"\\Device\\HarddiskVolume3\\missing.dll");
+    const std::vector<uint8_t> samplePayloadV1 (4, 0);
+
+    int64_t timeStamp = 10;
+    const auto write = [&] (const GUID& providerID, UCHAR opcode, const std::vector<uint8_t>& payload) {
+        return sink.WriteEvent (EventView (MakeRecord (providerID, opcode, ++timeStamp, payload)));
+    };
+
+    EUT_CHECK (write (ImageLoadGuid, ETWConstants::ImageLoadOpcode, samplePayload));
+    EUT_CHECK (recordingSink.GetEvents ().size () == 3);
+    EUT_CHECK (write (ImageLoadGuid, ETWConstants::ImageDCStartOpcode, noPDBPayload));
+    EUT_CHECK (recordingSink.GetEvents ().size () == 5);  // No DbgID_RSDS
+    EUT_CHECK (write (ImageLoadGuid, ETWConstants::ImageLoadOpcode, missingPayload));
+    EUT_CHECK (recordingSink.GetEvents ().size () == 6);
+    EUT_CHECK (write (ImageLoadGuid, ETWConstants::ImageUnloadOpcode, samplePayload));
+    EUT_CHECK (write (ImageLoadGuid, ETWConstants::ImageLoadOpcode, samplePayloadV1));
+    EUT_CHECK (write (ProcessGuid, ETWConstants::ImageLoadOpcode, samplePayload));
+    EUT_CHECK (recordingSink.GetEvents ().size () == 9);
+
+    EUT_CHECK (sink.GetStats ().nImageEvents == 3);
+    EUT_CHECK (sink.GetStats ().nIdentityEventsWritten == 3);
+    EUT_CHECK (sink.GetStats ().nUnresolvedImageEvents == 1);
+    EUT_CHECK (resolver.GetStats ().nResolved == 2);    // nopdb.dll was resolved on demand
+
+    const std::vector<RecordingSink::Event>& events = recordingSink.GetEvents ();
+    for (const size_t i : { 1, 2, 4 }) {
+        EUT_CHECK (events[i].header.m_providerID == ImageInfoExtraGuid);
+        EUT_CHECK (events[i].header.m_flags == ETLFormat::kEventHeaderFlagClassicHeader);
+        EUT_CHECK (events[i].header.m_timeStamp == events[i - 1].header.m_timeStamp);
+        EUT_CHECK (events[i].header.m_processID == 1'000);
+        EUT_CHECK (events[i].header.m_threadID == 1'004);
+        EUT_CHECK (events[i].processorNumber == 1);
+    }
+
+    // ImageID
+    const std::vector<uint8_t>& imageID = events[1].payload;
+    const char16_t kFileName[] = u"sample.dll";
+    EUT_CHECK (events[1].header.m_opcode == ETWConstants::ImageIDOpcode);
+    EUT_CHECK (imageID.size () == 24 + sizeof kFileName);
+    EUT_CHECK (ReadAt<uint64_t> (imageID, 0) == kImageBase);
+    EUT_CHECK (ReadAt<uint64_t> (imageID, 8) == kSizeOfImage);
+    EUT_CHECK (ReadAt<uint32_t> (imageID, 16) == 1'000);
+    EUT_CHECK (ReadAt<uint32_t> (imageID, 20) == kTimeDateStamp);
+    EUT_CHECK (std::memcmp (imageID.data () + 24, kFileName, sizeof kFileName) == 0);
+
+    // DbgID_RSDS
+    const std::vector<uint8_t>& dbgID = events[2].payload;
+    EUT_CHECK (events[2].header.m_opcode == ETWConstants::DbgIDRSDSOpcode);
+    EUT_CHECK (dbgID.size () == 32 + sizeof kPDBPath);
+    EUT_CHECK (ReadAt<uint64_t> (dbgID, 0) == kImageBase);
+    EUT_CHECK (ReadAt<uint32_t> (dbgID, 8) == 1'000);
+    EUT_CHECK (ReadAt<GUID> (dbgID, 12) == kPDBGUID);
+    EUT_CHECK (ReadAt<uint32_t> (dbgID, 28) == kPDBAge);
+    EUT_CHECK (std::memcmp (dbgID.data () + 32, kPDBPath, sizeof kPDBPath) == 0);
+
+    EUT_CHECK (events[4].header.m_opcode == ETWConstants::ImageIDOpcode);
+    EUT_CHECK (ReadAt<uint64_t> (events[4].payload, 0) == kImageBase + 0x10'0000);
+}
+
+// Images not read yet are read by the background thread of the resolver, events are held back (in order) until then
+void ImageIdentitySinkInBackground ()
+{
+    TempDirectory directory ("SinkInBackground");
+    WriteFile (directory.GetPath () / "sample.dll", MakePEImage (true, true));
+
+    // Reading the image waits until the events are written
+    std::promise<void> readAllowed;
+    std::shared_future<void> readAllowedFuture = readAllowed.get_future ().share ();
+    const std::filesystem::path directoryPath = directory.GetPath ();
+    ImageIdentityResolver resolver ([&directoryPath, readAllowedFuture] (const std::wstring& imagePath) {
+        readAllowedFuture.wait ();
+
+        return ToDirectory (directoryPath, imagePath);
+    });
+
+    RecordingSink recordingSink;
+    ImageIdentitySink sink (&recordingSink, &resolver, true);
+
+    const std::vector<uint8_t> samplePayload =
+        MakeImageLoadPayload (kImageBase, 1'000, L"\\Device\\HarddiskVolume3\\sample.dll");
+    const std::vector<uint8_t> otherPayload (8, 0);
+
+    const auto write = [&] (const GUID& providerID,
+                            UCHAR opcode,
+                            int64_t timeStamp,
+                            const std::vector<uint8_t>& payload)
+    {
+        return sink.WriteEvent (EventView (MakeRecord (providerID, opcode, timeStamp, payload)));
+    };
+
+    EUT_CHECK (write (ProcessGuid, ETWConstants::PStartOpcode, 10, otherPayload));
+    EUT_CHECK (recordingSink.GetEvents ().size () == 1);    // Nothing is held back yet
+    EUT_CHECK (write (ImageLoadGuid, ETWConstants::ImageDCStartOpcode, 11, samplePayload));
+    EUT_CHECK (write (ProcessGuid, ETWConstants::PStartOpcode, 12, otherPayload));
+    EUT_CHECK (recordingSink.GetEvents ().size () == 1);
+    EUT_CHECK (!resolver.IsResolved (L"\\Device\\HarddiskVolume3\\sample.dll"));
+
+    readAllowed.set_value ();
+    EUT_CHECK (sink.Flush ());
+
+    const std::vector<std::pair<UCHAR, int64_t>> expectedEvents = {
+        { ETWConstants::PStartOpcode,       10 },
+        { ETWConstants::ImageDCStartOpcode, 11 },
+        { ETWConstants::ImageIDOpcode,      11 },
+        { ETWConstants::DbgIDRSDSOpcode,    11 },
+        { ETWConstants::PStartOpcode,       12 }
+    };
+    std::vector<std::pair<UCHAR, int64_t>> events;
+    for (const RecordingSink::Event& event : recordingSink.GetEvents ())
+        events.emplace_back (event.header.m_opcode, event.header.m_timeStamp);
+
+    EUT_CHECK (events == expectedEvents);
+    EUT_CHECK (sink.GetStats ().nEventsHeldBack == 2);
+    EUT_CHECK (sink.GetStats ().nIdentityEventsWritten == 2);
+    EUT_CHECK (resolver.GetStats ().nResolved == 1);
+
+    // Once the image is read, its events are not held back
+    EUT_CHECK (write (ImageLoadGuid, ETWConstants::ImageLoadOpcode, 13, samplePayload));
+    EUT_CHECK (recordingSink.GetEvents ().size () == 8);
+    EUT_CHECK (sink.GetStats ().nEventsHeldBack == 2);
+}
+
+// Identity events written by the offline filter end up in the output file, right after their image events
+void ImageIdentityOfflineFilter ()
+{
+    TempDirectory directory ("OfflineFilter");
+    WriteFile (directory.GetPath () / "sample.dll", MakePEImage (false, true));
+
+    const std::filesystem::path inputPath = directory.GetPath () / "input.etl";
+    const std::filesystem::path outputPath = directory.GetPath () / "output.etl";
+    {
+        ETWP::ETLWriterConfig config;
+        config.numberOfProcessors = 2;
+        config.startTimeStamp = 1;
+
+        ETWP::ETLWriter writer (inputPath, config);
+        const std::vector<uint8_t> targetPayload = MakeImageLoadPayload (kImageBase, 1'000, L"C:\\sample.dll");
+        const std::vector<uint8_t> otherPayload = MakeImageLoadPayload (kImageBase, 2'000, L"C:\\sample.dll");
+        EventRecordLayout otherRecord = MakeRecord (ImageLoadGuid, ETWConstants::ImageDCStartOpcode, 5, otherPayload);
+        otherRecord.m_header.m_processID = 2'000;
+
+        EUT_CHECK (writer.WriteEvent (EventView (MakeRecord (ImageLoadGuid,
+                                                             ETWConstants::ImageDCStartOpcode,
+                                                             5,
+                                                             targetPayload))));
+        EUT_CHECK (writer.WriteEvent (EventView (otherRecord)));
+        EUT_CHECK (writer.WriteEvent (EventView (MakeRecord (ImageLoadGuid,
+                                                             ETWConstants::ImageLoadOpcode,
+                                                             7,
+                                                             targetPayload))));
+
+        std::wstring errorMsg;
+        EUT_CHECK (writer.Close (&errorMsg));
+    }
+
+    const std::filesystem::path directoryPath = directory.GetPath ();
+    ETWP::OfflineFilterOptions options;
+    options.targetPIDs = { 1'000 };
+    options.imagePathTranslator = [&directoryPath] (const std::wstring& imagePath) {
+        return ToDirectory (directoryPath, imagePath);
+    };
+    ETWP::ProgressCounters progress;
+    options.pProgress = &progress;
+
+    ETWP::OfflineFilterStats stats;
+    std::wstring errorMsg;
+    EUT_CHECK (ETWP::FilterETLFile (inputPath, outputPath, options, &stats, &errorMsg));
+    EUT_CHECK (stats.imageResolverStats.nResolved == 1);
+    EUT_CHECK (stats.imageIdentityStats.nImageEvents == 2);
+    EUT_CHECK (stats.imageIdentityStats.nIdentityEventsWritten == 4);
+    EUT_CHECK (progress.Sample ().nBytesWritten > 0);  // Identity events are not in the way of counting
+
+    std::vector<std::pair<UCHAR, int64_t>> events;    // Opcodes and timestamps
+    uint32_t pdbAge = 0;
+    const ETWP::ETLReader reader (outputPath);
+    reader.ForEachEvent ([&] (const EventView& event) {
+        if (event.GetProviderID () == ImageInfoExtraGuid) {
+            EUT_CHECK (event.GetRecord ().m_header.m_version == 2);
+            if (event.GetOpcode () == ETWConstants::DbgIDRSDSOpcode)
+                std::memcpy (&pdbAge, static_cast<const uint8_t*> (event.GetUserData ()) + 28, sizeof pdbAge);
+        }
+
+        if (event.GetProviderID () != EventTraceEventGuid)
+            events.emplace_back (event.GetOpcode (), event.GetTimestamp ());
+    });
+
+    const std::vector<std::pair<UCHAR, int64_t>> expectedEvents = {
+        { ETWConstants::ImageDCStartOpcode, 5 },
+        { ETWConstants::ImageIDOpcode,      5 },
+        { ETWConstants::DbgIDRSDSOpcode,    5 },
+        { ETWConstants::ImageLoadOpcode,    7 },
+        { ETWConstants::ImageIDOpcode,      7 },
+        { ETWConstants::DbgIDRSDSOpcode,    7 }
+    };
+    EUT_CHECK (events == expectedEvents);
+    EUT_CHECK (pdbAge == kPDBAge);
+}
+
+TestRegistrator peImageIdentity ("PEImage.Identity", PEImageIdentityTest);
+TestRegistrator imageIdentitySink ("ImageIdentity.Sink", ImageIdentitySinkTest);
+TestRegistrator imageIdentitySinkInBackground ("ImageIdentity.SinkInBackground", ImageIdentitySinkInBackground);
+TestRegistrator imageIdentityOfflineFilter ("ImageIdentity.OfflineFilter", ImageIdentityOfflineFilter);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
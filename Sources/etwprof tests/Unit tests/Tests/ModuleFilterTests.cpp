@@ -0,0 +1,170 @@
+#include "TestEvents.hpp"
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "Profiler/ModuleFilter.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::EventView;
+using ETWP::ModuleFilterConfig;
+using ETWP::ModuleSampleFilter;
+
+constexpr DWORD    kPID = 2'000;
+constexpr DWORD    kTID = 2'004;
+constexpr DWORD    kOtherTID = 2'008;
+constexpr uint64_t kKernelBase = 0xFFFF'F800'0000'0000;
+constexpr uint64_t kTargetBase = 0x7FF6'0000'0000;      // "target.dll"
+constexpr uint64_t kOtherBase = 0x7FF7'0000'0000;       // "other.dll"
+constexpr uint64_t kImageSize = 0x10'0000;
+constexpr int64_t  kPerfFreq = 1'000'000;               // I.e. a tick is a microsecond
+
+struct WrittenEvent {
+    UCHAR   opcode;
+    int64_t timeStamp;
+
+    bool operator== (const WrittenEvent&) const = default;
+};
+
+class RecordingSink final : public ETWP::IEventSink {
+public:
+    virtual bool WriteEvent (const EventView& event) override
+    {
+        m_events.push_back ({ event.GetOpcode (), event.GetTimestamp () });
+
+        return true;
+    }
+
+    const std::vector<WrittenEvent>& GetEvents () const { return m_events; }
+
+private:
+    std::vector<WrittenEvent> m_events;
+};
+
+ModuleFilterConfig MakeConfig (uint32_t window)
+{
+    ModuleFilterConfig config;
+    config.moduleNames = { L"Target.DLL" };     // Case does not matter
+    config.window = window;
+
+    return config;
+}
+
+void ModuleFilterSamplesTest ()
+{
+    RecordingSink sink;
+    ModuleSampleFilter filter (&sink, MakeConfig (100), kPerfFreq);
+    const auto write = [&] (TestEvent event) { EUT_CHECK (filter.WriteEvent (event.GetView ())); };
+
+    constexpr UCHAR kSample = ETWConstants::SampledProfileOpcode;
+    constexpr UCHAR kStackWalk = ETWConstants::StackWalkOpcode;
+    constexpr UCHAR kImage = ETWConstants::ImageLoadOpcode;
+    constexpr UCHAR kThread = ETWConstants::TDCStartOpcode;
+
+    write (MakeImageEvent (kImage, 0, kKernelBase, kImageSize, L"\\SystemRoot\\system32\\ntoskrnl.exe", 1));
+    write (MakeImageEvent (kImage, kPID, kTargetBase, kImageSize, L"C:\\app\\target.dll", 2));
+    write (MakeImageEvent (kImage, kPID, kOtherBase, kImageSize, L"C:\\app\\other.dll", 3));
+
+    // The IP is in the module: kept right away, along with its stack
+    write (MakeSampleEvent (kPID, kTID, kTargetBase + 0x100, 10));
+    write (MakeStackWalkEvent (kPID, kTID, { kTargetBase + 0x100, kOtherBase + 0x100 }, 10));
+    EUT_CHECK (sink.GetEvents ().size () == 5);
+
+    // Only a frame of the (second) stack is in the module: events in between are held back, but not reordered
+    write (MakeSampleEvent (kPID, kTID, kKernelBase + 0x100, 20));
+    write (MakeStackWalkEvent (kPID, kTID, { kKernelBase + 0x100 }, 20));
+    write (MakeThreadEvent (kThread, kPID, kOtherTID, 21));
+    EUT_CHECK (sink.GetEvents ().size () == 5);
+    write (MakeStackWalkEvent (kPID, kTID, { kOtherBase + 0x100, kTargetBase + 0x200 }, 20));
+    EUT_CHECK (sink.GetEvents ().size () == 9);
+
+    // Not in the module: dropped with its stacks, once the next sample of the thread arrives
+    write (MakeSampleEvent (kPID, kTID, kOtherBase + 0x100, 30));
+    write (MakeStackWalkEvent (kPID, kTID, { kOtherBase + 0x100, kOtherBase + 0x200 }, 30));
+    write (MakeSampleEvent (kPID, kOtherTID, kTargetBase + 0x100, 31));
+    write (MakeSampleEvent (kPID, kTID, 0x1000, 40));
+    write (MakeStackWalkEvent (kPID, kTID, { 0x1000 }, 40));
+    EUT_CHECK (filter.Flush ());
+
+    const std::vector<WrittenEvent> expected = { { kImage, 1 },
+                                                 { kImage, 2 },
+                                                 { kImage, 3 },
+                                                 { kSample, 10 },
+                                                 { kStackWalk, 10 },
+                                                 { kSample, 20 },
+                                                 { kStackWalk, 20 },
+                                                 { kThread, 21 },
+                                                 { kStackWalk, 20 },
+                                                 { kSample, 31 } };
+    EUT_CHECK (sink.GetEvents () == expected);
+
+    const ModuleSampleFilter::Stats stats = filter.GetStats ();
+    EUT_CHECK (stats.nSamples == 5);
+    EUT_CHECK (stats.nSamplesKept == 3);
+    EUT_CHECK (stats.nEventsDropped == 4);
+    EUT_CHECK (stats.queueHighWaterMark > 0);
+
+    // All samples are counted, kept or not
+    const std::vector<ModuleSampleFilter::ThreadCounters> threadCounters = filter.GetThreadCounters ();
+    EUT_CHECK (threadCounters.size () == 2);
+    EUT_CHECK (threadCounters[0].tid == kTID && threadCounters[0].nSamples == 4 && threadCounters[0].nSamplesKept == 2);
+    EUT_CHECK (threadCounters[1].tid == kOtherTID && threadCounters[1].nSamples == 1);
+    EUT_CHECK (threadCounters[1].nSamplesKept == 1);
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path () / "etwprof_unit_tests_samples.csv";
+    std::wstring errorMsg;
+    EUT_CHECK (filter.WriteThreadCounters (path, &errorMsg));
+    {
+        std::ifstream file (path);
+        std::stringstream contents;
+        contents << file.rdbuf ();
+        EUT_CHECK (contents.str () == "pid,tid,samples,kept_samples\n2000,2004,4,2\n2000,2008,1,1\n");
+    }
+
+    std::error_code ec;
+    std::filesystem::remove (path, ec);
+}
+
+void ModuleFilterWindowTest ()
+{
+    RecordingSink sink;
+    ModuleSampleFilter filter (&sink, MakeConfig (1), kPerfFreq);
+    const auto write = [&] (TestEvent event) { EUT_CHECK (filter.WriteEvent (event.GetView ())); };
+
+    // Samples whose stacks do not arrive within the window are dropped...
+    write (MakeSampleEvent (kPID, kTID, 0x1000, 100));
+    write (MakeThreadEvent (ETWConstants::TDCStartOpcode, kPID, kOtherTID, 500));
+    EUT_CHECK (sink.GetEvents ().empty ());
+    write (MakeThreadEvent (ETWConstants::TDCStartOpcode, kPID, kOtherTID, 1'200));
+    EUT_CHECK (sink.GetEvents ().size () == 2);
+
+    // ...as are the ones of threads that ended
+    write (MakeSampleEvent (kPID, kTID, 0x1000, 2'000));
+    write (MakeThreadEvent (ETWConstants::TEndOpcode, kPID, kTID, 2'001));
+    EUT_CHECK (sink.GetEvents ().size () == 3);
+    EUT_CHECK (sink.GetEvents ().back ().timeStamp == 2'001);
+
+    // Stacks after the decision are not filtered
+    write (MakeStackWalkEvent (kPID, kTID, { 0x1000 }, 100));
+    EUT_CHECK (sink.GetEvents ().size () == 4);
+
+    EUT_CHECK (filter.Flush ());
+    EUT_CHECK (filter.GetStats ().nEventsDropped == 2);
+    EUT_CHECK (filter.GetStats ().nSamplesKept == 0);
+}
+
+TestRegistrator samplesTestRegistrator ("ModuleFilter.Samples", ModuleFilterSamplesTest);
+TestRegistrator windowTestRegistrator ("ModuleFilter.Window", ModuleFilterWindowTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "Profiler/ModuleIndex.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::EventRecordLayout;
+using ETWP::EventView;
+using ETWP::ModuleIndex;
+using ETWP::ModuleMap;
+
+constexpr DWORD    kPID = 2'000;
+constexpr DWORD    kOtherPID = 3'000;
+constexpr uint64_t kKernelBase = 0xFFFF'F800'0000'0000;
+constexpr uint64_t kUserBase = 0x7FF6'0000'0000;
+
+// Reference implementation: linear search
+uint32_t FindLinear (const std::vector<ModuleIndex::Interval>& intervals, UINT_PTR address)
+{
+    for (const ModuleIndex::Interval& interval : intervals) {
+        if (interval.base <= address && address < interval.end)
+            return interval.moduleID;
+    }
+
+    return ModuleIndex::kNoModule;
+}
+
+void ModuleIndexFindTest ()
+{
+    EUT_CHECK (ModuleIndex ({}).Find (kUserBase) == ModuleIndex::kNoModule);
+
+    // Every size from 1 to 40 (i.e. full and partial trees), with gaps between some intervals, and adjacent ones
+    for (uint32_t size = 1; size <= 40; ++size) {
+        std::vector<ModuleIndex::Interval> intervals;
+        UINT_PTR base = kUserBase;
+        for (uint32_t i = 0; i < size; ++i) {
+            const UINT_PTR end = base + 0x1000 * (1 + i % 3);
+            intervals.push_back ({ base, end, size - i });    // Inserted in reverse order
+            base = end + (i % 2 == 0 ? 0 : 0x800);
+        }
+
+        const ModuleIndex index ({ intervals.rbegin (), intervals.rend () });
+        EUT_CHECK (index.GetSize () == size);
+
+        std::vector<UINT_PTR> addresses = { 0, kUserBase - 1, base, base + 0x10'0000, UINTPTR_MAX };
+        for (const ModuleIndex::Interval& interval : intervals) {
+            addresses.push_back (interval.base);
+            addresses.push_back (interval.base + 1);
+            addresses.push_back (interval.end - 1);
+            addresses.push_back (interval.end);
+        }
+
+        std::vector<uint32_t> batchResults (addresses.size ());
+        index.FindBatch (addresses.data (), addresses.size (), batchResults.data ());
+        for (size_t i = 0; i < addresses.size (); ++i) {
+            EUT_CHECK (index.Find (addresses[i]) == FindLinear (intervals, addresses[i]));
+            EUT_CHECK (batchResults[i] == FindLinear (intervals, addresses[i]));
+        }
+    }
+}
+
+void ModuleIndexOverlapTest ()
+{
+    // Overlapping intervals are clipped, empty ones are dropped
+    const ModuleIndex index ({ { 0x1000, 0x3000, 1 }, { 0x2000, 0x4000, 2 }, { 0x5000, 0x5000, 3 } });
+    EUT_CHECK (index.GetSize () == 2);
+    EUT_CHECK (index.Find (0x1FFF) == 1);
+    EUT_CHECK (index.Find (0x2000) == 2);
+    EUT_CHECK (index.Find (0x3FFF) == 2);
+    EUT_CHECK (index.Find (0x4000) == ModuleIndex::kNoModule);
+    EUT_CHECK (index.Find (0x5000) == ModuleIndex::kNoModule);
+}
+
+void ModuleIndexBatchTest ()
+{
+    // More addresses than a batch, and not a multiple of it
+    std::vector<ModuleIndex::Interval> intervals;
+    for (uint32_t i = 0; i < 2'000; ++i)
+        intervals.push_back ({ kUserBase + i * 0x10'0000, kUserBase + i * 0x10'0000 + 0x8'0000, i });
+
+    const ModuleIndex index (intervals);
+
+    std::vector<UINT_PTR> addresses;
+    for (uint32_t i = 0; i < 3 * ModuleIndex::kBatchSize + 5; ++i)
+        addresses.push_back (kUserBase + i * 0x3'3333);
+
+    std::vector<uint32_t> results (addresses.size (), 0);
+    index.FindBatch (addresses.data (), addresses.size (), results.data ());
+    for (size_t i = 0; i < addresses.size (); ++i)
+        EUT_CHECK (results[i] == FindLinear (intervals, addresses[i]));
+}
+
+EventRecordLayout MakeRecord (const GUID& providerID, UCHAR opcode, const std::vector<uint8_t>& payload)
+{
+    EventRecordLayout record = {};
+    record.m_header.m_providerID = providerID;
+    record.m_header.m_opcode = opcode;
+    record.m_header.m_version = 2;
+    record.m_pUserData = payload.data ();
+    record.m_userDataLength = static_cast<USHORT> (payload.size ());
+
+    return record;
+}
+
+std::vector<uint8_t> MakeImagePayload (uint64_t imageBase, uint64_t imageSize, DWORD pid, const std::wstring& fileName)
+{
+    std::vector<uint8_t> payload (56);
+    std::memcpy (payload.data (), &imageBase, sizeof imageBase);
+    std::memcpy (payload.data () + 8, &imageSize, sizeof imageSize);
+    std::memcpy (payload.data () + 16, &pid, sizeof pid);
+    for (const wchar_t c : fileName) {
+        const char16_t c16 = static_cast<char16_t> (c);
+        payload.resize (payload.size () + 2);
+        std::memcpy (payload.data () + payload.size () - 2, &c16, sizeof c16);
+    }
+
+    payload.resize (payload.size () + 2);
+
+    return payload;
+}
+
+void ModuleMapTest ()
+{
+    ModuleMap map;
+    const auto write = [&] (const GUID& providerID, UCHAR opcode, const std::vector<uint8_t>& payload) {
+        map.OnEvent (EventView (MakeRecord (providerID, opcode, payload)));
+    };
+
+    write (ImageLoadGuid, ETWConstants::ImageDCStartOpcode, MakeImagePayload (kKernelBase, 0x10'0000, 0, L"nt.exe"));
+    write (ImageLoadGuid, ETWConstants::ImageLoadOpcode, MakeImagePayload (kUserBase, 0x1'0000, kPID, L"a.dll"));
+    write (ImageLoadGuid, ETWConstants::ImageLoadOpcode, MakeImagePayload (kUserBase, 0x2'0000, kOtherPID, L"b.dll"));
+
+    const std::shared_ptr<const ModuleIndex> snapshot = map.GetSnapshot (kPID);
+    EUT_CHECK (snapshot->GetSize () == 2);
+    EUT_CHECK (map.GetSnapshot (kPID) == snapshot);     // Not rebuilt, nothing changed
+    EUT_CHECK (map.GetModule (snapshot->Find (kUserBase + 0x100)).path == L"a.dll");
+    EUT_CHECK (map.GetModule (snapshot->Find (kKernelBase + 0x100)).path == L"nt.exe");
+    EUT_CHECK (map.GetModule (snapshot->Find (kKernelBase + 0x100)).pid == 0);
+    EUT_CHECK (snapshot->Find (kUserBase + 0x1'0000) == ModuleIndex::kNoModule);
+    EUT_CHECK (map.GetModule (map.GetSnapshot (kOtherPID)->Find (kUserBase + 0x1'0000)).path == L"b.dll");
+
+    // Unknown processes see the kernel only
+    EUT_CHECK (map.GetSnapshot (4'000)->GetSize () == 1);
+
+    // Changes create new snapshots, old ones stay as they were
+    write (ImageLoadGuid, ETWConstants::ImageUnloadOpcode, MakeImagePayload (kUserBase, 0x1'0000, kPID, L"a.dll"));
+    write (ImageLoadGuid, ETWConstants::ImageLoadOpcode, MakeImagePayload (kUserBase, 0x4'0000, kPID, L"c.dll"));
+    const std::shared_ptr<const ModuleIndex> newSnapshot = map.GetSnapshot (kPID);
+    EUT_CHECK (newSnapshot != snapshot);
+    EUT_CHECK (map.GetModule (newSnapshot->Find (kUserBase + 0x3'0000)).path == L"c.dll");
+    EUT_CHECK (map.GetModule (snapshot->Find (kUserBase + 0x100)).path == L"a.dll");
+    EUT_CHECK (snapshot->Find (kUserBase + 0x3'0000) == ModuleIndex::kNoModule);
+
+    // Kernel changes invalidate the snapshots of all processes
+    const std::shared_ptr<const ModuleIndex> otherSnapshot = map.GetSnapshot (kOtherPID);
+    map.AddModule (4, kKernelBase + 0x100'0000, 0x1000, L"driver.sys");
+    EUT_CHECK (map.GetSnapshot (kOtherPID) != otherSnapshot);
+    EUT_CHECK (map.GetSnapshot (kOtherPID)->GetSize () == 3);
+
+    std::vector<uint8_t> processPayload (24, 0);
+    std::memcpy (processPayload.data () + 8, &kOtherPID, sizeof kOtherPID);
+    write (ProcessGuid, ETWConstants::PEndOpcode, processPayload);
+    EUT_CHECK (map.GetSnapshot (kOtherPID)->GetSize () == 2);
+    EUT_CHECK (map.GetModule (otherSnapshot->Find (kUserBase)).path == L"b.dll");
+
+    const ModuleMap::Stats stats = map.GetStats ();
+    EUT_CHECK (stats.nModules == 5);
+    EUT_CHECK (stats.nProcesses == 1);
+}
+
+TestRegistrator findTestRegistrator ("ModuleIndex.Find", ModuleIndexFindTest);
+TestRegistrator overlapTestRegistrator ("ModuleIndex.Overlap", ModuleIndexOverlapTest);
+TestRegistrator batchTestRegistrator ("ModuleIndex.Batch", ModuleIndexBatchTest);
+TestRegistrator moduleMapTestRegistrator ("ModuleIndex.ModuleMap", ModuleMapTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
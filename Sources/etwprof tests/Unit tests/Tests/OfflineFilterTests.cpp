@@ -0,0 +1,262 @@
+#include "TestEvents.hpp"
+#include "TestFiles.hpp"
+#include "TestRegistrar.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "OS/ETW/ETLReader.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+#include "Profiler/OfflineFilter.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETLFormat = ETWP::ETLFormat;
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::ETLReader;
+using ETWP::ETLWriter;
+using ETWP::ETLWriterConfig;
+using ETWP::EventRecordLayout;
+using ETWP::EventView;
+using ETWP::OfflineFilterOptions;
+using ETWP::OfflineFilterStats;
+
+constexpr char kTempFilePrefix[] = "offline";
+constexpr int64_t kStartTimeStamp = 1'000'000;
+
+// Process_TypeGroup1 payload, as written by the kernel
+std::vector<uint8_t> MakeProcessPayload (UCHAR version, DWORD pid, DWORD parentPID, bool nullSID, const char* pName)
+{
+    std::vector<uint8_t> payload;
+    Append (&payload, uint64_t (0xFFFF'A000'0000'0000 + pid));    // UniqueProcessKey
+    Append (&payload, pid);
+    Append (&payload, parentPID);
+    Append (&payload, uint32_t (1));                                // SessionId
+    Append (&payload, uint32_t (0));                                // ExitStatus
+    if (version >= 3)
+        Append (&payload, uint64_t (0x1AD000));                     // DirectoryTableBase
+    if (version >= 4)
+        Append (&payload, uint32_t (0));                            // Flags
+
+    if (nullSID) {
+        Append (&payload, uint32_t (0));
+    } else {
+        Append (&payload, uint64_t (0xFFFF'C000'0000'2000));        // TOKEN_USER
+        Append (&payload, uint64_t (0));
+        const uint8_t sid[] = { 1, 2, 0, 0, 0, 0, 0, 5, 32, 0, 0, 0, 33, 2, 0, 0 };    // S-1-5-32-545
+        Append (&payload, sid);
+    }
+
+    for (const char* pChar = pName; *pChar != '\0'; ++pChar)
+        Append (&payload, *pChar);
+
+    Append (&payload, '\0');
+    Append (&payload, uint16_t (0));                                // CommandLine (empty)
+
+    return payload;
+}
+
+std::vector<uint8_t> MakeThreadPayload (DWORD pid, DWORD tid)
+{
+    std::vector<uint8_t> payload;
+    Append (&payload, pid);
+    Append (&payload, tid);
+    Append (&payload, uint64_t (0));   // StackBase, and so on
+
+    return payload;
+}
+
+std::vector<uint8_t> MakeSamplePayload (DWORD tid)
+{
+    std::vector<uint8_t> payload;
+    Append (&payload, uint64_t (0x7FF6'0000'1000));    // InstructionPointer
+    Append (&payload, tid);
+    Append (&payload, uint32_t (1));                   // Count
+
+    return payload;
+}
+
+std::string_view GetImageFileName (UCHAR version, const std::vector<uint8_t>& payload)
+{
+    EventRecordLayout record = {};
+    record.m_header.m_providerID = ProcessGuid;
+    record.m_header.m_version = version;
+    record.m_pUserData = payload.data ();
+    record.m_userDataLength = static_cast<USHORT> (payload.size ());
+
+    return ETWConstants::GetProcessImageFileName (EventView (record));
+}
+
+void ETWConstantsProcessImageFileName ()
+{
+    for (UCHAR version = 2; version <= 5; ++version) {
+        for (const bool nullSID : { false, true }) {
+            const std::vector<uint8_t> payload = MakeProcessPayload (version, 4, 8, nullSID, "notepad.exe");
+            EUT_CHECK (GetImageFileName (version, payload) == "notepad.exe");
+
+            // Truncated payloads
+            for (size_t size : { size_t (0), size_t (20), payload.size () - 16, payload.size () - 3 }) {
+                const std::vector<uint8_t> truncated (payload.begin (), payload.begin () + size);
+                EUT_CHECK (GetImageFileName (version, truncated).empty ());
+            }
+        }
+    }
+
+    EUT_CHECK (GetImageFileName (1, MakeProcessPayload (2, 4, 8, true, "notepad.exe")).empty ());
+}
+
+// Writes a system-wide trace, and remembers the timestamps of the events the filter should keep
+class TraceBuilder final {
+public:
+    explicit TraceBuilder (const std::filesystem::path& path): m_writer (path, GetConfig ()), m_timeStamp (kStartTimeStamp)
+    {
+    }
+
+    void AddProcessEvent (UCHAR opcode, DWORD pid, DWORD parentPID, const char* pName, bool keep, UCHAR version = 4)
+    {
+        Add (ProcessGuid, opcode, version, MakeProcessPayload (version, pid, parentPID, pid % 8 == 0, pName), keep);
+    }
+
+    void AddThreadEvent (UCHAR opcode, DWORD pid, DWORD tid, bool keep)
+    {
+        Add (ThreadGuid, opcode, 3, MakeThreadPayload (pid, tid), keep);
+    }
+
+    void AddSample (DWORD tid, bool keep)
+    {
+        Add (PerfInfoGuid, ETWConstants::SampledProfileOpcode, 2, MakeSamplePayload (tid), keep);
+    }
+
+    void Close ()
+    {
+        std::wstring errorMsg;
+        EUT_CHECK (m_writer.Close (&errorMsg));
+    }
+
+    const std::vector<int64_t>& GetExpectedTimeStamps () const { return m_expectedTimeStamps; }
+
+private:
+    ETLWriter            m_writer;
+    int64_t              m_timeStamp;
+    std::vector<int64_t> m_expectedTimeStamps;
+
+    static ETLWriterConfig GetConfig ()
+    {
+        ETLWriterConfig config;
+        config.bufferSize = 4 * 1'024;
+        config.numberOfProcessors = 3;
+        config.startTimeStamp = kStartTimeStamp;
+
+        return config;
+    }
+
+    void Add (const GUID& providerID, UCHAR opcode, UCHAR version, const std::vector<uint8_t>& payload, bool keep)
+    {
+        ++m_timeStamp;
+
+        EventRecordLayout record = {};
+        record.m_header.m_providerID = providerID;
+        record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+        record.m_header.m_opcode = opcode;
+        record.m_header.m_version = version;
+        record.m_header.m_timeStamp = m_timeStamp;
+        record.m_processorNumber = static_cast<UCHAR> (m_timeStamp % 3);
+        record.m_pUserData = payload.data ();
+        record.m_userDataLength = static_cast<USHORT> (payload.size ());
+
+        EUT_CHECK (m_writer.WriteEvent (EventView (record)));
+        if (keep)
+            m_expectedTimeStamps.push_back (m_timeStamp);
+    }
+};
+
+void OfflineFilterTargets ()
+{
+    TempFile input (kTempFilePrefix, "TargetsInput.etl");
+    TempFile output (kTempFilePrefix, "TargetsOutput.etl");
+
+    TraceBuilder builder (input.GetPath ());
+
+    // Rundown: targets by name (one of them with a truncated name), by PID, and others
+    builder.AddProcessEvent (ETWConstants::PDCStartOpcode, 100, 4, "target.exe", true);
+    builder.AddProcessEvent (ETWConstants::PDCStartOpcode, 200, 4, "other.exe", false);
+    builder.AddProcessEvent (ETWConstants::PDCStartOpcode, 300, 4, "ALongProcessNa", true, 3);
+    builder.AddProcessEvent (ETWConstants::PDCStartOpcode, 600, 4, "explicit.exe", true, 2);
+    builder.AddProcessEvent (ETWConstants::PDCStartOpcode, 700, 4, "target.ex", false);
+    builder.AddProcessEvent (ETWConstants::PDCStartOpcode, 900, 4, "target.exe.bak", false);
+    for (const DWORD pid : { 100, 200, 300, 600, 700, 900 }) {
+        const bool target = pid == 100 || pid == 300 || pid == 600;
+        builder.AddThreadEvent (ETWConstants::TDCStartOpcode, pid, pid + 4, target);
+        builder.AddSample (pid + 4, target);
+    }
+
+    // A child of a target, a child of another process, and a new process matching by name
+    builder.AddProcessEvent (ETWConstants::PStartOpcode, 400, 100, "child.exe", true);
+    builder.AddThreadEvent (ETWConstants::TStartOpcode, 400, 404, true);
+    builder.AddSample (404, true);
+    builder.AddProcessEvent (ETWConstants::PStartOpcode, 800, 200, "child.exe", false);
+    builder.AddThreadEvent (ETWConstants::TStartOpcode, 800, 804, false);
+    builder.AddSample (804, false);
+    builder.AddProcessEvent (ETWConstants::PStartOpcode, 500, 200, "TARGET.EXE", true);
+    builder.AddThreadEvent (ETWConstants::TStartOpcode, 500, 504, true);
+    builder.AddSample (504, true);
+
+    // A target ends, and its PID is reused by another process
+    builder.AddProcessEvent (ETWConstants::PEndOpcode, 100, 4, "target.exe", true);
+    builder.AddProcessEvent (ETWConstants::PStartOpcode, 100, 200, "other.exe", false);
+    builder.AddThreadEvent (ETWConstants::TStartOpcode, 100, 108, false);
+    builder.AddSample (108, false);
+    builder.Close ();
+
+    for (const uint32_t nThreads : { 1u, 3u }) {
+        OfflineFilterOptions options;
+        options.targetPIDs = { 600 };
+        options.targetNames = { L"Target.exe", L"ALongProcessName.exe" };
+        options.profileChildren = true;
+        options.nThreads = nThreads;
+        ETWP::ProgressCounters progress;
+        options.pProgress = &progress;
+
+        OfflineFilterStats stats;
+        std::wstring errorMsg;
+        EUT_CHECK (ETWP::FilterETLFile (input.GetPath (), output.GetPath (), options, &stats, &errorMsg));
+        EUT_CHECK (stats.nEventsKept == builder.GetExpectedTimeStamps ().size () + 1);  // Logfile header
+        EUT_CHECK (stats.nProcessesMatchedByName == 3);
+        EUT_CHECK (stats.nChildProcesses == 1);
+        EUT_CHECK (stats.writerStats.nEventsLost == 0);
+        EUT_CHECK (stats.filterStats.GetNumberOfEvents () == stats.nEventsRead);
+        EUT_CHECK (stats.filterStats.GetTotals ().nKept == stats.nEventsKept);
+        EUT_CHECK (progress.Sample ().nEvents == stats.nEventsRead);
+        EUT_CHECK (progress.Sample ().nEventsKept == stats.nEventsKept);
+        EUT_CHECK (progress.Sample ().nBytesWritten > 0);
+
+        std::vector<int64_t> timeStamps;
+        ETLReader reader (output.GetPath ());
+        reader.ForEachEvent ([&] (const EventView& event) {
+            if (event.GetProviderID () != EventTraceEventGuid)
+                timeStamps.push_back (event.GetTimestamp ());
+        });
+
+        std::sort (timeStamps.begin (), timeStamps.end ());
+        EUT_CHECK (timeStamps == builder.GetExpectedTimeStamps ());
+    }
+
+    OfflineFilterStats stats;
+    std::wstring errorMsg;
+    EUT_CHECK (!ETWP::FilterETLFile (input.GetPath () / "missing", output.GetPath (), {}, &stats, &errorMsg));
+    EUT_CHECK (!errorMsg.empty ());
+}
+
+TestRegistrator etwConstantsProcessImageFileName ("ETWConstants.ProcessImageFileName",
+                                                  ETWConstantsProcessImageFileName);
+TestRegistrator offlineFilterTargets ("OfflineFilter.Targets", OfflineFilterTargets);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
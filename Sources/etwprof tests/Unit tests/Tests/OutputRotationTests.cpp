@@ -0,0 +1,380 @@
+#include "TestEvents.hpp"
+#include "TestRegistrar.hpp"
+#include "TestSegments.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETLReader.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+#include "Profiler/OutputRotation.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETLFormat = ETWP::ETLFormat;
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::ETLReader;
+using ETWP::ETLWriter;
+using ETWP::ETLWriterConfig;
+using ETWP::EventView;
+using ETWP::IOutputSegment;
+using ETWP::OutputRotationConfig;
+using ETWP::RotatingSink;
+using ETWP::RundownState;
+
+constexpr int64_t  kPerfFreq = 10'000'000;
+constexpr DWORD    kPID = 1'000;
+constexpr uint64_t kImageSize = 0x10'000;
+constexpr uint64_t kSampleIP = 0x7FF6'0000'1000;
+
+// Writes an ETL file, which is closed on the finisher thread
+class ETLSegment final : public IOutputSegment, public ETWP::IEventSink {
+public:
+    ETLSegment (const std::filesystem::path& path, const ETLWriterConfig& config, std::thread::id* pFinisherIDOut):
+        m_writer (path, config),
+        m_pFinisherIDOut (pFinisherIDOut)
+    {
+    }
+
+    virtual ETWP::IEventSink* GetSink () override { return this; }
+    virtual uint64_t GetSize () const override { return m_writer.GetStats ().nBytesWritten; }
+
+    virtual bool Finish (std::wstring* pErrorOut) override
+    {
+        *m_pFinisherIDOut = std::this_thread::get_id ();
+
+        return m_writer.Close (pErrorOut);
+    }
+
+    virtual bool WriteEvent (const EventView& event) override { return m_writer.WriteEvent (event); }
+
+private:
+    ETLWriter        m_writer;
+    std::thread::id* m_pFinisherIDOut;
+};
+
+// Deletes the segments on destruction
+class TempSegments final {
+public:
+    explicit TempSegments (const std::string& name):
+        m_path (std::filesystem::temp_directory_path () / ("etwprof_unit_tests_rotation_" + name + ".etl"))
+    {
+    }
+
+    ~TempSegments ()
+    {
+        for (uint32_t i = 1; i <= 1'000; ++i) {
+            std::error_code ec;
+            if (!std::filesystem::remove (GetSegmentPath (i), ec))
+                break;
+        }
+    }
+
+    std::filesystem::path GetSegmentPath (uint32_t segmentNumber) const
+    {
+        return ETWP::GetSegmentPath (m_path.wstring (), segmentNumber);
+    }
+
+private:
+    std::filesystem::path m_path;
+};
+
+void OutputRotationSegmentPathTest ()
+{
+    using ETWP::GetSegmentPath;
+
+    EUT_CHECK (GetSegmentPath (L"C:\\traces\\app.etl", 1) == L"C:\\traces\\app_001.etl");
+    EUT_CHECK (GetSegmentPath (L"C:\\traces\\app.ETL", 12) == L"C:\\traces\\app_012.ETL");
+    EUT_CHECK (GetSegmentPath (L"C:\\traces\\app.etl.xz", 3) == L"C:\\traces\\app_003.etl.xz");
+    EUT_CHECK (GetSegmentPath (L"C:\\my.traces\\my.app.etl", 1) == L"C:\\my.traces\\my.app_001.etl");
+    EUT_CHECK (GetSegmentPath (L"/tmp/trace.bin", 1'234) == L"/tmp/trace_1234.bin");
+    EUT_CHECK (GetSegmentPath (L"/tmp.d/trace", 2) == L"/tmp.d/trace_002");
+    EUT_CHECK (GetSegmentPath (L"/tmp/.trace", 2) == L"/tmp/.trace_002");
+}
+
+void OutputRotationSegmentWriterConfigTest ()
+{
+    ETLWriterConfig traceConfig;
+    traceConfig.perfFreq = 3'000'000;
+    traceConfig.startTimeStamp = 1'000'000;
+    traceConfig.startSystemTime = 133'000'000'000'000'000;
+
+    // 90 seconds (and a third of a microsecond) later
+    const ETLWriterConfig segmentConfig = ETWP::GetSegmentWriterConfig (traceConfig, 1'000'000 + 270'000'001);
+    EUT_CHECK (segmentConfig.startTimeStamp == 271'000'001);
+    EUT_CHECK (segmentConfig.startSystemTime == 133'000'000'000'000'000 + 900'000'003);
+    EUT_CHECK (segmentConfig.perfFreq == traceConfig.perfFreq);
+
+    // The first segment starts with the trace
+    EUT_CHECK (ETWP::GetSegmentWriterConfig (traceConfig, 0).startTimeStamp == traceConfig.startTimeStamp);
+}
+
+void OutputRotationRundownStateTest ()
+{
+    RundownState state;
+
+    TestEvent processStart = MakeProcessEvent (ETWConstants::PStartOpcode, kPID, 10);
+    TestEvent otherProcessStart = MakeProcessEvent (ETWConstants::PDCStartOpcode, kPID + 1, 11);
+    TestEvent otherProcessEnd = MakeProcessEvent (ETWConstants::PEndOpcode, kPID + 1, 12);
+    state.Update (processStart.GetView ());
+    state.Update (otherProcessStart.GetView ());
+    state.Update (otherProcessEnd.GetView ());
+
+    std::vector<TestEvent> threadEvents;
+    for (DWORD tid = 100; tid < 110; ++tid)
+        threadEvents.push_back (MakeThreadEvent (ETWConstants::TStartOpcode, kPID, tid, 20 + tid));
+
+    threadEvents.push_back (MakeThreadEvent (ETWConstants::TEndOpcode, kPID, 105, 200));
+    threadEvents.push_back (MakeThreadEvent (ETWConstants::TDCEndOpcode, kPID, 106, 200));   // Not an end
+    for (TestEvent& event : threadEvents)
+        state.Update (event.GetView ());
+
+    TestEvent imageLoad = MakeImageEvent (ETWConstants::ImageLoadOpcode, kPID, 0x7FF6'0000'0000, kImageSize, L"", 300);
+    TestEvent otherImageLoad = MakeImageEvent (ETWConstants::ImageDCStartOpcode, kPID, 0x7FF7'0000'0000,
+                                               kImageSize, L"", 301);
+    TestEvent otherImageUnload = MakeImageEvent (ETWConstants::ImageUnloadOpcode, kPID, 0x7FF7'0000'0000,
+                                                 kImageSize, L"", 302);
+    TestEvent truncatedImageLoad = MakeImageEvent (ETWConstants::ImageLoadOpcode, kPID, 0x7FF8'0000'0000,
+                                                   kImageSize, L"", 303);
+    truncatedImageLoad.payload.resize (8);
+    state.Update (imageLoad.GetView ());
+    state.Update (otherImageLoad.GetView ());
+    state.Update (otherImageUnload.GetView ());
+    state.Update (truncatedImageLoad.GetView ());
+
+    EUT_CHECK (state.GetNumberOfProcesses () == 1);
+    EUT_CHECK (state.GetNumberOfThreads () == 9);
+    EUT_CHECK (state.GetNumberOfImages () == 1);
+
+    TestEvent atEvent = MakeSampleEvent (kPID, 100, kSampleIP, 1'000, 3);
+    RecordingSink sink;
+    EUT_CHECK (state.Write (atEvent.GetView (), &sink) == 11);
+
+    const std::vector<RecordedEvent>& events = sink.GetEvents ();
+    EUT_CHECK (events.size () == 11);
+    EUT_CHECK (events[0].providerID == ProcessGuid);
+    EUT_CHECK (events[0].opcode == ETWConstants::PDCStartOpcode);
+    EUT_CHECK (events[0].payload == processStart.payload);
+    for (size_t i = 1; i < 10; ++i) {
+        EUT_CHECK (events[i].providerID == ThreadGuid);
+        EUT_CHECK (events[i].opcode == ETWConstants::TDCStartOpcode);
+    }
+
+    EUT_CHECK (events[10].providerID == ImageLoadGuid);
+    EUT_CHECK (events[10].opcode == ETWConstants::ImageDCStartOpcode);
+    EUT_CHECK (events[10].payload == imageLoad.payload);
+
+    for (const RecordedEvent& event : events) {
+        EUT_CHECK (event.timeStamp == 1'000);
+        EUT_CHECK (event.processorNumber == 3);
+    }
+}
+
+// Samples with stacks, on 4 CPUs, with some thread and image churn. Every segment must be readable, and must start
+//   with the rundown of the state at its start
+void OutputRotationRotatingSinkTest ()
+{
+    TempSegments segments ("sink");
+
+    ETLWriterConfig traceConfig;
+    traceConfig.numberOfProcessors = 4;
+    traceConfig.perfFreq = kPerfFreq;
+    traceConfig.startTimeStamp = 1'000;
+    traceConfig.startSystemTime = 133'000'000'000'000'000;
+
+    std::vector<int64_t> segmentStartTimeStamps;
+    std::thread::id finisherID;
+    const auto factory = [&] (uint32_t segmentNumber, int64_t startTimeStamp, std::wstring*) {
+        EUT_CHECK (segmentNumber == segmentStartTimeStamps.size () + 1);
+        segmentStartTimeStamps.push_back (startTimeStamp);
+
+        return std::make_unique<ETLSegment> (segments.GetSegmentPath (segmentNumber),
+                                             ETWP::GetSegmentWriterConfig (traceConfig, startTimeStamp),
+                                             &finisherID);
+    };
+
+    OutputRotationConfig config;
+    config.maxSegmentSize = 4 * ETLFormat::kDefaultBufferSize;
+
+    RotatingSink sink (factory, config, kPerfFreq);
+
+    int64_t timeStamp = 1'000;
+    uint64_t nWritten = 0;
+    const auto write = [&sink, &nWritten] (TestEvent event) {
+        EUT_CHECK (sink.WriteEvent (event.GetView ()));
+        ++nWritten;
+    };
+
+    write (MakeProcessEvent (ETWConstants::PDCStartOpcode, kPID, ++timeStamp));
+    for (DWORD tid = 100; tid < 104; ++tid)
+        write (MakeThreadEvent (ETWConstants::TDCStartOpcode, kPID, tid, ++timeStamp));
+
+    write (MakeImageEvent (ETWConstants::ImageDCStartOpcode, kPID, 0x7FF6'0000'0000, kImageSize, L"", ++timeStamp));
+
+    const std::vector<uint64_t> frames = MakeFrames (kSampleIP, 24);
+    uint64_t nSamples = 0;
+    int64_t churnTimeStamp = 0;
+    for (uint32_t i = 0; i < 20'000; ++i) {
+        const UCHAR processor = static_cast<UCHAR> (i % 4);
+        const DWORD tid = 100 + i % 4;
+        ++timeStamp;
+        write (MakeSampleEvent (kPID, tid, kSampleIP, timeStamp, processor));
+        write (MakeStackWalkEvent (kPID, tid, frames, timeStamp, processor));
+        ++nSamples;
+
+        if (i == 10'000) {
+            write (MakeThreadEvent (ETWConstants::TEndOpcode, kPID, 103, ++timeStamp));
+            write (MakeImageEvent (ETWConstants::ImageLoadOpcode, kPID, 0x7FF7'0000'0000,
+                                   kImageSize, L"", ++timeStamp));
+            churnTimeStamp = timeStamp;
+        }
+    }
+
+    std::wstring errorMsg;
+    EUT_CHECK (sink.Close (&errorMsg));
+    EUT_CHECK (finisherID != std::thread::id ());
+    EUT_CHECK (finisherID != std::this_thread::get_id ());
+
+    const RotatingSink::Stats stats = sink.GetStats ();
+    EUT_CHECK (stats.nSegments > 4);
+    EUT_CHECK (stats.nSegments == segmentStartTimeStamps.size ());
+    EUT_CHECK (stats.nSegmentsFailed == 0);
+    EUT_CHECK (segmentStartTimeStamps[0] == 0);
+
+    uint64_t nRead = 0;
+    uint64_t nRundownRead = 0;
+    uint64_t nSamplesRead = 0;
+    for (uint32_t segmentNumber = 1; segmentNumber <= stats.nSegments; ++segmentNumber) {
+        const ETLReader reader (segments.GetSegmentPath (segmentNumber));
+        const int64_t segmentStart = segmentStartTimeStamps[segmentNumber - 1];
+        EUT_CHECK (segmentNumber == 1 || reader.GetLogfileHeader ().m_startTime > traceConfig.startSystemTime);
+
+        RecordingSink recordingSink;
+        reader.ForEachEvent ([&recordingSink] (const EventView& event) { recordingSink.WriteEvent (event); });
+
+        uint32_t nProcesses = 0;
+        uint32_t nThreads = 0;
+        uint32_t nImages = 0;
+        GUID lastProviderIDs[4] = {};   // Per CPU
+        for (const RecordedEvent& event : recordingSink.GetEvents ()) {
+            // (Process, thread and image DCStart opcodes are the same)
+            const bool rundown = segmentNumber > 1 && event.timeStamp == segmentStart &&
+                                 event.opcode == ETWConstants::PDCStartOpcode &&
+                                 (event.providerID == ProcessGuid || event.providerID == ThreadGuid ||
+                                  event.providerID == ImageLoadGuid);
+            if (rundown) {
+                nProcesses += event.providerID == ProcessGuid;
+                nThreads += event.providerID == ThreadGuid;
+                nImages += event.providerID == ImageLoadGuid;
+                ++nRundownRead;
+            } else if (event.providerID != EventTraceEventGuid) {     // Not the logfile header
+                ++nRead;
+            }
+
+            // A stack is always in the same segment as its sample (stacks follow samples on the same CPU)
+            if (event.providerID == StackWalkGuid)
+                EUT_CHECK (lastProviderIDs[event.processorNumber] == PerfInfoGuid);
+
+            nSamplesRead += event.providerID == PerfInfoGuid;
+            lastProviderIDs[event.processorNumber] = event.providerID;
+        }
+
+        if (segmentNumber > 1 && segmentStart != churnTimeStamp) {
+            const bool afterChurn = segmentStart > churnTimeStamp;
+            EUT_CHECK (nProcesses == 1);
+            EUT_CHECK (nThreads == (afterChurn ? 3 : 4));
+            EUT_CHECK (nImages == (afterChurn ? 2 : 1));
+        }
+    }
+
+    EUT_CHECK (nRead == nWritten);
+    EUT_CHECK (nSamplesRead == nSamples);
+    EUT_CHECK (nRundownRead == stats.nRundownEventsWritten);
+}
+
+void OutputRotationDurationTest ()
+{
+    SegmentCollector collector;
+    OutputRotationConfig config;
+    config.maxSegmentDuration = 2;
+
+    {
+        RotatingSink sink (collector.GetFactory (), config, 1'000);
+
+        // 10 seconds, a sample every 100 ms, starting at 5 s
+        for (int64_t timeStamp = 5'000; timeStamp < 15'000; timeStamp += 100) {
+            TestEvent sample = MakeSampleEvent (kPID, 100, kSampleIP, timeStamp, 0);
+            EUT_CHECK (sink.WriteEvent (sample.GetView ()));
+        }
+
+        std::wstring errorMsg;
+        EUT_CHECK (sink.Close (&errorMsg));
+        EUT_CHECK (sink.GetStats ().nSegments == 5);
+    }
+
+    std::vector<int64_t> segmentStartTimeStamps;
+    for (const std::unique_ptr<RecordedSegment>& segment : collector.GetSegments ()) {
+        EUT_CHECK (segment->finished);
+        segmentStartTimeStamps.push_back (segment->startTimeStamp);
+    }
+
+    EUT_CHECK ((segmentStartTimeStamps == std::vector<int64_t> { 0, 7'000, 9'000, 11'000, 13'000 }));
+}
+
+void OutputRotationFailuresTest ()
+{
+    // Creating the third segment fails, so the second one is written until the end. Finishing the first one fails
+    SegmentCollector collector (3, 1);
+    OutputRotationConfig config;
+    config.maxSegmentDuration = 1;
+
+    RotatingSink sink (collector.GetFactory (), config, 1'000);
+    for (int64_t timeStamp = 1'000; timeStamp <= 5'000; timeStamp += 100) {
+        TestEvent sample = MakeSampleEvent (kPID, 100, kSampleIP, timeStamp, 0);
+        EUT_CHECK (sink.WriteEvent (sample.GetView ()));
+    }
+
+    std::wstring errorMsg;
+    EUT_CHECK (!sink.Close (&errorMsg));
+    EUT_CHECK (errorMsg == L"Finish failed" || errorMsg == L"Create failed");
+    EUT_CHECK (collector.GetNumberOfRequests () == 3);
+    EUT_CHECK (collector.GetSegments ().size () == 2);
+    EUT_CHECK (collector.GetSegments ()[0]->finished && collector.GetSegments ()[1]->finished);
+    EUT_CHECK (sink.GetStats ().nSegments == 2);
+    EUT_CHECK (sink.GetStats ().nSegmentsFailed == 2);
+
+    // The first segment cannot be created
+    const auto failingFactory = [] (uint32_t, int64_t, std::wstring* pErrorOut) {
+        *pErrorOut = L"Create failed";
+
+        return std::unique_ptr<IOutputSegment> ();
+    };
+
+    bool thrown = false;
+    try {
+        RotatingSink failingSink (failingFactory, config, 1'000);
+    } catch (const RotatingSink::InitException& e) {
+        thrown = e.GetMsg () == L"Create failed";
+    }
+
+    EUT_CHECK (thrown);
+}
+
+TestRegistrator outputRotationSegmentPath ("OutputRotation.SegmentPath", OutputRotationSegmentPathTest);
+TestRegistrator outputRotationSegmentWriterConfig ("OutputRotation.SegmentWriterConfig",
+                                                   OutputRotationSegmentWriterConfigTest);
+TestRegistrator outputRotationRundownState ("OutputRotation.RundownState", OutputRotationRundownStateTest);
+TestRegistrator outputRotationRotatingSink ("OutputRotation.RotatingSink", OutputRotationRotatingSinkTest);
+TestRegistrator outputRotationDuration ("OutputRotation.Duration", OutputRotationDurationTest);
+TestRegistrator outputRotationFailures ("OutputRotation.Failures", OutputRotationFailuresTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
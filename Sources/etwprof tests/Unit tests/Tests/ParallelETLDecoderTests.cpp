@@ -0,0 +1,261 @@
+#include "TestFiles.hpp"
+#include "TestRegistrar.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETLReader.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/ParallelETLDecoder.hpp"
+#include "Utility/LoserTree.hpp"
+#include "Utility/WorkStealingRanges.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETLFormat = ETWP::ETLFormat;
+
+using ETWP::ETLBufferView;
+using ETWP::ETLReader;
+using ETWP::ETLWriter;
+using ETWP::ETLWriterConfig;
+using ETWP::EventRecordLayout;
+using ETWP::EventView;
+using ETWP::LoserTree;
+using ETWP::ParallelETLDecoder;
+using ETWP::WorkStealingRanges;
+
+constexpr char kTempFilePrefix[] = "parallel";
+constexpr int64_t kStartTimeStamp = 1'000'000;
+
+void LoserTreeMerge ()
+{
+    std::mt19937_64 random (3);
+    for (size_t nSources = 1; nSources <= 17; ++nSources) {
+        // Sorted sources (some of them empty), with lots of equal keys
+        std::vector<std::vector<int>> sources (nSources);
+        std::vector<std::pair<int, size_t>> expected;
+        for (size_t s = 0; s < nSources; ++s) {
+            sources[s].resize (random () % 50);
+            for (int& key : sources[s]) {
+                key = static_cast<int> (random () % 100);
+                expected.push_back ({ key, s });
+            }
+
+            std::sort (sources[s].begin (), sources[s].end ());
+        }
+
+        std::sort (expected.begin (), expected.end ());
+
+        LoserTree<int> tree (nSources);
+        std::vector<size_t> positions (nSources, 0);
+        for (size_t s = 0; s < nSources; ++s) {
+            if (!sources[s].empty ())
+                tree.SetKey (s, sources[s][0]);
+        }
+
+        tree.Build ();
+
+        std::vector<std::pair<int, size_t>> merged;
+        for (size_t s = tree.GetWinner (); s != LoserTree<int>::kNoWinner; s = tree.GetWinner ()) {
+            EUT_CHECK (tree.GetWinnerKey () == sources[s][positions[s]]);
+            merged.push_back ({ sources[s][positions[s]], s });
+
+            if (++positions[s] < sources[s].size ())
+                tree.ReplaceWinnerKey (sources[s][positions[s]]);
+            else
+                tree.RemoveWinner ();
+        }
+
+        // Ties are broken by source index
+        EUT_CHECK (merged == expected);
+    }
+
+    LoserTree<int> emptyTree (0);
+    emptyTree.Build ();
+    EUT_CHECK (emptyTree.GetWinner () == LoserTree<int>::kNoWinner);
+}
+
+void WorkStealingRangesEachItemOnce ()
+{
+    for (const uint32_t nItems : { 0u, 3u, 10'000u }) {
+        const uint32_t nWorkers = 8;
+        WorkStealingRanges ranges (nItems, nWorkers);
+
+        std::vector<std::vector<uint32_t>> taken (nWorkers);
+        std::vector<std::thread> threads;
+        for (uint32_t worker = 0; worker < nWorkers; ++worker) {
+            threads.emplace_back ([&, worker] () {
+                uint32_t item;
+                while (ranges.Take (worker, &item)) {
+                    taken[worker].push_back (item);
+
+                    // Worker 0 is slow, so others have to steal from it
+                    if (worker == 0)
+                        std::this_thread::sleep_for (std::chrono::microseconds (20));
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+            thread.join ();
+
+        std::vector<uint32_t> all;
+        for (const std::vector<uint32_t>& items : taken)
+            all.insert (all.end (), items.begin (), items.end ());
+
+        std::sort (all.begin (), all.end ());
+        EUT_CHECK (all.size () == nItems);
+        for (uint32_t i = 0; i < all.size (); ++i)
+            EUT_CHECK (all[i] == i);
+
+        if (nItems == 10'000) {
+            EUT_CHECK (ranges.GetNumberOfSteals () > 0);
+            EUT_CHECK (taken[0].size () < nItems / nWorkers);
+        }
+    }
+}
+
+// Writes events with globally unique, increasing timestamps. Processors get very different loads (the last one
+//   gets hardly any events), so the buffers of some processors are far apart in the file. Returns the (processor
+//   number, timestamp) pairs of the events, in the order they were written
+std::vector<std::pair<UCHAR, int64_t>> WriteTestTrace (const std::filesystem::path& path)
+{
+    constexpr uint32_t kProcessors = 8;
+
+    ETLWriterConfig config;
+    config.bufferSize = 4 * 1'024;
+    config.numberOfProcessors = kProcessors;
+    config.startTimeStamp = kStartTimeStamp;
+
+    std::mt19937_64 random (5);
+    std::vector<std::pair<UCHAR, int64_t>> written;
+    ETLWriter writer (path, config);
+    for (uint32_t i = 0; i < 20'000; ++i) {
+        UCHAR cpu = static_cast<UCHAR> (random () % (kProcessors - 1));
+        if (i % 1'000 == 0)
+            cpu = kProcessors - 1;
+
+        const std::vector<uint8_t> payload (random () % 100, static_cast<uint8_t> (i));
+
+        EventRecordLayout record = {};
+        record.m_header.m_providerID = EtwProfProfilerGuid;
+        record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+        record.m_header.m_timeStamp = kStartTimeStamp + 1 + i;
+        record.m_processorNumber = cpu;
+        record.m_pUserData = payload.data ();
+        record.m_userDataLength = static_cast<USHORT> (payload.size ());
+        EUT_CHECK (writer.WriteEvent (EventView (record)));
+
+        written.push_back ({ cpu, record.m_header.m_timeStamp });
+    }
+
+    std::wstring errorMsg;
+    EUT_CHECK (writer.Close (&errorMsg));
+
+    return written;
+}
+
+void ParallelETLDecoderOrdered ()
+{
+    TempFile file (kTempFilePrefix, "Ordered.etl");
+    const std::vector<std::pair<UCHAR, int64_t>> written = WriteTestTrace (file.GetPath ());
+    ETLReader reader (file.GetPath ());
+
+    for (const uint32_t nThreads : { 1u, 2u, 8u }) {
+        // A lookahead of 1 makes the merge decode most buffers itself
+        for (const uint32_t lookahead : { 1u, 0u }) {
+            ParallelETLDecoder decoder (reader, nThreads);
+
+            std::vector<std::pair<UCHAR, int64_t>> delivered;
+            decoder.ForEachEventOrdered ([&] (const EventView& event) {
+                // The logfile header comes first
+                if (delivered.empty () && event.GetProviderID () == EventTraceEventGuid) {
+                    EUT_CHECK (event.GetTimestamp () == kStartTimeStamp);
+                    delivered.push_back ({ 0, 0 });
+
+                    return;
+                }
+
+                EUT_CHECK (event.GetProviderID () == EtwProfProfilerGuid);
+                EUT_CHECK (event.GetUserDataLength () == 0 ||
+                           *static_cast<const uint8_t*> (event.GetUserData ()) ==
+                               static_cast<uint8_t> (event.GetTimestamp () - kStartTimeStamp - 1));
+                delivered.push_back ({ event.GetProcessorNumber (), event.GetTimestamp () });
+            }, lookahead);
+
+            EUT_CHECK (!delivered.empty () && delivered[0].second == 0);
+            delivered.erase (delivered.begin ());
+            EUT_CHECK (delivered == written);
+
+            const ParallelETLDecoder::Stats stats = decoder.GetStats ();
+            EUT_CHECK (stats.nEvents == written.size () + 1);
+            EUT_CHECK (stats.nBuffersDecodedAhead <= reader.GetNumberOfBuffers ());
+            if (nThreads == 1)
+                EUT_CHECK (stats.nBuffersDecodedAhead == 0);
+        }
+    }
+}
+
+void ParallelETLDecoderUnordered ()
+{
+    TempFile file (kTempFilePrefix, "Unordered.etl");
+    const std::vector<std::pair<UCHAR, int64_t>> written = WriteTestTrace (file.GetPath ());
+    ETLReader reader (file.GetPath ());
+
+    ParallelETLDecoder decoder (reader, 4);
+    EUT_CHECK (decoder.GetNumberOfThreads () == 4);
+
+    // Aggregation per worker, merged at the end
+    std::vector<uint64_t> nEventsPerWorker (4, 0);
+    std::vector<int64_t> timeStampSumPerWorker (4, 0);
+    std::vector<std::atomic<uint32_t>> visits (reader.GetNumberOfBuffers ());
+    decoder.ForEachBufferUnordered ([&] (uint32_t workerIndex, const ETLBufferView& buffer) {
+        EUT_CHECK (workerIndex < 4);
+
+        // Find out which buffer this is
+        for (size_t i = 0; i < reader.GetNumberOfBuffers (); ++i) {
+            if (reader.GetBuffer (i).begin () == buffer.begin ())
+                ++visits[i];
+        }
+
+        for (const EventView& event : buffer) {
+            ++nEventsPerWorker[workerIndex];
+            timeStampSumPerWorker[workerIndex] += event.GetTimestamp ();
+        }
+    });
+
+    for (const std::atomic<uint32_t>& nVisits : visits)
+        EUT_CHECK (nVisits == 1);
+
+    int64_t expectedSum = kStartTimeStamp;  // Logfile header
+    for (const std::pair<UCHAR, int64_t>& event : written)
+        expectedSum += event.second;
+
+    uint64_t nEvents = 0;
+    int64_t timeStampSum = 0;
+    for (size_t worker = 0; worker < 4; ++worker) {
+        nEvents += nEventsPerWorker[worker];
+        timeStampSum += timeStampSumPerWorker[worker];
+    }
+
+    EUT_CHECK (nEvents == written.size () + 1);
+    EUT_CHECK (timeStampSum == expectedSum);
+}
+
+TestRegistrator loserTreeMerge ("LoserTree.Merge", LoserTreeMerge);
+TestRegistrator workStealingRangesEachItemOnce ("WorkStealingRanges.EachItemOnce", WorkStealingRangesEachItemOnce);
+TestRegistrator parallelETLDecoderOrdered ("ParallelETLDecoder.Ordered", ParallelETLDecoderOrdered);
+TestRegistrator parallelETLDecoderUnordered ("ParallelETLDecoder.Unordered", ParallelETLDecoderUnordered);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
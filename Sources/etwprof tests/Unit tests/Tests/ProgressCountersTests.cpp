@@ -0,0 +1,133 @@
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "Profiler/ProgressCounters.hpp"
+
+namespace EUT {
+namespace {
+
+using ETWP::EventRecordLayout;
+using ETWP::EventView;
+using ETWP::ProgressCounters;
+using ETWP::ProgressSample;
+
+class FailingSink final : public ETWP::IEventSink {
+public:
+    virtual bool WriteEvent (const EventView& event) override
+    {
+        return event.GetUserDataLength () != 13;
+    }
+};
+
+void ProgressCountersCountTest ()
+{
+    ProgressCounters counters;
+
+    uint32_t nQueueSamples = 0;
+    for (uint64_t i = 0; i < 4 * ProgressCounters::kQueueSampleInterval; ++i) {
+        counters.AddEvent (i % 4 == 0);
+        if (counters.ShouldSampleQueue ()) {
+            counters.SetQueuedBytes (i);
+            ++nQueueSamples;
+        }
+    }
+
+    EUT_CHECK (nQueueSamples == 4);
+
+    // Only events written successfully are counted
+    FailingSink failingSink;
+    ETWP::ProgressCountingSink sink (&failingSink, &counters);
+    EventRecordLayout record = {};
+    record.m_userDataLength = 100;
+    EUT_CHECK (sink.WriteEvent (EventView (record)));
+    record.m_userDataLength = 13;
+    EUT_CHECK (!sink.WriteEvent (EventView (record)));
+
+    const ProgressSample sample = counters.Sample ();
+    EUT_CHECK (sample.nEvents == 4 * ProgressCounters::kQueueSampleInterval);
+    EUT_CHECK (sample.nEventsKept == ProgressCounters::kQueueSampleInterval);
+    EUT_CHECK (sample.queuedBytes == 4 * ProgressCounters::kQueueSampleInterval - 1);
+    EUT_CHECK (sample.nBytesWritten == sizeof (ETWP::EventHeaderLayout) + 100);
+    EUT_CHECK (sample.nEventsLost == 0);
+}
+
+void ProgressCountersConcurrencyTest ()
+{
+    ProgressCounters counters;
+
+    // Samples taken while counting never go backwards
+    constexpr uint64_t kEvents = 1'000'000;
+    std::thread counterThread ([&counters] () {
+        for (uint64_t i = 0; i < kEvents; ++i) {
+            counters.AddEvent (true);
+            counters.AddBytesWritten (1);
+        }
+    });
+
+    ProgressSample previous = counters.Sample ();
+    bool monotonic = true;
+    while (previous.nEvents < kEvents) {
+        const ProgressSample current = counters.Sample ();
+        monotonic = monotonic && current.nEvents >= previous.nEvents && current.nBytesWritten >= previous.nBytesWritten;
+        previous = current;
+    }
+
+    counterThread.join ();
+
+    EUT_CHECK (monotonic);
+    EUT_CHECK (counters.Sample ().nEventsKept == kEvents);
+    EUT_CHECK (counters.Sample ().nBytesWritten == kEvents);
+}
+
+void ProgressCountersReportTest ()
+{
+    const ProgressSample previous = { 1'000'000'000, 1'000, 10, 0, 0, 0, 0, 0 };
+    const ProgressSample current = { 1'500'000'000, 1'001'000, 21'010, 3 * 1'024 * 1'024, 512 * 1'024, 7, 1, 2 };
+
+    const ETWP::ProgressRates rates = ETWP::GetProgressRates (previous, current);
+    EUT_CHECK (rates.eventsPerSec == 2'000'000.0);
+    EUT_CHECK (rates.eventsKeptPerSec == 42'000.0);
+    EUT_CHECK (ETWP::GetProgressRates (current, current).eventsPerSec == 0.0);
+
+    EUT_CHECK (ETWP::FormatProgress (previous, current) ==
+               L"2.00 M events/s (42.0 K kept), 3.0 MB written, queue 0.5 MB, lost: 7 events, 3 buffers");
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path () / "etwprof_unit_tests_progress.csv";
+    {
+        ETWP::ProgressLog log;
+        std::wstring errorMsg;
+        EUT_CHECK (log.Open (path, &errorMsg));
+        EUT_CHECK (log.Write (previous, current));
+    }
+
+    {
+        std::ifstream file (path);
+        std::stringstream contents;
+        contents << file.rdbuf ();
+        EUT_CHECK (contents.str () ==
+                   "time_ms,events,events_kept,bytes_written,queued_bytes,events_per_s,events_kept_per_s,"
+                   "events_lost,buffers_lost,realtime_buffers_lost\n"
+                   "1500,1001000,21010,3145728,524288,2000000,42000,7,1,2\n");
+    }
+
+    std::error_code ec;
+    std::filesystem::remove (path, ec);
+
+    ETWP::ProgressLog log;
+    std::wstring errorMsg;
+    EUT_CHECK (!log.Open (path / "missing" / "progress.csv", &errorMsg));
+    EUT_CHECK (!errorMsg.empty ());
+}
+
+TestRegistrator countTestRegistrator ("ProgressCounters.Count", ProgressCountersCountTest);
+TestRegistrator concurrencyTestRegistrator ("ProgressCounters.Concurrency", ProgressCountersConcurrencyTest);
+TestRegistrator reportTestRegistrator ("ProgressCounters.Report", ProgressCountersReportTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,345 @@
+#include "TestRegistrar.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "Profiler/EventRingBuffer.hpp"
+#include "Profiler/RelogPipeline.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETLFormat = ETWP::ETLFormat;
+
+using ETWP::EventExtendedItemLayout;
+using ETWP::EventRecordLayout;
+using ETWP::EventRingBuffer;
+using ETWP::EventView;
+using ETWP::IEventSink;
+using ETWP::RelogPipeline;
+using ETWP::RelogPipelineStats;
+
+// Payload bytes are derived from the sequence number of the record/event, so corruption can be detected
+uint8_t GetPayloadByte (uint64_t sequence, size_t index)
+{
+    return static_cast<uint8_t> (sequence * 31 + index * 7);
+}
+
+void FillPayload (uint64_t sequence, void* pPayload, size_t size)
+{
+    uint8_t* pBytes = static_cast<uint8_t*> (pPayload);
+    for (size_t i = 0; i < size; ++i)
+        pBytes[i] = GetPayloadByte (sequence, i);
+}
+
+bool CheckPayload (uint64_t sequence, const void* pPayload, size_t size)
+{
+    const uint8_t* pBytes = static_cast<const uint8_t*> (pPayload);
+    for (size_t i = 0; i < size; ++i) {
+        if (pBytes[i] != GetPayloadByte (sequence, i))
+            return false;
+    }
+
+    return true;
+}
+
+void EventRingBufferBasic ()
+{
+    EventRingBuffer buffer (1'024);
+    EUT_CHECK (buffer.GetCapacity () == 1'024);
+
+    size_t size;
+    EUT_CHECK (buffer.BeginRead (&size) == nullptr);
+    EUT_CHECK (buffer.BeginWrite (buffer.GetMaxRecordSize () + 1) == nullptr);
+
+    for (uint64_t i = 0; i < 3; ++i) {
+        void* pRecord = buffer.BeginWrite (100 + i);
+        EUT_CHECK (pRecord != nullptr);
+        FillPayload (i, pRecord, 100 + i);
+        buffer.EndWrite ();
+    }
+
+    for (uint64_t i = 0; i < 3; ++i) {
+        const void* pRecord = buffer.BeginRead (&size);
+        EUT_CHECK (pRecord != nullptr);
+        EUT_CHECK (size == 100 + i);
+        EUT_CHECK (CheckPayload (i, pRecord, size));
+        buffer.EndRead ();
+    }
+
+    EUT_CHECK (buffer.BeginRead (&size) == nullptr);
+
+    // Empty records are fine, too
+    EUT_CHECK (buffer.BeginWrite (0) != nullptr);
+    buffer.EndWrite ();
+    EUT_CHECK (buffer.BeginRead (&size) != nullptr);
+    EUT_CHECK (size == 0);
+    buffer.EndRead ();
+}
+
+void EventRingBufferFullAndWrapAround ()
+{
+    EventRingBuffer buffer (1'024);
+
+    // 8 bytes of header + 120 bytes of payload: exactly 8 records fit
+    for (uint64_t i = 0; i < 8; ++i) {
+        void* pRecord = buffer.BeginWrite (120);
+        EUT_CHECK (pRecord != nullptr);
+        buffer.EndWrite ();
+    }
+
+    EUT_CHECK (buffer.BeginWrite (0) == nullptr);
+    EUT_CHECK (buffer.GetHighWaterMark () == 1'024);
+    EUT_CHECK (buffer.GetUsedSize () == 1'024);
+
+    size_t size;
+    for (uint64_t i = 0; i < 8; ++i) {
+        EUT_CHECK (buffer.BeginRead (&size) != nullptr);
+        buffer.EndRead ();
+    }
+
+    EUT_CHECK (buffer.GetUsedSize () == 0);
+
+    // Now write 7 records, and free up 3 of them, so there are 128 bytes free at the end, and 384 at the start
+    for (uint64_t i = 0; i < 7; ++i) {
+        void* pRecord = buffer.BeginWrite (120);
+        EUT_CHECK (pRecord != nullptr);
+        FillPayload (i, pRecord, 120);
+        buffer.EndWrite ();
+    }
+
+    for (uint64_t i = 0; i < 3; ++i) {
+        EUT_CHECK (buffer.BeginRead (&size) != nullptr);
+        buffer.EndRead ();
+    }
+
+    // This record does not fit at the end, so it wraps around (and the end is skipped)
+    void* pRecord = buffer.BeginWrite (248);
+    EUT_CHECK (pRecord != nullptr);
+    FillPayload (7, pRecord, 248);
+    buffer.EndWrite ();
+
+    // 128 bytes remain free, but a record needs 8 bytes of header
+    EUT_CHECK (buffer.BeginWrite (121) == nullptr);
+
+    for (uint64_t i = 3; i < 8; ++i) {
+        const void* pReadRecord = buffer.BeginRead (&size);
+        EUT_CHECK (pReadRecord != nullptr);
+        EUT_CHECK (size == (i < 7 ? 120 : 248));
+        EUT_CHECK (CheckPayload (i, pReadRecord, size));
+        buffer.EndRead ();
+    }
+
+    EUT_CHECK (buffer.BeginRead (&size) == nullptr);
+}
+
+// A producer and a consumer thread hammer a small buffer with records of random sizes. The producer retries when the
+//   buffer is full, so every record has to arrive, in order, intact
+void EventRingBufferStress ()
+{
+    constexpr uint64_t kNumberOfRecords = 2'000'000;
+
+    EventRingBuffer buffer (16 * 1'024);
+    std::atomic<bool> failed = false;
+
+    std::thread consumer ([&] () {
+        for (uint64_t expected = 0; expected < kNumberOfRecords && !failed;) {
+            size_t size;
+            const void* pRecord = buffer.BeginRead (&size);
+            if (pRecord == nullptr) {
+                std::this_thread::yield ();
+
+                continue;
+            }
+
+            uint64_t sequence;
+            if (size < sizeof sequence) {
+                failed = true;
+            } else {
+                std::memcpy (&sequence, pRecord, sizeof sequence);
+                const uint8_t* pPayload = static_cast<const uint8_t*> (pRecord) + sizeof sequence;
+                if (sequence != expected || !CheckPayload (sequence, pPayload, size - sizeof sequence))
+                    failed = true;
+            }
+
+            buffer.EndRead ();
+            ++expected;
+        }
+    });
+
+    std::mt19937_64 random (13);
+    for (uint64_t i = 0; i < kNumberOfRecords && !failed;) {
+        // Mostly small records (like most events), with some big ones
+        const size_t payloadSize = random () % 16 == 0 ? random () % 4'000 : random () % 120;
+        void* pRecord = buffer.BeginWrite (sizeof i + payloadSize);
+        if (pRecord == nullptr) {
+            std::this_thread::yield ();
+
+            continue;
+        }
+
+        std::memcpy (pRecord, &i, sizeof i);
+        FillPayload (i, static_cast<uint8_t*> (pRecord) + sizeof i, payloadSize);
+        buffer.EndWrite ();
+        ++i;
+    }
+
+    consumer.join ();
+
+    EUT_CHECK (!failed);
+    size_t size;
+    EUT_CHECK (buffer.BeginRead (&size) == nullptr);
+}
+
+// Checks that events arrive in order, intact, and optionally slows down writing
+class CheckingSink final : public IEventSink {
+public:
+    explicit CheckingSink (uint32_t sleepEveryNthEvent): m_sleepEveryNthEvent (sleepEveryNthEvent)
+    {
+    }
+
+    virtual bool WriteEvent (const EventView& event) override
+    {
+        const uint64_t sequence = uint64_t (event.GetTimestamp ());
+        if (!CheckPayload (sequence, event.GetUserData (), event.GetUserDataLength ()) ||
+            event.GetThreadID () != static_cast<uint32_t> (sequence) ||
+            !CheckExtendedData (sequence, event))
+        {
+            m_corrupted = true;
+        }
+
+        m_written.push_back (sequence);
+
+        if (m_sleepEveryNthEvent != 0 && m_written.size () % m_sleepEveryNthEvent == 0)
+            std::this_thread::sleep_for (std::chrono::milliseconds (1));
+
+        return true;
+    }
+
+    const std::vector<uint64_t>& GetWritten () const { return m_written; }
+    bool                         IsCorrupted () const { return m_corrupted; }
+
+    // Every 8th event carries a (fake) stack trace, see PumpEvents
+    static bool CheckExtendedData (uint64_t sequence, const EventView& event)
+    {
+        if (sequence % 8 != 0)
+            return event.GetExtendedDataCount () == 0;
+
+        if (event.GetExtendedDataCount () != 1)
+            return false;
+
+        const EventExtendedItemLayout& item = event.GetExtendedData ()[0];
+
+        return item.m_extType == ETLFormat::kExtTypeStackTrace64 &&
+               CheckPayload (~sequence, reinterpret_cast<const void*> (item.m_dataPtr), item.m_dataSize);
+    }
+
+private:
+    uint32_t              m_sleepEveryNthEvent;
+    std::vector<uint64_t> m_written;
+    bool                  m_corrupted = false;
+};
+
+// Pushes events through a pipeline as fast as possible, returns the sequence numbers of events not dropped
+std::vector<uint64_t> PumpEvents (RelogPipeline* pPipeline, uint64_t nEvents)
+{
+    std::mt19937_64 random (42);
+    std::vector<uint8_t> payload (UINT16_MAX);
+    std::vector<uint8_t> extendedData (1'024);
+
+    std::vector<uint64_t> enqueued;
+    for (uint64_t i = 0; i < nEvents; ++i) {
+        const size_t payloadSize = random () % 32 == 0 ? random () % 8'000 : random () % 200;
+        FillPayload (i, payload.data (), payloadSize);
+
+        EventRecordLayout record = {};
+        record.m_header.m_timeStamp = int64_t (i);
+        record.m_header.m_threadID = static_cast<uint32_t> (i);
+        record.m_pUserData = payload.data ();
+        record.m_userDataLength = static_cast<uint16_t> (payloadSize);
+
+        EventExtendedItemLayout item = {};
+        if (i % 8 == 0) {
+            item.m_extType = ETLFormat::kExtTypeStackTrace64;
+            item.m_dataSize = static_cast<uint16_t> (8 + random () % 64 * 8);
+            item.m_dataPtr = reinterpret_cast<uint64_t> (extendedData.data ());
+            FillPayload (~i, extendedData.data (), item.m_dataSize);
+
+            record.m_pExtendedData = &item;
+            record.m_extendedDataCount = 1;
+        }
+
+        if (pPipeline->Enqueue (EventView (record)))
+            enqueued.push_back (i);
+    }
+
+    return enqueued;
+}
+
+void RelogPipelineNoDrops ()
+{
+    constexpr uint64_t kNumberOfEvents = 200'000;
+
+    CheckingSink sink (0);
+    RelogPipeline pipeline (&sink, 256 * 1'024 * 1'024);
+    const std::vector<uint64_t> enqueued = PumpEvents (&pipeline, kNumberOfEvents);
+    pipeline.Finish ();
+
+    const RelogPipelineStats stats = pipeline.GetStats ();
+    EUT_CHECK (stats.nDropped == 0);
+    EUT_CHECK (stats.nEnqueued == kNumberOfEvents);
+    EUT_CHECK (stats.nWritten == kNumberOfEvents);
+    EUT_CHECK (stats.nWriteFailures == 0);
+    EUT_CHECK (stats.queueHighWaterMark > 0 && stats.queueHighWaterMark <= stats.queueCapacity);
+    EUT_CHECK (!sink.IsCorrupted ());
+    EUT_CHECK (sink.GetWritten () == enqueued);
+}
+
+// The writer is much slower than the producer, so the (small) queue fills up: some events are dropped, but the ones
+//   enqueued must all be written, in order
+void RelogPipelineSlowWriterStress ()
+{
+    constexpr uint64_t kNumberOfEvents = 500'000;
+
+    CheckingSink sink (100);
+    RelogPipeline pipeline (&sink, 64 * 1'024);
+    const std::vector<uint64_t> enqueued = PumpEvents (&pipeline, kNumberOfEvents);
+    pipeline.Finish ();
+
+    const RelogPipelineStats stats = pipeline.GetStats ();
+    EUT_CHECK (stats.nDropped > 0);
+    EUT_CHECK (stats.nEnqueued + stats.nDropped == kNumberOfEvents);
+    EUT_CHECK (stats.nEnqueued == enqueued.size ());
+    EUT_CHECK (stats.nWritten == stats.nEnqueued);
+    EUT_CHECK (stats.queueHighWaterMark <= stats.queueCapacity);
+    EUT_CHECK (!sink.IsCorrupted ());
+    EUT_CHECK (sink.GetWritten () == enqueued);
+}
+
+void RelogPipelineFinishIsIdempotent ()
+{
+    CheckingSink sink (0);
+    RelogPipeline pipeline (&sink, 1'024 * 1'024);
+    PumpEvents (&pipeline, 1'000);
+    pipeline.Finish ();
+    pipeline.Finish ();
+
+    EUT_CHECK (pipeline.GetStats ().nWritten == 1'000);
+    EUT_CHECK (sink.GetWritten ().size () == 1'000);
+}
+
+TestRegistrator basic ("EventRingBuffer.Basic", EventRingBufferBasic);
+TestRegistrator fullAndWrapAround ("EventRingBuffer.FullAndWrapAround", EventRingBufferFullAndWrapAround);
+TestRegistrator ringBufferStress ("EventRingBuffer.Stress", EventRingBufferStress);
+TestRegistrator noDrops ("RelogPipeline.NoDrops", RelogPipelineNoDrops);
+TestRegistrator slowWriterStress ("RelogPipeline.SlowWriterStress", RelogPipelineSlowWriterStress);
+TestRegistrator finishIsIdempotent ("RelogPipeline.FinishIsIdempotent", RelogPipelineFinishIsIdempotent);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
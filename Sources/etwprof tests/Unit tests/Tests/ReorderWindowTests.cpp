@@ -0,0 +1,230 @@
+#include "TestEvents.hpp"
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "OS/Process/ProcessLifetimeEventSource.hpp"
+#include "Profiler/FilterStats.hpp"
+#include "Profiler/ProfileFilter.hpp"
+#include "Profiler/ProgressCounters.hpp"
+#include "Profiler/ReorderWindow.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::EventView;
+using ETWP::ProfileFilterData;
+using ETWP::ReorderWindow;
+using ETWP::ReorderWindowConfig;
+
+constexpr DWORD    kTargetPID = 2'000;
+constexpr DWORD    kOtherPID = 3'000;
+constexpr int64_t  kPerfFreq = 1'000'000;   // I.e. a tick is a microsecond
+constexpr int64_t  kMs = kPerfFreq / 1'000;
+constexpr uint64_t kSampleIP = 0x7FF6'0000'1000;
+
+// Collects the timestamps of the events written
+class TimeStampSink final : public ETWP::IEventSink {
+public:
+    std::vector<int64_t> timeStamps;
+
+    virtual bool WriteEvent (const EventView& event) override
+    {
+        timeStamps.push_back (event.GetTimestamp ());
+
+        return true;
+    }
+};
+
+// Filters events like ProfileEventFilter does: kept events are written through the reorder window, and all events are
+//   counted
+class ReorderTestFilter {
+public:
+    TimeStampSink           sink;
+    ETWP::FilterStats       stats;
+    ETWP::ProgressCounters  progress;
+
+    explicit ReorderTestFilter (const ReorderWindowConfig& config):
+        sink (),
+        stats (),
+        progress (),
+        m_filterData ({ {}, {}, {}, { kTargetPID }, true, false, {} }),
+        m_reorderWindow (&sink, config, kPerfFreq),
+        m_processLifetimeEventSource ()
+    {
+        m_filterData.threads.SetTimestampFrequency (kPerfFreq);
+        m_filterData.otherThreads.SetTimestampFrequency (kPerfFreq);
+        m_filterData.pReorderWindow = &m_reorderWindow;
+        m_reorderWindow.SetCounters (&stats, &progress);
+        ETWP::PrepareForProfiling (&m_filterData);
+    }
+
+    bool Filter (TestEvent event)
+    {
+        const EventView view = event.GetView ();
+        const bool keep = ETWP::FilterAndCount (view, &stats, [&] () {
+            return ETWP::FilterEventForProfiling (view, &m_filterData, &m_processLifetimeEventSource);
+        });
+        progress.AddEvent (keep);
+        if (keep)
+            m_reorderWindow.WriteEvent (view);
+
+        return keep;
+    }
+
+    ReorderWindow& GetReorderWindow ()
+    {
+        return m_reorderWindow;
+    }
+
+private:
+    ProfileFilterData                m_filterData;
+    ReorderWindow                    m_reorderWindow;
+    ETWP::ProcessLifetimeEventSource m_processLifetimeEventSource;
+};
+
+void ReorderWindowRecoveryTest ()
+{
+    ReorderTestFilter filter ({ 50 });
+
+    // Events of a new thread arrive before its start event
+    EUT_CHECK (!filter.Filter (MakeSampleEvent (kTargetPID, 104, kSampleIP, 10 * kMs)));
+    EUT_CHECK (!filter.Filter (MakeCSwitchEvent (104, 0, 11 * kMs)));
+    EUT_CHECK (!filter.Filter (MakeSampleEvent (kOtherPID, 108, kSampleIP, 12 * kMs)));
+    EUT_CHECK (filter.sink.timeStamps.empty ());
+
+    // The sample of thread 108 is still held, so the kept events after it are queued behind it
+    EUT_CHECK (filter.Filter (MakeThreadEvent (ETWConstants::TStartOpcode, kTargetPID, 104, 9 * kMs)));
+    EUT_CHECK ((filter.sink.timeStamps == std::vector<int64_t> { 10 * kMs, 11 * kMs }));
+    EUT_CHECK (filter.Filter (MakeSampleEvent (kTargetPID, 104, kSampleIP, 13 * kMs)));  // Known from now on
+    EUT_CHECK (filter.sink.timeStamps.size () == 2);
+
+    // Thread 108 is of another process, so its sample is discarded, and the queue is written
+    EUT_CHECK (!filter.Filter (MakeThreadEvent (ETWConstants::TStartOpcode, kOtherPID, 108, 12 * kMs)));
+    EUT_CHECK ((filter.sink.timeStamps == std::vector<int64_t> { 10 * kMs, 11 * kMs, 9 * kMs, 13 * kMs }));
+
+    // Held events from before the start of a thread belong to an earlier thread with the same ID...
+    EUT_CHECK (!filter.Filter (MakeSampleEvent (kTargetPID, 112, kSampleIP, 70 * kMs)));
+    EUT_CHECK (filter.Filter (MakeThreadEvent (ETWConstants::TStartOpcode, kTargetPID, 112, 71 * kMs)));
+
+    // ...unless the thread was running before the session started (rundown)
+    EUT_CHECK (!filter.Filter (MakeSampleEvent (kTargetPID, 116, kSampleIP, 72 * kMs)));
+    EUT_CHECK (filter.Filter (MakeThreadEvent (ETWConstants::TDCStartOpcode, kTargetPID, 116, 80 * kMs)));
+    EUT_CHECK (filter.sink.timeStamps.size () == 4);
+
+    // The sample of thread 112 expires (when an event after the window arrives)
+    EUT_CHECK (filter.Filter (MakeSampleEvent (kTargetPID, 104, kSampleIP, 121 * kMs)));
+    EUT_CHECK ((filter.sink.timeStamps == std::vector<int64_t> { 10 * kMs, 11 * kMs, 9 * kMs, 13 * kMs,
+                                                                 71 * kMs, 72 * kMs, 80 * kMs, 121 * kMs }));
+
+    filter.GetReorderWindow ().Flush ();
+
+    const ReorderWindow::Stats stats = filter.GetReorderWindow ().GetStats ();
+    EUT_CHECK (stats.nHeld == 5);
+    EUT_CHECK (stats.nRecovered == 3);
+    EUT_CHECK (stats.nRejected == 1);
+    EUT_CHECK (stats.nExpired == 1);
+    EUT_CHECK (stats.nEvicted == 0);
+    EUT_CHECK (stats.nQueued == 4);
+    EUT_CHECK (stats.highWaterMark > 0);
+
+    // Recovered events are counted as kept
+    const ETWP::FilterStats::Counters totals = filter.stats.GetTotals ();
+    EUT_CHECK (totals.nKept == filter.sink.timeStamps.size ());
+    EUT_CHECK (totals.nDropped == 3);
+    EUT_CHECK (filter.progress.Sample ().nEventsKept == filter.sink.timeStamps.size ());
+}
+
+void ReorderWindowOrderTest ()
+{
+    ReorderTestFilter filter ({ 50 });
+
+    EUT_CHECK (filter.Filter (MakeThreadEvent (ETWConstants::TDCStartOpcode, kTargetPID, 100, 0)));
+    EUT_CHECK (!filter.Filter (MakeThreadEvent (ETWConstants::TDCStartOpcode, kOtherPID, 200, 0)));
+
+    // Events of threads known to be of other processes are not held
+    EUT_CHECK (!filter.Filter (MakeSampleEvent (kOtherPID, 200, kSampleIP, 1 * kMs)));
+    EUT_CHECK (filter.GetReorderWindow ().GetStats ().nHeld == 0);
+
+    // Stacks follow their samples, recovered or not
+    EUT_CHECK (!filter.Filter (MakeSampleEvent (kTargetPID, 104, kSampleIP, 2 * kMs)));
+    EUT_CHECK (filter.Filter (MakeStackWalkEvent (kTargetPID, 104, MakeFrames (kSampleIP, 4), 2 * kMs)));
+    EUT_CHECK (filter.Filter (MakeSampleEvent (kTargetPID, 100, kSampleIP, 3 * kMs)));
+    EUT_CHECK (filter.Filter (MakeStackWalkEvent (kTargetPID, 100, MakeFrames (kSampleIP, 4), 3 * kMs)));
+
+    // Only the unknown thread of a context switch is waited for
+    EUT_CHECK (!filter.Filter (MakeCSwitchEvent (104, 200, 4 * kMs)));
+    EUT_CHECK (filter.sink.timeStamps == std::vector<int64_t> { 0 });
+
+    EUT_CHECK (filter.Filter (MakeThreadEvent (ETWConstants::TStartOpcode, kTargetPID, 104, 1 * kMs)));
+    EUT_CHECK ((filter.sink.timeStamps ==
+                std::vector<int64_t> { 0, 2 * kMs, 2 * kMs, 3 * kMs, 3 * kMs, 4 * kMs, 1 * kMs }));
+
+    const ReorderWindow::Stats stats = filter.GetReorderWindow ().GetStats ();
+    EUT_CHECK (stats.nHeld == 2);
+    EUT_CHECK (stats.nRecovered == 2);
+    EUT_CHECK (stats.nQueued == 3);
+
+    const ETWP::FilterStats::Counters totals = filter.stats.GetTotals ();
+    EUT_CHECK (totals.nKept == 7);
+    EUT_CHECK (totals.nDropped == 2);
+}
+
+void ReorderWindowOtherThreadsTest ()
+{
+    ReorderTestFilter filter ({ 50 });
+
+    // A context switch between two unknown threads is discarded only when neither of them can be a target thread
+    EUT_CHECK (!filter.Filter (MakeCSwitchEvent (300, 301, 1 * kMs)));
+    EUT_CHECK (!filter.Filter (MakeThreadEvent (ETWConstants::TStartOpcode, kOtherPID, 300, 0)));
+    EUT_CHECK (filter.GetReorderWindow ().GetStats ().nRejected == 0);
+
+    EUT_CHECK (!filter.Filter (MakeThreadEvent (ETWConstants::TStartOpcode, kOtherPID, 301, 0)));
+    EUT_CHECK (filter.GetReorderWindow ().GetStats ().nRejected == 1);
+
+    // Both are known from now on
+    EUT_CHECK (!filter.Filter (MakeCSwitchEvent (300, 301, 2 * kMs)));
+    EUT_CHECK (filter.GetReorderWindow ().GetStats ().nHeld == 1);
+
+    // A thread ID of another process might be reused by a target thread, after the thread ended
+    EUT_CHECK (!filter.Filter (MakeThreadEvent (ETWConstants::TEndOpcode, kOtherPID, 300, 3 * kMs)));
+    EUT_CHECK (filter.Filter (MakeThreadEvent (ETWConstants::TStartOpcode, kTargetPID, 300, 4 * kMs)));
+    EUT_CHECK (filter.Filter (MakeSampleEvent (kTargetPID, 300, kSampleIP, 5 * kMs)));
+
+    EUT_CHECK (filter.Filter (MakeThreadEvent (ETWConstants::TEndOpcode, kTargetPID, 300, 6 * kMs)));
+    EUT_CHECK (!filter.Filter (MakeThreadEvent (ETWConstants::TStartOpcode, kOtherPID, 300, 7 * kMs)));
+    EUT_CHECK (!filter.Filter (MakeSampleEvent (kOtherPID, 300, kSampleIP, 8 * kMs)));
+    EUT_CHECK (filter.GetReorderWindow ().GetStats ().nHeld == 1);
+    EUT_CHECK ((filter.sink.timeStamps == std::vector<int64_t> { 4 * kMs, 5 * kMs, 6 * kMs }));
+}
+
+void ReorderWindowMemoryLimitTest ()
+{
+    // Room for a handful of samples only: the oldest ones are evicted to make room
+    ReorderTestFilter filter ({ 1'000, 1'024 });
+    for (int64_t i = 0; i < 100; ++i)
+        EUT_CHECK (!filter.Filter (MakeSampleEvent (kTargetPID, 104, kSampleIP, i * kMs)));
+
+    EUT_CHECK (filter.Filter (MakeThreadEvent (ETWConstants::TStartOpcode, kTargetPID, 104, 0)));
+
+    const ReorderWindow::Stats stats = filter.GetReorderWindow ().GetStats ();
+    EUT_CHECK (stats.nHeld == 100);
+    EUT_CHECK (stats.nRecovered > 0 && stats.nRecovered < 100);
+    EUT_CHECK (stats.nRecovered + stats.nEvicted == 100);
+    EUT_CHECK (stats.highWaterMark <= 1'024);
+    EUT_CHECK (filter.sink.timeStamps.size () == stats.nRecovered + 1);
+    EUT_CHECK (filter.sink.timeStamps.end ()[-2] == 99 * kMs);     // The newest ones are kept...
+    EUT_CHECK (filter.sink.timeStamps.back () == 0);               // ...and written before the start event
+}
+
+TestRegistrator recoveryTestRegistrator ("ReorderWindow.Recovery", ReorderWindowRecoveryTest);
+TestRegistrator orderTestRegistrator ("ReorderWindow.Order", ReorderWindowOrderTest);
+TestRegistrator otherThreadsTestRegistrator ("ReorderWindow.OtherThreads", ReorderWindowOtherThreadsTest);
+TestRegistrator memoryLimitTestRegistrator ("ReorderWindow.MemoryLimit", ReorderWindowMemoryLimitTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+
+#include "OS/ETW/SessionSizing.hpp"
+
+namespace EUT {
+namespace {
+
+using ETWP::SamplingRateBackoff;
+using ETWP::SessionBufferConfig;
+using ETWP::SessionLoad;
+
+void SessionSizingBuffersTest ()
+{
+    // 8 processors sampled at 1 kHz: ~35 KB per processor in 100 ms, so buffers have the minimum size
+    const SessionLoad small = { 8, 1'000.0, false };
+    EUT_CHECK (ETWP::EstimateSessionBytesPerSecond (small) == 8 * 1'000 * (32 + 16 + 32 + 16 + 32 * 8));
+
+    const SessionBufferConfig smallConfig = ETWP::GetSessionBufferConfig (small);
+    EUT_CHECK (smallConfig.bufferSize == 64);
+    EUT_CHECK (smallConfig.minimumBuffers == 22);   // Half a second
+    EUT_CHECK (smallConfig.maximumBuffers == 129);  // Three seconds
+    EUT_CHECK (smallConfig.flushTimer == 1);
+
+    // Context switches and deeper stacks mean more data
+    EUT_CHECK (ETWP::EstimateSessionBytesPerSecond ({ 8, 1'000.0, true }) >
+               ETWP::EstimateSessionBytesPerSecond (small));
+    EUT_CHECK (ETWP::EstimateSessionBytesPerSecond ({ 8, 1'000.0, false, 64 }) >
+               ETWP::EstimateSessionBytesPerSecond (small));
+
+    // A big machine at a high rate: buffers are as big as ETW allows, and memory is limited
+    const SessionBufferConfig bigConfig = ETWP::GetSessionBufferConfig ({ 64, 20'000.0, true });
+    EUT_CHECK (bigConfig.bufferSize == 1'024);
+    EUT_CHECK (bigConfig.minimumBuffers == 259);
+    EUT_CHECK (bigConfig.maximumBuffers == 1'024);  // 1 GB
+
+    // An idle session still gets two buffers per processor (and some more to grow)
+    const SessionBufferConfig idleConfig = ETWP::GetSessionBufferConfig ({ 16, 0.0, false });
+    EUT_CHECK (idleConfig.bufferSize == 64);
+    EUT_CHECK (idleConfig.minimumBuffers == 32);
+    EUT_CHECK (idleConfig.maximumBuffers == 48);
+
+    // So does a machine with lots of processors, even if that's over the memory limit
+    const SessionBufferConfig manyConfig = ETWP::GetSessionBufferConfig ({ 1'024, 20'000.0, true });
+    EUT_CHECK (manyConfig.bufferSize == 1'024);
+    EUT_CHECK (manyConfig.minimumBuffers == 2'048);
+    EUT_CHECK (manyConfig.maximumBuffers == 3'072);
+}
+
+void SessionSizingBackoffTest ()
+{
+    SamplingRateBackoff backoff (1'000.0);
+    EUT_CHECK (!backoff.Update (0));
+    EUT_CHECK (backoff.GetRate () == 1'000.0);
+
+    EUT_CHECK (backoff.Update (5));
+    EUT_CHECK (backoff.GetRate () == 500.0);
+
+    // Losses right after backing off are ignored, the new rate might not have taken effect yet
+    for (uint64_t nLost = 10; nLost <= 40; nLost += 10)
+        EUT_CHECK (!backoff.Update (nLost));
+
+    EUT_CHECK (!backoff.Update (40));   // Nothing new lost
+    EUT_CHECK (backoff.Update (50));
+    EUT_CHECK (backoff.GetRate () == 250.0);
+
+    for (int i = 0; i < 4; ++i)
+        EUT_CHECK (!backoff.Update (50));
+
+    EUT_CHECK (backoff.Update (60));
+    EUT_CHECK (backoff.GetRate () == 125.0);
+
+    for (int i = 0; i < 4; ++i)
+        EUT_CHECK (!backoff.Update (60));
+
+    // The rate is not lowered below the minimum
+    EUT_CHECK (backoff.Update (70));
+    EUT_CHECK (backoff.GetRate () == 100.0);
+
+    for (int i = 0; i < 4; ++i)
+        EUT_CHECK (!backoff.Update (70));
+
+    EUT_CHECK (!backoff.Update (80));
+    EUT_CHECK (backoff.GetRate () == 100.0);
+    EUT_CHECK (backoff.GetNumberOfBackoffs () == 4);
+
+    // Counters going back to zero (e.g. the session stopped) are not a loss
+    SamplingRateBackoff resetBackoff (1'000.0, { 100.0, 0.5, 0 });
+    EUT_CHECK (resetBackoff.Update (10));
+    EUT_CHECK (!resetBackoff.Update (0));
+    EUT_CHECK (resetBackoff.Update (1));
+    EUT_CHECK (resetBackoff.GetRate () == 250.0);
+}
+
+TestRegistrator buffersTestRegistrator ("SessionSizing.Buffers", SessionSizingBuffersTest);
+TestRegistrator backoffTestRegistrator ("SessionSizing.Backoff", SessionSizingBackoffTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,295 @@
+#include "TestEvents.hpp"
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "Profiler/StackAggregator.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::EventView;
+using ETWP::StackAggregator;
+using ETWP::StackAggregatorConfig;
+
+constexpr int64_t  kPerfFreq = 10'000'000;
+constexpr DWORD    kPID = 2'000;
+constexpr DWORD    kTID = 2'004;
+constexpr DWORD    kOtherTID = 2'008;
+constexpr uint64_t kKernelBase = 0xFFFF'F800'0000'0000;
+constexpr uint64_t kUserBase = 0x7FF6'0000'0000;
+constexpr uint64_t kImageSize = 0x10'0000;
+
+// Minimal protobuf decoder: fields of a message, in order. Varints are stored in value, length-delimited fields in
+//   bytes
+struct ProtobufField {
+    uint32_t         number;
+    uint64_t         value;
+    std::string_view bytes;
+};
+
+uint64_t ReadVarint (std::string_view* pData)
+{
+    uint64_t value = 0;
+    for (uint32_t shift = 0; !pData->empty (); shift += 7) {
+        const uint8_t byte = static_cast<uint8_t> (pData->front ());
+        pData->remove_prefix (1);
+        value |= uint64_t (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            break;
+    }
+
+    return value;
+}
+
+std::vector<ProtobufField> DecodeMessage (std::string_view data)
+{
+    std::vector<ProtobufField> fields;
+    while (!data.empty ()) {
+        const uint64_t tag = ReadVarint (&data);
+        ProtobufField field = { static_cast<uint32_t> (tag >> 3), 0, {} };
+        if ((tag & 7) == 0) {
+            field.value = ReadVarint (&data);
+        } else {
+            const size_t length = static_cast<size_t> (ReadVarint (&data));
+            field.bytes = data.substr (0, length);
+            data.remove_prefix (length);
+        }
+
+        fields.push_back (field);
+    }
+
+    return fields;
+}
+
+std::vector<uint64_t> DecodePacked (std::string_view data)
+{
+    std::vector<uint64_t> values;
+    while (!data.empty ())
+        values.push_back (ReadVarint (&data));
+
+    return values;
+}
+
+// The parts of a pprof profile the tests check
+struct DecodedProfile {
+    struct Sample {
+        std::vector<uint64_t> locationIDs;
+        std::vector<uint64_t> values;
+        uint64_t              pid;
+    };
+
+    std::vector<Sample>                                    samples;
+    std::map<uint64_t, std::pair<uint64_t, uint64_t>>      locations;  // ID -> (mapping ID, address)
+    std::map<uint64_t, std::pair<std::string, std::string>> mappings;   // ID -> (file name, build ID)
+    std::vector<std::string>                               strings;
+    uint64_t                                               nSampleTypes = 0;
+    uint64_t                                               durationNanos = 0;
+};
+
+DecodedProfile DecodeProfile (const std::string& profile)
+{
+    DecodedProfile decoded;
+    std::vector<std::pair<uint64_t, std::pair<uint64_t, uint64_t>>> mappingStrings;
+    for (const ProtobufField& field : DecodeMessage (profile)) {
+        switch (field.number) {
+            case 1:
+                ++decoded.nSampleTypes;
+                break;
+            case 2: {
+                DecodedProfile::Sample sample = {};
+                for (const ProtobufField& sampleField : DecodeMessage (field.bytes)) {
+                    if (sampleField.number == 1)
+                        sample.locationIDs = DecodePacked (sampleField.bytes);
+                    else if (sampleField.number == 2)
+                        sample.values = DecodePacked (sampleField.bytes);
+                    else if (sampleField.number == 3)
+                        sample.pid = DecodeMessage (sampleField.bytes).at (1).value;
+                }
+
+                decoded.samples.push_back (sample);
+                break;
+            }
+            case 3: {
+                uint64_t id = 0, fileName = 0, buildID = 0;
+                for (const ProtobufField& mappingField : DecodeMessage (field.bytes)) {
+                    if (mappingField.number == 1)
+                        id = mappingField.value;
+                    else if (mappingField.number == 5)
+                        fileName = mappingField.value;
+                    else if (mappingField.number == 6)
+                        buildID = mappingField.value;
+                }
+
+                mappingStrings.push_back ({ id, { fileName, buildID } });
+                break;
+            }
+            case 4: {
+                uint64_t id = 0, mappingID = 0, address = 0;
+                for (const ProtobufField& locationField : DecodeMessage (field.bytes)) {
+                    if (locationField.number == 1)
+                        id = locationField.value;
+                    else if (locationField.number == 2)
+                        mappingID = locationField.value;
+                    else if (locationField.number == 3)
+                        address = locationField.value;
+                }
+
+                decoded.locations[id] = { mappingID, address };
+                break;
+            }
+            case 6:
+                decoded.strings.emplace_back (field.bytes);
+                break;
+            case 10:
+                decoded.durationNanos = field.value;
+                break;
+        }
+    }
+
+    for (const auto& [id, strings] : mappingStrings)
+        decoded.mappings[id] = { decoded.strings.at (strings.first), decoded.strings.at (strings.second) };
+
+    return decoded;
+}
+
+StackAggregatorConfig GetTestConfig (uint64_t maxMemory = 1'024 * 1'024)
+{
+    StackAggregatorConfig config;
+    config.maxMemory = maxMemory;
+    config.perfFreq = kPerfFreq;
+    config.samplingInterval = 1'000'000;    // 1 ms
+
+    return config;
+}
+
+void StackAggregatorJoinTest ()
+{
+    StackAggregatorConfig config = GetTestConfig ();
+    config.startTimeStamp = 100;
+
+    StackAggregator aggregator (config);
+    const auto write = [&] (TestEvent&& event) {
+        EUT_CHECK (aggregator.WriteEvent (event.GetView ()));
+    };
+
+    write (MakeImageEvent (ETWConstants::ImageLoadOpcode,
+                           4,
+                           kKernelBase,
+                           kImageSize,
+                           L"\\SystemRoot\\system32\\ntoskrnl.exe",
+                           1));
+    write (MakeImageEvent (ETWConstants::ImageLoadOpcode,
+                           kPID,
+                           kUserBase,
+                           kImageSize,
+                           L"\\Device\\HarddiskVolume3\\test.exe",
+                           1));
+
+    // The same stack, sampled twice: a kernel and a user StackWalk event for each sample
+    const std::vector<uint64_t> kernelFrames = { kKernelBase + 0x10, kKernelBase + 0x20 };
+    const std::vector<uint64_t> userFrames = { kUserBase + 0x100, kUserBase + 0x200 };
+    for (const int64_t timeStamp : { 100, 200 }) {
+        write (MakeSampleEvent (kPID, kTID, kKernelBase + 0x10, timeStamp));
+        write (MakeStackWalkEvent (kPID, kTID, kernelFrames, timeStamp));
+        write (MakeStackWalkEvent (kPID, kTID, userFrames, timeStamp));
+        write (MakeStackWalkEvent (kPID, kTID, { kUserBase + 0x300 }, timeStamp - 50));    // Of some other event
+    }
+
+    // No stack for this one, it's counted when its thread exits
+    write (MakeSampleEvent (kPID, kOtherTID, kUserBase + 0x400, 300));
+    write (MakeThreadEvent (ETWConstants::TEndOpcode, kPID, kOtherTID, kPerfFreq + 100));
+
+    StackAggregator::Stats stats = aggregator.GetStats ();
+    EUT_CHECK (stats.nSamples == 3);
+    EUT_CHECK (stats.nSamplesWithStack == 2);
+    EUT_CHECK (stats.nStacks == 2);     // The first sample is counted, when the second one arrives
+    EUT_CHECK (stats.nImages == 2);
+
+    const DecodedProfile profile = DecodeProfile (aggregator.SerializeProfile ());
+    stats = aggregator.GetStats ();
+    EUT_CHECK (stats.nStacks == 2);
+    EUT_CHECK (stats.nTruncatedSamples == 0);
+
+    EUT_CHECK (profile.nSampleTypes == 2);
+    EUT_CHECK (!profile.strings.empty () && profile.strings[0].empty ());
+    EUT_CHECK (profile.durationNanos == 1'000'000'000);
+    EUT_CHECK (profile.samples.size () == 2);
+    EUT_CHECK (profile.mappings.size () == 2);
+
+    bool foundStack = false;
+    bool foundIP = false;
+    for (const DecodedProfile::Sample& sample : profile.samples) {
+        EUT_CHECK (sample.pid == kPID);
+
+        std::vector<uint64_t> addresses;
+        for (const uint64_t locationID : sample.locationIDs)
+            addresses.push_back (profile.locations.at (locationID).second);
+
+        if (sample.locationIDs.size () == 4) {
+            foundStack = true;
+            EUT_CHECK ((addresses == std::vector<uint64_t> { kKernelBase + 0x10,
+                                                             kKernelBase + 0x20,
+                                                             kUserBase + 0x100,
+                                                             kUserBase + 0x200 }));
+            EUT_CHECK ((sample.values == std::vector<uint64_t> { 2, 2'000'000 }));
+
+            const auto& [fileName, buildID] = profile.mappings.at (profile.locations.at (sample.locationIDs[0]).first);
+            EUT_CHECK (fileName == "\\SystemRoot\\system32\\ntoskrnl.exe");
+            EUT_CHECK (buildID == "5E0B1A2C100000");
+        } else if (sample.locationIDs.size () == 1) {
+            foundIP = true;
+            EUT_CHECK (addresses[0] == kUserBase + 0x400);
+            EUT_CHECK ((sample.values == std::vector<uint64_t> { 1, 1'000'000 }));
+        }
+    }
+
+    EUT_CHECK (foundStack && foundIP);
+}
+
+void StackAggregatorMemoryBudgetTest ()
+{
+    constexpr uint64_t kMaxMemory = 64 * 1'024;
+
+    StackAggregator aggregator (GetTestConfig (kMaxMemory));
+
+    // Distinct stacks, until the budget is exhausted many times over
+    constexpr uint64_t kNumberOfSamples = 10'000;
+    for (uint64_t i = 0; i < kNumberOfSamples; ++i) {
+        const int64_t timeStamp = 100 + 10 * i;
+        const std::vector<uint64_t> frames = { kUserBase, kUserBase + 0x10 + i % 7, kUserBase + 0x100 + i };
+        TestEvent sample = MakeSampleEvent (kPID, kTID, kUserBase, timeStamp);
+        TestEvent stack = MakeStackWalkEvent (kPID, kTID, frames, timeStamp);
+        EUT_CHECK (aggregator.WriteEvent (sample.GetView ()));
+        EUT_CHECK (aggregator.WriteEvent (stack.GetView ()));
+    }
+
+    const DecodedProfile profile = DecodeProfile (aggregator.SerializeProfile ());
+    const StackAggregator::Stats stats = aggregator.GetStats ();
+    EUT_CHECK (stats.nSamples == kNumberOfSamples);
+    EUT_CHECK (stats.nTruncatedSamples > 0);
+    EUT_CHECK (stats.nTruncatedSamples < kNumberOfSamples);
+    EUT_CHECK (stats.memoryHighWaterMark <= kMaxMemory);
+
+    // Truncated stacks are counted at their innermost frames, so no sample is lost
+    uint64_t nSamples = 0;
+    for (const DecodedProfile::Sample& sample : profile.samples) {
+        EUT_CHECK (!sample.locationIDs.empty ());
+        nSamples += sample.values.at (0);
+    }
+
+    EUT_CHECK (nSamples == kNumberOfSamples);
+}
+
+TestRegistrator joinTestRegistrator ("StackAggregator.Join", StackAggregatorJoinTest);
+TestRegistrator memoryBudgetTestRegistrator ("StackAggregator.MemoryBudget", StackAggregatorMemoryBudgetTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include "Profiler/StackKeyTable.hpp"
+
+namespace EUT {
+namespace {
+
+using ETWP::StackKeyTable;
+
+// Stack keys are kernel mode addresses, aligned to 64 bytes
+constexpr StackKeyTable::Key kKeyBase = 0xFFFF'A000'0000'0000ULL;
+
+StackKeyTable::Key MakeKey (uint64_t i)
+{
+    return kKeyBase + i * 64;
+}
+
+size_t CountContained (const StackKeyTable& table, uint64_t nKeys)
+{
+    size_t nContained = 0;
+    for (uint64_t i = 0; i < nKeys; ++i)
+        nContained += table.Contains (MakeKey (i));
+
+    return nContained;
+}
+
+void StackKeyTableBasicTest ()
+{
+    StackKeyTable table;
+    EUT_CHECK (table.GetSize () == 0);
+    EUT_CHECK (!table.Contains (MakeKey (1)));
+
+    table.Reference (MakeKey (1));
+    table.Reference (MakeKey (1));
+    table.Reference (0);
+    EUT_CHECK (table.GetSize () == 2);
+    EUT_CHECK (table.Contains (MakeKey (1)) && table.Contains (0));
+
+    EUT_CHECK (table.Remove (MakeKey (1)));
+    EUT_CHECK (!table.Remove (MakeKey (1)));
+    EUT_CHECK (table.Remove (0));
+    EUT_CHECK (!table.Remove (0));
+    EUT_CHECK (table.GetSize () == 0);
+
+    // Enough keys to grow a couple of times. Removing every other key moves the rest around (no tombstones)
+    constexpr uint64_t kKeys = 20'000;
+    for (uint64_t i = 0; i < kKeys; ++i)
+        table.Reference (MakeKey (i));
+
+    EUT_CHECK (table.GetSize () == kKeys);
+    EUT_CHECK (table.GetCapacity () >= kKeys);
+
+    for (uint64_t i = 0; i < kKeys; i += 2)
+        EUT_CHECK (table.Remove (MakeKey (i)));
+
+    EUT_CHECK (table.GetSize () == kKeys / 2);
+    for (uint64_t i = 0; i < kKeys; ++i)
+        EUT_CHECK (table.Contains (MakeKey (i)) == (i % 2 == 1));
+
+    const StackKeyTable::Stats stats = table.GetStats ();
+    EUT_CHECK (stats.nReferences == 3 + kKeys);
+    EUT_CHECK (stats.nRemoved == 2 + kKeys / 2);
+    EUT_CHECK (stats.nMisses == 2);
+    EUT_CHECK (stats.nEvicted == 0);
+    EUT_CHECK (stats.highWaterMark == kKeys);
+
+    table.Clear ();
+    EUT_CHECK (table.GetSize () == 0);
+    EUT_CHECK (CountContained (table, kKeys) == 0);
+}
+
+void StackKeyTableEvictionTest ()
+{
+    // The smallest possible table (the initial capacity), so it's full at 768 keys
+    StackKeyTable table (1);
+    const size_t capacity = table.GetCapacity ();
+    const size_t memoryUsage = table.GetMemoryUsage ();
+
+    // Keys whose definitions are never seen pile up, while a few "hot" keys are referenced all the time
+    constexpr uint64_t kHotKeys = 16;
+    constexpr uint64_t kLeakedKeys = 10'000;
+    table.Reference (0);    // Ages like any other key
+    for (uint64_t i = 0; i < kLeakedKeys; ++i) {
+        table.Reference (MakeKey (kHotKeys + i));
+        if (i % 32 == 0) {
+            for (uint64_t hot = 0; hot < kHotKeys; ++hot)
+                table.Reference (MakeKey (hot));
+        }
+    }
+
+    EUT_CHECK (table.GetCapacity () == capacity);
+    EUT_CHECK (table.GetMemoryUsage () == memoryUsage);
+    EUT_CHECK (table.GetSize () * 4 <= capacity * 3);
+
+    const StackKeyTable::Stats stats = table.GetStats ();
+    EUT_CHECK (stats.nSweeps > 0);
+    EUT_CHECK (stats.nEvicted == 1 + kHotKeys + kLeakedKeys - table.GetSize ());
+    EUT_CHECK (!table.Contains (0));
+
+    // Recently referenced keys survive, and every key left can still be found (and removed)
+    for (uint64_t hot = 0; hot < kHotKeys; ++hot)
+        EUT_CHECK (table.Contains (MakeKey (hot)));
+
+    EUT_CHECK (table.Contains (MakeKey (kHotKeys + kLeakedKeys - 1)));
+    EUT_CHECK (!table.Contains (MakeKey (kHotKeys)));
+    EUT_CHECK (CountContained (table, kHotKeys + kLeakedKeys) == table.GetSize ());
+
+    for (uint64_t i = 0; i < kHotKeys + kLeakedKeys; ++i)
+        table.Remove (MakeKey (i));
+
+    EUT_CHECK (table.GetSize () == 0);
+}
+
+TestRegistrator stackKeyTableBasicTestRegistrator ("StackKeyTable.Basic", StackKeyTableBasicTest);
+TestRegistrator stackKeyTableEvictionTestRegistrator ("StackKeyTable.Eviction", StackKeyTableEvictionTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
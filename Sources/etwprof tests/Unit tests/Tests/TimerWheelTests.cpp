@@ -0,0 +1,150 @@
+#include "TestEvents.hpp"
+#include "TestRegistrar.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "OS/Process/ProcessLifetimeEventSource.hpp"
+#include "Profiler/ProfileFilter.hpp"
+
+#include "Utility/TimerWheel.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::ThreadRegistry;
+using ETWP::TimerWheel;
+
+std::vector<int> AdvanceTo (TimerWheel<int>* pWheel, int64_t now)
+{
+    std::vector<int> expired;
+    pWheel->Advance (now, [&expired] (int entry) { expired.push_back (entry); });
+
+    return expired;
+}
+
+void TimerWheelExpiryTest ()
+{
+    TimerWheel<int> wheel (10);
+    EUT_CHECK (wheel.IsEmpty ());
+
+    // Advancing an empty wheel is a jump, even to a large timestamp
+    const int64_t start = 1'000'000'000'000;
+    EUT_CHECK (AdvanceTo (&wheel, start).empty ());
+
+    wheel.Schedule (start + 100, 1);
+    wheel.Schedule (start + 35, 2);
+    wheel.Schedule (start + 30, 3);
+    EUT_CHECK (wheel.GetSize () == 3);
+
+    EUT_CHECK (AdvanceTo (&wheel, start + 29).empty ());
+    EUT_CHECK ((AdvanceTo (&wheel, start + 30) == std::vector<int> { 3 }));
+    EUT_CHECK (AdvanceTo (&wheel, start + 39).empty ());   // Rounded up to the next tick, never early
+    EUT_CHECK ((AdvanceTo (&wheel, start + 99) == std::vector<int> { 2 }));
+    EUT_CHECK ((AdvanceTo (&wheel, start + 100) == std::vector<int> { 1 }));
+    EUT_CHECK (wheel.IsEmpty ());
+
+    // Going back in time does nothing, entries already due expire on the next Advance
+    wheel.Schedule (start, 4);
+    EUT_CHECK (AdvanceTo (&wheel, start).empty ());
+    EUT_CHECK ((AdvanceTo (&wheel, start + 110) == std::vector<int> { 4 }));
+}
+
+void TimerWheelCascadeTest ()
+{
+    // Entries on every level (and beyond the range of the wheel) expire in order, at the right tick
+    constexpr uint64_t kRange = uint64_t (1) << (TimerWheel<int>::kSlotBits * TimerWheel<int>::kLevels);
+    const std::vector<int64_t> delays = { 1, 63, 64, 65, 4'095, 4'096, 100'000, 262'144, 5'000'000, int64_t (kRange),
+                                          int64_t (kRange) * 3 + 7 };
+
+    TimerWheel<int> wheel (1);
+    for (size_t i = 0; i < delays.size (); ++i)
+        wheel.Schedule (delays[i], int (i));
+
+    std::vector<int64_t> expiryTimes;
+    int64_t now = 0;
+    const int64_t step = 997;
+    while (!wheel.IsEmpty ()) {
+        const int64_t next = now + step;
+        // Advance by single ticks around expiry times, so they can be checked exactly
+        for (const int64_t delay : delays) {
+            if (delay > now && delay <= next) {
+                for (int64_t t = now + 1; t < delay; ++t)
+                    EUT_CHECK (AdvanceTo (&wheel, t).empty ());
+
+                const std::vector<int> expired = AdvanceTo (&wheel, delay);
+                EUT_CHECK (expired.size () == 1);
+                expiryTimes.push_back (delay);
+                now = delay;
+            }
+        }
+
+        EUT_CHECK (AdvanceTo (&wheel, next).empty ());
+        now = next;
+    }
+
+    EUT_CHECK (expiryTimes == delays);
+}
+
+void TimerWheelThreadRegistryTest ()
+{
+    ThreadRegistry threads;
+    threads.SetTimestampFrequency (1'000);  // Timestamps are milliseconds
+
+    threads.Add (4);
+    threads.Add (8);
+    threads.Add (12);
+    threads.MarkForDeletion (4, 10'000);
+    threads.MarkForDeletion (8, 10'500);
+    EUT_CHECK (threads.GetNumberOfThreadsMarkedForDeletion () == 2);
+
+    // Deletion is driven by timestamps only: no matter how long it takes to get here, nothing is deleted early
+    threads.DeleteThreadsMarkedForDeletion (10'900);
+    EUT_CHECK (threads.Contains (4) && threads.Contains (8));
+
+    threads.DeleteThreadsMarkedForDeletion (11'100);
+    EUT_CHECK (!threads.Contains (4) && threads.Contains (8));
+
+    // A TID reused (deleted and added again) after being marked is not affected by the old mark
+    threads.Delete (8);
+    threads.Add (8);
+    threads.DeleteThreadsMarkedForDeletion (12'000);
+    EUT_CHECK (threads.Contains (8) && threads.Contains (12));
+    EUT_CHECK (threads.GetNumberOfThreadsMarkedForDeletion () == 0);
+}
+
+void TimerWheelReusedThreadIDTest ()
+{
+    constexpr DWORD    kTargetPID = 2'000;
+    constexpr DWORD    kTID = 104;
+    constexpr int64_t  kPerfFreq = 1'000;    // Timestamps are milliseconds
+    constexpr uint64_t kSampleIP = 0x7FF6'0000'1000;
+
+    ETWP::ProfileFilterData filterData = { {}, {}, {}, { kTargetPID }, false, false, {} };
+    filterData.threads.SetTimestampFrequency (kPerfFreq);
+    ETWP::PrepareForProfiling (&filterData);
+    ETWP::ProcessLifetimeEventSource processLifetimeEventSource;
+    const auto filter = [&] (TestEvent event) {
+        return ETWP::FilterEventForProfiling (event.GetView (), &filterData, &processLifetimeEventSource);
+    };
+
+    EUT_CHECK (filter (MakeThreadEvent (ETWConstants::TStartOpcode, kTargetPID, kTID, 1'000)));
+    EUT_CHECK (filter (MakeThreadEvent (ETWConstants::TEndOpcode, kTargetPID, kTID, 2'000)));
+
+    // The ID is reused by a new thread of the target before the ended one is deleted: the mark of the ended thread
+    //   must not delete the new one
+    EUT_CHECK (filter (MakeThreadEvent (ETWConstants::TStartOpcode, kTargetPID, kTID, 2'100)));
+    EUT_CHECK (filter (MakeThreadEvent (ETWConstants::TStartOpcode, kTargetPID, kTID + 4, 3'100)));
+    EUT_CHECK (filter (MakeSampleEvent (kTargetPID, kTID, kSampleIP, 3'200)));
+}
+
+TestRegistrator timerWheelExpiryTestRegistrator ("TimerWheel.Expiry", TimerWheelExpiryTest);
+TestRegistrator timerWheelCascadeTestRegistrator ("TimerWheel.Cascade", TimerWheelCascadeTest);
+TestRegistrator timerWheelThreadRegistryTestRegistrator ("TimerWheel.ThreadRegistry", TimerWheelThreadRegistryTest);
+TestRegistrator timerWheelReusedThreadIDTestRegistrator ("TimerWheel.ReusedThreadID", TimerWheelReusedThreadIDTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "TestEvents.hpp"
+#include "TestRegistrar.hpp"
+#include "TestSegments.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "Profiler/TriggerRules.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETWConstants = ETWP::ETWConstants;
+
+using ETWP::EventView;
+using ETWP::SlidingWindowCounter;
+using ETWP::TriggerRule;
+using ETWP::TriggerRuleEngine;
+using ETWP::TriggeredSink;
+
+constexpr int64_t  kPerfFreq = 10'000'000;
+constexpr int64_t  kMs = kPerfFreq / 1'000;
+constexpr DWORD    kPID = 2'000;
+constexpr DWORD    kTID = kPID + 4;
+constexpr DWORD    kOtherPID = 3'000;
+constexpr uint64_t kSampleIP = 0x7FF6'0000'1000;
+
+// Samples/s above 500 for 200 ms start persisting, below 500 for 500 ms stop it. Rates are checked every 100 ms
+TriggerRule GetTestRule ()
+{
+    TriggerRule rule;
+    rule.minSampleRate = 500;
+    rule.startDelay = 200;
+    rule.stopDelay = 500;
+    rule.rateWindow = 1'000;
+
+    return rule;
+}
+
+struct Transition {
+    int64_t timeStamp;
+    bool    persisting;
+};
+
+// Feeds the engine with samples of pid every intervalMs between [fromMs, toMs), and advances it every millisecond.
+//   Returns the changes of IsPersisting
+std::vector<Transition> FeedSamples (TriggerRuleEngine* pEngine,
+                                     DWORD pid,
+                                     int64_t fromMs,
+                                     int64_t toMs,
+                                     int64_t intervalMs)
+{
+    std::vector<Transition> transitions;
+    bool persisting = pEngine->IsPersisting ();
+    for (int64_t ms = fromMs; ms < toMs; ++ms) {
+        if (intervalMs != 0 && (ms - fromMs) % intervalMs == 0)
+            pEngine->AddSample (pid, ms * kMs);
+        else
+            pEngine->AdvanceTo (ms * kMs);
+
+        if (pEngine->IsPersisting () != persisting) {
+            persisting = pEngine->IsPersisting ();
+            transitions.push_back ({ ms * kMs, persisting });
+        }
+    }
+
+    return transitions;
+}
+
+void TriggerRulesSlidingWindowCounterTest ()
+{
+    SlidingWindowCounter counter;
+    EUT_CHECK (counter.GetSum () == 0);
+
+    // One bucket holds 1, the next 2, and so on
+    constexpr uint32_t kBuckets = SlidingWindowCounter::kBuckets;
+    for (uint32_t i = 1; i <= kBuckets; ++i) {
+        counter.Add (i);
+        counter.Advance (1);
+    }
+
+    // The oldest (1) fell out
+    EUT_CHECK (counter.GetSum () == (kBuckets + 1) * kBuckets / 2 - 1);
+
+    counter.Advance (2);
+    EUT_CHECK (counter.GetSum () == (kBuckets + 1) * kBuckets / 2 - 1 - 2 - 3);
+
+    counter.Add ();
+    EUT_CHECK (counter.GetSum () == (kBuckets + 1) * kBuckets / 2 - 5);
+
+    counter.Advance (1'000'000);
+    EUT_CHECK (counter.GetSum () == 0);
+}
+
+// A steady, quiet process, and a 3 seconds long spike of another one (1000 samples/s)
+void TriggerRulesSpikeTest ()
+{
+    TriggerRuleEngine engine (GetTestRule (), kPerfFreq);
+
+    EUT_CHECK (FeedSamples (&engine, kOtherPID, 0, 5'000, 10).empty ());
+    EUT_CHECK (!engine.IsPersisting ());
+
+    const std::vector<Transition> spikeTransitions = FeedSamples (&engine, kPID, 5'000, 8'000, 1);
+    EUT_CHECK (spikeTransitions.size () == 1);
+    EUT_CHECK (spikeTransitions[0].persisting);
+
+    // The rate gets to 500 at 500 ms, then it has to stay there for 200 ms (100 ms granularity)
+    EUT_CHECK (spikeTransitions[0].timeStamp >= 5'600 * kMs);
+    EUT_CHECK (spikeTransitions[0].timeStamp <= 5'800 * kMs);
+
+    // The rate drops below 500 at 500 ms after the spike, then it has to stay there for 500 ms
+    const std::vector<Transition> quietTransitions = FeedSamples (&engine, kOtherPID, 8'000, 12'000, 10);
+    EUT_CHECK (quietTransitions.size () == 1);
+    EUT_CHECK (!quietTransitions[0].persisting);
+    EUT_CHECK (quietTransitions[0].timeStamp >= 8'900 * kMs);
+    EUT_CHECK (quietTransitions[0].timeStamp <= 9'100 * kMs);
+
+    const TriggerRuleEngine::Stats stats = engine.GetStats ();
+    EUT_CHECK (stats.nActivations == 1);
+    EUT_CHECK (stats.nSamples == 500 + 3'000 + 400);
+    EUT_CHECK (stats.nProcessesHighWaterMark == 2);
+}
+
+// Short bursts, and processes that are busy only together do not start persisting
+void TriggerRulesBelowThresholdTest ()
+{
+    TriggerRuleEngine engine (GetTestRule (), kPerfFreq);
+
+    // 300 ms at 1000 samples/s, then a second of silence, a few times
+    for (int64_t start = 0; start < 10'000; start += 1'300) {
+        EUT_CHECK (FeedSamples (&engine, kPID, start, start + 300, 1).empty ());
+        EUT_CHECK (FeedSamples (&engine, kPID, start + 300, start + 1'300, 0).empty ());
+    }
+
+    // Two processes at 300 samples/s each: 600 samples/s in total, but each one is below the threshold
+    for (int64_t ms = 10'000; ms < 15'000; ++ms) {
+        if (ms % 10 < 3)
+            engine.AddSample (kPID, ms * kMs);
+        else if (ms % 10 < 6)
+            engine.AddSample (kOtherPID, ms * kMs);
+
+        EUT_CHECK (!engine.IsPersisting ());
+    }
+
+    EUT_CHECK (engine.GetStats ().nActivations == 0);
+}
+
+// While persisting, time jumps a lot (i.e. there are no events at all). Persisting stops, and starts again, if the
+//   process is busy again
+void TriggerRulesTimeGapTest ()
+{
+    TriggerRule rule = GetTestRule ();
+    rule.startDelay = 0;
+    TriggerRuleEngine engine (rule, kPerfFreq);
+
+    EUT_CHECK (FeedSamples (&engine, kPID, 0, 2'000, 1).size () == 1);
+    EUT_CHECK (engine.IsPersisting ());
+
+    engine.AdvanceTo (1'000'000 * kMs);
+    EUT_CHECK (!engine.IsPersisting ());
+
+    const std::vector<Transition> transitions = FeedSamples (&engine, kPID, 1'000'000, 1'001'000, 1);
+    EUT_CHECK (transitions.size () == 1);
+    EUT_CHECK (transitions[0].persisting);
+    EUT_CHECK (transitions[0].timeStamp <= 1'000'600 * kMs);
+    EUT_CHECK (engine.GetStats ().nActivations == 2);
+}
+
+// Writes a process, a thread, then samples with stacks: 100 samples/s, except for two spikes (1000 samples/s, between
+//   2-4 s and 8-9 s)
+void WriteTestStream (TriggeredSink* pSink)
+{
+    TestEvent process = MakeProcessEvent (ETWConstants::PDCStartOpcode, kPID, 0);
+    EUT_CHECK (pSink->WriteEvent (process.GetView ()));
+    TestEvent thread = MakeThreadEvent (ETWConstants::TDCStartOpcode, kPID, kTID, 0);
+    EUT_CHECK (pSink->WriteEvent (thread.GetView ()));
+
+    for (int64_t ms = 1; ms < 12'000; ++ms) {
+        const bool spike = (ms >= 2'000 && ms < 4'000) || (ms >= 8'000 && ms < 9'000);
+        if (!spike && ms % 10 != 0)
+            continue;
+
+        TestEvent sample = MakeSampleEvent (kPID, kTID, kSampleIP, ms * kMs);
+        EUT_CHECK (pSink->WriteEvent (sample.GetView ()));
+        TestEvent stackWalk = MakeStackWalkEvent (kPID, kTID, { kSampleIP }, ms * kMs);
+        EUT_CHECK (pSink->WriteEvent (stackWalk.GetView ()));
+    }
+}
+
+// Each spike is a segment on its own, starting with a rundown, and samples with their stacks
+void TriggerRulesTriggeredSinkTest ()
+{
+    SegmentCollector collector;
+    {
+        TriggeredSink sink (collector.GetFactory (), GetTestRule (), kPerfFreq);
+        WriteTestStream (&sink);
+
+        std::wstring errorMsg;
+        EUT_CHECK (sink.Close (&errorMsg));
+
+        const TriggeredSink::Stats stats = sink.GetStats ();
+        EUT_CHECK (stats.engine.nActivations == 2);
+        EUT_CHECK (stats.nSegments == 2);
+        EUT_CHECK (stats.nSegmentsFailed == 0);
+        EUT_CHECK (stats.nRundownEventsWritten == 2 * 2);
+        EUT_CHECK (stats.nEventsSkipped > 0);
+        EUT_CHECK (stats.nEventsWritten + stats.nEventsSkipped == 2 + 2 * (1'199 + 3'000 - 300));
+    }
+
+    const std::vector<std::unique_ptr<RecordedSegment>>& segments = collector.GetSegments ();
+    EUT_CHECK (segments.size () == 2);
+    for (uint32_t i = 0; i < segments.size (); ++i) {
+        const RecordedSegment& segment = *segments[i];
+        EUT_CHECK (segment.segmentNumber == i + 1);
+        EUT_CHECK (segment.finished);
+        EUT_CHECK (segment.finisherID != std::this_thread::get_id ());
+
+        EUT_CHECK (segment.events.size () > 2 + 2 * 300);
+        EUT_CHECK (segment.events[0].providerID == ProcessGuid);
+        EUT_CHECK (segment.events[0].opcode == ETWConstants::PDCStartOpcode);
+        EUT_CHECK (segment.events[0].timeStamp == segment.startTimeStamp);
+        EUT_CHECK (segment.events[1].providerID == ThreadGuid);
+        EUT_CHECK (segment.events[1].opcode == ETWConstants::TDCStartOpcode);
+
+        // Samples and stacks alternate, from the first one to the last one
+        EUT_CHECK (segment.events[2].providerID == PerfInfoGuid);
+        EUT_CHECK (segment.events[2].timeStamp == segment.startTimeStamp);
+        EUT_CHECK (segment.events.back ().providerID == StackWalkGuid);
+        for (size_t j = 2; j < segment.events.size (); ++j)
+            EUT_CHECK ((segment.events[j].providerID == PerfInfoGuid) == (j % 2 == 0));
+    }
+
+    // Within the spikes (with the delays of the rule)
+    EUT_CHECK (segments[0]->startTimeStamp >= 2'600 * kMs && segments[0]->startTimeStamp <= 2'800 * kMs);
+    EUT_CHECK (segments[0]->events.back ().timeStamp >= 4'800 * kMs);
+    EUT_CHECK (segments[0]->events.back ().timeStamp <= 5'100 * kMs);
+    EUT_CHECK (segments[1]->startTimeStamp >= 8'600 * kMs && segments[1]->startTimeStamp <= 8'800 * kMs);
+}
+
+// The first segment cannot be created: the first spike is skipped, the second one is written (and it takes the name of
+//   the failed one)
+void TriggerRulesSegmentFailureTest ()
+{
+    SegmentCollector collector (1);
+    {
+        TriggeredSink sink (collector.GetFactory (), GetTestRule (), kPerfFreq);
+        WriteTestStream (&sink);
+
+        std::wstring errorMsg;
+        EUT_CHECK (!sink.Close (&errorMsg));
+        EUT_CHECK (errorMsg == L"Create failed");
+
+        const TriggeredSink::Stats stats = sink.GetStats ();
+        EUT_CHECK (stats.nSegments == 1);
+        EUT_CHECK (stats.nSegmentsFailed == 1);
+    }
+
+    EUT_CHECK (collector.GetSegments ().size () == 1);
+    EUT_CHECK (collector.GetSegments ()[0]->segmentNumber == 1);
+    EUT_CHECK (collector.GetSegments ()[0]->startTimeStamp >= 8'600 * kMs);
+}
+
+TestRegistrator slidingWindowCounterTestRegistrator ("TriggerRules.SlidingWindowCounter",
+                                                     TriggerRulesSlidingWindowCounterTest);
+TestRegistrator spikeTestRegistrator ("TriggerRules.Spike", TriggerRulesSpikeTest);
+TestRegistrator belowThresholdTestRegistrator ("TriggerRules.BelowThreshold", TriggerRulesBelowThresholdTest);
+TestRegistrator timeGapTestRegistrator ("TriggerRules.TimeGap", TriggerRulesTimeGapTest);
+TestRegistrator triggeredSinkTestRegistrator ("TriggerRules.TriggeredSink", TriggerRulesTriggeredSinkTest);
+TestRegistrator segmentFailureTestRegistrator ("TriggerRules.SegmentFailure", TriggerRulesSegmentFailureTest);
+
+}   // namespace
+}   // namespace EUT
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "TestFiles.hpp"
+#include "TestRegistrar.hpp"
+
+#ifdef ETWP_HAVE_LIBLZMA
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <lzma.h>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/FileSystem/XZFileWriter.hpp"
+
+namespace EUT {
+namespace {
+
+namespace ETLFormat = ETWP::ETLFormat;
+
+using ETWP::ETLWriter;
+using ETWP::ETLWriterConfig;
+using ETWP::EventRecordLayout;
+using ETWP::EventView;
+using ETWP::XZFileWriter;
+using ETWP::XZFileWriterConfig;
+
+constexpr char kTempFilePrefix[] = "xz";
+
+std::vector<uint8_t> ReadFile (const std::filesystem::path& path)
+{
+    std::ifstream file (path, std::ios::binary);
+
+    return std::vector<uint8_t> (std::istreambuf_iterator<char> (file), std::istreambuf_iterator<char> ());
+}
+
+// Decodes all streams (and stream padding) of an .xz file, like xz and 7-Zip do
+bool Decompress (const std::vector<uint8_t>& compressed, std::vector<uint8_t>* pDecompressedOut)
+{
+    lzma_stream stream = LZMA_STREAM_INIT;
+    if (lzma_stream_decoder (&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+        return false;
+
+    stream.next_in = compressed.data ();
+    stream.avail_in = compressed.size ();
+
+    std::vector<uint8_t> chunk (64 * 1'024);
+    lzma_ret result;
+    do {
+        stream.next_out = chunk.data ();
+        stream.avail_out = chunk.size ();
+        result = lzma_code (&stream, LZMA_FINISH);
+
+        const size_t oldSize = pDecompressedOut->size ();
+        const size_t chunkSize = chunk.size () - stream.avail_out;
+        pDecompressedOut->resize (oldSize + chunkSize);
+        if (chunkSize > 0)
+            std::memcpy (pDecompressedOut->data () + oldSize, chunk.data (), chunkSize);
+    } while (result == LZMA_OK);
+
+    lzma_end (&stream);
+
+    return result == LZMA_STREAM_END;
+}
+
+// Somewhat compressible data
+std::vector<uint8_t> MakeData (size_t size, uint64_t seed)
+{
+    std::mt19937_64 random (seed);
+    std::vector<uint8_t> data (size);
+    for (size_t i = 0; i < size; ++i)
+        data[i] = random () % 16 == 0 ? static_cast<uint8_t> (random ()) : static_cast<uint8_t> (i / 64);
+
+    return data;
+}
+
+void XZFileWriterRoundTrip ()
+{
+    for (const uint32_t prefixSize : { 0u, 4'096u }) {
+        TempFile file (kTempFilePrefix, "RoundTrip.xz");
+
+        const std::vector<uint8_t> data = MakeData (3 * 1'024 * 1'024 + 123, prefixSize);
+
+        XZFileWriterConfig config;
+        config.preset = 1;
+        config.nThreads = 3;
+        config.blockSize = 256 * 1'024;
+        config.prefixSize = prefixSize;
+
+        std::wstring errorMsg;
+        {
+            XZFileWriter writer (file.GetPath (), config);
+
+            // Odd sized writes, the prefix is provided at the end
+            for (size_t offset = prefixSize; offset < data.size (); offset += 100'003) {
+                const size_t size = std::min<size_t> (100'003, data.size () - offset);
+                EUT_CHECK (writer.Write (data.data () + offset, size, &errorMsg));
+            }
+
+            EUT_CHECK (writer.Finish (data.data (), &errorMsg));
+            EUT_CHECK (writer.GetCompressedSize () == std::filesystem::file_size (file.GetPath ()));
+        }
+
+        const std::vector<uint8_t> compressed = ReadFile (file.GetPath ());
+        EUT_CHECK (compressed.size () < data.size () / 2);
+
+        std::vector<uint8_t> decompressed;
+        EUT_CHECK (Decompress (compressed, &decompressed));
+        EUT_CHECK (decompressed == data);
+    }
+}
+
+void XZFileWriterETLWriterOutput ()
+{
+    TempFile plainFile (kTempFilePrefix, "Plain.etl");
+    TempFile compressedFile (kTempFilePrefix, "Compressed.etl.xz");
+
+    ETLWriterConfig config;
+    config.bufferSize = 16 * 1'024;
+    config.blockSize = 64 * 1'024;
+    config.numberOfProcessors = 2;
+    config.startTimeStamp = 1'000;
+    config.loggerName = L"etwprof xz test";
+    config.compression.nThreads = 2;
+    config.compression.blockSize = 128 * 1'024;
+
+    ETLWriterConfig compressedConfig = config;
+    compressedConfig.compress = true;
+
+    ETLWriter plainWriter (plainFile.GetPath (), config);
+    ETLWriter compressedWriter (compressedFile.GetPath (), compressedConfig);
+
+    std::mt19937_64 random (5);
+    for (uint32_t i = 0; i < 20'000; ++i) {
+        std::vector<uint8_t> payload (8 + random () % 64, static_cast<uint8_t> (i % 7));
+
+        EventRecordLayout record = {};
+        record.m_header.m_providerID = ThreadGuid;
+        record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+        record.m_header.m_opcode = static_cast<UCHAR> (i % 3);
+        record.m_header.m_timeStamp = 2'000 + i;
+        record.m_processorNumber = static_cast<UCHAR> (random () % 2);
+        record.m_pUserData = payload.data ();
+        record.m_userDataLength = static_cast<USHORT> (payload.size ());
+
+        EUT_CHECK (plainWriter.WriteEvent (EventView (record)));
+        EUT_CHECK (compressedWriter.WriteEvent (EventView (record)));
+    }
+
+    std::wstring errorMsg;
+    EUT_CHECK (plainWriter.Close (&errorMsg));
+    EUT_CHECK (compressedWriter.Close (&errorMsg));
+
+    const ETLWriter::Stats stats = compressedWriter.GetStats ();
+    EUT_CHECK (stats.nCompressedBytesWritten == std::filesystem::file_size (compressedFile.GetPath ()));
+    EUT_CHECK (plainWriter.GetStats ().nCompressedBytesWritten == 0);
+
+    // The decompressed file is the same as the uncompressed one (including the finalized logfile header)
+    std::vector<uint8_t> decompressed;
+    EUT_CHECK (Decompress (ReadFile (compressedFile.GetPath ()), &decompressed));
+    EUT_CHECK (decompressed == ReadFile (plainFile.GetPath ()));
+}
+
+TestRegistrator xzFileWriterRoundTrip ("XZFileWriter.RoundTrip", XZFileWriterRoundTrip);
+TestRegistrator xzFileWriterETLWriterOutput ("XZFileWriter.ETLWriterOutput", XZFileWriterETLWriterOutput);
+
+}   // namespace
+}   // namespace EUT
+
+#endif  // #ifdef ETWP_HAVE_LIBLZMA
\ No newline at end of file
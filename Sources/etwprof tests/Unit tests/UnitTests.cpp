@@ -0,0 +1,58 @@
+/*
+  This small utility program runs unit tests of etwprof's portable parts (i.e. etwprof_core). It does not depend on
+    Windows, so it can be run on any machine (the end-to-end tests in the "Tests" folder one level up need Windows).
+
+  Tests are named "<Suite>.<Test>". Only tests with names starting with the (optional) argument are run. See the
+    "Tests" folder for the available tests.
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+
+#include "TestRegistrar.hpp"
+
+int main (int argc, char* argv[])
+{
+    if (argc > 2) {
+        std::fprintf (stderr, "Usage: etwprof_unit_tests [<test name prefix>]\n");
+
+        return EXIT_FAILURE;
+    }
+
+    const std::string prefix = argc == 2 ? argv[1] : "";
+
+    uint32_t nRun = 0;
+    uint32_t nFailed = 0;
+    EUT::TestRegistrar::Instance ().Enumerate ([&] (const std::string& name, const EUT::Test& test) {
+            if (name.compare (0, prefix.size (), prefix) != 0)
+                return true;
+
+            ++nRun;
+            std::printf ("[ RUN    ] %s\n", name.c_str ());
+            std::fflush (stdout);
+
+            try {
+                test ();
+                std::printf ("[     OK ] %s\n", name.c_str ());
+            } catch (const std::exception& e) {
+                ++nFailed;
+                std::printf ("%s\n[ FAILED ] %s\n", e.what (), name.c_str ());
+            }
+
+            return true;
+        }
+    );
+
+    if (nRun == 0) {
+        std::fprintf (stderr, "No tests match \"%s\"!\n", prefix.c_str ());
+
+        return EXIT_FAILURE;
+    }
+
+    std::printf ("%u test(s) run, %u failed\n", nRun, nFailed);
+
+    return nFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <cwctype>
+#include <optional>
 
 #ifdef ETWP_DEBUG
 #include <crtdbg.h>
@@ -12,17 +14,24 @@
 
 #include "Log/Logging.hpp"
 
+#include "OS/ETW/SessionSizing.hpp"
 #include "OS/FileSystem/Utility.hpp"
 #include "OS/Process/Minidump.hpp"
 #include "OS/Process/ProcessList.hpp"
 #include "OS/Process/Utility.hpp"
 #include "OS/Stream/GlobalStreams.hpp"
+#include "OS/Utility/ProfileInterruptRate.hpp"
 #include "OS/Version/WinVersion.hpp"
 
 #include "Profiler/ETLReloggerProfiler.hpp"
 #include "Profiler/ETWProfiler.hpp"
+#include "Profiler/FilterStats.hpp"
+#include "Profiler/FlightRecorder.hpp"
+#include "Profiler/OutputRotation.hpp"
+#include "Profiler/ProgressCounters.hpp"
 
 #include "Utility/Asserts.hpp"
+#include "Utility/Macros.hpp"
 #include "Utility/OnExit.hpp"
 
 namespace ETWP {
@@ -85,6 +94,132 @@ std::wstring GenerateFileNameForProcess (const std::wstring processName, PID pid
     return result;
 }
 
+// Triggers for dumps in flight recorder mode (see FlightRecorder), polled while profiling
+class DumpTriggers final {
+public:
+    DumpTriggers (): m_hEvent (nullptr), m_hConsoleInput (nullptr), m_cpuTrigger (), m_targetHandles ()
+    {
+    }
+
+    ~DumpTriggers ()
+    {
+        if (m_hEvent != nullptr)
+            CloseHandle (m_hEvent);
+
+        for (HANDLE hTarget : m_targetHandles)
+            CloseHandle (hTarget);
+    }
+
+    ETWP_DISABLE_COPY_AND_MOVE (DumpTriggers);
+
+    // Auto-reset event, so other processes (e.g. a monitoring script) can signal it with SetEvent
+    bool EnableNamedEvent (const std::wstring& name, std::wstring* pErrorOut)
+    {
+        m_hEvent = CreateEventW (nullptr, FALSE, FALSE, name.c_str ());
+        if (m_hEvent == nullptr) {
+            *pErrorOut = L"Unable to create event \"" + name + L"\" (error: " + std::to_wstring (GetLastError ()) +
+                         L")";
+
+            return false;
+        }
+
+        return true;
+    }
+
+    // Only if the standard input is a console
+    bool EnableKey ()
+    {
+        HANDLE hConsoleInput = GetStdHandle (STD_INPUT_HANDLE);
+        DWORD mode;
+        if (hConsoleInput == INVALID_HANDLE_VALUE || hConsoleInput == nullptr || !GetConsoleMode (hConsoleInput, &mode))
+            return false;
+
+        m_hConsoleInput = hConsoleInput;
+
+        return true;
+    }
+
+    // Targets that cannot be opened are not taken into account
+    void EnableCPUThreshold (uint32_t thresholdPercent, const std::vector<ProcessInfo>& targets)
+    {
+        for (const ProcessInfo& target : targets) {
+            HANDLE hTarget = OpenProcess (PROCESS_QUERY_LIMITED_INFORMATION, FALSE, target.pid);
+            if (hTarget != nullptr)
+                m_targetHandles.push_back (hTarget);
+        }
+
+        m_cpuTrigger.emplace (thresholdPercent);
+    }
+
+    // Waits (at most timeoutMs) for a trigger to fire. Returns its description, or an empty string, if none fired
+    std::wstring Wait (DWORD timeoutMs)
+    {
+        if (m_hEvent != nullptr) {
+            if (WaitForSingleObject (m_hEvent, timeoutMs) == WAIT_OBJECT_0)
+                return L"named event signaled";
+        } else {
+            Sleep (timeoutMs);
+        }
+
+        if (m_hConsoleInput != nullptr && WasKeyPressed ())
+            return L"key pressed";
+
+        if (m_cpuTrigger.has_value ()) {
+            FILETIME now;
+            GetSystemTimeAsFileTime (&now);
+            if (m_cpuTrigger->Update (GetTargetCPUTime (), FileTimeToUInt64 (now)))
+                return L"CPU usage of targets is " + std::to_wstring (int (m_cpuTrigger->GetLastUsage ())) + L"%";
+        }
+
+        return {};
+    }
+
+private:
+    HANDLE                             m_hEvent;
+    HANDLE                             m_hConsoleInput;
+    std::optional<CPUThresholdTrigger> m_cpuTrigger;
+    std::vector<HANDLE>                m_targetHandles;
+
+    static uint64_t FileTimeToUInt64 (const FILETIME& fileTime)
+    {
+        return (uint64_t (fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
+    }
+
+    // Consumes all pending console input
+    bool WasKeyPressed ()
+    {
+        bool pressed = false;
+        DWORD nEvents;
+        while (GetNumberOfConsoleInputEvents (m_hConsoleInput, &nEvents) && nEvents > 0) {
+            INPUT_RECORD record;
+            DWORD nRead;
+            if (!ReadConsoleInputW (m_hConsoleInput, &record, 1, &nRead) || nRead == 0)
+                break;
+
+            if (record.EventType == KEY_EVENT && record.Event.KeyEvent.bKeyDown &&
+                std::towlower (record.Event.KeyEvent.uChar.UnicodeChar) == L'd')
+            {
+                pressed = true;
+            }
+        }
+
+        return pressed;
+    }
+
+    // In FILETIME units (100 ns), summed for all targets (exited ones included)
+    uint64_t GetTargetCPUTime () const
+    {
+        uint64_t cpuTime = 0;
+        for (HANDLE hTarget : m_targetHandles) {
+            FILETIME creationTime, exitTime, kernelTime, userTime;
+            if (GetProcessTimes (hTarget, &creationTime, &exitTime, &kernelTime, &userTime))
+                cpuTime += FileTimeToUInt64 (kernelTime) + FileTimeToUInt64 (userTime);
+        }
+
+        return cpuTime;
+    }
+};
+
 }   // namespace
 
 Application& Application::Instance ()
@@ -203,9 +338,9 @@ void Application::PrintUsage () const
         LR"(etwprof
 
   Usage:
-    etwprof profile --target=<PID_or_name> (--output=<file_path> | --outdir=<dir_path>) [--mdump [--mflags]] [--compress=<mode>] [--enable=<args>] [--cswitch] [--rate=<profile_rate>] [--nologo] [--verbose] [--debug] [--scache] [--children [--waitchildren]]
-    etwprof profile (--output=<file_path> | --outdir=<dir_path>) [--compress=<mode>] [--enable=<args>] [--cswitch] [--rate=<profile_rate>] [--nologo] [--verbose] [--debug] [--scache] [--children [--waitchildren]] -- <process_path> [<process_args>...]
-    etwprof profile --emulate=<ETL_path> --target=<PID> (--output=<file_path> | --outdir=<dir_path>) [--compress=<mode>] [--enable=<args>] [--cswitch] [--nologo] [--verbose] [--debug] [--children]
+    etwprof profile --target=<PID_or_name> (--output=<file_path> | --outdir=<dir_path>) [--mdump [--mflags]] [--compress=<mode>] [--enable=<args>] [--cswitch] [--rate=<profile_rate>] [--nologo] [--verbose] [--debug] [--scache] [--pipeline] [--backoff] [--rotatesize=<MB>] [--rotatetime=<s>] [--ring=<MB> [--ringtime=<s>] [--dumpevent=<name>] [--dumpcpu=<percent>]] [--trigger=<rate> [--trigstart=<ms>] [--trigstop=<ms>]] [--aggregate=<MB>] [--modules=<names>] [--stats=<file_path>] [--progress=<file_path>] [--reorder=<ms>] [--children [--waitchildren]]
+    etwprof profile (--output=<file_path> | --outdir=<dir_path>) [--compress=<mode>] [--enable=<args>] [--cswitch] [--rate=<profile_rate>] [--nologo] [--verbose] [--debug] [--scache] [--pipeline] [--backoff] [--rotatesize=<MB>] [--rotatetime=<s>] [--ring=<MB> [--ringtime=<s>] [--dumpevent=<name>] [--dumpcpu=<percent>]] [--trigger=<rate> [--trigstart=<ms>] [--trigstop=<ms>]] [--aggregate=<MB>] [--modules=<names>] [--stats=<file_path>] [--progress=<file_path>] [--reorder=<ms>] [--children [--waitchildren]] -- <process_path> [<process_args>...]
+    etwprof profile --emulate=<ETL_path> --target=<PID> (--output=<file_path> | --outdir=<dir_path>) [--compress=<mode>] [--enable=<args>] [--cswitch] [--nologo] [--verbose] [--debug] [--stats=<file_path>] [--progress=<file_path>] [--children]
     etwprof --help
     etwprof --version
 
@@ -223,10 +358,26 @@ void Application::PrintUsage () const
     --outdir=<od>    Output directory path
     --nologo         Do not print logo
     --rate=<r>       Sampling rate (in Hz) [default: use current global rate]
-    --compress=<c>   Compression method used on output file ("off", "etw", or "7z") [default: "etw"]
+    --compress=<c>   Compression method used on output file ("off", "etw", "xz", or "7z") [default: "etw"]
     --enable=<args>  Format: (<GUID>|<RegisteredName>|*<Name>)[:KeywordBitmask[:MaxLevel['stack']]][+...]
     --scache         Enable ETW stack caching
     --cswitch        Collect context switch events as well
+    --pipeline       Write the output on a separate thread, so slow writes do not cause ETW to drop events
+    --backoff        Lower the sampling rate (down to 100 Hz) while the ETW session keeps losing events
+    --rotatesize=<s> Start a new output segment (<output>_001.etl, ...) when the current one reaches this size (in MB)
+    --rotatetime=<t> Start a new output segment when the current one spans this much time (in seconds)
+    --ring=<r>       Flight recorder mode: keep the latest events in this much memory (in MB), write them on demand only
+    --ringtime=<rt>  Flight recorder mode: keep the events of this many seconds at most
+    --dumpevent=<e>  Flight recorder mode: write the recorded events when this named event is signaled
+    --dumpcpu=<c>    Flight recorder mode: write the recorded events when targets use more CPU than this (in %)
+    --trigger=<tr>   Write the output only while a target is sampled at least this many times a second
+    --trigstart=<ts> Start writing when the sample rate stays above the trigger rate this long (in ms) [default: 0]
+    --trigstop=<tp>  Stop writing when the sample rate stays below the trigger rate this long (in ms) [default: 1000]
+    --aggregate=<a>  Write a pprof stack-count profile (<output>.pb) instead of an ETL, using this much memory (in MB)
+    --modules=<m>    Keep samples only if their IP or stack is in these modules (e.g. "a.dll,b.dll"), count all of them
+    --stats=<s>      Write the number of events (and bytes) kept and dropped per provider and opcode into this JSON file
+    --progress=<p>   Write the progress (events/s, MB written, events lost by ETW, etc.) into this CSV file every 500 ms
+    --reorder=<ro>   Hold back events of unknown threads this long (in ms), in case their thread start arrives later
     --emulate=<f>    Debugging feature. Do not start a real time ETW session, use an already existing ETL file as input
 )";
 
@@ -387,18 +538,27 @@ bool Application::DoProfile ()
         const PID pid = m_args.targetIsPID ? m_args.targetPID : targetProcessInfos.begin ()->pid;
 
         finalOutputPath +=
-            GenerateFileNameForProcess (processName,
-                                        pid,
-                                        m_args.compressionMode ==
-                                            ApplicationArguments::CompressionMode::SevenZip ? L".7z" : L".etl");
+            GenerateFileNameForProcess (processName, pid, GetOutputExtension (m_args));
     }
 
-    // If 7z compression is requested, we need to change the profiler output path
+    // If 7z compression is requested, we need to change the profiler output path (xz compression is done by the
+    //   profiler, while the output is written)
     std::wstring profilerOutputPath = finalOutputPath;
     if (m_args.compressionMode == ApplicationArguments::CompressionMode::SevenZip)
         profilerOutputPath = PathReplaceExtension (finalOutputPath, L".etl");
 
     Log (LogSeverity::Info, L"Output file path is " + finalOutputPath);
+    if (m_args.rotateSize > 0 || m_args.rotateTime > 0)
+        Log (LogSeverity::Info, L"Output is rotated, segments are named like " + GetSegmentPath (finalOutputPath, 1));
+    if (m_args.ringSize > 0)
+        Log (LogSeverity::Info, L"Flight recorder mode, dumps are named like " + GetSegmentPath (finalOutputPath, 1));
+    if (m_args.triggerRate > 0)
+        Log (LogSeverity::Info, L"Output is triggered, segments are named like " + GetSegmentPath (finalOutputPath, 1));
+    if (m_args.aggregateMemory > 0)
+        Log (LogSeverity::Info, L"Samples are aggregated, the output is a pprof profile (not an ETL file)");
+    if (!m_args.moduleNames.empty ())
+        Log (LogSeverity::Info, L"Samples are filtered by module, sample counts are written to " + finalOutputPath +
+             L".samples.csv");
     if (finalOutputPath != profilerOutputPath)
         Log (LogSeverity::Info, L"Profiler output file path is " + profilerOutputPath);
 
@@ -409,12 +569,18 @@ bool Application::DoProfile ()
     if (m_args.compressionMode == ApplicationArguments::CompressionMode::ETW)
         options |= IETWBasedProfiler::Compress;
 
+    if (m_args.compressionMode == ApplicationArguments::CompressionMode::XZ)
+        options |= IETWBasedProfiler::CompressXZ;
+
     if (m_args.debug)
         options |= IETWBasedProfiler::Debug;
 
 	if (m_args.stackCache)
 		options |= IETWBasedProfiler::StackCache;
 
+    if (m_args.pipeline)
+        options |= IETWBasedProfiler::Pipeline;
+
     if (m_args.profileChildren)
         options |= IETWBasedProfiler::ProfileChildren;
 
@@ -451,7 +617,13 @@ bool Application::DoProfile ()
                                                 options,
                                                 m_args.waitForChildren ?
                                                     ETWProfiler::FinishCriterion::AllTargetsFinished :
-                                                    ETWProfiler::FinishCriterion::OriginalTargetsFinished));
+                                                    ETWProfiler::FinishCriterion::OriginalTargetsFinished,
+                                                { m_args.rotateSize, m_args.rotateTime },
+                                                { m_args.ringSize, m_args.ringTime },
+                                                { m_args.triggerRate, m_args.triggerStart, m_args.triggerStop },
+                                                { m_args.aggregateMemory },
+                                                { m_args.moduleNames, 100, finalOutputPath + L".samples.csv" },
+                                                { m_args.reorderWindow }));
         } catch (const IProfiler::InitException& e) {
             Log (LogSeverity::Error, L"Unable to construct profiler object: " + e.GetMsg ());
 
@@ -509,6 +681,30 @@ bool Application::DoProfile ()
         suspendedTargetKiller.Deactivate ();
     }
 
+    // In flight recorder mode, dumps are requested when a trigger fires
+    std::unique_ptr<DumpTriggers> dumpTriggers;
+    if (m_args.ringSize > 0) {
+        dumpTriggers = std::make_unique<DumpTriggers> ();
+
+        std::wstring triggerErrorMsg;
+        if (!m_args.dumpEventName.empty () &&
+            !dumpTriggers->EnableNamedEvent (m_args.dumpEventName, &triggerErrorMsg))
+        {
+            m_pProfiler->Abort ();
+
+            Log (LogSeverity::Error, triggerErrorMsg);
+
+            return false;
+        }
+
+        if (m_args.dumpCPUThreshold > 0)
+            dumpTriggers->EnableCPUThreshold (m_args.dumpCPUThreshold, targetProcessInfos);
+
+        // A started target might read the console, it's not robbed of its input
+        if (m_args.targetMode != ApplicationArguments::TargetMode::Start && dumpTriggers->EnableKey ())
+            Log (LogSeverity::Info, L"Flight recorder mode: press D to write the recorded events");
+    }
+
     ProgressFeedback::Style feebackStyle = COut ().GetType () == ConsoleOStream::Type::Console ?
                                            ProgressFeedback::Style::Animated : ProgressFeedback::Style::Static;
     
@@ -536,6 +732,45 @@ bool Application::DoProfile ()
                                feebackStyle,
                                ProgressFeedback::State::Running);
     
+    // Progress is sampled without holding up the profiler, and rates are computed between consecutive samples
+    ProgressLog progressLog;
+    bool writeProgress = !m_args.progressPath.empty ();
+    std::wstring progressErrorMsg;
+    if (writeProgress && !progressLog.Open (m_args.progressPath, &progressErrorMsg)) {
+        Log (LogSeverity::Warning, progressErrorMsg);
+
+        writeProgress = false;
+    }
+
+    // Losses are checked each time the progress is sampled. The sampling rate is global, so setting it takes effect
+    //   right away
+    std::optional<SamplingRateBackoff> rateBackoff;
+    if (m_args.backoff) {
+        ProfileRate currentRate (InvalidProfileRate);
+        if (GetGlobalSamplingRate (&currentRate))
+            rateBackoff.emplace (ConvertSamplingRateToHz (currentRate));
+        else
+            Log (LogSeverity::Warning, L"Unable to query the sampling rate, it will not be lowered on event loss!");
+    }
+
+    ProgressSample previousSample = m_pProfiler->GetProgress ();
+    auto updateProgress = [&] () {
+        // The ETW session is gone once profiling finished, then its losses cannot be queried anymore (they are zero)
+        ProgressSample sample = m_pProfiler->GetProgress ();
+        sample.nEventsLost = std::max (sample.nEventsLost, previousSample.nEventsLost);
+        sample.nBuffersLost = std::max (sample.nBuffersLost, previousSample.nBuffersLost);
+        sample.nRealTimeBuffersLost = std::max (sample.nRealTimeBuffersLost, previousSample.nRealTimeBuffersLost);
+
+        feedback.SetStatusString (FormatProgress (previousSample, sample));
+        if (writeProgress && !progressLog.Write (previousSample, sample)) {
+            Log (LogSeverity::Warning, L"Unable to write progress file: " + m_args.progressPath);
+
+            writeProgress = false;
+        }
+
+        previousSample = sample;
+    };
+
     IProfiler::State state;
     std::wstring profilingErrorMsg;
     while (!m_pProfiler->IsFinished (&state, &profilingErrorMsg)) {
@@ -543,11 +778,32 @@ bool Application::DoProfile ()
         feedback.SetDetailString (getDetailString ());
 
         constexpr DWORD kProgressFrequencyMs = 500;
-        Sleep (kProgressFrequencyMs);
+        if (dumpTriggers != nullptr) {
+            const std::wstring trigger = dumpTriggers->Wait (kProgressFrequencyMs);
+            if (!trigger.empty () && m_pProfiler->RequestDump ())
+                Log (LogSeverity::Info, L"Writing recorded events (" + trigger + L")");
+        } else {
+            Sleep (kProgressFrequencyMs);
+        }
+
+        updateProgress ();
+
+        const uint64_t nLost = previousSample.nEventsLost + previousSample.nBuffersLost +
+                               previousSample.nRealTimeBuffersLost;
+        if (rateBackoff.has_value () && rateBackoff->Update (nLost)) {
+            const uint32_t newRate = static_cast<uint32_t> (rateBackoff->GetRate ());
+            if (SetGlobalSamplingRate (ConvertSamplingRateFromHz (newRate)))
+                Log (LogSeverity::Warning, L"The ETW session is losing events, sampling rate lowered to " +
+                     std::to_wstring (newRate) + L" Hz");
+        }
     }
 
     consoleCtrlHandlerRemover.Trigger ();
 
+    // The last row of the progress file has the final counters. Rates are not displayed on the final line
+    updateProgress ();
+    feedback.SetStatusString (L"");
+
     // Profiling exited; update feedback accordingly
     switch (state) {
         case IProfiler::State::Finished:
@@ -569,6 +825,12 @@ bool Application::DoProfile ()
     feedback.SetDetailString (getDetailString ());
     feedback.PrintProgressLine ();
 
+    if (previousSample.nEventsLost + previousSample.nBuffersLost + previousSample.nRealTimeBuffersLost > 0) {
+        Log (LogSeverity::Warning, L"The ETW session lost " + std::to_wstring (previousSample.nEventsLost) +
+             L" events, " + std::to_wstring (previousSample.nBuffersLost) + L" buffers, and " +
+             std::to_wstring (previousSample.nRealTimeBuffersLost) + L" real-time buffers!");
+    }
+
     if (state == IProfiler::State::Error) {
         Log (LogSeverity::Error, L"Profiling finished with an error: " + profilingErrorMsg);
 
@@ -634,6 +896,16 @@ bool Application::DoProfile ()
         }
     }
 
+    // Statistics of the filter are complete by now, they help tuning what's recorded (e.g. --cswitch, --enable, --rate)
+    const FilterStats filterStats = m_pProfiler->GetFilterStats ();
+    COut () << ColorReset << L"Events seen by the filter, per provider and opcode:" << Endl;
+    for (const std::wstring& line : FormatFilterStats (filterStats, 20))
+        COut () << line << Endl;
+
+    std::wstring statsErrorMsg;
+    if (!m_args.statsPath.empty () && !filterStats.WriteJSON (m_args.statsPath, &statsErrorMsg))
+        Log (LogSeverity::Warning, statsErrorMsg);
+
     if (state == IProfiler::State::Finished)
         Log (LogSeverity::Info, L"Profiling finished because the target process(es) exited!");
     else
@@ -235,6 +235,76 @@ bool ParseLongAssignmentArg (const std::wstring& arg, ApplicationRawArguments* p
         pArgumentsOut->userProviders = true;
         pArgumentsOut->userProvidersValue = GetArgValue (arg);
 
+        return true;
+    } else if (argName == L"rotatesize") {
+        pArgumentsOut->rotateSize = true;
+        pArgumentsOut->rotateSizeValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"rotatetime") {
+        pArgumentsOut->rotateTime = true;
+        pArgumentsOut->rotateTimeValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"ring") {
+        pArgumentsOut->ring = true;
+        pArgumentsOut->ringValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"ringtime") {
+        pArgumentsOut->ringTime = true;
+        pArgumentsOut->ringTimeValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"dumpevent") {
+        pArgumentsOut->dumpEvent = true;
+        pArgumentsOut->dumpEventValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"dumpcpu") {
+        pArgumentsOut->dumpCPU = true;
+        pArgumentsOut->dumpCPUValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"trigger") {
+        pArgumentsOut->trigger = true;
+        pArgumentsOut->triggerValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"trigstart") {
+        pArgumentsOut->triggerStart = true;
+        pArgumentsOut->triggerStartValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"trigstop") {
+        pArgumentsOut->triggerStop = true;
+        pArgumentsOut->triggerStopValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"aggregate") {
+        pArgumentsOut->aggregate = true;
+        pArgumentsOut->aggregateValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"modules") {
+        pArgumentsOut->modules = true;
+        pArgumentsOut->modulesValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"stats") {
+        pArgumentsOut->stats = true;
+        pArgumentsOut->statsValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"progress") {
+        pArgumentsOut->progress = true;
+        pArgumentsOut->progressValue = GetArgValue (arg);
+
+        return true;
+    } else if (argName == L"reorder") {
+        pArgumentsOut->reorder = true;
+        pArgumentsOut->reorderValue = GetArgValue (arg);
+
         return true;
     }
 
@@ -249,7 +319,8 @@ bool ParseLongNonAssignmentArg (const std::wstring& arg, ApplicationRawArguments
     ETWP_ASSERT (!IsAssignmentArg (arg));
 
     std::wstring argName = GetArgName (arg);
-    // --help ; --version; --verbose ; --nologo ; --debug ; --cswitch ; --mdump ; --scache ; --noaction ; --children
+    // --help ; --version; --verbose ; --nologo ; --debug ; --cswitch ; --mdump ; --scache ; --pipeline ; --backoff ;
+    //   --noaction ; --children
     if (argName == L"help") {
         pArgumentsOut->help = true;
 
@@ -282,6 +353,14 @@ bool ParseLongNonAssignmentArg (const std::wstring& arg, ApplicationRawArguments
 		pArgumentsOut->stackCache = true;
 
 		return true;
+	} else if (argName == L"pipeline") {
+        pArgumentsOut->pipeline = true;
+
+        return true;
+    } else if (argName == L"backoff") {
+        pArgumentsOut->backoff = true;
+
+        return true;
 	} else if (argName == L"noaction") {
 		pArgumentsOut->noAction = true;
 
@@ -358,22 +437,15 @@ bool SemaOutputPath (const ApplicationRawArguments& parsedArgs, ApplicationArgum
         // If it does not have an extension, append the appropriate one, if it does, check it
         std::wstring extension = PathGetExtension (pArgumentsOut->output);
         if (extension.empty ()) {
-            pArgumentsOut->output += pArgumentsOut->compressionMode ==
-                ApplicationArguments::CompressionMode::SevenZip ? L".7z" : L".etl";
+            pArgumentsOut->output += GetOutputExtension (*pArgumentsOut);
         } else {
-            if (pArgumentsOut->compressionMode == ApplicationArguments::CompressionMode::SevenZip)
-            {
-                if (_wcsicmp (extension.c_str (), L".7z") != 0) {
-                    LogFailedSema (L"Invalid output path (expected file with .7z extension)!");
+            // Only the last part of the extension is checked (e.g. ".xz" of ".etl.xz")
+            const std::wstring expectedExtension =
+                PathGetExtension (GetOutputExtension (*pArgumentsOut));
+            if (_wcsicmp (extension.c_str (), expectedExtension.c_str ()) != 0) {
+                LogFailedSema (L"Invalid output path (expected file with " + expectedExtension + L" extension)!");
 
-                    return false;
-                }
-            } else {
-                if (_wcsicmp (extension.c_str (), L".etl") != 0) {
-                    LogFailedSema (L"Invalid output path (expected file with .etl extension)!");
-
-                    return false;
-                }
+                return false;
             }
         }
     } else {    // Output is a directory
@@ -504,6 +576,14 @@ bool SemaCompressionMode (const ApplicationRawArguments& parsedArgs, Application
             pArgumentsOut->compressionMode = ApplicationArguments::CompressionMode::Off;
         } else if (parsedArgs.compressionMode == L"etw") {
             pArgumentsOut->compressionMode = ApplicationArguments::CompressionMode::ETW;
+        } else if (parsedArgs.compressionMode == L"xz") {
+#ifdef ETWP_HAVE_LIBLZMA
+            pArgumentsOut->compressionMode = ApplicationArguments::CompressionMode::XZ;
+#else
+            LogFailedSema (L"xz compression is not available (etwprof was built without liblzma)!");
+
+            return false;
+#endif  // #ifdef ETWP_HAVE_LIBLZMA
         } else if (parsedArgs.compressionMode == L"7z") {
             pArgumentsOut->compressionMode = ApplicationArguments::CompressionMode::SevenZip;
         } else {
@@ -518,6 +598,137 @@ bool SemaCompressionMode (const ApplicationRawArguments& parsedArgs, Application
     return true;
 }
 
+// Must run before SemaOutputPath, as the output of aggregation has its own extension
+bool SemaAggregate (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
+{
+    if (!parsedArgs.aggregate)
+        return true;
+
+    if (pArgumentsOut->emulate) {
+        LogFailedSema (L"Aggregation is invalid in emulate mode!");
+
+        return false;
+    }
+
+    // Stacks are only resolved at the end of the session, when stack key definitions are written
+    if (parsedArgs.stackCache) {
+        LogFailedSema (L"Aggregation cannot be used together with ETW stack caching!");
+
+        return false;
+    }
+
+    if (!parsedArgs.compressionMode.empty () && parsedArgs.compressionMode != L"off") {
+        LogFailedSema (L"Aggregation cannot be used together with compression!");
+
+        return false;
+    }
+
+    if (parsedArgs.rotateSize || parsedArgs.rotateTime || parsedArgs.ring || parsedArgs.trigger) {
+        LogFailedSema (L"Aggregation cannot be used together with output rotation, flight recorder mode or trigger "
+                       L"rules!");
+
+        return false;
+    }
+
+    // In megabytes
+    const unsigned long memoryMB = wcstoul (parsedArgs.aggregateValue.c_str (), nullptr, 10);
+    if (memoryMB == 0 || memoryMB > 1'024 * 1'024) {
+        LogFailedSema (L"Invalid aggregation memory size!");
+
+        return false;
+    }
+
+    pArgumentsOut->aggregateMemory = uint64_t (memoryMB) * 1'024 * 1'024;
+    pArgumentsOut->compressionMode = ApplicationArguments::CompressionMode::Off;
+
+    return true;
+}
+
+bool SemaModules (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
+{
+    if (!parsedArgs.modules)
+        return true;
+
+    if (pArgumentsOut->emulate) {
+        LogFailedSema (L"Module filtering is invalid in emulate mode!");
+
+        return false;
+    }
+
+    // With stack caching, stacks are only stack keys, their frames are written at the end of the session
+    if (pArgumentsOut->stackCache) {
+        LogFailedSema (L"Module filtering cannot be used together with ETW stack caching!");
+
+        return false;
+    }
+
+    for (const std::wstring& moduleName : SplitString (parsedArgs.modulesValue, L',')) {
+        if (moduleName.empty () || moduleName.find_first_of (L"\\/") != std::wstring::npos) {
+            LogFailedSema (L"Invalid module name (file names are expected, like \"foo.dll\")!");
+
+            return false;
+        }
+
+        pArgumentsOut->moduleNames.push_back (moduleName);
+    }
+
+    return true;
+}
+
+bool SemaStats (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
+{
+    if (!parsedArgs.stats)
+        return true;
+
+    pArgumentsOut->statsPath = PathExpandEnvVars (parsedArgs.statsValue);
+    if (!PathValid (pArgumentsOut->statsPath)) {
+        LogFailedSema (L"Statistics file path is invalid!");
+
+        return false;
+    }
+
+    return true;
+}
+
+bool SemaProgress (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
+{
+    if (!parsedArgs.progress)
+        return true;
+
+    pArgumentsOut->progressPath = PathExpandEnvVars (parsedArgs.progressValue);
+    if (!PathValid (pArgumentsOut->progressPath)) {
+        LogFailedSema (L"Progress file path is invalid!");
+
+        return false;
+    }
+
+    return true;
+}
+
+bool SemaReorder (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
+{
+    if (!parsedArgs.reorder)
+        return true;
+
+    if (pArgumentsOut->emulate) {
+        LogFailedSema (L"Reorder window is invalid in emulate mode!");
+
+        return false;
+    }
+
+    constexpr unsigned long kMaxWindow = 10'000;   // In milliseconds
+    const unsigned long window = wcstoul (parsedArgs.reorderValue.c_str (), nullptr, 10);
+    if (window == 0 || window > kMaxWindow) {
+        LogFailedSema (L"Invalid reorder window!");
+
+        return false;
+    }
+
+    pArgumentsOut->reorderWindow = static_cast<uint32_t> (window);
+
+    return true;
+}
+
 bool SemaSamplingRate (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
 {
     if (pArgumentsOut->emulate && parsedArgs.samplingRate) {
@@ -845,6 +1056,251 @@ bool SemaStackCache (const ApplicationRawArguments& parsedArgs, ApplicationArgum
     return true;
 }
 
+bool SemaPipeline (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
+{
+    if (!parsedArgs.pipeline)
+        return true;
+
+    if (pArgumentsOut->emulate) {
+        LogFailedSema (L"Pipelined relogging parameter is invalid in emulate mode!");
+
+        return false;
+    }
+
+    return true;
+}
+
+bool SemaBackoff (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
+{
+    if (!parsedArgs.backoff)
+        return true;
+
+    if (pArgumentsOut->emulate) {
+        LogFailedSema (L"Sampling rate backoff is invalid in emulate mode!");
+
+        return false;
+    }
+
+    // Both rely on the sampling rate staying the same (the period of samples, and the sample rate threshold)
+    if (pArgumentsOut->aggregateMemory > 0 || pArgumentsOut->triggerRate > 0) {
+        LogFailedSema (L"Sampling rate backoff cannot be used together with aggregation or trigger rules!");
+
+        return false;
+    }
+
+    pArgumentsOut->backoff = true;
+
+    return true;
+}
+
+bool SemaOutputRotation (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
+{
+    if (!parsedArgs.rotateSize && !parsedArgs.rotateTime)
+        return true;
+
+    if (pArgumentsOut->emulate) {
+        LogFailedSema (L"Output rotation parameters are invalid in emulate mode!");
+
+        return false;
+    }
+
+    // Stack key definitions (rundown) are written at the end of the session, so they would end up in the last segment
+    if (pArgumentsOut->stackCache) {
+        LogFailedSema (L"Output rotation cannot be used together with ETW stack caching!");
+
+        return false;
+    }
+
+    if (pArgumentsOut->compressionMode == ApplicationArguments::CompressionMode::SevenZip) {
+        LogFailedSema (L"Output rotation cannot be used together with 7z compression!");
+
+        return false;
+    }
+
+    if (parsedArgs.rotateSize) {
+        // In megabytes. We can't distinguish between a wcstoul error or a "legit" 0, but 0 is invalid anyways
+        const unsigned long rotateSizeMB = wcstoul (parsedArgs.rotateSizeValue.c_str (), nullptr, 10);
+        if (rotateSizeMB == 0 || rotateSizeMB > 1'024 * 1'024) {
+            LogFailedSema (L"Invalid output rotation size!");
+
+            return false;
+        }
+
+        pArgumentsOut->rotateSize = uint64_t (rotateSizeMB) * 1'024 * 1'024;
+    }
+
+    if (parsedArgs.rotateTime) {
+        // In seconds
+        const unsigned long rotateTime = wcstoul (parsedArgs.rotateTimeValue.c_str (), nullptr, 10);
+        if (rotateTime == 0 || rotateTime > 7 * 24 * 60 * 60) {
+            LogFailedSema (L"Invalid output rotation time!");
+
+            return false;
+        }
+
+        pArgumentsOut->rotateTime = static_cast<uint32_t> (rotateTime);
+    }
+
+    return true;
+}
+
+bool SemaFlightRecorder (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
+{
+    if (!parsedArgs.ring) {
+        if (parsedArgs.ringTime || parsedArgs.dumpEvent || parsedArgs.dumpCPU) {
+            LogFailedSema (L"Flight recorder parameters are only valid in flight recorder mode!");
+
+            return false;
+        }
+
+        return true;
+    }
+
+    if (pArgumentsOut->emulate) {
+        LogFailedSema (L"Flight recorder mode is invalid in emulate mode!");
+
+        return false;
+    }
+
+    // Stack key definitions (rundown) are written at the end of the session, so they would only be in the last dump
+    if (pArgumentsOut->stackCache) {
+        LogFailedSema (L"Flight recorder mode cannot be used together with ETW stack caching!");
+
+        return false;
+    }
+
+    if (pArgumentsOut->compressionMode == ApplicationArguments::CompressionMode::SevenZip) {
+        LogFailedSema (L"Flight recorder mode cannot be used together with 7z compression!");
+
+        return false;
+    }
+
+    if (pArgumentsOut->rotateSize > 0 || pArgumentsOut->rotateTime > 0) {
+        LogFailedSema (L"Flight recorder mode cannot be used together with output rotation!");
+
+        return false;
+    }
+
+    // In megabytes
+    const unsigned long ringSizeMB = wcstoul (parsedArgs.ringValue.c_str (), nullptr, 10);
+    if (ringSizeMB == 0 || ringSizeMB > 1'024 * 1'024) {
+        LogFailedSema (L"Invalid flight recorder memory size!");
+
+        return false;
+    }
+
+    pArgumentsOut->ringSize = uint64_t (ringSizeMB) * 1'024 * 1'024;
+
+    if (parsedArgs.ringTime) {
+        // In seconds
+        const unsigned long ringTime = wcstoul (parsedArgs.ringTimeValue.c_str (), nullptr, 10);
+        if (ringTime == 0 || ringTime > 7 * 24 * 60 * 60) {
+            LogFailedSema (L"Invalid flight recorder time window!");
+
+            return false;
+        }
+
+        pArgumentsOut->ringTime = static_cast<uint32_t> (ringTime);
+    }
+
+    if (parsedArgs.dumpEvent)
+        pArgumentsOut->dumpEventName = parsedArgs.dumpEventValue;
+
+    if (parsedArgs.dumpCPU) {
+        // In percent of one core, so it can be above 100
+        const unsigned long threshold = wcstoul (parsedArgs.dumpCPUValue.c_str (), nullptr, 10);
+        if (threshold == 0 || threshold > 100 * 1'024) {
+            LogFailedSema (L"Invalid CPU usage threshold for dumps!");
+
+            return false;
+        }
+
+        pArgumentsOut->dumpCPUThreshold = static_cast<uint32_t> (threshold);
+    }
+
+    return true;
+}
+
+bool SemaTrigger (const ApplicationRawArguments& parsedArgs, ApplicationArguments* pArgumentsOut)
+{
+    if (!parsedArgs.trigger) {
+        if (parsedArgs.triggerStart || parsedArgs.triggerStop) {
+            LogFailedSema (L"Trigger delay parameters are only valid with a trigger rule!");
+
+            return false;
+        }
+
+        return true;
+    }
+
+    if (pArgumentsOut->emulate) {
+        LogFailedSema (L"Trigger rules are invalid in emulate mode!");
+
+        return false;
+    }
+
+    // Stack key definitions (rundown) are written at the end of the session, so they would end up in the last segment
+    if (pArgumentsOut->stackCache) {
+        LogFailedSema (L"Trigger rules cannot be used together with ETW stack caching!");
+
+        return false;
+    }
+
+    if (pArgumentsOut->compressionMode == ApplicationArguments::CompressionMode::SevenZip) {
+        LogFailedSema (L"Trigger rules cannot be used together with 7z compression!");
+
+        return false;
+    }
+
+    if (pArgumentsOut->rotateSize > 0 || pArgumentsOut->rotateTime > 0) {
+        LogFailedSema (L"Trigger rules cannot be used together with output rotation!");
+
+        return false;
+    }
+
+    if (pArgumentsOut->ringSize > 0) {
+        LogFailedSema (L"Trigger rules cannot be used in flight recorder mode!");
+
+        return false;
+    }
+
+    // In samples per second (of one target process)
+    const unsigned long rate = wcstoul (parsedArgs.triggerValue.c_str (), nullptr, 10);
+    if (rate == 0 || rate > 1'000'000) {
+        LogFailedSema (L"Invalid trigger sample rate!");
+
+        return false;
+    }
+
+    pArgumentsOut->triggerRate = static_cast<uint32_t> (rate);
+
+    // In milliseconds
+    constexpr unsigned long kMaxDelay = 24 * 60 * 60 * 1'000;
+    if (parsedArgs.triggerStart) {
+        const unsigned long startDelay = wcstoul (parsedArgs.triggerStartValue.c_str (), nullptr, 10);
+        if (startDelay == 0 || startDelay > kMaxDelay) {
+            LogFailedSema (L"Invalid trigger start delay!");
+
+            return false;
+        }
+
+        pArgumentsOut->triggerStart = static_cast<uint32_t> (startDelay);
+    }
+
+    if (parsedArgs.triggerStop) {
+        const unsigned long stopDelay = wcstoul (parsedArgs.triggerStopValue.c_str (), nullptr, 10);
+        if (stopDelay == 0 || stopDelay > kMaxDelay) {
+            LogFailedSema (L"Invalid trigger stop delay!");
+
+            return false;
+        }
+
+        pArgumentsOut->triggerStop = static_cast<uint32_t> (stopDelay);
+    }
+
+    return true;
+}
+
 bool UnpackRespFiles (const std::vector<std::wstring>& arguments, std::vector<std::wstring>* pArgumentsOut)
 {
     std::vector<std::wstring> result = arguments;
@@ -1016,6 +1472,7 @@ bool SemaArguments (const ApplicationRawArguments& parsedArgs, ApplicationArgume
     pArgumentsOut->cswitch = parsedArgs.cswitch;
     pArgumentsOut->minidump = parsedArgs.minidump;
     pArgumentsOut->stackCache = parsedArgs.stackCache;
+    pArgumentsOut->pipeline = parsedArgs.pipeline;
     pArgumentsOut->noAction = parsedArgs.noAction;
 
     // We could check here if both --debug and --verbose was provided, but I don't think we need to be that nitpicky
@@ -1036,6 +1493,9 @@ bool SemaArguments (const ApplicationRawArguments& parsedArgs, ApplicationArgume
         if (!SemaCompressionMode (parsedArgs, pArgumentsOut))
             return false;
 
+        if (!SemaAggregate (parsedArgs, pArgumentsOut))
+            return false;
+
         if (!SemaOutputPath (parsedArgs, pArgumentsOut))
             return false;
 
@@ -1053,6 +1513,33 @@ bool SemaArguments (const ApplicationRawArguments& parsedArgs, ApplicationArgume
 
 		if (!SemaStackCache (parsedArgs, pArgumentsOut))
 			return false;
+
+        if (!SemaPipeline (parsedArgs, pArgumentsOut))
+            return false;
+
+        if (!SemaOutputRotation (parsedArgs, pArgumentsOut))
+            return false;
+
+        if (!SemaFlightRecorder (parsedArgs, pArgumentsOut))
+            return false;
+
+        if (!SemaTrigger (parsedArgs, pArgumentsOut))
+            return false;
+
+        if (!SemaModules (parsedArgs, pArgumentsOut))
+            return false;
+
+        if (!SemaStats (parsedArgs, pArgumentsOut))
+            return false;
+
+        if (!SemaProgress (parsedArgs, pArgumentsOut))
+            return false;
+
+        if (!SemaBackoff (parsedArgs, pArgumentsOut))
+            return false;
+
+        if (!SemaReorder (parsedArgs, pArgumentsOut))
+            return false;
     } else {    // Not profiling
         if (parsedArgs.target) {
             LogFailedSema (L"Target parameter is only valid for profiling!");
@@ -1125,9 +1612,84 @@ bool SemaArguments (const ApplicationRawArguments& parsedArgs, ApplicationArgume
 
 			return false;
 		}
+
+        if (parsedArgs.pipeline) {
+            LogFailedSema (L"Pipelined relogging parameter is only valid for profiling!");
+
+            return false;
+        }
+
+        if (parsedArgs.backoff) {
+            LogFailedSema (L"Sampling rate backoff parameter is only valid for profiling!");
+
+            return false;
+        }
+
+        if (parsedArgs.rotateSize || parsedArgs.rotateTime) {
+            LogFailedSema (L"Output rotation parameters are only valid for profiling!");
+
+            return false;
+        }
+
+        if (parsedArgs.ring || parsedArgs.ringTime || parsedArgs.dumpEvent || parsedArgs.dumpCPU) {
+            LogFailedSema (L"Flight recorder parameters are only valid for profiling!");
+
+            return false;
+        }
+
+        if (parsedArgs.trigger || parsedArgs.triggerStart || parsedArgs.triggerStop) {
+            LogFailedSema (L"Trigger rule parameters are only valid for profiling!");
+
+            return false;
+        }
+
+        if (parsedArgs.aggregate) {
+            LogFailedSema (L"Aggregation parameter is only valid for profiling!");
+
+            return false;
+        }
+
+        if (parsedArgs.modules) {
+            LogFailedSema (L"Module filter parameter is only valid for profiling!");
+
+            return false;
+        }
+
+        if (parsedArgs.stats) {
+            LogFailedSema (L"Statistics parameter is only valid for profiling!");
+
+            return false;
+        }
+
+        if (parsedArgs.progress) {
+            LogFailedSema (L"Progress parameter is only valid for profiling!");
+
+            return false;
+        }
+
+        if (parsedArgs.reorder) {
+            LogFailedSema (L"Reorder window parameter is only valid for profiling!");
+
+            return false;
+        }
     }
 
     return true;
 }
 
+std::wstring GetOutputExtension (const ApplicationArguments& arguments)
+{
+    if (arguments.aggregateMemory > 0)
+        return L".pb";
+
+    switch (arguments.compressionMode) {
+        case ApplicationArguments::CompressionMode::XZ:
+            return L".etl.xz";
+        case ApplicationArguments::CompressionMode::SevenZip:
+            return L".7z";
+        default:
+            return L".etl";
+    }
+}
+
 }   // namespace ETWP
\ No newline at end of file
@@ -28,6 +28,22 @@ struct ApplicationRawArguments {
     bool minidumpFlags = false;
     bool userProviders = false;
     bool stackCache = false;
+    bool pipeline = false;
+    bool backoff = false;
+    bool rotateSize = false;
+    bool rotateTime = false;
+    bool ring = false;
+    bool ringTime = false;
+    bool dumpEvent = false;
+    bool dumpCPU = false;
+    bool trigger = false;
+    bool triggerStart = false;
+    bool triggerStop = false;
+    bool aggregate = false;
+    bool modules = false;
+    bool stats = false;
+    bool progress = false;
+    bool reorder = false;
     bool startCommandLine = false;
     bool noAction = false;
 
@@ -38,6 +54,20 @@ struct ApplicationRawArguments {
     std::wstring compressionMode;
     std::wstring minidumpFlagsValue;
     std::wstring userProvidersValue;
+    std::wstring rotateSizeValue;
+    std::wstring rotateTimeValue;
+    std::wstring ringValue;
+    std::wstring ringTimeValue;
+    std::wstring dumpEventValue;
+    std::wstring dumpCPUValue;
+    std::wstring triggerValue;
+    std::wstring triggerStartValue;
+    std::wstring triggerStopValue;
+    std::wstring aggregateValue;
+    std::wstring modulesValue;
+    std::wstring statsValue;
+    std::wstring progressValue;
+    std::wstring reorderValue;
     std::wstring startCommandLineValue;
 };
 
@@ -46,7 +76,8 @@ struct ApplicationArguments {
         Invalid,
         Off,
         ETW,
-        SevenZip
+        XZ,         // Built-in (see XZFileWriter)
+        SevenZip    // Using 7zr.exe (deprecated, XZ is faster)
     };
 
     enum class TargetMode {
@@ -85,6 +116,8 @@ struct ApplicationArguments {
     bool cswitch = false;
     bool minidump = false;
     bool stackCache = false;
+    bool pipeline = false;
+    bool backoff = false;   // Lower the sampling rate when the ETW session loses events
     bool noAction = false;
 
     DWORD                         targetPID;
@@ -95,6 +128,20 @@ struct ApplicationArguments {
     CompressionMode               compressionMode = CompressionMode::Invalid;
     uint32_t                      minidumpFlags;
     std::vector<UserProviderInfo> userProviderInfos;
+    uint64_t                      rotateSize = 0;     // In bytes, 0 means no size-based rotation
+    uint32_t                      rotateTime = 0;     // In seconds, 0 means no time-based rotation
+    uint64_t                      ringSize = 0;       // In bytes, 0 means no flight recorder mode
+    uint32_t                      ringTime = 0;       // In seconds, 0 means the window is limited by ringSize only
+    std::wstring                  dumpEventName;      // Empty if there is no named event to trigger dumps
+    uint32_t                      dumpCPUThreshold = 0;   // In percent (of one core), 0 means no CPU trigger
+    uint32_t                      triggerRate = 0;    // In samples/s, 0 means the output is written continuously
+    uint32_t                      triggerStart = 0;   // In milliseconds
+    uint32_t                      triggerStop = 1'000;    // In milliseconds
+    uint64_t                      aggregateMemory = 0;    // In bytes, 0 means events are written (not aggregated)
+    std::vector<std::wstring>     moduleNames;        // Empty means samples are not filtered by module
+    std::wstring                  statsPath;          // Empty means filter statistics are not written into a file
+    std::wstring                  progressPath;       // Empty means progress is not written into a file
+    uint32_t                      reorderWindow = 0;  // In milliseconds, 0 means events of unknown threads are dropped
     TargetMode                    targetMode = TargetMode::None;
     std::wstring                  processToStartCommandLine;
 };
@@ -105,6 +152,9 @@ bool ParseArguments (const std::vector<std::wstring>& arguments,
 bool SemaArguments (const ApplicationRawArguments& parsedArgs,
                     ApplicationArguments* pArgumentsOut);
 
+// Returns the extension of the final output file (e.g. ".etl")
+std::wstring GetOutputExtension (const ApplicationArguments& arguments);
+
 }   // namespace ETWP
 
 #endif  // #ifndef ETWP_ARGUMENTS_HPP
\ No newline at end of file
@@ -11,6 +11,7 @@ ProgressFeedback::ProgressFeedback (const std::wstring& process,
                                     State initialState /*= State::Idle*/):
     m_operation (process),
     m_detail (detail),
+    m_status (),
     m_animated (style == Style::Animated),
     m_state (initialState),
     m_currentStatePrinted (false),
@@ -63,6 +64,9 @@ void ProgressFeedback::PrintProgress ()
 
     COut () << FgColorCyan << L" ]" << ColorReset;
 
+    if (m_animated && !m_status.empty ())
+        COut () << L" " << FgColorGray << m_status << ColorReset;
+
     if (!m_animated)
         COut () << Endl;
 
@@ -99,4 +103,11 @@ void ProgressFeedback::SetDetailString (const std::wstring& detail)
     m_currentStatePrinted = false;
 }
 
+void ProgressFeedback::SetStatusString (const std::wstring& status)
+{
+    m_status = status;
+
+    m_currentStatePrinted = false;
+}
+
 }   // namespace ETWP
\ No newline at end of file
@@ -36,10 +36,13 @@ public:
 
     void SetOperationString (const std::wstring& operation);
     void SetDetailString (const std::wstring& detail);
+    // Displayed after the state, in animated style only (e.g. rates, which would flood a redirected output)
+    void SetStatusString (const std::wstring& status);
 
 private:
     std::wstring m_operation;
     std::wstring m_detail;
+    std::wstring m_status;
 
     bool m_animated;
 
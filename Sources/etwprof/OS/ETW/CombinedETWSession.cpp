@@ -7,10 +7,13 @@
 
 namespace ETWP {
 
-CombinedETWSession::CombinedETWSession (const std::wstring& name, ULONG kernelFlags):
+CombinedETWSession::CombinedETWSession (const std::wstring& name,
+                                        ULONG kernelFlags,
+                                        const SessionBufferConfig& bufferConfig /*= {}*/):
     m_handle (NULL),
     m_properties (nullptr),
     m_flags (kernelFlags),
+    m_bufferConfig (bufferConfig),
     m_name (name),
     m_started (false)
 {
@@ -38,6 +41,7 @@ bool CombinedETWSession::Start ()
     m_started = StartRealTimeETWSession (m_name,
                                          EVENT_TRACE_REAL_TIME_MODE | EVENT_TRACE_SYSTEM_LOGGER_MODE,
                                          m_flags,
+                                         m_bufferConfig,
                                          &m_handle,
                                          &m_properties);
 
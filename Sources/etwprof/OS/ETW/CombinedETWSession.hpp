@@ -5,6 +5,7 @@
 #include <string>
 
 #include "ETWSessionInterfaces.hpp"
+#include "SessionSizing.hpp"
 
 namespace ETWP {
 
@@ -13,7 +14,7 @@ class CombinedETWSession : public IUserETWSession,
 public:
     ETWP_DISABLE_COPY_AND_MOVE (CombinedETWSession);
 
-    CombinedETWSession (const std::wstring& name, ULONG kernelFlags);
+    CombinedETWSession (const std::wstring& name, ULONG kernelFlags, const SessionBufferConfig& bufferConfig = {});
 
     virtual ~CombinedETWSession () override;
 
@@ -38,6 +39,7 @@ protected:
     TRACEHANDLE                             m_handle;
     std::unique_ptr<EVENT_TRACE_PROPERTIES> m_properties;
     ULONG                                   m_flags;
+    SessionBufferConfig                     m_bufferConfig;
 
     std::wstring m_name;
     
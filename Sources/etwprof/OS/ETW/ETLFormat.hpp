@@ -0,0 +1,282 @@
+#ifndef ETWP_ETL_FORMAT_HPP
+#define ETWP_ETL_FORMAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ETWConstants.hpp"
+
+#include "OS/Utility/OSTypes.hpp"
+
+namespace ETWP {
+namespace ETLFormat {
+
+// On-disk structures of ETL files (aka. the "WMI buffer format"), as written by ETW in file mode. Only 64-bit traces
+//   are supported. An ETL file is a sequence of fixed size buffers. Each buffer holds events logged on one processor,
+//   in chronological order. The first buffer starts with a special event that describes the whole trace (see
+//   TraceLogfileHeader).
+// These mirror (undocumented) Windows structures (e.g. WMI_BUFFER_HEADER, SYSTEM_TRACE_HEADER), but are defined here
+//   for all platforms, so ETL files can be written and read anywhere
+
+constexpr size_t   kEventAlignment = 8;     // Of events inside buffers
+constexpr uint32_t kDefaultBufferSize = 64 * 1'024;
+
+struct BufferHeader {
+    ULONG     m_bufferSize;
+    ULONG     m_savedOffset;        // Number of bytes used (including this header)
+    ULONG     m_currentOffset;
+    int32_t   m_referenceCount;
+    int64_t   m_timeStamp;
+    int64_t   m_sequenceNumber;
+    ULONGLONG m_clockTypeAndFrequency;
+    // ETW_BUFFER_CONTEXT
+    UCHAR     m_processorNumber;
+    UCHAR     m_alignment;
+    USHORT    m_loggerID;
+    // End of ETW_BUFFER_CONTEXT
+    ULONG     m_state;
+    ULONG     m_offset;
+    USHORT    m_bufferFlag;
+    USHORT    m_bufferType;
+    GUID      m_instanceGUID;
+};
+
+static_assert (sizeof (BufferHeader) == 72);
+
+// BufferHeader::m_bufferType values
+constexpr USHORT kBufferTypeGeneric = 0;
+constexpr USHORT kBufferTypeRundown = 1;
+constexpr USHORT kBufferTypeHeader = 4;
+
+// BufferHeader::m_bufferFlag values (only the ones etwprof cares about)
+constexpr USHORT kBufferFlagCompressed = 0x0040;
+
+// Each event starts with a 32-bit "marker". Bit 31 is always set. Bits 16..23 tell the type of the header
+constexpr ULONG kHeaderMarkerFlags = 0xC0000000;   // TRACE_HEADER_FLAG | TRACE_HEADER_EVENT_TRACE
+
+enum class HeaderType : UCHAR {
+    System32       = 1,
+    System64       = 2,
+    Compact32      = 3,
+    Compact64      = 4,
+    FullHeader32   = 10,
+    Instance32     = 11,
+    Timed          = 12,
+    Error          = 13,
+    WNodeHeader    = 14,
+    Message        = 15,
+    PerfInfo32     = 16,
+    PerfInfo64     = 17,
+    EventHeader32  = 18,
+    EventHeader64  = 19,
+    FullHeader64   = 20,
+    Instance64     = 21
+};
+
+constexpr ULONG MakeMarker (HeaderType type, USHORT low16Bits)
+{
+    return kHeaderMarkerFlags | (ULONG (type) << 16) | low16Bits;
+}
+
+constexpr HeaderType GetHeaderType (ULONG marker)
+{
+    return HeaderType ((marker >> 16) & 0xFF);
+}
+
+// Header of kernel (NT Kernel Logger) events. The provider is identified by a "group" in HookId, not a GUID
+struct SystemTraceHeader {
+    ULONG   m_marker;       // Low 16 bits: version of the event
+    USHORT  m_size;         // Of the whole event, including this header
+    USHORT  m_hookID;       // Group (high byte) | opcode (low byte)
+    ULONG   m_threadID;
+    ULONG   m_processID;
+    int64_t m_systemTime;
+    ULONG   m_kernelTime;
+    ULONG   m_userTime;
+};
+
+static_assert (sizeof (SystemTraceHeader) == 32);
+
+// Same as SystemTraceHeader, without the CPU times
+struct CompactTraceHeader {
+    ULONG   m_marker;
+    USHORT  m_size;
+    USHORT  m_hookID;
+    ULONG   m_threadID;
+    ULONG   m_processID;
+    int64_t m_systemTime;
+};
+
+static_assert (sizeof (CompactTraceHeader) == 24);
+
+// Used by high frequency kernel events (e.g. some PerfInfo events). Has no thread or process ID
+struct PerfInfoTraceHeader {
+    ULONG   m_marker;
+    USHORT  m_size;
+    USHORT  m_hookID;
+    int64_t m_systemTime;
+};
+
+static_assert (sizeof (PerfInfoTraceHeader) == 16);
+
+// Header of classic (MOF) events, identified by a GUID (EVENT_TRACE_HEADER)
+struct FullTraceHeader {
+    USHORT    m_size;
+    UCHAR     m_headerType;
+    UCHAR     m_markerFlags;
+    UCHAR     m_type;           // Opcode
+    UCHAR     m_level;
+    USHORT    m_version;
+    ULONG     m_threadID;
+    ULONG     m_processID;
+    int64_t   m_timeStamp;
+    GUID      m_guid;
+    ULONGLONG m_processorTime;  // Kernel and user time
+};
+
+static_assert (sizeof (FullTraceHeader) == 48);
+
+// Manifest-based and TraceLogging events are stored with an EVENT_HEADER (see EventHeaderLayout), where m_size is the
+//   size of the whole event, and m_headerType is (kHeaderMarkerFlags >> 16) | HeaderType::EventHeader64. If
+//   EVENT_HEADER_FLAG_EXTENDED_INFO is set in m_flags, extended data items follow the header (see
+//   ExtendedItemHeader), before the payload
+constexpr USHORT kEventHeaderType = USHORT (kHeaderMarkerFlags >> 16) | USHORT (HeaderType::EventHeader64);
+
+constexpr USHORT kEventHeaderFlagExtendedInfo = 0x0001;
+constexpr USHORT kEventHeaderFlag64BitHeader = 0x0020;
+constexpr USHORT kEventHeaderFlagClassicHeader = 0x0100;
+
+// On-disk header of an extended data item: EVENT_HEADER_EXTENDED_DATA_ITEM without the data pointer. The data
+//   follows it, and the item (including this header) is padded to 8 bytes. m_linkage is 1 if another item follows
+struct ExtendedItemHeader {
+    USHORT m_reserved1;
+    USHORT m_extType;
+    USHORT m_linkage;
+    USHORT m_dataSize;
+};
+
+static_assert (sizeof (ExtendedItemHeader) == 8);
+
+// Extended data types (EVENT_HEADER_EXT_TYPE_*)
+constexpr USHORT kExtTypeRelatedActivityID = 1;
+constexpr USHORT kExtTypeSID = 2;
+constexpr USHORT kExtTypeTSID = 3;
+constexpr USHORT kExtTypeInstanceInfo = 4;
+constexpr USHORT kExtTypeStackTrace32 = 5;
+constexpr USHORT kExtTypeStackTrace64 = 6;
+constexpr USHORT kExtTypePEBSIndex = 7;
+constexpr USHORT kExtTypePMCCounters = 8;
+constexpr USHORT kExtTypePSMKey = 9;
+constexpr USHORT kExtTypeEventKey = 10;
+constexpr USHORT kExtTypeEventSchemaTL = 11;
+constexpr USHORT kExtTypeProvTraits = 12;
+constexpr USHORT kExtTypeProcessStartKey = 13;
+constexpr USHORT kExtTypeControlGUID = 14;
+constexpr USHORT kExtTypeQPCDelta = 15;
+constexpr USHORT kExtTypeContainerID = 16;
+constexpr USHORT kExtTypeStackKey32 = 18;
+constexpr USHORT kExtTypeStackKey64 = 19;
+
+// Payload of the first event of the first buffer (TRACE_LOGFILE_HEADER, as laid out for 64-bit pointers). The logger
+//   and log file names follow it, as null-terminated UTF-16 strings
+struct TraceLogfileHeader {
+    ULONG   m_bufferSize;
+    UCHAR   m_majorVersion;
+    UCHAR   m_minorVersion;
+    UCHAR   m_subVersion;
+    UCHAR   m_subMinorVersion;
+    ULONG   m_providerVersion;      // Build number of the OS
+    ULONG   m_numberOfProcessors;
+    int64_t m_endTime;              // FILETIME
+    ULONG   m_timerResolution;      // In 100 ns units
+    ULONG   m_maximumFileSize;
+    ULONG   m_logFileMode;
+    ULONG   m_buffersWritten;
+    ULONG   m_startBuffers;
+    ULONG   m_pointerSize;
+    ULONG   m_eventsLost;
+    ULONG   m_cpuSpeedInMHz;
+    uint64_t m_loggerName;          // Pointers, meaningless on disk
+    uint64_t m_logFileName;
+    uint8_t m_timeZone[176];        // TIME_ZONE_INFORMATION (172 bytes, plus padding)
+    int64_t m_bootTime;             // FILETIME
+    int64_t m_perfFreq;             // Of the QPC clock
+    int64_t m_startTime;            // FILETIME
+    ULONG   m_reservedFlags;        // Clock type (1: QPC)
+    ULONG   m_buffersLost;
+};
+
+static_assert (sizeof (TraceLogfileHeader) == 280);
+static_assert (offsetof (TraceLogfileHeader, m_bootTime) == 248);
+
+constexpr ULONG kLogFileModeSequential = 0x00000001;   // EVENT_TRACE_FILE_MODE_SEQUENTIAL
+constexpr ULONG kClockTypeQPC = 1;
+
+constexpr USHORT kLogfileHeaderVersion = 2;
+
+// Groups of kernel providers (high byte of SystemTraceHeader::m_hookID, EVENT_TRACE_GROUP_*)
+constexpr USHORT kGroupHeader = 0x0000;
+constexpr USHORT kGroupIO = 0x0100;
+constexpr USHORT kGroupMemory = 0x0200;
+constexpr USHORT kGroupProcess = 0x0300;
+constexpr USHORT kGroupFile = 0x0400;
+constexpr USHORT kGroupThread = 0x0500;
+constexpr USHORT kGroupTcpIp = 0x0600;
+constexpr USHORT kGroupUdpIp = 0x0800;
+constexpr USHORT kGroupRegistry = 0x0900;
+constexpr USHORT kGroupPerfInfo = 0x0F00;
+constexpr USHORT kGroupImage = 0x1400;
+constexpr USHORT kGroupStackWalk = 0x1800;
+constexpr USHORT kGroupALPC = 0x1A00;
+constexpr USHORT kGroupSplitIO = 0x1B00;
+constexpr USHORT kInvalidGroup = 0xFFFF;
+
+struct KernelGroup {
+    USHORT      group;
+    const GUID* pProviderID;
+};
+
+// The providers etwprof keeps events of come first, as they are looked up the most often
+inline constexpr KernelGroup kKernelGroups[] = {
+    { kGroupPerfInfo,  &PerfInfoGuid },
+    { kGroupStackWalk, &StackWalkGuid },
+    { kGroupThread,    &ThreadGuid },
+    { kGroupProcess,   &ProcessGuid },
+    { kGroupImage,     &ImageLoadGuid },
+    { kGroupHeader,    &EventTraceEventGuid },
+    { kGroupIO,        &DiskIoGuid },
+    { kGroupMemory,    &PageFaultGuid },
+    { kGroupFile,      &FileIoGuid },
+    { kGroupTcpIp,     &TcpIpGuid },
+    { kGroupUdpIp,     &UdpIpGuid },
+    { kGroupRegistry,  &RegistryGuid },
+    { kGroupALPC,      &ALPCGuid },
+    { kGroupSplitIO,   &SplitIoGuid }
+};
+
+// Returns kInvalidGroup for providers that are not kernel providers (or not known by etwprof)
+inline USHORT GetKernelGroup (const GUID& providerID)
+{
+    for (const KernelGroup& kernelGroup : kKernelGroups) {
+        if (*kernelGroup.pProviderID == providerID)
+            return kernelGroup.group;
+    }
+
+    return kInvalidGroup;
+}
+
+// Returns nullptr for unknown groups
+inline const GUID* GetKernelProviderID (USHORT group)
+{
+    for (const KernelGroup& kernelGroup : kKernelGroups) {
+        if (kernelGroup.group == group)
+            return kernelGroup.pProviderID;
+    }
+
+    return nullptr;
+}
+
+}   // namespace ETLFormat
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_ETL_FORMAT_HPP
\ No newline at end of file
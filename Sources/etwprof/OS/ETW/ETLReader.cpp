@@ -0,0 +1,445 @@
+#include "ETLReader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ETWP {
+
+namespace {
+
+constexpr ULONG kFillerMarker = 0xFFFFFFFF;   // Unused space at the end of buffers is filled with 0xFF
+constexpr ULONG kNoID = 0xFFFFFFFF;           // Thread and process ID of events with a PerfInfo header
+constexpr USHORT kClassicFlags = ETLFormat::kEventHeaderFlagClassicHeader | ETLFormat::kEventHeaderFlag64BitHeader;
+
+constexpr uint64_t AlignSize (uint64_t size)
+{
+    return (size + ETLFormat::kEventAlignment - 1) & ~uint64_t (ETLFormat::kEventAlignment - 1);
+}
+
+template<typename T>
+T Read (const std::byte* pData)
+{
+    T result;
+    std::memcpy (&result, pData, sizeof result);
+
+    return result;
+}
+
+bool HasSizeAfterMarker (ETLFormat::HeaderType type)
+{
+    switch (type) {
+        case ETLFormat::HeaderType::System32:
+        case ETLFormat::HeaderType::System64:
+        case ETLFormat::HeaderType::Compact32:
+        case ETLFormat::HeaderType::Compact64:
+        case ETLFormat::HeaderType::PerfInfo32:
+        case ETLFormat::HeaderType::PerfInfo64:
+            return true;
+        default:
+            return false;
+    }
+}
+
+}   // namespace
+
+ETLEventIterator::ETLEventIterator (const std::byte* pBuffer, uint32_t begin, uint32_t end):
+    m_pBuffer (pBuffer),
+    m_offset (begin),
+    m_nextOffset (begin),
+    m_end (end),
+    m_record (),
+    m_extendedItems ()
+{
+    m_record.m_pExtendedData = m_extendedItems;
+    if (m_offset >= m_end)
+        return;
+
+    const ETLFormat::BufferHeader bufferHeader = Read<ETLFormat::BufferHeader> (m_pBuffer);
+    m_record.m_processorNumber = bufferHeader.m_processorNumber;
+    m_record.m_loggerID = bufferHeader.m_loggerID;
+
+    DecodeNext ();
+}
+
+ETLEventIterator::ETLEventIterator (const ETLEventIterator& other):
+    m_pBuffer (other.m_pBuffer),
+    m_offset (other.m_offset),
+    m_nextOffset (other.m_nextOffset),
+    m_end (other.m_end),
+    m_record (other.m_record),
+    m_extendedItems ()
+{
+    std::memcpy (m_extendedItems, other.m_extendedItems, sizeof m_extendedItems);
+    m_record.m_pExtendedData = m_extendedItems;
+}
+
+ETLEventIterator& ETLEventIterator::operator= (const ETLEventIterator& other)
+{
+    m_pBuffer = other.m_pBuffer;
+    m_offset = other.m_offset;
+    m_nextOffset = other.m_nextOffset;
+    m_end = other.m_end;
+    m_record = other.m_record;
+    std::memcpy (m_extendedItems, other.m_extendedItems, sizeof m_extendedItems);
+    m_record.m_pExtendedData = m_extendedItems;
+
+    return *this;
+}
+
+EventView ETLEventIterator::operator* () const
+{
+    return EventView (m_record);
+}
+
+ETLEventIterator& ETLEventIterator::operator++ ()
+{
+    m_offset = m_nextOffset;
+    DecodeNext ();
+
+    return *this;
+}
+
+bool ETLEventIterator::operator== (const ETLEventIterator& rhs) const
+{
+    return m_pBuffer == rhs.m_pBuffer && m_offset == rhs.m_offset;
+}
+
+bool ETLEventIterator::operator!= (const ETLEventIterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+void ETLEventIterator::DecodeNext ()
+{
+    while (m_end - m_offset >= sizeof (ULONG)) {
+        const ULONG marker = Read<ULONG> (m_pBuffer + m_offset);
+        if (marker == kFillerMarker || (marker & ETLFormat::kHeaderMarkerFlags) == 0)
+            break;
+
+        const ETLFormat::HeaderType type = ETLFormat::GetHeaderType (marker);
+        uint32_t size;
+        if (HasSizeAfterMarker (type)) {
+            if (m_end - m_offset < sizeof (ULONG) + sizeof (USHORT))
+                break;
+
+            size = Read<USHORT> (m_pBuffer + m_offset + sizeof (ULONG));
+        } else {
+            size = marker & 0xFFFF;
+        }
+
+        if (size < sizeof (ULONG) || size > m_end - m_offset)
+            break;
+
+        m_nextOffset = static_cast<uint32_t> (std::min<uint64_t> (m_offset + AlignSize (size), m_end));
+
+        bool skip = false;
+        if (!Decode (size, &skip))
+            break;
+
+        if (!skip)
+            return;
+
+        m_offset = m_nextOffset;
+    }
+
+    // End of the buffer (or a malformed event)
+    m_offset = m_end;
+    m_nextOffset = m_end;
+}
+
+bool ETLEventIterator::Decode (uint32_t size, bool* pSkipOut)
+{
+    const ETLFormat::HeaderType type = ETLFormat::GetHeaderType (Read<ULONG> (m_pBuffer + m_offset));
+
+    m_record.m_header = {};
+    m_record.m_extendedDataCount = 0;
+
+    switch (type) {
+        case ETLFormat::HeaderType::System64:
+        case ETLFormat::HeaderType::Compact64:
+        case ETLFormat::HeaderType::PerfInfo64:
+            return DecodeSystemHeader (type, size);
+        case ETLFormat::HeaderType::FullHeader64:
+            return DecodeFullHeader (size);
+        case ETLFormat::HeaderType::EventHeader64:
+            return DecodeEventHeader (size);
+        default:
+            *pSkipOut = true;
+
+            return true;
+    }
+}
+
+bool ETLEventIterator::DecodeSystemHeader (ETLFormat::HeaderType type, uint32_t size)
+{
+    const std::byte* pEvent = m_pBuffer + m_offset;
+    EventHeaderLayout& header = m_record.m_header;
+
+    ULONG marker;
+    USHORT hookID;
+    uint32_t headerSize;
+    if (type == ETLFormat::HeaderType::PerfInfo64) {
+        if (size < sizeof (ETLFormat::PerfInfoTraceHeader))
+            return false;
+
+        const ETLFormat::PerfInfoTraceHeader perfInfoHeader = Read<ETLFormat::PerfInfoTraceHeader> (pEvent);
+        marker = perfInfoHeader.m_marker;
+        hookID = perfInfoHeader.m_hookID;
+        header.m_threadID = kNoID;
+        header.m_processID = kNoID;
+        header.m_timeStamp = perfInfoHeader.m_systemTime;
+        headerSize = sizeof perfInfoHeader;
+    } else if (type == ETLFormat::HeaderType::Compact64) {
+        if (size < sizeof (ETLFormat::CompactTraceHeader))
+            return false;
+
+        const ETLFormat::CompactTraceHeader compactHeader = Read<ETLFormat::CompactTraceHeader> (pEvent);
+        marker = compactHeader.m_marker;
+        hookID = compactHeader.m_hookID;
+        header.m_threadID = compactHeader.m_threadID;
+        header.m_processID = compactHeader.m_processID;
+        header.m_timeStamp = compactHeader.m_systemTime;
+        headerSize = sizeof compactHeader;
+    } else {
+        if (size < sizeof (ETLFormat::SystemTraceHeader))
+            return false;
+
+        const ETLFormat::SystemTraceHeader systemHeader = Read<ETLFormat::SystemTraceHeader> (pEvent);
+        marker = systemHeader.m_marker;
+        hookID = systemHeader.m_hookID;
+        header.m_threadID = systemHeader.m_threadID;
+        header.m_processID = systemHeader.m_processID;
+        header.m_timeStamp = systemHeader.m_systemTime;
+        header.m_processorTime = systemHeader.m_kernelTime | ULONGLONG (systemHeader.m_userTime) << 32;
+        headerSize = sizeof systemHeader;
+    }
+
+    // Kernel providers are identified by their group. Events of unknown groups get an empty provider ID, and their
+    //   hook ID as event ID, so they can be told apart
+    if (const GUID* pProviderID = ETLFormat::GetKernelProviderID (hookID & 0xFF00); pProviderID != nullptr)
+        header.m_providerID = *pProviderID;
+    else
+        header.m_id = hookID;
+
+    header.m_size = sizeof (EventHeaderLayout);
+    header.m_flags = kClassicFlags;
+    header.m_version = static_cast<UCHAR> (marker);
+    header.m_opcode = static_cast<UCHAR> (hookID);
+
+    m_record.m_userDataLength = static_cast<USHORT> (size - headerSize);
+    m_record.m_pUserData = pEvent + headerSize;
+
+    return true;
+}
+
+bool ETLEventIterator::DecodeFullHeader (uint32_t size)
+{
+    if (size < sizeof (ETLFormat::FullTraceHeader))
+        return false;
+
+    const std::byte* pEvent = m_pBuffer + m_offset;
+    const ETLFormat::FullTraceHeader fullHeader = Read<ETLFormat::FullTraceHeader> (pEvent);
+
+    EventHeaderLayout& header = m_record.m_header;
+    header.m_size = sizeof (EventHeaderLayout);
+    header.m_flags = kClassicFlags;
+    header.m_threadID = fullHeader.m_threadID;
+    header.m_processID = fullHeader.m_processID;
+    header.m_timeStamp = fullHeader.m_timeStamp;
+    header.m_providerID = fullHeader.m_guid;
+    header.m_version = static_cast<UCHAR> (fullHeader.m_version);
+    header.m_level = fullHeader.m_level;
+    header.m_opcode = fullHeader.m_type;
+    header.m_processorTime = fullHeader.m_processorTime;
+
+    m_record.m_userDataLength = static_cast<USHORT> (size - sizeof fullHeader);
+    m_record.m_pUserData = pEvent + sizeof fullHeader;
+
+    return true;
+}
+
+bool ETLEventIterator::DecodeEventHeader (uint32_t size)
+{
+    if (size < sizeof (EventHeaderLayout))
+        return false;
+
+    const std::byte* pEvent = m_pBuffer + m_offset;
+    m_record.m_header = Read<EventHeaderLayout> (pEvent);
+
+    // Extended data items are between the header and the payload, each one is aligned to 8 bytes
+    uint32_t payloadOffset = sizeof (EventHeaderLayout);
+    if (m_record.m_header.m_flags & ETLFormat::kEventHeaderFlagExtendedInfo) {
+        for (;;) {
+            if (size - payloadOffset < sizeof (ETLFormat::ExtendedItemHeader))
+                return false;
+
+            const ETLFormat::ExtendedItemHeader itemHeader =
+                Read<ETLFormat::ExtendedItemHeader> (pEvent + payloadOffset);
+            const uint64_t itemEnd = AlignSize (payloadOffset + sizeof itemHeader + itemHeader.m_dataSize);
+            if (itemEnd > size)
+                return false;
+
+            if (m_record.m_extendedDataCount < kMaxExtendedItems) {
+                EventExtendedItemLayout& item = m_extendedItems[m_record.m_extendedDataCount++];
+                item.m_reserved1 = itemHeader.m_reserved1;
+                item.m_extType = itemHeader.m_extType;
+                item.m_linkageAndReserved2 = itemHeader.m_linkage;
+                item.m_dataSize = itemHeader.m_dataSize;
+                item.m_dataPtr = reinterpret_cast<uintptr_t> (pEvent + payloadOffset + sizeof itemHeader);
+            }
+
+            payloadOffset = static_cast<uint32_t> (itemEnd);
+            if ((itemHeader.m_linkage & 1) == 0)
+                break;
+        }
+    }
+
+    m_record.m_userDataLength = static_cast<USHORT> (size - payloadOffset);
+    m_record.m_pUserData = pEvent + payloadOffset;
+
+    return true;
+}
+
+ETLBufferView::ETLBufferView (const std::byte* pBuffer, uint32_t size): m_pBuffer (pBuffer), m_size (size), m_used (size)
+{
+    // The used part of the buffer is not always recorded in the same field, the rest of it is filled with 0xFF anyway
+    const ETLFormat::BufferHeader header = GetHeader ();
+    if (header.m_savedOffset >= sizeof header && header.m_savedOffset <= size)
+        m_used = header.m_savedOffset;
+    else if (header.m_currentOffset >= sizeof header && header.m_currentOffset <= size)
+        m_used = header.m_currentOffset;
+}
+
+ETLFormat::BufferHeader ETLBufferView::GetHeader () const
+{
+    return Read<ETLFormat::BufferHeader> (m_pBuffer);
+}
+
+UCHAR ETLBufferView::GetProcessorNumber () const
+{
+    return GetHeader ().m_processorNumber;
+}
+
+uint32_t ETLBufferView::GetSize () const
+{
+    return m_size;
+}
+
+bool ETLBufferView::IsCompressed () const
+{
+    return (GetHeader ().m_bufferFlag & ETLFormat::kBufferFlagCompressed) != 0;
+}
+
+ETLEventIterator ETLBufferView::begin () const
+{
+    if (IsCompressed ())
+        return end ();
+
+    return ETLEventIterator (m_pBuffer, sizeof (ETLFormat::BufferHeader), m_used);
+}
+
+ETLEventIterator ETLBufferView::end () const
+{
+    return ETLEventIterator (m_pBuffer, m_used, m_used);
+}
+
+ETLReader::InitException::InitException (const std::wstring& msg): Exception (msg)
+{
+}
+
+ETLReader::ETLReader (const std::filesystem::path& path, MappedFile::AccessPattern accessPattern):
+    m_file (),
+    m_logfileHeader (),
+    m_loggerName (),
+    m_bufferOffsets ()
+{
+    try {
+        m_file = std::make_unique<MappedFile> (path, accessPattern);
+    } catch (const MappedFile::InitException& e) {
+        throw InitException (e.GetMsg ());
+    }
+
+    ReadLogfileHeader (path);
+    IndexBuffers ();
+}
+
+const ETLFormat::TraceLogfileHeader& ETLReader::GetLogfileHeader () const
+{
+    return m_logfileHeader;
+}
+
+const std::wstring& ETLReader::GetLoggerName () const
+{
+    return m_loggerName;
+}
+
+uint64_t ETLReader::GetFileSize () const
+{
+    return m_file->GetSize ();
+}
+
+size_t ETLReader::GetNumberOfBuffers () const
+{
+    return m_bufferOffsets.size ();
+}
+
+ETLBufferView ETLReader::GetBuffer (size_t index) const
+{
+    const std::byte* pBuffer = m_file->GetData () + m_bufferOffsets[index];
+
+    return ETLBufferView (pBuffer, Read<ULONG> (pBuffer));
+}
+
+void ETLReader::ReadLogfileHeader (const std::filesystem::path& path)
+{
+    // The first event of the first buffer describes the whole trace
+    constexpr size_t kHeaderEventOffset = sizeof (ETLFormat::BufferHeader);
+    constexpr size_t kLogfileHeaderOffset = kHeaderEventOffset + sizeof (ETLFormat::SystemTraceHeader);
+
+    const std::byte* pData = m_file->GetData ();
+    if (m_file->GetSize () < kLogfileHeaderOffset + sizeof (ETLFormat::TraceLogfileHeader))
+        throw InitException (L"Not an ETL file (or it is truncated): " + path.wstring ());
+
+    const ETLFormat::SystemTraceHeader eventHeader = Read<ETLFormat::SystemTraceHeader> (pData + kHeaderEventOffset);
+    const ETLFormat::HeaderType type = ETLFormat::GetHeaderType (eventHeader.m_marker);
+    if (type == ETLFormat::HeaderType::System32)
+        throw InitException (L"Only 64-bit traces are supported: " + path.wstring ());
+
+    if (type != ETLFormat::HeaderType::System64 ||
+        eventHeader.m_hookID != ETLFormat::kGroupHeader ||
+        eventHeader.m_size < sizeof eventHeader + sizeof m_logfileHeader ||
+        kHeaderEventOffset + eventHeader.m_size > m_file->GetSize ())
+    {
+        throw InitException (L"Not an ETL file (no logfile header found): " + path.wstring ());
+    }
+
+    m_logfileHeader = Read<ETLFormat::TraceLogfileHeader> (pData + kLogfileHeaderOffset);
+    if (m_logfileHeader.m_pointerSize != 8)
+        throw InitException (L"Only 64-bit traces are supported: " + path.wstring ());
+
+    // The logger name follows, as a null-terminated UTF-16 string
+    const std::byte* pName = pData + kLogfileHeaderOffset + sizeof m_logfileHeader;
+    const std::byte* pEventEnd = pData + kHeaderEventOffset + eventHeader.m_size;
+    for (; pEventEnd - pName >= 2; pName += sizeof (char16_t)) {
+        const char16_t character = Read<char16_t> (pName);
+        if (character == u'\0')
+            break;
+
+        m_loggerName.push_back (static_cast<wchar_t> (character));
+    }
+}
+
+void ETLReader::IndexBuffers ()
+{
+    const uint64_t fileSize = m_file->GetSize ();
+    for (uint64_t offset = 0; fileSize - offset >= sizeof (ETLFormat::BufferHeader);) {
+        const ULONG bufferSize = Read<ULONG> (m_file->GetData () + offset);
+        if (bufferSize < sizeof (ETLFormat::BufferHeader) || bufferSize > fileSize - offset)
+            break;  // Truncated (or preallocated, but unused) part of the file
+
+        m_bufferOffsets.push_back (offset);
+        offset += bufferSize;
+    }
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,128 @@
+#ifndef ETWP_ETL_READER_HPP
+#define ETWP_ETL_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ETLFormat.hpp"
+#include "EventView.hpp"
+
+#include "OS/FileSystem/MappedFile.hpp"
+
+#include "Utility/Exception.hpp"
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Iterates over the events of one ETL buffer, without copying them: events are decoded into an EVENT_RECORD-like
+//   structure (so they can be handled the same way as events of a live session), whose payload and extended data
+//   pointers point into the buffer itself. Consequently, an EventView obtained from the iterator is only valid until
+//   the iterator is advanced (or destroyed).
+// Kernel events (system, compact and PerfInfo headers), classic events (full header) and manifest-based events
+//   (event header, including extended data items) are decoded. Other kinds of events are skipped. A malformed event
+//   ends the iteration of its buffer
+class ETLEventIterator final {
+public:
+    static constexpr size_t kMaxExtendedItems = 16;     // Further items of an event are ignored
+
+    ETLEventIterator (const std::byte* pBuffer, uint32_t begin, uint32_t end);
+    ETLEventIterator (const ETLEventIterator& other);
+
+    ETLEventIterator& operator= (const ETLEventIterator& other);
+
+    EventView         operator* () const;
+    ETLEventIterator& operator++ ();
+
+    bool operator== (const ETLEventIterator& rhs) const;
+    bool operator!= (const ETLEventIterator& rhs) const;
+
+private:
+    const std::byte*        m_pBuffer;
+    uint32_t                m_offset;       // Of the current event
+    uint32_t                m_nextOffset;
+    uint32_t                m_end;
+    EventRecordLayout       m_record;
+    EventExtendedItemLayout m_extendedItems[kMaxExtendedItems];
+
+    void DecodeNext ();     // Decodes the event at m_offset (or the first decodable one after it)
+    bool Decode (uint32_t size, bool* pSkipOut);
+    bool DecodeSystemHeader (ETLFormat::HeaderType type, uint32_t size);
+    bool DecodeFullHeader (uint32_t size);
+    bool DecodeEventHeader (uint32_t size);
+};
+
+// Read-only view of one buffer of an ETL file
+class ETLBufferView final {
+public:
+    ETLBufferView (const std::byte* pBuffer, uint32_t size);
+
+    ETLFormat::BufferHeader GetHeader () const;
+    UCHAR                   GetProcessorNumber () const;
+    uint32_t                GetSize () const;
+    bool                    IsCompressed () const;
+
+    // Compressed buffers are not supported: there are no events to iterate over in them
+    ETLEventIterator begin () const;
+    ETLEventIterator end () const;
+
+private:
+    const std::byte* m_pBuffer;
+    uint32_t         m_size;
+    uint32_t         m_used;
+};
+
+// Reads ETL files (see ETLFormat.hpp), e.g. the ones written by ETW or by ETLWriter, on any platform. The file is
+//   memory mapped, and nothing is copied from it: buffers are indexed when the file is opened, and events are decoded
+//   on the fly, as they are iterated over (see ETLEventIterator). Only 64-bit traces are supported.
+// Buffers are in file order, so events are chronological per processor, but not globally. A truncated last buffer
+//   (e.g. of an aborted trace) is ignored
+class ETLReader final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ETLReader);
+
+    class InitException : public Exception {
+    public:
+        InitException (const std::wstring& msg);
+    };
+
+    // Might throw InitException
+    explicit ETLReader (const std::filesystem::path& path,
+                        MappedFile::AccessPattern accessPattern = MappedFile::AccessPattern::Sequential);
+
+    const ETLFormat::TraceLogfileHeader& GetLogfileHeader () const;
+    const std::wstring&                  GetLoggerName () const;
+    uint64_t                             GetFileSize () const;
+
+    size_t        GetNumberOfBuffers () const;
+    ETLBufferView GetBuffer (size_t index) const;
+
+    // Calls callback with each event (as an EventView) of the file, buffer by buffer
+    template<typename Callback>
+    void ForEachEvent (Callback&& callback) const;
+
+private:
+    std::unique_ptr<MappedFile>   m_file;
+    ETLFormat::TraceLogfileHeader m_logfileHeader;
+    std::wstring                  m_loggerName;
+    std::vector<uint64_t>         m_bufferOffsets;
+
+    void ReadLogfileHeader (const std::filesystem::path& path);
+    void IndexBuffers ();
+};
+
+template<typename Callback>
+void ETLReader::ForEachEvent (Callback&& callback) const
+{
+    for (size_t i = 0; i < m_bufferOffsets.size (); ++i) {
+        for (const EventView& event : GetBuffer (i))
+            callback (event);
+    }
+}
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_ETL_READER_HPP
\ No newline at end of file
@@ -0,0 +1,535 @@
+#include "ETLWriter.hpp"
+
+#include <cstring>
+#include <new>
+
+#include "ETWConstants.hpp"
+#include "ExtendedData.hpp"
+
+#include "OS/Utility/Time.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+namespace {
+
+constexpr size_t kBlockAlignment = 4'096;   // So unbuffered writes are possible
+constexpr USHORT kStackWalkEventVersion = 2;
+
+constexpr size_t AlignSize (size_t size)
+{
+    return (size + ETLFormat::kEventAlignment - 1) & ~(ETLFormat::kEventAlignment - 1);
+}
+
+USHORT MakeHookID (USHORT group, UCHAR opcode)
+{
+    return group | opcode;
+}
+
+}   // namespace
+
+ETLWriter::InitException::InitException (const std::wstring& msg): Exception (msg)
+{
+}
+
+void ETLWriter::AlignedBlockDeleter::operator() (std::byte* pBlock) const
+{
+    ::operator delete[] (pBlock, std::align_val_t (kBlockAlignment));
+}
+
+ETLWriter::ETLWriter (const std::filesystem::path& outputPath, const ETLWriterConfig& config):
+    m_config (config),
+    m_file (),
+    m_cpuBuffers (),
+    m_headerBuffer (),
+    m_lastTimeStamp (config.startTimeStamp),
+    m_nextSequenceNumber (0),
+    m_closed (false),
+    m_stats (),
+    m_xzWriter (),
+    m_lastProviderID (),
+    m_lastGroup (ETLFormat::kInvalidGroup),
+    m_blocks (),
+    m_blockSize (0),
+    m_fillingBlock (0),
+    m_fillingBlockUsed (0),
+    m_ioLock (),
+    m_ioCondition (),
+    m_pPendingBlock (nullptr),
+    m_pendingBlockSize (0),
+    m_stopIOThread (false),
+    m_ioError (),
+    m_ioThread ()
+{
+    if (m_config.bufferSize < 4 * 1'024 || m_config.bufferSize % kBlockAlignment != 0)
+        throw InitException (L"Invalid ETL buffer size (it must be a multiple of 4 KiB)!");
+
+    if (m_config.perfFreq <= 0)
+        throw InitException (L"Invalid QPC frequency!");
+
+    m_blockSize = m_config.blockSize < m_config.bufferSize ?
+        m_config.bufferSize :
+        m_config.blockSize - m_config.blockSize % m_config.bufferSize;
+
+    for (Block& block : m_blocks)
+        block.reset (new (std::align_val_t (kBlockAlignment)) std::byte[m_blockSize]);
+
+    if (m_config.compress) {
+#ifdef ETWP_HAVE_LIBLZMA
+        // The header buffer is finalized on Close, it's passed to the compressor then
+        m_config.compression.prefixSize = m_config.bufferSize;
+        try {
+            m_xzWriter = std::make_unique<XZFileWriter> (outputPath, m_config.compression);
+        } catch (const XZFileWriter::InitException& e) {
+            throw InitException (L"Unable to create compressed output ETL file: " + e.GetMsg ());
+        }
+#else
+        throw InitException (L"Compressed output is not supported (etwprof was built without liblzma)!");
+#endif  // #ifdef ETWP_HAVE_LIBLZMA
+    } else {
+        // Our blocks are written as they are, there is no need for another layer of buffering
+        m_file.rdbuf ()->pubsetbuf (nullptr, 0);
+        m_file.open (outputPath, std::ios::binary | std::ios::trunc);
+        if (!m_file)
+            throw InitException (L"Unable to open output ETL file: " + outputPath.wstring ());
+    }
+
+    m_cpuBuffers.resize (256);  // Processor numbers are UCHARs
+
+    InitializeHeaderBuffer ();
+    if (m_xzWriter == nullptr) {
+        std::memcpy (m_blocks[m_fillingBlock].get (), m_headerBuffer.data (), m_headerBuffer.size ());
+        m_fillingBlockUsed = m_headerBuffer.size ();
+    }
+
+    ++m_stats.nBuffersWritten;
+
+    m_ioThread = std::thread (&ETLWriter::IOThreadMain, this);
+}
+
+ETLWriter::~ETLWriter ()
+{
+    std::wstring dummy;
+    Close (&dummy);
+}
+
+bool ETLWriter::WriteEvent (const EventView& event)
+{
+    ETWP_ASSERT (!m_closed);
+
+    const EventRecordLayout& record = event.GetRecord ();
+    const EventHeaderLayout& header = record.m_header;
+
+    // We write our own logfile header. The incoming one marks the start of the trace, though (if it's not known yet)
+    if (header.m_providerID == EventTraceEventGuid && header.m_opcode == 0) {
+        if (m_config.startTimeStamp == 0)
+            m_config.startTimeStamp = header.m_timeStamp;
+
+        return true;
+    }
+
+    const USHORT payloadSize = event.GetUserDataLength ();
+    const bool classic = (header.m_flags & ETLFormat::kEventHeaderFlagClassicHeader) != 0;
+    const USHORT group = classic ? GetKernelGroup (header.m_providerID) : ETLFormat::kInvalidGroup;
+
+    size_t headerSize;
+    if (group != ETLFormat::kInvalidGroup)
+        headerSize = sizeof (ETLFormat::SystemTraceHeader);
+    else if (classic)
+        headerSize = sizeof (ETLFormat::FullTraceHeader);
+    else
+        headerSize = sizeof (EventHeaderLayout);
+
+    const size_t eventSize = headerSize + payloadSize;
+    std::byte* pEvent = eventSize <= UINT16_MAX ? Reserve (record.m_processorNumber, eventSize) : nullptr;
+    if (pEvent == nullptr) {
+        ++m_stats.nEventsLost;
+
+        return false;
+    }
+
+    if (group != ETLFormat::kInvalidGroup) {
+        const ETLFormat::SystemTraceHeader systemHeader = {
+            ETLFormat::MakeMarker (ETLFormat::HeaderType::System64, header.m_version),
+            static_cast<USHORT> (eventSize),
+            MakeHookID (group, header.m_opcode),
+            header.m_threadID,
+            header.m_processID,
+            header.m_timeStamp,
+            static_cast<ULONG> (header.m_processorTime),
+            static_cast<ULONG> (header.m_processorTime >> 32)
+        };
+        std::memcpy (pEvent, &systemHeader, sizeof systemHeader);
+    } else if (classic) {
+        const ETLFormat::FullTraceHeader fullHeader = {
+            static_cast<USHORT> (eventSize),
+            UCHAR (ETLFormat::HeaderType::FullHeader64),
+            UCHAR (ETLFormat::kHeaderMarkerFlags >> 24),
+            header.m_opcode,
+            header.m_level,
+            header.m_version,
+            header.m_threadID,
+            header.m_processID,
+            header.m_timeStamp,
+            header.m_providerID,
+            header.m_processorTime
+        };
+        std::memcpy (pEvent, &fullHeader, sizeof fullHeader);
+    } else {
+        EventHeaderLayout eventHeader = header;
+        eventHeader.m_size = static_cast<USHORT> (eventSize);
+        eventHeader.m_headerType = ETLFormat::kEventHeaderType;
+        eventHeader.m_flags &= ~ETLFormat::kEventHeaderFlagExtendedInfo;   // See below
+        std::memcpy (pEvent, &eventHeader, sizeof eventHeader);
+    }
+
+    if (payloadSize > 0)
+        std::memcpy (pEvent + headerSize, event.GetUserData (), payloadSize);
+
+    ++m_stats.nEventsWritten;
+    if (header.m_timeStamp > m_lastTimeStamp)
+        m_lastTimeStamp = header.m_timeStamp;
+
+    for (USHORT i = 0; i < event.GetExtendedDataCount (); ++i) {
+        const EventExtendedItemLayout& item = event.GetExtendedData ()[i];
+        if (item.m_extType == ETLFormat::kExtTypeStackTrace64 || item.m_extType == ETLFormat::kExtTypeStackTrace32)
+            WriteStackWalkEvent (event, item);
+        else
+            ++m_stats.nExtendedItemsDropped;
+    }
+
+    return true;
+}
+
+bool ETLWriter::Close (std::wstring* pErrorOut)
+{
+    if (m_closed)
+        return true;
+
+    m_closed = true;
+
+    for (size_t i = 0; i < m_cpuBuffers.size (); ++i) {
+        CPUBuffer& buffer = m_cpuBuffers[i];
+        if (buffer.memory != nullptr && buffer.used > sizeof (ETLFormat::BufferHeader))
+            FlushCPUBuffer (static_cast<UCHAR> (i), &buffer);
+    }
+
+    if (m_fillingBlockUsed > 0)
+        SubmitFillingBlock ();
+
+    {
+        std::unique_lock<std::mutex> lock (m_ioLock);
+        m_stopIOThread = true;
+    }
+
+    m_ioCondition.notify_all ();
+    m_ioThread.join ();
+
+    if (!m_ioError.empty ()) {
+        *pErrorOut = m_ioError;
+
+        return false;
+    }
+
+    // Now that we know everything about the trace, the logfile header can be finalized
+    FinalizeHeaderBuffer ();
+    if (m_xzWriter != nullptr) {
+        if (!m_xzWriter->Finish (m_headerBuffer.data (), pErrorOut))
+            return false;
+
+        m_stats.nCompressedBytesWritten = m_xzWriter->GetCompressedSize ();
+
+        return true;
+    }
+
+    m_file.seekp (0);
+    m_file.write (reinterpret_cast<const char*> (m_headerBuffer.data ()), m_headerBuffer.size ());
+    m_file.close ();
+    if (!m_file) {
+        *pErrorOut = L"Unable to finalize ETL file!";
+
+        return false;
+    }
+
+    return true;
+}
+
+ETLWriter::Stats ETLWriter::GetStats () const
+{
+    return m_stats;
+}
+
+void ETLWriter::InitializeHeaderBuffer ()
+{
+    m_headerBuffer.assign (m_config.bufferSize, std::byte (0xFF));
+
+    const std::wstring& loggerName = m_config.loggerName;
+    const size_t namesSize = (loggerName.size () + 1) * sizeof (char16_t) + sizeof (char16_t);   // Log file name is empty
+    const size_t eventSize = sizeof (ETLFormat::SystemTraceHeader) + sizeof (ETLFormat::TraceLogfileHeader) + namesSize;
+
+    const ETLFormat::SystemTraceHeader systemHeader = {
+        ETLFormat::MakeMarker (ETLFormat::HeaderType::System64, ETLFormat::kLogfileHeaderVersion),
+        static_cast<USHORT> (eventSize),
+        MakeHookID (ETLFormat::kGroupHeader, 0),
+        0,
+        0,
+        m_config.startTimeStamp,
+        0,
+        0
+    };
+
+    std::byte* pEvent = m_headerBuffer.data () + sizeof (ETLFormat::BufferHeader);
+    std::memcpy (pEvent, &systemHeader, sizeof systemHeader);
+
+    // Names are written as UTF-16 (wchar_t is 32 bits wide on some platforms)
+    std::byte* pNames = pEvent + sizeof systemHeader + sizeof (ETLFormat::TraceLogfileHeader);
+    for (size_t i = 0; i <= loggerName.size (); ++i) {
+        const char16_t character = i < loggerName.size () ? static_cast<char16_t> (loggerName[i]) : u'\0';
+        std::memcpy (pNames + i * sizeof character, &character, sizeof character);
+    }
+
+    std::memset (pNames + (loggerName.size () + 1) * sizeof (char16_t), 0, sizeof (char16_t));
+
+    FinalizeHeaderBuffer ();
+}
+
+void ETLWriter::FinalizeHeaderBuffer ()
+{
+    ETLFormat::TraceLogfileHeader logfileHeader = {};
+    logfileHeader.m_bufferSize = m_config.bufferSize;
+    logfileHeader.m_majorVersion = m_config.majorVersion;
+    logfileHeader.m_minorVersion = m_config.minorVersion;
+    logfileHeader.m_providerVersion = m_config.providerVersion;
+    logfileHeader.m_numberOfProcessors = m_config.numberOfProcessors;
+    logfileHeader.m_endTime = ConvertToSystemTime (m_lastTimeStamp);
+    logfileHeader.m_timerResolution = m_config.timerResolution;
+    logfileHeader.m_logFileMode = ETLFormat::kLogFileModeSequential;
+    logfileHeader.m_buffersWritten = static_cast<ULONG> (m_stats.nBuffersWritten);
+    logfileHeader.m_startBuffers = 1;
+    logfileHeader.m_pointerSize = 8;
+    logfileHeader.m_eventsLost = static_cast<ULONG> (m_stats.nEventsLost);
+    logfileHeader.m_cpuSpeedInMHz = m_config.cpuSpeedInMHz;
+    logfileHeader.m_bootTime = m_config.bootTime;
+    logfileHeader.m_perfFreq = m_config.perfFreq;
+    logfileHeader.m_startTime = m_config.startSystemTime;
+    logfileHeader.m_reservedFlags = ETLFormat::kClockTypeQPC;
+
+    std::byte* pEvent = m_headerBuffer.data () + sizeof (ETLFormat::BufferHeader);
+    std::memcpy (pEvent + sizeof (ETLFormat::SystemTraceHeader), &logfileHeader, sizeof logfileHeader);
+
+    ETLFormat::SystemTraceHeader systemHeader;
+    std::memcpy (&systemHeader, pEvent, sizeof systemHeader);
+    systemHeader.m_systemTime = m_config.startTimeStamp;
+    std::memcpy (pEvent, &systemHeader, sizeof systemHeader);
+    const ULONG used = static_cast<ULONG> (sizeof (ETLFormat::BufferHeader) + AlignSize (systemHeader.m_size));
+
+    ETLFormat::BufferHeader bufferHeader = {};
+    bufferHeader.m_bufferSize = m_config.bufferSize;
+    bufferHeader.m_savedOffset = used;
+    bufferHeader.m_currentOffset = used;
+    bufferHeader.m_timeStamp = m_config.startTimeStamp;
+    bufferHeader.m_sequenceNumber = 0;
+    bufferHeader.m_offset = used;
+    bufferHeader.m_bufferType = ETLFormat::kBufferTypeHeader;
+    std::memcpy (m_headerBuffer.data (), &bufferHeader, sizeof bufferHeader);
+
+    // Sequence number 0 is taken by this buffer
+    if (m_nextSequenceNumber == 0)
+        m_nextSequenceNumber = 1;
+}
+
+ETLWriter::CPUBuffer* ETLWriter::GetCPUBuffer (UCHAR processorNumber)
+{
+    CPUBuffer& buffer = m_cpuBuffers[processorNumber];
+    if (buffer.memory == nullptr) {
+        buffer.memory.reset (new std::byte[m_config.bufferSize]);
+        buffer.used = sizeof (ETLFormat::BufferHeader);
+    }
+
+    return &buffer;
+}
+
+std::byte* ETLWriter::Reserve (UCHAR processorNumber, size_t size)
+{
+    const size_t alignedSize = AlignSize (size);
+    if (sizeof (ETLFormat::BufferHeader) + alignedSize > m_config.bufferSize)
+        return nullptr;
+
+    CPUBuffer* pBuffer = GetCPUBuffer (processorNumber);
+    if (pBuffer->used + alignedSize > m_config.bufferSize)
+        FlushCPUBuffer (processorNumber, pBuffer);
+
+    std::byte* pEvent = pBuffer->memory.get () + pBuffer->used;
+    // Padding is zeroed, so no uninitialized memory is written to the disk
+    std::memset (pEvent + size, 0, alignedSize - size);
+    pBuffer->used += static_cast<uint32_t> (alignedSize);
+
+    return pEvent;
+}
+
+void ETLWriter::FlushCPUBuffer (UCHAR processorNumber, CPUBuffer* pBuffer)
+{
+    std::byte* pMemory = pBuffer->memory.get ();
+
+    // The timestamp of a buffer is the timestamp of its last event
+    int64_t lastTimeStamp = 0;
+    for (uint32_t offset = sizeof (ETLFormat::BufferHeader); offset < pBuffer->used;) {
+        ULONG marker;
+        std::memcpy (&marker, pMemory + offset, sizeof marker);
+
+        int64_t timeStamp;
+        USHORT size;
+        if (ETLFormat::GetHeaderType (marker) == ETLFormat::HeaderType::System64) {
+            ETLFormat::SystemTraceHeader header;
+            std::memcpy (&header, pMemory + offset, sizeof header);
+            timeStamp = header.m_systemTime;
+            size = header.m_size;
+        } else {    // FullTraceHeader and EventHeaderLayout start the same way
+            ETLFormat::FullTraceHeader header;
+            std::memcpy (&header, pMemory + offset, sizeof header);
+            timeStamp = header.m_timeStamp;
+            size = header.m_size;
+        }
+
+        lastTimeStamp = timeStamp;
+        offset += static_cast<uint32_t> (AlignSize (size));
+    }
+
+    ETLFormat::BufferHeader bufferHeader = {};
+    bufferHeader.m_bufferSize = m_config.bufferSize;
+    bufferHeader.m_savedOffset = pBuffer->used;
+    bufferHeader.m_currentOffset = pBuffer->used;
+    bufferHeader.m_timeStamp = lastTimeStamp;
+    bufferHeader.m_sequenceNumber = m_nextSequenceNumber++;
+    bufferHeader.m_processorNumber = processorNumber;
+    bufferHeader.m_offset = pBuffer->used;
+    bufferHeader.m_bufferType = ETLFormat::kBufferTypeGeneric;
+    std::memcpy (pMemory, &bufferHeader, sizeof bufferHeader);
+    std::memset (pMemory + pBuffer->used, 0xFF, m_config.bufferSize - pBuffer->used);
+
+    if (m_fillingBlockUsed + m_config.bufferSize > m_blockSize)
+        SubmitFillingBlock ();
+
+    std::memcpy (m_blocks[m_fillingBlock].get () + m_fillingBlockUsed, pMemory, m_config.bufferSize);
+    m_fillingBlockUsed += m_config.bufferSize;
+    ++m_stats.nBuffersWritten;
+    m_stats.nBytesWritten += m_config.bufferSize;
+
+    pBuffer->used = sizeof (ETLFormat::BufferHeader);
+}
+
+bool ETLWriter::WriteStackWalkEvent (const EventView& event, const EventExtendedItemLayout& item)
+{
+    const EventHeaderLayout& header = event.GetRecord ().m_header;
+
+    StackTraceView stack = {};
+    if (!GetStackTrace (item, &stack))
+        stack.nFrames = 0;
+
+    const ETWConstants::StackWalkDataStub stackWalkData = {
+        static_cast<UINT64> (header.m_timeStamp),
+        header.m_processID,
+        header.m_threadID
+    };
+
+    const size_t eventSize =
+        sizeof (ETLFormat::SystemTraceHeader) + sizeof stackWalkData + stack.nFrames * sizeof (uint64_t);
+    std::byte* pEvent = eventSize <= UINT16_MAX ? Reserve (event.GetProcessorNumber (), eventSize) : nullptr;
+    if (pEvent == nullptr) {
+        ++m_stats.nEventsLost;
+
+        return false;
+    }
+
+    const ETLFormat::SystemTraceHeader systemHeader = {
+        ETLFormat::MakeMarker (ETLFormat::HeaderType::System64, kStackWalkEventVersion),
+        static_cast<USHORT> (eventSize),
+        MakeHookID (ETLFormat::kGroupStackWalk, ETWConstants::StackWalkOpcode),
+        header.m_threadID,
+        header.m_processID,
+        header.m_timeStamp,
+        0,
+        0
+    };
+
+    std::memcpy (pEvent, &systemHeader, sizeof systemHeader);
+    std::memcpy (pEvent + sizeof systemHeader, &stackWalkData, sizeof stackWalkData);
+
+    std::byte* pFrames = pEvent + sizeof systemHeader + sizeof stackWalkData;
+    for (size_t i = 0; i < stack.nFrames; ++i) {
+        const uint64_t address = stack.GetAddress (i);
+        std::memcpy (pFrames + i * sizeof address, &address, sizeof address);
+    }
+
+    ++m_stats.nEventsWritten;
+
+    return true;
+}
+
+void ETLWriter::SubmitFillingBlock ()
+{
+    WaitForPendingBlock ();
+
+    {
+        std::unique_lock<std::mutex> lock (m_ioLock);
+        m_pPendingBlock = m_blocks[m_fillingBlock].get ();
+        m_pendingBlockSize = m_fillingBlockUsed;
+    }
+
+    m_ioCondition.notify_all ();
+
+    m_fillingBlock = 1 - m_fillingBlock;
+    m_fillingBlockUsed = 0;
+}
+
+void ETLWriter::WaitForPendingBlock ()
+{
+    std::unique_lock<std::mutex> lock (m_ioLock);
+    m_ioCondition.wait (lock, [this] () { return m_pPendingBlock == nullptr; });
+}
+
+void ETLWriter::IOThreadMain ()
+{
+    std::unique_lock<std::mutex> lock (m_ioLock);
+    for (;;) {
+        m_ioCondition.wait (lock, [this] () { return m_pPendingBlock != nullptr || m_stopIOThread; });
+        if (m_pPendingBlock == nullptr)
+            return;     // Stopping, and everything is written
+
+        const std::byte* pBlock = m_pPendingBlock;
+        const size_t blockSize = m_pendingBlockSize;
+
+        lock.unlock ();
+        std::wstring errorMsg;
+        bool success;
+        if (m_xzWriter != nullptr)
+            success = m_xzWriter->Write (pBlock, blockSize, &errorMsg);
+        else
+            success = bool (m_file.write (reinterpret_cast<const char*> (pBlock), blockSize));
+        lock.lock ();
+
+        if (!success && m_ioError.empty ())
+            m_ioError = errorMsg.empty () ? L"Unable to write ETL file!" : errorMsg;
+
+        m_pPendingBlock = nullptr;
+        m_ioCondition.notify_all ();
+    }
+}
+
+USHORT ETLWriter::GetKernelGroup (const GUID& providerID)
+{
+    if (!(providerID == m_lastProviderID)) {
+        m_lastProviderID = providerID;
+        m_lastGroup = ETLFormat::GetKernelGroup (providerID);
+    }
+
+    return m_lastGroup;
+}
+
+int64_t ETLWriter::ConvertToSystemTime (int64_t timeStamp) const
+{
+    return m_config.startSystemTime + ConvertTicks (timeStamp - m_config.startTimeStamp, m_config.perfFreq, 10'000'000);
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,149 @@
+#ifndef ETWP_ETL_WRITER_HPP
+#define ETWP_ETL_WRITER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ETLFormat.hpp"
+#include "EventView.hpp"
+
+#include "OS/FileSystem/XZFileWriter.hpp"
+
+#include "Utility/Exception.hpp"
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Describes the trace being written (most of it goes into the logfile header, see ETLFormat::TraceLogfileHeader).
+//   Event timestamps are expected to be raw QPC values
+struct ETLWriterConfig {
+    uint32_t     bufferSize = ETLFormat::kDefaultBufferSize;
+    uint32_t     blockSize = 1'024 * 1'024;    // Unit of writes to the disk (rounded to a multiple of bufferSize)
+    uint32_t     numberOfProcessors = 1;
+    int64_t      perfFreq = 10'000'000;
+    int64_t      startTimeStamp = 0;            // QPC value at...
+    int64_t      startSystemTime = 0;           // ...this point in time (FILETIME). If startTimeStamp is 0, the
+                                                //   timestamp of the logfile header event of the input is used
+    int64_t      bootTime = 0;                  // FILETIME
+    uint32_t     providerVersion = 0;           // Build number of the OS
+    uint32_t     timerResolution = 156'250;     // In 100 ns units
+    uint32_t     cpuSpeedInMHz = 0;
+    uint8_t      majorVersion = 10;             // Of the OS
+    uint8_t      minorVersion = 0;
+    std::wstring loggerName;
+
+    // If set, an .xz compressed ETL file is written (see XZFileWriter), which is compressed while it's being written.
+    //   Requires liblzma (see ETWP_HAVE_LIBLZMA). The prefix size of the compression config is set by ETLWriter
+    bool               compress = false;
+    XZFileWriterConfig compression;
+};
+
+// Writes events into an ETL file directly, without the COM relogger (ITraceRelogger), in the format ETW itself writes
+//   in file mode. This class does not depend on Windows, so it can be tested anywhere.
+// Events are packed into per-CPU buffers (as ETW does), based on the processor number of the events, so events must
+//   be written in chronological order per CPU. Full buffers are collected into big, aligned blocks, which are written
+//   to disk by a dedicated I/O thread, while the next block is being filled (double buffering). Finally, the logfile
+//   header (in the first buffer) is updated on Close.
+// Stack traces in extended data items (e.g. of user provider events) are written as separate StackWalk events, the
+//   same way kernel stacks are stored. Other extended data items are dropped (and counted).
+// Not thread safe: WriteEvent and Close must be called from the same thread
+class ETLWriter final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ETLWriter);
+
+    class InitException : public Exception {
+    public:
+        InitException (const std::wstring& msg);
+    };
+
+    struct Stats {
+        uint64_t nEventsWritten;
+        uint64_t nEventsLost;               // Did not fit into a buffer
+        uint64_t nExtendedItemsDropped;
+        uint64_t nBuffersWritten;
+        uint64_t nBytesWritten;
+        uint64_t nCompressedBytesWritten;   // Known after Close (0 if the output is not compressed)
+    };
+
+    // Might throw InitException
+    ETLWriter (const std::filesystem::path& outputPath, const ETLWriterConfig& config);
+    ~ETLWriter ();  // Calls Close, if it was not called
+
+    // Returns false if the event could not be written (it's counted as lost)
+    bool WriteEvent (const EventView& event);
+
+    // Flushes all buffers, and finalizes the file
+    bool Close (std::wstring* pErrorOut);
+
+    Stats GetStats () const;
+
+private:
+    struct CPUBuffer {
+        std::unique_ptr<std::byte[]> memory;
+        uint32_t                     used;
+    };
+
+    struct AlignedBlockDeleter {
+        void operator() (std::byte* pBlock) const;
+    };
+
+    using Block = std::unique_ptr<std::byte[], AlignedBlockDeleter>;
+
+    ETLWriterConfig        m_config;
+    std::ofstream          m_file;
+    std::vector<CPUBuffer> m_cpuBuffers;    // Indexed by processor number, allocated on first use
+    std::vector<std::byte> m_headerBuffer;  // Rewritten on Close
+    int64_t                m_lastTimeStamp;
+    int64_t                m_nextSequenceNumber;
+    bool                   m_closed;
+    Stats                  m_stats;
+
+    // Used instead of m_file, if the output is compressed
+    std::unique_ptr<XZFileWriter> m_xzWriter;
+
+    // Cache of the last kernel group lookup
+    GUID                   m_lastProviderID;
+    USHORT                 m_lastGroup;
+
+    // Double buffering. Block m_fillingBlock is filled by WriteEvent, while the I/O thread might be writing the other
+    //   one (m_pPendingBlock)
+    Block                   m_blocks[2];
+    size_t                  m_blockSize;
+    size_t                  m_fillingBlock;
+    size_t                  m_fillingBlockUsed;
+    std::mutex              m_ioLock;
+    std::condition_variable m_ioCondition;
+    const std::byte*        m_pPendingBlock;        // Guarded by m_ioLock
+    size_t                  m_pendingBlockSize;     // Guarded by m_ioLock
+    bool                    m_stopIOThread;         // Guarded by m_ioLock
+    std::wstring            m_ioError;              // Guarded by m_ioLock
+    std::thread             m_ioThread;
+
+    void InitializeHeaderBuffer ();
+    void FinalizeHeaderBuffer ();
+
+    CPUBuffer* GetCPUBuffer (UCHAR processorNumber);
+    std::byte* Reserve (UCHAR processorNumber, size_t size);
+    void       FlushCPUBuffer (UCHAR processorNumber, CPUBuffer* pBuffer);
+
+    bool WriteStackWalkEvent (const EventView& event, const EventExtendedItemLayout& item);
+
+    void SubmitFillingBlock ();
+    void WaitForPendingBlock ();
+    void IOThreadMain ();
+
+    USHORT  GetKernelGroup (const GUID& providerID);
+    int64_t ConvertToSystemTime (int64_t timeStamp) const;
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_ETL_WRITER_HPP
\ No newline at end of file
@@ -1,11 +1,97 @@
-// Define GUIDs in this translation unit
-#define INITGUID
-#include "ETWGUIDImpl.inl"
+#include "ETWConstants.hpp"
+
+#include <cstring>
 
 namespace ETWP {
 namespace ETWConstants {
 
+namespace {
+
+template<typename T>
+bool ReadAt (const UCHAR* pData, size_t size, size_t offset, T* pValueOut)
+{
+    if (offset + sizeof (T) > size)
+        return false;
+
+    std::memcpy (pValueOut, pData + offset, sizeof (T));
+
+    return true;
+}
+
+}   // namespace
+
+std::string_view GetProcessImageFileName (const EventView& event)
+{
+    // Process_TypeGroup1 (see the kernel's MOF definitions):
+    //   UniqueProcessKey, ProcessId, ParentId, SessionId, ExitStatus, DirectoryTableBase (v3+), Flags (v4+), UserSID,
+    //   ImageFileName (ANSI string), CommandLine (wide string), ...
+    const UCHAR version = event.GetRecord ().m_header.m_version;
+    if (version < 2)
+        return {};
+
+    const UCHAR* pData = static_cast<const UCHAR*> (event.GetUserData ());
+    const size_t size = event.GetUserDataLength ();
+
+    size_t offset = sizeof (UINT_PTR) + 4 * sizeof (DWORD);
+    if (version >= 3)
+        offset += sizeof (UINT_PTR);
+    if (version >= 4)
+        offset += sizeof (DWORD);
+
+    // UserSID is a TOKEN_USER structure (a pointer and attributes, padded to two pointers), followed by the SID
+    //   itself, unless it's NULL, which is stored as a single, zero DWORD
+    DWORD sidStart;
+    if (!ReadAt (pData, size, offset, &sidStart))
+        return {};
+
+    if (sidStart == 0) {
+        offset += sizeof (DWORD);
+    } else {
+        const size_t sidOffset = offset + 2 * sizeof (UINT_PTR);
+
+        UCHAR nSubAuthorities;
+        if (!ReadAt (pData, size, sidOffset + 1, &nSubAuthorities))
+            return {};
+
+        offset = sidOffset + 8 + 4 * size_t (nSubAuthorities);
+    }
+
+    if (offset >= size)
+        return {};
+
+    const char* pName = reinterpret_cast<const char*> (pData + offset);
+    const void* pTerminator = std::memchr (pName, '\0', size - offset);
+    if (pTerminator == nullptr)
+        return {};
+
+    return std::string_view (pName, static_cast<const char*> (pTerminator) - pName);
+}
+
+std::wstring GetImageFileName (const EventView& event)
+{
+    // Image_Load (see the kernel's MOF definitions):
+    //   ImageBase, ImageSize, ProcessId, ImageCheckSum, TimeDateStamp, Reserved0, DefaultBase, Reserved1-4,
+    //   FileName (wide string)
+    if (event.GetRecord ().m_header.m_version < 2)
+        return {};
+
+    const UCHAR* pData = static_cast<const UCHAR*> (event.GetUserData ());
+    const size_t size = event.GetUserDataLength ();
+
+    std::wstring fileName;
+    for (size_t offset = 3 * sizeof (UINT_PTR) + 8 * sizeof (DWORD); ; offset += sizeof (char16_t)) {
+        char16_t c;
+        if (!ReadAt (pData, size, offset, &c))
+            return {};
+
+        if (c == u'\0')
+            break;
+
+        fileName.push_back (static_cast<wchar_t> (c));
+    }
 
+    return fileName;
+}
 
 }   // namespace ETWConstants
 }   // namespace ETWP
\ No newline at end of file
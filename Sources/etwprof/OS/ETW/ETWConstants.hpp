@@ -1,6 +1,11 @@
 #ifndef ETWP_ETW_CONSTANTS_HPP
 #define ETWP_ETW_CONSTANTS_HPP
 
+#include <string>
+#include <string_view>
+
+#include "EventView.hpp"
+
 // Declare GUIDs in the global namespace
 #include "ETWGUIDImpl.inl"
 
@@ -21,6 +26,20 @@ const UCHAR PEndOpcode = 2;
 const UCHAR PDCStartOpcode = 3;
 const UCHAR PDCEndOpcode = 4;
 
+// Image opcodes
+const UCHAR ImageUnloadOpcode = 2;
+const UCHAR ImageDCStartOpcode = 3;
+const UCHAR ImageDCEndOpcode = 4;
+const UCHAR ImageLoadOpcode = 10;
+
+// ImageInfoExtra (KernelTraceControl) opcodes
+const UCHAR ImageIDOpcode = 0;
+const UCHAR DbgIDRSDSOpcode = 36;
+
+// EventMetadata (KernelTraceControl) opcodes
+const UCHAR EventInfoOpcode = 32;
+const UCHAR EventMapInfoOpcode = 33;
+
 // PerfInfo opcodes
 const UCHAR SampledProfileOpcode = 46;
 
@@ -94,6 +113,18 @@ struct StackKeyDefinition {
     // Other members follow in the "real" struct
 };
 
+// The kernel truncates the image names in process events to this many characters (it's stored in a fixed size array)
+constexpr size_t kMaxProcessImageFileNameLength = 14;
+
+// Returns the image file name (e.g. "notepad.exe") of a process (start, end or rundown) event, without copying it.
+//   Returns an empty string for malformed payloads and unsupported versions (before 2)
+std::string_view GetProcessImageFileName (const EventView& event);
+
+// Returns the file path of an image (load, unload or rundown) event, as logged by the kernel (i.e. an NT path, like
+//   "\Device\HarddiskVolume3\Windows\System32\ntdll.dll"). Returns an empty string for malformed payloads and
+//   unsupported versions (before 2). The path is copied, as it's UTF-16, which is not wchar_t everywhere
+std::wstring GetImageFileName (const EventView& event);
+
 }   // namespace ETWConstants
 }   // namespace ETWP
 
@@ -1,83 +1,165 @@
-// Note: no header guard
+#ifndef ETWP_ETW_GUID_IMPL_INL
+#define ETWP_ETW_GUID_IMPL_INL
 
-#include <windows.h>
+#include "OS/Utility/OSTypes.hpp"
 
-DEFINE_GUID ( /* ce1dbfb4-137e-4da6-87b0-3f59aa102cbc */
-             PerfInfoGuid,
-             0xce1dbfb4,
-             0x137e,
-             0x4da6,
-             0x87, 0xb0, 0x3f, 0x59, 0xaa, 0x10, 0x2c, 0xbc
+// Unlike DEFINE_GUID, this makes GUIDs usable in constant expressions (see EventDispatchTable), and does not need
+//   INITGUID in exactly one translation unit
+#define ETWP_DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    inline constexpr GUID name = { l, w1, w2, { b1, b2, b3, b4, b5, b6, b7, b8 } }
+
+ETWP_DEFINE_GUID ( /* ce1dbfb4-137e-4da6-87b0-3f59aa102cbc */
+                  PerfInfoGuid,
+                  0xce1dbfb4,
+                  0x137e,
+                  0x4da6,
+                  0x87, 0xb0, 0x3f, 0x59, 0xaa, 0x10, 0x2c, 0xbc
+);
+
+ETWP_DEFINE_GUID ( /* b3e675d7-2554-4f18-830b-2762732560de */
+                  ImageInfoExtraGuid,
+                  0xb3e675d7,
+                  0x2554,
+                  0x4f18,
+                  0x83, 0x0b, 0x27, 0x62, 0x73, 0x25, 0x60, 0xde
+);
+
+ETWP_DEFINE_GUID ( /* bbccf6c1-6cd1-48c4-80ff-839482e37671 */
+                  EventMetadataGuid,
+                  0xbbccf6c1,
+                  0x6cd1,
+                  0x48c4,
+                  0x80, 0xff, 0x83, 0x94, 0x82, 0xe3, 0x76, 0x71
+);
+
+ETWP_DEFINE_GUID ( /* def2fe46-7bd6-4b80-bd94-f57fe20d0ce3 */
+                  StackWalkGuid,
+                  0xdef2fe46,
+                  0x7bd6,
+                  0x4b80,
+                  0xbd, 0x94, 0xf5, 0x7f, 0xe2, 0x0d, 0x0c, 0xe3
+);
+
+ETWP_DEFINE_GUID ( /* 3ff37a1c-a68d-4d6e-8c9b-f79e8b16c482 */
+                  NTFSGuid,
+                  0x3ff37a1c,
+                  0xa68d,
+                  0x4d6e,
+                  0x8c, 0x9b, 0xf7, 0x9e, 0x8b, 0x16, 0xc4, 0x82
+);
+
+ETWP_DEFINE_GUID ( /* 422088e6-cd0c-4f99-bd0b-6985fa290bdf */
+                  UxThemeGuid,
+                  0x422088e6,
+                  0xcd0c,
+                  0x4f99,
+                  0xbd, 0x0b, 0x69, 0x85, 0xfa, 0x29, 0x0b, 0xdf
 );
 
-DEFINE_GUID ( /* b3e675d7-2554-4f18-830b-2762732560de */
-             ImageInfoExtraGuid,
-             0xb3e675d7,
-             0x2554,
-             0x4f18,
-             0x83, 0x0b, 0x27, 0x62, 0x73, 0x25, 0x60, 0xde
+ETWP_DEFINE_GUID ( /* 3d6fa8d1-fe05-11d0-9dda-00c04fd7ba7c */
+                  ThreadGuid,
+                  0x3d6fa8d1,
+                  0xfe05,
+                  0x11d0,
+                  0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c
 );
 
-DEFINE_GUID ( /* def2fe46-7bd6-4b80-bd94-f57fe20d0ce3 */
-             StackWalkGuid,
-             0xdef2fe46,
-             0x7bd6,
-             0x4b80,
-             0xbd, 0x94, 0xf5, 0x7f, 0xe2, 0x0d, 0x0c, 0xe3
+ETWP_DEFINE_GUID ( /* 3d6fa8d0-fe05-11d0-9dda-00c04fd7ba7c */
+                  ProcessGuid,
+                  0x3d6fa8d0,
+                  0xfe05,
+                  0x11d0,
+                  0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c
 );
 
-DEFINE_GUID ( /* 3ff37a1c-a68d-4d6e-8c9b-f79e8b16c482 */
-             NTFSGuid,
-             0x3ff37a1c,
-             0xa68d,
-             0x4d6e,
-             0x8c, 0x9b, 0xf7, 0x9e, 0x8b, 0x16, 0xc4, 0x82
+ETWP_DEFINE_GUID ( /* 2cb15d1d-5fc1-11d2-abe1-00a0c911f518 */
+                  ImageLoadGuid,
+                  0x2cb15d1d,
+                  0x5fc1,
+                  0x11d2,
+                  0xab, 0xe1, 0x00, 0xa0, 0xc9, 0x11, 0xf5, 0x18
 );
 
-DEFINE_GUID ( /* 422088e6-cd0c-4f99-bd0b-6985fa290bdf */
-             UxThemeGuid,
-             0x422088e6,
-             0xcd0c,
-             0x4f99,
-             0xbd, 0x0b, 0x69, 0x85, 0xfa, 0x29, 0x0b, 0xdf
+ETWP_DEFINE_GUID ( /* 68fdd900-4a3e-11d1-84f4-0000f80464e3 */
+                  EventTraceEventGuid,
+                  0x68fdd900,
+                  0x4a3e,
+                  0x11d1,
+                  0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3
 );
 
-DEFINE_GUID ( /* 3d6fa8d1-fe05-11d0-9dda-00c04fd7ba7c */
-             ThreadGuid,
-             0x3d6fa8d1,
-             0xfe05,
-             0x11d0,
-             0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c
+ETWP_DEFINE_GUID ( /* 90e7946c-2266-4ad2-86f1-1521bf0b64c9 */
+                  EtwProfProfilerGuid,
+                  0x90e7946c,
+                  0x2266,
+                  0x4ad2,
+                  0x86, 0xf1, 0x15, 0x21, 0xbf, 0x0b, 0x64, 0xc9
 );
 
-DEFINE_GUID ( /* 3d6fa8d0-fe05-11d0-9dda-00c04fd7ba7c */
-             ProcessGuid,
-             0x3d6fa8d0,
-             0xfe05,
-             0x11d0,
-             0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c
+ETWP_DEFINE_GUID ( /* 3d6fa8d4-fe05-11d0-9dda-00c04fd7ba7c */
+                  DiskIoGuid,
+                  0x3d6fa8d4,
+                  0xfe05,
+                  0x11d0,
+                  0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c
 );
 
-DEFINE_GUID ( /* 2cb15d1d-5fc1-11d2-abe1-00a0c911f518 */
-             ImageLoadGuid,
-             0x2cb15d1d,
-             0x5fc1,
-             0x11d2,
-             0xab, 0xe1, 0x00, 0xa0, 0xc9, 0x11, 0xf5, 0x18
+ETWP_DEFINE_GUID ( /* 3d6fa8d3-fe05-11d0-9dda-00c04fd7ba7c */
+                  PageFaultGuid,
+                  0x3d6fa8d3,
+                  0xfe05,
+                  0x11d0,
+                  0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c
 );
 
-DEFINE_GUID ( /* 68fdd900-4a3e-11d1-84f4-0000f80464e3 */
-             EventTraceEventGuid,
-             0x68fdd900,
-             0x4a3e,
-             0x11d1,
-             0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3
+ETWP_DEFINE_GUID ( /* 90cbdc39-4a3e-11d1-84f4-0000f80464e3 */
+                  FileIoGuid,
+                  0x90cbdc39,
+                  0x4a3e,
+                  0x11d1,
+                  0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3
 );
 
-DEFINE_GUID ( /* 90e7946c-2266-4ad2-86f1-1521bf0b64c9 */
-             EtwProfProfilerGuid,
-             0x90e7946c,
-             0x2266,
-             0x4ad2,
-             0x86, 0xf1, 0x15, 0x21, 0xbf, 0x0b, 0x64, 0xc9
-);
\ No newline at end of file
+ETWP_DEFINE_GUID ( /* 9a280ac0-c8e0-11d1-84e2-00c04fb998a2 */
+                  TcpIpGuid,
+                  0x9a280ac0,
+                  0xc8e0,
+                  0x11d1,
+                  0x84, 0xe2, 0x00, 0xc0, 0x4f, 0xb9, 0x98, 0xa2
+);
+
+ETWP_DEFINE_GUID ( /* bf3a50c5-a9c9-4988-a005-2df0b7c80f80 */
+                  UdpIpGuid,
+                  0xbf3a50c5,
+                  0xa9c9,
+                  0x4988,
+                  0xa0, 0x05, 0x2d, 0xf0, 0xb7, 0xc8, 0x0f, 0x80
+);
+
+ETWP_DEFINE_GUID ( /* ae53722e-c863-11d2-8659-00c04fa321a1 */
+                  RegistryGuid,
+                  0xae53722e,
+                  0xc863,
+                  0x11d2,
+                  0x86, 0x59, 0x00, 0xc0, 0x4f, 0xa3, 0x21, 0xa1
+);
+
+ETWP_DEFINE_GUID ( /* 45d8cccd-539f-4b72-a8b7-5c683142609a */
+                  ALPCGuid,
+                  0x45d8cccd,
+                  0x539f,
+                  0x4b72,
+                  0xa8, 0xb7, 0x5c, 0x68, 0x31, 0x42, 0x60, 0x9a
+);
+
+ETWP_DEFINE_GUID ( /* d837ca92-12b9-44a5-ad6a-3a65b3578aa8 */
+                  SplitIoGuid,
+                  0xd837ca92,
+                  0x12b9,
+                  0x44a5,
+                  0xad, 0x6a, 0x3a, 0x65, 0xb3, 0x57, 0x8a, 0xa8
+);
+
+#undef ETWP_DEFINE_GUID
+
+#endif  // #ifndef ETWP_ETW_GUID_IMPL_INL
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "ETWSessionCommon.hpp"
 
+#include <vector>
+
 #include "OS/Utility/WinInternal.hpp"
 
 namespace ETWP {
@@ -12,6 +14,7 @@ bool StopETWSession (TRACEHANDLE hSession, const std::wstring& name, PEVENT_TRAC
 bool StartRealTimeETWSession (const std::wstring& name,
                               ULONG logFileMode,
                               ULONG enableFlags,
+                              const SessionBufferConfig& bufferConfig,
                               PTRACEHANDLE pHandle,
                               std::unique_ptr<EVENT_TRACE_PROPERTIES>* pPropertiesOut)
 {
@@ -32,6 +35,12 @@ bool StartRealTimeETWSession (const std::wstring& name,
 
     pProperties->EnableFlags = enableFlags;
 
+    // Zeros mean ETW's defaults
+    pProperties->BufferSize = bufferConfig.bufferSize;
+    pProperties->MinimumBuffers = bufferConfig.minimumBuffers;
+    pProperties->MaximumBuffers = bufferConfig.maximumBuffers;
+    pProperties->FlushTimer = bufferConfig.flushTimer;
+
     if (StartTraceW (pHandle, name.c_str (), pProperties.get ()) == ERROR_SUCCESS) {
         *pPropertiesOut = std::move (pProperties);
 
@@ -41,6 +50,25 @@ bool StartRealTimeETWSession (const std::wstring& name,
     }
 }
 
+bool QueryETWSession (const std::wstring& name, EVENT_TRACE_PROPERTIES* pPropertiesOut)
+{
+    // The session and log file names are returned as well, after the structure, so there must be room for them
+    constexpr size_t kMaxNameLength = 1'024;
+    std::vector<char> buffer (sizeof (EVENT_TRACE_PROPERTIES) + 2 * kMaxNameLength * sizeof (wchar_t));
+
+    PEVENT_TRACE_PROPERTIES pProperties = reinterpret_cast<PEVENT_TRACE_PROPERTIES> (buffer.data ());
+    pProperties->Wnode.BufferSize = static_cast<ULONG> (buffer.size ());
+    pProperties->LoggerNameOffset = sizeof (EVENT_TRACE_PROPERTIES);
+    pProperties->LogFileNameOffset = sizeof (EVENT_TRACE_PROPERTIES) + kMaxNameLength * sizeof (wchar_t);
+
+    if (ControlTraceW (0, name.c_str (), pProperties, EVENT_TRACE_CONTROL_QUERY) != ERROR_SUCCESS)
+        return false;
+
+    *pPropertiesOut = *pProperties;
+
+    return true;
+}
+
 bool EnableStackCachingForSession (TRACEHANDLE pSession, uint32_t cacheSize, uint32_t bucketCount)
 {
 	WinInternal::EVENT_TRACE_STACK_CACHING_INFORMATION stackCacheInfo;
@@ -7,15 +7,21 @@
 #include <memory>
 #include <string>
 
+#include "SessionSizing.hpp"
+
 namespace ETWP {
 
 bool StopETWSession (TRACEHANDLE hSession, const std::wstring& name, PEVENT_TRACE_PROPERTIES pProperties);
 bool StartRealTimeETWSession (const std::wstring& name,
                               ULONG logFileMode,
                               ULONG enableFlags,
+                              const SessionBufferConfig& bufferConfig,
                               PTRACEHANDLE pHandle,
                               std::unique_ptr<EVENT_TRACE_PROPERTIES>* pPropertiesOut);
 
+// Queries the properties (including the statistics, e.g. EventsLost) of a running session. Any thread may call this
+bool QueryETWSession (const std::wstring& name, EVENT_TRACE_PROPERTIES* pPropertiesOut);
+
 bool EnableStackCachingForSession (TRACEHANDLE pSession, uint32_t cacheSize, uint32_t bucketCount);
 
 }   // namespace ETWP
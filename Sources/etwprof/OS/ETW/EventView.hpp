@@ -0,0 +1,185 @@
+#ifndef ETWP_EVENT_VIEW_HPP
+#define ETWP_EVENT_VIEW_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "OS/Utility/OSTypes.hpp"
+
+#ifdef _WIN32
+#include <evntcons.h>
+#endif  // #ifdef _WIN32
+
+namespace ETWP {
+
+// Mirrors the memory layout of EVENT_HEADER and EVENT_RECORD (evntcons.h), so code that only reads events (e.g. the
+//   per-event filter) does not have to depend on Windows. Only 64-bit layouts are mirrored
+struct EventHeaderLayout {
+    USHORT    m_size;
+    USHORT    m_headerType;
+    USHORT    m_flags;
+    USHORT    m_eventProperty;
+    ULONG     m_threadID;
+    ULONG     m_processID;
+    int64_t   m_timeStamp;
+    GUID      m_providerID;
+    // EVENT_DESCRIPTOR
+    USHORT    m_id;
+    UCHAR     m_version;
+    UCHAR     m_channel;
+    UCHAR     m_level;
+    UCHAR     m_opcode;
+    USHORT    m_task;
+    ULONGLONG m_keyword;
+    // End of EVENT_DESCRIPTOR
+    ULONGLONG m_processorTime;
+    GUID      m_activityID;
+};
+
+// Mirrors EVENT_HEADER_EXTENDED_DATA_ITEM
+struct EventExtendedItemLayout {
+    USHORT    m_reserved1;
+    USHORT    m_extType;
+    USHORT    m_linkageAndReserved2;
+    USHORT    m_dataSize;
+    ULONGLONG m_dataPtr;
+};
+
+struct EventRecordLayout {
+    EventHeaderLayout              m_header;
+    // ETW_BUFFER_CONTEXT
+    UCHAR                          m_processorNumber;
+    UCHAR                          m_alignment;
+    USHORT                         m_loggerID;
+    // End of ETW_BUFFER_CONTEXT
+    USHORT                         m_extendedDataCount;
+    USHORT                         m_userDataLength;
+    const EventExtendedItemLayout* m_pExtendedData;
+    const void*                    m_pUserData;
+    void*                          m_pUserContext;
+};
+
+#ifdef ETWP_64BIT
+static_assert (sizeof (EventHeaderLayout) == 80);
+static_assert (sizeof (EventRecordLayout) == 112);
+static_assert (sizeof (EventExtendedItemLayout) == 16);
+#endif  // #ifdef ETWP_64BIT
+
+#ifdef _WIN32
+static_assert (sizeof (EventHeaderLayout) == sizeof (EVENT_HEADER));
+static_assert (offsetof (EventHeaderLayout, m_threadID) == offsetof (EVENT_HEADER, ThreadId));
+static_assert (offsetof (EventHeaderLayout, m_processID) == offsetof (EVENT_HEADER, ProcessId));
+static_assert (offsetof (EventHeaderLayout, m_timeStamp) == offsetof (EVENT_HEADER, TimeStamp));
+static_assert (offsetof (EventHeaderLayout, m_providerID) == offsetof (EVENT_HEADER, ProviderId));
+static_assert (offsetof (EventHeaderLayout, m_opcode) == offsetof (EVENT_HEADER, EventDescriptor.Opcode));
+static_assert (offsetof (EventHeaderLayout, m_activityID) == offsetof (EVENT_HEADER, ActivityId));
+
+static_assert (sizeof (EventRecordLayout) == sizeof (EVENT_RECORD));
+static_assert (offsetof (EventRecordLayout, m_processorNumber) ==
+               offsetof (EVENT_RECORD, BufferContext.ProcessorNumber));
+static_assert (offsetof (EventRecordLayout, m_userDataLength) == offsetof (EVENT_RECORD, UserDataLength));
+static_assert (offsetof (EventRecordLayout, m_pUserData) == offsetof (EVENT_RECORD, UserData));
+static_assert (offsetof (EventRecordLayout, m_pExtendedData) == offsetof (EVENT_RECORD, ExtendedData));
+
+static_assert (sizeof (EventExtendedItemLayout) == sizeof (EVENT_HEADER_EXTENDED_DATA_ITEM));
+static_assert (offsetof (EventExtendedItemLayout, m_extType) == offsetof (EVENT_HEADER_EXTENDED_DATA_ITEM, ExtType));
+static_assert (offsetof (EventExtendedItemLayout, m_dataSize) == offsetof (EVENT_HEADER_EXTENDED_DATA_ITEM, DataSize));
+static_assert (offsetof (EventExtendedItemLayout, m_dataPtr) == offsetof (EVENT_HEADER_EXTENDED_DATA_ITEM, DataPtr));
+#endif  // #ifdef _WIN32
+
+// Lightweight, read-only view of an event. It does not copy (or own) the event it refers to, so it must not outlive it
+class EventView final {
+public:
+    explicit EventView (const EventRecordLayout& record);
+#ifdef _WIN32
+    explicit EventView (const EVENT_RECORD& record);
+#endif  // #ifdef _WIN32
+
+    const GUID& GetProviderID () const;
+    UCHAR       GetOpcode () const;
+    DWORD       GetProcessID () const;
+    DWORD       GetThreadID () const;
+    UCHAR       GetProcessorNumber () const;
+    int64_t     GetTimestamp () const;
+
+    const void* GetUserData () const;
+    USHORT      GetUserDataLength () const;
+
+    USHORT                         GetExtendedDataCount () const;
+    const EventExtendedItemLayout* GetExtendedData () const;
+
+    const EventRecordLayout& GetRecord () const;
+
+private:
+    const EventRecordLayout* m_pRecord;
+};
+
+inline EventView::EventView (const EventRecordLayout& record): m_pRecord (&record)
+{
+}
+
+#ifdef _WIN32
+inline EventView::EventView (const EVENT_RECORD& record):
+    m_pRecord (reinterpret_cast<const EventRecordLayout*> (&record))
+{
+}
+#endif  // #ifdef _WIN32
+
+inline const GUID& EventView::GetProviderID () const
+{
+    return m_pRecord->m_header.m_providerID;
+}
+
+inline UCHAR EventView::GetOpcode () const
+{
+    return m_pRecord->m_header.m_opcode;
+}
+
+inline DWORD EventView::GetProcessID () const
+{
+    return m_pRecord->m_header.m_processID;
+}
+
+inline DWORD EventView::GetThreadID () const
+{
+    return m_pRecord->m_header.m_threadID;
+}
+
+inline UCHAR EventView::GetProcessorNumber () const
+{
+    return m_pRecord->m_processorNumber;
+}
+
+inline int64_t EventView::GetTimestamp () const
+{
+    return m_pRecord->m_header.m_timeStamp;
+}
+
+inline const void* EventView::GetUserData () const
+{
+    return m_pRecord->m_pUserData;
+}
+
+inline USHORT EventView::GetUserDataLength () const
+{
+    return m_pRecord->m_userDataLength;
+}
+
+inline USHORT EventView::GetExtendedDataCount () const
+{
+    return m_pRecord->m_extendedDataCount;
+}
+
+inline const EventExtendedItemLayout* EventView::GetExtendedData () const
+{
+    return m_pRecord->m_pExtendedData;
+}
+
+inline const EventRecordLayout& EventView::GetRecord () const
+{
+    return *m_pRecord;
+}
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_EVENT_VIEW_HPP
\ No newline at end of file
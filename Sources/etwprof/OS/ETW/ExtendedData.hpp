@@ -0,0 +1,125 @@
+#ifndef ETWP_EXTENDED_DATA_HPP
+#define ETWP_EXTENDED_DATA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "ETLFormat.hpp"
+#include "EventView.hpp"
+
+namespace ETWP {
+
+// Accessors for the extended data items of events (see EventView::GetExtendedData) etwprof cares about. They work
+//   the same way for events of live sessions, and for events read by ETLReader
+
+// Stack trace (EVENT_EXTENDED_ITEM_STACK_TRACE32/64): a match ID, followed by return addresses
+struct StackTraceView {
+    uint64_t         matchID;
+    const std::byte* pAddresses;
+    size_t           nFrames;
+    bool             is64Bit;
+
+    uint64_t GetAddress (size_t index) const;
+};
+
+// Returns nullptr if the event has no item of this type
+const EventExtendedItemLayout* FindExtendedItem (const EventView& event, USHORT extType);
+
+// These return false if the event has no such item (or it's malformed)
+bool GetStackTrace (const EventExtendedItemLayout& item, StackTraceView* pStackOut);
+bool GetStackTrace (const EventView& event, StackTraceView* pStackOut);
+bool GetStackKey (const EventView& event, uint64_t* pMatchIDOut, uint64_t* pStackKeyOut);
+bool GetEventKey (const EventView& event, uint64_t* pKeyOut);
+bool GetProcessStartKey (const EventView& event, uint64_t* pKeyOut);
+
+inline uint64_t StackTraceView::GetAddress (size_t index) const
+{
+    if (is64Bit) {
+        uint64_t address;
+        std::memcpy (&address, pAddresses + index * sizeof address, sizeof address);
+
+        return address;
+    } else {
+        uint32_t address;
+        std::memcpy (&address, pAddresses + index * sizeof address, sizeof address);
+
+        return address;
+    }
+}
+
+inline const EventExtendedItemLayout* FindExtendedItem (const EventView& event, USHORT extType)
+{
+    const EventExtendedItemLayout* pItems = event.GetExtendedData ();
+    for (USHORT i = 0; i < event.GetExtendedDataCount (); ++i) {
+        if (pItems[i].m_extType == extType)
+            return &pItems[i];
+    }
+
+    return nullptr;
+}
+
+inline bool GetStackTrace (const EventExtendedItemLayout& item, StackTraceView* pStackOut)
+{
+    if ((item.m_extType != ETLFormat::kExtTypeStackTrace64 && item.m_extType != ETLFormat::kExtTypeStackTrace32) ||
+        item.m_dataSize < sizeof (uint64_t))
+    {
+        return false;
+    }
+
+    const std::byte* pData = reinterpret_cast<const std::byte*> (item.m_dataPtr);
+    pStackOut->is64Bit = item.m_extType == ETLFormat::kExtTypeStackTrace64;
+    std::memcpy (&pStackOut->matchID, pData, sizeof pStackOut->matchID);
+    pStackOut->pAddresses = pData + sizeof (uint64_t);
+    pStackOut->nFrames = (item.m_dataSize - sizeof (uint64_t)) / (pStackOut->is64Bit ? 8 : 4);
+
+    return true;
+}
+
+inline bool GetStackTrace (const EventView& event, StackTraceView* pStackOut)
+{
+    const EventExtendedItemLayout* pItem = FindExtendedItem (event, ETLFormat::kExtTypeStackTrace64);
+    if (pItem == nullptr)
+        pItem = FindExtendedItem (event, ETLFormat::kExtTypeStackTrace32);
+
+    return pItem != nullptr && GetStackTrace (*pItem, pStackOut);
+}
+
+inline bool GetStackKey (const EventView& event, uint64_t* pMatchIDOut, uint64_t* pStackKeyOut)
+{
+    const EventExtendedItemLayout* pItem = FindExtendedItem (event, ETLFormat::kExtTypeStackKey64);
+    if (pItem == nullptr || pItem->m_dataSize < 2 * sizeof (uint64_t))
+        return false;
+
+    const std::byte* pData = reinterpret_cast<const std::byte*> (pItem->m_dataPtr);
+    std::memcpy (pMatchIDOut, pData, sizeof (uint64_t));
+    std::memcpy (pStackKeyOut, pData + sizeof (uint64_t), sizeof (uint64_t));
+
+    return true;
+}
+
+inline bool GetEventKey (const EventView& event, uint64_t* pKeyOut)
+{
+    const EventExtendedItemLayout* pItem = FindExtendedItem (event, ETLFormat::kExtTypeEventKey);
+    if (pItem == nullptr || pItem->m_dataSize < sizeof (uint64_t))
+        return false;
+
+    std::memcpy (pKeyOut, reinterpret_cast<const void*> (pItem->m_dataPtr), sizeof (uint64_t));
+
+    return true;
+}
+
+inline bool GetProcessStartKey (const EventView& event, uint64_t* pKeyOut)
+{
+    const EventExtendedItemLayout* pItem = FindExtendedItem (event, ETLFormat::kExtTypeProcessStartKey);
+    if (pItem == nullptr || pItem->m_dataSize < sizeof (uint64_t))
+        return false;
+
+    std::memcpy (pKeyOut, reinterpret_cast<const void*> (pItem->m_dataPtr), sizeof (uint64_t));
+
+    return true;
+}
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_EXTENDED_DATA_HPP
\ No newline at end of file
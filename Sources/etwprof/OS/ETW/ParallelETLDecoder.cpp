@@ -0,0 +1,343 @@
+#include "ParallelETLDecoder.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Utility/LoserTree.hpp"
+#include "Utility/WorkStealingRanges.hpp"
+
+namespace ETWP {
+
+namespace {
+
+struct DecodedBuffer {
+    std::vector<EventRecordLayout>       records;
+    std::vector<EventExtendedItemLayout> extendedItems;
+};
+
+void DecodeBuffer (const ETLBufferView& buffer, DecodedBuffer* pDecodedOut)
+{
+    std::vector<EventRecordLayout>& records = pDecodedOut->records;
+    std::vector<EventExtendedItemLayout>& extendedItems = pDecodedOut->extendedItems;
+
+    for (const EventView& event : buffer) {
+        records.push_back (event.GetRecord ());
+        extendedItems.insert (extendedItems.end (),
+                              event.GetExtendedData (),
+                              event.GetExtendedData () + event.GetExtendedDataCount ());
+    }
+
+    // Extended data pointers can only be set now, extendedItems might have been reallocated during decoding
+    size_t nextItem = 0;
+    for (EventRecordLayout& record : records) {
+        record.m_pExtendedData = record.m_extendedDataCount > 0 ? extendedItems.data () + nextItem : nullptr;
+        nextItem += record.m_extendedDataCount;
+    }
+
+    // Events of a buffer should be in chronological order already, but the merge relies on it, so let's make sure
+    const auto isEarlier = [] (const EventRecordLayout& lhs, const EventRecordLayout& rhs) {
+        return lhs.m_header.m_timeStamp < rhs.m_header.m_timeStamp;
+    };
+
+    if (!std::is_sorted (records.begin (), records.end (), isEarlier))
+        std::stable_sort (records.begin (), records.end (), isEarlier);
+}
+
+// State of one ordered decoding: worker threads decode buffers in file order (but at most lookahead buffers ahead of
+//   the merge) into slots, while the calling thread merges the streams of decoded buffers. If the merge needs a
+//   buffer nobody has started decoding yet (e.g. the next buffer of a rarely flushed processor, far ahead in the
+//   file), it decodes it itself
+class OrderedDecoding final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (OrderedDecoding);
+
+    OrderedDecoding (const ETLReader& reader, uint32_t lookahead);
+
+    void WorkerMain ();
+    void Merge (const ParallelETLDecoder::EventCallback& callback);
+    void Stop ();
+
+    uint64_t GetNumberOfEvents () const;
+    uint64_t GetNumberOfBuffersDecodedAhead () const;
+
+private:
+    enum class SlotState : uint8_t {
+        NotStarted,
+        Decoding,
+        Done
+    };
+
+    struct Slot {
+        std::atomic<SlotState> state;
+        DecodedBuffer          decoded;
+    };
+
+    struct Stream {
+        std::vector<uint32_t> buffers;      // Indices, in file order
+        size_t                position;     // In buffers
+        const DecodedBuffer*  pDecoded;     // Of the current buffer
+        size_t                nextEvent;
+    };
+
+    static constexpr uint32_t kNoBuffer = std::numeric_limits<uint32_t>::max ();
+
+    const ETLReader&        m_reader;
+    uint32_t                m_nBuffers;
+    uint32_t                m_lookahead;
+    std::unique_ptr<Slot[]> m_slots;
+    std::vector<Stream>     m_streams;
+    std::atomic<uint32_t>   m_nextBufferToDecode;
+    std::atomic<uint64_t>   m_nBuffersDecodedAhead;
+    uint64_t                m_nEvents;
+
+    std::mutex              m_lock;
+    std::condition_variable m_workerCondition;
+    std::condition_variable m_mergeCondition;
+    uint32_t                m_mergePosition;    // Lowest index of buffers still needed. Guarded by m_lock
+    bool                    m_stopping;         // Guarded by m_lock
+
+    bool AcquireNextBuffer (Stream* pStream);
+    void ReleaseCurrentBuffer (Stream* pStream);
+    void UpdateMergePosition ();
+};
+
+OrderedDecoding::OrderedDecoding (const ETLReader& reader, uint32_t lookahead):
+    m_reader (reader),
+    m_nBuffers (static_cast<uint32_t> (reader.GetNumberOfBuffers ())),
+    m_lookahead (lookahead),
+    m_slots (new Slot[reader.GetNumberOfBuffers ()]),
+    m_streams (),
+    m_nextBufferToDecode (0),
+    m_nBuffersDecodedAhead (0),
+    m_nEvents (0),
+    m_lock (),
+    m_workerCondition (),
+    m_mergeCondition (),
+    m_mergePosition (0),
+    m_stopping (false)
+{
+    // One stream per processor
+    uint32_t streamOfProcessor[256];
+    std::fill (std::begin (streamOfProcessor), std::end (streamOfProcessor), kNoBuffer);
+    for (uint32_t i = 0; i < m_nBuffers; ++i) {
+        m_slots[i].state.store (SlotState::NotStarted, std::memory_order_relaxed);
+
+        const UCHAR processorNumber = reader.GetBuffer (i).GetProcessorNumber ();
+        if (streamOfProcessor[processorNumber] == kNoBuffer) {
+            streamOfProcessor[processorNumber] = static_cast<uint32_t> (m_streams.size ());
+            m_streams.push_back ({ {}, 0, nullptr, 0 });
+        }
+
+        m_streams[streamOfProcessor[processorNumber]].buffers.push_back (i);
+    }
+}
+
+void OrderedDecoding::WorkerMain ()
+{
+    for (;;) {
+        const uint32_t i = m_nextBufferToDecode.fetch_add (1, std::memory_order_relaxed);
+        if (i >= m_nBuffers)
+            return;
+
+        {
+            std::unique_lock<std::mutex> lock (m_lock);
+            m_workerCondition.wait (lock, [&] () {
+                return uint64_t (i) < uint64_t (m_mergePosition) + m_lookahead || m_stopping;
+            });
+            if (m_stopping)
+                return;
+        }
+
+        SlotState expected = SlotState::NotStarted;
+        if (!m_slots[i].state.compare_exchange_strong (expected, SlotState::Decoding))
+            continue;   // The merge got here first
+
+        DecodeBuffer (m_reader.GetBuffer (i), &m_slots[i].decoded);
+        m_nBuffersDecodedAhead.fetch_add (1, std::memory_order_relaxed);
+
+        {
+            std::unique_lock<std::mutex> lock (m_lock);
+            m_slots[i].state.store (SlotState::Done, std::memory_order_release);
+        }
+
+        m_mergeCondition.notify_all ();
+    }
+}
+
+void OrderedDecoding::Merge (const ParallelETLDecoder::EventCallback& callback)
+{
+    LoserTree<int64_t> tree (m_streams.size ());
+    for (size_t s = 0; s < m_streams.size (); ++s) {
+        if (AcquireNextBuffer (&m_streams[s]))
+            tree.SetKey (s, m_streams[s].pDecoded->records[0].m_header.m_timeStamp);
+    }
+
+    UpdateMergePosition ();
+    tree.Build ();
+
+    for (size_t s = tree.GetWinner (); s != LoserTree<int64_t>::kNoWinner; s = tree.GetWinner ()) {
+        Stream& stream = m_streams[s];
+        callback (EventView (stream.pDecoded->records[stream.nextEvent]));
+        ++m_nEvents;
+
+        if (++stream.nextEvent < stream.pDecoded->records.size ()) {
+            tree.ReplaceWinnerKey (stream.pDecoded->records[stream.nextEvent].m_header.m_timeStamp);
+        } else {
+            ReleaseCurrentBuffer (&stream);
+            if (AcquireNextBuffer (&stream))
+                tree.ReplaceWinnerKey (stream.pDecoded->records[0].m_header.m_timeStamp);
+            else
+                tree.RemoveWinner ();
+
+            UpdateMergePosition ();
+        }
+    }
+}
+
+void OrderedDecoding::Stop ()
+{
+    {
+        std::unique_lock<std::mutex> lock (m_lock);
+        m_stopping = true;
+    }
+
+    m_workerCondition.notify_all ();
+}
+
+uint64_t OrderedDecoding::GetNumberOfEvents () const
+{
+    return m_nEvents;
+}
+
+uint64_t OrderedDecoding::GetNumberOfBuffersDecodedAhead () const
+{
+    return m_nBuffersDecodedAhead.load (std::memory_order_relaxed);
+}
+
+// Moves to the next buffer of the stream that has events (empty buffers are skipped). Returns false at the end
+bool OrderedDecoding::AcquireNextBuffer (Stream* pStream)
+{
+    for (; pStream->position < pStream->buffers.size (); ++pStream->position) {
+        const uint32_t i = pStream->buffers[pStream->position];
+        Slot& slot = m_slots[i];
+
+        SlotState expected = SlotState::NotStarted;
+        if (slot.state.compare_exchange_strong (expected, SlotState::Decoding)) {
+            DecodeBuffer (m_reader.GetBuffer (i), &slot.decoded);
+            slot.state.store (SlotState::Done, std::memory_order_relaxed);
+        } else if (expected != SlotState::Done) {
+            std::unique_lock<std::mutex> lock (m_lock);
+            m_mergeCondition.wait (lock, [&] () {
+                return slot.state.load (std::memory_order_acquire) == SlotState::Done;
+            });
+        }
+
+        if (!slot.decoded.records.empty ()) {
+            pStream->pDecoded = &slot.decoded;
+            pStream->nextEvent = 0;
+
+            return true;
+        }
+
+        slot.decoded = {};
+    }
+
+    pStream->pDecoded = nullptr;
+
+    return false;
+}
+
+void OrderedDecoding::ReleaseCurrentBuffer (Stream* pStream)
+{
+    m_slots[pStream->buffers[pStream->position]].decoded = {};
+    ++pStream->position;
+}
+
+void OrderedDecoding::UpdateMergePosition ()
+{
+    uint32_t mergePosition = m_nBuffers;
+    for (const Stream& stream : m_streams) {
+        if (stream.position < stream.buffers.size ())
+            mergePosition = std::min (mergePosition, stream.buffers[stream.position]);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock (m_lock);
+        if (mergePosition == m_mergePosition)
+            return;
+
+        m_mergePosition = mergePosition;
+    }
+
+    m_workerCondition.notify_all ();
+}
+
+}   // namespace
+
+ParallelETLDecoder::ParallelETLDecoder (const ETLReader& reader, uint32_t nThreads /*= 0*/):
+    m_reader (reader),
+    m_nThreads (nThreads != 0 ? nThreads : std::max (std::thread::hardware_concurrency (), 1u)),
+    m_stats ()
+{
+}
+
+uint32_t ParallelETLDecoder::GetNumberOfThreads () const
+{
+    return m_nThreads;
+}
+
+void ParallelETLDecoder::ForEachBufferUnordered (const BufferCallback& callback)
+{
+    m_stats = {};
+
+    WorkStealingRanges ranges (static_cast<uint32_t> (m_reader.GetNumberOfBuffers ()), m_nThreads);
+    const auto work = [&] (uint32_t workerIndex) {
+        uint32_t i;
+        while (ranges.Take (workerIndex, &i))
+            callback (workerIndex, m_reader.GetBuffer (i));
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t workerIndex = 1; workerIndex < m_nThreads; ++workerIndex)
+        threads.emplace_back (work, workerIndex);
+
+    work (0);
+
+    for (std::thread& thread : threads)
+        thread.join ();
+
+    m_stats.nSteals = ranges.GetNumberOfSteals ();
+}
+
+void ParallelETLDecoder::ForEachEventOrdered (const EventCallback& callback, uint32_t lookahead /*= 0*/)
+{
+    m_stats = {};
+
+    OrderedDecoding decoding (m_reader, lookahead != 0 ? lookahead : kDefaultLookaheadPerThread * m_nThreads);
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < m_nThreads; ++i)
+        threads.emplace_back (&OrderedDecoding::WorkerMain, &decoding);
+
+    decoding.Merge (callback);
+    decoding.Stop ();
+
+    for (std::thread& thread : threads)
+        thread.join ();
+
+    m_stats.nEvents = decoding.GetNumberOfEvents ();
+    m_stats.nBuffersDecodedAhead = decoding.GetNumberOfBuffersDecodedAhead ();
+}
+
+ParallelETLDecoder::Stats ParallelETLDecoder::GetStats () const
+{
+    return m_stats;
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef ETWP_PARALLEL_ETL_DECODER_HPP
+#define ETWP_PARALLEL_ETL_DECODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "ETLReader.hpp"
+#include "EventView.hpp"
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Decodes the buffers of an ETL file on multiple threads. Buffers are independent of each other (each one holds
+//   events of one processor, in chronological order), so they can be decoded in any order:
+//   - Unordered mode hands out whole buffers to worker threads, with work stealing (see WorkStealingRanges). This is
+//     for processing that does not care about the order of events (e.g. aggregations, done per worker, then merged)
+//   - Ordered mode delivers every event on the calling thread, in timestamp order. Worker threads decode buffers
+//     (into EVENT_RECORD-like structures) ahead of the merge, in file order. Buffers of each processor make up a
+//     stream, and streams are merged by timestamp with a loser tree (see LoserTree). Buffers are released as soon as
+//     they are merged, so memory usage depends on the lookahead (number of buffers decoded ahead), not on the size of
+//     the file. Events with equal timestamps are delivered in processor order
+// Callbacks must not throw
+class ParallelETLDecoder final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ParallelETLDecoder);
+
+    using BufferCallback = std::function<void (uint32_t workerIndex, const ETLBufferView& buffer)>;
+    using EventCallback = std::function<void (const EventView& event)>;
+
+    struct Stats {
+        uint64_t nEvents;               // Delivered in ordered mode
+        uint64_t nBuffersDecodedAhead;  // By the worker threads in ordered mode (the rest is decoded by the merge)
+        uint64_t nSteals;               // In unordered mode
+    };
+
+    static constexpr uint32_t kDefaultLookaheadPerThread = 16;
+
+    // If nThreads is 0, one thread per (logical) processor is used. The calling thread is one of the threads
+    explicit ParallelETLDecoder (const ETLReader& reader, uint32_t nThreads = 0);
+
+    uint32_t GetNumberOfThreads () const;
+
+    // callback is called concurrently (with worker indices in [0, GetNumberOfThreads ())). Each buffer is passed to
+    //   exactly one of the workers
+    void ForEachBufferUnordered (const BufferCallback& callback);
+
+    // callback is called on the calling thread. If lookahead is 0, kDefaultLookaheadPerThread buffers per thread are
+    //   decoded ahead
+    void ForEachEventOrdered (const EventCallback& callback, uint32_t lookahead = 0);
+
+    Stats GetStats () const;
+
+private:
+    const ETLReader& m_reader;
+    uint32_t         m_nThreads;
+    Stats            m_stats;
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_PARALLEL_ETL_DECODER_HPP
\ No newline at end of file
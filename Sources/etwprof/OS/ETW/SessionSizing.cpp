@@ -0,0 +1,131 @@
+#include "SessionSizing.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ETWP {
+
+namespace {
+
+// Sizes of kernel events in the buffers of a session (header and payload, rounded up), and the number of context
+//   switches assumed per processor. These are rough, but on the safe side
+constexpr uint64_t kEventHeaderSize = 32;
+constexpr uint64_t kSampledProfilePayloadSize = 16;
+constexpr uint64_t kStackWalkPayloadSize = 16;     // Without the frames
+constexpr uint64_t kCSwitchPayloadSize = 24;
+constexpr uint64_t kReadyThreadPayloadSize = 16;
+constexpr double   kCSwitchesPerSecond = 2'000.0;
+
+constexpr double   kBufferFillTime = 0.1;          // In seconds
+constexpr double   kPreallocatedTime = 0.5;        // In seconds
+constexpr double   kStallTime = 3.0;               // In seconds
+constexpr uint32_t kMinBufferSize = 64;            // In KB
+constexpr uint32_t kMaxBufferSize = 1'024;         // In KB, ETW's limit
+constexpr uint64_t kMaxMemory = 1'024;             // In MB
+constexpr uint32_t kFlushTimer = 1;                // In seconds
+
+uint64_t GetStackWalkSize (uint32_t stackDepth)
+{
+    return kEventHeaderSize + kStackWalkPayloadSize + uint64_t (stackDepth) * sizeof (uint64_t);
+}
+
+uint32_t RoundUpToPowerOfTwo (uint32_t value)
+{
+    uint32_t result = 1;
+    while (result < value)
+        result *= 2;
+
+    return result;
+}
+
+uint32_t DivideRoundingUp (double dividend, uint32_t divisor)
+{
+    return static_cast<uint32_t> (std::ceil (dividend / divisor));
+}
+
+}   // namespace
+
+uint64_t EstimateSessionBytesPerSecond (const SessionLoad& load)
+{
+    const uint64_t sampleSize = kEventHeaderSize + kSampledProfilePayloadSize + GetStackWalkSize (load.stackDepth);
+    double bytesPerProcessor = load.samplingRate * sampleSize;
+
+    if (load.cswitch) {
+        const uint64_t cswitchSize = kEventHeaderSize + kCSwitchPayloadSize +
+                                     kEventHeaderSize + kReadyThreadPayloadSize +
+                                     2 * GetStackWalkSize (load.stackDepth);
+        bytesPerProcessor += kCSwitchesPerSecond * cswitchSize;
+    }
+
+    return static_cast<uint64_t> (bytesPerProcessor * load.nProcessors);
+}
+
+SessionBufferConfig GetSessionBufferConfig (const SessionLoad& load)
+{
+    const uint32_t nProcessors = std::max (load.nProcessors, 1u);
+    const double bytesPerSecond = static_cast<double> (EstimateSessionBytesPerSecond (load));
+
+    SessionBufferConfig config;
+    const uint32_t fillSize = DivideRoundingUp (bytesPerSecond / nProcessors * kBufferFillTime, 1'024);
+    config.bufferSize = std::clamp (RoundUpToPowerOfTwo (fillSize), kMinBufferSize, kMaxBufferSize);
+
+    const uint32_t bufferBytes = config.bufferSize * 1'024;
+    const uint32_t memoryLimit = static_cast<uint32_t> (kMaxMemory * 1'024 / config.bufferSize);   // In buffers
+    const uint32_t required = 2 * nProcessors;
+
+    config.minimumBuffers = std::clamp (DivideRoundingUp (bytesPerSecond * kPreallocatedTime, bufferBytes),
+                                        required,
+                                        std::max (memoryLimit / 2, required));
+
+    const uint32_t minimumGrowth = config.minimumBuffers + nProcessors;
+    config.maximumBuffers = std::clamp (DivideRoundingUp (bytesPerSecond * kStallTime, bufferBytes),
+                                        minimumGrowth,
+                                        std::max (memoryLimit, minimumGrowth));
+
+    config.flushTimer = kFlushTimer;
+
+    return config;
+}
+
+SamplingRateBackoff::SamplingRateBackoff (double initialRate, const SamplingRateBackoffConfig& config):
+    m_config (config),
+    m_rate (initialRate),
+    m_nLost (0),
+    m_cooldownLeft (0),
+    m_nBackoffs (0)
+{
+}
+
+bool SamplingRateBackoff::Update (uint64_t nLost)
+{
+    // Counters are reset if the session is gone, that's not a loss
+    const bool lost = nLost > m_nLost;
+    m_nLost = nLost;
+
+    if (m_cooldownLeft > 0) {
+        --m_cooldownLeft;
+
+        return false;
+    }
+
+    if (!lost || m_rate <= m_config.minimumRate)
+        return false;
+
+    m_rate = std::max (m_rate * m_config.factor, m_config.minimumRate);
+    m_cooldownLeft = m_config.cooldown;
+    ++m_nBackoffs;
+
+    return true;
+}
+
+double SamplingRateBackoff::GetRate () const
+{
+    return m_rate;
+}
+
+uint32_t SamplingRateBackoff::GetNumberOfBackoffs () const
+{
+    return m_nBackoffs;
+}
+
+}   // namespace ETWP
\ No newline at end of file
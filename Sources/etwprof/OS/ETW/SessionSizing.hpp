@@ -0,0 +1,68 @@
+#ifndef ETWP_SESSION_SIZING_HPP
+#define ETWP_SESSION_SIZING_HPP
+
+#include <cstdint>
+
+namespace ETWP {
+
+// Expected load of a profiling session
+struct SessionLoad {
+    static constexpr uint32_t kDefaultStackDepth = 32;
+
+    uint32_t nProcessors;
+    double   samplingRate;      // Per processor, in Hz
+    bool     cswitch;           // Context switch and ready thread events (with stacks) are recorded, too
+    uint32_t stackDepth = kDefaultStackDepth;   // Average number of frames per stack
+};
+
+// Buffer settings of an ETW session (see EVENT_TRACE_PROPERTIES). Zero means ETW's default
+struct SessionBufferConfig {
+    uint32_t bufferSize = 0;        // In KB
+    uint32_t minimumBuffers = 0;
+    uint32_t maximumBuffers = 0;
+    uint32_t flushTimer = 0;        // In seconds
+};
+
+// Upper estimate of the bytes per second the kernel logs for the load (sampled profile and stack walk events, plus
+//   context switch, ready thread and stack walk events, if enabled), assuming every processor is busy
+uint64_t EstimateSessionBytesPerSecond (const SessionLoad& load);
+
+// Sizes the buffers of a session for the load: each processor fills a buffer in about kBufferFillTime (a bigger buffer
+//   means fewer buffer switches, up to ETW's limit of 1 MB), there are enough buffers allocated up front for the
+//   first half second (but at least two per processor, like ETW requires), and ETW may allocate more, so events of
+//   kStallTime can be buffered while consuming is held up. The memory used is limited to kMaxMemory
+SessionBufferConfig GetSessionBufferConfig (const SessionLoad& load);
+
+struct SamplingRateBackoffConfig {
+    double   minimumRate = 100.0;   // In Hz, the rate is never lowered below this
+    double   factor = 0.5;          // The rate is multiplied by this when backing off
+    uint32_t cooldown = 4;          // Updates to skip after backing off, until the new rate takes effect
+};
+
+// Decides when to lower the sampling rate of a session that loses events (or buffers). The loss counters of the
+//   session are passed to Update periodically: if they increased since the last update, the rate is lowered by a
+//   factor. Losses are ignored for some updates after that, since events sampled at the old rate may still be lost.
+//   The rate is never raised again (that would make the loss come back).
+// It does not change the sampling rate itself, so it can be tested (and reused) without a session
+class SamplingRateBackoff final {
+public:
+    SamplingRateBackoff (double initialRate, const SamplingRateBackoffConfig& config = {});
+
+    // Loss counters are cumulative (events and buffers lost, summed). Returns true if the rate should be changed to
+    //   GetRate ()
+    bool Update (uint64_t nLost);
+
+    double   GetRate () const;
+    uint32_t GetNumberOfBackoffs () const;
+
+private:
+    SamplingRateBackoffConfig m_config;
+    double                    m_rate;
+    uint64_t                  m_nLost;
+    uint32_t                  m_cooldownLeft;
+    uint32_t                  m_nBackoffs;
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_SESSION_SIZING_HPP
\ No newline at end of file
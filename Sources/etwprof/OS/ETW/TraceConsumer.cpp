@@ -0,0 +1,117 @@
+#include "TraceConsumer.hpp"
+
+#include "OS/ETW/ETWSessionInterfaces.hpp"
+#include "OS/FileSystem/Utility.hpp"
+#include "Log/Logging.hpp"
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+IEventFilter::~IEventFilter ()
+{
+}
+
+TraceConsumer::TraceConsumer (IEventFilter* pEventFilter):
+    m_pEventFilter (pEventFilter),
+    m_traceHandle (INVALID_PROCESSTRACE_HANDLE),
+    m_logfileHeader ()
+{
+}
+
+TraceConsumer::~TraceConsumer ()
+{
+    if (m_traceHandle != INVALID_PROCESSTRACE_HANDLE)
+        CloseTrace (m_traceHandle);
+}
+
+bool TraceConsumer::OpenRealTimeSession (const IETWSession& session, std::wstring* pErrorOut)
+{
+    std::wstring sessionName = session.GetName ();
+
+    EVENT_TRACE_LOGFILEW logFile = {};
+    logFile.LoggerName = sessionName.data ();
+    logFile.ProcessTraceMode = PROCESS_TRACE_MODE_REAL_TIME;
+
+    return Open (&logFile, pErrorOut);
+}
+
+bool TraceConsumer::OpenTraceFile (const std::wstring& traceFilePath, std::wstring* pErrorOut)
+{
+    if (!PathExists (traceFilePath)) {
+        *pErrorOut = L"Trace file does not exist!";
+
+        return false;
+    }
+
+    std::wstring pathCopy = traceFilePath;
+
+    EVENT_TRACE_LOGFILEW logFile = {};
+    logFile.LogFileName = pathCopy.data ();
+
+    return Open (&logFile, pErrorOut);
+}
+
+const TRACE_LOGFILE_HEADER& TraceConsumer::GetLogfileHeader () const
+{
+    ETWP_ASSERT (m_traceHandle != INVALID_PROCESSTRACE_HANDLE);
+
+    return m_logfileHeader;
+}
+
+bool TraceConsumer::StartProcessing (std::wstring* pErrorOut)
+{
+    if (ETWP_ERROR (m_traceHandle == INVALID_PROCESSTRACE_HANDLE)) {
+        *pErrorOut = L"No session or trace file was opened!";
+
+        return false;
+    }
+
+    // Blocks until the session is stopped, or the end of the file is reached
+    const ULONG result = ProcessTrace (&m_traceHandle, 1, nullptr, nullptr);
+
+    m_pEventFilter->FinishFiltering ();
+
+    if (result != ERROR_SUCCESS && result != ERROR_CANCELLED) {
+        *pErrorOut = L"ProcessTrace failed with error code " + std::to_wstring (result) + L"!";
+
+        return false;
+    }
+
+    return true;
+}
+
+bool TraceConsumer::Open (EVENT_TRACE_LOGFILEW* pLogFile, std::wstring* pErrorOut)
+{
+    if (ETWP_ERROR (m_traceHandle != INVALID_PROCESSTRACE_HANDLE)) {
+        *pErrorOut = L"A session or trace file is already opened!";
+
+        return false;
+    }
+
+    // Raw timestamps: events can be written to the output without any conversion
+    pLogFile->ProcessTraceMode |= PROCESS_TRACE_MODE_EVENT_RECORD | PROCESS_TRACE_MODE_RAW_TIMESTAMP;
+    pLogFile->EventRecordCallback = EventRecordCallback;
+    pLogFile->Context = this;
+
+    m_traceHandle = OpenTraceW (pLogFile);
+    if (m_traceHandle == INVALID_PROCESSTRACE_HANDLE) {
+        *pErrorOut = L"OpenTrace failed with error code " + std::to_wstring (GetLastError ()) + L"!";
+
+        return false;
+    }
+
+    Log (LogSeverity::Debug, L"Trace handle: " + std::to_wstring (m_traceHandle));
+
+    m_logfileHeader = pLogFile->LogfileHeader;
+
+    return true;
+}
+
+VOID WINAPI TraceConsumer::EventRecordCallback (PEVENT_RECORD pEventRecord)
+{
+    TraceConsumer* pInstance = static_cast<TraceConsumer*> (pEventRecord->UserContext);
+
+    pInstance->m_pEventFilter->FilterEvent (EventView (*pEventRecord));
+}
+
+}   // namespace ETWP
\ No newline at end of file
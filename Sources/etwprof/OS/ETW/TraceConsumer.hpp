@@ -0,0 +1,60 @@
+#ifndef ETWP_TRACE_CONSUMER_HPP
+#define ETWP_TRACE_CONSUMER_HPP
+
+#include <windows.h>
+#include <evntrace.h>
+#include <evntcons.h>
+
+#include <string>
+
+#include "EventView.hpp"
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+class IETWSession;
+
+class IEventFilter {
+public:
+    virtual ~IEventFilter ();
+
+    virtual void FilterEvent (const EventView& event) = 0;
+    // Called after the last event
+    virtual void FinishFiltering () = 0;
+};
+
+// Consumes events of a real-time ETW session, or of an ETL file, with OpenTrace/ProcessTrace (no COM involved).
+//   Timestamps are not converted, they are delivered as raw QPC values
+// 1.) Create an instance with your filter
+// 2.) Open a session or a trace file
+// 3.) Start processing; your filter will be called back with events on the calling thread, until the session is
+//     stopped, or the end of the file is reached
+class TraceConsumer final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (TraceConsumer);
+
+    explicit TraceConsumer (IEventFilter* pEventFilter);
+    ~TraceConsumer ();
+
+    bool OpenRealTimeSession (const IETWSession& session, std::wstring* pErrorOut);
+    bool OpenTraceFile (const std::wstring& traceFilePath, std::wstring* pErrorOut);
+
+    // Only valid after a session or a file was opened successfully
+    const TRACE_LOGFILE_HEADER& GetLogfileHeader () const;
+
+    bool StartProcessing (std::wstring* pErrorOut);
+
+private:
+    IEventFilter*        m_pEventFilter;
+    TRACEHANDLE          m_traceHandle;
+    TRACE_LOGFILE_HEADER m_logfileHeader;
+
+    bool Open (EVENT_TRACE_LOGFILEW* pLogFile, std::wstring* pErrorOut);
+
+    static VOID WINAPI EventRecordCallback (PEVENT_RECORD pEventRecord);
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_TRACE_CONSUMER_HPP
\ No newline at end of file
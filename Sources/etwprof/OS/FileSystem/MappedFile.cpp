@@ -0,0 +1,128 @@
+#include "MappedFile.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // #ifndef _WIN32
+
+namespace ETWP {
+
+MappedFile::InitException::InitException (const std::wstring& msg): Exception (msg)
+{
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile (const std::filesystem::path& path, AccessPattern accessPattern):
+    m_pData (nullptr),
+    m_size (0),
+    m_hFile (INVALID_HANDLE_VALUE),
+    m_hMapping (nullptr)
+{
+    const DWORD flags = accessPattern == AccessPattern::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+    // Deleting is shared, so files mapped can still be replaced by other processes (see ImageIdentityCache::Save)
+    m_hFile = CreateFileW (path.c_str (),
+                           GENERIC_READ,
+                           FILE_SHARE_READ | FILE_SHARE_DELETE,
+                           nullptr,
+                           OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | flags,
+                           nullptr);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+        throw InitException (L"Unable to open file: " + path.wstring ());
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx (m_hFile, &size)) {
+        CloseHandle (m_hFile);
+
+        throw InitException (L"Unable to query the size of file: " + path.wstring ());
+    }
+
+    m_size = static_cast<size_t> (size.QuadPart);
+    if (m_size == 0)
+        return;
+
+    m_hMapping = CreateFileMappingW (m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_hMapping == nullptr) {
+        CloseHandle (m_hFile);
+
+        throw InitException (L"Unable to create file mapping for file: " + path.wstring ());
+    }
+
+    m_pData = static_cast<const std::byte*> (MapViewOfFile (m_hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_pData == nullptr) {
+        CloseHandle (m_hMapping);
+        CloseHandle (m_hFile);
+
+        throw InitException (L"Unable to map file: " + path.wstring ());
+    }
+}
+
+MappedFile::~MappedFile ()
+{
+    if (m_pData != nullptr)
+        UnmapViewOfFile (m_pData);
+
+    if (m_hMapping != nullptr)
+        CloseHandle (m_hMapping);
+
+    CloseHandle (m_hFile);
+}
+
+#else
+
+MappedFile::MappedFile (const std::filesystem::path& path, AccessPattern accessPattern):
+    m_pData (nullptr),
+    m_size (0),
+    m_fd (-1)
+{
+    m_fd = open (path.c_str (), O_RDONLY | O_CLOEXEC);
+    if (m_fd == -1)
+        throw InitException (L"Unable to open file: " + path.wstring ());
+
+    struct stat status;
+    if (fstat (m_fd, &status) != 0) {
+        close (m_fd);
+
+        throw InitException (L"Unable to query the size of file: " + path.wstring ());
+    }
+
+    m_size = static_cast<size_t> (status.st_size);
+    if (m_size == 0)
+        return;
+
+    void* pData = mmap (nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (pData == MAP_FAILED) {
+        close (m_fd);
+
+        throw InitException (L"Unable to map file: " + path.wstring ());
+    }
+
+    madvise (pData, m_size, accessPattern == AccessPattern::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+
+    m_pData = static_cast<const std::byte*> (pData);
+}
+
+MappedFile::~MappedFile ()
+{
+    if (m_pData != nullptr)
+        munmap (const_cast<std::byte*> (m_pData), m_size);
+
+    close (m_fd);
+}
+
+#endif  // #ifdef _WIN32
+
+const std::byte* MappedFile::GetData () const
+{
+    return m_pData;
+}
+
+size_t MappedFile::GetSize () const
+{
+    return m_size;
+}
+
+}   // namespace ETWP
\ No newline at end of file
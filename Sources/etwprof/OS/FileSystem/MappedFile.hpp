@@ -0,0 +1,51 @@
+#ifndef ETWP_MAPPED_FILE_HPP
+#define ETWP_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+#include "OS/Utility/OSTypes.hpp"
+
+#include "Utility/Exception.hpp"
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Read-only memory mapping of a whole file. Works on Windows and on POSIX systems as well
+class MappedFile final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (MappedFile);
+
+    class InitException : public Exception {
+    public:
+        InitException (const std::wstring& msg);
+    };
+
+    // Hint for the OS (e.g. for read-ahead)
+    enum class AccessPattern {
+        Sequential,
+        Random
+    };
+
+    // Might throw InitException
+    explicit MappedFile (const std::filesystem::path& path, AccessPattern accessPattern = AccessPattern::Sequential);
+    ~MappedFile ();
+
+    const std::byte* GetData () const;  // nullptr for empty files
+    size_t           GetSize () const;
+
+private:
+    const std::byte* m_pData;
+    size_t           m_size;
+#ifdef _WIN32
+    HANDLE           m_hFile;
+    HANDLE           m_hMapping;
+#else
+    int              m_fd;
+#endif  // #ifdef _WIN32
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_MAPPED_FILE_HPP
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "PEImage.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "MappedFile.hpp"
+
+namespace ETWP {
+
+namespace {
+
+// Offsets and constants of the PE format (see IMAGE_DOS_HEADER, IMAGE_NT_HEADERS, etc. in winnt.h)
+constexpr uint16_t kDOSSignature = 0x5A4D;              // "MZ"
+constexpr size_t   kNTHeadersOffsetOffset = 0x3C;       // IMAGE_DOS_HEADER::e_lfanew
+constexpr uint32_t kNTSignature = 0x00004550;           // "PE\0\0"
+constexpr size_t   kFileHeaderSize = 20;
+constexpr uint16_t kPE32Magic = 0x10B;
+constexpr uint16_t kPE32PlusMagic = 0x20B;
+constexpr size_t   kSectionHeaderSize = 40;
+constexpr uint32_t kDebugDirectoryIndex = 6;            // IMAGE_DIRECTORY_ENTRY_DEBUG
+constexpr size_t   kDebugDirectoryEntrySize = 28;       // IMAGE_DEBUG_DIRECTORY
+constexpr uint32_t kDebugTypeCodeView = 2;              // IMAGE_DEBUG_TYPE_CODEVIEW
+constexpr uint32_t kRSDSSignature = 0x53445352;         // "RSDS"
+constexpr size_t   kRSDSHeaderSize = 24;                // Signature, GUID, age
+
+template<typename T>
+bool ReadAt (const std::byte* pData, size_t size, size_t offset, T* pValueOut)
+{
+    if (offset > size || sizeof (T) > size - offset)
+        return false;
+
+    std::memcpy (pValueOut, pData + offset, sizeof (T));
+
+    return true;
+}
+
+// Images are read as files, not as mapped images, so RVAs have to be translated to file offsets via the section
+//   headers
+bool RVAToFileOffset (const std::byte* pData,
+                      size_t size,
+                      size_t sectionHeadersOffset,
+                      uint16_t nSections,
+                      uint32_t rva,
+                      size_t* pOffsetOut)
+{
+    for (uint16_t i = 0; i < nSections; ++i) {
+        const size_t sectionOffset = sectionHeadersOffset + i * kSectionHeaderSize;
+
+        uint32_t virtualSize;
+        uint32_t virtualAddress;
+        uint32_t sizeOfRawData;
+        uint32_t pointerToRawData;
+        if (!ReadAt (pData, size, sectionOffset + 8, &virtualSize) ||
+            !ReadAt (pData, size, sectionOffset + 12, &virtualAddress) ||
+            !ReadAt (pData, size, sectionOffset + 16, &sizeOfRawData) ||
+            !ReadAt (pData, size, sectionOffset + 20, &pointerToRawData))
+        {
+            return false;
+        }
+
+        const uint32_t sectionSize = std::max (virtualSize, sizeOfRawData);
+        if (rva >= virtualAddress && rva - virtualAddress < sectionSize) {
+            if (rva - virtualAddress >= sizeOfRawData)
+                return false;   // Not backed by the file
+
+            *pOffsetOut = size_t (pointerToRawData) + (rva - virtualAddress);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}   // namespace
+
+bool ParsePEImageIdentity (const std::byte* pData,
+                           size_t size,
+                           PEImageIdentity* pIdentityOut,
+                           std::wstring* pErrorOut)
+{
+    *pIdentityOut = {};
+
+    uint16_t dosSignature;
+    uint32_t ntHeadersOffset;
+    uint32_t ntSignature;
+    if (!ReadAt (pData, size, 0, &dosSignature) || dosSignature != kDOSSignature ||
+        !ReadAt (pData, size, kNTHeadersOffsetOffset, &ntHeadersOffset) ||
+        !ReadAt (pData, size, ntHeadersOffset, &ntSignature) || ntSignature != kNTSignature)
+    {
+        *pErrorOut = L"Not a PE image!";
+
+        return false;
+    }
+
+    // IMAGE_FILE_HEADER
+    const size_t fileHeaderOffset = size_t (ntHeadersOffset) + sizeof ntSignature;
+    uint16_t nSections;
+    uint16_t sizeOfOptionalHeader;
+    if (!ReadAt (pData, size, fileHeaderOffset + 2, &nSections) ||
+        !ReadAt (pData, size, fileHeaderOffset + 4, &pIdentityOut->timeDateStamp) ||
+        !ReadAt (pData, size, fileHeaderOffset + 16, &sizeOfOptionalHeader))
+    {
+        *pErrorOut = L"Truncated PE file header!";
+
+        return false;
+    }
+
+    // IMAGE_OPTIONAL_HEADER32/64. They only differ in the size of some fields before the data directories
+    const size_t optionalHeaderOffset = fileHeaderOffset + kFileHeaderSize;
+    uint16_t magic;
+    if (!ReadAt (pData, size, optionalHeaderOffset, &magic) || (magic != kPE32Magic && magic != kPE32PlusMagic)) {
+        *pErrorOut = L"Unknown PE optional header!";
+
+        return false;
+    }
+
+    const size_t dataDirectoriesOffset = magic == kPE32PlusMagic ? 112 : 96;
+    uint32_t nDataDirectories;
+    if (!ReadAt (pData, size, optionalHeaderOffset + 56, &pIdentityOut->sizeOfImage) ||
+        !ReadAt (pData, size, optionalHeaderOffset + 64, &pIdentityOut->checksum) ||
+        !ReadAt (pData, size, optionalHeaderOffset + dataDirectoriesOffset - 4, &nDataDirectories))
+    {
+        *pErrorOut = L"Truncated PE optional header!";
+
+        return false;
+    }
+
+    // No debug directory is fine, the image is identified by its timestamp and size then
+    uint32_t debugDirectoryRVA = 0;
+    uint32_t debugDirectorySize = 0;
+    const size_t debugDirectoryOffset = optionalHeaderOffset + dataDirectoriesOffset + kDebugDirectoryIndex * 8;
+    if (nDataDirectories <= kDebugDirectoryIndex ||
+        debugDirectoryOffset + 8 > optionalHeaderOffset + sizeOfOptionalHeader ||
+        !ReadAt (pData, size, debugDirectoryOffset, &debugDirectoryRVA) ||
+        !ReadAt (pData, size, debugDirectoryOffset + 4, &debugDirectorySize) ||
+        debugDirectoryRVA == 0)
+    {
+        return true;
+    }
+
+    const size_t sectionHeadersOffset = optionalHeaderOffset + sizeOfOptionalHeader;
+    size_t debugEntriesOffset;
+    if (!RVAToFileOffset (pData, size, sectionHeadersOffset, nSections, debugDirectoryRVA, &debugEntriesOffset))
+        return true;
+
+    for (size_t i = 0; i < debugDirectorySize / kDebugDirectoryEntrySize; ++i) {
+        const size_t entryOffset = debugEntriesOffset + i * kDebugDirectoryEntrySize;
+
+        uint32_t type;
+        uint32_t sizeOfData;
+        uint32_t pointerToRawData;
+        if (!ReadAt (pData, size, entryOffset + 12, &type) ||
+            !ReadAt (pData, size, entryOffset + 16, &sizeOfData) ||
+            !ReadAt (pData, size, entryOffset + 24, &pointerToRawData))
+        {
+            break;
+        }
+
+        uint32_t signature;
+        if (type != kDebugTypeCodeView ||
+            sizeOfData <= kRSDSHeaderSize ||
+            !ReadAt (pData, size, pointerToRawData, &signature) ||
+            signature != kRSDSSignature ||
+            !ReadAt (pData, size, size_t (pointerToRawData) + 4, &pIdentityOut->pdbGUID) ||
+            !ReadAt (pData, size, size_t (pointerToRawData) + 20, &pIdentityOut->pdbAge) ||
+            size_t (pointerToRawData) + sizeOfData > size)
+        {
+            continue;
+        }
+
+        const char* pPath = reinterpret_cast<const char*> (pData + pointerToRawData + kRSDSHeaderSize);
+        const char* pPathEnd = pPath + (sizeOfData - kRSDSHeaderSize);
+        pIdentityOut->pdbPath.assign (pPath, std::find (pPath, pPathEnd, '\0'));
+        pIdentityOut->hasPDBInfo = true;
+
+        break;
+    }
+
+    if (!pIdentityOut->hasPDBInfo) {
+        pIdentityOut->pdbGUID = {};
+        pIdentityOut->pdbAge = 0;
+    }
+
+    return true;
+}
+
+bool ReadPEImageIdentity (const std::filesystem::path& path, PEImageIdentity* pIdentityOut, std::wstring* pErrorOut)
+{
+    try {
+        const MappedFile file (path, MappedFile::AccessPattern::Random);
+        if (!ParsePEImageIdentity (file.GetData (), file.GetSize (), pIdentityOut, pErrorOut)) {
+            *pErrorOut = path.wstring () + L": " + *pErrorOut;
+
+            return false;
+        }
+    } catch (const MappedFile::InitException& e) {
+        *pErrorOut = e.GetMsg ();
+
+        return false;
+    }
+
+    return true;
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef ETWP_PE_IMAGE_HPP
+#define ETWP_PE_IMAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "OS/Utility/OSTypes.hpp"
+
+namespace ETWP {
+
+// What symbol servers (and WPA, TraceEvent, etc.) need to find the binary and the PDB of an image
+struct PEImageIdentity {
+    uint32_t    timeDateStamp;
+    uint32_t    sizeOfImage;
+    uint32_t    checksum;
+    bool        hasPDBInfo;     // The debug directory has a CodeView (RSDS) entry. If not, the members below are empty
+    GUID        pdbGUID;
+    uint32_t    pdbAge;
+    std::string pdbPath;        // As stored in the image (usually a path on the build machine)
+};
+
+// Reads the identity of a PE image (.exe, .dll, .sys, etc.; both PE32 and PE32+) from its file contents. Only the
+//   headers and the debug directory are touched. Does not depend on Windows
+bool ParsePEImageIdentity (const std::byte* pData,
+                           size_t size,
+                           PEImageIdentity* pIdentityOut,
+                           std::wstring* pErrorOut);
+
+bool ReadPEImageIdentity (const std::filesystem::path& path, PEImageIdentity* pIdentityOut, std::wstring* pErrorOut);
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_PE_IMAGE_HPP
\ No newline at end of file
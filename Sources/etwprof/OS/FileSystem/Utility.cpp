@@ -1,6 +1,7 @@
 #include "Utility.hpp"
 
 #include <cstdlib>
+#include <iterator>
 #include <windows.h>
 
 #include "Utility/Asserts.hpp"
@@ -256,6 +257,35 @@ std::wstring PathExpandEnvVars (const std::wstring& path)
         return expandedPath;
 }
 
+std::wstring PathFromNTPath (const std::wstring& ntPath)
+{
+    constexpr wchar_t kSystemRootPrefix[] = L"\\SystemRoot\\";
+    constexpr wchar_t kDOSDevicesPrefix[] = L"\\??\\";
+
+    if (_wcsnicmp (ntPath.c_str (), kSystemRootPrefix, std::size (kSystemRootPrefix) - 1) == 0)
+        return PathExpandEnvVars (L"%SystemRoot%\\") + ntPath.substr (std::size (kSystemRootPrefix) - 1);
+
+    if (ntPath.starts_with (kDOSDevicesPrefix))
+        return ntPath.substr (std::size (kDOSDevicesPrefix) - 1);
+
+    for (wchar_t driveLetter = L'A'; driveLetter <= L'Z'; ++driveLetter) {
+        const wchar_t drive[] = { driveLetter, L':', L'\0' };
+        WCHAR devicePath[MAX_PATH];
+        if (QueryDosDeviceW (drive, devicePath, MAX_PATH) == 0)
+            continue;
+
+        const size_t devicePathLength = wcslen (devicePath);
+        if (ntPath.length () > devicePathLength &&
+            ntPath[devicePathLength] == L'\\' &&
+            _wcsnicmp (ntPath.c_str (), devicePath, devicePathLength) == 0)
+        {
+            return drive + ntPath.substr (devicePathLength);
+        }
+    }
+
+    return ntPath;
+}
+
 bool FileDelete (const std::wstring& path)
 {
     return DeleteFileW (path.c_str ()) != FALSE;
@@ -35,6 +35,11 @@ std::wstring PathReplaceExtension (const std::wstring& path, const std::wstring&
 
 std::wstring PathExpandEnvVars (const std::wstring& path);
 
+// Converts paths logged by the kernel (e.g. "\Device\HarddiskVolume3\Windows\System32\ntdll.dll", or
+//   "\SystemRoot\System32\drivers\ntfs.sys") to Win32 paths, based on the current drive mappings. Other paths are
+//   returned as they are. Thread safe
+std::wstring PathFromNTPath (const std::wstring& ntPath);
+
 bool FileDelete (const std::wstring& path);
 bool FileRename (const std::wstring& oldPath, const std::wstring& newPath);
 bool FileRenameByName (const std::wstring& oldPath, const std::wstring& newFileName);
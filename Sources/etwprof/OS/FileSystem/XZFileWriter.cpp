@@ -0,0 +1,212 @@
+#include "XZFileWriter.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#include <lzma.h>
+
+#include "MappedFile.hpp"
+
+namespace ETWP {
+
+namespace {
+
+constexpr size_t kOutputBufferSize = 1'024 * 1'024;
+constexpr size_t kStreamPaddingAlignment = 4;
+
+size_t GetPrefixReserve (uint32_t prefixSize)
+{
+    if (prefixSize == 0)
+        return 0;
+
+    const size_t bound = lzma_stream_buffer_bound (prefixSize);
+
+    return (bound + kStreamPaddingAlignment - 1) & ~(kStreamPaddingAlignment - 1);
+}
+
+}   // namespace
+
+struct XZFileWriter::Encoder {
+    lzma_stream stream = LZMA_STREAM_INIT;
+};
+
+XZFileWriter::InitException::InitException (const std::wstring& msg): Exception (msg)
+{
+}
+
+XZFileWriter::XZFileWriter (const std::filesystem::path& path, const XZFileWriterConfig& config):
+    m_config (config),
+    m_file (),
+    m_encoder (std::make_unique<Encoder> ()),
+    m_outputBuffer (kOutputBufferSize),
+    m_compressedSize (0),
+    m_finished (false)
+{
+    if (m_config.preset > 9)
+        throw InitException (L"Invalid xz preset!");
+
+    uint32_t nThreads = m_config.nThreads;
+    if (nThreads == 0)
+        nThreads = std::clamp (std::thread::hardware_concurrency (), 1u, kMaxDefaultThreads);
+
+    lzma_mt options = {};
+    options.threads = nThreads;
+    options.block_size = m_config.blockSize;
+    options.timeout = 0;
+    options.preset = m_config.preset;
+    options.check = LZMA_CHECK_CRC32;
+
+    if (lzma_stream_encoder_mt (&m_encoder->stream, &options) != LZMA_OK)
+        throw InitException (L"Unable to initialize xz encoder!");
+
+    m_file.open (path, std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        lzma_end (&m_encoder->stream);
+
+        throw InitException (L"Unable to open output file: " + path.wstring ());
+    }
+
+    // Space for the prefix, see Finish
+    const std::vector<char> reserve (GetPrefixReserve (m_config.prefixSize), '\0');
+    m_file.write (reserve.data (), reserve.size ());
+    m_compressedSize = reserve.size ();
+}
+
+XZFileWriter::~XZFileWriter ()
+{
+    if (!m_finished)
+        lzma_end (&m_encoder->stream);
+}
+
+bool XZFileWriter::Write (const void* pData, size_t size, std::wstring* pErrorOut)
+{
+    if (size == 0)
+        return true;
+
+    m_encoder->stream.next_in = static_cast<const uint8_t*> (pData);
+    m_encoder->stream.avail_in = size;
+
+    return Encode (false, pErrorOut);
+}
+
+bool XZFileWriter::Finish (const void* pPrefix, std::wstring* pErrorOut)
+{
+    if (m_finished)
+        return true;
+
+    m_encoder->stream.next_in = nullptr;
+    m_encoder->stream.avail_in = 0;
+    const bool success = Encode (true, pErrorOut);
+
+    lzma_end (&m_encoder->stream);
+    m_finished = true;
+
+    if (!success)
+        return false;
+
+    if (m_config.prefixSize > 0) {
+        lzma_options_lzma lzmaOptions;
+        lzma_lzma_preset (&lzmaOptions, 0);     // The prefix is small (e.g. one ETL buffer)
+
+        const lzma_filter filters[] = { { LZMA_FILTER_LZMA2, &lzmaOptions }, { LZMA_VLI_UNKNOWN, nullptr } };
+
+        std::vector<uint8_t> encodedPrefix (GetPrefixReserve (m_config.prefixSize));
+        size_t encodedSize = 0;
+        if (lzma_stream_buffer_encode (const_cast<lzma_filter*> (filters),
+                                       LZMA_CHECK_CRC32,
+                                       nullptr,
+                                       static_cast<const uint8_t*> (pPrefix),
+                                       m_config.prefixSize,
+                                       encodedPrefix.data (),
+                                       &encodedSize,
+                                       encodedPrefix.size ()) != LZMA_OK)
+        {
+            *pErrorOut = L"Unable to compress file header!";
+
+            return false;
+        }
+
+        // The rest of the reserved space stays zero, which is valid stream padding (xz streams are a multiple of four
+        //   bytes long)
+        m_file.seekp (0);
+        m_file.write (reinterpret_cast<const char*> (encodedPrefix.data ()), encodedSize);
+    }
+
+    m_file.close ();
+    if (!m_file) {
+        *pErrorOut = L"Unable to finalize compressed file!";
+
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t XZFileWriter::GetCompressedSize () const
+{
+    return m_compressedSize;
+}
+
+bool XZFileWriter::Encode (bool finish, std::wstring* pErrorOut)
+{
+    lzma_stream& stream = m_encoder->stream;
+    for (;;) {
+        stream.next_out = m_outputBuffer.data ();
+        stream.avail_out = m_outputBuffer.size ();
+
+        const lzma_ret result = lzma_code (&stream, finish ? LZMA_FINISH : LZMA_RUN);
+        if (result != LZMA_OK && result != LZMA_STREAM_END) {
+            *pErrorOut = L"xz compression failed (liblzma error " + std::to_wstring (int (result)) + L")!";
+
+            return false;
+        }
+
+        if (!FlushOutputBuffer (m_outputBuffer.size () - stream.avail_out, pErrorOut))
+            return false;
+
+        if (result == LZMA_STREAM_END || (!finish && stream.avail_in == 0 && stream.avail_out != 0))
+            return true;
+    }
+}
+
+bool XZFileWriter::FlushOutputBuffer (size_t size, std::wstring* pErrorOut)
+{
+    if (size == 0)
+        return true;
+
+    if (!m_file.write (reinterpret_cast<const char*> (m_outputBuffer.data ()), size)) {
+        *pErrorOut = L"Unable to write compressed file!";
+
+        return false;
+    }
+
+    m_compressedSize += size;
+
+    return true;
+}
+
+bool CompressFileXZ (const std::filesystem::path& inputPath,
+                     const std::filesystem::path& outputPath,
+                     const XZFileWriterConfig& config,
+                     std::wstring* pErrorOut)
+{
+    XZFileWriterConfig fileConfig = config;
+    fileConfig.prefixSize = 0;
+
+    try {
+        const MappedFile input (inputPath);
+        XZFileWriter writer (outputPath, fileConfig);
+
+        return writer.Write (input.GetData (), input.GetSize (), pErrorOut) && writer.Finish (nullptr, pErrorOut);
+    } catch (const MappedFile::InitException& e) {
+        *pErrorOut = e.GetMsg ();
+
+        return false;
+    } catch (const XZFileWriter::InitException& e) {
+        *pErrorOut = e.GetMsg ();
+
+        return false;
+    }
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef ETWP_XZ_FILE_WRITER_HPP
+#define ETWP_XZ_FILE_WRITER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Utility/Exception.hpp"
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+struct XZFileWriterConfig {
+    uint32_t preset = 4;                    // 0-9, as in "xz -4" (etwprof used to run 7zr with -mx=4)
+    uint32_t nThreads = 0;                  // If 0, one per (logical) processor, at most kMaxDefaultThreads
+    uint32_t blockSize = 4 * 1'024 * 1'024; // Data is compressed in independent blocks of this size, in parallel
+    uint32_t prefixSize = 0;                // See XZFileWriter
+};
+
+// Writes an .xz file: data is compressed with LZMA2 (by liblzma) on multiple threads, as it is written, so
+//   compression finishes shortly after the last write. The result is a standard .xz file (it can be decompressed with
+//   xz, 7-Zip, etc.), its integrity is checked with CRC32s.
+// The first prefixSize bytes of the (uncompressed) data are passed to Finish, so headers can be finalized after
+//   everything else is written (e.g. the logfile header of ETL files). The prefix is stored as a separate xz stream at
+//   the start of the file, in space reserved for its worst case size. Unused space is filled with stream padding, so
+//   decompressors skip it.
+// Not thread safe. Only available if etwprof is built with liblzma (ETWP_HAVE_LIBLZMA)
+class XZFileWriter final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (XZFileWriter);
+
+    class InitException : public Exception {
+    public:
+        InitException (const std::wstring& msg);
+    };
+
+    static constexpr uint32_t kMaxDefaultThreads = 4;  // Each thread needs tens of MiBs of memory
+
+    // Might throw InitException
+    XZFileWriter (const std::filesystem::path& path, const XZFileWriterConfig& config);
+    ~XZFileWriter ();
+
+    bool Write (const void* pData, size_t size, std::wstring* pErrorOut);
+
+    // pPrefix points to prefixSize bytes (it's ignored if prefixSize is 0)
+    bool Finish (const void* pPrefix, std::wstring* pErrorOut);
+
+    uint64_t GetCompressedSize () const;
+
+private:
+    struct Encoder;
+
+    XZFileWriterConfig       m_config;
+    std::ofstream            m_file;
+    std::unique_ptr<Encoder> m_encoder;
+    std::vector<uint8_t>     m_outputBuffer;
+    uint64_t                 m_compressedSize;
+    bool                     m_finished;
+
+    bool Encode (bool finish, std::wstring* pErrorOut);
+    bool FlushOutputBuffer (size_t size, std::wstring* pErrorOut);
+};
+
+// Compresses a whole file with XZFileWriter (config.prefixSize is ignored)
+bool CompressFileXZ (const std::filesystem::path& inputPath,
+                     const std::filesystem::path& outputPath,
+                     const XZFileWriterConfig& config,
+                     std::wstring* pErrorOut);
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_XZ_FILE_WRITER_HPP
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef ETWP_ADDRESS_HPP
+#define ETWP_ADDRESS_HPP
+
+#include "OSTypes.hpp"
+
+namespace ETWP {
+
+inline bool IsKernelModeAddress (UINT_PTR address)
+{
+#ifdef ETWP_64BIT
+    return address & (1ULL << 63);  // Take advantage of the canonical form
+#else
+#error Need to implement this to support 32-bit builds!
+#endif  // #ifdef ETWP_64BIT
+}
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_ADDRESS_HPP
\ No newline at end of file
@@ -1,7 +1,38 @@
 #ifndef ETWP_OS_TYPES_HPP
 #define ETWP_OS_TYPES_HPP
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+// Parts of etwprof that do not depend on Windows (e.g. the per-event filter's data structures) are built on other
+//   platforms as well, for benchmarking purposes. Provide the handful of Windows types they use
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+using UCHAR = uint8_t;
+using USHORT = uint16_t;
+using ULONG = uint32_t;
+using DWORD = uint32_t;
+using UINT64 = uint64_t;
+using ULONGLONG = uint64_t;
+using UINT_PTR = uintptr_t;
+
+struct GUID {
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t  Data4[8];
+};
+
+inline bool operator== (const GUID& lhs, const GUID& rhs)
+{
+    return lhs.Data1 == rhs.Data1 &&
+           lhs.Data2 == rhs.Data2 &&
+           lhs.Data3 == rhs.Data3 &&
+           std::equal (std::begin (lhs.Data4), std::end (lhs.Data4), std::begin (rhs.Data4));
+}
+#endif  // #ifdef _WIN32
 
 namespace ETWP {
 
@@ -12,4 +43,4 @@ const PID InvalidPID = 0;
 
 }   // namespace ETWP
 
-#endif  // #ifndef ETWP_TIME_HPP
\ No newline at end of file
+#endif  // #ifndef ETWP_OS_TYPES_HPP
\ No newline at end of file
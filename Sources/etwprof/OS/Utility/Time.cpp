@@ -1,5 +1,9 @@
 #include "Time.hpp"
 
+#ifndef _WIN32
+#include <chrono>
+#endif  // #ifndef _WIN32
+
 namespace ETWP {
 
 TickCount operator""_tsec (unsigned long long seconds)
@@ -14,7 +18,13 @@ TickCount operator""_tmin (unsigned long long minutes)
 
 TickCount GetTickCount()
 {
+#ifdef _WIN32
 	return GetTickCount64 ();
+#else
+	using namespace std::chrono;
+
+	return duration_cast<milliseconds> (steady_clock::now ().time_since_epoch ()).count ();
+#endif  // #ifdef _WIN32
 }
 
 }   // namespace ETWP
\ No newline at end of file
@@ -1,18 +1,31 @@
 #ifndef ETWP_TIME_HPP
 #define ETWP_TIME_HPP
 
+#include <cstdint>
+
 #include "OSTypes.hpp"
 
 namespace ETWP {
 
 using Timeout = uint32_t;
+#ifdef _WIN32
 const Timeout Infinite = INFINITE;
+#else
+const Timeout Infinite = 0xFFFFFFFF;
+#endif  // #ifdef _WIN32
 
 TickCount operator""_tsec(unsigned long long seconds);
 TickCount operator""_tmin(unsigned long long minutes);
 
 TickCount GetTickCount ();
 
+// Converts a duration in ticks of frequency (e.g. of event timestamps) into ticks of targetFrequency (e.g. 100 ns
+//   units of system time). In two steps, to avoid overflows
+inline int64_t ConvertTicks (int64_t ticks, int64_t frequency, int64_t targetFrequency)
+{
+    return ticks / frequency * targetFrequency + ticks % frequency * targetFrequency / frequency;
+}
+
 }   // namespace ETWP
 
 #endif  // #ifndef ETWP_TIME_HPP
\ No newline at end of file
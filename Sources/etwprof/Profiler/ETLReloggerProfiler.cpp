@@ -4,12 +4,12 @@
 
 #include "Log/Logging.hpp"
 
-#include "OS/ETW/TraceRelogger.hpp"
 #include "OS/FileSystem/Utility.hpp"
 #include "OS/Process/Utility.hpp"
 #include "OS/Synchronization/LockableGuard.hpp"
 #include "OS/Utility/Win32Utils.hpp"
 
+#include "OfflineFilter.hpp"
 #include "ProfilerCommon.hpp"
 
 #include "Utility/Asserts.hpp"
@@ -29,7 +29,9 @@ ETLReloggerProfiler::ETLReloggerProfiler (const std::wstring& inputPath,
     m_profiling (false),
     m_options (static_cast<Options> (options)),
     m_state (State::Unstarted),
-    m_errorFromWorkerThread ()
+    m_errorFromWorkerThread (),
+    m_filterStats (),
+    m_progress ()
 {
     if (!PathValid (m_inputPath))
         throw InitException (L"Input ETL path is invalid!");
@@ -178,14 +180,30 @@ uint32_t ETLReloggerProfiler::GetNumberOfProfiledProcesses ()
     return 1;
 }
 
+bool ETLReloggerProfiler::RequestDump ()
+{
+    return false;   // The whole input is written
+}
+
+FilterStats ETLReloggerProfiler::GetFilterStats ()
+{
+    LockableGuard resultLockGuard (&m_resultLock);
+
+    return m_filterStats;
+}
+
+ProgressSample ETLReloggerProfiler::GetProgress ()
+{
+    return m_progress.Sample ();   // There is no ETW session, so nothing can be lost
+}
+
 void ETLReloggerProfiler::StopImpl ()
 {
     if (ETWP_ERROR (!m_profiling))
         return;
 
-    // We could stop the relogger by calling Cancel on it. However, we can't access the relogger right here, so we
-    //   can't do that w/o code changes. This way Stop will just wait for relogging to finish synchronously, which is
-    //  bad UX. On the other hand, relogging is pretty fast, so this is not a huge problem.
+    // Offline filtering cannot be cancelled, so Stop will just wait for it to finish synchronously, which is bad UX.
+    //   On the other hand, filtering runs at disk speed, so this is not a huge problem.
     
     ETWP_ASSERT (m_hWorkerThread != nullptr);
 
@@ -215,82 +233,74 @@ void ETLReloggerProfiler::Profile ()
 {
     LockableGuard lockGuard (&m_lock);
 
-    // Create copy of data needed by the filtering relogger callback, so it can run lockless
-    ProfileFilterData filterData = { {},
-                                     {m_userProviders.begin (), m_userProviders.end () },
-                                     {},
-                                     {m_targetPID},
-                                     bool (m_options & RecordCSwitches),
-                                     bool (m_options & ProfileChildren) };
+    // Create copy of data needed by the filter, so it can run lockless
+    OfflineFilterOptions filterOptions;
+    filterOptions.targetPIDs = { m_targetPID };
+    filterOptions.userProviderIDs = GetProviderIDs (m_userProviders);
+    filterOptions.cswitch = bool (m_options & RecordCSwitches);
+    filterOptions.profileChildren = bool (m_options & ProfileChildren);
+    filterOptions.imagePathTranslator = PathFromNTPath;
+    filterOptions.imageCachePath = GetImageIdentityCachePath ();
+    filterOptions.eventMetadataSource = GetEventMetadata;
+    filterOptions.compress = bool (m_options & CompressXZ);
+    filterOptions.pProgress = &m_progress;
 
     // These will be used later, we create a copy as well (so no locking will be required)
+    std::wstring inputPath = m_inputPath;
     std::wstring outputPath = m_outputPath;
-    std::wstring rawOutputPath = m_outputPath + L".raw.etl";
+    std::wstring writerOutputPath = GetWriterOutputPath (m_outputPath, m_options);
     bool debug = m_options & Debug;
-    bool compress = m_options & Compress;
-
-    try {
-        ProfileEventFilter eventFilter (filterData);
-        TraceRelogger filteringRelogger (&eventFilter,
-                                         rawOutputPath,
-                                         m_options & Compress);
-
-        std::wstring errorMsg;
-        if (ETWP_ERROR (!filteringRelogger.AddTraceFile (m_inputPath, &errorMsg))) {
-            LockableGuard resultLockGuard (&m_resultLock);
-
-            m_state = State::Error;
-            m_errorFromWorkerThread = L"Unable to add input ETL file to filtering relogger: " + errorMsg;
-
-            return;
-        }
 
-        // Note: we unlock the lock, so the relogging process can run lock free
-        lockGuard.Unlock ();
+    // Note: we unlock the lock, so filtering can run lock free
+    lockGuard.Unlock ();
 
-        // This will call back FilterEventForProfiling
-        if (ETWP_ERROR (!filteringRelogger.StartRelogging (&errorMsg))) {
-            LockableGuard resultLockGuard (&m_resultLock);
+    // The file written is deleted, unless it's the output, and the trace is finalized successfully
+    OnExit writerOutputDeleter ([&writerOutputPath]() {
+        if (PathExists (writerOutputPath) && ETWP_ERROR (!FileDelete (writerOutputPath)))
+            Log (LogSeverity::Debug, L"Unable to delete ETL file written!");
+    });
 
-            m_state = State::Error;
-            m_errorFromWorkerThread = L"Unable to start relogger: " + errorMsg;
+    if (debug)
+        writerOutputDeleter.Deactivate ();
 
-            return;
-        }
-    } catch (const TraceRelogger::InitException& e) {
+    OfflineFilterStats stats;
+    std::wstring errorMsg;
+    if (ETWP_ERROR (!FilterETLFile (inputPath, writerOutputPath, filterOptions, &stats, &errorMsg))) {
         LockableGuard resultLockGuard (&m_resultLock);
 
         m_state = State::Error;
-        m_errorFromWorkerThread = L"Unable to construct filtering relogger: " + e.GetMsg ();
+        m_errorFromWorkerThread = errorMsg;
 
         return;
     }
 
-    // This point is reached, when the original ETW session is stopped
+    {
+        LockableGuard resultLockGuard (&m_resultLock);
 
-    OnExit rawETLDeleter ([&rawOutputPath]() {
-        // Delete temporary (unmerged) file
-        if (ETWP_ERROR (!FileDelete (rawOutputPath)))
-            Log (LogSeverity::Debug, L"Unable to delete raw ETL file!");
-    });
+        m_filterStats = stats.filterStats;
+    }
 
-    if (debug)
-        rawETLDeleter.Deactivate ();
+    Log (LogSeverity::Info, L"Offline filter: " + std::to_wstring (stats.nEventsKept) + L" of " +
+         std::to_wstring (stats.nEventsRead) + L" events kept");
+    LogETLWriterStats (stats.writerStats);
+    LogImageIdentityResolverStats (stats.imageResolverStats);
+    LogImageIdentityStats (stats.imageIdentityStats);
+    LogEventMetadataStats (stats.eventMetadataStats);
 
-    DWORD mergeFlags = EVENT_TRACE_MERGE_EXTENDED_DATA_IMAGEID |
-                       EVENT_TRACE_MERGE_EXTENDED_DATA_EVENT_METADATA;
-    if (compress)
-        mergeFlags |= EVENT_TRACE_MERGE_EXTENDED_DATA_COMPRESS_TRACE;
+    // This point is reached, when the whole input file is filtered
 
-    std::wstring mergeErrorMsg;
-    if (ETWP_ERROR (!MergeTrace (rawOutputPath, mergeFlags, outputPath, &mergeErrorMsg))) {
+    std::wstring finalizeErrorMsg;
+    if (ETWP_ERROR (!FinalizeTrace (writerOutputPath, outputPath, &finalizeErrorMsg))) {
         LockableGuard resultLockGuard (&m_resultLock);
 
         m_state = State::Error;
-        m_errorFromWorkerThread = L"Debug info merge failed: " + mergeErrorMsg;
+        m_errorFromWorkerThread = L"Unable to finalize output ETL file: " + finalizeErrorMsg;
 
         return;
     }
+
+    if (writerOutputPath == outputPath)
+        writerOutputDeleter.Deactivate ();
 }
 
 void ETLReloggerProfiler::CloseHandles ()
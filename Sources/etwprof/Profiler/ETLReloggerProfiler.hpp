@@ -11,14 +11,10 @@
 
 #include "IETWBasedProfiler.hpp"
 
-struct ITraceEvent;
-
 namespace ETWP {
 
-class TraceRelogger;
-
 // Thread-safe class (except when stated otherwise) that can emulate ETW
-//   profiling by relogging an ETL file
+//   profiling by filtering an existing ETL file (see FilterETLFile)
 class ETLReloggerProfiler final : public IETWBasedProfiler {
 public:
     ETLReloggerProfiler (const std::wstring& inputPath,
@@ -37,10 +33,16 @@ public:
 
     virtual uint32_t GetNumberOfProfiledProcesses () override;
 
+    virtual bool RequestDump () override;
+
+    virtual FilterStats GetFilterStats () override;
+
+    virtual ProgressSample GetProgress () override;
+
 private:
     // See the comment in ETLProfiler.hpp as for why we need two locks
-    CriticalSection m_lock;         // Lock guarding everything, except m_result and m_errorFromWorkerThread
-    CriticalSection m_resultLock;   // Lock guarding m_result and m_errorFromWorkerThread
+    CriticalSection m_lock;         // Lock guarding everything, except the members guarded by m_resultLock
+    CriticalSection m_resultLock;   // Lock guarding m_result, m_errorFromWorkerThread and m_filterStats
 
     HANDLE m_hWorkerThread;
 
@@ -55,6 +57,9 @@ private:
 
     State        m_state;
     std::wstring m_errorFromWorkerThread;
+    FilterStats  m_filterStats;
+
+    ProgressCounters m_progress;   // Updated without locking (see ProgressCounters)
 
     void StopImpl ();   // Not thread safe
 
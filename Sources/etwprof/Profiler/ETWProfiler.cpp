@@ -1,16 +1,18 @@
 #include "ETWProfiler.hpp"
 
 #include <process.h>
+#include <memory>
 #include <string>
-#include <unordered_set>
 #include <vector>
 
 #include "Log/Logging.hpp"
 
 #include "OS/ETW/ETWConstants.hpp"
 #include "OS/ETW/ETWSessionCommon.hpp"
-#include "OS/ETW/TraceRelogger.hpp"
 #include "OS/ETW/CombinedETWSession.hpp"
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/SessionSizing.hpp"
+#include "OS/ETW/TraceConsumer.hpp"
 
 #include "OS/FileSystem/Utility.hpp"
 
@@ -20,6 +22,7 @@
 #include "OS/Synchronization/LockableGuard.hpp"
 
 #include "ProfilerCommon.hpp"
+#include "RelogPipeline.hpp"
 
 #include "Utility/Asserts.hpp"
 #include "Utility/GUID.hpp"
@@ -31,9 +34,16 @@ ETWProfiler::ETWProfiler (const std::wstring& outputPath,
                           const std::vector<PID>& targetPIDs,
                           const ProfileRate& samplingRate,
                           IETWBasedProfiler::Flags options,
-                          FinishCriterion finishCriterion):
+                          FinishCriterion finishCriterion,
+                          const OutputRotationConfig& rotation,
+                          const FlightRecorderConfig& flightRecorder,
+                          const TriggerRule& trigger,
+                          const StackAggregatorConfig& aggregate,
+                          const ModuleFilterConfig& moduleFilter,
+                          const ReorderWindowConfig& reorder):
     m_lock (),
     m_resultLock (),
+    m_flightRecorderLock (),
     m_hWorkerThread (nullptr),
     m_ETWSession (nullptr),
     m_originalTargets (),
@@ -41,9 +51,18 @@ ETWProfiler::ETWProfiler (const std::wstring& outputPath,
     m_samplingRate (samplingRate),
     m_options (static_cast<Options> (options)),
     m_finishCriterion (finishCriterion),
+    m_rotation (rotation),
+    m_flightRecorderConfig (flightRecorder),
+    m_pFlightRecorder (nullptr),
+    m_trigger (trigger),
+    m_aggregate (aggregate),
+    m_moduleFilter (moduleFilter),
+    m_reorder (reorder),
     m_outputPath (outputPath),
     m_state (State::Unstarted),
-    m_errorFromWorkerThread ()
+    m_errorFromWorkerThread (),
+    m_filterStats (),
+    m_progress ()
 {
     if (!PathValid (m_outputPath))
         throw InitException (L"Output ETL path is invalid!");
@@ -87,9 +106,23 @@ ETWProfiler::ETWProfiler (const std::wstring& outputPath,
     if (m_options & RecordCSwitches)
         kProfilingFlags |= EVENT_TRACE_FLAG_CSWITCH | EVENT_TRACE_FLAG_DISPATCHER;
 
-    m_ETWSession.reset (new CombinedETWSession (GenerateETWSessionName (), kProfilingFlags));
+    // Buffers are sized for the expected amount of events, otherwise ETW loses buffers on machines with lots of
+    //   processors, or at high sampling rates. If the rate is not set, the current one will be used
+    ProfileRate expectedRate = m_samplingRate;
+    if (expectedRate == InvalidProfileRate && !GetGlobalSamplingRate (&expectedRate))
+        expectedRate = ConvertSamplingRateFromHz (1'000);
+
+    const SessionLoad load = { GetActiveProcessorCount (ALL_PROCESSOR_GROUPS),
+                               ConvertSamplingRateToHz (expectedRate),
+                               bool (m_options & RecordCSwitches) };
+    const SessionBufferConfig bufferConfig = GetSessionBufferConfig (load);
+
+    m_ETWSession.reset (new CombinedETWSession (GenerateETWSessionName (), kProfilingFlags, bufferConfig));
 
     Log (LogSeverity::Debug, L"ETW session name of profiler will be: " + m_ETWSession->GetName ());
+    Log (LogSeverity::Debug, L"ETW session buffers: " + std::to_wstring (bufferConfig.bufferSize) + L" KB, " +
+         std::to_wstring (bufferConfig.minimumBuffers) + L" to " + std::to_wstring (bufferConfig.maximumBuffers) +
+         L" buffers (expecting " + std::to_wstring (EstimateSessionBytesPerSecond (load) / 1'024) + L" KB/s)");
 }
 
 ETWProfiler::~ETWProfiler ()
@@ -238,6 +271,41 @@ uint32_t ETWProfiler::GetNumberOfProfiledProcesses ()
     return m_originalTargets.GetWaitingSize () + m_additionalTargets.GetWaitingSize ();
 }
 
+FilterStats ETWProfiler::GetFilterStats ()
+{
+    LockableGuard resultLockGuard (&m_resultLock);
+
+    return m_filterStats;
+}
+
+ProgressSample ETWProfiler::GetProgress ()
+{
+    ProgressSample sample = m_progress.Sample ();
+
+    // The session is created in the constructor, and its name never changes, so no locking is needed. Querying fails
+    //   if the session is not running (yet, or anymore), then there is nothing lost to report
+    EVENT_TRACE_PROPERTIES properties;
+    if (QueryETWSession (m_ETWSession->GetName (), &properties)) {
+        sample.nEventsLost = properties.EventsLost;
+        sample.nBuffersLost = properties.LogBuffersLost;
+        sample.nRealTimeBuffersLost = properties.RealTimeBuffersLost;
+    }
+
+    return sample;
+}
+
+bool ETWProfiler::RequestDump ()
+{
+    LockableGuard lockGuard (&m_flightRecorderLock);
+
+    if (m_pFlightRecorder == nullptr)
+        return false;
+
+    m_pFlightRecorder->RequestDump ();
+
+    return true;
+}
+
 unsigned int ETWProfiler::ProfileHelper (void* instance)
 {
     ETWProfiler* pInstance = static_cast<ETWProfiler*> (instance);
@@ -283,32 +351,46 @@ void ETWProfiler::Profile ()
 
     ETWP_DEBUG_ONLY (OnExit stateChecker ([this]() { ETWP_ASSERT (GetState () != State::Running); }));
 
-    std::unordered_set<DWORD> targetPIDs;
+    IDRegistry targetPIDs;
     for (const auto& [pid, _] : m_originalTargets)
-        targetPIDs.insert (pid);
+        targetPIDs.Add (pid);
 
-    // Create copy of data needed by the filtering relogger callback, so it can run lockless
+    // Create copy of data needed by the filter callback, so it can run lockless
     ProfileFilterData filterData = { { },
-                                     { m_userProviders.begin (), m_userProviders.end () },
+                                     GetProviderIDs (m_userProviders),
                                      {},
                                      std::move (targetPIDs),
                                      bool (m_options & RecordCSwitches),
                                      bool (m_options & ProfileChildren) };
 
     // These will be used later, we create a copy as well (so no locking will be required)
-    std::wstring outputPath = m_outputPath;
-    std::wstring rawOutputPath = m_outputPath + L".raw.etl";
-    bool debug = m_options & Debug;
-    bool compress = m_options & Compress;
+    const std::wstring outputPath = m_outputPath;
+    const IETWBasedProfiler::Flags options = m_options;
+    const OutputRotationConfig rotation = m_rotation;
+    const FlightRecorderConfig flightRecorderConfig = m_flightRecorderConfig;
+    const TriggerRule trigger = m_trigger;
+    const StackAggregatorConfig aggregate = m_aggregate;
+    const ModuleFilterConfig moduleFilter = m_moduleFilter;
+    const ReorderWindowConfig reorder = m_reorder;
+
+    // Images are read on a background thread, when their first load (or rundown) event is written. Events are held
+    //   back (in order) until then, so consuming does not wait for the disk (see ImageIdentitySink)
+    const std::wstring imageCachePath = GetImageIdentityCachePath ();
+    std::unique_ptr<ImageIdentityCache> imageCache;
+    if (!imageCachePath.empty ())
+        imageCache = std::make_unique<ImageIdentityCache> (imageCachePath);
+
+    ImageIdentityResolver imageResolver (PathFromNTPath, imageCache.get ());
+
+    // If the output is rotated, it's finished by the rotating sink (segment by segment), otherwise here
+    std::unique_ptr<ETLOutputSegment> output;
 
     try {
-        // Create and set up the relogger before starting the kernel logger. This way we minimize the time between
-        // relogging (~consuming) events, and the kernel logger emitting events into buffers
+        // Create and set up the consumer before starting the kernel logger. This way we minimize the time between
+        // consuming events, and the kernel logger emitting events into buffers
         ProfileEventFilter eventFilter (filterData);
         eventFilter.Attach (this);
-        TraceRelogger filteringRelogger (&eventFilter,
-                                         rawOutputPath,
-                                         m_options & Compress);
+        TraceConsumer consumer (&eventFilter);
 
         if (ETWP_ERROR (!m_ETWSession->Start ())) {
             SetErrorFromWorkerThread (L"Unable to start ETW session!");
@@ -345,7 +427,7 @@ void ETWProfiler::Profile ()
             return;
         }
 
-        for (auto&& providerInfo : filterData.userProviders) {
+        for (auto&& providerInfo : m_userProviders) {
             if (ETWP_ERROR (!m_ETWSession->EnableProvider (&providerInfo.providerID,
                                                              providerInfo.stack,
                                                              providerInfo.level,
@@ -370,40 +452,215 @@ void ETWProfiler::Profile ()
         }
 
         std::wstring errorMsg;
-        if (ETWP_ERROR (!filteringRelogger.AddRealTimeSession (*m_ETWSession.get (), &errorMsg))) {
-            SetErrorFromWorkerThread (L"Unable to add ETW session to filtering relogger: " + errorMsg);
+        if (ETWP_ERROR (!consumer.OpenRealTimeSession (*m_ETWSession.get (), &errorMsg))) {
+            SetErrorFromWorkerThread (L"Unable to open ETW session for consuming: " + errorMsg);
 
             return;
         }
 
-        // Note: we unlock the lock, so the relogging process can run lock free
+        ETLWriterConfig writerConfig = CreateETLWriterConfig (consumer.GetLogfileHeader (), true);
+        writerConfig.compress = options & CompressXZ;
+        filterData.threads.SetTimestampFrequency (writerConfig.perfFreq);
+        if (reorder.IsEnabled ())
+            eventFilter.EnableReorderWindow (reorder, writerConfig.perfFreq);
+
+        // Rotated outputs, flight recorder dumps and triggered periods are written as segments
+        const OutputSegmentFactory segmentFactory = [&] (uint32_t segmentNumber,
+                                                         int64_t startTimeStamp,
+                                                         std::wstring* pErrorOut) -> std::unique_ptr<IOutputSegment>
+        {
+            const std::wstring segmentPath = GetSegmentPath (outputPath, segmentNumber);
+            try {
+                return std::make_unique<ETLOutputSegment> (segmentPath,
+                                                           GetSegmentWriterConfig (writerConfig, startTimeStamp),
+                                                           options,
+                                                           &imageResolver,
+                                                           filterData.userProviderIDs);
+            } catch (const ETLWriter::InitException& e) {
+                *pErrorOut = L"Unable to create output segment " + segmentPath + L": " + e.GetMsg ();
+
+                return nullptr;
+            }
+        };
+
+        std::unique_ptr<RotatingSink> rotatingSink;
+        std::unique_ptr<FlightRecorder> flightRecorder;
+        std::unique_ptr<TriggeredSink> triggeredSink;
+        std::unique_ptr<StackAggregator> stackAggregator;
+        IEventSink* pOutputSink = nullptr;
+        if (aggregate.IsEnabled ()) {
+            StackAggregatorConfig aggregatorConfig = aggregate;
+            aggregatorConfig.perfFreq = writerConfig.perfFreq;
+            aggregatorConfig.startTimeStamp = writerConfig.startTimeStamp;
+            aggregatorConfig.startSystemTime = writerConfig.startSystemTime;
+
+            ProfileRate currentRate (InvalidProfileRate);
+            if (ETWP_VERIFY (GetGlobalSamplingRate (&currentRate)))
+                aggregatorConfig.samplingInterval = static_cast<uint64_t> (currentRate.count () * 1'000'000);
+
+            stackAggregator = std::make_unique<StackAggregator> (aggregatorConfig, &imageResolver);
+            pOutputSink = stackAggregator.get ();
+        } else if (flightRecorderConfig.IsEnabled ()) {
+            flightRecorder = std::make_unique<FlightRecorder> (segmentFactory,
+                                                               flightRecorderConfig,
+                                                               writerConfig.perfFreq);
+            pOutputSink = flightRecorder.get ();
+        } else if (trigger.IsEnabled ()) {
+            triggeredSink = std::make_unique<TriggeredSink> (segmentFactory, trigger, writerConfig.perfFreq);
+            pOutputSink = triggeredSink.get ();
+        } else if (rotation.IsEnabled ()) {
+            try {
+                rotatingSink = std::make_unique<RotatingSink> (segmentFactory, rotation, writerConfig.perfFreq);
+            } catch (const RotatingSink::InitException& e) {
+                SetErrorFromWorkerThread (e.GetMsg ());
+
+                return;
+            }
+
+            pOutputSink = rotatingSink.get ();
+        } else {
+            output = std::make_unique<ETLOutputSegment> (outputPath,
+                                                         writerConfig,
+                                                         options,
+                                                         &imageResolver,
+                                                         filterData.userProviderIDs);
+            pOutputSink = output->GetSink ();
+        }
+
+        // Samples are filtered right before being written, as (unlike the per-event filter) this has to wait for their
+        //   stacks. Since events are only held back (never reordered), this works with any of the outputs above
+        std::unique_ptr<ModuleSampleFilter> moduleSampleFilter;
+        if (moduleFilter.IsEnabled ()) {
+            moduleSampleFilter = std::make_unique<ModuleSampleFilter> (pOutputSink,
+                                                                       moduleFilter,
+                                                                       writerConfig.perfFreq);
+            pOutputSink = moduleSampleFilter.get ();
+        }
+
+        // Bytes are counted when the output accepts an event, on the thread writing it (see ProgressCountingSink)
+        ProgressCountingSink progressSink (pOutputSink, &m_progress);
+        pOutputSink = &progressSink;
+        eventFilter.SetProgressCounters (&m_progress);
+
+        // Dumps can be requested from now on (until the flight recorder is closed)
+        SetFlightRecorder (flightRecorder.get ());
+        OnExit flightRecorderResetter ([this]() { SetFlightRecorder (nullptr); });
+
+        eventFilter.SetSink (pOutputSink);
+
+        // In pipelined mode, kept events are written by a separate thread, so writing does not hold up consuming
+        std::unique_ptr<RelogPipeline> pipeline;
+        if (options & Pipeline) {
+            pipeline = std::make_unique<RelogPipeline> (pOutputSink);
+            eventFilter.SetPipeline (pipeline.get ());
+        }
+
+        OnExit pipelineStatsLogger ([&pipeline]() {
+            if (pipeline != nullptr) {
+                pipeline->Finish ();    // In case filtering did not finish normally
+                LogRelogPipelineStats (pipeline->GetStats ());
+            }
+        });
+
+        // Note: we unlock the lock, so consuming can run lock free
         lockGuard.Unlock ();
 
         SetState (State::Running);
 
         // This will call back FilterEventForProfiling
-        if (ETWP_ERROR (!filteringRelogger.StartRelogging (&errorMsg))) {
-            SetErrorFromWorkerThread (L"Unable to start relogger: " + errorMsg);
+        if (ETWP_ERROR (!consumer.StartProcessing (&errorMsg))) {
+            SetErrorFromWorkerThread (L"Unable to consume ETW session: " + errorMsg);
 
             return;
         }
 
         // At this point, the session must already be stopped, so no need for this
         etwSessionDestroyer.Deactivate ();
-    } catch (const TraceRelogger::InitException& e) {
-        SetErrorFromWorkerThread (L"Unable to construct filtering relogger: " + e.GetMsg ());
 
-        return;
-    }
+        {
+            LockableGuard resultLockGuard (&m_resultLock);
+
+            m_filterStats = eventFilter.GetStats ();
+        }
+
+        if (reorder.IsEnabled ())
+            LogReorderWindowStats (eventFilter.GetReorderWindowStats ());
+
+        if (options & StackCache)
+            LogStackKeyTableStats (filterData.stackKeys.GetStats ());
+
+        if (moduleSampleFilter != nullptr) {
+            // Filtering (and with it, the pipeline) is finished by now, so what's held back can be written
+            const bool flushed = moduleSampleFilter->Flush ();
+            LogModuleSampleFilterStats (moduleSampleFilter->GetStats ());
+            if (ETWP_ERROR (!flushed)) {
+                SetErrorFromWorkerThread (L"Unable to write held back events!");
+
+                return;
+            }
+
+            if (!moduleFilter.countersPath.empty () &&
+                !moduleSampleFilter->WriteThreadCounters (moduleFilter.countersPath, &errorMsg))
+            {
+                Log (LogSeverity::Warning, errorMsg);
+            }
+        }
 
-    OnExit rawETLDeleter ([&rawOutputPath]() {
-        // Delete temporary (unmerged) file
-        if (ETWP_ERROR (!FileDelete (rawOutputPath)))
-            Log (LogSeverity::Debug, L"Unable to delete raw ETL file!");
-    });
+        if (stackAggregator != nullptr) {
+            const bool written = stackAggregator->WriteProfile (outputPath, &errorMsg);
+            LogStackAggregatorStats (stackAggregator->GetStats ());
+            if (ETWP_ERROR (!written)) {
+                SetErrorFromWorkerThread (errorMsg);
+
+                return;
+            }
+        } else if (flightRecorder != nullptr) {
+            // What's in memory is dumped, unless profiling was aborted
+            flightRecorderResetter.Trigger ();
+            const bool closed = flightRecorder->Close (GetState () != State::Aborted, &errorMsg);
+            LogFlightRecorderStats (flightRecorder->GetStats ());
+            if (ETWP_ERROR (!closed)) {
+                SetErrorFromWorkerThread (L"Unable to write flight recorder dumps: " + errorMsg);
 
-    if (debug)
-        rawETLDeleter.Deactivate ();
+                return;
+            }
+        } else if (triggeredSink != nullptr) {
+            const bool closed = triggeredSink->Close (&errorMsg);
+            LogTriggeredSinkStats (triggeredSink->GetStats ());
+            if (ETWP_ERROR (!closed)) {
+                SetErrorFromWorkerThread (L"Unable to write output segments: " + errorMsg);
+
+                return;
+            }
+        } else if (rotatingSink != nullptr) {
+            // Sealed segments are finished already (or they are being finished), only the last one remains
+            const bool closed = rotatingSink->Close (&errorMsg);
+            LogRotatingSinkStats (rotatingSink->GetStats ());
+            if (ETWP_ERROR (!closed)) {
+                SetErrorFromWorkerThread (L"Unable to write output segments: " + errorMsg);
+
+                return;
+            }
+        } else if (ETWP_ERROR (!output->Close (&errorMsg))) {
+            SetErrorFromWorkerThread (L"Unable to write output ETL file: " + errorMsg);
+
+            return;
+        }
+
+        LogImageIdentityResolverStats (imageResolver.GetStats ());
+
+        std::wstring cacheErrorMsg;
+        if (imageCache != nullptr && !imageCache->Save (&cacheErrorMsg))
+            Log (LogSeverity::Debug, L"Unable to update image identity cache: " + cacheErrorMsg);
+    } catch (const ETLWriter::InitException& e) {
+        SetErrorFromWorkerThread (L"Unable to create output ETL file: " + e.GetMsg ());
+
+        return;
+    } catch (const EventDispatchTable::FullException& e) {
+        SetErrorFromWorkerThread (L"Unable to set up event filtering: " + e.GetMsg ());
+
+        return;
+    }
 
 	// The kernel session stopped, possible causes:
 	// a.) the target process(es) exited (detected by IsFinished)
@@ -417,16 +674,14 @@ void ETWProfiler::Profile ()
     const State currentState = GetState ();
     ETWP_ASSERT (currentState != State::Running && currentState != State::Unstarted);
 
-    if (currentState == IProfiler::State::Aborted)
+    // Note: finished segments of a rotated (or triggered) output, dumps or aggregated profiles are kept, even if
+    //   profiling was aborted
+    if (currentState == IProfiler::State::Aborted || output == nullptr)
         return;
 
-    DWORD mergeFlags = EVENT_TRACE_MERGE_EXTENDED_DATA_IMAGEID | EVENT_TRACE_MERGE_EXTENDED_DATA_EVENT_METADATA;
-    if (compress)
-        mergeFlags |= EVENT_TRACE_MERGE_EXTENDED_DATA_COMPRESS_TRACE;
-
-    std::wstring mergeErrorMsg;
-    if (ETWP_ERROR (!MergeTrace (rawOutputPath, mergeFlags, outputPath, &mergeErrorMsg))) {
-        SetErrorFromWorkerThread (L"Debug info merge failed: " + mergeErrorMsg);
+    std::wstring finalizeErrorMsg;
+    if (ETWP_ERROR (!output->Finalize (&finalizeErrorMsg))) {
+        SetErrorFromWorkerThread (L"Unable to finalize output ETL file: " + finalizeErrorMsg);
 
         return;
     }
@@ -454,6 +709,13 @@ void ETWProfiler::CloseHandles ()
     }
 }
 
+void ETWProfiler::SetFlightRecorder (FlightRecorder* pFlightRecorder)
+{
+    LockableGuard lockGuard (&m_flightRecorderLock);
+
+    m_pFlightRecorder = pFlightRecorder;
+}
+
 void ETWProfiler::SetErrorFromWorkerThread (const std::wstring& message)
 {
 	LockableGuard resultLockGuard (&m_resultLock);
@@ -7,7 +7,13 @@
 #include <string>
 #include <vector>
 
+#include "FlightRecorder.hpp"
 #include "IETWBasedProfiler.hpp"
+#include "ModuleFilter.hpp"
+#include "OutputRotation.hpp"
+#include "ReorderWindow.hpp"
+#include "StackAggregator.hpp"
+#include "TriggerRules.hpp"
 
 #include "OS/ETW/CombinedETWSession.hpp"
 
@@ -17,12 +23,8 @@
 #include "OS/Synchronization/CriticalSection.hpp"
 #include "OS/Utility/ProfileInterruptRate.hpp"
 
-struct ITraceEvent;
-
 namespace ETWP {
 
-class TraceRelogger;
-
 // Thread-safe class (except when stated otherwise) that can profile a process using ETW. It's also an event source for
 //   the lifetime of profiled processes
 class ETWProfiler final : public IETWBasedProfiler, public ProcessLifetimeObserver {
@@ -45,7 +47,13 @@ public:
                  const std::vector<PID>& targetPIDs,
                  const ProfileRate& samplingRate,
                  IETWBasedProfiler::Flags options,
-                 FinishCriterion finishCriterion = FinishCriterion::AllTargetsFinished);
+                 FinishCriterion finishCriterion = FinishCriterion::AllTargetsFinished,
+                 const OutputRotationConfig& rotation = {},  // If enabled, segments are written (see GetSegmentPath)
+                 const FlightRecorderConfig& flightRecorder = {},   // If enabled, only dumps are written
+                 const TriggerRule& trigger = {},   // If enabled, segments are written while the rule says so
+                 const StackAggregatorConfig& aggregate = {},   // If enabled, a pprof profile is written instead
+                 const ModuleFilterConfig& moduleFilter = {},   // If enabled, samples outside the modules are dropped
+                 const ReorderWindowConfig& reorder = {});  // If enabled, events of unknown threads are held back
     virtual ~ETWProfiler () override;
 
     virtual bool Start (std::wstring* pErrorOut) override;
@@ -58,6 +66,12 @@ public:
 
     virtual uint32_t GetNumberOfProfiledProcesses () override;
 
+    virtual bool RequestDump () override;
+
+    virtual FilterStats GetFilterStats () override;
+
+    virtual ProgressSample GetProgress () override;
+
 private:
     using ProviderInfos = std::vector<IETWBasedProfiler::ProviderInfo>;
 
@@ -67,8 +81,9 @@ private:
     //   fine-grained locking)
     //
     // Make sure to acquire these in order, if you need both
-    CriticalSection m_lock;         // Lock guarding everything, except m_result and m_errorFromWorkerThread
-    CriticalSection m_resultLock;   // Lock guarding m_result and m_errorFromWorkerThread
+    CriticalSection m_lock;         // Lock guarding everything, except the members guarded by m_resultLock
+    CriticalSection m_resultLock;   // Lock guarding m_result, m_errorFromWorkerThread and m_filterStats
+    CriticalSection m_flightRecorderLock;   // Lock guarding m_pFlightRecorder only (never held with the others)
     HANDLE m_hWorkerThread;
 
     std::unique_ptr<CombinedETWSession> m_ETWSession;
@@ -80,10 +95,20 @@ private:
     ProfileRate                m_samplingRate;
     IETWBasedProfiler::Options m_options;
     FinishCriterion            m_finishCriterion;
+    OutputRotationConfig       m_rotation;
+    FlightRecorderConfig       m_flightRecorderConfig;
+    FlightRecorder*            m_pFlightRecorder;  // While profiling in flight recorder mode
+    TriggerRule                m_trigger;
+    StackAggregatorConfig      m_aggregate;
+    ModuleFilterConfig         m_moduleFilter;
+    ReorderWindowConfig        m_reorder;
     std::wstring               m_outputPath;
 
     State m_state;
     std::wstring m_errorFromWorkerThread;
+    FilterStats m_filterStats;
+
+    ProgressCounters m_progress;   // Updated without locking (see ProgressCounters)
 
     static unsigned int ProfileHelper (void* instance);
 
@@ -99,6 +124,8 @@ private:
     std::wstring GenerateETWSessionName ();
     void CloseHandles ();   // Not thread safe
 
+    void  SetFlightRecorder (FlightRecorder* pFlightRecorder);
+
     void  SetErrorFromWorkerThread (const std::wstring& message);
     void  SetState (State newState);
     State GetState ();
@@ -0,0 +1,167 @@
+#include "EventDispatchTable.hpp"
+
+#include <string>
+
+#include "OS/ETW/ETWConstants.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+namespace {
+
+constexpr uint64_t kMaxSeedAttempts = 1'024;    // Per table size
+constexpr uint32_t kMaxSizeLog2 = 16;
+
+constexpr GUID kKernelProviderIDs[] = { StackWalkGuid,
+                                        PerfInfoGuid,
+                                        ThreadGuid,
+                                        ProcessGuid,
+                                        ImageLoadGuid,
+                                        EventTraceEventGuid };
+
+constexpr uint64_t kKernelProviderSeed = EventDispatchTable::FindPerfectSeed (kKernelProviderIDs,
+                                                                              EventDispatchTable::kMinSizeLog2,
+                                                                              kMaxSeedAttempts);
+static_assert (kKernelProviderSeed != 0, "No perfect hash seed for the kernel providers, adjust EventDispatchTable!");
+
+constexpr bool IsNullGUID (const GUID& guid)
+{
+    return EventDispatchTable::GUIDEquals (guid, GUID {});
+}
+
+}   // namespace
+
+EventDispatchTable::FullException::FullException (const std::wstring& msg): Exception (msg)
+{
+}
+
+EventDispatchTable::EventDispatchTable (): EventDispatchTable (1, kMinSizeLog2)
+{
+}
+
+EventDispatchTable::EventDispatchTable (uint64_t seed, uint32_t sizeLog2):
+    m_entries (size_t (1) << sizeLog2, Entry { {}, {} }),
+    m_seed (seed),
+    m_sizeLog2 (sizeLog2),
+    m_nProviders (0)
+{
+    ETWP_ASSERT (sizeLog2 >= 1 && sizeLog2 <= kMaxSizeLog2);
+}
+
+void EventDispatchTable::SetHandler (const GUID& providerID, UCHAR opcode, Handler handler)
+{
+    GetOrCreateEntry (providerID).handlers[opcode] = handler;
+}
+
+void EventDispatchTable::SetHandler (const GUID& providerID, Handler handler)
+{
+    GetOrCreateEntry (providerID).handlers.fill (handler);
+}
+
+bool EventDispatchTable::ContainsProvider (const GUID& providerID) const
+{
+    const Entry& entry = m_entries[GetSlotIndex (HashGUID (providerID, m_seed), m_sizeLog2)];
+
+    return !IsNullGUID (providerID) && GUIDEquals (entry.providerID, providerID);
+}
+
+size_t EventDispatchTable::GetNumberOfProviders () const
+{
+    return m_nProviders;
+}
+
+size_t EventDispatchTable::GetSize () const
+{
+    return m_entries.size ();
+}
+
+EventDispatchTable::Entry& EventDispatchTable::GetOrCreateEntry (const GUID& providerID)
+{
+    ETWP_ASSERT (!IsNullGUID (providerID));
+
+    Entry* pEntry = &m_entries[GetSlotIndex (HashGUID (providerID, m_seed), m_sizeLog2)];
+    if (GUIDEquals (pEntry->providerID, providerID))
+        return *pEntry;
+
+    if (!IsNullGUID (pEntry->providerID)) {
+        // Collision, the table has to be rebuilt with a different seed (and possibly size)
+        Rehash (providerID);
+
+        pEntry = &m_entries[GetSlotIndex (HashGUID (providerID, m_seed), m_sizeLog2)];
+    }
+
+    pEntry->providerID = providerID;
+    ++m_nProviders;
+
+    return *pEntry;
+}
+
+void EventDispatchTable::Rehash (const GUID& newProviderID)
+{
+    std::vector<GUID> providerIDs;
+    for (const Entry& entry : m_entries) {
+        if (!IsNullGUID (entry.providerID))
+            providerIDs.push_back (entry.providerID);
+    }
+
+    providerIDs.push_back (newProviderID);
+
+    for (uint32_t sizeLog2 = m_sizeLog2; sizeLog2 <= kMaxSizeLog2; ++sizeLog2) {
+        const uint64_t seed = FindPerfectSeed (providerIDs, sizeLog2, kMaxSeedAttempts);
+        if (seed == 0)
+            continue;
+
+        std::vector<Entry> entries (size_t (1) << sizeLog2, Entry { {}, {} });
+        for (const Entry& entry : m_entries) {
+            if (!IsNullGUID (entry.providerID))
+                entries[GetSlotIndex (HashGUID (entry.providerID, seed), sizeLog2)] = entry;
+        }
+
+        m_entries = std::move (entries);
+        m_seed = seed;
+        m_sizeLog2 = sizeLog2;
+
+        return;
+    }
+
+    // With a couple dozen providers at most, this is practically impossible. Still, overwriting the entry of another
+    //   provider would silently misdispatch its events, so give up instead
+    throw FullException (L"Unable to fit " + std::to_wstring (providerIDs.size ()) +
+                         L" providers into the event dispatch table!");
+}
+
+EventDispatchTable CreateProfileDispatchTable (bool cswitch, std::span<const GUID> userProviderIDs)
+{
+    using Handler = EventDispatchTable::Handler;
+
+    EventDispatchTable table (kKernelProviderSeed, EventDispatchTable::kMinSizeLog2);
+
+    table.SetHandler (StackWalkGuid, Handler::StackWalk);
+    table.SetHandler (PerfInfoGuid, ETWConstants::SampledProfileOpcode, Handler::SampledProfile);
+
+    table.SetHandler (ThreadGuid, ETWConstants::TStartOpcode, Handler::Thread);
+    table.SetHandler (ThreadGuid, ETWConstants::TDCStartOpcode, Handler::Thread);
+    table.SetHandler (ThreadGuid, ETWConstants::TEndOpcode, Handler::Thread);
+    table.SetHandler (ThreadGuid, ETWConstants::TDCEndOpcode, Handler::Thread);
+    if (cswitch) {
+        table.SetHandler (ThreadGuid, ETWConstants::ReadyThreadOpcode, Handler::ContextSwitch);
+        table.SetHandler (ThreadGuid, ETWConstants::CSwitchOpcode, Handler::ContextSwitch);
+    }
+
+    table.SetHandler (ProcessGuid, Handler::Process);
+    table.SetHandler (ImageLoadGuid, Handler::ImageLoad);
+    table.SetHandler (EventTraceEventGuid, Handler::Keep);
+
+    ETWP_ASSERT (table.GetSize () == (size_t (1) << EventDispatchTable::kMinSizeLog2));   // No rehash happened
+
+    // Kernel providers take precedence (a user provider with the same ID would be rejected by ETW, anyway)
+    for (const GUID& providerID : userProviderIDs) {
+        if (!table.ContainsProvider (providerID))
+            table.SetHandler (providerID, Handler::UserProvider);
+    }
+
+    return table;
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,145 @@
+#ifndef ETWP_EVENT_DISPATCH_TABLE_HPP
+#define ETWP_EVENT_DISPATCH_TABLE_HPP
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "OS/Utility/OSTypes.hpp"
+
+#include "Utility/Exception.hpp"
+
+namespace ETWP {
+
+// Maps (provider ID, opcode) pairs of incoming events to the handler the per-event filter should invoke for them.
+//   Providers are stored in an open hash table that is perfect (collision free) for the providers it contains, so a
+//   lookup is a hash, a GUID comparison and an index into the provider's 256-entry opcode table: one probe, no
+//   branching on provider IDs. Unknown providers map to Handler::Drop.
+// The hash seed for the well-known kernel providers is computed at compile time (see CreateProfileDispatchTable);
+//   adding providers at runtime (e.g. user providers) searches for a new seed if needed, growing the table if no
+//   suitable seed can be found. This class does not depend on Windows, so it can be benchmarked anywhere.
+class EventDispatchTable final {
+public:
+    // Thrown when a provider is added, but no collision free seed can be found, even for the largest table size
+    class FullException : public Exception {
+    public:
+        FullException (const std::wstring& msg);
+    };
+
+    enum class Handler : uint8_t {
+        Drop = 0,
+        Keep,
+        StackWalk,
+        SampledProfile,
+        Thread,
+        ContextSwitch,
+        Process,
+        ImageLoad,
+        UserProvider    // Kept if it belongs to a target process
+    };
+
+    static constexpr uint32_t kMinSizeLog2 = 4;
+
+    EventDispatchTable ();
+    EventDispatchTable (uint64_t seed, uint32_t sizeLog2);
+
+    // Might throw FullException
+    void SetHandler (const GUID& providerID, UCHAR opcode, Handler handler);
+    void SetHandler (const GUID& providerID, Handler handler);  // For all opcodes
+    bool ContainsProvider (const GUID& providerID) const;
+
+    Handler GetHandler (const GUID& providerID, UCHAR opcode) const;
+
+    size_t GetNumberOfProviders () const;
+    size_t GetSize () const;
+
+    static constexpr uint64_t HashGUID (const GUID& guid, uint64_t seed);
+    static constexpr uint32_t GetSlotIndex (uint64_t hash, uint32_t sizeLog2);
+    static constexpr bool     GUIDEquals (const GUID& lhs, const GUID& rhs);
+
+    // Returns 0 if no seed in [1, maxSeed] maps all GUIDs to different slots
+    static constexpr uint64_t FindPerfectSeed (std::span<const GUID> guids, uint32_t sizeLog2, uint64_t maxSeed);
+
+private:
+    struct Entry {
+        GUID                     providerID; // All zeroes for unused entries
+        std::array<Handler, 256> handlers;   // Indexed by opcode
+    };
+
+    std::vector<Entry> m_entries;
+    uint64_t           m_seed;
+    uint32_t           m_sizeLog2;
+    size_t             m_nProviders;
+
+    Entry& GetOrCreateEntry (const GUID& providerID);
+    void   Rehash (const GUID& newProviderID);
+};
+
+constexpr uint64_t EventDispatchTable::HashGUID (const GUID& guid, uint64_t seed)
+{
+    const uint64_t low = uint64_t (guid.Data1) | uint64_t (guid.Data2) << 32 | uint64_t (guid.Data3) << 48;
+    const uint64_t high = std::bit_cast<uint64_t> (guid.Data4);
+
+    // Murmur3-like finalizer over the two halves
+    uint64_t hash = (low ^ seed) * 0x9e3779b97f4a7c15ULL ^ high;
+    hash ^= hash >> 31;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 29;
+
+    return hash;
+}
+
+constexpr uint32_t EventDispatchTable::GetSlotIndex (uint64_t hash, uint32_t sizeLog2)
+{
+    return static_cast<uint32_t> (hash >> (64 - sizeLog2));
+}
+
+constexpr bool EventDispatchTable::GUIDEquals (const GUID& lhs, const GUID& rhs)
+{
+    return lhs.Data1 == rhs.Data1 &&
+           lhs.Data2 == rhs.Data2 &&
+           lhs.Data3 == rhs.Data3 &&
+           std::bit_cast<uint64_t> (lhs.Data4) == std::bit_cast<uint64_t> (rhs.Data4);
+}
+
+constexpr uint64_t EventDispatchTable::FindPerfectSeed (std::span<const GUID> guids,
+                                                        uint32_t sizeLog2,
+                                                        uint64_t maxSeed)
+{
+    if (guids.size () > (size_t (1) << sizeLog2))
+        return 0;
+
+    for (uint64_t seed = 1; seed <= maxSeed; ++seed) {
+        bool collision = false;
+        for (size_t i = 0; i < guids.size () && !collision; ++i) {
+            const uint32_t slot = GetSlotIndex (HashGUID (guids[i], seed), sizeLog2);
+            for (size_t j = 0; j < i && !collision; ++j)
+                collision = GetSlotIndex (HashGUID (guids[j], seed), sizeLog2) == slot;
+        }
+
+        if (!collision)
+            return seed;
+    }
+
+    return 0;
+}
+
+inline EventDispatchTable::Handler EventDispatchTable::GetHandler (const GUID& providerID, UCHAR opcode) const
+{
+    const Entry& entry = m_entries[GetSlotIndex (HashGUID (providerID, m_seed), m_sizeLog2)];
+
+    // Unused entries have a null provider ID, and all of their handlers are Handler::Drop, so events of a (bogus)
+    //   null provider are handled correctly, too
+    return GUIDEquals (entry.providerID, providerID) ? entry.handlers[opcode] : Handler::Drop;
+}
+
+// Creates the dispatch table used for filtering events when profiling. User providers are folded into the table,
+//   so their events are dispatched with the same single lookup. Might throw EventDispatchTable::FullException
+EventDispatchTable CreateProfileDispatchTable (bool cswitch, std::span<const GUID> userProviderIDs);
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_EVENT_DISPATCH_TABLE_HPP
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "EventMetadata.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+
+namespace ETWP {
+
+bool EventMetadataSink::EventKind::operator== (const EventKind& rhs) const
+{
+    return providerID == rhs.providerID && id == rhs.id && version == rhs.version && opcode == rhs.opcode;
+}
+
+size_t EventMetadataSink::EventKindHash::operator() (const EventKind& kind) const
+{
+    uint64_t guidHalves[2];
+    std::memcpy (guidHalves, &kind.providerID, sizeof guidHalves);
+
+    const uint64_t descriptor = (uint64_t (kind.id) << 16) | (uint64_t (kind.version) << 8) | kind.opcode;
+
+    return static_cast<size_t> ((guidHalves[0] ^ (guidHalves[1] * 0x9E37'79B9'7F4A'7C15) ^ descriptor) *
+                                0xBF58'476D'1CE4'E5B9);
+}
+
+EventMetadataSink::EventMetadataSink (IEventSink* pSink,
+                                      const EventMetadataSource& source,
+                                      const std::vector<GUID>& providerIDs):
+    m_pSink (pSink),
+    m_source (source),
+    m_providerIDs (providerIDs),
+    m_stats ()
+{
+}
+
+bool EventMetadataSink::WriteEvent (const EventView& event)
+{
+    if (IsMetadataNeeded (event))
+        WriteMetadata (event);
+
+    return m_pSink->WriteEvent (event);
+}
+
+EventMetadataSink::Stats EventMetadataSink::GetStats () const
+{
+    return m_stats;
+}
+
+bool EventMetadataSink::IsMetadataNeeded (const EventView& event) const
+{
+    return std::find (m_providerIDs.begin (), m_providerIDs.end (), event.GetProviderID ()) != m_providerIDs.end ();
+}
+
+void EventMetadataSink::WriteMetadata (const EventView& event)
+{
+    const EventHeaderLayout& header = event.GetRecord ().m_header;
+    const EventKind kind = { header.m_providerID, header.m_id, header.m_version, header.m_opcode };
+    if (!m_seenKinds.insert (kind).second)
+        return;
+
+    ++m_stats.nEventKinds;
+
+    m_records.clear ();
+    if (!m_source (event, &m_records) || m_records.empty ()) {
+        ++m_stats.nEventKindsWithoutMetadata;
+
+        return;
+    }
+
+    for (const EventMetadataRecord& metadataRecord : m_records) {
+        if (metadataRecord.data.size () > std::numeric_limits<USHORT>::max ())
+            continue;   // Cannot be an event
+
+        EventRecordLayout record = {};
+        record.m_header = header;
+        record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+        record.m_header.m_providerID = EventMetadataGuid;
+        record.m_header.m_id = 0;
+        record.m_header.m_version = 0;
+        record.m_header.m_opcode = metadataRecord.opcode;
+        record.m_header.m_task = 0;
+        record.m_header.m_keyword = 0;
+        record.m_processorNumber = event.GetProcessorNumber ();
+        record.m_loggerID = event.GetRecord ().m_loggerID;
+        record.m_userDataLength = static_cast<USHORT> (metadataRecord.data.size ());
+        record.m_pUserData = metadataRecord.data.data ();
+
+        if (m_pSink->WriteEvent (EventView (record)))
+            ++m_stats.nMetadataEventsWritten;
+    }
+}
+
+}   // namespace ETWP
\ No newline at end of file
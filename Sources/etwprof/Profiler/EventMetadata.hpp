@@ -0,0 +1,74 @@
+#ifndef ETWP_EVENT_METADATA_HPP
+#define ETWP_EVENT_METADATA_HPP
+
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+#include "RelogPipeline.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+namespace ETWP {
+
+// Payload of an EventMetadata event: a TRACE_EVENT_INFO (ETWConstants::EventInfoOpcode) or an EVENT_MAP_INFO
+//   (ETWConstants::EventMapInfoOpcode) structure, as returned by TDH
+struct EventMetadataRecord {
+    UCHAR                opcode;
+    std::vector<uint8_t> data;
+};
+
+// Returns the metadata needed to decode an event. Returns false (or no records), if the event needs none (e.g. it's
+//   self-describing, like TraceLogging events are)
+using EventMetadataSource = std::function<bool (const EventView& event, std::vector<EventMetadataRecord>* pRecordsOut)>;
+
+// Writes EventMetadata events (the events kerneltracecontrol.dll adds when merging a trace with
+//   EVENT_TRACE_MERGE_EXTENDED_DATA_EVENT_METADATA) right before the first event of each kind (provider, event ID,
+//   version and opcode) of the given providers passed through it, so user provider events can be decoded on machines
+//   where the providers are not registered. This way, the trace does not have to be rewritten by
+//   CreateMergedTraceFile just to add these.
+// Metadata events have the timestamp, processor, process and thread of the event they precede
+class EventMetadataSink final : public IEventSink {
+public:
+    struct Stats {
+        uint64_t nEventKinds;                   // Distinct kinds of events of the providers seen
+        uint64_t nMetadataEventsWritten;
+        uint64_t nEventKindsWithoutMetadata;
+    };
+
+    EventMetadataSink (IEventSink* pSink, const EventMetadataSource& source, const std::vector<GUID>& providerIDs);
+
+    virtual bool WriteEvent (const EventView& event) override;
+
+    Stats GetStats () const;
+
+private:
+    struct EventKind {
+        GUID   providerID;
+        USHORT id;
+        UCHAR  version;
+        UCHAR  opcode;
+
+        bool operator== (const EventKind& rhs) const;
+    };
+
+    struct EventKindHash {
+        size_t operator() (const EventKind& kind) const;
+    };
+
+    IEventSink*                                  m_pSink;
+    EventMetadataSource                          m_source;
+    std::vector<GUID>                            m_providerIDs;
+    std::unordered_set<EventKind, EventKindHash> m_seenKinds;
+    std::vector<EventMetadataRecord>             m_records;
+    Stats                                        m_stats;
+
+    bool IsMetadataNeeded (const EventView& event) const;
+    void WriteMetadata (const EventView& event);
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_EVENT_METADATA_HPP
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "EventRingBuffer.hpp"
+
+#include <bit>
+#include <cstring>
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+namespace {
+
+// The header of each record is its size (padded to kAlignment), or a marker for skipped space at the end
+uint32_t ReadRecordHeader (const std::byte* pRecord)
+{
+    uint32_t header;
+    std::memcpy (&header, pRecord, sizeof header);
+
+    return header;
+}
+
+void WriteRecordHeader (std::byte* pRecord, uint32_t header)
+{
+    std::memcpy (pRecord, &header, sizeof header);
+}
+
+}   // namespace
+
+EventRingBuffer::EventRingBuffer (size_t capacity):
+    m_buffer (),
+    m_capacity (std::bit_ceil (capacity < 4 * kCacheLineSize ? 4 * kCacheLineSize : capacity)),
+    m_mask (m_capacity - 1),
+    m_writePos (0),
+    m_readPos (0),
+    m_producerWritePos (0),
+    m_cachedReadPos (0),
+    m_pendingWriteSize (0),
+    m_highWaterMark (0),
+    m_consumerReadPos (0),
+    m_cachedWritePos (0),
+    m_pendingReadSize (0)
+{
+    m_buffer.reset (new std::byte[m_capacity]);
+}
+
+size_t EventRingBuffer::GetCapacity () const
+{
+    return m_capacity;
+}
+
+size_t EventRingBuffer::GetMaxRecordSize () const
+{
+    // Even in the worst case (i.e. almost a whole record's worth of space is skipped at the end), a record of this
+    //   size fits into an empty buffer
+    return m_capacity / 2 - kRecordHeaderSize;
+}
+
+void* EventRingBuffer::BeginWrite (size_t size)
+{
+    ETWP_ASSERT (m_pendingWriteSize == 0);
+
+    if (size > GetMaxRecordSize ())
+        return nullptr;
+
+    const size_t footprint = GetRecordFootprint (size);
+    const size_t offset = m_producerWritePos & m_mask;
+    // If the record does not fit at the end, the rest of the buffer has to be skipped
+    const size_t skip = offset + footprint > m_capacity ? m_capacity - offset : 0;
+    const size_t needed = skip + footprint;
+
+    if (m_producerWritePos + needed - m_cachedReadPos > m_capacity) {
+        m_cachedReadPos = m_readPos.load (std::memory_order_acquire);
+        if (m_producerWritePos + needed - m_cachedReadPos > m_capacity)
+            return nullptr;
+    }
+
+    if (skip > 0) {
+        WriteRecordHeader (&m_buffer[offset], kWrapMarker);
+        m_producerWritePos += skip;
+    }
+
+    std::byte* pRecord = &m_buffer[m_producerWritePos & m_mask];
+    WriteRecordHeader (pRecord, static_cast<uint32_t> (size));
+    m_pendingWriteSize = footprint;
+
+    return pRecord + kRecordHeaderSize;
+}
+
+void EventRingBuffer::EndWrite ()
+{
+    ETWP_ASSERT (m_pendingWriteSize != 0);
+
+    m_producerWritePos += m_pendingWriteSize;
+    m_pendingWriteSize = 0;
+
+    // The cached read position might be stale (overestimating the usage), so it's refreshed before recording a new
+    //   maximum. This is rare, once the high-water mark settles
+    if (m_producerWritePos - m_cachedReadPos > m_highWaterMark) {
+        m_cachedReadPos = m_readPos.load (std::memory_order_acquire);
+
+        const size_t used = m_producerWritePos - m_cachedReadPos;
+        if (used > m_highWaterMark)
+            m_highWaterMark = used;
+    }
+
+    m_writePos.store (m_producerWritePos, std::memory_order_release);
+}
+
+const void* EventRingBuffer::BeginRead (size_t* pSizeOut)
+{
+    ETWP_ASSERT (m_pendingReadSize == 0);
+
+    if (m_consumerReadPos == m_cachedWritePos) {
+        m_cachedWritePos = m_writePos.load (std::memory_order_acquire);
+        if (m_consumerReadPos == m_cachedWritePos)
+            return nullptr;
+    }
+
+    const std::byte* pRecord = &m_buffer[m_consumerReadPos & m_mask];
+    uint32_t header = ReadRecordHeader (pRecord);
+    if (header == kWrapMarker) {
+        // Skipped space is always followed by a record (they are published together)
+        m_consumerReadPos += m_capacity - (m_consumerReadPos & m_mask);
+        pRecord = &m_buffer[0];
+        header = ReadRecordHeader (pRecord);
+    }
+
+    *pSizeOut = header;
+    m_pendingReadSize = GetRecordFootprint (header);
+
+    return pRecord + kRecordHeaderSize;
+}
+
+void EventRingBuffer::EndRead ()
+{
+    ETWP_ASSERT (m_pendingReadSize != 0);
+
+    m_consumerReadPos += m_pendingReadSize;
+    m_pendingReadSize = 0;
+
+    m_readPos.store (m_consumerReadPos, std::memory_order_release);
+}
+
+size_t EventRingBuffer::GetUsedSize () const
+{
+    return m_producerWritePos - m_readPos.load (std::memory_order_relaxed);
+}
+
+size_t EventRingBuffer::GetHighWaterMark () const
+{
+    return m_highWaterMark;
+}
+
+size_t EventRingBuffer::GetRecordFootprint (size_t size)
+{
+    return kRecordHeaderSize + ((size + kAlignment - 1) & ~(kAlignment - 1));
+}
+
+}   // namespace ETWP
\ No newline at end of file
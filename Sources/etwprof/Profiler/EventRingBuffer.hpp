@@ -0,0 +1,78 @@
+#ifndef ETWP_EVENT_RING_BUFFER_HPP
+#define ETWP_EVENT_RING_BUFFER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Lock-free, single-producer single-consumer ring buffer of variable-sized records (e.g. copies of events). Records are
+//   written and read in place: the producer reserves space with BeginWrite, fills it, then publishes it with
+//   EndWrite. The consumer gets the oldest record with BeginRead, and releases it with EndRead.
+// Records are contiguous in memory: if a record does not fit at the end of the buffer, the rest of the buffer is
+//   skipped (with a marker), and the record is placed at the beginning. Both sides cache the other's position, so
+//   the shared positions (on separate cache lines) are only read when the cached value is not enough.
+// One thread may call the "producer" functions, and one (other) thread may call the "consumer" functions
+//   concurrently. GetUsedSize and GetHighWaterMark may be called from the producer thread only (or when both threads
+//   are idle)
+class EventRingBuffer final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (EventRingBuffer);
+
+    static constexpr size_t kAlignment = 8;     // Of records (and their sizes)
+
+    explicit EventRingBuffer (size_t capacity);   // Rounded up to a power of two
+
+    size_t GetCapacity () const;
+    size_t GetMaxRecordSize () const;
+
+    // Producer side. BeginWrite returns nullptr if there is not enough free space (or size is bigger than the maximum
+    //   record size). Each successful BeginWrite must be followed by an EndWrite before the next BeginWrite
+    void* BeginWrite (size_t size);
+    void  EndWrite ();
+
+    // Consumer side. BeginRead returns nullptr if the buffer is empty. Each successful BeginRead must be followed by an
+    //   EndRead before the next BeginRead
+    const void* BeginRead (size_t* pSizeOut);
+    void        EndRead ();
+
+    // Number of bytes used (including skipped space at the end). Records being read are counted until EndRead
+    size_t GetUsedSize () const;
+
+    // Highest number of bytes used right after publishing a record (including skipped space at the end)
+    size_t GetHighWaterMark () const;
+
+private:
+    static constexpr size_t   kCacheLineSize = 64;
+    static constexpr size_t   kRecordHeaderSize = kAlignment;
+    static constexpr uint32_t kWrapMarker = UINT32_MAX;
+
+    std::unique_ptr<std::byte[]> m_buffer;
+    size_t                       m_capacity;
+    size_t                       m_mask;
+
+    // Positions are "virtual", i.e. they are never wrapped around, only when indexing m_buffer
+    alignas (kCacheLineSize) std::atomic<size_t> m_writePos;
+    alignas (kCacheLineSize) std::atomic<size_t> m_readPos;
+
+    // Used by the producer only
+    alignas (kCacheLineSize) size_t m_producerWritePos;
+    size_t                          m_cachedReadPos;
+    size_t                          m_pendingWriteSize;
+    size_t                          m_highWaterMark;
+
+    // Used by the consumer only
+    alignas (kCacheLineSize) size_t m_consumerReadPos;
+    size_t                          m_cachedWritePos;
+    size_t                          m_pendingReadSize;
+
+    static size_t GetRecordFootprint (size_t size);
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_EVENT_RING_BUFFER_HPP
\ No newline at end of file
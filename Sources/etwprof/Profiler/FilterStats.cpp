@@ -0,0 +1,294 @@
+#include "FilterStats.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+
+#include "OS/ETW/ETWConstants.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+namespace {
+
+struct KnownProvider {
+    const GUID* pProviderID;
+    const char* name;
+};
+
+constexpr KnownProvider kKnownProviders[] = { { &PerfInfoGuid, "PerfInfo" },
+                                              { &StackWalkGuid, "StackWalk" },
+                                              { &ThreadGuid, "Thread" },
+                                              { &ProcessGuid, "Process" },
+                                              { &ImageLoadGuid, "Image" },
+                                              { &ImageInfoExtraGuid, "ImageId" },
+                                              { &EventTraceEventGuid, "EventTrace" },
+                                              { &EventMetadataGuid, "EventMetadata" },
+                                              { &DiskIoGuid, "DiskIo" },
+                                              { &FileIoGuid, "FileIo" },
+                                              { &SplitIoGuid, "SplitIo" },
+                                              { &PageFaultGuid, "PageFault" },
+                                              { &TcpIpGuid, "TcpIp" },
+                                              { &UdpIpGuid, "UdpIp" },
+                                              { &RegistryGuid, "Registry" },
+                                              { &ALPCGuid, "ALPC" },
+                                              { &NTFSGuid, "NTFS" },
+                                              { &UxThemeGuid, "UxTheme" },
+                                              { &EtwProfProfilerGuid, "etwprof" } };
+
+std::string FormatGUID (const GUID& guid)
+{
+    char buffer[40];
+    std::snprintf (buffer,
+                   sizeof buffer,
+                   "%08" PRIx32 "-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+                   uint32_t (guid.Data1),
+                   guid.Data2,
+                   guid.Data3,
+                   guid.Data4[0],
+                   guid.Data4[1],
+                   guid.Data4[2],
+                   guid.Data4[3],
+                   guid.Data4[4],
+                   guid.Data4[5],
+                   guid.Data4[6],
+                   guid.Data4[7]);
+
+    return buffer;
+}
+
+// Only for the ASCII strings above
+std::wstring Widen (const std::string& string)
+{
+    return std::wstring (string.begin (), string.end ());
+}
+
+std::wstring PadLeft (const std::wstring& string, size_t width)
+{
+    return string.size () >= width ? string : std::wstring (width - string.size (), L' ') + string;
+}
+
+std::wstring PadRight (const std::wstring& string, size_t width)
+{
+    return string.size () >= width ? string : string + std::wstring (width - string.size (), L' ');
+}
+
+// Time it takes to read the clock twice, in nanoseconds. It's comparable to the time it takes to filter an event, so
+//   it's subtracted from measurements
+int64_t GetClockOverhead ()
+{
+    static const int64_t overhead = [] () {
+        int64_t minNs = INT64_MAX;
+        for (int i = 0; i < 1'000; ++i) {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+            const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds> (
+                std::chrono::steady_clock::now () - start).count ();
+            minNs = std::min (minNs, ns);
+        }
+
+        return minNs;
+    } ();
+
+    return overhead;
+}
+
+std::wstring FormatRow (const std::wstring& provider, const std::wstring& opcode, const FilterStats::Counters& counters)
+{
+    return PadRight (provider, 38) + PadLeft (opcode, 6) +
+           PadLeft (std::to_wstring (counters.nKept + counters.nDropped), 13) +
+           PadLeft (std::to_wstring (counters.nKept), 13) +
+           PadLeft (std::to_wstring (counters.nDropped), 13) +
+           PadLeft (std::to_wstring (counters.nKeptBytes / 1'024), 12) +
+           PadLeft (std::to_wstring (counters.nDroppedBytes / 1'024), 13);
+}
+
+}   // namespace
+
+void FilterStats::Counters::Add (const Counters& other)
+{
+    nKept += other.nKept;
+    nDropped += other.nDropped;
+    nKeptBytes += other.nKeptBytes;
+    nDroppedBytes += other.nDroppedBytes;
+}
+
+FilterStats::FilterStats ():
+    m_providers (1),
+    m_cache (),
+    m_nEvents (0),
+    m_nTimedEvents (0),
+    m_timedNs (0)
+{
+}
+
+void FilterStats::CountRecovered (const EventView& event)
+{
+    Counters& counters = m_providers[FindOrAddProvider (event.GetProviderID ())].counters[event.GetOpcode ()];
+    const uint64_t size = sizeof (EventHeaderLayout) + event.GetUserDataLength ();
+    ETWP_ASSERT (counters.nDropped > 0 && counters.nDroppedBytes >= size);
+
+    --counters.nDropped;
+    counters.nDroppedBytes -= size;
+    ++counters.nKept;
+    counters.nKeptBytes += size;
+}
+
+void FilterStats::AddTime (uint64_t ns)
+{
+    ++m_nTimedEvents;
+    m_timedNs += ns;
+}
+
+void FilterStats::AddTimeSince (std::chrono::steady_clock::time_point start)
+{
+    const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds> (
+        std::chrono::steady_clock::now () - start).count ();
+
+    AddTime (static_cast<uint64_t> (std::max<int64_t> (ns - GetClockOverhead (), 0)));
+}
+
+std::vector<FilterStats::Category> FilterStats::GetCategories () const
+{
+    std::vector<Category> categories;
+    for (const ProviderCounters& provider : m_providers) {
+        for (size_t opcode = 0; opcode < provider.counters.size (); ++opcode) {
+            const Counters& counters = provider.counters[opcode];
+            if (counters.nKept + counters.nDropped > 0)
+                categories.push_back ({ provider.providerID, static_cast<UCHAR> (opcode), counters });
+        }
+    }
+
+    std::stable_sort (categories.begin (), categories.end (), [] (const Category& lhs, const Category& rhs) {
+        return lhs.counters.nKeptBytes + lhs.counters.nDroppedBytes >
+               rhs.counters.nKeptBytes + rhs.counters.nDroppedBytes;
+    });
+
+    return categories;
+}
+
+FilterStats::Counters FilterStats::GetTotals () const
+{
+    Counters totals;
+    for (const ProviderCounters& provider : m_providers) {
+        for (const Counters& counters : provider.counters)
+            totals.Add (counters);
+    }
+
+    return totals;
+}
+
+uint64_t FilterStats::GetNumberOfEvents () const
+{
+    return m_nEvents;
+}
+
+uint64_t FilterStats::GetEstimatedFilterTime () const
+{
+    if (m_nTimedEvents == 0)
+        return 0;
+
+    return static_cast<uint64_t> (double (m_timedNs) / m_nTimedEvents * m_nEvents);
+}
+
+bool FilterStats::WriteJSON (const std::filesystem::path& path, std::wstring* pErrorOut) const
+{
+    const Counters totals = GetTotals ();
+
+    std::ofstream file (path, std::ios::trunc);
+    file << "{\n"
+         << "  \"events\": " << m_nEvents << ",\n"
+         << "  \"kept\": " << totals.nKept << ",\n"
+         << "  \"dropped\": " << totals.nDropped << ",\n"
+         << "  \"keptBytes\": " << totals.nKeptBytes << ",\n"
+         << "  \"droppedBytes\": " << totals.nDroppedBytes << ",\n"
+         << "  \"timedEvents\": " << m_nTimedEvents << ",\n"
+         << "  \"estimatedFilterTimeNs\": " << GetEstimatedFilterTime () << ",\n"
+         << "  \"categories\": [";
+
+    const std::vector<Category> categories = GetCategories ();
+    for (size_t i = 0; i < categories.size (); ++i) {
+        const Category& category = categories[i];
+        file << (i == 0 ? "\n" : ",\n")
+             << "    { \"provider\": \"" << GetProviderName (category.providerID) << "\", "
+             << "\"providerID\": \"" << FormatGUID (category.providerID) << "\", "
+             << "\"opcode\": " << unsigned (category.opcode) << ", "
+             << "\"kept\": " << category.counters.nKept << ", "
+             << "\"dropped\": " << category.counters.nDropped << ", "
+             << "\"keptBytes\": " << category.counters.nKeptBytes << ", "
+             << "\"droppedBytes\": " << category.counters.nDroppedBytes << " }";
+    }
+
+    file << (categories.empty () ? "]\n" : "\n  ]\n") << "}\n";
+
+    file.close ();
+    if (!file) {
+        *pErrorOut = L"Unable to write filter statistics file: " + path.wstring ();
+
+        return false;
+    }
+
+    return true;
+}
+
+size_t FilterStats::FindOrAddProvider (const GUID& providerID)
+{
+    for (size_t i = 0; i < m_providers.size (); ++i) {
+        if (EventDispatchTable::GUIDEquals (m_providers[i].providerID, providerID))
+            return i;
+    }
+
+    m_providers.push_back ({ providerID, {} });
+
+    return m_providers.size () - 1;
+}
+
+std::string GetProviderName (const GUID& providerID)
+{
+    for (const KnownProvider& knownProvider : kKnownProviders) {
+        if (EventDispatchTable::GUIDEquals (*knownProvider.pProviderID, providerID))
+            return knownProvider.name;
+    }
+
+    return FormatGUID (providerID);
+}
+
+std::vector<std::wstring> FormatFilterStats (const FilterStats& stats, size_t maxRows)
+{
+    std::vector<std::wstring> lines;
+    lines.push_back (PadRight (L"Provider", 38) + PadLeft (L"Opcode", 6) + PadLeft (L"Events", 13) +
+                     PadLeft (L"Kept", 13) + PadLeft (L"Dropped", 13) + PadLeft (L"Kept KB", 12) +
+                     PadLeft (L"Dropped KB", 13));
+
+    const std::vector<FilterStats::Category> categories = stats.GetCategories ();
+    FilterStats::Counters others;
+    for (size_t i = 0; i < categories.size (); ++i) {
+        if (i < maxRows) {
+            lines.push_back (FormatRow (Widen (GetProviderName (categories[i].providerID)),
+                                        std::to_wstring (categories[i].opcode),
+                                        categories[i].counters));
+        } else {
+            others.Add (categories[i].counters);
+        }
+    }
+
+    if (categories.size () > maxRows)
+        lines.push_back (FormatRow (L"(" + std::to_wstring (categories.size () - maxRows) + L" more)", L"", others));
+
+    lines.push_back (FormatRow (L"Total", L"", stats.GetTotals ()));
+
+    const uint64_t filterNs = stats.GetEstimatedFilterTime ();
+    const uint64_t nEvents = stats.GetNumberOfEvents ();
+    wchar_t buffer[128];
+    std::swprintf (buffer,
+                   sizeof buffer / sizeof buffer[0],
+                   L"Filter time: %.1f ms (%.1f ns/event, estimated)",
+                   filterNs / 1'000'000.0,
+                   nEvents == 0 ? 0.0 : double (filterNs) / nEvents);
+    lines.push_back (buffer);
+
+    return lines;
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,137 @@
+#ifndef ETWP_FILTER_STATS_HPP
+#define ETWP_FILTER_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "EventDispatchTable.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+namespace ETWP {
+
+// Counts the events seen by the per-event filter per category (provider ID and opcode): how many of them were kept
+//   and dropped, and how many bytes (header and payload) they carried. It is updated by the consuming thread only, so
+//   the counters are plain integers. Kernel events tend to come in runs of the same provider, so the category of an
+//   event is usually found by comparing its provider ID with the previous one, and indexing by opcode.
+// Timing each event would cost about as much as filtering it, so only every kTimingInterval-th event is timed (see
+//   ShouldTime), and the total filter time is estimated from those
+class FilterStats final {
+public:
+    static constexpr uint64_t kTimingInterval = 64;
+
+    struct Counters {
+        uint64_t nKept = 0;
+        uint64_t nDropped = 0;
+        uint64_t nKeptBytes = 0;
+        uint64_t nDroppedBytes = 0;
+
+        void Add (const Counters& other);
+    };
+
+    struct Category {
+        GUID     providerID;
+        UCHAR    opcode;
+        Counters counters;
+    };
+
+    FilterStats ();
+
+    void Count (const EventView& event, bool kept);
+    void CountRecovered (const EventView& event);  // An event counted as dropped was kept after all (see ReorderWindow)
+
+    bool ShouldTime () const;       // Whether the next event to be counted should be timed
+    void AddTime (uint64_t ns);     // Filter time of an event selected by ShouldTime
+    void AddTimeSince (std::chrono::steady_clock::time_point start);   // Same, measured from start until now
+
+    std::vector<Category> GetCategories () const;  // Sorted by the number of bytes, in descending order
+    Counters              GetTotals () const;
+    uint64_t              GetNumberOfEvents () const;
+    uint64_t              GetEstimatedFilterTime () const;   // In nanoseconds
+
+    // Totals, filter time and categories, as a JSON object
+    bool WriteJSON (const std::filesystem::path& path, std::wstring* pErrorOut) const;
+
+private:
+    struct ProviderCounters {
+        GUID                      providerID;
+        std::array<Counters, 256> counters;    // Indexed by opcode
+    };
+
+    // Direct-mapped (by the first part of the provider ID) cache of provider indices. Unused entries refer to the
+    //   null provider ID, which has the first entry in m_providers
+    struct CacheEntry {
+        GUID   providerID;
+        size_t providerIndex;
+    };
+
+    static constexpr size_t kCacheSize = 32;
+
+    std::vector<ProviderCounters>       m_providers;
+    std::array<CacheEntry, kCacheSize>  m_cache;
+    uint64_t                            m_nEvents;
+    uint64_t                            m_nTimedEvents;
+    uint64_t                            m_timedNs;
+
+    size_t FindOrAddProvider (const GUID& providerID);
+};
+
+inline void FilterStats::Count (const EventView& event, bool kept)
+{
+    const GUID& providerID = event.GetProviderID ();
+    CacheEntry& cacheEntry = m_cache[providerID.Data1 % kCacheSize];
+    if (!EventDispatchTable::GUIDEquals (cacheEntry.providerID, providerID)) {
+        cacheEntry.providerID = providerID;
+        cacheEntry.providerIndex = FindOrAddProvider (providerID);
+    }
+
+    // Whether an event is kept is hard to predict, so counters are updated without branching on it
+    Counters& counters = m_providers[cacheEntry.providerIndex].counters[event.GetOpcode ()];
+    const uint64_t size = sizeof (EventHeaderLayout) + event.GetUserDataLength ();
+    counters.nKept += kept;
+    counters.nDropped += !kept;
+    counters.nKeptBytes += kept ? size : 0;
+    counters.nDroppedBytes += kept ? 0 : size;
+
+    ++m_nEvents;
+}
+
+inline bool FilterStats::ShouldTime () const
+{
+    return m_nEvents % kTimingInterval == 0;
+}
+
+// Calls filter (returning whether the event should be kept), and counts (and if needed, times) the event
+template<typename Filter>
+bool FilterAndCount (const EventView& event, FilterStats* pStats, Filter&& filter)
+{
+    const bool timed = pStats->ShouldTime ();
+    std::chrono::steady_clock::time_point start;
+    if (timed)
+        start = std::chrono::steady_clock::now ();
+
+    const bool keep = filter ();
+    if (timed)
+        pStats->AddTimeSince (start);
+
+    pStats->Count (event, keep);
+
+    return keep;
+}
+
+// Known (kernel) providers are named, others are formatted as GUIDs
+std::string GetProviderName (const GUID& providerID);
+
+// Formats the statistics as a table, one line per category. Categories beyond the first maxRows are summed up in a
+//   single line
+std::vector<std::wstring> FormatFilterStats (const FilterStats& stats, size_t maxRows);
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_FILTER_STATS_HPP
\ No newline at end of file
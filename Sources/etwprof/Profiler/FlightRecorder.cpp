@@ -0,0 +1,438 @@
+#include "FlightRecorder.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "StoredEvent.hpp"
+
+#include "OS/ETW/ETWConstants.hpp"
+
+#include "Utility/Asserts.hpp"
+#include "Utility/OnExit.hpp"
+
+namespace ETWP {
+
+namespace {
+
+// Layout of a block: size of event 0 (uint64_t) | stored event 0 (see StoreEvent) | padding | size of event 1...
+constexpr size_t kSizeFieldSize = sizeof (uint64_t);
+
+constexpr size_t AlignSize (size_t size)
+{
+    return (size + kStoredEventAlignment - 1) & ~(kStoredEventAlignment - 1);
+}
+
+// Calls fn for each event stored between offset and end in pData
+template<typename Fn>
+void ForEachStoredEvent (const std::byte* pData, size_t offset, size_t end, Fn fn)
+{
+    EventRecordLayout record;
+    std::vector<EventExtendedItemLayout> extendedData;
+    while (offset < end) {
+        uint64_t size;
+        std::memcpy (&size, pData + offset, sizeof size);
+
+        fn (LoadStoredEvent (pData + offset + kSizeFieldSize, &record, &extendedData));
+
+        offset += kSizeFieldSize + AlignSize (static_cast<size_t> (size));
+    }
+}
+
+}   // namespace
+
+bool FlightRecorderConfig::IsEnabled () const
+{
+    return maxMemory != 0;
+}
+
+FlightRecorder::FlightRecorder (const OutputSegmentFactory& factory,
+                                const FlightRecorderConfig& config,
+                                int64_t perfFreq):
+    m_factory (factory),
+    m_config (config),
+    m_sliceTicks (std::max<int64_t> (int64_t (config.sliceDuration) * perfFreq / 1'000, 1)),
+    m_maxDurationTicks (int64_t (config.maxDuration) * perfFreq),
+    m_blocks (),
+    m_firstBlock (0),
+    m_slices (),
+    m_startRundown (),
+    m_currentRundown (),
+    m_dumpRequested (false),
+    m_closed (false),
+    m_stats (),
+    m_freeBlocks (),
+    m_nBlocks (0),
+    m_nBlocksInUse (0),
+    m_maxBlocks (std::max<size_t> (static_cast<size_t> (config.maxMemory / kBlockSize), 2)),
+    m_nBlocksHighWaterMark (0),
+    m_pendingDumps (),
+    m_stopDumper (false),
+    m_nDumps (0),
+    m_nDumpsFailed (0),
+    m_nEventsDumped (0)
+{
+    m_dumperThread = std::thread (&FlightRecorder::DumperThreadMain, this);
+}
+
+FlightRecorder::~FlightRecorder ()
+{
+    std::wstring errorMsg;
+    Close (false, &errorMsg);
+}
+
+bool FlightRecorder::WriteEvent (const EventView& event)
+{
+    ETWP_ASSERT (!m_closed);
+
+    // The flag is read first, so the (rare) exchange does not slow down recording
+    if (m_dumpRequested.load (std::memory_order_relaxed) && m_dumpRequested.exchange (false))
+        TakeDump ();
+
+    if (ShouldStartSlice (event))
+        StartSlice (event.GetTimestamp ());
+
+    const bool recorded = Record (event);
+
+    // Even if the event was dropped, so the state stays accurate
+    m_currentRundown.Update (event);
+
+    return recorded;
+}
+
+void FlightRecorder::RequestDump ()
+{
+    m_dumpRequested.store (true);
+}
+
+bool FlightRecorder::Close (bool dumpRecorded, std::wstring* pErrorOut)
+{
+    if (m_closed)
+        return true;
+
+    m_closed = true;
+
+    if (dumpRecorded)
+        TakeDump ();
+
+    {
+        std::unique_lock<std::mutex> lock (m_lock);
+        m_stopDumper = true;
+    }
+
+    m_dumperCondition.notify_all ();
+    m_dumperThread.join ();
+
+    std::unique_lock<std::mutex> lock (m_lock);
+    if (!m_error.empty ()) {
+        *pErrorOut = m_error;
+
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t FlightRecorder::GetMemoryUsage () const
+{
+    std::unique_lock<std::mutex> lock (m_lock);
+
+    return uint64_t (m_nBlocksInUse) * kBlockSize;
+}
+
+FlightRecorder::Stats FlightRecorder::GetStats () const
+{
+    std::unique_lock<std::mutex> lock (m_lock);
+
+    Stats stats = m_stats;
+    stats.nDumps = m_nDumps;
+    stats.nDumpsFailed = m_nDumpsFailed;
+    stats.nEventsDumped = m_nEventsDumped;
+    stats.memoryHighWaterMark = uint64_t (m_nBlocksHighWaterMark) * kBlockSize;
+
+    return stats;
+}
+
+bool FlightRecorder::ShouldStartSlice (const EventView& event) const
+{
+    if (m_slices.empty ())
+        return true;
+
+    // Stacks belong to the event before them
+    if (event.GetProviderID () == StackWalkGuid)
+        return false;
+
+    return event.GetTimestamp () - m_slices.back ().startTimeStamp >= m_sliceTicks;
+}
+
+void FlightRecorder::StartSlice (int64_t timeStamp)
+{
+    m_slices.push_back ({ timeStamp, {}, 0 });
+
+    // A slice is out of the window, if the next one started before the window
+    if (m_maxDurationTicks != 0) {
+        while (m_slices.size () > 1 && m_slices[1].startTimeStamp <= timeStamp - m_maxDurationTicks)
+            EvictOldestSlice ();
+    }
+}
+
+bool FlightRecorder::Record (const EventView& event)
+{
+    const size_t size = GetStoredEventSize (event);
+    const size_t footprint = kSizeFieldSize + AlignSize (size);
+    if (footprint > kBlockSize) {
+        ++m_stats.nEventsDropped;
+
+        return false;
+    }
+
+    if (m_blocks.empty () || m_blocks.back ().used + footprint > kBlockSize) {
+        Block block;
+        while (!AcquireBlock (&block)) {
+            // Out of memory: the oldest slice has to go, even if it's the one being recorded. If nothing is recorded,
+            //   the whole budget is used by a dump in progress
+            if (m_blocks.empty ()) {
+                ++m_stats.nEventsDropped;
+
+                return false;
+            }
+
+            EvictOldestSlice ();
+            if (m_slices.empty ())
+                m_slices.push_back ({ event.GetTimestamp (), {}, 0 });
+        }
+
+        m_blocks.push_back (std::move (block));
+    }
+
+    Block& block = m_blocks.back ();
+    Slice& slice = m_slices.back ();
+    if (slice.nEvents == 0)
+        slice.start = { m_firstBlock + m_blocks.size () - 1, block.used };
+
+    std::byte* pDestination = block.data.get () + block.used;
+    const uint64_t storedSize = size;
+    std::memcpy (pDestination, &storedSize, sizeof storedSize);
+    StoreEvent (event, pDestination + kSizeFieldSize);
+    block.used += footprint;
+
+    ++slice.nEvents;
+    ++m_stats.nEventsRecorded;
+
+    return true;
+}
+
+void FlightRecorder::EvictOldestSlice ()
+{
+    ETWP_ASSERT (!m_slices.empty ());
+
+    const Slice slice = m_slices.front ();
+    m_slices.pop_front ();
+
+    // The slice ends where the next (non-empty) one starts, or with the recorded events
+    Position end = { m_firstBlock + m_blocks.size (), 0 };
+    for (const Slice& nextSlice : m_slices) {
+        if (nextSlice.nEvents > 0) {
+            end = nextSlice.start;
+
+            break;
+        }
+    }
+
+    if (slice.nEvents > 0) {
+        for (uint64_t blockNumber = slice.start.block; blockNumber <= end.block; ++blockNumber) {
+            if (blockNumber - m_firstBlock >= m_blocks.size ())
+                break;
+
+            const Block& block = m_blocks[blockNumber - m_firstBlock];
+            ForEachStoredEvent (block.data.get (),
+                                blockNumber == slice.start.block ? slice.start.offset : 0,
+                                blockNumber == end.block ? end.offset : block.used,
+                                [this] (const EventView& event) { m_startRundown.Update (event); });
+        }
+
+        m_stats.nEventsEvicted += slice.nEvents;
+    }
+
+    ++m_stats.nSlicesEvicted;
+
+    // Blocks before the one the next slice starts in are not needed anymore
+    while (m_firstBlock < end.block && !m_blocks.empty ()) {
+        ReleaseBlock (&m_blocks.front ());
+        m_blocks.pop_front ();
+        ++m_firstBlock;
+    }
+}
+
+void FlightRecorder::TakeDump ()
+{
+    // Empty slices (if any) at the front do not matter
+    while (!m_slices.empty () && m_slices.front ().nEvents == 0)
+        m_slices.pop_front ();
+
+    if (m_slices.empty ())
+        return;     // Nothing was recorded since the last dump
+
+    const Position start = m_slices.front ().start;
+    while (m_firstBlock < start.block) {
+        ReleaseBlock (&m_blocks.front ());
+        m_blocks.pop_front ();
+        ++m_firstBlock;
+    }
+
+    Dump dump = { m_startRundown, std::move (m_blocks), start.offset };
+    m_firstBlock += dump.blocks.size ();
+    m_blocks.clear ();
+    m_slices.clear ();
+    m_startRundown = m_currentRundown;
+
+    {
+        std::unique_lock<std::mutex> lock (m_lock);
+        m_pendingDumps.push_back (std::move (dump));
+    }
+
+    m_dumperCondition.notify_all ();
+}
+
+bool FlightRecorder::AcquireBlock (Block* pBlockOut)
+{
+    std::unique_lock<std::mutex> lock (m_lock);
+
+    if (!m_freeBlocks.empty ()) {
+        *pBlockOut = std::move (m_freeBlocks.back ());
+        m_freeBlocks.pop_back ();
+    } else if (m_nBlocks < m_maxBlocks) {
+        pBlockOut->data.reset (new std::byte[kBlockSize]);
+        ++m_nBlocks;
+    } else {
+        return false;
+    }
+
+    pBlockOut->used = 0;
+    ++m_nBlocksInUse;
+    m_nBlocksHighWaterMark = std::max (m_nBlocksHighWaterMark, m_nBlocksInUse);
+
+    return true;
+}
+
+void FlightRecorder::ReleaseBlock (Block* pBlock)
+{
+    std::unique_lock<std::mutex> lock (m_lock);
+
+    m_freeBlocks.push_back (std::move (*pBlock));
+    --m_nBlocksInUse;
+}
+
+void FlightRecorder::DumperThreadMain ()
+{
+    std::unique_lock<std::mutex> lock (m_lock);
+    for (;;) {
+        m_dumperCondition.wait (lock, [this]() { return !m_pendingDumps.empty () || m_stopDumper; });
+        if (m_pendingDumps.empty ())
+            return;     // Stopping, and everything is dumped
+
+        Dump dump = std::move (m_pendingDumps.front ());
+        m_pendingDumps.pop_front ();
+
+        lock.unlock ();
+        WriteDump (&dump);
+        lock.lock ();
+    }
+}
+
+void FlightRecorder::WriteDump (Dump* pDump)
+{
+    // Blocks are given back as soon as they are written, so recording can go on while dumping
+    OnExit blockReleaser ([&]() {
+        for (Block& block : pDump->blocks)
+            ReleaseBlock (&block);
+    });
+
+    if (pDump->blocks.empty ())
+        return;
+
+    // The rundown is written with the timestamp (and processor) of the first event
+    EventRecordLayout firstRecord;
+    std::vector<EventExtendedItemLayout> firstExtendedData;
+    const EventView firstEvent = LoadStoredEvent (pDump->blocks.front ().data.get () + pDump->startOffset +
+                                                    kSizeFieldSize,
+                                                  &firstRecord,
+                                                  &firstExtendedData);
+
+    uint32_t dumpNumber;
+    {
+        std::unique_lock<std::mutex> lock (m_lock);
+        dumpNumber = ++m_nDumps;
+    }
+
+    std::wstring errorMsg;
+    std::unique_ptr<IOutputSegment> output = m_factory (dumpNumber, firstEvent.GetTimestamp (), &errorMsg);
+    bool succeeded = output != nullptr;
+    uint64_t nEventsWritten = 0;
+    if (succeeded) {
+        IEventSink* pSink = output->GetSink ();
+        nEventsWritten += pDump->rundown.Write (firstEvent, pSink);
+
+        size_t offset = pDump->startOffset;
+        while (!pDump->blocks.empty ()) {
+            Block& block = pDump->blocks.front ();
+            ForEachStoredEvent (block.data.get (), offset, block.used, [&] (const EventView& event) {
+                if (pSink->WriteEvent (event))
+                    ++nEventsWritten;
+            });
+
+            ReleaseBlock (&block);
+            pDump->blocks.pop_front ();
+            offset = 0;
+        }
+
+        succeeded = output->Finish (&errorMsg);
+        output.reset ();
+    }
+
+    std::unique_lock<std::mutex> lock (m_lock);
+    m_nEventsDumped += nEventsWritten;
+    if (!succeeded) {
+        ++m_nDumpsFailed;
+        if (m_error.empty ())
+            m_error = errorMsg;
+    }
+}
+
+CPUThresholdTrigger::CPUThresholdTrigger (double thresholdPercent):
+    m_threshold (thresholdPercent),
+    m_lastUsage (0),
+    m_lastCPUTime (0),
+    m_lastWallTime (0),
+    m_hasSample (false),
+    m_above (false)
+{
+}
+
+bool CPUThresholdTrigger::Update (uint64_t cpuTime, uint64_t wallTime)
+{
+    // CPU time might go backwards if a target exits, then there is nothing to compare to
+    const bool comparable = m_hasSample && wallTime > m_lastWallTime && cpuTime >= m_lastCPUTime;
+    const uint64_t cpuTimeDelta = cpuTime - m_lastCPUTime;
+    const uint64_t wallTimeDelta = wallTime - m_lastWallTime;
+
+    m_lastCPUTime = cpuTime;
+    m_lastWallTime = wallTime;
+    m_hasSample = true;
+
+    if (!comparable)
+        return false;
+
+    m_lastUsage = 100.0 * cpuTimeDelta / wallTimeDelta;
+
+    const bool wasAbove = m_above;
+    m_above = m_lastUsage > m_threshold;
+
+    return m_above && !wasAbove;
+}
+
+double CPUThresholdTrigger::GetLastUsage () const
+{
+    return m_lastUsage;
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,166 @@
+#ifndef ETWP_FLIGHT_RECORDER_HPP
+#define ETWP_FLIGHT_RECORDER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OutputRotation.hpp"
+#include "RelogPipeline.hpp"
+
+#include "OS/ETW/EventView.hpp"
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+struct FlightRecorderConfig {
+    uint64_t maxMemory = 0;             // In bytes, 0 means the flight recorder is disabled
+    uint32_t maxDuration = 0;           // In seconds, 0 means the recorded window is limited by maxMemory only
+    uint32_t sliceDuration = 1'000;     // In milliseconds, the unit of eviction
+
+    bool IsEnabled () const;
+};
+
+// Keeps the most recent events in memory, and writes them into an output (see IOutputSegment) on demand only, e.g.
+//   when something interesting happens in a long profiling session.
+// Events are copied into a sequence of fixed-size blocks, which is divided into time slices (of sliceDuration). If the
+//   memory budget (maxMemory) is exhausted, or a slice falls out of the recorded window (maxDuration), the oldest
+//   slice is evicted as a whole (and the blocks it no longer shares with the next slice are freed). A slice is never
+//   started with a StackWalk event, so stacks are not separated from their events.
+// To make dumps self-contained, the processes, threads and images alive at the start of the oldest slice are tracked
+//   (see RundownState), and written as a rundown at the start of the dump.
+// A dump is requested with RequestDump (from any thread). It's taken before the next recorded event: the slices are
+//   handed over to a background thread, which writes them (block by block, giving memory back as it goes) into a new
+//   output (the nth dump is the nth segment, see OutputSegmentFactory), and the recording starts over. The memory
+//   budget is shared by the recording and the dump in progress, so the total memory used for events is bounded.
+// Events that do not fit into a block, or into the budget (when all of it is used by a dump), are dropped.
+// Not thread safe (except when stated otherwise): WriteEvent and Close must be called from the same thread
+class FlightRecorder final : public IEventSink {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (FlightRecorder);
+
+    static constexpr size_t kBlockSize = 256 * 1'024;
+
+    struct Stats {
+        uint64_t nEventsRecorded;
+        uint64_t nEventsEvicted;
+        uint64_t nEventsDropped;
+        uint64_t nSlicesEvicted;
+        uint32_t nDumps;
+        uint32_t nDumpsFailed;          // Could not be created or finished
+        uint64_t nEventsDumped;         // Including rundown events
+        uint64_t memoryHighWaterMark;   // In bytes
+    };
+
+    // perfFreq is the frequency of event timestamps
+    FlightRecorder (const OutputSegmentFactory& factory, const FlightRecorderConfig& config, int64_t perfFreq);
+    ~FlightRecorder ();     // Calls Close (without a dump), if it was not called
+
+    virtual bool WriteEvent (const EventView& event) override;
+
+    void RequestDump ();    // Thread safe
+
+    // Dumps the events recorded so far (if dumpRecorded is set), then waits for all dumps to finish. Returns the first
+    //   error, if any
+    bool Close (bool dumpRecorded, std::wstring* pErrorOut);
+
+    uint64_t GetMemoryUsage () const;   // Thread safe
+    Stats    GetStats () const;         // Dump-related members are final after Close only
+
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t                       used;
+    };
+
+    // Of an event in the recorded blocks. Blocks are numbered in the order they are recorded
+    struct Position {
+        uint64_t block;
+        size_t   offset;
+    };
+
+    struct Slice {
+        int64_t  startTimeStamp;
+        Position start;         // Of its first event, valid if nEvents > 0
+        uint64_t nEvents;
+    };
+
+    struct Dump {
+        RundownState      rundown;      // At the start of the first event
+        std::deque<Block> blocks;
+        size_t            startOffset;  // Of the first event in the first block
+    };
+
+    OutputSegmentFactory m_factory;
+    FlightRecorderConfig m_config;
+    int64_t              m_sliceTicks;
+    int64_t              m_maxDurationTicks;
+    std::deque<Block>    m_blocks;
+    uint64_t             m_firstBlock;      // Number of the first block in m_blocks
+    std::deque<Slice>    m_slices;          // The last one is being recorded
+    RundownState         m_startRundown;    // At the start of the first slice
+    RundownState         m_currentRundown;
+    std::atomic<bool>    m_dumpRequested;
+    bool                 m_closed;
+    Stats                m_stats;
+
+    // Shared by the recording and the dumper thread
+    mutable std::mutex      m_lock;
+    std::condition_variable m_dumperCondition;
+    std::vector<Block>      m_freeBlocks;       // Guarded by m_lock
+    size_t                  m_nBlocks;          // Guarded by m_lock (allocated, including free ones)
+    size_t                  m_nBlocksInUse;     // Guarded by m_lock
+    size_t                  m_maxBlocks;
+    size_t                  m_nBlocksHighWaterMark;     // Guarded by m_lock (in use)
+    std::deque<Dump>        m_pendingDumps;     // Guarded by m_lock
+    bool                    m_stopDumper;       // Guarded by m_lock
+    uint32_t                m_nDumps;           // Guarded by m_lock
+    uint32_t                m_nDumpsFailed;     // Guarded by m_lock
+    uint64_t                m_nEventsDumped;    // Guarded by m_lock
+    std::wstring            m_error;            // Guarded by m_lock (first error)
+    std::thread             m_dumperThread;
+
+    bool ShouldStartSlice (const EventView& event) const;
+    void StartSlice (int64_t timeStamp);
+    bool Record (const EventView& event);
+    void EvictOldestSlice ();
+    void TakeDump ();
+
+    bool AcquireBlock (Block* pBlockOut);
+    void ReleaseBlock (Block* pBlock);
+
+    void DumperThreadMain ();
+    void WriteDump (Dump* pDump);
+};
+
+// Fires when the CPU usage of the target(s) goes above a threshold. Fed periodically with the total CPU time used by
+//   the target(s) so far, and the current (wall clock) time, in the same unit
+class CPUThresholdTrigger final {
+public:
+    explicit CPUThresholdTrigger (double thresholdPercent);    // 100% is one fully used core
+
+    // Returns true if the usage since the previous update is above the threshold, but the one before was not
+    bool Update (uint64_t cpuTime, uint64_t wallTime);
+
+    double GetLastUsage () const;   // In percent
+
+private:
+    double   m_threshold;
+    double   m_lastUsage;
+    uint64_t m_lastCPUTime;
+    uint64_t m_lastWallTime;
+    bool     m_hasSample;
+    bool     m_above;
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_FLIGHT_RECORDER_HPP
\ No newline at end of file
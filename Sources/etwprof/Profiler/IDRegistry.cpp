@@ -0,0 +1,148 @@
+#include "IDRegistry.hpp"
+
+namespace ETWP {
+
+IDRegistry::IDRegistry ():
+    m_pages (),
+    m_irregularIDs (),
+    m_irregularGenerations (),
+    m_size (0)
+{
+}
+
+IDRegistry::IDRegistry (std::initializer_list<ID> ids): IDRegistry ()
+{
+    for (const ID id : ids)
+        Add (id);
+}
+
+bool IDRegistry::Add (ID id)
+{
+    if (IsIrregular (id)) [[unlikely]] {
+        if (!m_irregularIDs.insert (id).second)
+            return false;
+
+        ++m_size;
+
+        return true;
+    }
+
+    const uint32_t index = id >> kIDGranularityLog2;
+    Page* pPage = GetOrCreatePage (index >> kPageSizeLog2);
+
+    const uint32_t bitIndex = index & (kPageSize - 1);
+    uint64_t& word = pPage->bits[bitIndex >> 6];
+    const uint64_t mask = uint64_t (1) << (bitIndex & 63);
+    if (word & mask)
+        return false;
+
+    word |= mask;
+    ++m_size;
+
+    return true;
+}
+
+bool IDRegistry::Remove (ID id)
+{
+    if (IsIrregular (id)) [[unlikely]] {
+        if (m_irregularIDs.erase (id) == 0)
+            return false;
+
+        ++m_irregularGenerations[id];
+        --m_size;
+
+        return true;
+    }
+
+    const uint32_t index = id >> kIDGranularityLog2;
+    const uint32_t pageIndex = index >> kPageSizeLog2;
+    if (pageIndex >= m_pages.size () || m_pages[pageIndex] == nullptr)
+        return false;
+
+    Page* pPage = m_pages[pageIndex].get ();
+    const uint32_t bitIndex = index & (kPageSize - 1);
+    uint64_t& word = pPage->bits[bitIndex >> 6];
+    const uint64_t mask = uint64_t (1) << (bitIndex & 63);
+    if ((word & mask) == 0)
+        return false;
+
+    word &= ~mask;
+    --m_size;
+
+    if (pPage->generations == nullptr)
+        pPage->generations = std::make_unique<Generation[]> (kPageSize);   // Value-initialized, aka. zeroed
+
+    ++pPage->generations[bitIndex];
+
+    return true;
+}
+
+IDRegistry::Generation IDRegistry::GetGeneration (ID id) const
+{
+    if (IsIrregular (id)) [[unlikely]] {
+        auto it = m_irregularGenerations.find (id);
+
+        return it == m_irregularGenerations.end () ? 0 : it->second;
+    }
+
+    const uint32_t index = id >> kIDGranularityLog2;
+    const uint32_t pageIndex = index >> kPageSizeLog2;
+    if (pageIndex >= m_pages.size () || m_pages[pageIndex] == nullptr)
+        return 0;
+
+    const Page* pPage = m_pages[pageIndex].get ();
+    if (pPage->generations == nullptr)
+        return 0;
+
+    return pPage->generations[index & (kPageSize - 1)];
+}
+
+size_t IDRegistry::GetSize () const
+{
+    return m_size;
+}
+
+bool IDRegistry::IsEmpty () const
+{
+    return m_size == 0;
+}
+
+size_t IDRegistry::GetMemoryUsage () const
+{
+    size_t result = m_pages.capacity () * sizeof (std::unique_ptr<Page>);
+    for (const auto& pPage : m_pages) {
+        if (pPage == nullptr)
+            continue;
+
+        result += sizeof (Page);
+        if (pPage->generations != nullptr)
+            result += kPageSize * sizeof (Generation);
+    }
+
+    // Node-based containers; this is a rough estimate
+    result += m_irregularIDs.size () * (sizeof (ID) + 2 * sizeof (void*));
+    result += m_irregularGenerations.size () * (sizeof (ID) + sizeof (Generation) + 2 * sizeof (void*));
+
+    return result;
+}
+
+void IDRegistry::Clear ()
+{
+    m_pages.clear ();
+    m_irregularIDs.clear ();
+    m_irregularGenerations.clear ();
+    m_size = 0;
+}
+
+IDRegistry::Page* IDRegistry::GetOrCreatePage (uint32_t pageIndex)
+{
+    if (pageIndex >= m_pages.size ())
+        m_pages.resize (pageIndex + 1);
+
+    if (m_pages[pageIndex] == nullptr)
+        m_pages[pageIndex] = std::make_unique<Page> ();
+
+    return m_pages[pageIndex].get ();
+}
+
+}   // namespace ETWP
\ No newline at end of file
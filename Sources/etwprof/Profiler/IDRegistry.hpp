@@ -0,0 +1,93 @@
+#ifndef ETWP_ID_REGISTRY_HPP
+#define ETWP_ID_REGISTRY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ETWP {
+
+// Set of thread or process IDs, tailored for the lookups done by the per-event filter (this class does not depend on
+//   Windows, so it can be benchmarked anywhere).
+// TIDs and PIDs are handed out by Windows from the same handle table, so they are multiples of four, and (mostly)
+//   dense. Because of this, IDs are stored in a lazily allocated, paged bitmap, indexed by (ID >> 2). A lookup is a
+//   couple of shifts and two loads, without hashing. IDs that are *not* multiples of four (this should never happen
+//   in practice) are stored in an overflow set, so correctness does not depend on this assumption.
+// Each ID has a generation counter as well, which is incremented every time the ID is removed. This way, clients can
+//   cheaply refer to "an ID, unless it was removed in the meantime" (see ThreadRegistry). Generation counters are only
+//   allocated for pages with at least one removal.
+class IDRegistry final {
+public:
+    using ID = uint32_t;
+    using Generation = uint8_t;
+
+    IDRegistry ();
+    IDRegistry (std::initializer_list<ID> ids);
+    IDRegistry (IDRegistry&&) = default;
+    IDRegistry& operator= (IDRegistry&&) = default;
+
+    bool Add (ID id);       // Returns false if the ID was already present
+    bool Remove (ID id);    // Returns false if the ID was not present
+    bool Contains (ID id) const;
+
+    Generation GetGeneration (ID id) const;
+
+    size_t GetSize () const;
+    bool   IsEmpty () const;
+    size_t GetMemoryUsage () const;  // Approximate number of bytes allocated by the registry
+
+    void Clear ();  // Resets generation counters, as well
+
+private:
+    static constexpr uint32_t kIDGranularityLog2 = 2;
+    static constexpr ID       kIrregularIDMask = (1 << kIDGranularityLog2) - 1;
+    static constexpr uint32_t kPageSizeLog2 = 15;  // 32768 IDs per page (4 KiB of bitmap)
+    static constexpr uint32_t kPageSize = 1 << kPageSizeLog2;
+    static constexpr uint32_t kWordsPerPage = kPageSize / 64;
+
+    struct Page {
+        uint64_t                      bits[kWordsPerPage] = {};
+        std::unique_ptr<Generation[]> generations;  // Allocated on the first removal
+    };
+
+    std::vector<std::unique_ptr<Page>>     m_pages;
+    std::unordered_set<ID>                 m_irregularIDs;
+    std::unordered_map<ID, Generation>     m_irregularGenerations;
+    size_t                                 m_size;
+
+    static bool IsIrregular (ID id);
+
+    Page* GetOrCreatePage (uint32_t pageIndex);
+};
+
+inline bool IDRegistry::IsIrregular (ID id)
+{
+    return (id & kIrregularIDMask) != 0;
+}
+
+inline bool IDRegistry::Contains (ID id) const
+{
+    if (IsIrregular (id)) [[unlikely]]
+        return m_irregularIDs.contains (id);
+
+    const uint32_t index = id >> kIDGranularityLog2;
+    const uint32_t pageIndex = index >> kPageSizeLog2;
+    if (pageIndex >= m_pages.size ())
+        return false;
+
+    const Page* pPage = m_pages[pageIndex].get ();
+    if (pPage == nullptr)
+        return false;
+
+    const uint32_t bitIndex = index & (kPageSize - 1);
+
+    return (pPage->bits[bitIndex >> 6] >> (bitIndex & 63)) & 1;
+}
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_ID_REGISTRY_HPP
\ No newline at end of file
@@ -3,7 +3,9 @@
 
 #include <windows.h>
 
+#include "FilterStats.hpp"
 #include "IProfiler.hpp"
+#include "ProgressCounters.hpp"
 
 #include "Utility/Macros.hpp"
 
@@ -24,12 +26,14 @@ public:
     using Flags = uint8_t;
 
     enum Options : Flags {
-        Default         = 0b00000,     
-        RecordCSwitches = 0b00001,     // Record context switch information
-        Compress        = 0b00010,     // Compress result ETL with ETW's built-in compression
-        Debug           = 0b00100,     // Preserve intermediate ETL files (if any)
-        StackCache      = 0b01000,     // Use ETW's stack caching feature
-        ProfileChildren = 0b10000      // Profile child processes
+        Default         = 0b0000000,     
+        RecordCSwitches = 0b0000001,    // Record context switch information
+        Compress        = 0b0000010,    // Compress result ETL with ETW's built-in compression
+        Debug           = 0b0000100,    // Preserve intermediate ETL files (if any)
+        StackCache      = 0b0001000,    // Use ETW's stack caching feature
+        ProfileChildren = 0b0010000,    // Profile child processes
+        Pipeline        = 0b0100000,    // Write output on a separate thread (see RelogPipeline)
+        CompressXZ      = 0b1000000     // Write an xz compressed ETL (see ETLWriterConfig), requires ETWP_HAVE_LIBLZMA
     };
 
     IETWBasedProfiler () = default;
@@ -38,6 +42,17 @@ public:
     virtual bool EnableProvider (const ProviderInfo& providerInfo) = 0;
 
     virtual uint32_t GetNumberOfProfiledProcesses () = 0;
+
+    // Requests the events recorded in memory to be written (see FlightRecorder). Returns false if the profiler does not
+    //   record in memory
+    virtual bool RequestDump () = 0;
+
+    // Statistics of the per-event filter. Complete once profiling finished (see IsFinished)
+    virtual FilterStats GetFilterStats () = 0;
+
+    // Counters of the events consumed and written so far (and the losses of the ETW session, if any). Can be called
+    //   while profiling; it never waits for the thread consuming the events
+    virtual ProgressSample GetProgress () = 0;
 };
 
 bool operator== (const IETWBasedProfiler::ProviderInfo& lhs, const IETWBasedProfiler::ProviderInfo& rhs);
@@ -0,0 +1,424 @@
+#include "ImageIdentity.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+#include "StoredEvent.hpp"
+
+#include "OS/ETW/ETLFormat.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+
+#include "Utility/WorkStealingRanges.hpp"
+
+namespace ETWP {
+
+namespace {
+
+// Versions of the identity events written
+constexpr UCHAR kImageIDVersion = 2;
+constexpr UCHAR kDbgIDRSDSVersion = 2;
+
+template<typename T>
+void Append (std::vector<uint8_t>* pBytes, const T& value)
+{
+    const size_t oldSize = pBytes->size ();
+    pBytes->resize (oldSize + sizeof value);
+    std::memcpy (pBytes->data () + oldSize, &value, sizeof value);
+}
+
+// Strings in identity events are null terminated, the file name is UTF-16, the PDB path is ANSI
+void AppendUTF16 (std::vector<uint8_t>* pBytes, const std::wstring& string)
+{
+    for (wchar_t c : string)
+        Append (pBytes, static_cast<char16_t> (c));
+
+    Append (pBytes, char16_t (0));
+}
+
+void AppendANSI (std::vector<uint8_t>* pBytes, const std::string& string)
+{
+    const size_t oldSize = pBytes->size ();
+    pBytes->resize (oldSize + string.size () + 1);
+    std::memcpy (pBytes->data () + oldSize, string.c_str (), string.size () + 1);
+}
+
+std::wstring GetFileNameAndExtension (const std::wstring& imagePath)
+{
+    const size_t lastSeparator = imagePath.find_last_of (L"\\/");
+
+    return lastSeparator == std::wstring::npos ? imagePath : imagePath.substr (lastSeparator + 1);
+}
+
+}   // namespace
+
+ImageIdentityResolver::ImageIdentityResolver (const ImagePathTranslator& pathTranslator,
+                                              ImageIdentityCache* pCache /*= nullptr*/):
+    m_pathTranslator (pathTranslator),
+    m_pCache (pCache),
+    m_lock (),
+    m_resolvedCondition (),
+    m_identities (),
+    m_pendingPaths (),
+    m_stats (),
+    m_backgroundPaths (),
+    m_backgroundCondition (),
+    m_stopBackgroundThread (false),
+    m_backgroundThread ()
+{
+}
+
+ImageIdentityResolver::~ImageIdentityResolver ()
+{
+    {
+        std::lock_guard<std::mutex> guard (m_lock);
+        m_stopBackgroundThread = true;
+    }
+
+    m_backgroundCondition.notify_one ();
+    if (m_backgroundThread.joinable ())
+        m_backgroundThread.join ();
+}
+
+void ImageIdentityResolver::Resolve (const std::vector<std::wstring>& imagePaths, uint32_t nThreads /*= 0*/)
+{
+    // Images read (or being read) by someone else are not waited for, Get does that if needed
+    std::vector<const std::wstring*> unresolvedPaths;
+    {
+        std::lock_guard<std::mutex> guard (m_lock);
+        for (const std::wstring& imagePath : imagePaths) {
+            if (!m_identities.contains (imagePath) && m_pendingPaths.insert (imagePath).second)
+                unresolvedPaths.push_back (&imagePath);     // Duplicates are read only once
+        }
+    }
+
+    if (unresolvedPaths.empty ())
+        return;
+
+    if (nThreads == 0)
+        nThreads = std::max (std::thread::hardware_concurrency (), 1u);
+
+    ReadAll (unresolvedPaths, nThreads);
+}
+
+void ImageIdentityResolver::ResolveInBackground (const std::wstring& imagePath)
+{
+    {
+        std::lock_guard<std::mutex> guard (m_lock);
+        if (m_identities.contains (imagePath) || !m_pendingPaths.insert (imagePath).second)
+            return;
+
+        m_backgroundPaths.push_back (imagePath);
+        if (!m_backgroundThread.joinable ())
+            m_backgroundThread = std::thread (&ImageIdentityResolver::BackgroundThreadMain, this);
+    }
+
+    m_backgroundCondition.notify_one ();
+}
+
+bool ImageIdentityResolver::IsResolved (const std::wstring& imagePath) const
+{
+    std::lock_guard<std::mutex> guard (m_lock);
+
+    return m_identities.contains (imagePath);
+}
+
+const PEImageIdentity* ImageIdentityResolver::Get (const std::wstring& imagePath)
+{
+    std::unique_lock<std::mutex> lock (m_lock);
+    auto it = m_identities.find (imagePath);
+    if (it == m_identities.end () && m_pendingPaths.insert (imagePath).second) {
+        lock.unlock ();
+
+        bool fromCache;
+        std::optional<PEImageIdentity> identity = Read (imagePath, &fromCache);
+
+        lock.lock ();
+        Add (imagePath, std::move (identity), fromCache);
+        m_resolvedCondition.notify_all ();
+        it = m_identities.find (imagePath);
+    } else if (it == m_identities.end ()) {
+        m_resolvedCondition.wait (lock, [&] () { return !m_pendingPaths.contains (imagePath); });
+        it = m_identities.find (imagePath);
+    }
+
+    // Elements of the map are never changed (or removed) once added, and references to them stay valid
+    return it->second.has_value () ? &*it->second : nullptr;
+}
+
+ImageIdentityResolver::Stats ImageIdentityResolver::GetStats () const
+{
+    std::lock_guard<std::mutex> guard (m_lock);
+
+    return m_stats;
+}
+
+void ImageIdentityResolver::ReadAll (const std::vector<const std::wstring*>& imagePaths, uint32_t nThreads)
+{
+    const uint32_t nItems = static_cast<uint32_t> (imagePaths.size ());
+    nThreads = std::min (nThreads, nItems);
+
+    // Reading an image is mostly waiting for the disk (the headers are small), so the threads are kept busy with
+    //   work stealing
+    std::vector<std::optional<PEImageIdentity>> identities (nItems);
+    std::vector<uint8_t> fromCache (nItems, false);
+    WorkStealingRanges ranges (nItems, nThreads);
+    const auto worker = [&] (uint32_t workerIndex) {
+        uint32_t item;
+        while (ranges.Take (workerIndex, &item)) {
+            bool itemFromCache;
+            identities[item] = Read (*imagePaths[item], &itemFromCache);
+            fromCache[item] = itemFromCache;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < nThreads; ++i)
+        threads.emplace_back (worker, i);
+
+    worker (0);
+
+    for (std::thread& thread : threads)
+        thread.join ();
+
+    {
+        std::lock_guard<std::mutex> guard (m_lock);
+        for (uint32_t i = 0; i < nItems; ++i)
+            Add (*imagePaths[i], std::move (identities[i]), fromCache[i]);
+    }
+
+    m_resolvedCondition.notify_all ();
+}
+
+std::optional<PEImageIdentity> ImageIdentityResolver::Read (const std::wstring& imagePath, bool* pFromCacheOut) const
+{
+    *pFromCacheOut = false;
+    if (imagePath.empty ())
+        return std::nullopt;
+
+    const std::filesystem::path path = m_pathTranslator (imagePath);
+
+    PEImageIdentity identity;
+    uint64_t fileSize;
+    int64_t lastWriteTime;
+    const bool hasFileKey = m_pCache != nullptr && ImageIdentityCache::GetFileKey (path, &fileSize, &lastWriteTime);
+    if (hasFileKey && m_pCache->Find (path, fileSize, lastWriteTime, &identity)) {
+        *pFromCacheOut = true;
+
+        return identity;
+    }
+
+    std::wstring errorMsg;
+    if (!ReadPEImageIdentity (path, &identity, &errorMsg))
+        return std::nullopt;
+
+    if (hasFileKey)
+        m_pCache->Add (path, fileSize, lastWriteTime, identity);
+
+    return identity;
+}
+
+void ImageIdentityResolver::Add (const std::wstring& imagePath,
+                                 std::optional<PEImageIdentity>&& identity,
+                                 bool fromCache)
+{
+    if (identity.has_value ())
+        ++m_stats.nResolved;
+    else
+        ++m_stats.nUnresolved;
+
+    if (fromCache)
+        ++m_stats.nFromCache;
+
+    m_identities.emplace (imagePath, std::move (identity));
+    m_pendingPaths.erase (imagePath);
+}
+
+void ImageIdentityResolver::BackgroundThreadMain ()
+{
+    std::vector<std::wstring> imagePaths;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock (m_lock);
+            m_backgroundCondition.wait (lock, [this] () {
+                return m_stopBackgroundThread || !m_backgroundPaths.empty ();
+            });
+            if (m_stopBackgroundThread)
+                return;
+
+            imagePaths.clear ();
+            imagePaths.swap (m_backgroundPaths);
+        }
+
+        // Images queued while these are being read are read in the next batch. At the start of a trace, the image
+        //   rundown queues lots of images at once, so they are read on multiple threads
+        std::vector<const std::wstring*> pImagePaths;
+        for (const std::wstring& imagePath : imagePaths)
+            pImagePaths.push_back (&imagePath);
+
+        ReadAll (pImagePaths, std::max (std::thread::hardware_concurrency (), 1u));
+    }
+}
+
+bool IsImageIdentitySource (const EventView& event)
+{
+    const UCHAR opcode = event.GetOpcode ();
+
+    return event.GetProviderID () == ImageLoadGuid &&
+           (opcode == ETWConstants::ImageLoadOpcode || opcode == ETWConstants::ImageDCStartOpcode) &&
+           event.GetUserDataLength () >= sizeof (ETWConstants::ImageLoadDataStub);
+}
+
+ImageIdentitySink::ImageIdentitySink (IEventSink* pSink,
+                                      ImageIdentityResolver* pResolver,
+                                      bool resolveInBackground /*= false*/):
+    m_pSink (pSink),
+    m_pResolver (pResolver),
+    m_resolveInBackground (resolveInBackground),
+    m_heldEvents (),
+    m_heldSize (0),
+    m_heldRecord (),
+    m_heldExtendedData (),
+    m_payload (),
+    m_stats ()
+{
+}
+
+bool ImageIdentitySink::WriteEvent (const EventView& event)
+{
+    const bool imageEvent = IsImageIdentitySource (event);
+    if (!m_resolveInBackground)
+        return WriteWithIdentity (event);
+
+    std::wstring imagePath;
+    if (imageEvent) {
+        imagePath = ETWConstants::GetImageFileName (event);
+        if (!m_pResolver->IsResolved (imagePath))
+            m_pResolver->ResolveInBackground (imagePath);
+        else if (m_heldEvents.empty ())
+            return WriteWithIdentity (event);
+    } else if (m_heldEvents.empty ()) {
+        return WriteWithIdentity (event);
+    }
+
+    const size_t nWords = (GetStoredEventSize (event) + sizeof (uint64_t) - 1) / sizeof (uint64_t);
+    m_heldEvents.push_back ({ std::vector<uint64_t> (nWords), imageEvent, std::move (imagePath) });
+    HeldEvent& heldEvent = m_heldEvents.back ();
+    StoreEvent (event, heldEvent.storage.data ());
+
+    ++m_stats.nEventsHeldBack;
+    m_heldSize += nWords * sizeof (uint64_t);
+    m_stats.heldBackHighWaterMark = std::max (m_stats.heldBackHighWaterMark, m_heldSize);
+
+    // Events are written in order, so an event is written once the images of all events before it are read
+    bool result = true;
+    while (!m_heldEvents.empty () &&
+           (m_heldSize > kMaxHeldBackSize ||
+            !m_heldEvents.front ().imageEvent ||
+            m_pResolver->IsResolved (m_heldEvents.front ().imagePath)))
+    {
+        result = WriteHeldEvent () && result;
+    }
+
+    return result;
+}
+
+bool ImageIdentitySink::Flush ()
+{
+    bool result = true;
+    while (!m_heldEvents.empty ())
+        result = WriteHeldEvent () && result;
+
+    return result;
+}
+
+ImageIdentitySink::Stats ImageIdentitySink::GetStats () const
+{
+    return m_stats;
+}
+
+bool ImageIdentitySink::WriteWithIdentity (const EventView& event)
+{
+    const bool result = m_pSink->WriteEvent (event);
+    if (!result || !IsImageIdentitySource (event))
+        return result;
+
+    ++m_stats.nImageEvents;
+
+    // ImageID first, then DbgID_RSDS (if the image refers to a PDB), like kerneltracecontrol.dll does
+    if (!WriteIdentityEvent (event, ETWConstants::ImageIDOpcode))
+        return result;
+
+    WriteIdentityEvent (event, ETWConstants::DbgIDRSDSOpcode);
+
+    return result;
+}
+
+bool ImageIdentitySink::WriteHeldEvent ()
+{
+    const HeldEvent& heldEvent = m_heldEvents.front ();
+    const bool result = WriteWithIdentity (LoadStoredEvent (heldEvent.storage.data (),
+                                                            &m_heldRecord,
+                                                            &m_heldExtendedData));
+
+    m_heldSize -= heldEvent.storage.size () * sizeof (uint64_t);
+    m_heldEvents.pop_front ();
+
+    return result;
+}
+
+bool ImageIdentitySink::WriteIdentityEvent (const EventView& imageEvent, UCHAR opcode)
+{
+    const std::wstring imagePath = ETWConstants::GetImageFileName (imageEvent);
+    const PEImageIdentity* pIdentity = m_pResolver->Get (imagePath);
+    if (pIdentity == nullptr) {
+        ++m_stats.nUnresolvedImageEvents;
+
+        return false;
+    }
+
+    if (opcode == ETWConstants::DbgIDRSDSOpcode && !pIdentity->hasPDBInfo)
+        return false;
+
+    const ETWConstants::ImageLoadDataStub* pImageData =
+        static_cast<const ETWConstants::ImageLoadDataStub*> (imageEvent.GetUserData ());
+
+    // Layouts of ImageID and DbgID_RSDS (of 64-bit traces), as decoded by e.g. TraceEvent
+    m_payload.clear ();
+    Append (&m_payload, uint64_t (pImageData->m_imageBase));
+    if (opcode == ETWConstants::ImageIDOpcode) {
+        Append (&m_payload, uint64_t (pIdentity->sizeOfImage));
+        Append (&m_payload, uint32_t (pImageData->m_processID));
+        Append (&m_payload, pIdentity->timeDateStamp);
+        AppendUTF16 (&m_payload, GetFileNameAndExtension (imagePath));
+    } else {
+        Append (&m_payload, uint32_t (pImageData->m_processID));
+        Append (&m_payload, pIdentity->pdbGUID);
+        Append (&m_payload, pIdentity->pdbAge);
+        AppendANSI (&m_payload, pIdentity->pdbPath);
+    }
+
+    EventRecordLayout record = {};
+    record.m_header = imageEvent.GetRecord ().m_header;
+    record.m_header.m_flags = ETLFormat::kEventHeaderFlagClassicHeader;
+    record.m_header.m_providerID = ImageInfoExtraGuid;
+    record.m_header.m_id = 0;
+    record.m_header.m_version = opcode == ETWConstants::ImageIDOpcode ? kImageIDVersion : kDbgIDRSDSVersion;
+    record.m_header.m_opcode = opcode;
+    record.m_header.m_task = 0;
+    record.m_header.m_keyword = 0;
+    record.m_processorNumber = imageEvent.GetProcessorNumber ();
+    record.m_loggerID = imageEvent.GetRecord ().m_loggerID;
+    record.m_userDataLength = static_cast<USHORT> (m_payload.size ());
+    record.m_pUserData = m_payload.data ();
+
+    if (!m_pSink->WriteEvent (EventView (record)))
+        return false;
+
+    ++m_stats.nIdentityEventsWritten;
+
+    return true;
+}
+
+}   // namespace ETWP
\ No newline at end of file
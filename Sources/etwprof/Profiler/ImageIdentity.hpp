@@ -0,0 +1,152 @@
+#ifndef ETWP_IMAGE_IDENTITY_HPP
+#define ETWP_IMAGE_IDENTITY_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ImageIdentityCache.hpp"
+#include "RelogPipeline.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/FileSystem/PEImage.hpp"
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Maps image paths, as logged by the kernel (e.g. "\Device\HarddiskVolume3\Windows\System32\ntdll.dll"), to paths
+//   that can be opened (e.g. "C:\Windows\System32\ntdll.dll"). Must be thread safe
+using ImagePathTranslator = std::function<std::filesystem::path (const std::wstring& imagePath)>;
+
+// Reads (and caches) the identities of images (see PEImageIdentity), by their paths as logged by the kernel. If a
+//   persistent cache is given, images found in it (with the same size and last write time) are not read at all, and
+//   the identities of the others are added to it. Images can be read in the background as well (see
+//   ResolveInBackground), by a thread started on first use. Thread safe
+class ImageIdentityResolver final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ImageIdentityResolver);
+
+    struct Stats {
+        uint32_t nResolved;
+        uint32_t nUnresolved;     // E.g. the file does not exist (anymore), or it's not a PE image
+        uint32_t nFromCache;      // Resolved from the persistent cache, without reading the image
+    };
+
+    explicit ImageIdentityResolver (const ImagePathTranslator& pathTranslator, ImageIdentityCache* pCache = nullptr);
+
+    ~ImageIdentityResolver ();  // Stops the background thread (images queued, but not read yet are not read)
+
+    // Reads the identities of the images not read yet, on nThreads threads (if 0, one per (logical) processor). The
+    //   calling thread is one of the threads
+    void Resolve (const std::vector<std::wstring>& imagePaths, uint32_t nThreads = 0);
+
+    // Queues the image to be read by the background thread, if it's not read (or queued) yet. Does not wait
+    void ResolveInBackground (const std::wstring& imagePath);
+
+    // Returns true if the image is read already, i.e. Get will not wait
+    bool IsResolved (const std::wstring& imagePath) const;
+
+    // Returns nullptr, if the identity of the image cannot be read. Images not resolved yet are read now, images
+    //   queued for the background thread are waited for
+    const PEImageIdentity* Get (const std::wstring& imagePath);
+
+    Stats GetStats () const;
+
+private:
+    ImagePathTranslator                                               m_pathTranslator;
+    ImageIdentityCache*                                               m_pCache;
+    mutable std::mutex                                                m_lock;
+    std::condition_variable                                           m_resolvedCondition;
+    std::unordered_map<std::wstring, std::optional<PEImageIdentity>> m_identities;   // Guarded by m_lock
+    std::unordered_set<std::wstring>                                  m_pendingPaths; // Being read, guarded by m_lock
+    Stats                                                             m_stats;        // Guarded by m_lock
+
+    // Images queued by ResolveInBackground (these are pending as well), guarded by m_lock
+    std::vector<std::wstring>                                         m_backgroundPaths;
+    std::condition_variable                                           m_backgroundCondition;
+    bool                                                              m_stopBackgroundThread;
+    std::thread                                                       m_backgroundThread;
+
+    // Reads the images (which must be pending, i.e. not read by anyone else) on nThreads threads, then adds them
+    void ReadAll (const std::vector<const std::wstring*>& imagePaths, uint32_t nThreads);
+
+    std::optional<PEImageIdentity> Read (const std::wstring& imagePath, bool* pFromCacheOut) const;
+    void                           Add (const std::wstring& imagePath,
+                                        std::optional<PEImageIdentity>&& identity,
+                                        bool fromCache);    // m_lock must be held
+
+    void BackgroundThreadMain ();
+};
+
+// Returns true for image events that are followed by image identity events in merged traces (image loads and image
+//   rundown at the start of the trace)
+bool IsImageIdentitySource (const EventView& event);
+
+// Writes image identity events (ImageInfoExtraGuid ImageID and DbgID_RSDS, the events kerneltracecontrol.dll adds
+//   when merging a trace with EVENT_TRACE_MERGE_EXTENDED_DATA_IMAGEID) right after each image load and image rundown
+//   event passed through it, so symbols can be found for the trace. This way, the trace does not have to be rewritten
+//   by CreateMergedTraceFile just to add these.
+// Identity events have the timestamp, processor, process and thread of the image event they follow.
+// If images are resolved in the background, an image event whose image is not read yet is held back (along with every
+//   event after it, so the order of events is kept), and its image is read by the background thread of the resolver.
+//   Events held back are written once their images are read, so the thread writing events does not wait for the disk.
+//   If more than kMaxHeldBackSize bytes are held back, the oldest ones are waited for (events are never dropped)
+class ImageIdentitySink final : public IEventSink {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ImageIdentitySink);
+
+    static constexpr size_t kMaxHeldBackSize = 16 * 1'024 * 1'024;
+
+    struct Stats {
+        uint64_t nImageEvents;
+        uint64_t nIdentityEventsWritten;
+        uint64_t nUnresolvedImageEvents;    // No identity events were written for these
+        uint64_t nEventsHeldBack;           // Written later than they arrived (waiting for an image to be read)
+        size_t   heldBackHighWaterMark;     // In bytes
+    };
+
+    ImageIdentitySink (IEventSink* pSink, ImageIdentityResolver* pResolver, bool resolveInBackground = false);
+
+    virtual bool WriteEvent (const EventView& event) override;
+
+    // Waits for the images still being read, and writes the events held back. Call after the last event. Returns
+    //   false if writing any of them failed
+    bool Flush ();
+
+    Stats GetStats () const;
+
+private:
+    struct HeldEvent {
+        std::vector<uint64_t> storage;      // See StoreEvent
+        bool                  imageEvent;   // See IsImageIdentitySource
+        std::wstring          imagePath;    // Of image events
+    };
+
+    IEventSink*                          m_pSink;
+    ImageIdentityResolver*               m_pResolver;
+    bool                                 m_resolveInBackground;
+    std::deque<HeldEvent>                m_heldEvents;
+    size_t                               m_heldSize;         // In bytes
+    EventRecordLayout                    m_heldRecord;       // Of the held event being written
+    std::vector<EventExtendedItemLayout> m_heldExtendedData; // Of the held event being written
+    std::vector<uint8_t>                 m_payload;
+    Stats                                m_stats;
+
+    bool WriteWithIdentity (const EventView& event);
+    bool WriteHeldEvent ();     // Writes (and removes) the oldest event held back
+    bool WriteIdentityEvent (const EventView& imageEvent, UCHAR opcode);
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_IMAGE_IDENTITY_HPP
\ No newline at end of file
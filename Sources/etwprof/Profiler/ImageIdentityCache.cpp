@@ -0,0 +1,421 @@
+#include "ImageIdentityCache.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "Utility/OnExit.hpp"
+
+namespace ETWP {
+
+namespace {
+
+// Layout of the cache file (native byte order, it's not meant to be moved between machines anyways):
+//   FileHeaderLayout, bucket array (nBuckets x uint32_t, index of the record + 1, or 0 for empty buckets, open
+//   addressing with linear probing), record array (nRecords x RecordLayout), string pool (paths, not null terminated)
+constexpr uint64_t kMagic = 0x4344'4949'5057'5445;     // "ETWPIIDC"
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kMinBuckets = 16;
+
+struct FileHeaderLayout {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t nBuckets;      // Power of two
+    uint32_t nRecords;
+    uint32_t reserved;
+    uint64_t stringsSize;
+};
+
+struct RecordLayout {
+    uint64_t pathHash;
+    uint64_t fileSize;
+    int64_t  lastWriteTime;
+    uint32_t pathOffset;    // In the string pool
+    uint32_t pathLength;
+    uint32_t pdbPathOffset;
+    uint32_t pdbPathLength;
+    uint32_t timeDateStamp;
+    uint32_t sizeOfImage;
+    uint32_t checksum;
+    uint32_t pdbAge;
+    GUID     pdbGUID;
+    uint32_t hasPDBInfo;
+    uint32_t reserved;
+};
+
+static_assert (sizeof (FileHeaderLayout) == 32);
+static_assert (sizeof (RecordLayout) == 80);
+
+uint64_t HashPath (std::string_view path)
+{
+    // FNV-1a
+    uint64_t hash = 0xCBF2'9CE4'8422'2325;
+    for (char c : path) {
+        hash ^= static_cast<uint8_t> (c);
+        hash *= 0x0000'0100'0000'01B3;
+    }
+
+    return hash;
+}
+
+std::string ToUTF8 (const std::filesystem::path& path)
+{
+    const std::u8string utf8Path = path.u8string ();
+
+    return std::string (utf8Path.begin (), utf8Path.end ());
+}
+
+// Bounds checked access to a (validated) cache file
+class CacheFileView final {
+public:
+    explicit CacheFileView (const MappedFile& file);
+
+    // Validates the header and the size of the file. Records are checked when they are read
+    static bool IsValid (const MappedFile& file);
+
+    uint32_t GetNumberOfRecords () const;
+
+    bool FindRecord (std::string_view path, RecordLayout* pRecordOut) const;
+    bool ReadRecord (uint32_t index, RecordLayout* pRecordOut) const;
+    bool ReadString (uint32_t offset, uint32_t length, std::string_view* pStringOut) const;
+
+    bool ToRecord (const RecordLayout& layout, ImageIdentityCache::Record* pRecordOut) const;
+
+private:
+    const std::byte* m_pData;
+    FileHeaderLayout m_header;
+    size_t           m_recordsOffset;
+    size_t           m_stringsOffset;
+};
+
+CacheFileView::CacheFileView (const MappedFile& file):
+    m_pData (file.GetData ()),
+    m_header (),
+    m_recordsOffset (0),
+    m_stringsOffset (0)
+{
+    std::memcpy (&m_header, m_pData, sizeof m_header);
+    m_recordsOffset = sizeof (FileHeaderLayout) + size_t (m_header.nBuckets) * sizeof (uint32_t);
+    m_stringsOffset = m_recordsOffset + size_t (m_header.nRecords) * sizeof (RecordLayout);
+}
+
+bool CacheFileView::IsValid (const MappedFile& file)
+{
+    if (file.GetSize () < sizeof (FileHeaderLayout))
+        return false;
+
+    FileHeaderLayout header;
+    std::memcpy (&header, file.GetData (), sizeof header);
+    if (header.magic != kMagic || header.version != kVersion)
+        return false;
+
+    if (!std::has_single_bit (header.nBuckets) || header.nRecords > header.nBuckets)
+        return false;
+
+    const uint64_t expectedSize = sizeof (FileHeaderLayout) +
+                                  uint64_t (header.nBuckets) * sizeof (uint32_t) +
+                                  uint64_t (header.nRecords) * sizeof (RecordLayout) +
+                                  header.stringsSize;
+
+    return header.stringsSize <= file.GetSize () && expectedSize == file.GetSize ();
+}
+
+uint32_t CacheFileView::GetNumberOfRecords () const
+{
+    return m_header.nRecords;
+}
+
+bool CacheFileView::FindRecord (std::string_view path, RecordLayout* pRecordOut) const
+{
+    const uint64_t hash = HashPath (path);
+    const uint32_t mask = m_header.nBuckets - 1;
+
+    uint32_t bucket = static_cast<uint32_t> (hash) & mask;
+    for (uint32_t i = 0; i < m_header.nBuckets; ++i, bucket = (bucket + 1) & mask) {
+        uint32_t recordIndexPlusOne;
+        std::memcpy (&recordIndexPlusOne,
+                     m_pData + sizeof (FileHeaderLayout) + bucket * sizeof (uint32_t),
+                     sizeof recordIndexPlusOne);
+        if (recordIndexPlusOne == 0)
+            return false;
+
+        std::string_view recordPath;
+        if (!ReadRecord (recordIndexPlusOne - 1, pRecordOut) ||
+            !ReadString (pRecordOut->pathOffset, pRecordOut->pathLength, &recordPath))
+        {
+            return false;
+        }
+
+        if (pRecordOut->pathHash == hash && recordPath == path)
+            return true;
+    }
+
+    return false;
+}
+
+bool CacheFileView::ReadRecord (uint32_t index, RecordLayout* pRecordOut) const
+{
+    if (index >= m_header.nRecords)
+        return false;
+
+    std::memcpy (pRecordOut, m_pData + m_recordsOffset + index * sizeof (RecordLayout), sizeof (RecordLayout));
+
+    return true;
+}
+
+bool CacheFileView::ReadString (uint32_t offset, uint32_t length, std::string_view* pStringOut) const
+{
+    if (uint64_t (offset) + length > m_header.stringsSize)
+        return false;
+
+    *pStringOut = std::string_view (reinterpret_cast<const char*> (m_pData + m_stringsOffset + offset), length);
+
+    return true;
+}
+
+bool CacheFileView::ToRecord (const RecordLayout& layout, ImageIdentityCache::Record* pRecordOut) const
+{
+    std::string_view pdbPath;
+    if (!ReadString (layout.pdbPathOffset, layout.pdbPathLength, &pdbPath))
+        return false;
+
+    pRecordOut->fileSize = layout.fileSize;
+    pRecordOut->lastWriteTime = layout.lastWriteTime;
+    pRecordOut->identity.timeDateStamp = layout.timeDateStamp;
+    pRecordOut->identity.sizeOfImage = layout.sizeOfImage;
+    pRecordOut->identity.checksum = layout.checksum;
+    pRecordOut->identity.hasPDBInfo = layout.hasPDBInfo != 0;
+    pRecordOut->identity.pdbGUID = layout.pdbGUID;
+    pRecordOut->identity.pdbAge = layout.pdbAge;
+    pRecordOut->identity.pdbPath = pdbPath;
+
+    return true;
+}
+
+std::unique_ptr<MappedFile> OpenCacheFile (const std::filesystem::path& path)
+{
+    std::error_code ec;
+    if (!std::filesystem::exists (path, ec))
+        return nullptr;
+
+    std::unique_ptr<MappedFile> file;
+    try {
+        file = std::make_unique<MappedFile> (path, MappedFile::AccessPattern::Random);
+    } catch (const MappedFile::InitException&) {
+        return nullptr;
+    }
+
+    return CacheFileView::IsValid (*file) ? std::move (file) : nullptr;
+}
+
+std::vector<std::byte> BuildCacheFile (const std::unordered_map<std::string, ImageIdentityCache::Record>& records)
+{
+    const uint32_t nRecords = static_cast<uint32_t> (records.size ());
+    const uint32_t nBuckets = std::max (std::bit_ceil (nRecords * 2), kMinBuckets);   // Load factor <= 0.5
+
+    std::vector<uint32_t> buckets (nBuckets, 0);
+    std::vector<RecordLayout> recordLayouts;
+    std::string strings;
+    recordLayouts.reserve (nRecords);
+    for (const auto& [path, record] : records) {
+        RecordLayout layout = {};
+        layout.pathHash = HashPath (path);
+        layout.fileSize = record.fileSize;
+        layout.lastWriteTime = record.lastWriteTime;
+        layout.pathOffset = static_cast<uint32_t> (strings.size ());
+        layout.pathLength = static_cast<uint32_t> (path.size ());
+        strings += path;
+        layout.pdbPathOffset = static_cast<uint32_t> (strings.size ());
+        layout.pdbPathLength = static_cast<uint32_t> (record.identity.pdbPath.size ());
+        strings += record.identity.pdbPath;
+        layout.timeDateStamp = record.identity.timeDateStamp;
+        layout.sizeOfImage = record.identity.sizeOfImage;
+        layout.checksum = record.identity.checksum;
+        layout.pdbAge = record.identity.pdbAge;
+        layout.pdbGUID = record.identity.pdbGUID;
+        layout.hasPDBInfo = record.identity.hasPDBInfo;
+
+        uint32_t bucket = static_cast<uint32_t> (layout.pathHash) & (nBuckets - 1);
+        while (buckets[bucket] != 0)
+            bucket = (bucket + 1) & (nBuckets - 1);
+
+        recordLayouts.push_back (layout);
+        buckets[bucket] = static_cast<uint32_t> (recordLayouts.size ());
+    }
+
+    FileHeaderLayout header = {};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.nBuckets = nBuckets;
+    header.nRecords = nRecords;
+    header.stringsSize = strings.size ();
+
+    const size_t bucketsSize = buckets.size () * sizeof (uint32_t);
+    const size_t recordsSize = recordLayouts.size () * sizeof (RecordLayout);
+    std::vector<std::byte> contents (sizeof header + bucketsSize + recordsSize + strings.size ());
+    std::byte* pNext = contents.data ();
+    std::memcpy (pNext, &header, sizeof header);
+    pNext += sizeof header;
+    std::memcpy (pNext, buckets.data (), bucketsSize);
+    pNext += bucketsSize;
+    std::memcpy (pNext, recordLayouts.data (), recordsSize);
+    pNext += recordsSize;
+    std::memcpy (pNext, strings.data (), strings.size ());
+
+    return contents;
+}
+
+}   // namespace
+
+ImageIdentityCache::ImageIdentityCache (const std::filesystem::path& path):
+    m_path (path),
+    m_mutex (),
+    m_file (OpenCacheFile (path)),
+    m_addedRecords ()
+{
+}
+
+bool ImageIdentityCache::Find (const std::filesystem::path& imagePath,
+                               uint64_t fileSize,
+                               int64_t lastWriteTime,
+                               PEImageIdentity* pIdentityOut) const
+{
+    const std::string utf8Path = ToUTF8 (imagePath);
+
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    // Records added are newer than the ones in the file
+    Record record;
+    const auto it = m_addedRecords.find (utf8Path);
+    if (it != m_addedRecords.end ()) {
+        record = it->second;
+    } else {
+        if (m_file == nullptr)
+            return false;
+
+        const CacheFileView view (*m_file);
+        RecordLayout layout;
+        if (!view.FindRecord (utf8Path, &layout) || !view.ToRecord (layout, &record))
+            return false;
+    }
+
+    if (record.fileSize != fileSize || record.lastWriteTime != lastWriteTime)
+        return false;   // The image has changed since
+
+    *pIdentityOut = std::move (record.identity);
+
+    return true;
+}
+
+void ImageIdentityCache::Add (const std::filesystem::path& imagePath,
+                              uint64_t fileSize,
+                              int64_t lastWriteTime,
+                              const PEImageIdentity& identity)
+{
+    std::string utf8Path = ToUTF8 (imagePath);
+
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    m_addedRecords.insert_or_assign (std::move (utf8Path), Record { fileSize, lastWriteTime, identity });
+}
+
+bool ImageIdentityCache::Save (std::wstring* pErrorOut)
+{
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    if (m_addedRecords.empty ())
+        return true;
+
+    // The file on disk might have been replaced by other processes since it was loaded, so it's read again. On
+    //   Windows, a mapped file cannot be replaced, so it's only reopened after saving
+    m_file.reset ();
+    OnExit fileReopener ([this]() { m_file = OpenCacheFile (m_path); });
+
+    std::unordered_map<std::string, Record> records;
+    if (std::unique_ptr<MappedFile> currentFile = OpenCacheFile (m_path); currentFile != nullptr) {
+        const CacheFileView view (*currentFile);
+        if (view.GetNumberOfRecords () + m_addedRecords.size () <= kMaxRecords) {
+            for (uint32_t i = 0; i < view.GetNumberOfRecords (); ++i) {
+                RecordLayout layout;
+                Record record;
+                std::string_view path;
+                if (view.ReadRecord (i, &layout) &&
+                    view.ReadString (layout.pathOffset, layout.pathLength, &path) &&
+                    view.ToRecord (layout, &record))
+                {
+                    records.emplace (path, std::move (record));
+                }
+            }
+        }
+    }
+
+    for (const auto& [path, record] : m_addedRecords)
+        records.insert_or_assign (path, record);
+
+    const std::vector<std::byte> contents = BuildCacheFile (records);
+
+    std::error_code ec;
+    if (m_path.has_parent_path ())
+        std::filesystem::create_directories (m_path.parent_path (), ec);
+
+    // The new file is written next to the old one, then it replaces the old one in one step
+    std::filesystem::path tempPath = m_path;
+    tempPath += ".";
+    tempPath += std::to_string (std::random_device {} ());
+    tempPath += ".tmp";
+    {
+        std::ofstream tempFile (tempPath, std::ios::binary | std::ios::trunc);
+        tempFile.write (reinterpret_cast<const char*> (contents.data ()), contents.size ());
+        tempFile.close ();
+        if (!tempFile) {
+            std::filesystem::remove (tempPath, ec);
+            *pErrorOut = L"Unable to write image identity cache file: " + tempPath.wstring ();
+
+            return false;
+        }
+    }
+
+    std::filesystem::rename (tempPath, m_path, ec);
+    if (ec) {
+        std::filesystem::remove (tempPath, ec);
+        *pErrorOut = L"Unable to replace image identity cache file: " + m_path.wstring ();
+
+        return false;
+    }
+
+    m_addedRecords.clear ();
+
+    return true;
+}
+
+uint32_t ImageIdentityCache::GetNumberOfRecords () const
+{
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    return m_file != nullptr ? CacheFileView (*m_file).GetNumberOfRecords () : 0;
+}
+
+bool ImageIdentityCache::GetFileKey (const std::filesystem::path& path,
+                                     uint64_t* pFileSizeOut,
+                                     int64_t* pLastWriteTimeOut)
+{
+    std::error_code ec;
+    const uintmax_t fileSize = std::filesystem::file_size (path, ec);
+    if (ec)
+        return false;
+
+    const std::filesystem::file_time_type lastWriteTime = std::filesystem::last_write_time (path, ec);
+    if (ec)
+        return false;
+
+    *pFileSizeOut = fileSize;
+    *pLastWriteTimeOut = static_cast<int64_t> (lastWriteTime.time_since_epoch ().count ());
+
+    return true;
+}
+
+}   // namespace ETWP
\ No newline at end of file
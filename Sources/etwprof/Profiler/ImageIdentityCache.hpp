@@ -0,0 +1,68 @@
+#ifndef ETWP_IMAGE_IDENTITY_CACHE_HPP
+#define ETWP_IMAGE_IDENTITY_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "OS/FileSystem/MappedFile.hpp"
+#include "OS/FileSystem/PEImage.hpp"
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Persistent cache of image identities (see PEImageIdentity), so the same (system) images do not have to be read again
+//   and again, for every trace. Records are keyed by the path of the image, and they are only valid as long as the
+//   size and last write time of the file match, so updated images are read again automatically.
+// The cache file is memory mapped, and looked up through an on-disk hash table (no parsing needed when loading it).
+//   It is never modified in place: Save writes a new file, containing the records of the file on disk at that time
+//   (written by other processes in the meantime, maybe) and the records added, and replaces the old file with it. This
+//   way, readers always see a complete file. If two processes save at the same time, the records of one of them might
+//   be lost, which is fine for a cache.
+// A missing, invalid or outdated (format) cache file is treated as an empty one. Thread safe
+class ImageIdentityCache final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ImageIdentityCache);
+
+    // Records of other images are dropped when saving, if there would be more records than this
+    static constexpr uint32_t kMaxRecords = 64 * 1'024;
+
+    explicit ImageIdentityCache (const std::filesystem::path& path);
+
+    bool Find (const std::filesystem::path& imagePath,
+               uint64_t fileSize,
+               int64_t lastWriteTime,
+               PEImageIdentity* pIdentityOut) const;
+    void Add (const std::filesystem::path& imagePath,
+              uint64_t fileSize,
+              int64_t lastWriteTime,
+              const PEImageIdentity& identity);
+
+    // Does nothing, if no records were added
+    bool Save (std::wstring* pErrorOut);
+
+    uint32_t GetNumberOfRecords () const;  // Of the cache file loaded (or saved last)
+
+    // Size and last write time of a file, as used by the cache (the time is in file clock units)
+    static bool GetFileKey (const std::filesystem::path& path, uint64_t* pFileSizeOut, int64_t* pLastWriteTimeOut);
+
+    struct Record {
+        uint64_t        fileSize;
+        int64_t         lastWriteTime;
+        PEImageIdentity identity;
+    };
+
+private:
+    std::filesystem::path                   m_path;
+    mutable std::mutex                      m_mutex;
+    std::unique_ptr<MappedFile>             m_file;             // nullptr if there is no valid cache file
+    std::unordered_map<std::string, Record> m_addedRecords;     // Keys are UTF-8 paths
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_IMAGE_IDENTITY_CACHE_HPP
\ No newline at end of file
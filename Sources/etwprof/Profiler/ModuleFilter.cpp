@@ -0,0 +1,326 @@
+#include "ModuleFilter.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+#include <fstream>
+
+#include "StoredEvent.hpp"
+
+#include "OS/ETW/ETWConstants.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+namespace {
+
+// Compacting the storage of queued events is worth it above this size only (in words)
+constexpr size_t kMinCompactionSize = 64 * 1'024;
+
+std::wstring ToLower (std::wstring string)
+{
+    for (wchar_t& c : string)
+        c = static_cast<wchar_t> (std::towlower (c));
+
+    return string;
+}
+
+std::wstring GetFileName (const std::wstring& path)
+{
+    const size_t lastSeparator = path.find_last_of (L"\\/");
+
+    return lastSeparator == std::wstring::npos ? path : path.substr (lastSeparator + 1);
+}
+
+bool IsSampledProfileEvent (const EventView& event)
+{
+    return event.GetProviderID () == PerfInfoGuid && event.GetOpcode () == ETWConstants::SampledProfileOpcode &&
+           event.GetUserDataLength () >= sizeof (ETWConstants::SampledProfileDataStub);
+}
+
+bool IsStackWalkEvent (const EventView& event)
+{
+    return event.GetProviderID () == StackWalkGuid && event.GetOpcode () == ETWConstants::StackWalkOpcode &&
+           event.GetUserDataLength () >= sizeof (ETWConstants::StackWalkDataStub);
+}
+
+bool IsThreadEndEvent (const EventView& event)
+{
+    return event.GetProviderID () == ThreadGuid && event.GetOpcode () == ETWConstants::TEndOpcode &&
+           event.GetUserDataLength () >= sizeof (ETWConstants::ThreadDataStub);
+}
+
+}   // namespace
+
+bool ModuleFilterConfig::IsEnabled () const
+{
+    return !moduleNames.empty ();
+}
+
+ModuleSampleFilter::ModuleSampleFilter (IEventSink* pSink, const ModuleFilterConfig& config, int64_t perfFreq):
+    m_pSink (pSink),
+    m_moduleNames (),
+    m_windowTicks (int64_t (config.window) * perfFreq / 1'000),
+    m_modules (),
+    m_matchingModules (),
+    m_pendingSamples (),
+    m_expiryQueue (),
+    m_queue (),
+    m_firstSequenceNumber (0),
+    m_storage (),
+    m_storageHead (0),
+    m_threadCounters (),
+    m_stats ()
+{
+    ETWP_ASSERT (m_pSink != nullptr);
+
+    for (const std::wstring& moduleName : config.moduleNames)
+        m_moduleNames.push_back (ToLower (moduleName));
+}
+
+bool ModuleSampleFilter::WriteEvent (const EventView& event)
+{
+    m_modules.OnEvent (event);
+
+    // Samples older than the window will not get their stacks anymore (or they are not interesting)
+    Expire (event.GetTimestamp ());
+
+    // Events that do not have to wait are written right away, unless something before them is waiting
+    bool result = true;
+    const auto pass = [&] () {
+        if (m_queue.empty ()) {
+            result = m_pSink->WriteEvent (event);
+        } else {
+            Enqueue (event, Decision::Keep);
+            ++m_stats.nEventsHeldBack;
+        }
+    };
+
+    if (IsSampledProfileEvent (event)) {
+        const ETWConstants::SampledProfileDataStub* pData =
+            static_cast<const ETWConstants::SampledProfileDataStub*> (event.GetUserData ());
+        const DWORD pid = event.GetProcessID ();
+        const DWORD tid = pData->m_threadID;
+
+        // The previous sample of the thread has all of its stack by now, and it did not match
+        Decide (tid, false);
+
+        ThreadCounters& counters = m_threadCounters[uint64_t (pid) << 32 | tid];
+        counters.pid = pid;
+        counters.tid = tid;
+        ++counters.nSamples;
+        ++m_stats.nSamples;
+
+        if (IsMatchingAddress (pid, pData->m_ip)) {
+            ++counters.nSamplesKept;
+            ++m_stats.nSamplesKept;
+            pass ();
+        } else {
+            m_pendingSamples[tid] = { event.GetTimestamp (), pid, 1, { Enqueue (event, Decision::Undecided) } };
+            m_expiryQueue.push_back ({ tid, event.GetTimestamp () });
+        }
+    } else if (IsStackWalkEvent (event)) {
+        const ETWConstants::StackWalkDataStub* pData =
+            static_cast<const ETWConstants::StackWalkDataStub*> (event.GetUserData ());
+
+        // Stacks of other events (and of samples decided already) are not filtered
+        const auto it = m_pendingSamples.find (pData->m_threadID);
+        if (it != m_pendingSamples.end () &&
+            it->second.timeStamp == int64_t (pData->m_timeStamp) &&
+            it->second.nEvents < it->second.sequenceNumbers.size ())
+        {
+            PendingSample& sample = it->second;
+            sample.sequenceNumbers[sample.nEvents++] = Enqueue (event, Decision::Undecided);
+            if (IsMatchingStack (pData->m_processID, event))
+                Decide (pData->m_threadID, true);
+        } else {
+            pass ();
+        }
+    } else {
+        pass ();
+
+        if (IsThreadEndEvent (event))
+            Decide (static_cast<const ETWConstants::ThreadDataStub*> (event.GetUserData ())->m_threadID, false);
+    }
+
+    return WriteDecided () && result;
+}
+
+bool ModuleSampleFilter::Flush ()
+{
+    while (!m_pendingSamples.empty ())
+        Decide (m_pendingSamples.begin ()->first, false);
+
+    m_expiryQueue.clear ();
+
+    return WriteDecided ();
+}
+
+std::vector<ModuleSampleFilter::ThreadCounters> ModuleSampleFilter::GetThreadCounters () const
+{
+    std::vector<ThreadCounters> threadCounters;
+    threadCounters.reserve (m_threadCounters.size ());
+    for (const auto& [key, counters] : m_threadCounters)
+        threadCounters.push_back (counters);
+
+    std::sort (threadCounters.begin (),
+               threadCounters.end (),
+               [] (const ThreadCounters& lhs, const ThreadCounters& rhs) {
+                   return lhs.pid != rhs.pid ? lhs.pid < rhs.pid : lhs.tid < rhs.tid;
+               });
+
+    return threadCounters;
+}
+
+bool ModuleSampleFilter::WriteThreadCounters (const std::filesystem::path& path, std::wstring* pErrorOut) const
+{
+    std::ofstream file (path, std::ios::trunc);
+    file << "pid,tid,samples,kept_samples\n";
+    for (const ThreadCounters& counters : GetThreadCounters ())
+        file << counters.pid << ',' << counters.tid << ',' << counters.nSamples << ',' << counters.nSamplesKept << '\n';
+
+    file.close ();
+    if (!file) {
+        *pErrorOut = L"Unable to write sample counters file: " + path.wstring ();
+
+        return false;
+    }
+
+    return true;
+}
+
+ModuleSampleFilter::Stats ModuleSampleFilter::GetStats () const
+{
+    return m_stats;
+}
+
+bool ModuleSampleFilter::IsMatchingAddress (DWORD pid, UINT_PTR address)
+{
+    const uint32_t moduleID = m_modules.GetSnapshot (pid)->Find (address);
+
+    return moduleID != ModuleIndex::kNoModule && IsMatchingModule (moduleID);
+}
+
+bool ModuleSampleFilter::IsMatchingStack (DWORD pid, const EventView& stackWalkEvent)
+{
+    const std::shared_ptr<const ModuleIndex> snapshot = m_modules.GetSnapshot (pid);
+
+    // Frames are copied, as the payload is not necessarily aligned
+    const size_t nFrames =
+        (stackWalkEvent.GetUserDataLength () - sizeof (ETWConstants::StackWalkDataStub)) / sizeof (UINT_PTR);
+    const uint8_t* pFrames =
+        static_cast<const uint8_t*> (stackWalkEvent.GetUserData ()) + sizeof (ETWConstants::StackWalkDataStub);
+
+    std::array<UINT_PTR, ModuleIndex::kBatchSize> frames;
+    std::array<uint32_t, ModuleIndex::kBatchSize> moduleIDs;
+    for (size_t start = 0; start < nFrames; start += ModuleIndex::kBatchSize) {
+        const size_t n = std::min (ModuleIndex::kBatchSize, nFrames - start);
+        std::memcpy (frames.data (), pFrames + start * sizeof (UINT_PTR), n * sizeof (UINT_PTR));
+        snapshot->FindBatch (frames.data (), n, moduleIDs.data ());
+
+        for (size_t i = 0; i < n; ++i) {
+            if (moduleIDs[i] != ModuleIndex::kNoModule && IsMatchingModule (moduleIDs[i]))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+bool ModuleSampleFilter::IsMatchingModule (uint32_t moduleID)
+{
+    if (moduleID >= m_matchingModules.size ())
+        m_matchingModules.resize (moduleID + 1, Decision::Undecided);
+
+    Decision& matching = m_matchingModules[moduleID];
+    if (matching == Decision::Undecided) {
+        const std::wstring fileName = ToLower (GetFileName (m_modules.GetModule (moduleID).path));
+        const bool found = std::find (m_moduleNames.begin (), m_moduleNames.end (), fileName) != m_moduleNames.end ();
+        matching = found ? Decision::Keep : Decision::Drop;
+    }
+
+    return matching == Decision::Keep;
+}
+
+uint64_t ModuleSampleFilter::Enqueue (const EventView& event, Decision decision)
+{
+    const size_t nWords = (GetStoredEventSize (event) + sizeof (uint64_t) - 1) / sizeof (uint64_t);
+    const size_t offset = m_storage.size ();
+    m_storage.resize (offset + nWords);
+    StoreEvent (event, m_storage.data () + offset);
+
+    m_queue.push_back ({ offset, decision });
+    m_stats.queueHighWaterMark = std::max (m_stats.queueHighWaterMark,
+                                           (m_storage.size () - m_storageHead) * sizeof (uint64_t));
+
+    return m_firstSequenceNumber + m_queue.size () - 1;
+}
+
+void ModuleSampleFilter::Decide (DWORD tid, bool keep)
+{
+    const auto it = m_pendingSamples.find (tid);
+    if (it == m_pendingSamples.end ())
+        return;
+
+    const PendingSample& sample = it->second;
+    for (uint32_t i = 0; i < sample.nEvents; ++i)
+        m_queue[sample.sequenceNumbers[i] - m_firstSequenceNumber].decision = keep ? Decision::Keep : Decision::Drop;
+
+    if (keep) {
+        ++m_threadCounters[uint64_t (sample.pid) << 32 | tid].nSamplesKept;
+        ++m_stats.nSamplesKept;
+    } else {
+        m_stats.nEventsDropped += sample.nEvents;
+    }
+
+    m_pendingSamples.erase (it);
+}
+
+void ModuleSampleFilter::Expire (int64_t timeStamp)
+{
+    while (!m_expiryQueue.empty () && m_expiryQueue.front ().timeStamp + m_windowTicks < timeStamp) {
+        const ExpiryEntry& entry = m_expiryQueue.front ();
+        const auto it = m_pendingSamples.find (entry.tid);
+        if (it != m_pendingSamples.end () && it->second.timeStamp == entry.timeStamp)
+            Decide (entry.tid, false);
+
+        m_expiryQueue.pop_front ();
+    }
+}
+
+bool ModuleSampleFilter::WriteDecided ()
+{
+    bool result = true;
+    EventRecordLayout record;
+    std::vector<EventExtendedItemLayout> extendedData;
+    while (!m_queue.empty () && m_queue.front ().decision != Decision::Undecided) {
+        if (m_queue.front ().decision == Decision::Keep) {
+            const EventView event = LoadStoredEvent (m_storage.data () + m_queue.front ().offset,
+                                                     &record,
+                                                     &extendedData);
+            result = m_pSink->WriteEvent (event) && result;
+        }
+
+        m_queue.pop_front ();
+        ++m_firstSequenceNumber;
+    }
+
+    if (m_queue.empty ()) {
+        m_storage.clear ();
+        m_storageHead = 0;
+    } else {
+        m_storageHead = m_queue.front ().offset;
+        if (m_storageHead >= kMinCompactionSize && m_storageHead > m_storage.size () / 2) {
+            m_storage.erase (m_storage.begin (), m_storage.begin () + m_storageHead);
+            for (QueuedEvent& queuedEvent : m_queue)
+                queuedEvent.offset -= m_storageHead;
+
+            m_storageHead = 0;
+        }
+    }
+
+    return result;
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,123 @@
+#ifndef ETWP_MODULE_FILTER_HPP
+#define ETWP_MODULE_FILTER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ModuleIndex.hpp"
+#include "RelogPipeline.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+struct ModuleFilterConfig {
+    std::vector<std::wstring> moduleNames;  // File names (e.g. "foo.dll"), case insensitive. Empty means no filtering
+    uint32_t                  window = 100; // In milliseconds: samples wait for their stacks this long at most
+    std::filesystem::path     countersPath; // Where the profiler writes per-thread sample counts (if not empty)
+
+    bool IsEnabled () const;
+};
+
+// Keeps a SampledProfile event (and its StackWalk events) only if its instruction pointer, or any frame of its stack
+//   falls into one of the given modules. Addresses are resolved with a ModuleMap, built from the image events passing
+//   through. Stacks arrive after their samples (user mode parts possibly much later), so a sample that does not match
+//   by its instruction pointer is held back (with all events after it, so the order of events is kept), until it
+//   matches, or the next sample (or the end) of its thread arrives, or the window elapses.
+// The number of samples (and kept samples) of each thread is counted, so percentages can be computed from the
+//   filtered output, too (see WriteThreadCounters).
+// Not thread safe: WriteEvent and Flush must be called from the same thread
+class ModuleSampleFilter final : public IEventSink {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ModuleSampleFilter);
+
+    struct ThreadCounters {
+        DWORD    pid;
+        DWORD    tid;
+        uint64_t nSamples;
+        uint64_t nSamplesKept;
+    };
+
+    struct Stats {
+        uint64_t nSamples;
+        uint64_t nSamplesKept;
+        uint64_t nEventsDropped;        // Samples and their stacks
+        uint64_t nEventsHeldBack;       // Written later than they arrived (waiting for a sample to be decided)
+        size_t   queueHighWaterMark;    // In bytes
+    };
+
+    // perfFreq is the frequency of event timestamps
+    ModuleSampleFilter (IEventSink* pSink, const ModuleFilterConfig& config, int64_t perfFreq);
+
+    virtual bool WriteEvent (const EventView& event) override;
+
+    // Decides the samples still waiting for their stacks, and writes the events held back. Call after the last event
+    bool Flush ();
+
+    std::vector<ThreadCounters> GetThreadCounters () const;     // Ordered by process and thread ID
+    bool                        WriteThreadCounters (const std::filesystem::path& path, std::wstring* pErrorOut) const;
+
+    Stats GetStats () const;
+
+private:
+    static constexpr size_t kMaxStackWalkEvents = 3;    // Per sample
+
+    enum class Decision : uint8_t {
+        Undecided,
+        Keep,
+        Drop
+    };
+
+    struct QueuedEvent {
+        size_t   offset;    // In m_storage, in words
+        Decision decision;
+    };
+
+    // A sample, which did not match (yet), waiting for its StackWalk events
+    struct PendingSample {
+        int64_t                                         timeStamp;
+        DWORD                                           pid;
+        uint32_t                                        nEvents;
+        std::array<uint64_t, kMaxStackWalkEvents + 1>   sequenceNumbers;   // Of its queued events
+    };
+
+    struct ExpiryEntry {
+        DWORD   tid;
+        int64_t timeStamp;
+    };
+
+    IEventSink*                                   m_pSink;
+    std::vector<std::wstring>                     m_moduleNames;  // In lower case
+    int64_t                                       m_windowTicks;
+    ModuleMap                                     m_modules;
+    std::vector<Decision>                         m_matchingModules;  // By module ID, Undecided if not checked yet
+    std::unordered_map<DWORD, PendingSample>      m_pendingSamples;   // By thread ID
+    std::deque<ExpiryEntry>                       m_expiryQueue;      // In the order of samples
+    std::deque<QueuedEvent>                       m_queue;
+    uint64_t                                      m_firstSequenceNumber;  // Of the front of m_queue
+    std::vector<uint64_t>                         m_storage;          // Queued events (see StoreEvent)
+    size_t                                        m_storageHead;      // In words, before this everything is written
+    std::unordered_map<uint64_t, ThreadCounters>  m_threadCounters;   // By (PID, TID)
+    Stats                                         m_stats;
+
+    bool     IsMatchingAddress (DWORD pid, UINT_PTR address);
+    bool     IsMatchingStack (DWORD pid, const EventView& stackWalkEvent);
+    bool     IsMatchingModule (uint32_t moduleID);
+    uint64_t Enqueue (const EventView& event, Decision decision);
+    void     Decide (DWORD tid, bool keep);
+    void     Expire (int64_t timeStamp);
+    bool     WriteDecided ();
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_MODULE_FILTER_HPP
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "ModuleIndex.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "OS/Utility/Address.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+namespace {
+
+constexpr UINT_PTR kMaxAddress = std::numeric_limits<UINT_PTR>::max ();
+
+// In-order traversal of the (implicit) tree visits its nodes in sorted order
+template<typename Fill>
+void FillInOrder (size_t k, size_t capacity, Fill& fill)
+{
+    if (k >= capacity)
+        return;
+
+    FillInOrder (2 * k, capacity, fill);
+    fill (k);
+    FillInOrder (2 * k + 1, capacity, fill);
+}
+
+}   // namespace
+
+ModuleIndex::ModuleIndex (std::vector<Interval> intervals): m_depth (0), m_size (0), m_ends (), m_nodes ()
+{
+    std::stable_sort (intervals.begin (), intervals.end (), [] (const Interval& lhs, const Interval& rhs) {
+        return lhs.base < rhs.base;
+    });
+
+    std::vector<Interval> sorted;
+    sorted.reserve (intervals.size ());
+    for (const Interval& interval : intervals) {
+        if (interval.end <= interval.base)
+            continue;
+
+        if (!sorted.empty () && sorted.back ().end > interval.base) {
+            sorted.back ().end = interval.base;
+            if (sorted.back ().end <= sorted.back ().base)
+                sorted.pop_back ();
+        }
+
+        sorted.push_back (interval);
+    }
+
+    m_size = sorted.size ();
+    m_depth = static_cast<uint32_t> (std::bit_width (m_size));
+
+    // Padding nodes (after the real ones, in sorted order) and index 0 end at the top of the address space, and belong
+    //   to no module
+    const size_t capacity = size_t (1) << m_depth;
+    m_ends.assign (capacity, kMaxAddress);
+    m_nodes.assign (capacity, { kMaxAddress, kNoModule });
+
+    size_t i = 0;
+    auto fill = [&] (size_t k) {
+        if (i < sorted.size ()) {
+            m_ends[k] = sorted[i].end;
+            m_nodes[k] = { sorted[i].base, sorted[i].moduleID };
+        }
+
+        ++i;
+    };
+
+    FillInOrder (1, capacity, fill);
+}
+
+void ModuleIndex::FindBatch (const UINT_PTR* pAddresses, size_t nAddresses, uint32_t* pModuleIDsOut) const
+{
+    const UINT_PTR* pEnds = m_ends.data ();
+    const Node* pNodes = m_nodes.data ();
+
+    size_t k[kBatchSize];
+    for (size_t start = 0; start < nAddresses; start += kBatchSize) {
+        const size_t n = std::min (kBatchSize, nAddresses - start);
+        const UINT_PTR* pBatch = pAddresses + start;
+
+        // Level by level, so the loads of different lookups are in flight at the same time
+        std::fill_n (k, n, size_t (1));
+        for (uint32_t level = 0; level < m_depth; ++level) {
+            for (size_t i = 0; i < n; ++i)
+                k[i] = 2 * k[i] + (pEnds[k[i]] <= pBatch[i]);
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            const Node& node = pNodes[k[i] >> (std::countr_one (k[i]) + 1)];
+            pModuleIDsOut[start + i] = node.base <= pBatch[i] ? node.moduleID : kNoModule;
+        }
+    }
+}
+
+size_t ModuleIndex::GetSize () const
+{
+    return m_size;
+}
+
+size_t ModuleIndex::GetMemoryUsage () const
+{
+    return m_ends.capacity () * sizeof (UINT_PTR) + m_nodes.capacity () * sizeof (Node);
+}
+
+ModuleMap::ModuleMap ():
+    m_modules (),
+    m_kernel (),
+    m_kernelVersion (0),
+    m_processes (),
+    m_nSnapshotsBuilt (0)
+{
+}
+
+void ModuleMap::OnEvent (const EventView& event)
+{
+    const GUID& providerID = event.GetProviderID ();
+    const UCHAR opcode = event.GetOpcode ();
+    if (providerID == ImageLoadGuid) {
+        if (event.GetUserDataLength () < sizeof (ETWConstants::ImageLoadDataStub))
+            return;
+
+        const ETWConstants::ImageLoadDataStub* pData =
+            static_cast<const ETWConstants::ImageLoadDataStub*> (event.GetUserData ());
+        if (opcode == ETWConstants::ImageLoadOpcode || opcode == ETWConstants::ImageDCStartOpcode) {
+            AddModule (pData->m_processID,
+                       pData->m_imageBase,
+                       pData->m_imageSize,
+                       ETWConstants::GetImageFileName (event));
+        } else if (opcode == ETWConstants::ImageUnloadOpcode) {
+            RemoveModule (pData->m_processID, pData->m_imageBase);
+        }
+    } else if (providerID == ProcessGuid && opcode == ETWConstants::PEndOpcode) {
+        if (event.GetUserDataLength () < sizeof (ETWConstants::ProcessDataStub))
+            return;
+
+        RemoveProcess (static_cast<const ETWConstants::ProcessDataStub*> (event.GetUserData ())->m_processID);
+    }
+}
+
+uint32_t ModuleMap::AddModule (DWORD pid, UINT_PTR base, UINT_PTR size, const std::wstring& path)
+{
+    const bool kernel = IsKernelModeAddress (base);
+    const uint32_t moduleID = static_cast<uint32_t> (m_modules.size ());
+    m_modules.push_back ({ kernel ? 0 : pid, base, std::min (size, kMaxAddress - base), path });
+
+    if (kernel) {
+        m_kernel.modules[base] = moduleID;
+        ++m_kernelVersion;
+    } else {
+        AddressSpace& space = m_processes[pid];
+        space.modules[base] = moduleID;
+        space.dirty = true;
+    }
+
+    return moduleID;
+}
+
+void ModuleMap::RemoveModule (DWORD pid, UINT_PTR base)
+{
+    if (IsKernelModeAddress (base)) {
+        if (m_kernel.modules.erase (base) > 0)
+            ++m_kernelVersion;
+    } else if (const auto it = m_processes.find (pid); it != m_processes.end ()) {
+        if (it->second.modules.erase (base) > 0)
+            it->second.dirty = true;
+    }
+}
+
+void ModuleMap::RemoveProcess (DWORD pid)
+{
+    m_processes.erase (pid);
+}
+
+std::shared_ptr<const ModuleIndex> ModuleMap::GetSnapshot (DWORD pid)
+{
+    const auto it = m_processes.find (pid);
+    AddressSpace& space = it != m_processes.end () ? it->second : m_kernel;
+    if (space.snapshot != nullptr && !space.dirty && space.kernelVersion == m_kernelVersion)
+        return space.snapshot;
+
+    std::vector<ModuleIndex::Interval> intervals;
+    intervals.reserve (space.modules.size () + m_kernel.modules.size ());
+    const auto addModules = [&] (const AddressSpace& addressSpace) {
+        for (const auto& [base, moduleID] : addressSpace.modules)
+            intervals.push_back ({ base, base + m_modules[moduleID].size, moduleID });
+    };
+
+    if (&space != &m_kernel)
+        addModules (space);
+
+    addModules (m_kernel);
+
+    // Snapshots handed out earlier are left alone
+    space.snapshot = std::make_shared<const ModuleIndex> (std::move (intervals));
+    space.kernelVersion = m_kernelVersion;
+    space.dirty = false;
+    ++m_nSnapshotsBuilt;
+
+    return space.snapshot;
+}
+
+const ModuleMap::Module& ModuleMap::GetModule (uint32_t moduleID) const
+{
+    ETWP_ASSERT (moduleID < m_modules.size ());
+
+    return m_modules[moduleID];
+}
+
+ModuleMap::Stats ModuleMap::GetStats () const
+{
+    return { m_modules.size (), m_processes.size (), m_nSnapshotsBuilt };
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,127 @@
+#ifndef ETWP_MODULE_INDEX_HPP
+#define ETWP_MODULE_INDEX_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Immutable index of the modules of an address space, for resolving (instruction) addresses to modules. Modules are
+//   stored as a sorted array of [base, end) intervals in Eytzinger (BFS) layout, so the first levels of the search
+//   share a couple of cache lines, and the search has no data-dependent branches: the tree is padded to a full one,
+//   so every lookup takes the same number of steps. Lookups in a batch are interleaved level by level, so their
+//   (independent) loads overlap. Overlapping intervals are clipped (the one with the higher base wins).
+// Does not depend on Windows
+class ModuleIndex final {
+public:
+    static constexpr uint32_t kNoModule = UINT32_MAX;
+    static constexpr size_t   kBatchSize = 64;
+
+    struct Interval {
+        UINT_PTR base;
+        UINT_PTR end;       // Exclusive
+        uint32_t moduleID;
+    };
+
+    explicit ModuleIndex (std::vector<Interval> intervals);
+
+    uint32_t Find (UINT_PTR address) const;     // Returns kNoModule, if no module contains the address
+    void     FindBatch (const UINT_PTR* pAddresses, size_t nAddresses, uint32_t* pModuleIDsOut) const;
+
+    size_t GetSize () const;
+    size_t GetMemoryUsage () const;
+
+private:
+    struct Node {
+        UINT_PTR base;
+        uint32_t moduleID;
+    };
+
+    uint32_t              m_depth;  // Number of levels of the (full) tree
+    size_t                m_size;
+    std::vector<UINT_PTR> m_ends;   // In Eytzinger order, from index 1. Index 0 (and padding) belongs to no module
+    std::vector<Node>     m_nodes;  // Same order
+};
+
+inline uint32_t ModuleIndex::Find (UINT_PTR address) const
+{
+    // Find the first interval ending after the address: going right means "ends at or before". Then the trailing
+    //   right turns (and the last left turn) are undone, which yields the node of the last left turn
+    size_t k = 1;
+    for (uint32_t level = 0; level < m_depth; ++level)
+        k = 2 * k + (m_ends[k] <= address);
+
+    k >>= std::countr_one (k) + 1;
+
+    const Node& node = m_nodes[k];
+
+    return node.base <= address ? node.moduleID : kNoModule;
+}
+
+// Modules of all processes, built from image load and unload events, with a (lazily rebuilt) ModuleIndex snapshot for
+//   each process. Kernel modules are part of every process' snapshot. Snapshots are never modified, so they can be
+//   kept (and used on other threads) while the map changes: a snapshot is rebuilt on request, if the modules of its
+//   process (or the kernel) changed since it was built.
+// Module IDs are stable: unloaded modules are kept, so IDs of old snapshots can be resolved, as well.
+// Not thread safe. Does not depend on Windows
+class ModuleMap final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ModuleMap);
+
+    struct Module {
+        DWORD        pid;       // 0 for kernel modules
+        UINT_PTR     base;
+        UINT_PTR     size;
+        std::wstring path;      // As logged by the kernel
+    };
+
+    struct Stats {
+        uint64_t nModules;      // Including unloaded ones
+        uint64_t nProcesses;
+        uint64_t nSnapshotsBuilt;
+    };
+
+    ModuleMap ();
+
+    // Processes image load (and rundown), image unload and process end events, ignores others
+    void OnEvent (const EventView& event);
+
+    uint32_t AddModule (DWORD pid, UINT_PTR base, UINT_PTR size, const std::wstring& path);   // Returns the ID
+    void     RemoveModule (DWORD pid, UINT_PTR base);
+    void     RemoveProcess (DWORD pid);
+
+    // Never returns nullptr; processes without modules get the kernel modules only
+    std::shared_ptr<const ModuleIndex> GetSnapshot (DWORD pid);
+
+    const Module& GetModule (uint32_t moduleID) const;
+    Stats         GetStats () const;
+
+private:
+    struct AddressSpace {
+        std::map<UINT_PTR, uint32_t>       modules;    // By base
+        std::shared_ptr<const ModuleIndex> snapshot;
+        uint64_t                           kernelVersion = 0;   // Of the kernel modules in the snapshot
+        bool                               dirty = true;        // The modules of the process changed
+    };
+
+    std::vector<Module>                     m_modules;  // By ID
+    AddressSpace                            m_kernel;
+    uint64_t                                m_kernelVersion;
+    std::unordered_map<DWORD, AddressSpace> m_processes;
+    uint64_t                                m_nSnapshotsBuilt;
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_MODULE_INDEX_HPP
\ No newline at end of file
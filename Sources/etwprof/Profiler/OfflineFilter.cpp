@@ -0,0 +1,297 @@
+#include "OfflineFilter.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+
+#include "ProfileFilter.hpp"
+
+#include "OS/ETW/ETLReader.hpp"
+#include "OS/ETW/ETWConstants.hpp"
+#include "OS/ETW/ParallelETLDecoder.hpp"
+#include "OS/Process/ProcessLifetimeEventSource.hpp"
+
+namespace ETWP {
+
+namespace {
+
+char ToLowerASCII (char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char> (c - 'A' + 'a') : c;
+}
+
+// Image names in process events are ANSI strings, target names are compared to them in lowercase ASCII (characters
+//   outside of ASCII never match)
+class ImageNameMatcher final {
+public:
+    explicit ImageNameMatcher (const std::vector<std::wstring>& names);
+
+    bool IsEmpty () const;
+    bool Matches (std::string_view imageName) const;
+
+private:
+    std::vector<std::string> m_names;
+};
+
+ImageNameMatcher::ImageNameMatcher (const std::vector<std::wstring>& names)
+{
+    for (const std::wstring& name : names) {
+        std::string lowercaseName;
+        for (wchar_t c : name)
+            lowercaseName.push_back (c < 0x80 ? ToLowerASCII (static_cast<char> (c)) : '\0');
+
+        m_names.push_back (std::move (lowercaseName));
+    }
+}
+
+bool ImageNameMatcher::IsEmpty () const
+{
+    return m_names.empty ();
+}
+
+bool ImageNameMatcher::Matches (std::string_view imageName) const
+{
+    if (imageName.empty ())
+        return false;
+
+    const bool truncated = imageName.size () >= ETWConstants::kMaxProcessImageFileNameLength;
+    for (const std::string& name : m_names) {
+        if (name.size () < imageName.size () || (!truncated && name.size () != imageName.size ()))
+            continue;
+
+        if (std::equal (imageName.begin (), imageName.end (), name.begin (), [] (char lhs, char rhs) {
+                return ToLowerASCII (lhs) == rhs;
+            }))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Describes the output trace based on the input trace
+ETLWriterConfig CreateOutputConfig (const ETLFormat::TraceLogfileHeader& logfileHeader, bool compress)
+{
+    ETLWriterConfig config;
+    config.numberOfProcessors = std::max<uint32_t> (logfileHeader.m_numberOfProcessors, 1);
+    config.startTimeStamp = 0;  // Taken from the logfile header event of the input
+    config.startSystemTime = logfileHeader.m_startTime;
+    config.bootTime = logfileHeader.m_bootTime;
+    config.providerVersion = logfileHeader.m_providerVersion;
+    config.timerResolution = logfileHeader.m_timerResolution;
+    config.cpuSpeedInMHz = logfileHeader.m_cpuSpeedInMHz;
+    config.majorVersion = logfileHeader.m_majorVersion;
+    config.minorVersion = logfileHeader.m_minorVersion;
+    config.loggerName = L"etwprof";
+    config.compress = compress;
+
+    if (logfileHeader.m_perfFreq != 0)
+        config.perfFreq = logfileHeader.m_perfFreq;
+
+    return config;
+}
+
+// Writes kept events into the output
+class WriterSink final : public IEventSink {
+public:
+    explicit WriterSink (ETLWriter* pWriter): m_pWriter (pWriter)
+    {
+    }
+
+    virtual bool WriteEvent (const EventView& event) override
+    {
+        return m_pWriter->WriteEvent (event);
+    }
+
+private:
+    ETLWriter* m_pWriter;
+};
+
+// Collects the paths of the images identity events are written for, on the decoding threads
+std::vector<std::wstring> CollectImagePaths (ParallelETLDecoder* pDecoder)
+{
+    std::vector<std::unordered_set<std::wstring>> imagePathsPerWorker (pDecoder->GetNumberOfThreads ());
+    pDecoder->ForEachBufferUnordered ([&] (uint32_t workerIndex, const ETLBufferView& buffer) {
+        for (const EventView event : buffer) {
+            if (IsImageIdentitySource (event))
+                imagePathsPerWorker[workerIndex].insert (ETWConstants::GetImageFileName (event));
+        }
+    });
+
+    std::unordered_set<std::wstring> imagePaths;
+    for (std::unordered_set<std::wstring>& workerImagePaths : imagePathsPerWorker)
+        imagePaths.merge (workerImagePaths);
+
+    return std::vector<std::wstring> (imagePaths.begin (), imagePaths.end ());
+}
+
+// Returns true if the event is the start (or rundown) event of a process that should be profiled because of its name
+bool IsMatchingProcessStart (const EventView& event, const ImageNameMatcher& nameMatcher, PID* pPIDOut)
+{
+    const UCHAR opcode = event.GetOpcode ();
+    if (event.GetProviderID () != ProcessGuid ||
+        (opcode != ETWConstants::PStartOpcode && opcode != ETWConstants::PDCStartOpcode) ||
+        event.GetUserDataLength () < sizeof (ETWConstants::ProcessDataStub))
+    {
+        return false;
+    }
+
+    if (!nameMatcher.Matches (ETWConstants::GetProcessImageFileName (event)))
+        return false;
+
+    *pPIDOut = static_cast<const ETWConstants::ProcessDataStub*> (event.GetUserData ())->m_processID;
+
+    return true;
+}
+
+}   // namespace
+
+bool FilterETLFile (const std::filesystem::path& inputPath,
+                    const std::filesystem::path& outputPath,
+                    const OfflineFilterOptions& options,
+                    OfflineFilterStats* pStatsOut,
+                    std::wstring* pErrorOut)
+{
+    *pStatsOut = {};
+
+    ProfileFilterData filterData = { {},
+                                     options.userProviderIDs,
+                                     {},
+                                     {},
+                                     options.cswitch,
+                                     options.profileChildren,
+                                     {} };
+    for (PID pid : options.targetPIDs)
+        filterData.targetPIDs.Add (pid);
+
+    const ImageNameMatcher nameMatcher (options.targetNames);
+    ProcessLifetimeEventSource processLifetimeEventSource;
+
+    try {
+        PrepareForProfiling (&filterData);
+
+        const ETLReader reader (inputPath);
+        const ETLWriterConfig writerConfig = CreateOutputConfig (reader.GetLogfileHeader (), options.compress);
+        ETLWriter writer (outputPath, writerConfig);
+        filterData.threads.SetTimestampFrequency (writerConfig.perfFreq);
+
+        ParallelETLDecoder decoder (reader, options.nThreads);
+
+        WriterSink writerSink (&writer);
+        IEventSink* pSink = &writerSink;
+        std::unique_ptr<ProgressCountingSink> progressSink;
+        if (options.pProgress != nullptr) {
+            progressSink = std::make_unique<ProgressCountingSink> (pSink, options.pProgress);
+            pSink = progressSink.get ();
+        }
+
+        std::unique_ptr<ImageIdentityCache> imageCache;
+        std::unique_ptr<ImageIdentityResolver> imageResolver;
+        std::unique_ptr<ImageIdentitySink> imageIdentitySink;
+        if (options.imagePathTranslator != nullptr) {
+            if (!options.imageCachePath.empty ())
+                imageCache = std::make_unique<ImageIdentityCache> (options.imageCachePath);
+
+            imageResolver = std::make_unique<ImageIdentityResolver> (options.imagePathTranslator, imageCache.get ());
+            imageResolver->Resolve (CollectImagePaths (&decoder), decoder.GetNumberOfThreads ());
+
+            // The cache is only an optimization, being unable to update it is not an error
+            std::wstring cacheErrorMsg;
+            if (imageCache != nullptr)
+                imageCache->Save (&cacheErrorMsg);
+
+            imageIdentitySink = std::make_unique<ImageIdentitySink> (pSink, imageResolver.get ());
+            pSink = imageIdentitySink.get ();
+        }
+
+        std::unique_ptr<EventMetadataSink> eventMetadataSink;
+        if (options.eventMetadataSource != nullptr && !options.userProviderIDs.empty ()) {
+            eventMetadataSink = std::make_unique<EventMetadataSink> (pSink,
+                                                                     options.eventMetadataSource,
+                                                                     options.userProviderIDs);
+            pSink = eventMetadataSink.get ();
+        }
+
+        std::unique_ptr<ReorderWindow> reorderWindow;
+        if (options.reorder.IsEnabled ()) {
+            reorderWindow = std::make_unique<ReorderWindow> (pSink, options.reorder, writerConfig.perfFreq);
+            reorderWindow->SetCounters (&pStatsOut->filterStats, options.pProgress);
+            filterData.pReorderWindow = reorderWindow.get ();
+            filterData.otherThreads.SetTimestampFrequency (writerConfig.perfFreq);
+
+            // Kept events are queued behind held ones, so they are not written ahead of them
+            pSink = reorderWindow.get ();
+        }
+
+        decoder.ForEachEventOrdered ([&] (const EventView& event) {
+            ++pStatsOut->nEventsRead;
+
+            PID pid;
+            if (!nameMatcher.IsEmpty () &&
+                IsMatchingProcessStart (event, nameMatcher, &pid) &&
+                filterData.targetPIDs.Add (pid))
+            {
+                ++pStatsOut->nProcessesMatchedByName;
+            }
+
+            // The filter adds child processes to the targets
+            const size_t nTargets = filterData.targetPIDs.GetSize ();
+            const bool keep = FilterAndCount (event, &pStatsOut->filterStats, [&] () {
+                return FilterEventForProfiling (event, &filterData, &processLifetimeEventSource);
+            });
+            if (options.pProgress != nullptr)
+                options.pProgress->AddEvent (keep);
+
+            if (keep) {
+                ++pStatsOut->nEventsKept;
+
+                pSink->WriteEvent (event);  // Events that cannot be written are counted by the writer
+            }
+
+            if (filterData.targetPIDs.GetSize () > nTargets)
+                ++pStatsOut->nChildProcesses;
+        });
+
+        pStatsOut->nBytesRead = reader.GetFileSize ();
+
+        if (reorderWindow != nullptr) {
+            reorderWindow->Flush ();
+            pStatsOut->reorderStats = reorderWindow->GetStats ();
+            pStatsOut->nEventsKept += pStatsOut->reorderStats.nRecovered;
+        }
+
+        if (!writer.Close (pErrorOut)) {
+            *pErrorOut = L"Unable to write output ETL file: " + *pErrorOut;
+
+            return false;
+        }
+
+        pStatsOut->writerStats = writer.GetStats ();
+        if (imageIdentitySink != nullptr) {
+            pStatsOut->imageResolverStats = imageResolver->GetStats ();
+            pStatsOut->imageIdentityStats = imageIdentitySink->GetStats ();
+        }
+
+        if (eventMetadataSink != nullptr)
+            pStatsOut->eventMetadataStats = eventMetadataSink->GetStats ();
+    } catch (const ETLReader::InitException& e) {
+        *pErrorOut = L"Unable to open input ETL file: " + e.GetMsg ();
+
+        return false;
+    } catch (const ETLWriter::InitException& e) {
+        *pErrorOut = L"Unable to create output ETL file: " + e.GetMsg ();
+
+        return false;
+    } catch (const EventDispatchTable::FullException& e) {
+        *pErrorOut = L"Unable to set up event filtering: " + e.GetMsg ();
+
+        return false;
+    }
+
+    return true;
+}
+
+}   // namespace ETWP
\ No newline at end of file
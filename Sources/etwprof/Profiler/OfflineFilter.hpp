@@ -0,0 +1,72 @@
+#ifndef ETWP_OFFLINE_FILTER_HPP
+#define ETWP_OFFLINE_FILTER_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "EventMetadata.hpp"
+#include "FilterStats.hpp"
+#include "ImageIdentity.hpp"
+#include "ProgressCounters.hpp"
+#include "ReorderWindow.hpp"
+
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+namespace ETWP {
+
+struct OfflineFilterOptions {
+    std::vector<PID>          targetPIDs;
+    std::vector<std::wstring> targetNames;      // Image names (e.g. "notepad.exe"), case insensitive
+    std::vector<GUID>         userProviderIDs;
+    bool                      cswitch = false;
+    bool                      profileChildren = false;
+    uint32_t                  nThreads = 0;     // Used for decoding. If 0, one thread per (logical) processor is used
+    bool                      compress = false; // Write an .xz compressed file (see ETLWriterConfig::compress)
+    // If set, image identity events are added (see ImageIdentitySink), images are opened through this
+    ImagePathTranslator       imagePathTranslator;
+    // If not empty, image identities are cached in this file (see ImageIdentityCache). Only used with the above
+    std::filesystem::path     imageCachePath;
+    // If set, event metadata is added for events of the user providers (see EventMetadataSink)
+    EventMetadataSource       eventMetadataSource;
+    // If set, events and bytes written are counted here while filtering (e.g. to display progress on another thread)
+    ProgressCounters*         pProgress = nullptr;
+    // If enabled, events of threads not known yet are held back for a while (see ReorderWindow)
+    ReorderWindowConfig       reorder;
+};
+
+struct OfflineFilterStats {
+    uint64_t         nEventsRead;
+    uint64_t         nEventsKept;       // Including the ones recovered by the reorder window
+    uint64_t         nBytesRead;
+    uint32_t         nProcessesMatchedByName;
+    uint32_t         nChildProcesses;
+    ETLWriter::Stats writerStats;
+    FilterStats      filterStats;
+
+    ImageIdentityResolver::Stats imageResolverStats;
+    ImageIdentitySink::Stats     imageIdentityStats;
+    EventMetadataSink::Stats     eventMetadataStats;
+    ReorderWindow::Stats         reorderStats;
+};
+
+// Cuts an existing (e.g. system-wide, captured with xperf) ETL file down to the events etwprof would have recorded
+//   when profiling the target processes, with the same per-event filter (FilterEventForProfiling). The input is read
+//   with ETLReader, decoded in parallel and merged into timestamp order (see ParallelETLDecoder), and kept events are
+//   written with ETLWriter. Nothing here depends on Windows.
+// Processes can be targeted by PID and by image name. Names are matched when the start (or rundown) event of a
+//   process is seen, so a PID is only targeted while it belongs to a matching process. Image names longer than
+//   ETWConstants::kMaxProcessImageFileNameLength are truncated by the kernel, so they are matched by prefix.
+// If image identity events are added, the images are collected in a first pass over the input, and their identities
+//   are read in parallel before filtering starts
+bool FilterETLFile (const std::filesystem::path& inputPath,
+                    const std::filesystem::path& outputPath,
+                    const OfflineFilterOptions& options,
+                    OfflineFilterStats* pStatsOut,
+                    std::wstring* pErrorOut);
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_OFFLINE_FILTER_HPP
\ No newline at end of file
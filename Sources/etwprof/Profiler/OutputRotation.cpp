@@ -0,0 +1,350 @@
+#include "OutputRotation.hpp"
+
+#include <cwctype>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "OS/Utility/Time.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+namespace {
+
+constexpr int64_t kFileTimeTicksPerSecond = 10'000'000;
+
+// Returns the position of ".etl" in the file name part of path (case insensitively), or the position of the last dot
+//   (if there is no ".etl"), or the end of path
+size_t FindExtension (const std::wstring& path)
+{
+    const size_t lastSeparator = path.find_last_of (L"\\/");
+    const size_t nameStart = lastSeparator == std::wstring::npos ? 0 : lastSeparator + 1;
+
+    std::wstring lowerName = path.substr (nameStart);
+    for (wchar_t& c : lowerName)
+        c = static_cast<wchar_t> (std::towlower (c));
+
+    const size_t etlPos = lowerName.rfind (L".etl");
+    if (etlPos != std::wstring::npos)
+        return nameStart + etlPos;
+
+    const size_t dotPos = lowerName.rfind (L'.');
+    if (dotPos != std::wstring::npos && dotPos != 0)
+        return nameStart + dotPos;
+
+    return path.size ();
+}
+
+}   // namespace
+
+bool OutputRotationConfig::IsEnabled () const
+{
+    return maxSegmentSize != 0 || maxSegmentDuration != 0;
+}
+
+std::wstring GetSegmentPath (const std::wstring& outputPath, uint32_t segmentNumber)
+{
+    std::wstring number = std::to_wstring (segmentNumber);
+    if (number.size () < 3)
+        number.insert (0, 3 - number.size (), L'0');
+
+    const size_t extensionPos = FindExtension (outputPath);
+
+    return outputPath.substr (0, extensionPos) + L"_" + number + outputPath.substr (extensionPos);
+}
+
+ETLWriterConfig GetSegmentWriterConfig (const ETLWriterConfig& traceConfig, int64_t startTimeStamp)
+{
+    ETLWriterConfig config = traceConfig;
+    if (startTimeStamp == 0 || traceConfig.startTimeStamp == 0 || traceConfig.perfFreq == 0)
+        return config;
+
+    config.startSystemTime += ConvertTicks (startTimeStamp - traceConfig.startTimeStamp,
+                                            traceConfig.perfFreq,
+                                            kFileTimeTicksPerSecond);
+    config.startTimeStamp = startTimeStamp;
+
+    return config;
+}
+
+void RundownState::Update (const EventView& event)
+{
+    const GUID& providerID = event.GetProviderID ();
+    const UCHAR opcode = event.GetOpcode ();
+    const USHORT payloadSize = event.GetUserDataLength ();
+
+    if (providerID == ProcessGuid) {
+        if (payloadSize < sizeof (ETWConstants::ProcessDataStub))
+            return;
+
+        const DWORD pid = static_cast<const ETWConstants::ProcessDataStub*> (event.GetUserData ())->m_processID;
+        if (opcode == ETWConstants::PStartOpcode || opcode == ETWConstants::PDCStartOpcode)
+            m_processes[pid] = Store (event);
+        else if (opcode == ETWConstants::PEndOpcode)
+            m_processes.erase (pid);
+    } else if (providerID == ThreadGuid) {
+        if (payloadSize < sizeof (ETWConstants::ThreadDataStub))
+            return;
+
+        const DWORD tid = static_cast<const ETWConstants::ThreadDataStub*> (event.GetUserData ())->m_threadID;
+        if (opcode == ETWConstants::TStartOpcode || opcode == ETWConstants::TDCStartOpcode)
+            m_threads[tid] = Store (event);
+        else if (opcode == ETWConstants::TEndOpcode)
+            m_threads.erase (tid);
+    } else if (providerID == ImageLoadGuid) {
+        if (payloadSize < sizeof (ETWConstants::ImageLoadDataStub))
+            return;
+
+        const ETWConstants::ImageLoadDataStub* pData =
+            static_cast<const ETWConstants::ImageLoadDataStub*> (event.GetUserData ());
+        const ImageKey key = { pData->m_processID, pData->m_imageBase };
+        if (opcode == ETWConstants::ImageLoadOpcode || opcode == ETWConstants::ImageDCStartOpcode)
+            m_images[key] = Store (event);
+        else if (opcode == ETWConstants::ImageUnloadOpcode)
+            m_images.erase (key);
+    }
+}
+
+uint64_t RundownState::Write (const EventView& atEvent, IEventSink* pSink) const
+{
+    uint64_t nWritten = 0;
+    for (const auto& [_, storedEvent] : m_processes)
+        nWritten += WriteRundownEvent (storedEvent, ETWConstants::PDCStartOpcode, atEvent, pSink);
+
+    for (const auto& [_, storedEvent] : m_threads)
+        nWritten += WriteRundownEvent (storedEvent, ETWConstants::TDCStartOpcode, atEvent, pSink);
+
+    for (const auto& [_, storedEvent] : m_images)
+        nWritten += WriteRundownEvent (storedEvent, ETWConstants::ImageDCStartOpcode, atEvent, pSink);
+
+    return nWritten;
+}
+
+size_t RundownState::GetNumberOfProcesses () const
+{
+    return m_processes.size ();
+}
+
+size_t RundownState::GetNumberOfThreads () const
+{
+    return m_threads.size ();
+}
+
+size_t RundownState::GetNumberOfImages () const
+{
+    return m_images.size ();
+}
+
+RundownState::StoredEvent RundownState::Store (const EventView& event)
+{
+    const uint8_t* pPayload = static_cast<const uint8_t*> (event.GetUserData ());
+
+    return { event.GetRecord ().m_header, std::vector<uint8_t> (pPayload, pPayload + event.GetUserDataLength ()) };
+}
+
+bool RundownState::WriteRundownEvent (const StoredEvent& storedEvent,
+                                      UCHAR opcode,
+                                      const EventView& atEvent,
+                                      IEventSink* pSink)
+{
+    // Extended data items (if any) are not kept, the payload describes the process/thread/image fully
+    EventRecordLayout record = {};
+    record.m_header = storedEvent.header;
+    record.m_header.m_opcode = opcode;
+    record.m_header.m_timeStamp = atEvent.GetTimestamp ();
+    record.m_processorNumber = atEvent.GetProcessorNumber ();
+    record.m_loggerID = atEvent.GetRecord ().m_loggerID;
+    record.m_userDataLength = static_cast<USHORT> (storedEvent.payload.size ());
+    record.m_pUserData = storedEvent.payload.data ();
+
+    return pSink->WriteEvent (EventView (record));
+}
+
+IOutputSegment::~IOutputSegment () = default;
+
+SegmentFinisher::SegmentFinisher (): m_stop (false), m_closed (false), m_nFailures (0)
+{
+    m_thread = std::thread (&SegmentFinisher::ThreadMain, this);
+}
+
+SegmentFinisher::~SegmentFinisher ()
+{
+    std::wstring errorMsg;
+    Close (&errorMsg);
+}
+
+void SegmentFinisher::Seal (std::unique_ptr<IOutputSegment>&& segment)
+{
+    {
+        std::unique_lock<std::mutex> lock (m_lock);
+        m_sealedSegments.push_back (std::move (segment));
+    }
+
+    m_condition.notify_all ();
+}
+
+void SegmentFinisher::SetError (const std::wstring& error)
+{
+    std::unique_lock<std::mutex> lock (m_lock);
+    if (m_error.empty ())
+        m_error = error;
+}
+
+bool SegmentFinisher::Close (std::wstring* pErrorOut)
+{
+    if (!m_closed) {
+        m_closed = true;
+
+        {
+            std::unique_lock<std::mutex> lock (m_lock);
+            m_stop = true;
+        }
+
+        m_condition.notify_all ();
+        m_thread.join ();
+    }
+
+    if (!m_error.empty ()) {
+        *pErrorOut = m_error;
+
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t SegmentFinisher::GetNumberOfFailures () const
+{
+    std::unique_lock<std::mutex> lock (m_lock);
+
+    return m_nFailures;
+}
+
+void SegmentFinisher::ThreadMain ()
+{
+    std::unique_lock<std::mutex> lock (m_lock);
+    for (;;) {
+        m_condition.wait (lock, [this]() { return !m_sealedSegments.empty () || m_stop; });
+        if (m_sealedSegments.empty ())
+            return;     // Stopping, and everything is finished
+
+        std::unique_ptr<IOutputSegment> segment = std::move (m_sealedSegments.front ());
+        m_sealedSegments.pop_front ();
+
+        // Finishing might take long (e.g. if it has to merge the trace), don't hold up sealing meanwhile
+        lock.unlock ();
+        std::wstring errorMsg;
+        const bool finished = segment->Finish (&errorMsg);
+        segment.reset ();
+        lock.lock ();
+
+        if (!finished) {
+            ++m_nFailures;
+            if (m_error.empty ())
+                m_error = errorMsg;
+        }
+    }
+}
+
+RotatingSink::InitException::InitException (const std::wstring& msg): Exception (msg)
+{
+}
+
+RotatingSink::RotatingSink (const OutputSegmentFactory& factory,
+                            const OutputRotationConfig& config,
+                            int64_t perfFreq):
+    m_factory (factory),
+    m_config (config),
+    m_maxSegmentTicks (int64_t (config.maxSegmentDuration) * perfFreq),
+    m_segment (),
+    m_segmentStartTimeStamp (0),
+    m_rotationFailed (false),
+    m_closed (false),
+    m_rundown (),
+    m_stats (),
+    m_finisher ()
+{
+    std::wstring errorMsg;
+    m_segment = m_factory (1, 0, &errorMsg);
+    if (m_segment == nullptr)
+        throw InitException (errorMsg);
+
+    m_stats.nSegments = 1;
+}
+
+RotatingSink::~RotatingSink ()
+{
+    std::wstring errorMsg;
+    Close (&errorMsg);
+}
+
+bool RotatingSink::WriteEvent (const EventView& event)
+{
+    ETWP_ASSERT (!m_closed);
+
+    if (m_segmentStartTimeStamp == 0)
+        m_segmentStartTimeStamp = event.GetTimestamp ();
+    else if (ShouldRotate (event))
+        Rotate (event);
+
+    m_rundown.Update (event);
+
+    return m_segment->GetSink ()->WriteEvent (event);
+}
+
+bool RotatingSink::Close (std::wstring* pErrorOut)
+{
+    if (m_closed)
+        return true;
+
+    m_closed = true;
+
+    m_finisher.Seal (std::move (m_segment));
+
+    const bool succeeded = m_finisher.Close (pErrorOut);
+    m_stats.nSegmentsFailed += m_finisher.GetNumberOfFailures ();
+
+    return succeeded;
+}
+
+RotatingSink::Stats RotatingSink::GetStats () const
+{
+    return m_stats;
+}
+
+bool RotatingSink::ShouldRotate (const EventView& event) const
+{
+    if (m_rotationFailed)
+        return false;
+
+    // Stacks belong to the event before them
+    if (event.GetProviderID () == StackWalkGuid)
+        return false;
+
+    if (m_config.maxSegmentSize != 0 && m_segment->GetSize () >= m_config.maxSegmentSize)
+        return true;
+
+    return m_maxSegmentTicks != 0 && event.GetTimestamp () - m_segmentStartTimeStamp >= m_maxSegmentTicks;
+}
+
+void RotatingSink::Rotate (const EventView& event)
+{
+    std::wstring errorMsg;
+    std::unique_ptr<IOutputSegment> nextSegment = m_factory (m_stats.nSegments + 1, event.GetTimestamp (), &errorMsg);
+    if (nextSegment == nullptr) {
+        m_finisher.SetError (errorMsg);
+        ++m_stats.nSegmentsFailed;
+        m_rotationFailed = true;
+
+        return;
+    }
+
+    ++m_stats.nSegments;
+    m_stats.nRundownEventsWritten += m_rundown.Write (event, nextSegment->GetSink ());
+
+    m_finisher.Seal (std::move (m_segment));
+    m_segment = std::move (nextSegment);
+    m_segmentStartTimeStamp = event.GetTimestamp ();
+}
+
+}   // namespace ETWP
\ No newline at end of file
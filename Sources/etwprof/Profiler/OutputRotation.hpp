@@ -0,0 +1,176 @@
+#ifndef ETWP_OUTPUT_ROTATION_HPP
+#define ETWP_OUTPUT_ROTATION_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "RelogPipeline.hpp"
+
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+#include "Utility/Exception.hpp"
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Controls when a new output segment is started. If both limits are set, whichever is reached first wins
+struct OutputRotationConfig {
+    uint64_t maxSegmentSize = 0;        // In bytes, 0 means no limit
+    uint32_t maxSegmentDuration = 0;    // In seconds, 0 means no limit
+
+    bool IsEnabled () const;
+};
+
+// Returns the path of the nth (starting from 1) segment of a rotated output, e.g. C:\traces\app_003.etl for
+//   C:\traces\app.etl (or C:\traces\app_003.etl.xz for C:\traces\app.etl.xz)
+std::wstring GetSegmentPath (const std::wstring& outputPath, uint32_t segmentNumber);
+
+// Describes a segment of a trace starting at startTimeStamp (a QPC value), so it starts there in trace viewers, too
+ETLWriterConfig GetSegmentWriterConfig (const ETLWriterConfig& traceConfig, int64_t startTimeStamp);
+
+// Latest state of the processes, threads and images seen in a stream of events, kept as copies of their start (or
+//   rundown) events, so the state can be written as a rundown (DCStart events), e.g. at the start of an output segment.
+//   Ended processes and threads, and unloaded images are forgotten
+class RundownState final {
+public:
+    void Update (const EventView& event);
+
+    // Writes a DCStart event for each live process, thread and image (in this order), with the timestamp and processor
+    //   of atEvent. Returns the number of events written
+    uint64_t Write (const EventView& atEvent, IEventSink* pSink) const;
+
+    size_t GetNumberOfProcesses () const;
+    size_t GetNumberOfThreads () const;
+    size_t GetNumberOfImages () const;
+
+private:
+    struct StoredEvent {
+        EventHeaderLayout    header;
+        std::vector<uint8_t> payload;
+    };
+
+    using ImageKey = std::pair<DWORD, UINT_PTR>;    // PID and image base
+
+    std::map<DWORD, StoredEvent>    m_processes;
+    std::map<DWORD, StoredEvent>    m_threads;
+    std::map<ImageKey, StoredEvent> m_images;
+
+    static StoredEvent Store (const EventView& event);
+    static bool        WriteRundownEvent (const StoredEvent& storedEvent,
+                                          UCHAR opcode,
+                                          const EventView& atEvent,
+                                          IEventSink* pSink);
+};
+
+// One output file of a rotated trace, along with whatever is needed to write events into it
+class IOutputSegment {
+public:
+    virtual ~IOutputSegment ();
+
+    virtual IEventSink* GetSink () = 0;
+    virtual uint64_t    GetSize () const = 0;    // Bytes written so far
+
+    // Completes the output file. Called on a background thread (see RotatingSink), the segment is not written anymore
+    virtual bool Finish (std::wstring* pErrorOut) = 0;
+};
+
+// Creates the nth (starting from 1) segment, starting at startTimeStamp (0 for the first one, which starts along with
+//   the trace). Returns nullptr on error
+using OutputSegmentFactory = std::function<std::unique_ptr<IOutputSegment> (uint32_t segmentNumber,
+                                                                            int64_t startTimeStamp,
+                                                                            std::wstring* pErrorOut)>;
+
+// Finishes (see IOutputSegment::Finish) sealed segments on a background thread, in the order they were sealed, so
+//   writing can continue meanwhile
+class SegmentFinisher final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (SegmentFinisher);
+
+    SegmentFinisher ();
+    ~SegmentFinisher ();    // Calls Close, if it was not called
+
+    void Seal (std::unique_ptr<IOutputSegment>&& segment);
+    void SetError (const std::wstring& error);  // Keeps the first error only
+
+    // Waits until all sealed segments are finished. Returns the first error, if any
+    bool Close (std::wstring* pErrorOut);
+
+    uint32_t GetNumberOfFailures () const;      // Final after Close only
+
+private:
+    mutable std::mutex                          m_lock;
+    std::condition_variable                     m_condition;
+    std::deque<std::unique_ptr<IOutputSegment>> m_sealedSegments;     // Guarded by m_lock
+    bool                                        m_stop;               // Guarded by m_lock
+    bool                                        m_closed;
+    uint32_t                                    m_nFailures;          // Guarded by m_lock
+    std::wstring                                m_error;              // Guarded by m_lock (first error)
+    std::thread                                 m_thread;
+
+    void ThreadMain ();
+};
+
+// Writes events into a series of output segments: a new segment is started if the current one grows too big, or spans
+//   too much time (see OutputRotationConfig), so each segment is usable on its own, as soon as it's finished. To
+//   achieve that, every new segment starts with a rundown of the processes, threads and images seen so far (see
+//   RundownState). Rotation never separates an event from its stack (StackWalk events are never the first in a
+//   segment).
+// Sealed segments are finished (see IOutputSegment::Finish) on a background thread, so writing can continue.
+//   If a new segment cannot be created, writing continues into the current one (and rotation is not attempted again).
+// Not thread safe: WriteEvent and Close must be called from the same thread
+class RotatingSink final : public IEventSink {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (RotatingSink);
+
+    class InitException : public Exception {
+    public:
+        InitException (const std::wstring& msg);
+    };
+
+    struct Stats {
+        uint32_t nSegments;
+        uint32_t nSegmentsFailed;           // Could not be created or finished
+        uint64_t nRundownEventsWritten;
+    };
+
+    // Creates the first segment. Might throw InitException. perfFreq is the frequency of event timestamps
+    RotatingSink (const OutputSegmentFactory& factory, const OutputRotationConfig& config, int64_t perfFreq);
+    ~RotatingSink ();   // Calls Close, if it was not called
+
+    virtual bool WriteEvent (const EventView& event) override;
+
+    // Finishes the current segment, then waits until all segments are finished. Returns the first error, if any
+    bool Close (std::wstring* pErrorOut);
+
+    Stats GetStats () const;    // nSegmentsFailed is final after Close only
+
+private:
+    OutputSegmentFactory            m_factory;
+    OutputRotationConfig            m_config;
+    int64_t                         m_maxSegmentTicks;
+    std::unique_ptr<IOutputSegment> m_segment;
+    int64_t                         m_segmentStartTimeStamp;    // 0 until the first event
+    bool                            m_rotationFailed;
+    bool                            m_closed;
+    RundownState                    m_rundown;
+    Stats                           m_stats;
+    SegmentFinisher                 m_finisher;
+
+    bool ShouldRotate (const EventView& event) const;
+    void Rotate (const EventView& event);
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_OUTPUT_ROTATION_HPP
\ No newline at end of file
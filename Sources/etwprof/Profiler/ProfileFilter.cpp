@@ -0,0 +1,320 @@
+#include "ProfileFilter.hpp"
+
+#include <cstdint>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "OS/Process/ProcessLifetimeEventSource.hpp"
+#include "OS/Utility/Address.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+namespace {
+
+// The thread(s) of the event might be new threads of a target, with their start events still to come. Threads known
+//   to be of other processes can't be
+void HoldForUnknownThread (const EventView& event, ProfileFilterData* pFilterData, DWORD tid, DWORD otherTID)
+{
+    if (pFilterData->pReorderWindow == nullptr)
+        return;
+
+    const bool unknown = !pFilterData->otherThreads.Contains (tid);
+    const bool otherUnknown = otherTID != tid && !pFilterData->otherThreads.Contains (otherTID);
+    if (unknown && otherUnknown)
+        pFilterData->pReorderWindow->Hold (event, tid, otherTID);
+    else if (unknown)
+        pFilterData->pReorderWindow->Hold (event, tid, tid);
+    else if (otherUnknown)
+        pFilterData->pReorderWindow->Hold (event, otherTID, otherTID);
+}
+
+// Bookkeeping of threads of other processes, for HoldForUnknownThread
+void TrackOtherThread (UCHAR opcode, int64_t timestamp, ProfileFilterData* pFilterData, DWORD tid)
+{
+    if (pFilterData->pReorderWindow == nullptr)
+        return;
+
+    switch (opcode) {
+        case ETWConstants::TStartOpcode:
+            // Same as for target threads (the ID might be reused, so the previous mark for deletion is stale)
+            pFilterData->otherThreads.DeleteThreadsMarkedForDeletion (timestamp);
+            pFilterData->otherThreads.Delete (tid);
+            pFilterData->otherThreads.Add (tid);
+            pFilterData->pReorderWindow->Reject (tid, timestamp);
+
+            break;
+
+        case ETWConstants::TDCStartOpcode:
+            pFilterData->otherThreads.Add (tid);
+            pFilterData->pReorderWindow->Reject (tid, INT64_MIN);
+
+            break;
+
+        case ETWConstants::TEndOpcode:
+            pFilterData->otherThreads.MarkForDeletion (tid, timestamp);
+
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool FilterStackWalkEvent (UCHAR opcode, ProfileFilterData* pFilterData, const void* pUserData)
+{
+    switch (opcode) {
+        case ETWConstants::StackWalkOpcode: {
+            const ETWConstants::StackWalkDataStub* pData =
+                reinterpret_cast<const ETWConstants::StackWalkDataStub*> (pUserData);
+
+            return pFilterData->targetPIDs.Contains (pData->m_processID);
+        }
+
+        case ETWConstants::StackKeyKernelOpcode:
+        case ETWConstants::StackKeyUserOpcode: {
+            const ETWConstants::StackKeyReference* pData =
+                reinterpret_cast<const ETWConstants::StackKeyReference*> (pUserData);
+
+            if (pFilterData->targetPIDs.Contains(pData->m_processID)) {
+                pFilterData->stackKeys.Reference (pData->m_key);
+
+                return true;
+            } else {
+                return false;
+            }
+        }
+
+        case ETWConstants::StackWalkKeyDeleteOpcode:
+        case ETWConstants::StackWalkKeyRundownOpcode: {
+            const ETWConstants::StackKeyDefinition* pData =
+                reinterpret_cast<const ETWConstants::StackKeyDefinition*> (pUserData);
+
+            return pFilterData->stackKeys.Remove (pData->m_key);
+        }
+    }
+
+    return false;
+}
+
+bool FilterThreadEvent (UCHAR opcode, int64_t timestamp, ProfileFilterData* pFilterData, const void* pUserData)
+{
+    const ETWConstants::ThreadDataStub* pData = reinterpret_cast<const ETWConstants::ThreadDataStub*> (pUserData);
+
+    if (pFilterData->targetPIDs.Contains (pData->m_processID)) {
+        switch (opcode) {
+            case ETWConstants::TStartOpcode:
+                // Thread start events shouldn't be too frequent, so this is a good opportunity to perform cleanup on
+                //   threads marked for deletion. If there are no such events for a long time (or at all), then cleanup
+                //   is not necessary/urgent, as the number of bookkept threads can not increase (if it does, we will
+                //   get a start event).
+                pFilterData->threads.DeleteThreadsMarkedForDeletion (timestamp);
+                // The ID might be of a recently ended thread (of this target), whose mark for deletion would delete
+                //   the new thread. Deleting it first makes that mark stale
+                pFilterData->threads.Delete (pData->m_threadID);
+                pFilterData->threads.Add (pData->m_threadID);
+
+                if (pFilterData->pReorderWindow != nullptr) {
+                    pFilterData->otherThreads.Delete (pData->m_threadID);   // The ID was reused
+                    pFilterData->pReorderWindow->Release (pData->m_threadID, timestamp);
+                }
+
+                break;
+
+            case ETWConstants::TDCStartOpcode:
+                pFilterData->threads.Add (pData->m_threadID);
+
+                // The thread has been running since before the session started, so all of its held events belong to it
+                if (pFilterData->pReorderWindow != nullptr)
+                    pFilterData->pReorderWindow->Release (pData->m_threadID, INT64_MIN);
+
+                break;
+
+            case ETWConstants::TEndOpcode:
+                pFilterData->threads.MarkForDeletion (pData->m_threadID, timestamp);
+                [[fallthrough]];
+
+            case ETWConstants::TDCEndOpcode:
+                break;
+
+            default:
+                break;
+        }
+
+        return true;
+    } else {
+        // If a recently ended thread's ID of our target gets reassigned to another process's new thread,
+        //    we need to delete that TID from our bookkeping, lest we record irrelevant events
+        if (opcode == ETWConstants::TStartOpcode && pFilterData->threads.Contains (pData->m_threadID))
+            pFilterData->threads.Delete (pData->m_threadID);
+
+        TrackOtherThread (opcode, timestamp, pFilterData, pData->m_threadID);
+
+        return false;
+    }
+}
+
+bool FilterContextSwitchEvent (const EventView& event,
+                               UCHAR opcode,
+                               ProfileFilterData* pFilterData,
+                               const void* pUserData)
+{
+    if (opcode == ETWConstants::ReadyThreadOpcode) {
+        const ETWConstants::ReadyThreadDataStub* pData =
+            reinterpret_cast<const ETWConstants::ReadyThreadDataStub*> (pUserData);
+
+        if (pFilterData->threads.Contains (pData->m_readyThreadID))
+            return true;
+
+        HoldForUnknownThread (event, pFilterData, pData->m_readyThreadID, pData->m_readyThreadID);
+
+        return false;
+    } else if (opcode == ETWConstants::CSwitchOpcode) {
+        const ETWConstants::CSwitchDataStub* pData =
+            reinterpret_cast<const ETWConstants::CSwitchDataStub*> (pUserData);
+
+        // A thread of interest was involved in a context switch
+        if (pFilterData->threads.Contains (pData->m_newThreadID) ||
+            pFilterData->threads.Contains (pData->m_oldThreadID))
+        {
+            return true;
+        }
+
+        HoldForUnknownThread (event, pFilterData, pData->m_newThreadID, pData->m_oldThreadID);
+
+        return false;
+    } else {
+        return false;
+    }
+}
+
+bool FilterProcessEvent (UCHAR opcode,
+                         ProfileFilterData* pFilterData,
+                         const void* pUserData,
+                         ProcessLifetimeEventSource* pProcessLifetimeEventSource)
+{
+    const ETWConstants::ProcessDataStub* pData =
+        reinterpret_cast<const ETWConstants::ProcessDataStub*> (pUserData);
+
+    bool profiledProcess = pFilterData->targetPIDs.Contains (pData->m_processID);
+
+    if (!profiledProcess &&
+        pFilterData->profileChildren &&
+        opcode == ETWConstants::PStartOpcode &&
+        pFilterData->targetPIDs.Contains (pData->m_parentProcessID))
+    {
+        // A child process of one of our current targets started, let's add it to our bookkeeping
+        pFilterData->targetPIDs.Add (pData->m_processID);
+        profiledProcess = true;
+    }
+
+    if (profiledProcess) {
+        switch (opcode) {
+            case ETWConstants::PStartOpcode:
+                pProcessLifetimeEventSource->NotifyProcessStarted (pData->m_processID,
+                                                                   pData->m_parentProcessID);
+
+                break;
+            case ETWConstants::PEndOpcode:
+                pProcessLifetimeEventSource->NotifyProcessEnded (pData->m_processID,
+                                                                 pData->m_parentProcessID);
+
+                pFilterData->targetPIDs.Remove (pData->m_processID);
+                break;
+        }
+    }
+
+    return profiledProcess;
+}
+
+bool FilterSampledProfileEvent (const EventView& event, ProfileFilterData* pFilterData, const void* pUserData)
+{
+    const ETWConstants::SampledProfileDataStub* pData =
+        reinterpret_cast<const ETWConstants::SampledProfileDataStub*> (pUserData);
+
+    if (pFilterData->threads.Contains (pData->m_threadID))
+        return true;
+
+    HoldForUnknownThread (event, pFilterData, pData->m_threadID, pData->m_threadID);
+
+    return false;
+}
+
+bool FilterImageLoadEvent (ProfileFilterData* pFilterData, const void* pUserData)
+{
+    const ETWConstants::ImageLoadDataStub* pData =
+        reinterpret_cast<const ETWConstants::ImageLoadDataStub*> (pUserData);
+
+    return pFilterData->targetPIDs.Contains (pData->m_processID) ||
+           IsKernelModeAddress (pData->m_imageBase);    // Kernel mode parts of stacks can be interesting, so preserve
+                                                        //   kernel module loads (drivers, etc.)
+}
+
+}   // namespace
+
+ThreadRegistry::ThreadRegistry ():
+    m_threadIDs (),
+    m_deletionDelay (kDefaultTimestampFrequency * kDeletionDelayMs / 1'000),
+    m_deletionMarks (m_deletionDelay / kTicksPerDeletionDelay)
+{
+}
+
+void ThreadRegistry::SetTimestampFrequency (int64_t frequency)
+{
+    m_deletionDelay = frequency * kDeletionDelayMs / 1'000;
+    m_deletionMarks = TimerWheel<DeletionMark> (m_deletionDelay / kTicksPerDeletionDelay);
+}
+
+void ThreadRegistry::DeleteThreadsMarkedForDeletion (int64_t timestamp)
+{
+    m_deletionMarks.Advance (timestamp, [this] (const DeletionMark& mark) {
+        // Stale marks are skipped, the thread has been deleted (and maybe added again) since
+        if (mark.generation == m_threadIDs.GetGeneration (mark.tid))
+            Delete (mark.tid);
+    });
+}
+
+size_t ThreadRegistry::GetNumberOfThreadsMarkedForDeletion () const
+{
+    return m_deletionMarks.GetSize ();
+}
+
+void PrepareForProfiling (ProfileFilterData* pFilterData)
+{
+    // User providers are known at this point, fold them into the dispatch table, so the per-event filter can find the
+    //   handler of any event with a single lookup
+    pFilterData->dispatchTable = CreateProfileDispatchTable (pFilterData->cswitch, pFilterData->userProviderIDs);
+}
+
+bool FilterEventForProfiling (const EventView& event,
+                              ProfileFilterData* pFilterData,
+                              ProcessLifetimeEventSource* pProcessLifetimeEventSource)
+{
+    const UCHAR opcode = event.GetOpcode ();
+    const void* pUserData = event.GetUserData ();
+
+    switch (pFilterData->dispatchTable.GetHandler (event.GetProviderID (), opcode)) {
+        case EventDispatchTable::Handler::Drop:
+            return false;
+        case EventDispatchTable::Handler::Keep:
+            return true;
+        case EventDispatchTable::Handler::StackWalk:
+            return FilterStackWalkEvent (opcode, pFilterData, pUserData);
+        case EventDispatchTable::Handler::SampledProfile:
+            return FilterSampledProfileEvent (event, pFilterData, pUserData);
+        case EventDispatchTable::Handler::Thread:
+            return FilterThreadEvent (opcode, event.GetTimestamp (), pFilterData, pUserData);
+        case EventDispatchTable::Handler::ContextSwitch:
+            return FilterContextSwitchEvent (event, opcode, pFilterData, pUserData);
+        case EventDispatchTable::Handler::Process:
+            return FilterProcessEvent (opcode, pFilterData, pUserData, pProcessLifetimeEventSource);
+        case EventDispatchTable::Handler::ImageLoad:
+            return FilterImageLoadEvent (pFilterData, pUserData);
+        case EventDispatchTable::Handler::UserProvider:
+            return pFilterData->targetPIDs.Contains (event.GetProcessID ());
+    }
+
+    return false;
+}
+
+}   // namespace ETWP
\ No newline at end of file
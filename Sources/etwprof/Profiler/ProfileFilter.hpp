@@ -0,0 +1,113 @@
+#ifndef ETWP_PROFILE_FILTER_HPP
+#define ETWP_PROFILE_FILTER_HPP
+
+#include <vector>
+
+#include "EventDispatchTable.hpp"
+#include "IDRegistry.hpp"
+#include "ReorderWindow.hpp"
+#include "StackKeyTable.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+#include "OS/Utility/Time.hpp"
+
+#include "Utility/TimerWheel.hpp"
+
+namespace ETWP {
+
+class ProcessLifetimeEventSource;
+
+// Class for recording thread IDs of interest. Besides deleting, you can also mark threads for deletion. These are
+//   deleted a while (kDeletionDelay) after being marked, by DeleteThreadsMarkedForDeletion.
+// Time is measured by event timestamps (and not by the clock), so replaying a trace behaves the same as capturing it
+class ThreadRegistry {
+public:
+    static constexpr int64_t kDefaultTimestampFrequency = 10'000'000;  // System time (FILETIME) resolution
+    static constexpr int64_t kDeletionDelayMs = 1'000;
+
+    ThreadRegistry ();
+
+    // Must be called before the first thread is marked for deletion
+    void SetTimestampFrequency (int64_t frequency);
+
+    void Add (DWORD tid);
+    void MarkForDeletion (DWORD tid, int64_t timestamp);
+    void Delete (DWORD tid);
+    bool Contains (DWORD tid) const;
+
+    // Deletes threads marked for deletion at least kDeletionDelayMs before timestamp
+    void DeleteThreadsMarkedForDeletion (int64_t timestamp);
+
+    size_t GetNumberOfThreadsMarkedForDeletion () const;
+
+private:
+    // Expiry is bucketed into this many ticks per deletion delay (see TimerWheel)
+    static constexpr int64_t kTicksPerDeletionDelay = 32;
+
+    // Deleting a thread bumps its generation in m_threadIDs, so marks that refer to an earlier "incarnation" of a TID
+    //   become stale, and don't have to be looked up and erased eagerly. So a reused TID has to be deleted before it's
+    //   added again
+    struct DeletionMark {
+        DWORD                  tid;
+        IDRegistry::Generation generation;
+    };
+
+    IDRegistry               m_threadIDs;
+    int64_t                  m_deletionDelay;   // In timestamp units
+    TimerWheel<DeletionMark> m_deletionMarks;
+};
+
+inline void ThreadRegistry::Add (DWORD tid)
+{
+    m_threadIDs.Add (tid);
+}
+
+inline void ThreadRegistry::MarkForDeletion (DWORD tid, int64_t timestamp)
+{
+    m_deletionMarks.Schedule (timestamp + m_deletionDelay, { tid, m_threadIDs.GetGeneration (tid) });
+}
+
+inline void ThreadRegistry::Delete (DWORD tid)
+{
+    m_threadIDs.Remove (tid);
+}
+
+inline bool ThreadRegistry::Contains (DWORD tid) const
+{
+    return m_threadIDs.Contains (tid);
+}
+
+struct ProfileFilterData {
+    // Unfortunately, sometimes we receive events for a thread *after* their end event. To mitigate this, we keep
+    //   terminated thread ID's around for some time.
+    ThreadRegistry threads;
+    std::vector<GUID> userProviderIDs;
+    StackKeyTable stackKeys;    // For stack cache filtering (when enabled)
+    IDRegistry targetPIDs;
+
+    bool cswitch;
+    bool profileChildren;
+
+    // Built from the members above by PrepareForProfiling, at session start (i.e. no need to initialize it)
+    EventDispatchTable dispatchTable;
+
+    // If set, events of threads not known (yet) are held back for a while, instead of dropping them at once
+    ReorderWindow* pReorderWindow = nullptr;
+    // Threads of other processes (kept around after their end, like threads), so their events are not held. Only
+    //   tracked if pReorderWindow is set
+    ThreadRegistry otherThreads = {};
+};
+
+// Must be called before filtering the first event. Might throw EventDispatchTable::FullException
+void PrepareForProfiling (ProfileFilterData* pFilterData);
+
+// Returns true if the event should be kept. This is the portable core of the per-event filter, the consumer wraps
+//   events into an EventView without copying them
+bool FilterEventForProfiling (const EventView& event,
+                              ProfileFilterData* pFilterData,
+                              ProcessLifetimeEventSource* pProcessLifetimeEventSource);
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_PROFILE_FILTER_HPP
\ No newline at end of file
@@ -1,308 +1,392 @@
 #include "ProfilerCommon.hpp"
 
+#include <algorithm>
+
+#include <tdh.h>
+
 #include "Log/Logging.hpp"
 
 #include "OS/ETW/ETWConstants.hpp"
-#include "OS/ETW/TraceRelogger.hpp"
+#include "OS/ETW/EventView.hpp"
 #include "OS/FileSystem/Utility.hpp"
-#include "OS/Process/ProcessLifetimeEventSource.hpp"
 
 #include "Utility/Asserts.hpp"
+#include "Utility/OnExit.hpp"
 
 namespace ETWP {
 
-namespace {
-
-bool IsKernelModeAddress (UINT_PTR address)
+ProfileEventFilter::ProfileEventFilter (ProfileFilterData& filterData):
+    m_filterData (filterData),
+    m_stats (),
+    m_pSink (nullptr),
+    m_pPipeline (nullptr),
+    m_pProgress (nullptr),
+    m_reorderWindow ()
 {
-#ifdef ETWP_64BIT
-    return address & (1ULL << 63);  // Take advantage of the canonical form
-#else
-#error Need to implement this to support 32-bit builds!
-#endif  // #ifdef ETWP_64BIT
+    PrepareForProfiling (&m_filterData);
 }
 
-bool FilterStackWalkEvent (UCHAR opcode, ProfileFilterData* pFilterData, void* pUserData)
+void ProfileEventFilter::SetSink (IEventSink* pSink)
 {
-    switch (opcode) {
-        case ETWConstants::StackWalkOpcode: {
-            const ETWConstants::StackWalkDataStub* pData =
-                reinterpret_cast<const ETWConstants::StackWalkDataStub*> (pUserData);
-
-            return pFilterData->targetPIDs.contains (pData->m_processID);
-        }
+    m_pSink = pSink;
+}
 
-        case ETWConstants::StackKeyKernelOpcode:
-        case ETWConstants::StackKeyUserOpcode: {
-            const ETWConstants::StackKeyReference* pData =
-                reinterpret_cast<const ETWConstants::StackKeyReference*> (pUserData);
+void ProfileEventFilter::SetPipeline (RelogPipeline* pPipeline)
+{
+    m_pPipeline = pPipeline;
+}
 
-            if (pFilterData->targetPIDs.contains(pData->m_processID)) {
-                pFilterData->stackKeys.insert (pData->m_key);
+void ProfileEventFilter::SetProgressCounters (ProgressCounters* pProgress)
+{
+    m_pProgress = pProgress;
+    if (m_reorderWindow != nullptr)
+        m_reorderWindow->SetCounters (&m_stats, m_pProgress);
+}
 
-                return true;
-            } else {
-                return false;
-            }
-        }
+void ProfileEventFilter::EnableReorderWindow (const ReorderWindowConfig& config, int64_t perfFreq)
+{
+    m_reorderWindow = std::make_unique<ReorderWindow> (this, config, perfFreq);
+    m_reorderWindow->SetCounters (&m_stats, m_pProgress);
+    m_filterData.pReorderWindow = m_reorderWindow.get ();
+    m_filterData.otherThreads.SetTimestampFrequency (perfFreq);
+}
 
-        case ETWConstants::StackWalkKeyDeleteOpcode:
-        case ETWConstants::StackWalkKeyRundownOpcode: {
-            const ETWConstants::StackKeyDefinition* pData =
-                reinterpret_cast<const ETWConstants::StackKeyDefinition*> (pUserData);
+void ProfileEventFilter::FilterEvent (const EventView& event)
+{
+    ETWP_ASSERT (m_pSink != nullptr);
 
-            if (pFilterData->stackKeys.contains (pData->m_key)) {
-                pFilterData->stackKeys.erase (pData->m_key);
+    const bool keep = FilterAndCount (event, &m_stats, [&] () {
+        return FilterEventForProfiling (event, &m_filterData, this);
+    });
 
-                return true;
-            } else {
-                return false;
-            }
-        }
+    if (m_pProgress != nullptr) {
+        m_pProgress->AddEvent (keep);
+        if (m_pPipeline != nullptr && m_pProgress->ShouldSampleQueue ())
+            m_pProgress->SetQueuedBytes (m_pPipeline->GetQueuedSize ());
     }
 
-    return false;
+    if (!keep)
+        return;
+
+    if (m_reorderWindow != nullptr)
+        m_reorderWindow->WriteEvent (event);
+    else
+        WriteEvent (event);
 }
 
-bool FilterThreadEvent (UCHAR opcode, ProfileFilterData* pFilterData, void* pUserData)
+const FilterStats& ProfileEventFilter::GetStats () const
 {
-    const ETWConstants::ThreadDataStub* pData = reinterpret_cast<const ETWConstants::ThreadDataStub*> (pUserData);
-
-    if (pFilterData->targetPIDs.contains (pData->m_processID)) {
-        switch (opcode) {
-            case ETWConstants::TStartOpcode:
-                // Thread start events shouldn't be too frequent, so this is a good opportunity to perform cleanup on
-                //   threads marked for deletion. If there are no such events for a long time (or at all), then cleanup
-                //   is not necessary/urgent, as the number of bookkept threads can not increase (if it does, we will
-                //   get a start event).
-                pFilterData->threads.DeleteThreadsMarkedForDeletion (1_tsec);
-                [[fallthrough]];
+    return m_stats;
+}
 
-            case ETWConstants::TDCStartOpcode:
-                pFilterData->threads.Add (pData->m_threadID);
+ReorderWindow::Stats ProfileEventFilter::GetReorderWindowStats () const
+{
+    return m_reorderWindow != nullptr ? m_reorderWindow->GetStats () : ReorderWindow::Stats {};
+}
 
-                break;
+void ProfileEventFilter::FinishFiltering ()
+{
+    // Nothing can claim the events still held back, but the events queued behind them have to be written
+    if (m_reorderWindow != nullptr)
+        m_reorderWindow->Flush ();
 
-            case ETWConstants::TEndOpcode:
-                pFilterData->threads.MarkForDeletion (pData->m_threadID);
-                [[fallthrough]];
+    // Events still in the pipeline have to be written before the output is closed
+    if (m_pPipeline != nullptr)
+        m_pPipeline->Finish ();
+}
 
-            case ETWConstants::TDCEndOpcode:
-                break;
+bool ProfileEventFilter::WriteEvent (const EventView& event)
+{
+    // Events that cannot be written are counted by the pipeline/writer, no need to log them one by one
+    if (m_pPipeline != nullptr)
+        return m_pPipeline->Enqueue (event);
+    else
+        return m_pSink->WriteEvent (event);
+}
 
-            default:
-                break;
-        }
+ETLWriterEventSink::ETLWriterEventSink (ETLWriter* pWriter): m_pWriter (pWriter)
+{
+}
 
-        return true;
-    } else if (opcode == ETWConstants::TStartOpcode) {
-        // If a recently ended thread's ID of our target gets reassigned to another process's new thread,
-        //    we need to delete that TID from our bookkeping, lest we record irrelevant events
-        if (pFilterData->threads.Contains (pData->m_threadID))
-            pFilterData->threads.Delete (pData->m_threadID);
+bool ETLWriterEventSink::WriteEvent (const EventView& event)
+{
+    return m_pWriter->WriteEvent (event);
+}
 
-        return false;
+ETLWriterConfig CreateETLWriterConfig (const TRACE_LOGFILE_HEADER& logfileHeader, bool realTime)
+{
+    ETLWriterConfig config;
+    config.numberOfProcessors = logfileHeader.NumberOfProcessors;
+    config.perfFreq = logfileHeader.PerfFreq.QuadPart;
+    config.bootTime = logfileHeader.BootTime.QuadPart;
+    config.providerVersion = logfileHeader.ProviderVersion;
+    config.timerResolution = logfileHeader.TimerResolution;
+    config.cpuSpeedInMHz = logfileHeader.CpuSpeedInMHz;
+    config.majorVersion = logfileHeader.VersionDetail.MajorVersion;
+    config.minorVersion = logfileHeader.VersionDetail.MinorVersion;
+    config.loggerName = L"etwprof";
+
+    if (realTime) {
+        // Events are consumed as they are emitted, so the trace (as far as we're concerned) starts now
+        LARGE_INTEGER qpc;
+        FILETIME now;
+        QueryPerformanceCounter (&qpc);
+        GetSystemTimePreciseAsFileTime (&now);
+
+        config.startTimeStamp = qpc.QuadPart;
+        config.startSystemTime = (int64_t (now.dwHighDateTime) << 32) | now.dwLowDateTime;
     } else {
-        return false;
+        // The start QPC value will be taken from the logfile header event of the file (see ETLWriterConfig)
+        config.startTimeStamp = 0;
+        config.startSystemTime = logfileHeader.StartTime.QuadPart;
+    }
+
+    if (config.perfFreq == 0) {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency (&frequency);
+        config.perfFreq = frequency.QuadPart;
     }
+
+    if (config.numberOfProcessors == 0)
+        config.numberOfProcessors = GetActiveProcessorCount (ALL_PROCESSOR_GROUPS);
+
+    return config;
 }
 
-bool FilterContextSwitchEvent (UCHAR opcode, ProfileFilterData* pFilterData, void* pUserData)
+void LogETLWriterStats (const ETLWriter::Stats& stats)
 {
-    if (opcode == ETWConstants::ReadyThreadOpcode) {
-        const ETWConstants::ReadyThreadDataStub* pData =
-            reinterpret_cast<const ETWConstants::ReadyThreadDataStub*> (pUserData);
+    Log (LogSeverity::Info, L"ETL writer: " + std::to_wstring (stats.nEventsWritten) + L" events written in " +
+         std::to_wstring (stats.nBuffersWritten) + L" buffers");
 
-        return pFilterData->threads.Contains (pData->m_readyThreadID);
-    } else if (opcode == ETWConstants::CSwitchOpcode) {
-        const ETWConstants::CSwitchDataStub* pData =
-            reinterpret_cast<const ETWConstants::CSwitchDataStub*> (pUserData);
+    if (stats.nEventsLost > 0)
+        Log (LogSeverity::Warning, L"Writing " + std::to_wstring (stats.nEventsLost) + L" events failed!");
 
-        // A thread of interest was involved in a context switch
-        return pFilterData->threads.Contains (pData->m_newThreadID) ||
-               pFilterData->threads.Contains (pData->m_oldThreadID);
-    } else {
-        return false;
+    if (stats.nExtendedItemsDropped > 0) {
+        Log (LogSeverity::Debug, std::to_wstring (stats.nExtendedItemsDropped) + L" extended data items (other than "
+             L"stack traces) were dropped");
     }
 }
 
-bool FilterProcessEvent (UCHAR opcode,
-                         ProfileFilterData* pFilterData,
-                         void* pUserData,
-                         ProcessLifetimeEventSource* pProcessLifetimeEventSource)
+void LogRelogPipelineStats (const RelogPipelineStats& stats)
 {
-    const ETWConstants::ProcessDataStub* pData =
-        reinterpret_cast<const ETWConstants::ProcessDataStub*> (pUserData);
+    Log (LogSeverity::Info, L"Relog pipeline: " + std::to_wstring (stats.nWritten) + L" events written, " +
+         std::to_wstring (stats.nDropped) + L" dropped, queue high-water mark: " +
+         std::to_wstring (stats.queueHighWaterMark / 1'024) + L" KiB (of " +
+         std::to_wstring (stats.queueCapacity / 1'024) + L" KiB)");
+
+    if (stats.nDropped > 0) {
+        Log (LogSeverity::Warning, std::to_wstring (stats.nDropped) + L" events were dropped, because the relog "
+             L"pipeline's queue was full!");
+    }
 
-    bool profiledProcess = pFilterData->targetPIDs.contains (pData->m_processID);
+    if (stats.nWriteFailures > 0)
+        Log (LogSeverity::Warning, L"Writing " + std::to_wstring (stats.nWriteFailures) + L" events failed!");
+}
 
-    if (!profiledProcess &&
-        pFilterData->profileChildren &&
-        opcode == ETWConstants::PStartOpcode &&
-        pFilterData->targetPIDs.contains (pData->m_parentProcessID))
-    {
-        // A child process of one of our current targets started, let's add it to our bookkeeping
-        pFilterData->targetPIDs.insert (pData->m_processID);
-        profiledProcess = true;
-    }
+void LogImageIdentityResolverStats (const ImageIdentityResolver::Stats& stats)
+{
+    Log (LogSeverity::Info, L"Image identities: " + std::to_wstring (stats.nResolved) + L" images resolved (" +
+         std::to_wstring (stats.nFromCache) + L" from cache)");
 
-    if (profiledProcess) {
-        switch (opcode) {
-            case ETWConstants::PStartOpcode:
-                pProcessLifetimeEventSource->NotifyProcessStarted (pData->m_processID,
-                                                                   pData->m_parentProcessID);
+    if (stats.nUnresolved > 0)
+        Log (LogSeverity::Debug, L"Unable to read " + std::to_wstring (stats.nUnresolved) + L" images");
+}
 
-                break;
-            case ETWConstants::PEndOpcode:
-                pProcessLifetimeEventSource->NotifyProcessEnded (pData->m_processID,
-                                                                 pData->m_parentProcessID);
+void LogImageIdentityStats (const ImageIdentitySink::Stats& stats)
+{
+    Log (LogSeverity::Info, L"Image identities: " + std::to_wstring (stats.nIdentityEventsWritten) + L" identity "
+         L"events written for " + std::to_wstring (stats.nImageEvents) + L" image events");
 
-                pFilterData->targetPIDs.erase (pData->m_processID);
-                break;
-        }
+    if (stats.nUnresolvedImageEvents > 0) {
+        Log (LogSeverity::Debug, L"No identity events were written for " +
+             std::to_wstring (stats.nUnresolvedImageEvents) + L" image events (the images could not be read)");
     }
 
-    return profiledProcess;
+    if (stats.nEventsHeldBack > 0) {
+        Log (LogSeverity::Debug, L"Image identities: " + std::to_wstring (stats.nEventsHeldBack) + L" events held "
+             L"back while images were read, high-water mark: " +
+             std::to_wstring (stats.heldBackHighWaterMark / 1'024) + L" KB");
+    }
 }
 
-bool FilterSampledProfileEvent (ProfileFilterData* pFilterData, void* pUserData)
+void LogEventMetadataStats (const EventMetadataSink::Stats& stats)
 {
-    const ETWConstants::SampledProfileDataStub* pData =
-        reinterpret_cast<const ETWConstants::SampledProfileDataStub*> (pUserData);
+    Log (LogSeverity::Info, L"Event metadata: " + std::to_wstring (stats.nMetadataEventsWritten) + L" metadata events "
+         L"written for " + std::to_wstring (stats.nEventKinds) + L" kinds of user provider events");
 
-    return pFilterData->threads.Contains (pData->m_threadID);
+    if (stats.nEventKindsWithoutMetadata > 0) {
+        Log (LogSeverity::Debug, L"No metadata is available for " + std::to_wstring (stats.nEventKindsWithoutMetadata) +
+             L" kinds of user provider events");
+    }
 }
 
-bool FilterImageLoadEvent (ProfileFilterData* pFilterData, void* pUserData)
+void LogRotatingSinkStats (const RotatingSink::Stats& stats)
 {
-    const ETWConstants::ImageLoadDataStub* pData =
-        reinterpret_cast<const ETWConstants::ImageLoadDataStub*> (pUserData);
+    Log (LogSeverity::Info, L"Output rotation: " + std::to_wstring (stats.nSegments) + L" segments written, with " +
+         std::to_wstring (stats.nRundownEventsWritten) + L" rundown events");
 
-    return pFilterData->targetPIDs.contains (pData->m_processID) ||
-           IsKernelModeAddress (pData->m_imageBase);    // Kernel mode parts of stacks can be interesting, so preserve
-                                                        //   kernel module loads (drivers, etc.)
+    if (stats.nSegmentsFailed > 0) {
+        Log (LogSeverity::Warning, std::to_wstring (stats.nSegmentsFailed) + L" output segments could not be created "
+             L"or finished!");
+    }
 }
 
-bool FilterUserProviderEvent (ProfileFilterData* pFilterData, const GUID& eventGUID)
+void LogFlightRecorderStats (const FlightRecorder::Stats& stats)
 {
-    return pFilterData->userProviders.find ({ eventGUID }) != pFilterData->userProviders.end ();
-}
+    Log (LogSeverity::Info, L"Flight recorder: " + std::to_wstring (stats.nEventsRecorded) + L" events recorded, " +
+         std::to_wstring (stats.nEventsEvicted) + L" evicted (in " + std::to_wstring (stats.nSlicesEvicted) +
+         L" slices), " + std::to_wstring (stats.nDumps) + L" dumps written with " +
+         std::to_wstring (stats.nEventsDumped) + L" events, memory high-water mark: " +
+         std::to_wstring (stats.memoryHighWaterMark / 1'024) + L" KiB");
+
+    if (stats.nEventsDropped > 0) {
+        Log (LogSeverity::Warning, std::to_wstring (stats.nEventsDropped) + L" events could not be recorded, because "
+             L"the flight recorder's memory was used by a dump!");
+    }
 
-}   // namespace
+    if (stats.nDumpsFailed > 0)
+        Log (LogSeverity::Warning, std::to_wstring (stats.nDumpsFailed) + L" dumps could not be written!");
+}
 
-void ThreadRegistry::DeleteThreadsMarkedForDeletion (TickCount markTimeThreshold)
+void LogTriggeredSinkStats (const TriggeredSink::Stats& stats)
 {
-    std::vector<DWORD> tidsToDelete;
-    for (const auto [tid, deletionMarkTime] : m_threadIDsMarkedForDeletion) {
-        if (GetTickCount() >= deletionMarkTime + markTimeThreshold)
-            tidsToDelete.push_back(tid);
+    Log (LogSeverity::Info, L"Trigger rule: " + std::to_wstring (stats.engine.nActivations) + L" activations (on " +
+         std::to_wstring (stats.engine.nSamples) + L" samples), " + std::to_wstring (stats.nSegments) +
+         L" segments written with " + std::to_wstring (stats.nEventsWritten) + L" events (and " +
+         std::to_wstring (stats.nRundownEventsWritten) + L" rundown events), " +
+         std::to_wstring (stats.nEventsSkipped) + L" events skipped");
+
+    if (stats.nSegmentsFailed > 0) {
+        Log (LogSeverity::Warning, std::to_wstring (stats.nSegmentsFailed) + L" output segments could not be created "
+             L"or finished!");
     }
+}
 
-    for (const auto tid : tidsToDelete) {
-        Delete(tid);
+void LogStackAggregatorStats (const StackAggregator::Stats& stats)
+{
+    Log (LogSeverity::Info, L"Stack aggregation: " + std::to_wstring (stats.nSamples) + L" samples (" +
+         std::to_wstring (stats.nSamplesWithStack) + L" with stacks), " + std::to_wstring (stats.nStacks) +
+         L" distinct stacks, " + std::to_wstring (stats.nNodes) + L" nodes, " + std::to_wstring (stats.nImages) +
+         L" images, memory high-water mark: " + std::to_wstring (stats.memoryHighWaterMark / 1'024) + L" KB");
+
+    if (stats.nTruncatedSamples > 0) {
+        Log (LogSeverity::Warning, std::to_wstring (stats.nTruncatedSamples) + L" samples had their stacks truncated "
+             L"(the memory budget of aggregation was exhausted)!");
     }
 }
 
-ProfileEventFilter::ProfileEventFilter (ProfileFilterData& filterData): m_filterData (filterData)
+void LogModuleSampleFilterStats (const ModuleSampleFilter::Stats& stats)
 {
+    Log (LogSeverity::Info, L"Module filter: " + std::to_wstring (stats.nSamplesKept) + L" of " +
+         std::to_wstring (stats.nSamples) + L" samples kept, " + std::to_wstring (stats.nEventsDropped) +
+         L" events dropped, " + std::to_wstring (stats.nEventsHeldBack) +
+         L" events held back, queue high-water mark: " +
+         std::to_wstring (stats.queueHighWaterMark / 1'024) + L" KB");
 }
 
-void ProfileEventFilter::FilterEvent (ITraceEvent* pEvent, TraceRelogger* pRelogger)
+void LogReorderWindowStats (const ReorderWindow::Stats& stats)
 {
-    FilterEventForProfiling (pEvent, pRelogger, &m_filterData, this);
+    Log (LogSeverity::Info, L"Reorder window: " + std::to_wstring (stats.nRecovered) + L" events recovered (of " +
+         std::to_wstring (stats.nHeld) + L" held back), " + std::to_wstring (stats.nRejected) + L" rejected, " +
+         std::to_wstring (stats.nExpired) + L" expired, " + std::to_wstring (stats.nEvicted) + L" evicted, " +
+         std::to_wstring (stats.nQueued) + L" kept events queued, high-water mark: " +
+         std::to_wstring (stats.highWaterMark / 1'024) + L" KB");
+
+    if (stats.nEvicted > 0) {
+        Log (LogSeverity::Debug, std::to_wstring (stats.nEvicted) + L" events were discarded before the reorder window "
+             L"elapsed, because its memory was full");
+    }
 }
 
-void FilterEventForProfiling (ITraceEvent* pEvent,
-                              TraceRelogger* pRelogger,
-                              ProfileFilterData* pFilterData,
-                              ProcessLifetimeEventSource* pProcessLifetimeEventSource)
+void LogStackKeyTableStats (const StackKeyTable::Stats& stats)
 {
-    EVENT_RECORD* pEventRecord;
-    if (FAILED (pEvent->GetEventRecord (&pEventRecord))) {
-        Log (LogSeverity::Warning, L"Event dropped in relog (GetEventRecord failed)!");
+    Log (LogSeverity::Info, L"Stack keys: " + std::to_wstring (stats.nReferences) + L" references, " +
+         std::to_wstring (stats.nRemoved) + L" definitions kept, " + std::to_wstring (stats.nMisses) +
+         L" dropped, high-water mark: " + std::to_wstring (stats.highWaterMark) + L" keys");
 
-        return;
+    if (stats.nEvicted > 0) {
+        Log (LogSeverity::Warning, std::to_wstring (stats.nEvicted) + L" stack keys were evicted, because their "
+             L"definitions did not arrive in time (some stacks might be missing)!");
     }
+}
 
-    EVENT_HEADER* pHeader = &pEventRecord->EventHeader;
-    if (pHeader->ProviderId == StackWalkGuid) {
-        if (FilterStackWalkEvent (pHeader->EventDescriptor.Opcode, pFilterData, pEventRecord->UserData)) {
-            std::wstring errorMsg;
-            if (!pRelogger->Inject (pEvent, &errorMsg))
-                Log (LogSeverity::Warning, L"Injecting event failed: " + errorMsg);
+std::vector<GUID> GetProviderIDs (const std::vector<IETWBasedProfiler::ProviderInfo>& providerInfos)
+{
+    std::vector<GUID> providerIDs;
+    for (const IETWBasedProfiler::ProviderInfo& providerInfo : providerInfos)
+        providerIDs.push_back (providerInfo.providerID);
 
-            return;
-        }
-    } else if (pHeader->ProviderId == PerfInfoGuid &&
-               pHeader->EventDescriptor.Opcode == ETWConstants::SampledProfileOpcode)
+    return providerIDs;
+}
+
+bool GetEventMetadata (const EventView& event, std::vector<EventMetadataRecord>* pRecordsOut)
+{
+    // TraceLogging events carry their own metadata
+    for (USHORT i = 0; i < event.GetExtendedDataCount (); ++i) {
+        if (event.GetExtendedData ()[i].m_extType == EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL)
+            return false;
+    }
+
+    // TDH does not modify the event, it just has no const correct interface
+    EVENT_RECORD* pEventRecord =
+        const_cast<EVENT_RECORD*> (reinterpret_cast<const EVENT_RECORD*> (&event.GetRecord ()));
+
+    ULONG size = 0;
+    if (TdhGetEventInformation (pEventRecord, 0, nullptr, nullptr, &size) != ERROR_INSUFFICIENT_BUFFER)
+        return false;
+
+    EventMetadataRecord eventInfo = { ETWConstants::EventInfoOpcode, std::vector<uint8_t> (size) };
+    TRACE_EVENT_INFO* pEventInfo = reinterpret_cast<TRACE_EVENT_INFO*> (eventInfo.data.data ());
+    if (TdhGetEventInformation (pEventRecord, 0, nullptr, pEventInfo, &size) != ERROR_SUCCESS ||
+        pEventInfo->DecodingSource == DecodingSourceTlg)
     {
-        if (FilterSampledProfileEvent (pFilterData, pEventRecord->UserData)) {
-            std::wstring errorMsg;
-            if (!pRelogger->Inject (pEvent, &errorMsg))
-                Log (LogSeverity::Warning, L"Injecting event failed: " + errorMsg);
+        return false;
+    }
 
-            return;
-        }
-    } else if (pHeader->ProviderId == ThreadGuid) {
-        UCHAR opcode = pHeader->EventDescriptor.Opcode;
-        if (opcode == ETWConstants::TStartOpcode   ||
-            opcode == ETWConstants::TDCStartOpcode ||
-            opcode == ETWConstants::TEndOpcode     ||
-            opcode == ETWConstants::TDCEndOpcode)
+    // Value maps (e.g. names of enum values) referenced by the properties of the event
+    std::vector<std::wstring> mapNames;
+    for (ULONG i = 0; i < pEventInfo->PropertyCount; ++i) {
+        const EVENT_PROPERTY_INFO& propertyInfo = pEventInfo->EventPropertyInfoArray[i];
+        if ((propertyInfo.Flags & PropertyStruct) != 0 || propertyInfo.nonStructType.MapNameOffset == 0)
+            continue;
+
+        const std::wstring mapName =
+            reinterpret_cast<const wchar_t*> (eventInfo.data.data () + propertyInfo.nonStructType.MapNameOffset);
+        if (std::find (mapNames.begin (), mapNames.end (), mapName) != mapNames.end ())
+            continue;
+
+        mapNames.push_back (mapName);
+
+        ULONG mapSize = 0;
+        if (TdhGetEventMapInformation (pEventRecord, const_cast<PWSTR> (mapName.c_str ()), nullptr, &mapSize) !=
+            ERROR_INSUFFICIENT_BUFFER)
         {
-            if (FilterThreadEvent (opcode, pFilterData, pEventRecord->UserData)) {
-                std::wstring errorMsg;
-                if (!pRelogger->Inject (pEvent, &errorMsg))
-                    Log (LogSeverity::Warning, L"Injecting event failed: " + errorMsg);
-
-                return;
-            }
-        } else if (pFilterData->cswitch) {
-            if (opcode == ETWConstants::ReadyThreadOpcode || opcode == ETWConstants::CSwitchOpcode) {
-                if (FilterContextSwitchEvent (opcode, pFilterData, pEventRecord->UserData)) {
-                    std::wstring errorMsg;
-                    if (!pRelogger->Inject (pEvent, &errorMsg))
-                        Log (LogSeverity::Warning, L"Injecting event failed: " + errorMsg);
-
-                    return;
-                }
-            }
+            continue;
         }
-    } else if (pHeader->ProviderId == ProcessGuid) {
-        if (FilterProcessEvent (pHeader->EventDescriptor.Opcode,
-                                pFilterData,
-                                pEventRecord->UserData,
-                                pProcessLifetimeEventSource))
-        {
-            std::wstring errorMsg;
-            if (!pRelogger->Inject (pEvent, &errorMsg))
-                Log (LogSeverity::Warning, L"Injecting event failed: " + errorMsg);
 
-            return;
+        EventMetadataRecord mapInfo = { ETWConstants::EventMapInfoOpcode, std::vector<uint8_t> (mapSize) };
+        if (TdhGetEventMapInformation (pEventRecord,
+                                       const_cast<PWSTR> (mapName.c_str ()),
+                                       reinterpret_cast<PEVENT_MAP_INFO> (mapInfo.data.data ()),
+                                       &mapSize) == ERROR_SUCCESS)
+        {
+            pRecordsOut->push_back (std::move (mapInfo));
         }
-    }  else if (pHeader->ProviderId == ImageLoadGuid) {
-        if (FilterImageLoadEvent (pFilterData, pEventRecord->UserData)) {
-            std::wstring errorMsg;
-            if (!pRelogger->Inject (pEvent, &errorMsg))
-                Log (LogSeverity::Warning, L"Injecting event failed: " + errorMsg);
+    }
 
-            return;
-        }
-    } else if (pHeader->ProviderId == EventTraceEventGuid) {
-        std::wstring errorMsg;
-        if (!pRelogger->Inject (pEvent, &errorMsg))
-            Log (LogSeverity::Warning, L"Injecting event failed: " + errorMsg);
+    // The event info comes first
+    pRecordsOut->insert (pRecordsOut->begin (), std::move (eventInfo));
 
-        return;
-    } else if (pFilterData->targetPIDs.contains (pHeader->ProcessId)) {
-        if (FilterUserProviderEvent (pFilterData, pEventRecord->EventHeader.ProviderId)) {
-            std::wstring errorMsg;
-            if (!pRelogger->Inject (pEvent, &errorMsg))
-                Log (LogSeverity::Warning, L"Injecting event failed: " + errorMsg);
+    return true;
+}
 
-            return;
-        }
-    }
+std::wstring GetImageIdentityCachePath ()
+{
+    const std::wstring localAppDataPath = PathExpandEnvVars (L"%LOCALAPPDATA%");
+    if (localAppDataPath.empty () || localAppDataPath.starts_with (L"%"))
+        return {};
+
+    return localAppDataPath + L"\\etwprof\\ImageIdentityCache.bin";
 }
 
 bool MergeTrace (const std::wstring& inputETLPath,
@@ -369,4 +453,100 @@ bool MergeTrace (const std::wstring& inputETLPath,
     return true;
 }
 
+std::wstring GetWriterOutputPath (const std::wstring& outputETLPath, IETWBasedProfiler::Flags options)
+{
+    if (options & IETWBasedProfiler::Compress)
+        return outputETLPath + L".raw.etl";
+
+    return outputETLPath;
+}
+
+bool FinalizeTrace (const std::wstring& writerOutputPath, const std::wstring& outputETLPath, std::wstring* pErrorOut)
+{
+    if (writerOutputPath == outputETLPath)
+        return true;
+
+    return MergeTrace (writerOutputPath, EVENT_TRACE_MERGE_EXTENDED_DATA_COMPRESS_TRACE, outputETLPath, pErrorOut);
+}
+
+ETLOutputSegment::ETLOutputSegment (const std::wstring& outputETLPath,
+                                    const ETLWriterConfig& writerConfig,
+                                    IETWBasedProfiler::Flags options,
+                                    ImageIdentityResolver* pImageResolver,
+                                    const std::vector<GUID>& userProviderIDs):
+    m_outputETLPath (outputETLPath),
+    m_writerOutputPath (GetWriterOutputPath (outputETLPath, options)),
+    m_debug (options & IETWBasedProfiler::Debug),
+    m_finalized (false),
+    m_writer (m_writerOutputPath, writerConfig),
+    m_writerSink (&m_writer),
+    m_imageIdentitySink (&m_writerSink, pImageResolver, true),
+    m_eventMetadataSink (&m_imageIdentitySink, GetEventMetadata, userProviderIDs)
+{
+}
+
+ETLOutputSegment::~ETLOutputSegment ()
+{
+    // The file has to be closed before it can be deleted
+    std::wstring errorMsg;
+    m_writer.Close (&errorMsg);
+
+    if (m_debug || (m_finalized && m_writerOutputPath == m_outputETLPath))
+        return;
+
+    if (PathExists (m_writerOutputPath) && ETWP_ERROR (!FileDelete (m_writerOutputPath)))
+        Log (LogSeverity::Debug, L"Unable to delete ETL file written: " + m_writerOutputPath);
+}
+
+IEventSink* ETLOutputSegment::GetSink ()
+{
+    return &m_eventMetadataSink;
+}
+
+uint64_t ETLOutputSegment::GetSize () const
+{
+    return m_writer.GetStats ().nBytesWritten;
+}
+
+bool ETLOutputSegment::Close (std::wstring* pErrorOut)
+{
+    // Events held back are written even if some of them could not be (those are counted as lost by the writer)
+    m_imageIdentitySink.Flush ();
+    if (!m_writer.Close (pErrorOut))
+        return false;
+
+    LogETLWriterStats (m_writer.GetStats ());
+    LogImageIdentityStats (m_imageIdentitySink.GetStats ());
+    LogEventMetadataStats (m_eventMetadataSink.GetStats ());
+
+    return true;
+}
+
+bool ETLOutputSegment::Finalize (std::wstring* pErrorOut)
+{
+    m_finalized = FinalizeTrace (m_writerOutputPath, m_outputETLPath, pErrorOut);
+
+    return m_finalized;
+}
+
+bool ETLOutputSegment::Finish (std::wstring* pErrorOut)
+{
+    std::wstring errorMsg;
+    if (!Close (&errorMsg)) {
+        *pErrorOut = L"Unable to write output segment " + m_outputETLPath + L": " + errorMsg;
+
+        return false;
+    }
+
+    if (!Finalize (&errorMsg)) {
+        *pErrorOut = L"Unable to finalize output segment " + m_outputETLPath + L": " + errorMsg;
+
+        return false;
+    }
+
+    Log (LogSeverity::Info, L"Output segment finished: " + m_outputETLPath);
+
+    return true;
+}
+
 }   // namespace ETWP
\ No newline at end of file
@@ -3,98 +3,105 @@
 
 #include <windows.h>
 
+#include <memory>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
+#include "EventMetadata.hpp"
+#include "FilterStats.hpp"
+#include "FlightRecorder.hpp"
 #include "IETWBasedProfiler.hpp"
-
-#include "OS/ETW/TraceRelogger.hpp"
+#include "ImageIdentity.hpp"
+#include "ModuleFilter.hpp"
+#include "OutputRotation.hpp"
+#include "ProfileFilter.hpp"
+#include "ProgressCounters.hpp"
+#include "RelogPipeline.hpp"
+#include "ReorderWindow.hpp"
+#include "StackAggregator.hpp"
+#include "StackKeyTable.hpp"
+#include "TriggerRules.hpp"
+
+#include "OS/ETW/ETLWriter.hpp"
+#include "OS/ETW/TraceConsumer.hpp"
 #include "OS/Process/ProcessLifetimeEventSource.hpp"
 
-#include "OS/Utility/Time.hpp"
-
-struct ITraceEvent;
-
-template<>
-struct std::hash<ETWP::IETWBasedProfiler::ProviderInfo> {
-    std::size_t operator() (const ETWP::IETWBasedProfiler::ProviderInfo& providerInfo) const {
-        const GUID& guid = providerInfo.providerID;
-        // According to my experiments (with GUIDs generated with CoCreateGuid), Data1-3 used as a hash value provides
-        //   significantly better uniformity than Data4. I'm not sure why, and haven't bothered to investigate
-        return *reinterpret_cast<const std::size_t*> (&guid.Data1);
-    }
-};
+#include "Utility/Macros.hpp"
 
 namespace ETWP {
 
 class ProcessLifetimeEventSource;
 
-// Class for recording thread IDs of interest. Besides deleting, you can also mark threads for deletion. These can be
-//   deleted later manually by calling DeleteThreadsMarkedForDeletion, with a time threshold
-class ThreadRegistry {
+// Kept events are written into the pipeline or the sink through the (private) IEventSink interface. If the reorder
+//   window is enabled, kept events pass through it first (so they are not written ahead of the events it holds)
+class ProfileEventFilter final : public IEventFilter, public ProcessLifetimeEventSource, private IEventSink {
 public:
-    void Add (DWORD tid);
-    void MarkForDeletion (DWORD tid);
-    void Delete (DWORD tid);
-    bool Contains (DWORD tid) const;
+    // Might throw EventDispatchTable::FullException (see PrepareForProfiling)
+    ProfileEventFilter (ProfileFilterData& filterData);
 
-    void DeleteThreadsMarkedForDeletion (TickCount markTimeThreshold);
+    // Kept events are written into this sink (must be set before filtering starts)
+    void SetSink (IEventSink* pSink);
+    // If a pipeline is set, kept events are enqueued into it, instead of writing them into the sink directly.
+    //   The pipeline is finished when filtering finishes
+    void SetPipeline (RelogPipeline* pPipeline);
+    // If set, consumed and kept events (and the queue size of the pipeline) are counted here
+    void SetProgressCounters (ProgressCounters* pProgress);
+    // Events of threads not known yet are held back for a while (see ReorderWindow). perfFreq is the frequency of event
+    //   timestamps
+    void EnableReorderWindow (const ReorderWindowConfig& config, int64_t perfFreq);
 
-private:
-    std::unordered_set<DWORD>            m_threadIDs;
-    std::unordered_map<DWORD, TickCount> m_threadIDsMarkedForDeletion;    // TID + tick count when it was marked for deletion
-};
+    virtual void FilterEvent (const EventView& event) override;
+    virtual void FinishFiltering () override;
+
+    const FilterStats& GetStats () const;
+    // Only meaningful if the reorder window is enabled
+    ReorderWindow::Stats GetReorderWindowStats () const;
 
-inline void ThreadRegistry::Add (DWORD tid)
-{
-    m_threadIDs.insert (tid);
-}
-
-inline void ThreadRegistry::MarkForDeletion (DWORD tid)
-{
-    m_threadIDsMarkedForDeletion.insert({ tid, GetTickCount ()});
-}
-
-inline void ThreadRegistry::Delete (DWORD tid)
-{
-    m_threadIDs.erase (tid);
-    m_threadIDsMarkedForDeletion.erase (tid);
-}
-
-inline bool ThreadRegistry::Contains (DWORD tid) const
-{
-    return m_threadIDs.contains (tid);
-}
-
-struct ProfileFilterData {
-    // Unfortunately, sometimes we receive events for a thread *after* their end event. To mitigate this, we keep
-    //   terminated thread ID's around for some time.
-    ThreadRegistry threads;
-    // In theory, std::vector should perform better if the number of providers is small. However, my experiments showed
-    //   only a very tiny difference, so using a hash set alone should suffice
-    std::unordered_set<IETWBasedProfiler::ProviderInfo> userProviders;
-    std::unordered_set<UINT_PTR> stackKeys;  // For stack cache filtering (when enabled)
-    std::unordered_set<DWORD> targetPIDs;
-
-    bool cswitch;
-    bool profileChildren;
+private:
+    ProfileFilterData&             m_filterData;
+    FilterStats                    m_stats;
+    IEventSink*                    m_pSink;
+    RelogPipeline*                 m_pPipeline;
+    ProgressCounters*              m_pProgress;
+    std::unique_ptr<ReorderWindow> m_reorderWindow;
+
+    virtual bool WriteEvent (const EventView& event) override;
 };
 
-class ProfileEventFilter final : public IEventFilter, public ProcessLifetimeEventSource {
+// Writes events into an ETL file
+class ETLWriterEventSink final : public IEventSink {
 public:
-    ProfileEventFilter (ProfileFilterData& filterData);
+    explicit ETLWriterEventSink (ETLWriter* pWriter);
 
-    virtual void FilterEvent (ITraceEvent* pEvent, TraceRelogger* pRelogger) override;
+    virtual bool WriteEvent (const EventView& event) override;
 
 private:
-    ProfileFilterData& m_filterData;
+    ETLWriter* m_pWriter;
 };
 
-void FilterEventForProfiling (ITraceEvent* pEvent,
-                              TraceRelogger* pRelogger,
-                              ProfileFilterData* pFilterData,
-                              ProcessLifetimeEventSource* pProcessLifetimeEventSource);
+// Describes the output trace based on the trace being consumed
+ETLWriterConfig CreateETLWriterConfig (const TRACE_LOGFILE_HEADER& logfileHeader, bool realTime);
+
+void LogETLWriterStats (const ETLWriter::Stats& stats);
+void LogRelogPipelineStats (const RelogPipelineStats& stats);
+void LogImageIdentityResolverStats (const ImageIdentityResolver::Stats& stats);
+void LogImageIdentityStats (const ImageIdentitySink::Stats& stats);
+void LogEventMetadataStats (const EventMetadataSink::Stats& stats);
+void LogRotatingSinkStats (const RotatingSink::Stats& stats);
+void LogFlightRecorderStats (const FlightRecorder::Stats& stats);
+void LogTriggeredSinkStats (const TriggeredSink::Stats& stats);
+void LogStackAggregatorStats (const StackAggregator::Stats& stats);
+void LogModuleSampleFilterStats (const ModuleSampleFilter::Stats& stats);
+void LogReorderWindowStats (const ReorderWindow::Stats& stats);
+void LogStackKeyTableStats (const StackKeyTable::Stats& stats);
+
+std::vector<GUID> GetProviderIDs (const std::vector<IETWBasedProfiler::ProviderInfo>& providerInfos);
+
+// Reads the metadata of (manifest based and classic) user provider events with TDH, for EventMetadataSink
+bool GetEventMetadata (const EventView& event, std::vector<EventMetadataRecord>* pRecordsOut);
+
+// Image identities are cached per user, in %LOCALAPPDATA%. Returns an empty string, if that's not available
+std::wstring GetImageIdentityCachePath ();
 
 // This code snippet is copied here from KernelTraceControl.h in the Windows SDK
 #define EVENT_TRACE_MERGE_EXTENDED_DATA_NONE                0x00000000
@@ -118,6 +125,52 @@ bool MergeTrace (const std::wstring& inputETLPath,
                  const std::wstring& outputETLPath,
                  std::wstring* pErrorOut);
 
+// The output is written in a single pass, directly into the output file: image identities and event metadata are
+//   written along with the events (see ImageIdentitySink and EventMetadataSink), and xz compression is done while
+//   writing (see ETLWriterConfig). Only ETW's own compression needs a second pass, as it's only available through
+//   kerneltracecontrol.dll's merge, which rewrites the whole trace. So in that case, a raw file is written first.
+// Returns the path the ETL writer should write to
+std::wstring GetWriterOutputPath (const std::wstring& outputETLPath, IETWBasedProfiler::Flags options);
+
+// Turns the file written by the ETL writer (see GetWriterOutputPath) into the output, if they differ
+bool FinalizeTrace (const std::wstring& writerOutputPath, const std::wstring& outputETLPath, std::wstring* pErrorOut);
+
+// The output of a trace (or a segment of a rotated trace, see RotatingSink): event metadata and image identities are
+//   added to the events (see EventMetadataSink and ImageIdentitySink), which are written into an ETL file (see
+//   GetWriterOutputPath). The file written is deleted on destruction, unless it's the output, and it was finalized
+//   (or the Debug option is set).
+// Images are read by the background thread of the image identity resolver (see ImageIdentitySink)
+class ETLOutputSegment final : public IOutputSegment {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ETLOutputSegment);
+
+    // Might throw ETLWriter::InitException
+    ETLOutputSegment (const std::wstring& outputETLPath,
+                      const ETLWriterConfig& writerConfig,
+                      IETWBasedProfiler::Flags options,
+                      ImageIdentityResolver* pImageResolver,
+                      const std::vector<GUID>& userProviderIDs);
+    virtual ~ETLOutputSegment () override;
+
+    virtual IEventSink* GetSink () override;
+    virtual uint64_t    GetSize () const override;      // Uncompressed
+
+    bool Close (std::wstring* pErrorOut);               // Closes the ETL file written, and logs statistics
+    bool Finalize (std::wstring* pErrorOut);            // See FinalizeTrace
+
+    virtual bool Finish (std::wstring* pErrorOut) override;    // Close, then Finalize
+
+private:
+    std::wstring       m_outputETLPath;
+    std::wstring       m_writerOutputPath;
+    bool               m_debug;
+    bool               m_finalized;
+    ETLWriter          m_writer;
+    ETLWriterEventSink m_writerSink;
+    ImageIdentitySink  m_imageIdentitySink;
+    EventMetadataSink  m_eventMetadataSink;
+};
+
 }   // namespace ETWP
 
 #endif  // #ifndef #define ETWP_PROFILER_COMMON_HPP
\ No newline at end of file
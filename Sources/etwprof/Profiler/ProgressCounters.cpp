@@ -0,0 +1,135 @@
+#include "ProgressCounters.hpp"
+
+#include <cstdio>
+
+namespace ETWP {
+
+namespace {
+
+constexpr double kMB = 1'024.0 * 1'024.0;
+
+// E.g. "950", "42.0 K", "1.25 M"
+std::string FormatCount (double count)
+{
+    char buffer[32];
+    if (count >= 1'000'000.0)
+        std::snprintf (buffer, sizeof buffer, "%.2f M", count / 1'000'000.0);
+    else if (count >= 1'000.0)
+        std::snprintf (buffer, sizeof buffer, "%.1f K", count / 1'000.0);
+    else
+        std::snprintf (buffer, sizeof buffer, "%.0f", count);
+
+    return buffer;
+}
+
+}   // namespace
+
+ProgressCounters::ProgressCounters ():
+    m_start (std::chrono::steady_clock::now ()),
+    m_nEvents (0),
+    m_nEventsKept (0),
+    m_queuedBytes (0),
+    m_nBytesWritten (0)
+{
+}
+
+void ProgressCounters::SetQueuedBytes (size_t queuedBytes)
+{
+    m_queuedBytes.store (queuedBytes, std::memory_order_relaxed);
+}
+
+ProgressSample ProgressCounters::Sample () const
+{
+    const auto elapsed = std::chrono::steady_clock::now () - m_start;
+
+    ProgressSample sample = {};
+    sample.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds> (elapsed).count ();
+    sample.nEvents = m_nEvents.load (std::memory_order_relaxed);
+    sample.nEventsKept = m_nEventsKept.load (std::memory_order_relaxed);
+    sample.nBytesWritten = m_nBytesWritten.load (std::memory_order_relaxed);
+    sample.queuedBytes = m_queuedBytes.load (std::memory_order_relaxed);
+
+    return sample;
+}
+
+ProgressCountingSink::ProgressCountingSink (IEventSink* pSink, ProgressCounters* pCounters):
+    m_pSink (pSink),
+    m_pCounters (pCounters)
+{
+}
+
+bool ProgressCountingSink::WriteEvent (const EventView& event)
+{
+    if (!m_pSink->WriteEvent (event))
+        return false;
+
+    m_pCounters->AddBytesWritten (sizeof (EventHeaderLayout) + event.GetUserDataLength ());
+
+    return true;
+}
+
+ProgressRates GetProgressRates (const ProgressSample& previous, const ProgressSample& current)
+{
+    if (current.timeNs <= previous.timeNs)
+        return { 0.0, 0.0 };
+
+    const double elapsedSec = (current.timeNs - previous.timeNs) / 1e9;
+
+    // Samples are not consistent snapshots, but counters never decrease
+    return { (current.nEvents - previous.nEvents) / elapsedSec,
+             (current.nEventsKept - previous.nEventsKept) / elapsedSec };
+}
+
+std::wstring FormatProgress (const ProgressSample& previous, const ProgressSample& current)
+{
+    const ProgressRates rates = GetProgressRates (previous, current);
+
+    char buffer[256];
+    std::snprintf (buffer,
+                   sizeof buffer,
+                   "%s events/s (%s kept), %.1f MB written, queue %.1f MB, lost: %llu events, %llu buffers",
+                   FormatCount (rates.eventsPerSec).c_str (),
+                   FormatCount (rates.eventsKeptPerSec).c_str (),
+                   current.nBytesWritten / kMB,
+                   current.queuedBytes / kMB,
+                   static_cast<unsigned long long> (current.nEventsLost),
+                   static_cast<unsigned long long> (current.nBuffersLost + current.nRealTimeBuffersLost));
+
+    const std::string line = buffer;
+
+    return std::wstring (line.begin (), line.end ());
+}
+
+ProgressLog::ProgressLog (): m_file ()
+{
+}
+
+bool ProgressLog::Open (const std::filesystem::path& path, std::wstring* pErrorOut)
+{
+    m_file.open (path, std::ios::trunc);
+    m_file << "time_ms,events,events_kept,bytes_written,queued_bytes,events_per_s,events_kept_per_s,"
+              "events_lost,buffers_lost,realtime_buffers_lost\n" << std::flush;
+    if (!m_file) {
+        *pErrorOut = L"Unable to create progress file: " + path.wstring ();
+
+        return false;
+    }
+
+    return true;
+}
+
+bool ProgressLog::Write (const ProgressSample& previous, const ProgressSample& current)
+{
+    const ProgressRates rates = GetProgressRates (previous, current);
+
+    char buffer[64];
+    std::snprintf (buffer, sizeof buffer, "%.0f,%.0f", rates.eventsPerSec, rates.eventsKeptPerSec);
+
+    m_file << current.timeNs / 1'000'000 << ',' << current.nEvents << ',' << current.nEventsKept << ','
+           << current.nBytesWritten << ',' << current.queuedBytes << ',' << buffer << ',' << current.nEventsLost
+           << ',' << current.nBuffersLost << ',' << current.nRealTimeBuffersLost << '\n' << std::flush;
+
+    return bool (m_file);
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef ETWP_PROGRESS_COUNTERS_HPP
+#define ETWP_PROGRESS_COUNTERS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "RelogPipeline.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Snapshot of ProgressCounters (and of the loss counters of the ETW session being consumed, if any)
+struct ProgressSample {
+    uint64_t timeNs;                // Since the counters were created
+    uint64_t nEvents;               // Consumed
+    uint64_t nEventsKept;
+    uint64_t nBytesWritten;         // Header and payload of events written, uncompressed
+    uint64_t queuedBytes;           // In the queue of the relog pipeline (if any)
+    uint64_t nEventsLost;           // By the ETW session
+    uint64_t nBuffersLost;          // By the ETW session
+    uint64_t nRealTimeBuffersLost;  // By the ETW session (i.e. the consumer was too slow)
+};
+
+struct ProgressRates {
+    double eventsPerSec;
+    double eventsKeptPerSec;
+};
+
+// Counters of a running profiler, to be sampled by another thread (e.g. to display progress). Each counter has a
+//   single writer: the consuming thread counts events, the thread writing the output (which is the consuming thread,
+//   unless a relog pipeline is used) counts bytes. So counters are updated with a relaxed load and store (not a
+//   read-modify-write), which costs as much as updating a plain integer, and the filter path never waits for the
+//   reader. The two writers' counters are on separate cache lines.
+// Samples are not consistent snapshots (counters are read one by one), which is fine for displaying progress
+class ProgressCounters final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ProgressCounters);
+
+    static constexpr uint64_t kQueueSampleInterval = 1'024;    // See ShouldSampleQueue
+
+    ProgressCounters ();
+
+    // Consuming thread only
+    void AddEvent (bool kept);
+    void AddRecoveredEvent ();             // An event counted as dropped was kept after all (see ReorderWindow)
+    bool ShouldSampleQueue () const;        // True for every kQueueSampleInterval-th event
+    void SetQueuedBytes (size_t queuedBytes);
+
+    // Writing thread only
+    void AddBytesWritten (uint64_t nBytes);
+
+    // Any thread. Fields of the ETW session are left zero
+    ProgressSample Sample () const;
+
+private:
+    static constexpr size_t kCacheLineSize = 64;
+
+    std::chrono::steady_clock::time_point m_start;
+
+    alignas (kCacheLineSize) std::atomic<uint64_t> m_nEvents;
+    std::atomic<uint64_t>                          m_nEventsKept;
+    std::atomic<uint64_t>                          m_queuedBytes;
+
+    alignas (kCacheLineSize) std::atomic<uint64_t> m_nBytesWritten;
+};
+
+inline void ProgressCounters::AddEvent (bool kept)
+{
+    m_nEvents.store (m_nEvents.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_nEventsKept.store (m_nEventsKept.load (std::memory_order_relaxed) + kept, std::memory_order_relaxed);
+}
+
+inline void ProgressCounters::AddRecoveredEvent ()
+{
+    m_nEventsKept.store (m_nEventsKept.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+inline bool ProgressCounters::ShouldSampleQueue () const
+{
+    return m_nEvents.load (std::memory_order_relaxed) % kQueueSampleInterval == 0;
+}
+
+inline void ProgressCounters::AddBytesWritten (uint64_t nBytes)
+{
+    m_nBytesWritten.store (m_nBytesWritten.load (std::memory_order_relaxed) + nBytes, std::memory_order_relaxed);
+}
+
+// Counts the bytes of the events successfully written into another sink (on the writing thread)
+class ProgressCountingSink final : public IEventSink {
+public:
+    ProgressCountingSink (IEventSink* pSink, ProgressCounters* pCounters);
+
+    virtual bool WriteEvent (const EventView& event) override;
+
+private:
+    IEventSink*       m_pSink;
+    ProgressCounters* m_pCounters;
+};
+
+// Rates between two samples (zero, if no time elapsed)
+ProgressRates GetProgressRates (const ProgressSample& previous, const ProgressSample& current);
+
+// One line summary, e.g. "1.25 M events/s (42.0 K kept), 12.5 MB written, queue 0.0 MB, lost: 0 events, 0 buffers"
+std::wstring FormatProgress (const ProgressSample& previous, const ProgressSample& current);
+
+// Appends samples to a CSV file (one row per sample, with the rates since the previous one), flushing each row, so
+//   the file can be followed while profiling (e.g. by a script running an unattended capture)
+class ProgressLog final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ProgressLog);
+
+    ProgressLog ();
+
+    bool Open (const std::filesystem::path& path, std::wstring* pErrorOut);    // Truncates, and writes the header
+    bool Write (const ProgressSample& previous, const ProgressSample& current);
+
+private:
+    std::ofstream m_file;
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_PROGRESS_COUNTERS_HPP
\ No newline at end of file
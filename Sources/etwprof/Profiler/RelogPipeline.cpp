@@ -0,0 +1,139 @@
+#include "RelogPipeline.hpp"
+
+#include <chrono>
+
+#include "StoredEvent.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+namespace {
+
+// The writer thread spins (yielding) this many times on an empty queue before it starts sleeping. Sleeping is fine,
+//   as the queue is big enough to buffer the events of a couple of milliseconds of even the busiest session
+constexpr uint32_t kWriterSpinCount = 64;
+constexpr auto     kWriterSleepTime = std::chrono::microseconds (500);
+
+// Events are stored in the queue as is (see StoreEvent)
+static_assert (EventRingBuffer::kAlignment % kStoredEventAlignment == 0);
+
+}   // namespace
+
+IEventSink::~IEventSink ()
+{
+}
+
+RelogPipeline::RelogPipeline (IEventSink* pSink, size_t queueCapacity /*= kDefaultQueueCapacity*/):
+    m_queue (queueCapacity),
+    m_pSink (pSink),
+    m_finishing (false),
+    m_writerThread (),
+    m_nEnqueued (0),
+    m_nDropped (0),
+    m_nWritten (0),
+    m_nWriteFailures (0)
+{
+    ETWP_ASSERT (m_pSink != nullptr);
+
+    m_writerThread = std::thread (&RelogPipeline::WriterThreadMain, this);
+}
+
+RelogPipeline::~RelogPipeline ()
+{
+    Finish ();
+}
+
+bool RelogPipeline::Enqueue (const EventView& event)
+{
+    ETWP_ASSERT (!m_finishing.load (std::memory_order_relaxed));
+
+    void* pRecord = m_queue.BeginWrite (GetStoredEventSize (event));
+    if (pRecord == nullptr) {
+        ++m_nDropped;
+
+        return false;
+    }
+
+    StoreEvent (event, pRecord);
+
+    m_queue.EndWrite ();
+    ++m_nEnqueued;
+
+    return true;
+}
+
+void RelogPipeline::Finish ()
+{
+    if (!m_writerThread.joinable ())
+        return;
+
+    m_finishing.store (true, std::memory_order_release);
+    m_writerThread.join ();
+}
+
+size_t RelogPipeline::GetQueuedSize () const
+{
+    return m_queue.GetUsedSize ();
+}
+
+RelogPipelineStats RelogPipeline::GetStats () const
+{
+    ETWP_ASSERT (!m_writerThread.joinable ());
+
+    return { m_nEnqueued,
+             m_nDropped,
+             m_nWritten,
+             m_nWriteFailures,
+             m_queue.GetCapacity (),
+             m_queue.GetHighWaterMark () };
+}
+
+void RelogPipeline::WriterThreadMain ()
+{
+    uint32_t nEmptyPolls = 0;
+    for (;;) {
+        if (WriteQueuedEvent ()) {
+            nEmptyPolls = 0;
+
+            continue;
+        }
+
+        // The queue was empty. If we are finishing, we have to check once more, as events might have been enqueued
+        //   between the check above and the request to finish
+        if (m_finishing.load (std::memory_order_acquire)) {
+            while (WriteQueuedEvent ())
+                ;
+
+            return;
+        }
+
+        if (++nEmptyPolls < kWriterSpinCount)
+            std::this_thread::yield ();
+        else
+            std::this_thread::sleep_for (kWriterSleepTime);
+    }
+}
+
+bool RelogPipeline::WriteQueuedEvent ()
+{
+    size_t size;
+    const void* pRecord = m_queue.BeginRead (&size);
+    if (pRecord == nullptr)
+        return false;
+
+    ETWP_ASSERT (size >= sizeof (EventRecordLayout));
+
+    EventRecordLayout record;
+    const EventView event = LoadStoredEvent (pRecord, &record, &m_extendedData);
+    if (m_pSink->WriteEvent (event))
+        ++m_nWritten;
+    else
+        ++m_nWriteFailures;
+
+    m_queue.EndRead ();
+
+    return true;
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,82 @@
+#ifndef ETWP_RELOG_PIPELINE_HPP
+#define ETWP_RELOG_PIPELINE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "EventRingBuffer.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Receives the events to be written by a RelogPipeline, on its writer thread
+class IEventSink {
+public:
+    virtual ~IEventSink ();
+
+    virtual bool WriteEvent (const EventView& event) = 0;   // Returns false if writing the event failed
+};
+
+struct RelogPipelineStats {
+    uint64_t nEnqueued;
+    uint64_t nDropped;              // The queue was full (or the event did not fit into it at all)
+    uint64_t nWritten;
+    uint64_t nWriteFailures;
+    size_t   queueCapacity;         // In bytes
+    size_t   queueHighWaterMark;    // In bytes
+};
+
+// Decouples consuming events from writing them: the consuming thread (e.g. the one draining a real-time session)
+//   copies the events to be kept into a lock-free queue with Enqueue, and a writer thread owned by this class passes
+//   them to an IEventSink. This way, a slow write does not hold up consumption (which would make ETW drop events).
+//   If the queue is full, events are dropped (and counted), the consuming thread never waits for the writer.
+// Events are copied with their payload and extended data items.
+// Enqueue and Finish must be called from the same thread
+class RelogPipeline final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (RelogPipeline);
+
+    static constexpr size_t kDefaultQueueCapacity = 64 * 1'024 * 1'024;
+
+    // Starts the writer thread
+    explicit RelogPipeline (IEventSink* pSink, size_t queueCapacity = kDefaultQueueCapacity);
+    ~RelogPipeline ();  // Calls Finish
+
+    bool Enqueue (const EventView& event);  // Returns false if the event was dropped
+
+    // Waits until all queued events are written, then stops the writer thread. Events must not be enqueued afterwards
+    void Finish ();
+
+    // Number of bytes in the queue (i.e. enqueued, but not written yet). Can be called from the enqueuing thread only
+    size_t GetQueuedSize () const;
+
+    // Can be called after Finish only
+    RelogPipelineStats GetStats () const;
+
+private:
+    EventRingBuffer   m_queue;
+    IEventSink*       m_pSink;
+    std::atomic<bool> m_finishing;
+    std::thread       m_writerThread;
+
+    // Used by the enqueuing thread only
+    uint64_t m_nEnqueued;
+    uint64_t m_nDropped;
+
+    // Used by the writer thread only (until it's joined)
+    uint64_t                             m_nWritten;
+    uint64_t                             m_nWriteFailures;
+    std::vector<EventExtendedItemLayout> m_extendedData;    // Of the event being written
+
+    void WriterThreadMain ();
+    bool WriteQueuedEvent ();   // Returns false if the queue was empty
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_RELOG_PIPELINE_HPP
\ No newline at end of file
@@ -0,0 +1,227 @@
+#include "ReorderWindow.hpp"
+
+#include <algorithm>
+
+#include "FilterStats.hpp"
+#include "ProgressCounters.hpp"
+#include "StoredEvent.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+static_assert (EventRingBuffer::kAlignment % kStoredEventAlignment == 0);
+
+bool ReorderWindowConfig::IsEnabled () const
+{
+    return window > 0;
+}
+
+ReorderWindow::ReorderWindow (IEventSink* pSink, const ReorderWindowConfig& config, int64_t perfFreq):
+    m_pSink (pSink),
+    m_pFilterStats (nullptr),
+    m_pProgress (nullptr),
+    m_windowTicks (int64_t (config.window) * perfFreq / 1'000),
+    m_storage (config.maxMemory),
+    m_queue (),
+    m_firstSequenceNumber (0),
+    m_heldEvents (),
+    m_extendedData (),
+    m_stats ()
+{
+    ETWP_ASSERT (m_pSink != nullptr);
+}
+
+void ReorderWindow::SetCounters (FilterStats* pFilterStats, ProgressCounters* pProgress)
+{
+    m_pFilterStats = pFilterStats;
+    m_pProgress = pProgress;
+}
+
+bool ReorderWindow::WriteEvent (const EventView& event)
+{
+    const int64_t timeStamp = event.GetTimestamp ();
+    Expire (timeStamp);
+
+    // Events after a held one have to wait for it, otherwise it could not be written in its place
+    while (!m_queue.empty ()) {
+        if (Enqueue (event, { timeStamp, nullptr, 0, 0, 0, false, Decision::Keep })) {
+            ++m_stats.nQueued;
+
+            return true;
+        }
+
+        ++m_stats.nEvicted;
+        DiscardOldest ();
+    }
+
+    return m_pSink->WriteEvent (event);
+}
+
+void ReorderWindow::Hold (const EventView& event, DWORD tid, DWORD otherTID)
+{
+    const int64_t timeStamp = event.GetTimestamp ();
+    Expire (timeStamp);
+
+    ++m_stats.nHeld;
+
+    if (GetStoredEventSize (event) > m_storage.GetMaxRecordSize ()) {
+        ++m_stats.nEvicted;
+
+        return;
+    }
+
+    const uint8_t nThreads = tid == otherTID ? 1 : 2;
+    while (!Enqueue (event, { timeStamp, nullptr, tid, otherTID, nThreads, true, Decision::Undecided })) {
+        ++m_stats.nEvicted;
+        DiscardOldest ();
+    }
+
+    const uint64_t sequenceNumber = m_firstSequenceNumber + m_queue.size () - 1;
+    m_heldEvents[tid].push_back (sequenceNumber);
+    if (otherTID != tid)
+        m_heldEvents[otherTID].push_back (sequenceNumber);
+}
+
+void ReorderWindow::Release (DWORD tid, int64_t startTimeStamp)
+{
+    Decide (tid, startTimeStamp, true);
+}
+
+void ReorderWindow::Reject (DWORD tid, int64_t startTimeStamp)
+{
+    Decide (tid, startTimeStamp, false);
+}
+
+void ReorderWindow::Flush ()
+{
+    // Nothing can claim the events still held
+    while (!m_queue.empty ()) {
+        ++m_stats.nExpired;
+        DiscardOldest ();
+    }
+}
+
+ReorderWindow::Stats ReorderWindow::GetStats () const
+{
+    return m_stats;
+}
+
+bool ReorderWindow::Enqueue (const EventView& event, const QueuedEvent& queuedEvent)
+{
+    void* pStored = m_storage.BeginWrite (GetStoredEventSize (event));
+    if (pStored == nullptr)
+        return false;
+
+    StoreEvent (event, pStored);
+    m_storage.EndWrite ();
+
+    m_queue.push_back (queuedEvent);
+    m_queue.back ().pStored = pStored;
+
+    m_stats.highWaterMark = m_storage.GetHighWaterMark ();
+
+    return true;
+}
+
+void ReorderWindow::Decide (DWORD tid, int64_t startTimeStamp, bool keep)
+{
+    const auto it = m_heldEvents.find (tid);
+    if (it == m_heldEvents.end ())
+        return;
+
+    // Events before the start stay held, they belong to an earlier thread with the same ID
+    std::erase_if (it->second, [&] (uint64_t sequenceNumber) {
+        if (sequenceNumber < m_firstSequenceNumber)
+            return true;    // Written or discarded already
+
+        QueuedEvent& heldEvent = m_queue[sequenceNumber - m_firstSequenceNumber];
+        if (heldEvent.decision != Decision::Undecided)
+            return true;    // Through its other thread
+
+        if (heldEvent.timeStamp < startTimeStamp)
+            return false;
+
+        if (keep) {
+            heldEvent.decision = Decision::Keep;
+        } else if (--heldEvent.nUndecidedThreads == 0) {
+            heldEvent.decision = Decision::Drop;
+            ++m_stats.nRejected;
+        }
+
+        return true;
+    });
+
+    if (it->second.empty ())
+        m_heldEvents.erase (it);
+
+    WriteDecided ();
+}
+
+void ReorderWindow::Expire (int64_t timeStamp)
+{
+    // The front of the queue is always held (decided events before it are written right away)
+    while (!m_queue.empty () && m_queue.front ().timeStamp + m_windowTicks < timeStamp) {
+        ++m_stats.nExpired;
+        DiscardOldest ();
+    }
+}
+
+void ReorderWindow::DiscardOldest ()
+{
+    ETWP_ASSERT (m_queue.front ().held && m_queue.front ().decision == Decision::Undecided);
+
+    m_queue.front ().decision = Decision::Drop;
+    WriteDecided ();
+}
+
+void ReorderWindow::ForgetOldest (DWORD tid)
+{
+    const auto it = m_heldEvents.find (tid);
+    if (it == m_heldEvents.end ())
+        return;
+
+    // Sequence numbers are in ascending order, the ones not bigger than the oldest one are gone
+    std::vector<uint64_t>& sequenceNumbers = it->second;
+    sequenceNumbers.erase (sequenceNumbers.begin (),
+                           std::upper_bound (sequenceNumbers.begin (), sequenceNumbers.end (), m_firstSequenceNumber));
+    if (sequenceNumbers.empty ())
+        m_heldEvents.erase (it);
+}
+
+void ReorderWindow::WriteDecided ()
+{
+    while (!m_queue.empty () && m_queue.front ().decision != Decision::Undecided) {
+        const QueuedEvent& queuedEvent = m_queue.front ();
+        if (queuedEvent.decision == Decision::Keep) {
+            EventRecordLayout record;
+            const EventView event = LoadStoredEvent (queuedEvent.pStored, &record, &m_extendedData);
+            if (queuedEvent.held) {
+                ++m_stats.nRecovered;
+                if (m_pFilterStats != nullptr)
+                    m_pFilterStats->CountRecovered (event);
+
+                if (m_pProgress != nullptr)
+                    m_pProgress->AddRecoveredEvent ();
+            }
+
+            m_pSink->WriteEvent (event);
+        }
+
+        if (queuedEvent.held) {
+            ForgetOldest (queuedEvent.tid);
+            if (queuedEvent.otherTID != queuedEvent.tid)
+                ForgetOldest (queuedEvent.otherTID);
+        }
+
+        size_t size;
+        [[maybe_unused]] const void* pStored = m_storage.BeginRead (&size);
+        ETWP_ASSERT (pStored == queuedEvent.pStored);
+
+        m_storage.EndRead ();
+        m_queue.pop_front ();
+        ++m_firstSequenceNumber;
+    }
+}
+
+}   // namespace ETWP
\ No newline at end of file
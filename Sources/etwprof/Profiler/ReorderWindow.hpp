@@ -0,0 +1,119 @@
+#ifndef ETWP_REORDER_WINDOW_HPP
+#define ETWP_REORDER_WINDOW_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "EventRingBuffer.hpp"
+#include "RelogPipeline.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+class FilterStats;
+class ProgressCounters;
+
+struct ReorderWindowConfig {
+    uint32_t window = 0;                    // In milliseconds. 0 means events of unknown threads are dropped at once
+    size_t   maxMemory = 8 * 1'024 * 1'024; // In bytes
+
+    bool IsEnabled () const;
+};
+
+// Events of a new thread sometimes arrive before the start event of the thread (e.g. they were logged on another
+//   processor), so the per-event filter does not know yet whether the thread belongs to a target. Such events (that
+//   refer to threads by ID only, e.g. SampledProfile and CSwitch events) are held back here for a while, instead of
+//   dropping them at once. Threads of other processes are known from their start (or rundown) events, so only events
+//   of threads not seen yet are held (see ProfileFilterData::otherThreads).
+// Kept events pass through here, too (see WriteEvent): while an event is held, the events after it are queued behind
+//   it, so nothing is reordered (events of a CPU stay in chronological order, and stacks follow their events). When
+//   the start event of the thread arrives, its held events are kept (if it's a target thread) or discarded, and the
+//   queue is written up to the next event still held. Events not claimed within the window are discarded.
+// Memory usage is limited: when the limit is reached, the oldest held events are discarded early.
+// Events that cannot be written are counted by the sink. Not thread safe: all functions must be called from the same
+//   thread
+class ReorderWindow final : public IEventSink {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (ReorderWindow);
+
+    struct Stats {
+        uint64_t nHeld;
+        uint64_t nRecovered;        // Written, because the start event of their (target) thread arrived in the window
+        uint64_t nRejected;         // Discarded, because their thread turned out to be of another process
+        uint64_t nExpired;          // Discarded, because no thread claimed them within the window
+        uint64_t nEvicted;          // Discarded before the window elapsed, to stay within the memory limit
+        uint64_t nQueued;           // Kept events queued behind held ones
+        size_t   highWaterMark;     // In bytes
+    };
+
+    // perfFreq is the frequency of event timestamps
+    ReorderWindow (IEventSink* pSink, const ReorderWindowConfig& config, int64_t perfFreq);
+
+    // Held events are counted as dropped by the per-event filter, recovered ones are counted as kept in these (if set)
+    void SetCounters (FilterStats* pFilterStats, ProgressCounters* pProgress);
+
+    // An event kept by the per-event filter: written at once, unless events before it are held
+    virtual bool WriteEvent (const EventView& event) override;
+
+    // The event refers to these threads (both IDs might be the same), which might be new threads of a target. Held
+    //   events that are older than the window (relative to this event) are discarded
+    void Hold (const EventView& event, DWORD tid, DWORD otherTID);
+
+    // A target thread started (at startTimeStamp): its held events from that point on are kept. Events before that
+    //   belong to an earlier thread with the same ID
+    void Release (DWORD tid, int64_t startTimeStamp);
+
+    // Same, but the thread is of another process: its held events from that point on are discarded (unless they refer
+    //   to another thread, which is still unknown)
+    void Reject (DWORD tid, int64_t startTimeStamp);
+
+    void Flush ();  // Discards everything held, and writes the events queued behind them. Call after the last event
+
+    Stats GetStats () const;
+
+private:
+    enum class Decision : uint8_t {
+        Undecided,
+        Keep,
+        Drop
+    };
+
+    struct QueuedEvent {
+        int64_t     timeStamp;
+        const void* pStored;            // In m_storage
+        DWORD       tid;                // Held events only
+        DWORD       otherTID;           // Held events only
+        uint8_t     nUndecidedThreads;  // Held events only. Discarded when none of their threads can be a target
+        bool        held;
+        Decision    decision;
+    };
+
+    IEventSink*                                      m_pSink;
+    FilterStats*                                     m_pFilterStats;
+    ProgressCounters*                                m_pProgress;
+    int64_t                                          m_windowTicks;
+    EventRingBuffer                                  m_storage;      // Used by this thread only, as a FIFO
+    std::deque<QueuedEvent>                          m_queue;        // In the order of m_storage
+    uint64_t                                         m_firstSequenceNumber;  // Of the front of m_queue
+    std::unordered_map<DWORD, std::vector<uint64_t>> m_heldEvents;   // Their sequence numbers, by thread ID
+    std::vector<EventExtendedItemLayout>             m_extendedData; // Reused by WriteDecided
+    Stats                                            m_stats;
+
+    bool Enqueue (const EventView& event, const QueuedEvent& queuedEvent);   // Returns false if there is no room
+    void Decide (DWORD tid, int64_t startTimeStamp, bool keep);
+    void Expire (int64_t timeStamp);
+    void DiscardOldest ();
+    void ForgetOldest (DWORD tid);
+    void WriteDecided ();
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_REORDER_WINDOW_HPP
\ No newline at end of file
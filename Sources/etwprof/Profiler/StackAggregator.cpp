@@ -0,0 +1,556 @@
+#include "StackAggregator.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+
+#include "OS/ETW/ETWConstants.hpp"
+#include "OS/Utility/Address.hpp"
+#include "OS/Utility/Time.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+namespace {
+
+constexpr int64_t kUnixEpochInFileTime = 116'444'736'000'000'000;
+
+// Node memory is bounded with the worst case in mind: a vector that just doubled its capacity, and a hash table that
+//   just doubled its size (kept at most half full)
+constexpr uint64_t kMaxBytesPerNode = 2 * 24 + 4 * sizeof (uint32_t);
+
+uint64_t HashNodeKey (uint32_t parent, uint64_t address)
+{
+    // Murmur3-like finalizer
+    uint64_t hash = address * 0x9e37'79b9'7f4a'7c15 ^ parent;
+    hash ^= hash >> 31;
+    hash *= 0xbf58'476d'1ce4'e5b9;
+    hash ^= hash >> 29;
+
+    return hash;
+}
+
+template<typename T>
+bool ReadAt (const EventView& event, size_t offset, T* pValueOut)
+{
+    if (offset + sizeof (T) > event.GetUserDataLength ())
+        return false;
+
+    std::memcpy (pValueOut, static_cast<const uint8_t*> (event.GetUserData ()) + offset, sizeof (T));
+
+    return true;
+}
+
+std::string ToUTF8 (const std::wstring& string)
+{
+    const std::u8string utf8String = std::filesystem::path (string).u8string ();
+
+    return std::string (utf8String.begin (), utf8String.end ());
+}
+
+// Symbol server key of the PDB (GUID and age), or of the image itself (timestamp and size), if it has no PDB info
+std::string GetBuildID (const PEImageIdentity& identity)
+{
+    char buffer[64];
+    if (identity.hasPDBInfo) {
+        const GUID& guid = identity.pdbGUID;
+        std::snprintf (buffer,
+                       sizeof buffer,
+                       "%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X%X",
+                       static_cast<unsigned> (guid.Data1),
+                       static_cast<unsigned> (guid.Data2),
+                       static_cast<unsigned> (guid.Data3),
+                       guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+                       guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7],
+                       static_cast<unsigned> (identity.pdbAge));
+    } else {
+        std::snprintf (buffer, sizeof buffer, "%08X%X", identity.timeDateStamp, identity.sizeOfImage);
+    }
+
+    return buffer;
+}
+
+// Writes a protobuf message, field by field (see https://protobuf.dev/programming-guides/encoding)
+class ProtobufWriter final {
+public:
+    void WriteUInt (uint32_t field, uint64_t value)
+    {
+        WriteTag (field, kVarint);
+        WriteVarint (value);
+    }
+
+    void WriteInt (uint32_t field, int64_t value)
+    {
+        WriteUInt (field, static_cast<uint64_t> (value));
+    }
+
+    void WriteBytes (uint32_t field, std::string_view bytes)
+    {
+        WriteTag (field, kLengthDelimited);
+        WriteVarint (bytes.size ());
+        m_bytes.append (bytes);
+    }
+
+    void WriteMessage (uint32_t field, const ProtobufWriter& message)
+    {
+        WriteBytes (field, message.GetBytes ());
+    }
+
+    void WritePacked (uint32_t field, const std::vector<uint64_t>& values)
+    {
+        ProtobufWriter packed;
+        for (uint64_t value : values)
+            packed.WriteVarint (value);
+
+        WriteBytes (field, packed.GetBytes ());
+    }
+
+    const std::string& GetBytes () const { return m_bytes; }
+
+private:
+    static constexpr uint32_t kVarint = 0;
+    static constexpr uint32_t kLengthDelimited = 2;
+
+    std::string m_bytes;
+
+    void WriteTag (uint32_t field, uint32_t wireType)
+    {
+        WriteVarint (uint64_t (field) << 3 | wireType);
+    }
+
+    void WriteVarint (uint64_t value)
+    {
+        while (value >= 0x80) {
+            m_bytes.push_back (static_cast<char> (value | 0x80));
+            value >>= 7;
+        }
+
+        m_bytes.push_back (static_cast<char> (value));
+    }
+};
+
+// Field numbers of profile.proto (see https://github.com/google/pprof/blob/main/proto/profile.proto)
+namespace PProf {
+
+constexpr uint32_t kProfileSampleType = 1;
+constexpr uint32_t kProfileSample = 2;
+constexpr uint32_t kProfileMapping = 3;
+constexpr uint32_t kProfileLocation = 4;
+constexpr uint32_t kProfileStringTable = 6;
+constexpr uint32_t kProfileTimeNanos = 9;
+constexpr uint32_t kProfileDurationNanos = 10;
+constexpr uint32_t kProfilePeriodType = 11;
+constexpr uint32_t kProfilePeriod = 12;
+
+constexpr uint32_t kValueTypeType = 1;
+constexpr uint32_t kValueTypeUnit = 2;
+
+constexpr uint32_t kSampleLocationID = 1;
+constexpr uint32_t kSampleValue = 2;
+constexpr uint32_t kSampleLabel = 3;
+
+constexpr uint32_t kLabelKey = 1;
+constexpr uint32_t kLabelNum = 3;
+
+constexpr uint32_t kMappingID = 1;
+constexpr uint32_t kMappingMemoryStart = 2;
+constexpr uint32_t kMappingMemoryLimit = 3;
+constexpr uint32_t kMappingFilename = 5;
+constexpr uint32_t kMappingBuildID = 6;
+
+constexpr uint32_t kLocationID = 1;
+constexpr uint32_t kLocationMappingID = 2;
+constexpr uint32_t kLocationAddress = 3;
+
+}   // namespace PProf
+
+class StringTable final {
+public:
+    StringTable ()
+    {
+        Intern ({});    // The first string must be the empty one
+    }
+
+    int64_t Intern (const std::string& string)
+    {
+        const auto [it, inserted] = m_indices.try_emplace (string, int64_t (m_strings.size ()));
+        if (inserted)
+            m_strings.push_back (string);
+
+        return it->second;
+    }
+
+    void Write (ProtobufWriter* pWriter) const
+    {
+        for (const std::string& string : m_strings)
+            pWriter->WriteBytes (PProf::kProfileStringTable, string);
+    }
+
+private:
+    std::unordered_map<std::string, int64_t> m_indices;
+    std::vector<std::string>                 m_strings;
+};
+
+ProtobufWriter MakeValueType (StringTable* pStrings, const std::string& type, const std::string& unit)
+{
+    ProtobufWriter valueType;
+    valueType.WriteInt (PProf::kValueTypeType, pStrings->Intern (type));
+    valueType.WriteInt (PProf::kValueTypeUnit, pStrings->Intern (unit));
+
+    return valueType;
+}
+
+}   // namespace
+
+bool StackAggregatorConfig::IsEnabled () const
+{
+    return maxMemory != 0;
+}
+
+StackAggregator::StackAggregator (const StackAggregatorConfig& config,
+                                  ImageIdentityResolver* pResolver /*= nullptr*/):
+    m_config (config),
+    m_pResolver (pResolver),
+    m_maxNodes (std::max<uint64_t> (config.maxMemory / kMaxBytesPerNode, 1)),
+    m_nodes (),
+    m_slots (),
+    m_pendingSamples (),
+    m_images (),
+    m_imagesSize (0),
+    m_firstTimeStamp (0),
+    m_lastTimeStamp (0),
+    m_stats ()
+{
+    static_assert (sizeof (Node) == 24);
+
+    Rehash (16);
+}
+
+bool StackAggregator::WriteEvent (const EventView& event)
+{
+    if (m_firstTimeStamp == 0)
+        m_firstTimeStamp = event.GetTimestamp ();
+
+    m_lastTimeStamp = std::max (m_lastTimeStamp, event.GetTimestamp ());
+
+    const GUID& providerID = event.GetProviderID ();
+    const UCHAR opcode = event.GetOpcode ();
+    if (providerID == PerfInfoGuid && opcode == ETWConstants::SampledProfileOpcode) {
+        AddSample (event);
+    } else if (providerID == StackWalkGuid && opcode == ETWConstants::StackWalkOpcode) {
+        AddStack (event);
+    } else if (providerID == ImageLoadGuid &&
+               (opcode == ETWConstants::ImageLoadOpcode || opcode == ETWConstants::ImageDCStartOpcode))
+    {
+        AddImage (event);
+    } else if (providerID == ThreadGuid && opcode == ETWConstants::TEndOpcode) {
+        // No more stacks will arrive for the thread
+        DWORD tid;
+        if (ReadAt (event, offsetof (ETWConstants::ThreadDataStub, m_threadID), &tid))
+            CountPendingSample (tid);
+    }
+
+    return true;
+}
+
+std::string StackAggregator::SerializeProfile ()
+{
+    CountPendingSamples ();
+
+    StringTable strings;
+    ProtobufWriter profile;
+
+    profile.WriteMessage (PProf::kProfileSampleType, MakeValueType (&strings, "samples", "count"));
+    if (m_config.samplingInterval != 0) {
+        profile.WriteMessage (PProf::kProfileSampleType, MakeValueType (&strings, "cpu", "nanoseconds"));
+        profile.WriteMessage (PProf::kProfilePeriodType, MakeValueType (&strings, "cpu", "nanoseconds"));
+        profile.WriteInt (PProf::kProfilePeriod, int64_t (m_config.samplingInterval));
+    }
+
+    // Mappings: every image seen (including unloaded ones, samples might refer to them)
+    std::map<ImageKey, uint64_t> mappingIDs;
+    for (const auto& [key, image] : m_images) {
+        const uint64_t mappingID = mappingIDs.size () + 1;
+        mappingIDs.emplace (key, mappingID);
+
+        const PEImageIdentity* pIdentity = m_pResolver != nullptr ? m_pResolver->Get (image.path) : nullptr;
+        const std::string buildID = pIdentity != nullptr ?
+                                    GetBuildID (*pIdentity) :
+                                    GetBuildID ({ image.timeDateStamp, uint32_t (image.size), 0, false, {}, 0, {} });
+
+        ProtobufWriter mapping;
+        mapping.WriteUInt (PProf::kMappingID, mappingID);
+        mapping.WriteUInt (PProf::kMappingMemoryStart, key.second);
+        mapping.WriteUInt (PProf::kMappingMemoryLimit, key.second + image.size);
+        mapping.WriteInt (PProf::kMappingFilename, strings.Intern (ToUTF8 (image.path)));
+        mapping.WriteInt (PProf::kMappingBuildID, strings.Intern (buildID));
+        profile.WriteMessage (PProf::kProfileMapping, mapping);
+    }
+
+    // Samples: one for each distinct stack, with the locations from the innermost frame outwards. Locations are
+    //   written along the way, kernel addresses are shared by all processes
+    const int64_t pidKey = strings.Intern ("pid");
+    std::map<std::pair<DWORD, uint64_t>, uint64_t> locationIDs;
+    std::vector<uint64_t> stackLocationIDs;
+    for (const Node& node : m_nodes) {
+        if (node.count == 0)
+            continue;
+
+        stackLocationIDs.clear ();
+        const Node* pFrame = &node;
+        for (; pFrame->parent != kNoNode; pFrame = &m_nodes[pFrame->parent])
+            stackLocationIDs.push_back (pFrame->address);
+
+        // Addresses are replaced by location IDs in place
+        const DWORD pid = static_cast<DWORD> (pFrame->address);
+        std::reverse (stackLocationIDs.begin (), stackLocationIDs.end ());
+        for (uint64_t& location : stackLocationIDs) {
+            const uint64_t address = location;
+            const DWORD locationPID = IsKernelModeAddress (static_cast<UINT_PTR> (address)) ? 0 : pid;
+            const auto [it, inserted] = locationIDs.try_emplace ({ locationPID, address }, locationIDs.size () + 1);
+            if (inserted) {
+                ProtobufWriter locationMessage;
+                locationMessage.WriteUInt (PProf::kLocationID, it->second);
+                if (const auto* pImage = FindImage (locationPID, static_cast<UINT_PTR> (address)); pImage != nullptr)
+                    locationMessage.WriteUInt (PProf::kLocationMappingID, mappingIDs.at (pImage->first));
+
+                locationMessage.WriteUInt (PProf::kLocationAddress, address);
+                profile.WriteMessage (PProf::kProfileLocation, locationMessage);
+            }
+
+            location = it->second;
+        }
+
+        std::vector<uint64_t> values = { node.count };
+        if (m_config.samplingInterval != 0)
+            values.push_back (node.count * m_config.samplingInterval);
+
+        ProtobufWriter label;
+        label.WriteInt (PProf::kLabelKey, pidKey);
+        label.WriteInt (PProf::kLabelNum, pid);
+
+        ProtobufWriter sample;
+        sample.WritePacked (PProf::kSampleLocationID, stackLocationIDs);
+        sample.WritePacked (PProf::kSampleValue, values);
+        sample.WriteMessage (PProf::kSampleLabel, label);
+        profile.WriteMessage (PProf::kProfileSample, sample);
+    }
+
+    if (m_config.startSystemTime != 0)
+        profile.WriteInt (PProf::kProfileTimeNanos, (m_config.startSystemTime - kUnixEpochInFileTime) * 100);
+
+    const int64_t startTimeStamp = m_config.startTimeStamp != 0 ? m_config.startTimeStamp : m_firstTimeStamp;
+    if (m_lastTimeStamp > startTimeStamp && m_config.perfFreq != 0) {
+        profile.WriteInt (PProf::kProfileDurationNanos,
+                          ConvertTicks (m_lastTimeStamp - startTimeStamp, m_config.perfFreq, 1'000'000'000));
+    }
+
+    strings.Write (&profile);
+
+    return profile.GetBytes ();
+}
+
+bool StackAggregator::WriteProfile (const std::filesystem::path& path, std::wstring* pErrorOut)
+{
+    const std::string profile = SerializeProfile ();
+
+    std::ofstream file (path, std::ios::binary | std::ios::trunc);
+    file.write (profile.data (), profile.size ());
+    file.close ();
+    if (!file) {
+        *pErrorOut = L"Unable to write profile file: " + path.wstring ();
+
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t StackAggregator::GetMemoryUsage () const
+{
+    return m_nodes.capacity () * sizeof (Node) +
+           m_slots.capacity () * sizeof (uint32_t) +
+           m_pendingSamples.size () * (sizeof (DWORD) + sizeof (PendingSample) + 2 * sizeof (void*)) +
+           m_imagesSize;
+}
+
+StackAggregator::Stats StackAggregator::GetStats () const
+{
+    Stats stats = m_stats;
+    stats.nNodes = m_nodes.size ();
+    stats.nImages = m_images.size ();
+    stats.memoryUsage = GetMemoryUsage ();
+
+    return stats;
+}
+
+void StackAggregator::AddSample (const EventView& event)
+{
+    const ETWConstants::SampledProfileDataStub* pData =
+        static_cast<const ETWConstants::SampledProfileDataStub*> (event.GetUserData ());
+    if (event.GetUserDataLength () < sizeof (ETWConstants::SampledProfileDataStub))
+        return;
+
+    // The previous sample of the thread has all of its stack by now
+    CountPendingSample (pData->m_threadID);
+
+    m_pendingSamples[pData->m_threadID] = { event.GetTimestamp (), event.GetProcessID (), pData->m_ip, kNoNode, false };
+    ++m_stats.nSamples;
+}
+
+void StackAggregator::AddStack (const EventView& event)
+{
+    if (event.GetUserDataLength () < sizeof (ETWConstants::StackWalkDataStub))
+        return;
+
+    const ETWConstants::StackWalkDataStub* pData =
+        static_cast<const ETWConstants::StackWalkDataStub*> (event.GetUserData ());
+
+    // Stacks of other events (e.g. context switches), or of a sample that is counted already
+    const auto it = m_pendingSamples.find (pData->m_threadID);
+    if (it == m_pendingSamples.end () || it->second.timeStamp != int64_t (pData->m_timeStamp))
+        return;
+
+    PendingSample& sample = it->second;
+    if (sample.node == kNoNode) {
+        sample.pid = pData->m_processID;    // More reliable than the event header
+        sample.node = InternRoot (sample.pid);
+        ++m_stats.nSamplesWithStack;
+    }
+
+    const size_t nFrames = (event.GetUserDataLength () - sizeof (ETWConstants::StackWalkDataStub)) / sizeof (UINT_PTR);
+    for (size_t i = 0; i < nFrames && !sample.truncated; ++i) {
+        UINT_PTR address = 0;
+        ReadAt (event, sizeof (ETWConstants::StackWalkDataStub) + i * sizeof (UINT_PTR), &address);
+
+        const uint32_t node = Intern (sample.node, address);
+        if (node == kNoNode)
+            sample.truncated = true;
+        else
+            sample.node = node;
+    }
+}
+
+void StackAggregator::AddImage (const EventView& event)
+{
+    const ETWConstants::ImageLoadDataStub* pData =
+        static_cast<const ETWConstants::ImageLoadDataStub*> (event.GetUserData ());
+    if (event.GetUserDataLength () < sizeof (ETWConstants::ImageLoadDataStub))
+        return;
+
+    // ImageBase, ImageSize, ProcessId, ImageCheckSum, TimeDateStamp, ...
+    uint32_t timeDateStamp = 0;
+    ReadAt (event, 2 * sizeof (UINT_PTR) + 2 * sizeof (DWORD), &timeDateStamp);
+
+    const DWORD pid = IsKernelModeAddress (pData->m_imageBase) ? 0 : pData->m_processID;
+    Image image = { pData->m_imageSize, timeDateStamp, ETWConstants::GetImageFileName (event) };
+
+    const size_t imageSize = sizeof (ImageKey) + sizeof (Image) + 4 * sizeof (void*) +
+                             image.path.capacity () * sizeof (wchar_t);
+    const auto [it, inserted] = m_images.insert_or_assign ({ pid, pData->m_imageBase }, std::move (image));
+    if (inserted)
+        m_imagesSize += imageSize;
+
+    UpdateMemoryStats ();
+}
+
+void StackAggregator::CountPendingSample (DWORD tid)
+{
+    const auto it = m_pendingSamples.find (tid);
+    if (it == m_pendingSamples.end ())
+        return;
+
+    PendingSample& sample = it->second;
+    if (sample.node == kNoNode) {
+        // No stack arrived, the sample stands for the instruction pointer alone
+        sample.node = Intern (InternRoot (sample.pid), sample.ip);
+        if (sample.node == kNoNode) {
+            sample.node = InternRoot (sample.pid);
+            sample.truncated = true;
+        }
+    }
+
+    if (m_nodes[sample.node].count++ == 0)
+        ++m_stats.nStacks;
+
+    if (sample.truncated)
+        ++m_stats.nTruncatedSamples;
+
+    m_pendingSamples.erase (it);
+}
+
+void StackAggregator::CountPendingSamples ()
+{
+    while (!m_pendingSamples.empty ())
+        CountPendingSample (m_pendingSamples.begin ()->first);
+}
+
+uint32_t StackAggregator::Intern (uint32_t parent, uint64_t address)
+{
+    const size_t mask = m_slots.size () - 1;
+    size_t slot = HashNodeKey (parent, address) & mask;
+    for (; m_slots[slot] != 0; slot = (slot + 1) & mask) {
+        const uint32_t index = m_slots[slot] - 1;
+        if (m_nodes[index].parent == parent && m_nodes[index].address == address)
+            return index;
+    }
+
+    if (parent != kNoNode && m_nodes.size () >= m_maxNodes)
+        return kNoNode;
+
+    const uint32_t index = static_cast<uint32_t> (m_nodes.size ());
+    m_nodes.push_back ({ address, 0, parent });
+    m_slots[slot] = index + 1;
+
+    if (m_nodes.size () * 2 > m_slots.size ())
+        Rehash (m_slots.size () * 2);
+
+    UpdateMemoryStats ();
+
+    return index;
+}
+
+uint32_t StackAggregator::InternRoot (DWORD pid)
+{
+    return Intern (kNoNode, pid);
+}
+
+void StackAggregator::Rehash (size_t nSlots)
+{
+    ETWP_ASSERT (std::has_single_bit (nSlots));
+
+    m_slots.assign (nSlots, 0);
+    const size_t mask = nSlots - 1;
+    for (uint32_t index = 0; index < m_nodes.size (); ++index) {
+        size_t slot = HashNodeKey (m_nodes[index].parent, m_nodes[index].address) & mask;
+        while (m_slots[slot] != 0)
+            slot = (slot + 1) & mask;
+
+        m_slots[slot] = index + 1;
+    }
+}
+
+void StackAggregator::UpdateMemoryStats ()
+{
+    m_stats.memoryHighWaterMark = std::max (m_stats.memoryHighWaterMark, GetMemoryUsage ());
+}
+
+const std::pair<const StackAggregator::ImageKey, StackAggregator::Image>*
+StackAggregator::FindImage (DWORD pid, UINT_PTR address) const
+{
+    auto it = m_images.upper_bound ({ pid, address });
+    if (it == m_images.begin ())
+        return nullptr;
+
+    --it;
+    if (it->first.first != pid || address >= it->first.second + it->second.size)
+        return nullptr;
+
+    return &*it;
+}
+
+}   // namespace ETWP
\ No newline at end of file
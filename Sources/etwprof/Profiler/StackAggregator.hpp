@@ -0,0 +1,122 @@
+#ifndef ETWP_STACK_AGGREGATOR_HPP
+#define ETWP_STACK_AGGREGATOR_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ImageIdentity.hpp"
+#include "RelogPipeline.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+struct StackAggregatorConfig {
+    uint64_t maxMemory = 0;         // In bytes, 0 means aggregation is disabled (events are written instead)
+    int64_t  perfFreq = 10'000'000;
+    int64_t  startTimeStamp = 0;    // QPC value at...
+    int64_t  startSystemTime = 0;   // ...this point in time (FILETIME)
+    uint64_t samplingInterval = 0;  // In nanoseconds, 0 if unknown
+
+    bool IsEnabled () const;
+};
+
+// Aggregates samples into a stack-count profile, instead of keeping events: each SampledProfile event is joined with
+//   its StackWalk event(s) (by thread and timestamp), and its call stack is interned into a hash-consed tree (one node
+//   for each distinct (parent, address) pair). The tree is rooted at the processes, and goes from the innermost frame
+//   outwards (the kernel part of a stack arrives before the user part), so the node of the outermost frame counts how
+//   many times the stack was sampled. Memory use is proportional to the number of distinct stacks, not to the
+//   duration of the session, and it's bounded by maxMemory: once it's reached, stacks that would need new nodes are
+//   truncated (counted with their innermost frames that are in the tree already).
+// Image load (and rundown) events are collected, too, so the profile has the module map needed for symbolization.
+// The profile is written in pprof format (an uncompressed profile.proto message). If an image identity resolver is
+//   given, mappings have the PDB signature (GUID and age) of the images as build ID.
+// Not thread safe
+class StackAggregator final : public IEventSink {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (StackAggregator);
+
+    struct Stats {
+        uint64_t nSamples;
+        uint64_t nSamplesWithStack;
+        uint64_t nTruncatedSamples;     // Their stacks did not fit into the memory budget
+        uint64_t nStacks;               // Distinct stacks sampled
+        uint64_t nNodes;
+        uint64_t nImages;
+        uint64_t memoryUsage;           // In bytes
+        uint64_t memoryHighWaterMark;   // In bytes
+    };
+
+    explicit StackAggregator (const StackAggregatorConfig& config, ImageIdentityResolver* pResolver = nullptr);
+
+    virtual bool WriteEvent (const EventView& event) override;
+
+    // Counts the samples still waiting for their stacks, so call it after the last event only
+    std::string SerializeProfile ();
+    bool        WriteProfile (const std::filesystem::path& path, std::wstring* pErrorOut);
+
+    uint64_t GetMemoryUsage () const;
+    Stats    GetStats () const;
+
+private:
+    static constexpr uint32_t kNoNode = UINT32_MAX;
+
+    struct Node {
+        uint64_t address;   // For process roots, the process ID
+        uint64_t count;     // Samples with this node as their outermost frame
+        uint32_t parent;    // kNoNode for process roots
+    };
+
+    // A sample waiting for its StackWalk event(s)
+    struct PendingSample {
+        int64_t  timeStamp;
+        DWORD    pid;
+        UINT_PTR ip;
+        uint32_t node;      // The outermost frame of the stack so far, kNoNode if no stack has arrived yet
+        bool     truncated;
+    };
+
+    struct Image {
+        UINT_PTR     size;
+        uint32_t     timeDateStamp;
+        std::wstring path;
+    };
+
+    using ImageKey = std::pair<DWORD, UINT_PTR>;    // Process ID (0 for kernel images) and image base
+
+    StackAggregatorConfig                     m_config;
+    ImageIdentityResolver*                    m_pResolver;
+    uint64_t                                  m_maxNodes;
+    std::vector<Node>                         m_nodes;
+    std::vector<uint32_t>                     m_slots;    // Open addressing hash table of node indices (+ 1)
+    std::unordered_map<DWORD, PendingSample>  m_pendingSamples;     // By thread ID
+    std::map<ImageKey, Image>                 m_images;
+    uint64_t                                  m_imagesSize;         // Approximate memory used by m_images
+    int64_t                                   m_firstTimeStamp;
+    int64_t                                   m_lastTimeStamp;
+    Stats                                     m_stats;
+
+    void     AddSample (const EventView& event);
+    void     AddStack (const EventView& event);
+    void     AddImage (const EventView& event);
+    void     CountPendingSample (DWORD tid);
+    void     CountPendingSamples ();
+    uint32_t Intern (uint32_t parent, uint64_t address);    // Returns kNoNode, if there is no memory left
+    uint32_t InternRoot (DWORD pid);                        // Roots are always added
+    void     Rehash (size_t nSlots);
+    void     UpdateMemoryStats ();
+
+    const std::pair<const ImageKey, Image>* FindImage (DWORD pid, UINT_PTR address) const;
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_STACK_AGGREGATOR_HPP
\ No newline at end of file
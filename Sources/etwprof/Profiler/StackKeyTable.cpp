@@ -0,0 +1,246 @@
+#include "StackKeyTable.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace ETWP {
+
+StackKeyTable::StackKeyTable (): StackKeyTable (kDefaultMaxMemory)
+{
+}
+
+StackKeyTable::StackKeyTable (size_t maxMemory):
+    m_slots (kInitialCapacity),
+    m_maxCapacity (std::max (std::bit_floor (maxMemory / sizeof (Slot)), kInitialCapacity)),
+    m_shift (64 - std::countr_zero (kInitialCapacity)),
+    m_size (0),
+    m_hasZeroKey (false),
+    m_zeroKeyGeneration (0),
+    m_generation (0),
+    m_nAddedInGeneration (0),
+    m_stats ()
+{
+}
+
+void StackKeyTable::Reference (Key key)
+{
+    ++m_stats.nReferences;
+
+    if (key == 0) [[unlikely]] {
+        m_hasZeroKey = true;
+        m_zeroKeyGeneration = m_generation;
+
+        return;
+    }
+
+    const size_t index = FindIndex (key);
+    if (index != m_slots.size ()) {
+        m_slots[index].generation = m_generation;
+
+        return;
+    }
+
+    if (IsFull ()) {
+        if (m_slots.size () < m_maxCapacity)
+            Grow ();
+        else
+            EvictOldest ();
+    }
+
+    InsertNew (key, m_generation);
+    m_stats.highWaterMark = std::max (m_stats.highWaterMark, m_size);
+
+    if (++m_nAddedInGeneration >= m_slots.size () / kGenerationFraction) {
+        ++m_generation;
+        m_nAddedInGeneration = 0;
+    }
+}
+
+bool StackKeyTable::Remove (Key key)
+{
+    if (key == 0) [[unlikely]] {
+        if (!m_hasZeroKey) {
+            ++m_stats.nMisses;
+
+            return false;
+        }
+
+        m_hasZeroKey = false;
+        ++m_stats.nRemoved;
+
+        return true;
+    }
+
+    const size_t index = FindIndex (key);
+    if (index == m_slots.size ()) {
+        ++m_stats.nMisses;
+
+        return false;
+    }
+
+    EraseAt (index);
+    ++m_stats.nRemoved;
+
+    return true;
+}
+
+size_t StackKeyTable::GetSize () const
+{
+    return m_size + (m_hasZeroKey ? 1 : 0);
+}
+
+size_t StackKeyTable::GetCapacity () const
+{
+    return m_slots.size ();
+}
+
+size_t StackKeyTable::GetMemoryUsage () const
+{
+    return m_slots.capacity () * sizeof (Slot);
+}
+
+StackKeyTable::Stats StackKeyTable::GetStats () const
+{
+    return m_stats;
+}
+
+void StackKeyTable::Clear ()
+{
+    std::fill (m_slots.begin (), m_slots.end (), Slot {});
+    m_size = 0;
+    m_hasZeroKey = false;
+}
+
+bool StackKeyTable::IsFull () const
+{
+    return (m_size + 1) * 4 > m_slots.size () * 3;   // Linear probing degrades quickly above 75% load
+}
+
+void StackKeyTable::InsertNew (Key key, uint32_t generation)
+{
+    const size_t mask = m_slots.size () - 1;
+    size_t i = GetHomeIndex (key);
+    while (m_slots[i].key != 0)
+        i = (i + 1) & mask;
+
+    m_slots[i] = { key, generation };
+    ++m_size;
+}
+
+// Backward shift deletion: keys after the erased one are moved back, if their probe sequence went through its slot.
+//   This way, there is no need for tombstones
+void StackKeyTable::EraseAt (size_t index)
+{
+    const size_t mask = m_slots.size () - 1;
+    size_t hole = index;
+    for (size_t i = (index + 1) & mask; m_slots[i].key != 0; i = (i + 1) & mask) {
+        const size_t home = GetHomeIndex (m_slots[i].key);
+        const bool reachable = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!reachable) {
+            m_slots[hole] = m_slots[i];
+            hole = i;
+        }
+    }
+
+    m_slots[hole] = {};
+    --m_size;
+}
+
+void StackKeyTable::Grow ()
+{
+    std::vector<Slot> oldSlots (m_slots.size () * 2);
+    oldSlots.swap (m_slots);
+    --m_shift;
+    m_size = 0;
+
+    for (const Slot& slot : oldSlots) {
+        if (slot.key != 0)
+            InsertNew (slot.key, slot.generation);
+    }
+}
+
+// Evicts (at least) a quarter of the keys, the least recently referenced ones first
+void StackKeyTable::EvictOldest ()
+{
+    // Keys of the current generation are evicted last, so start a new one
+    ++m_generation;
+    m_nAddedInGeneration = 0;
+
+    const auto getAge = [this] (uint32_t generation) { return std::min (m_generation - generation, kMaxAge); };
+
+    std::vector<size_t> nKeysPerAge (kMaxAge + 1);
+    for (const Slot& slot : m_slots) {
+        if (slot.key != 0)
+            ++nKeysPerAge[getAge (slot.generation)];
+    }
+
+    if (m_hasZeroKey)
+        ++nKeysPerAge[getAge (m_zeroKeyGeneration)];
+
+    // Keys older than the cutoff age are all evicted, keys of the cutoff age only until the target is reached
+    const size_t target = std::max<size_t> (GetSize () / 4, 1);
+    uint32_t cutoffAge = kMaxAge;
+    size_t nOlder = 0;
+    while (cutoffAge > 0 && nOlder + nKeysPerAge[cutoffAge] < target)
+        nOlder += nKeysPerAge[cutoffAge--];
+
+    size_t nCutoffAgeToEvict = target - nOlder;
+    const auto shouldEvict = [&] (uint32_t generation) {
+        const uint32_t age = getAge (generation);
+        if (age > cutoffAge)
+            return true;
+
+        if (age < cutoffAge || nCutoffAgeToEvict == 0)
+            return false;
+
+        --nCutoffAgeToEvict;
+
+        return true;
+    };
+
+    if (m_hasZeroKey && shouldEvict (m_zeroKeyGeneration)) {
+        m_hasZeroKey = false;
+        ++m_stats.nEvicted;
+    }
+
+    size_t nEvicted = 0;
+    for (Slot& slot : m_slots) {
+        if (slot.key != 0 && shouldEvict (slot.generation)) {
+            slot = {};
+            ++nEvicted;
+        }
+    }
+
+    m_size -= nEvicted;
+    m_stats.nEvicted += nEvicted;
+    ++m_stats.nSweeps;
+
+    Reseat ();
+}
+
+// Keys are visited in probe order, starting after an empty slot, and each is moved to the first empty slot of its probe
+//   sequence (i.e. they are "reinserted" in the same order as they were inserted originally)
+void StackKeyTable::Reseat ()
+{
+    const size_t mask = m_slots.size () - 1;
+    size_t start = 0;
+    while (m_slots[start].key != 0)
+        ++start;
+
+    for (size_t n = 1; n < m_slots.size (); ++n) {
+        const size_t i = (start + n) & mask;
+        if (m_slots[i].key == 0)
+            continue;
+
+        for (size_t j = GetHomeIndex (m_slots[i].key); j != i; j = (j + 1) & mask) {
+            if (m_slots[j].key == 0) {
+                m_slots[j] = m_slots[i];
+                m_slots[i] = {};
+
+                break;
+            }
+        }
+    }
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef ETWP_STACK_KEY_TABLE_HPP
+#define ETWP_STACK_KEY_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ETWP {
+
+// Set of stack keys referenced by target processes, for filtering stack cache events (this class does not depend on
+//   Windows, so it can be benchmarked anywhere). A key is added when a target references it (StackKeyKernel/User
+//   events), and removed when its definition arrives (StackWalkKeyDelete/Rundown events).
+// If a definition is never seen (e.g. events were lost), its key would stay forever, so the table has a hard memory
+//   limit. Keys are stored in a single array (open addressing, linear probing, no per-key allocations), which grows up
+//   to the limit. Each key is tagged with the generation it was last referenced in (a new generation starts every
+//   kGenerationFraction-th of the capacity of newly added keys); when the table is full, the keys of the oldest
+//   generations are evicted, in place. Keys referenced since are kept, as they are likely to be defined later.
+// Not thread safe
+class StackKeyTable final {
+public:
+    using Key = uint64_t;
+
+    static constexpr size_t kDefaultMaxMemory = 16 * 1'024 * 1'024;
+
+    struct Stats {
+        uint64_t nReferences;   // Keys added or refreshed
+        uint64_t nRemoved;      // Definitions of keys in the table
+        uint64_t nMisses;       // Definitions of keys not in the table (of other processes, or evicted ones)
+        uint64_t nEvicted;      // Keys evicted to stay within the memory limit
+        uint64_t nSweeps;       // Number of times keys were evicted
+        size_t   highWaterMark; // In keys
+    };
+
+    StackKeyTable ();
+    explicit StackKeyTable (size_t maxMemory);  // In bytes. At least the initial capacity is allocated, though
+
+    void Reference (Key key);   // Adds the key, or moves it into the current generation
+    bool Remove (Key key);      // Returns false if the key was not present
+    bool Contains (Key key) const;
+
+    size_t GetSize () const;
+    size_t GetCapacity () const;
+    size_t GetMemoryUsage () const;     // Approximate number of bytes allocated by the table
+    Stats  GetStats () const;
+
+    void Clear ();  // Keeps the memory allocated, and the statistics
+
+private:
+    static constexpr size_t   kInitialCapacity = 1'024;
+    static constexpr size_t   kGenerationFraction = 8;
+    static constexpr uint32_t kMaxAge = 255;    // Older generations are treated alike by sweeps
+
+    // Key 0 marks empty slots (stack keys are never 0 in practice, but it's stored separately, just in case)
+    struct Slot {
+        Key      key;
+        uint32_t generation;
+    };
+
+    std::vector<Slot> m_slots;              // Capacity is a power of two
+    size_t            m_maxCapacity;
+    uint32_t          m_shift;              // For hashing (64 - log2 of the capacity)
+    size_t            m_size;
+    bool              m_hasZeroKey;
+    uint32_t          m_zeroKeyGeneration;
+    uint32_t          m_generation;
+    size_t            m_nAddedInGeneration;
+    Stats             m_stats;
+
+    size_t GetHomeIndex (Key key) const;
+    size_t FindIndex (Key key) const;   // Returns the capacity, if the key is not present
+    bool   IsFull () const;
+
+    void InsertNew (Key key, uint32_t generation);
+    void EraseAt (size_t index);
+    void Grow ();
+    void EvictOldest ();
+    void Reseat ();     // Moves keys back into their probe sequences, after slots were emptied (see EvictOldest)
+};
+
+inline size_t StackKeyTable::GetHomeIndex (Key key) const
+{
+    return static_cast<size_t> ((key * 0x9E37'79B9'7F4A'7C15ULL) >> m_shift);  // Fibonacci hashing
+}
+
+inline size_t StackKeyTable::FindIndex (Key key) const
+{
+    const size_t mask = m_slots.size () - 1;
+    for (size_t i = GetHomeIndex (key);; i = (i + 1) & mask) {
+        if (m_slots[i].key == key)
+            return i;
+
+        if (m_slots[i].key == 0)
+            return m_slots.size ();
+    }
+}
+
+inline bool StackKeyTable::Contains (Key key) const
+{
+    if (key == 0) [[unlikely]]
+        return m_hasZeroKey;
+
+    return FindIndex (key) != m_slots.size ();
+}
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_STACK_KEY_TABLE_HPP
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "StoredEvent.hpp"
+
+#include <cstring>
+
+namespace ETWP {
+
+namespace {
+
+constexpr size_t AlignSize (size_t size)
+{
+    return (size + kStoredEventAlignment - 1) & ~(kStoredEventAlignment - 1);
+}
+
+size_t GetExtendedItemsOffset (USHORT payloadSize)
+{
+    return sizeof (EventRecordLayout) + AlignSize (payloadSize);
+}
+
+}   // namespace
+
+size_t GetStoredEventSize (const EventView& event)
+{
+    const USHORT nExtendedItems = event.GetExtendedDataCount ();
+    const EventExtendedItemLayout* pExtendedItems = event.GetExtendedData ();
+
+    size_t size = GetExtendedItemsOffset (event.GetUserDataLength ()) +
+                  nExtendedItems * sizeof (EventExtendedItemLayout);
+    for (USHORT i = 0; i < nExtendedItems; ++i)
+        size += AlignSize (pExtendedItems[i].m_dataSize);
+
+    return size;
+}
+
+void StoreEvent (const EventView& event, void* pDestination)
+{
+    std::byte* pStored = static_cast<std::byte*> (pDestination);
+    const USHORT payloadSize = event.GetUserDataLength ();
+    const USHORT nExtendedItems = event.GetExtendedDataCount ();
+    const EventExtendedItemLayout* pExtendedItems = event.GetExtendedData ();
+
+    std::memcpy (pStored, &event.GetRecord (), sizeof (EventRecordLayout));
+    if (payloadSize > 0)
+        std::memcpy (pStored + sizeof (EventRecordLayout), event.GetUserData (), payloadSize);
+
+    const size_t itemsOffset = GetExtendedItemsOffset (payloadSize);
+    size_t dataOffset = itemsOffset + nExtendedItems * sizeof (EventExtendedItemLayout);
+    for (USHORT i = 0; i < nExtendedItems; ++i) {
+        EventExtendedItemLayout item = pExtendedItems[i];
+        std::memcpy (pStored + dataOffset, reinterpret_cast<const void*> (item.m_dataPtr), item.m_dataSize);
+        item.m_dataPtr = dataOffset;
+        std::memcpy (pStored + itemsOffset + i * sizeof item, &item, sizeof item);
+
+        dataOffset += AlignSize (item.m_dataSize);
+    }
+}
+
+EventView LoadStoredEvent (const void* pStored,
+                           EventRecordLayout* pRecordOut,
+                           std::vector<EventExtendedItemLayout>* pExtendedDataOut)
+{
+    const std::byte* pBase = static_cast<const std::byte*> (pStored);
+    std::memcpy (pRecordOut, pBase, sizeof (EventRecordLayout));
+    pRecordOut->m_pUserData = pBase + sizeof (EventRecordLayout);
+
+    pExtendedDataOut->resize (pRecordOut->m_extendedDataCount);
+    if (pRecordOut->m_extendedDataCount > 0) {
+        std::memcpy (pExtendedDataOut->data (),
+                     pBase + GetExtendedItemsOffset (pRecordOut->m_userDataLength),
+                     pExtendedDataOut->size () * sizeof (EventExtendedItemLayout));
+        for (EventExtendedItemLayout& item : *pExtendedDataOut)
+            item.m_dataPtr = reinterpret_cast<ULONGLONG> (pBase + item.m_dataPtr);
+
+        pRecordOut->m_pExtendedData = pExtendedDataOut->data ();
+    } else {
+        pRecordOut->m_pExtendedData = nullptr;
+    }
+
+    return EventView (*pRecordOut);
+}
+
+}   // namespace ETWP
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef ETWP_STORED_EVENT_HPP
+#define ETWP_STORED_EVENT_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "OS/ETW/EventView.hpp"
+
+namespace ETWP {
+
+// Flat copies of events (with their payload and extended data items), e.g. for queueing or recording them. Layout:
+//   EventRecordLayout | payload | padding | EventExtendedItemLayout[n] | data of item 0 | padding | data of item 1...
+//   The data pointers of items are offsets from the beginning of the copy. Copies must be kStoredEventAlignment
+//   aligned (so must be their sizes, if they are stored back to back)
+constexpr size_t kStoredEventAlignment = 8;
+
+size_t GetStoredEventSize (const EventView& event);
+
+// pDestination must have room for GetStoredEventSize (event) bytes
+void StoreEvent (const EventView& event, void* pDestination);
+
+// The copy in pStored refers to the original payload and extended data, so its pointers are fixed up in pRecordOut
+//   (and the extended data items in pExtendedDataOut). The returned view refers to these, and to pStored
+EventView LoadStoredEvent (const void* pStored,
+                           EventRecordLayout* pRecordOut,
+                           std::vector<EventExtendedItemLayout>* pExtendedDataOut);
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_STORED_EVENT_HPP
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "TriggerRules.hpp"
+
+#include <algorithm>
+
+#include "OS/ETW/ETWConstants.hpp"
+
+#include "Utility/Asserts.hpp"
+
+namespace ETWP {
+
+bool TriggerRule::IsEnabled () const
+{
+    return minSampleRate != 0;
+}
+
+SlidingWindowCounter::SlidingWindowCounter (): m_buckets (), m_current (0), m_sum (0)
+{
+}
+
+void SlidingWindowCounter::Add (uint32_t count /*= 1*/)
+{
+    m_buckets[m_current] += count;
+    m_sum += count;
+}
+
+void SlidingWindowCounter::Advance (uint64_t nBuckets)
+{
+    // Advancing by kBuckets (or more) empties the whole window
+    const uint32_t nSteps = static_cast<uint32_t> (std::min<uint64_t> (nBuckets, kBuckets));
+    for (uint32_t i = 0; i < nSteps; ++i) {
+        m_current = (m_current + 1) % kBuckets;
+        m_sum -= m_buckets[m_current];
+        m_buckets[m_current] = 0;
+    }
+}
+
+uint64_t SlidingWindowCounter::GetSum () const
+{
+    return m_sum;
+}
+
+TriggerRuleEngine::TriggerRuleEngine (const TriggerRule& rule, int64_t perfFreq):
+    m_bucketTicks (std::max<int64_t> (int64_t (rule.rateWindow) * perfFreq / 1'000 / SlidingWindowCounter::kBuckets,
+                                      1)),
+    m_startDelayTicks (int64_t (rule.startDelay) * perfFreq / 1'000),
+    m_stopDelayTicks (int64_t (rule.stopDelay) * perfFreq / 1'000),
+    m_minSamplesInWindow (std::max<uint64_t> (uint64_t (rule.minSampleRate) * rule.rateWindow / 1'000, 1)),
+    m_bucketEnd (0),
+    m_processes (),
+    m_nPersisting (0),
+    m_stats ()
+{
+}
+
+void TriggerRuleEngine::AdvanceTo (int64_t timeStamp)
+{
+    if (m_bucketEnd == 0) {
+        m_bucketEnd = timeStamp + m_bucketTicks;
+
+        return;
+    }
+
+    // After kBuckets buckets without samples, nothing changes in the counters, and the processes that remained are
+    //   persisting, waiting for stopDelay to pass. So the time in between can be skipped
+    uint32_t nBucketsEnded = 0;
+    while (timeStamp >= m_bucketEnd) {
+        if (++nBucketsEnded > SlidingWindowCounter::kBuckets) {
+            const int64_t nSkipped = (timeStamp - m_bucketEnd) / m_bucketTicks;
+            m_bucketEnd += nSkipped * m_bucketTicks;
+        }
+
+        EndBucket ();
+        m_bucketEnd += m_bucketTicks;
+    }
+}
+
+void TriggerRuleEngine::AddSample (DWORD pid, int64_t timeStamp)
+{
+    AdvanceTo (timeStamp);
+
+    auto [it, inserted] = m_processes.try_emplace (pid);
+    if (inserted)
+        m_stats.nProcessesHighWaterMark = std::max (m_stats.nProcessesHighWaterMark, m_processes.size ());
+
+    it->second.samples.Add ();
+    ++m_stats.nSamples;
+}
+
+bool TriggerRuleEngine::IsPersisting () const
+{
+    return m_nPersisting > 0;
+}
+
+TriggerRuleEngine::Stats TriggerRuleEngine::GetStats () const
+{
+    return m_stats;
+}
+
+void TriggerRuleEngine::EndBucket ()
+{
+    for (auto it = m_processes.begin (); it != m_processes.end ();) {
+        ProcessState& process = it->second;
+        Evaluate (&process);
+        process.samples.Advance (1);
+
+        if (process.state == State::Idle && process.samples.GetSum () == 0)
+            it = m_processes.erase (it);
+        else
+            ++it;
+    }
+}
+
+void TriggerRuleEngine::Evaluate (ProcessState* pProcess)
+{
+    const bool above = pProcess->samples.GetSum () >= m_minSamplesInWindow;
+    const bool conditionMet = pProcess->state == State::Idle ? above : !above;
+    if (!conditionMet) {
+        pProcess->conditionSince = 0;
+
+        return;
+    }
+
+    if (pProcess->conditionSince == 0)
+        pProcess->conditionSince = m_bucketEnd;
+
+    if (pProcess->state == State::Idle) {
+        if (m_bucketEnd - pProcess->conditionSince < m_startDelayTicks)
+            return;
+
+        pProcess->state = State::Persisting;
+        if (m_nPersisting++ == 0)
+            ++m_stats.nActivations;
+    } else {
+        if (m_bucketEnd - pProcess->conditionSince < m_stopDelayTicks)
+            return;
+
+        pProcess->state = State::Idle;
+        ETWP_ASSERT (m_nPersisting > 0);
+        --m_nPersisting;
+    }
+
+    pProcess->conditionSince = 0;
+}
+
+TriggeredSink::TriggeredSink (const OutputSegmentFactory& factory, const TriggerRule& rule, int64_t perfFreq):
+    m_factory (factory),
+    m_engine (rule, perfFreq),
+    m_segment (),
+    m_segmentFailed (false),
+    m_closed (false),
+    m_rundown (),
+    m_stats (),
+    m_finisher ()
+{
+}
+
+TriggeredSink::~TriggeredSink ()
+{
+    std::wstring errorMsg;
+    Close (&errorMsg);
+}
+
+bool TriggeredSink::WriteEvent (const EventView& event)
+{
+    ETWP_ASSERT (!m_closed);
+
+    const GUID& providerID = event.GetProviderID ();
+    if (providerID == PerfInfoGuid && event.GetOpcode () == ETWConstants::SampledProfileOpcode)
+        m_engine.AddSample (event.GetProcessID (), event.GetTimestamp ());
+    else
+        m_engine.AdvanceTo (event.GetTimestamp ());
+
+    // Stacks belong to the event before them
+    if (providerID != StackWalkGuid) {
+        if (m_engine.IsPersisting () && m_segment == nullptr && !m_segmentFailed) {
+            StartSegment (event);
+        } else if (!m_engine.IsPersisting ()) {
+            if (m_segment != nullptr)
+                m_finisher.Seal (std::move (m_segment));
+
+            m_segmentFailed = false;
+        }
+    }
+
+    m_rundown.Update (event);
+
+    if (m_segment == nullptr) {
+        ++m_stats.nEventsSkipped;
+
+        return true;
+    }
+
+    ++m_stats.nEventsWritten;
+
+    return m_segment->GetSink ()->WriteEvent (event);
+}
+
+bool TriggeredSink::Close (std::wstring* pErrorOut)
+{
+    if (m_closed)
+        return true;
+
+    m_closed = true;
+
+    if (m_segment != nullptr)
+        m_finisher.Seal (std::move (m_segment));
+
+    const bool succeeded = m_finisher.Close (pErrorOut);
+    m_stats.nSegmentsFailed += m_finisher.GetNumberOfFailures ();
+
+    return succeeded;
+}
+
+TriggeredSink::Stats TriggeredSink::GetStats () const
+{
+    Stats stats = m_stats;
+    stats.engine = m_engine.GetStats ();
+
+    return stats;
+}
+
+void TriggeredSink::StartSegment (const EventView& event)
+{
+    std::wstring errorMsg;
+    m_segment = m_factory (m_stats.nSegments + 1, event.GetTimestamp (), &errorMsg);
+    if (m_segment == nullptr) {
+        m_finisher.SetError (errorMsg);
+        ++m_stats.nSegmentsFailed;
+        m_segmentFailed = true;
+
+        return;
+    }
+
+    ++m_stats.nSegments;
+    m_stats.nRundownEventsWritten += m_rundown.Write (event, m_segment->GetSink ());
+}
+
+}   // namespace ETWP
\ No newline at end of file
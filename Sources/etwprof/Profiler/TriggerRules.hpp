@@ -0,0 +1,145 @@
+#ifndef ETWP_TRIGGER_RULES_HPP
+#define ETWP_TRIGGER_RULES_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "OutputRotation.hpp"
+#include "RelogPipeline.hpp"
+
+#include "OS/ETW/EventView.hpp"
+#include "OS/Utility/OSTypes.hpp"
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Describes when the output is written: only while the sample rate of a target process is high. Persisting starts
+//   once the rate of a process stays at (or above) minSampleRate for startDelay, and stops once the rates of all
+//   processes stay below it for stopDelay
+struct TriggerRule {
+    uint32_t minSampleRate = 0;     // In samples per second, 0 means the rule is disabled
+    uint32_t startDelay = 0;        // In milliseconds
+    uint32_t stopDelay = 1'000;     // In milliseconds
+    uint32_t rateWindow = 1'000;    // In milliseconds, the sample rate is measured over this much time
+
+    bool IsEnabled () const;
+};
+
+// Counts events in a sliding time window, divided into kBuckets buckets. Counting and moving the window by a bucket
+//   are O(1), the sum of the window is kept up to date
+class SlidingWindowCounter final {
+public:
+    static constexpr uint32_t kBuckets = 10;
+
+    SlidingWindowCounter ();
+
+    void     Add (uint32_t count = 1);     // To the current (last) bucket
+    void     Advance (uint64_t nBuckets);  // The oldest buckets fall out of the window, new, empty ones are started
+    uint64_t GetSum () const;
+
+private:
+    std::array<uint32_t, kBuckets> m_buckets;
+    uint32_t                       m_current;
+    uint64_t                       m_sum;
+};
+
+// Evaluates a TriggerRule for each target process, on a stream of samples. Sample rates are checked at the end of
+//   each bucket of the window (see SlidingWindowCounter) only, so the reaction time is rateWindow / kBuckets at most.
+// Samples are attributed to processes by the process ID in their header, so they should be filtered to the target
+//   processes beforehand. Processes with no recent samples are forgotten.
+// Timestamps must not decrease
+class TriggerRuleEngine final {
+public:
+    struct Stats {
+        uint64_t nSamples;
+        uint32_t nActivations;      // Times persisting started
+        size_t   nProcessesHighWaterMark;
+    };
+
+    // perfFreq is the frequency of timestamps
+    TriggerRuleEngine (const TriggerRule& rule, int64_t perfFreq);
+
+    void AdvanceTo (int64_t timeStamp);
+    void AddSample (DWORD pid, int64_t timeStamp);  // Advances, too
+
+    bool IsPersisting () const;
+    Stats GetStats () const;
+
+private:
+    enum class State : uint8_t {
+        Idle,
+        Persisting
+    };
+
+    struct ProcessState {
+        SlidingWindowCounter samples;
+        State                state = State::Idle;
+        int64_t              conditionSince = 0;    // Since when the rate has been above (when idle), or below (when
+                                                    //   persisting) the threshold, 0 if it hasn't
+    };
+
+    int64_t                                   m_bucketTicks;
+    int64_t                                   m_startDelayTicks;
+    int64_t                                   m_stopDelayTicks;
+    uint64_t                                  m_minSamplesInWindow;
+    int64_t                                   m_bucketEnd;    // 0 until the first timestamp
+    std::unordered_map<DWORD, ProcessState>   m_processes;
+    uint32_t                                  m_nPersisting;  // Processes in Persisting state
+    Stats                                     m_stats;
+
+    void EndBucket ();
+    void Evaluate (ProcessState* pProcess);
+};
+
+// Writes events into output segments (see OutputSegmentFactory) while a TriggerRule says so: every period of
+//   persisting is a segment on its own, starting with a rundown of the processes, threads and images seen so far (see
+//   RundownState). Events outside of these periods are skipped. StackWalk events never start or end a period, so
+//   stacks are not separated from their events.
+// Segments are finished on a background thread (see SegmentFinisher). If a segment cannot be created, the events of
+//   that period are skipped.
+// Not thread safe: WriteEvent and Close must be called from the same thread
+class TriggeredSink final : public IEventSink {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (TriggeredSink);
+
+    struct Stats {
+        TriggerRuleEngine::Stats engine;
+        uint32_t                 nSegments;
+        uint32_t                 nSegmentsFailed;       // Could not be created or finished
+        uint64_t                 nEventsWritten;        // Excluding rundown events
+        uint64_t                 nEventsSkipped;
+        uint64_t                 nRundownEventsWritten;
+    };
+
+    // perfFreq is the frequency of event timestamps
+    TriggeredSink (const OutputSegmentFactory& factory, const TriggerRule& rule, int64_t perfFreq);
+    ~TriggeredSink ();  // Calls Close, if it was not called
+
+    virtual bool WriteEvent (const EventView& event) override;
+
+    // Finishes the current segment (if any), then waits until all segments are finished. Returns the first error,
+    //   if any
+    bool Close (std::wstring* pErrorOut);
+
+    Stats GetStats () const;    // nSegmentsFailed is final after Close only
+
+private:
+    OutputSegmentFactory            m_factory;
+    TriggerRuleEngine               m_engine;
+    std::unique_ptr<IOutputSegment> m_segment;
+    bool                            m_segmentFailed;    // For the current period of persisting
+    bool                            m_closed;
+    RundownState                    m_rundown;
+    Stats                           m_stats;
+    SegmentFinisher                 m_finisher;
+
+    void StartSegment (const EventView& event);
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_TRIGGER_RULES_HPP
\ No newline at end of file
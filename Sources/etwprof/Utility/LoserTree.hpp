@@ -0,0 +1,150 @@
+#ifndef ETWP_LOSER_TREE_HPP
+#define ETWP_LOSER_TREE_HPP
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace ETWP {
+
+// Tournament tree of losers, for merging k sorted sources: each internal node stores the source that lost the match
+//   played there, the overall winner is stored separately. After the head of the winning source is consumed, only the
+//   matches on the path of that source (log2 (k) of them) have to be replayed, against the stored losers.
+// Sources are identified by indices. Ties are broken in favor of the source with the lower index, so merging is
+//   stable (and deterministic)
+template<typename Key>
+class LoserTree final {
+public:
+    static constexpr size_t kNoWinner = static_cast<size_t> (-1);
+
+    explicit LoserTree (size_t nSources);
+
+    size_t GetNumberOfSources () const;
+
+    // Sources start exhausted. Set the first keys of the non-empty ones, then call Build
+    void SetKey (size_t source, const Key& key);
+    void Build ();
+
+    // Returns kNoWinner if every source is exhausted
+    size_t     GetWinner () const;
+    const Key& GetWinnerKey () const;
+
+    // Call one of these after consuming the head of the winning source
+    void ReplaceWinnerKey (const Key& key);
+    void RemoveWinner ();       // The winning source is exhausted
+
+private:
+    size_t              m_nSources;
+    std::vector<size_t> m_losers;   // Indexed by internal nodes (1..m_nSources - 1), the root is 1
+    size_t              m_winner;
+    std::vector<Key>    m_keys;
+    std::vector<bool>   m_exhausted;
+
+    bool Beats (size_t lhs, size_t rhs) const;
+    void Replay ();
+};
+
+template<typename Key>
+LoserTree<Key>::LoserTree (size_t nSources):
+    m_nSources (nSources),
+    m_losers (nSources, kNoWinner),
+    m_winner (kNoWinner),
+    m_keys (nSources),
+    m_exhausted (nSources, true)
+{
+}
+
+template<typename Key>
+size_t LoserTree<Key>::GetNumberOfSources () const
+{
+    return m_nSources;
+}
+
+template<typename Key>
+void LoserTree<Key>::SetKey (size_t source, const Key& key)
+{
+    m_keys[source] = key;
+    m_exhausted[source] = false;
+}
+
+template<typename Key>
+void LoserTree<Key>::Build ()
+{
+    if (m_nSources == 0)
+        return;
+
+    // Leaves are nodes m_nSources..2 * m_nSources - 1, the parent of node i is i / 2. Winners of the matches are
+    //   needed only while building
+    std::vector<size_t> winners (2 * m_nSources);
+    for (size_t source = 0; source < m_nSources; ++source)
+        winners[m_nSources + source] = source;
+
+    for (size_t node = m_nSources - 1; node >= 1; --node) {
+        const size_t lhs = winners[2 * node];
+        const size_t rhs = winners[2 * node + 1];
+        const bool lhsWins = Beats (lhs, rhs);
+
+        winners[node] = lhsWins ? lhs : rhs;
+        m_losers[node] = lhsWins ? rhs : lhs;
+    }
+
+    m_winner = m_nSources == 1 ? 0 : winners[1];
+    if (m_exhausted[m_winner])
+        m_winner = kNoWinner;
+}
+
+template<typename Key>
+size_t LoserTree<Key>::GetWinner () const
+{
+    return m_winner;
+}
+
+template<typename Key>
+const Key& LoserTree<Key>::GetWinnerKey () const
+{
+    return m_keys[m_winner];
+}
+
+template<typename Key>
+void LoserTree<Key>::ReplaceWinnerKey (const Key& key)
+{
+    m_keys[m_winner] = key;
+    Replay ();
+}
+
+template<typename Key>
+void LoserTree<Key>::RemoveWinner ()
+{
+    m_exhausted[m_winner] = true;
+    Replay ();
+}
+
+template<typename Key>
+bool LoserTree<Key>::Beats (size_t lhs, size_t rhs) const
+{
+    if (m_exhausted[lhs] || m_exhausted[rhs])
+        return !m_exhausted[lhs] || (m_exhausted[rhs] && lhs < rhs);
+
+    if (m_keys[lhs] < m_keys[rhs])
+        return true;
+    else if (m_keys[rhs] < m_keys[lhs])
+        return false;
+    else
+        return lhs < rhs;
+}
+
+template<typename Key>
+void LoserTree<Key>::Replay ()
+{
+    size_t winner = m_winner;
+    for (size_t node = (m_nSources + winner) / 2; node >= 1; node /= 2) {
+        if (Beats (m_losers[node], winner))
+            std::swap (m_losers[node], winner);
+    }
+
+    m_winner = m_exhausted[winner] ? kNoWinner : winner;
+}
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_LOSER_TREE_HPP
\ No newline at end of file
@@ -0,0 +1,167 @@
+#ifndef ETWP_TIMER_WHEEL_HPP
+#define ETWP_TIMER_WHEEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ETWP {
+
+// Hierarchical timer wheel (the "classic" cascading scheme of the Linux kernel), driven by caller supplied timestamps
+//   instead of a clock, so the same input always expires the same entries at the same point.
+// Time is divided into ticks (of the resolution passed to the constructor). The lowest level has a slot for each of
+//   the next kSlots ticks, each level above has a slot for kSlots ticks of the level below. An entry is put into the
+//   lowest level that covers its expiry time, and it's moved one level down ("cascaded") when the wheel below it
+//   wraps around. Scheduling is O(1), and every entry is moved at most kLevels times before it expires.
+// Entries expire at most one tick late, but never early. Advancing over an empty wheel is O(1), otherwise it's
+//   proportional to the number of ticks elapsed, so the resolution should be chosen accordingly.
+// Timestamps are expected to be non-negative
+template<typename Entry>
+class TimerWheel final {
+public:
+    static constexpr uint32_t kSlotBits = 6;
+    static constexpr uint32_t kSlots = 1 << kSlotBits;
+    static constexpr uint32_t kLevels = 4;
+
+    explicit TimerWheel (int64_t resolution);
+
+    // Entries with an expiry time that has already been passed expire on the next call to Advance. Until Advance is
+    //   called first, the wheel is at the expiry time of the first entry (so entries scheduled before that with an
+    //   earlier expiry time expire at that point)
+    void Schedule (int64_t expiryTime, const Entry& entry);
+
+    // Calls onExpired (const Entry&) for every entry that expired by now, in the order of their expiry (ticks)
+    template<typename OnExpired>
+    void Advance (int64_t now, OnExpired&& onExpired);
+
+    size_t GetSize () const;
+    bool   IsEmpty () const;
+
+private:
+    static constexpr uint64_t kMaxDelta = (uint64_t (1) << (kSlotBits * kLevels)) - 1;
+
+    struct Node {
+        uint64_t expiryTick;
+        Entry    entry;
+    };
+
+    int64_t           m_resolution;
+    bool              m_started;
+    uint64_t          m_nextTick;   // The next tick to be processed by Advance
+    size_t            m_size;
+    std::vector<Node> m_slots[kLevels][kSlots];
+    std::vector<Node> m_processed;  // Reused, so slots can be emptied before their nodes are processed
+
+    void Insert (const Node& node);
+    void Cascade (uint32_t level);
+};
+
+template<typename Entry>
+TimerWheel<Entry>::TimerWheel (int64_t resolution):
+    m_resolution (resolution > 0 ? resolution : 1),
+    m_started (false),
+    m_nextTick (0),
+    m_size (0),
+    m_slots (),
+    m_processed ()
+{
+}
+
+template<typename Entry>
+void TimerWheel<Entry>::Schedule (int64_t expiryTime, const Entry& entry)
+{
+    // Rounded up, so entries never expire early
+    const uint64_t expiryTick = (uint64_t (expiryTime) + m_resolution - 1) / m_resolution;
+
+    // Without this, the first entry scheduled at a large timestamp (e.g. QPC ticks since boot) would have to be
+    //   cascaded through all the ticks since zero
+    if (!m_started) {
+        m_started = true;
+        m_nextTick = expiryTick;
+    }
+
+    Insert ({ expiryTick, entry });
+    ++m_size;
+}
+
+template<typename Entry>
+template<typename OnExpired>
+void TimerWheel<Entry>::Advance (int64_t now, OnExpired&& onExpired)
+{
+    const uint64_t nowTick = uint64_t (now) / m_resolution;
+    m_started = true;
+
+    while (m_nextTick <= nowTick) {
+        if (m_size == 0) {
+            m_nextTick = nowTick + 1;
+
+            break;
+        }
+
+        const uint32_t index = m_nextTick & (kSlots - 1);
+        if (index == 0) {
+            // The lowest level wrapped around: bring down the entries of the next kSlots ticks from the level above,
+            //   and so on, as long as the levels above wrap around as well
+            for (uint32_t level = 1; level < kLevels; ++level) {
+                Cascade (level);
+                if (((m_nextTick >> (kSlotBits * level)) & (kSlots - 1)) != 0)
+                    break;
+            }
+        }
+
+        std::swap (m_processed, m_slots[0][index]);
+        m_size -= m_processed.size ();
+        for (const Node& node : m_processed)
+            onExpired (node.entry);
+
+        m_processed.clear ();
+        ++m_nextTick;
+    }
+}
+
+template<typename Entry>
+size_t TimerWheel<Entry>::GetSize () const
+{
+    return m_size;
+}
+
+template<typename Entry>
+bool TimerWheel<Entry>::IsEmpty () const
+{
+    return m_size == 0;
+}
+
+template<typename Entry>
+void TimerWheel<Entry>::Insert (const Node& node)
+{
+    const uint64_t tick = node.expiryTick > m_nextTick ? node.expiryTick : m_nextTick;
+    const uint64_t delta = tick - m_nextTick;
+
+    for (uint32_t level = 0; level < kLevels - 1; ++level) {
+        if (delta < (uint64_t (1) << (kSlotBits * (level + 1)))) {
+            m_slots[level][(tick >> (kSlotBits * level)) & (kSlots - 1)].push_back (node);
+
+            return;
+        }
+    }
+
+    // Entries beyond the range of the wheel are parked in the farthest slot of the top level, they are put back there
+    //   on every cascade, until they get into range
+    const uint64_t topTick = delta > kMaxDelta ? m_nextTick + kMaxDelta : tick;
+    m_slots[kLevels - 1][(topTick >> (kSlotBits * (kLevels - 1))) & (kSlots - 1)].push_back (node);
+}
+
+template<typename Entry>
+void TimerWheel<Entry>::Cascade (uint32_t level)
+{
+    std::swap (m_processed, m_slots[level][(m_nextTick >> (kSlotBits * level)) & (kSlots - 1)]);
+    for (const Node& node : m_processed)
+        Insert (node);
+
+    m_processed.clear ();
+}
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_TIMER_WHEEL_HPP
\ No newline at end of file
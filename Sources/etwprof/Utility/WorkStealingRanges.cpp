@@ -0,0 +1,95 @@
+#include "WorkStealingRanges.hpp"
+
+namespace ETWP {
+
+namespace {
+
+constexpr uint64_t Pack (uint32_t begin, uint32_t end)
+{
+    return uint64_t (begin) << 32 | end;
+}
+
+constexpr uint32_t GetBegin (uint64_t range)
+{
+    return static_cast<uint32_t> (range >> 32);
+}
+
+constexpr uint32_t GetEnd (uint64_t range)
+{
+    return static_cast<uint32_t> (range);
+}
+
+}   // namespace
+
+WorkStealingRanges::WorkStealingRanges (uint32_t nItems, uint32_t nWorkers):
+    m_ranges (new Range[nWorkers]),
+    m_nWorkers (nWorkers),
+    m_nSteals (0)
+{
+    for (uint32_t worker = 0; worker < nWorkers; ++worker) {
+        const uint32_t begin = static_cast<uint32_t> (uint64_t (nItems) * worker / nWorkers);
+        const uint32_t end = static_cast<uint32_t> (uint64_t (nItems) * (worker + 1) / nWorkers);
+        m_ranges[worker].beginAndEnd.store (Pack (begin, end), std::memory_order_relaxed);
+    }
+}
+
+bool WorkStealingRanges::Take (uint32_t worker, uint32_t* pItemOut)
+{
+    std::atomic<uint64_t>& ownRange = m_ranges[worker].beginAndEnd;
+
+    uint64_t range = ownRange.load (std::memory_order_relaxed);
+    while (GetBegin (range) < GetEnd (range)) {
+        if (ownRange.compare_exchange_weak (range, Pack (GetBegin (range) + 1, GetEnd (range)))) {
+            *pItemOut = GetBegin (range);
+
+            return true;
+        }
+    }
+
+    return Steal (worker, pItemOut);
+}
+
+uint64_t WorkStealingRanges::GetNumberOfSteals () const
+{
+    return m_nSteals.load (std::memory_order_relaxed);
+}
+
+bool WorkStealingRanges::Steal (uint32_t thief, uint32_t* pItemOut)
+{
+    // A non-empty range never becomes non-empty again with the same begin and end (items are handed out only once),
+    //   so there is no ABA problem with the CASes below
+    for (;;) {
+        uint32_t victim = m_nWorkers;
+        uint64_t victimRange = 0;
+        uint32_t biggestSize = 0;
+        for (uint32_t worker = 0; worker < m_nWorkers; ++worker) {
+            const uint64_t range = m_ranges[worker].beginAndEnd.load (std::memory_order_relaxed);
+            if (worker != thief && GetEnd (range) - GetBegin (range) > biggestSize) {
+                victim = worker;
+                victimRange = range;
+                biggestSize = GetEnd (range) - GetBegin (range);
+            }
+        }
+
+        if (victim == m_nWorkers)
+            return false;
+
+        // The victim keeps the front half (at least one item, if it's a single one, it's taken as a whole)
+        const uint32_t stolenBegin = GetBegin (victimRange) + biggestSize / 2;
+        const uint32_t stolenEnd = GetEnd (victimRange);
+        if (!m_ranges[victim].beginAndEnd.compare_exchange_strong (victimRange,
+                                                                  Pack (GetBegin (victimRange), stolenBegin)))
+        {
+            continue;   // The victim (or another thief) was faster, try again
+        }
+
+        // Our own range is empty, so nobody else modifies it
+        m_ranges[thief].beginAndEnd.store (Pack (stolenBegin + 1, stolenEnd));
+        m_nSteals.fetch_add (1, std::memory_order_relaxed);
+        *pItemOut = stolenBegin;
+
+        return true;
+    }
+}
+
+}   // namespace ETWP
\ No newline at end of file
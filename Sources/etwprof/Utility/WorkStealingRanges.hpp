@@ -0,0 +1,45 @@
+#ifndef ETWP_WORK_STEALING_RANGES_HPP
+#define ETWP_WORK_STEALING_RANGES_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "Utility/Macros.hpp"
+
+namespace ETWP {
+
+// Distributes the items [0, nItems) among workers: each worker gets a contiguous range of items, and takes them from
+//   its front. A worker whose range is empty steals the back half of the biggest range of the other workers, so
+//   workers stay busy even if items take very different amounts of time. Ranges are single atomic words (begin and
+//   end packed together), so both taking and stealing are a single CAS.
+// Worker w may call Take (w) from one thread at a time. Each item is handed out exactly once
+class WorkStealingRanges final {
+public:
+    ETWP_DISABLE_COPY_AND_MOVE (WorkStealingRanges);
+
+    WorkStealingRanges (uint32_t nItems, uint32_t nWorkers);
+
+    // Returns false if there are no items left (for anyone)
+    bool Take (uint32_t worker, uint32_t* pItemOut);
+
+    uint64_t GetNumberOfSteals () const;
+
+private:
+    static constexpr size_t kCacheLineSize = 64;
+
+    struct alignas (kCacheLineSize) Range {
+        std::atomic<uint64_t> beginAndEnd;
+    };
+
+    std::unique_ptr<Range[]> m_ranges;
+    uint32_t                 m_nWorkers;
+    std::atomic<uint64_t>    m_nSteals;
+
+    bool Steal (uint32_t thief, uint32_t* pItemOut);
+};
+
+}   // namespace ETWP
+
+#endif  // #ifndef ETWP_WORK_STEALING_RANGES_HPP
\ No newline at end of file